@@ -0,0 +1,60 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib, { type RegistryValue, type RegistryValueType } from '../src/index.js';
+import { closeSync, openSync } from 'node:fs';
+import { devNull } from 'node:os';
+
+// one value of each kind, read 1,000 times per iteration with get(), and a key with 10,000 values
+// of every kind decoded by scan() and exportTree()
+const root = 'HKCU\\Software\\winreglib\\bench-codec';
+const values: [string, RegistryValue, RegistryValueType][] = [
+	['sz', 'x'.repeat(256), 'REG_SZ'],
+	['multi', Array.from({ length: 16 }, (_, i) => `string-${i}`), 'REG_MULTI_SZ'],
+	['dword', 0xdeadbeef, 'REG_DWORD'],
+	['be', 0xdeadbeef, 'REG_DWORD_BIG_ENDIAN'],
+	['qword', 0xfedcba9876543210n, 'REG_QWORD'],
+	['binary', Buffer.alloc(1024, 1), 'REG_BINARY']
+];
+const count = 10_000;
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		values.map(([name, value, type]) => ({ op: 'set' as const, key: root, name, value, type }))
+	);
+	winreglib.batch(
+		Array.from({ length: count }, (_, i) => {
+			const [name, value, type] = values[i % values.length];
+			return { op: 'set' as const, key: `${root}\\many`, name: `${name}-${i}`, value, type };
+		})
+	);
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe('get() 1,000 times', () => {
+	for (const [name, , type] of values) {
+		bench(type, () => {
+			for (let i = 0; i < 1_000; i++) {
+				winreglib.get(root, name);
+			}
+		});
+	}
+});
+
+describe(`${count} mixed values`, () => {
+	bench('scan()', async () => {
+		await winreglib.scan(`${root}\\many`);
+	});
+
+	bench('exportTree()', async () => {
+		const fd = openSync(devNull, 'w');
+		try {
+			await winreglib.exportTree(`${root}\\many`, fd);
+		} finally {
+			closeSync(fd);
+		}
+	});
+});
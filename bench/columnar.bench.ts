@@ -0,0 +1,102 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+import { PerformanceObserver } from 'node:perf_hooks';
+
+// a key with 50,000 values and a tree of 10,000 keys with 4 values each, read as objects and as
+// columns. The time spent in garbage collection pauses while reading each one 20 times, keeping
+// the last few results alive like a caller that holds on to them, is reported up front.
+const root = 'HKCU\\Software\\winreglib\\bench-columnar';
+const wide = `${root}\\wide`;
+const tree = `${root}\\tree`;
+const pattern = `${tree}\\**`;
+const values = ['*'];
+
+/**
+ * Returns the total duration of the garbage collection pauses while calling `fn` repeatedly.
+ */
+const gcPause = async (fn: () => unknown): Promise<number> => {
+	let total = 0;
+	const observer = new PerformanceObserver(list => {
+		for (const entry of list.getEntries()) {
+			total += entry.duration;
+		}
+	});
+	observer.observe({ entryTypes: ['gc'] });
+
+	const kept: unknown[] = [];
+	for (let i = 0; i < 20; i++) {
+		kept.push(await fn());
+		if (kept.length > 4) {
+			kept.shift();
+		}
+	}
+
+	// entries are delivered asynchronously
+	await new Promise(resolve => setTimeout(resolve, 10));
+	observer.disconnect();
+	return total;
+};
+
+beforeAll(async () => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		Array.from({ length: 50_000 }, (_, i) => ({
+			op: 'set' as const,
+			key: wide,
+			name: `value-${i}`,
+			value: i
+		}))
+	);
+	winreglib.batch(
+		Array.from({ length: 10_000 }, (_, i) => [
+			{ op: 'set' as const, key: `${tree}\\${i % 100}\\key-${i}`, name: 'Name', value: `Key ${i}` },
+			{ op: 'set' as const, key: `${tree}\\${i % 100}\\key-${i}`, name: 'Path', value: `C:\\Program Files\\${i}` },
+			{ op: 'set' as const, key: `${tree}\\${i % 100}\\key-${i}`, name: 'Size', value: i },
+			{ op: 'set' as const, key: `${tree}\\${i % 100}\\key-${i}`, name: 'Tags', value: ['a', 'b'] }
+		]).flat()
+	);
+
+	const results = {
+		'list()': await gcPause(() => winreglib.list(wide)),
+		'list() columnar': await gcPause(() => winreglib.list(wide, { columnar: true })),
+		'query()': await gcPause(() => winreglib.query(pattern, { values })),
+		'query() columnar': await gcPause(() =>
+			winreglib.query(pattern, { values, columnar: true })
+		)
+	};
+	for (const [name, pause] of Object.entries(results)) {
+		console.log(`${name}: ${pause.toFixed(1)} ms of GC pauses`);
+	}
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe('list() a key with 50,000 values', () => {
+	bench('objects', () => {
+		winreglib.list(wide);
+	});
+
+	bench('columnar', () => {
+		winreglib.list(wide, { columnar: true });
+	});
+});
+
+describe('query() 10,000 keys with 4 values each', () => {
+	bench('objects', async () => {
+		await winreglib.query(pattern, { values });
+	});
+
+	bench('columnar', async () => {
+		await winreglib.query(pattern, { values, columnar: true });
+	});
+
+	bench('columnar, reading every value', async () => {
+		const { rows } = await winreglib.query(pattern, { values, columnar: true });
+		for (let i = 0; i < rows.valueNames.length; i++) {
+			rows.value(i);
+		}
+	});
+});
@@ -0,0 +1,47 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+
+// 100 keys of 1,000 subkeys each with one value that differ in a single value, so the diff only
+// has to descend into one of the 100,100 keys
+const root = 'HKCU\\Software\\winreglib\\bench-diff';
+const width = 100;
+const subkeys = 1_000;
+
+let before: Buffer;
+let after: Buffer;
+
+beforeAll(async () => {
+	winreglib.setBackend('memory');
+	for (let i = 0; i < width; i++) {
+		winreglib.batch(
+			Array.from({ length: subkeys }, (_, j) => ({
+				op: 'set' as const,
+				key: `${root}\\${i}\\${j}`,
+				name: 'value',
+				value: j
+			}))
+		);
+	}
+	before = await winreglib.fingerprint(root);
+	winreglib.set(`${root}\\${width / 2}\\${subkeys / 2}`, 'value', -1);
+	after = await winreglib.fingerprint(root);
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe(`${width * subkeys + width} keys`, () => {
+	bench('fingerprint()', async () => {
+		await winreglib.fingerprint(root);
+	});
+
+	bench('diff() snapshots', async () => {
+		await winreglib.diff(before, after);
+	});
+
+	bench('diff() snapshot and live key', async () => {
+		await winreglib.diff(before, root);
+	});
+});
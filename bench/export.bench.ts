@@ -0,0 +1,80 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+import { closeSync, openSync, writeSync } from 'node:fs';
+import { devNull } from 'node:os';
+import { Writable } from 'node:stream';
+
+// a synthetic tree in the in-memory backend, 10 keys wide and 3 levels deep with 20 values per key
+const root = 'HKCU\\Software\\winreglib\\bench-export';
+const width = 10;
+const depth = 3;
+const valuesPerKey = 20;
+
+let fd: number;
+
+// the baseline walks the tree with list() and get() and serializes each key in JavaScript
+const exportInJs = (key: string) => {
+	const { subkeys, values } = winreglib.list(key);
+	const record = {
+		key,
+		values: values.map(name => ({ name, data: winreglib.get(key, name) }))
+	};
+	writeSync(
+		fd,
+		`${JSON.stringify(record, (_, v) => (typeof v === 'bigint' ? v.toString() : v))}\n`
+	);
+	for (const subkey of subkeys) {
+		exportInJs(`${key}\\${subkey}`);
+	}
+};
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	const ops: Parameters<typeof winreglib.batch>[0] = [];
+	const populate = (key: string, level: number) => {
+		for (let i = 0; i < valuesPerKey; i++) {
+			ops.push({ op: 'set', key, name: `string-${i}`, value: `value ${i} of ${key}` });
+			ops.push({ op: 'set', key, name: `number-${i}`, value: i });
+			ops.push({ op: 'set', key, name: `binary-${i}`, value: Buffer.alloc(16, i) });
+		}
+		if (level < depth) {
+			for (let i = 0; i < width; i++) {
+				populate(`${key}\\subkey-${i}`, level + 1);
+			}
+		}
+	};
+	populate(root, 0);
+	winreglib.batch(ops);
+	fd = openSync(devNull, 'w');
+});
+
+afterAll(() => {
+	closeSync(fd);
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe(`export ${(width ** (depth + 1) - 1) / (width - 1)} keys`, () => {
+	bench('list() + get() + JSON.stringify()', () => {
+		exportInJs(root);
+	});
+
+	bench('exportTree() ndjson', async () => {
+		await winreglib.exportTree(root, fd);
+	});
+
+	bench('exportTree() binary', async () => {
+		await winreglib.exportTree(root, fd, { format: 'binary' });
+	});
+
+	bench('exportTree() ndjson to a stream', async () => {
+		await winreglib.exportTree(
+			root,
+			new Writable({
+				write(_chunk, _encoding, callback) {
+					callback();
+				}
+			})
+		);
+	});
+});
@@ -0,0 +1,64 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import winreglib, {
+	type Journal,
+	type WinRegLibWatchHandle
+} from '../src/index.js';
+
+// a service watching 1,000 keys with 10 values each restarts after 100 of them changed: catching
+// up from the journal against rescanning the tree
+const root = 'HKCU\\Software\\winreglib\\bench-journal';
+const keys = Array.from({ length: 1_000 }, (_, i) => `${root}\\key-${i}`);
+const dir = mkdtempSync(join(tmpdir(), 'winreglib-journal-'));
+const settle = () => new Promise(resolve => setTimeout(resolve, 100));
+
+let journal: Journal;
+let handles: WinRegLibWatchHandle[];
+
+beforeAll(async () => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		keys.flatMap(key =>
+			Array.from({ length: 10 }, (_, i) => ({
+				op: 'set' as const,
+				key,
+				name: `value-${i}`,
+				value: i
+			}))
+		)
+	);
+
+	journal = winreglib.openJournal(dir, { fsync: 'never', values: true });
+	handles = keys.map(key => winreglib.watch(key));
+	for (let round = 0; round < 10; round++) {
+		await settle();
+		winreglib.batch(
+			keys
+				.filter((_, i) => i % 100 === round)
+				.map(key => ({ op: 'set' as const, key, name: 'value-0', value: round }))
+		);
+	}
+	await settle();
+});
+
+afterAll(() => {
+	for (const handle of handles) {
+		handle.stop();
+	}
+	journal.close();
+	rmSync(dir, { recursive: true });
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe('catch up after 100 of 1,000 watched keys changed', () => {
+	bench('readSince()', () => {
+		journal.readSince(0);
+	});
+
+	bench('scan()', async () => {
+		await winreglib.scan(root);
+	});
+});
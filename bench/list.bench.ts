@@ -0,0 +1,79 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+
+// the in-memory backend keeps the registry out of the measurement so that only the cost of
+// building the JavaScript arrays is compared
+const sizes = [10, 1_000, 100_000];
+const root = 'HKCU\\Software\\winreglib\\bench-list';
+const push = Array.prototype.push;
+
+/**
+ * Builds an array the way list() and get() did before they preallocated it, calling `push()` for
+ * every element like the old napi_call_function() loop.
+ */
+const pushed = (names: string[]) => {
+	const result: string[] = [];
+	for (const name of names) {
+		push.call(result, name);
+	}
+	return result;
+};
+
+/**
+ * Builds an array allocated to its final length up front, like napi_create_array_with_length()
+ * and napi_set_element().
+ */
+const preallocated = (names: string[]) => {
+	const result: string[] = new Array(names.length);
+	for (let i = 0; i < names.length; i++) {
+		result[i] = names[i];
+	}
+	return result;
+};
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	for (const size of sizes) {
+		const key = `${root}\\${size}`;
+		const ops = [];
+		for (let i = 0; i < size; i++) {
+			ops.push({ op: 'createKey' as const, key: `${key}\\subkey-${i}` });
+			ops.push({ op: 'set' as const, key, name: `value-${i}`, value: i });
+		}
+		ops.push({
+			op: 'set' as const,
+			key,
+			name: 'multi',
+			value: Array.from({ length: size }, (_, i) => `string-${i}`)
+		});
+		winreglib.batch(ops);
+	}
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+for (const size of sizes) {
+	describe(`${size} elements`, () => {
+		// the strings are created once so that only the way the array is built is compared
+		const names = Array.from({ length: size }, (_, i) => `subkey-${i}`);
+
+		bench('push()', () => {
+			pushed(names);
+		});
+
+		bench('preallocated', () => {
+			preallocated(names);
+		});
+
+		bench('list()', () => {
+			winreglib.list(`${root}\\${size}`);
+		});
+
+		bench('get() REG_MULTI_SZ', () => {
+			winreglib.get(`${root}\\${size}`, 'multi');
+		});
+	});
+}
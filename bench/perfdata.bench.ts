@@ -0,0 +1,83 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib, { type PerfSampler } from '../src/index.js';
+
+// a processor-style object with 256 instances of 20 8-byte counters, sampled with a sampler that
+// keeps its buffer and with get() and parsePerfData(), which grow a new buffer every time
+const instances = 256;
+const counters = 20;
+
+/**
+ * Builds a `PERF_DATA_BLOCK` with a single object.
+ */
+const buildPerfData = () => {
+	const header = Buffer.alloc(88);
+	header.write('PERF', 0, 'utf16le');
+	header.writeUInt32LE(1, 8);
+	header.writeUInt32LE(88, 24);
+	header.writeUInt32LE(1, 28);
+
+	const definitions = Buffer.alloc(64 + counters * 40);
+	for (let i = 0; i < counters; i++) {
+		const p = 64 + i * 40;
+		definitions.writeUInt32LE(40, p);
+		definitions.writeUInt32LE(6 + i * 2, p + 4);
+		definitions.writeUInt32LE(0x20410500, p + 28);
+		definitions.writeUInt32LE(8, p + 32);
+		definitions.writeUInt32LE(8 + i * 8, p + 36);
+	}
+
+	const body: Buffer[] = [];
+	for (let i = 0; i < instances; i++) {
+		const name = Buffer.from(`${i}\0`.padEnd(8, '\0'), 'utf16le');
+		const definition = Buffer.alloc(24 + name.length);
+		definition.writeUInt32LE(definition.length, 0);
+		definition.writeUInt32LE(24, 16);
+		definition.writeUInt32LE(name.length, 20);
+		name.copy(definition, 24);
+
+		const block = Buffer.alloc(8 + counters * 8);
+		block.writeUInt32LE(block.length, 0);
+		for (let c = 0; c < counters; c++) {
+			block.writeBigUInt64LE(BigInt(i * c) * 1000n, 8 + c * 8);
+		}
+		body.push(definition, block);
+	}
+
+	const object = Buffer.concat([definitions, ...body]);
+	object.writeUInt32LE(object.length, 0);
+	object.writeUInt32LE(definitions.length, 4);
+	object.writeUInt32LE(64, 8);
+	object.writeUInt32LE(238, 12);
+	object.writeUInt32LE(counters, 32);
+	object.writeInt32LE(instances, 40);
+
+	const result = Buffer.concat([header, object]);
+	result.writeUInt32LE(result.length, 20);
+	return result;
+};
+
+let sampler: PerfSampler;
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.set('HKEY_PERFORMANCE_DATA\\', 'Global', buildPerfData());
+	sampler = winreglib.openPerfSampler();
+});
+
+afterAll(() => {
+	sampler.close();
+	winreglib.delete('HKEY_PERFORMANCE_DATA\\', 'Global');
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe(`${instances} instances of ${counters} counters`, () => {
+	bench('sample()', () => {
+		sampler.sample();
+	});
+
+	bench('get() and parsePerfData()', () => {
+		winreglib.parsePerfData(
+			winreglib.get('HKEY_PERFORMANCE_DATA\\', 'Global') as Buffer
+		);
+	});
+});
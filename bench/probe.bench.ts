@@ -0,0 +1,47 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+
+// 1,000 probes for optional values where only 1 in 10 exists, the way settings with defaults are
+// read: get() with try/catch against the non-throwing probes
+const root = 'HKCU\\Software\\winreglib\\bench-probe';
+const names = Array.from({ length: 1_000 }, (_, i) => `option-${i}`);
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		names
+			.filter((_, i) => i % 10 === 0)
+			.map(name => ({ op: 'set' as const, key: root, name, value: name }))
+	);
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe('1,000 probes, 90% misses', () => {
+	bench('get() with try/catch', () => {
+		for (const name of names) {
+			try {
+				winreglib.get(root, name);
+			} catch {}
+		}
+	});
+
+	bench('tryGet()', () => {
+		for (const name of names) {
+			winreglib.tryGet(root, name);
+		}
+	});
+
+	bench('has()', () => {
+		for (const name of names) {
+			winreglib.has(root, name);
+		}
+	});
+
+	bench('hasMany()', () => {
+		winreglib.hasMany(root, names);
+	});
+});
@@ -0,0 +1,50 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+
+// an uninstall-style tree with 2,000 entries in both the native and WOW6432Node views, each with
+// a handful of values, read with one query() and with the equivalent list() and get() calls
+const root = 'HKCU\\Software\\winreglib\\bench-query';
+const uninstall = 'Microsoft\\Windows\\CurrentVersion\\Uninstall';
+const views = [`${root}\\${uninstall}`, `${root}\\WOW6432Node\\${uninstall}`];
+const count = 2_000;
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		views.flatMap(view =>
+			Array.from({ length: count }, (_, i) => [
+				{ op: 'set' as const, key: `${view}\\app-${i}`, name: 'DisplayName', value: `App ${i}` },
+				{ op: 'set' as const, key: `${view}\\app-${i}`, name: 'DisplayVersion', value: `${i}.0` },
+				{ op: 'set' as const, key: `${view}\\app-${i}`, name: 'Publisher', value: 'winreglib' },
+				{ op: 'set' as const, key: `${view}\\app-${i}`, name: 'EstimatedSize', value: i }
+			]).flat()
+		)
+	);
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe(`${count * views.length} uninstall entries`, () => {
+	bench('query()', async () => {
+		await winreglib.query(`${root}\\{,WOW6432Node\\}${uninstall}\\*`, {
+			values: ['DisplayName', 'DisplayVersion']
+		});
+	});
+
+	bench('list() and get()', () => {
+		for (const view of views) {
+			for (const name of winreglib.list(view).subkeys) {
+				const key = `${view}\\${name}`;
+				try {
+					winreglib.get(key, 'DisplayName');
+				} catch {}
+				try {
+					winreglib.get(key, 'DisplayVersion');
+				} catch {}
+			}
+		}
+	});
+});
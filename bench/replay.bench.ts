@@ -0,0 +1,52 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+import { rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+
+// a workload of 100 keys with 10 values each, read with list() and get(), recorded once and then
+// replayed from the trace as fast as possible, loading the trace each time
+const root = 'HKCU\\Software\\winreglib\\bench-replay';
+const file = join(tmpdir(), `winreglib-bench-${process.pid}.trace`);
+
+const workload = () => {
+	for (const name of winreglib.list(root).subkeys) {
+		for (let i = 0; i < 10; i++) {
+			winreglib.get(`${root}\\${name}`, `value-${i}`);
+		}
+	}
+};
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		Array.from({ length: 1_000 }, (_, i) => ({
+			op: 'set' as const,
+			key: `${root}\\key-${Math.floor(i / 10)}`,
+			name: `value-${i % 10}`,
+			value: `data-${i}`
+		}))
+	);
+	winreglib.startRecording(file);
+	workload();
+	winreglib.stopRecording();
+});
+
+afterAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+	rmSync(file, { force: true });
+});
+
+describe('1,000 get() calls', () => {
+	bench('memory backend', () => {
+		winreglib.setBackend('memory');
+		workload();
+	});
+
+	bench('replayed trace', () => {
+		winreglib.replay(file);
+		workload();
+	});
+});
@@ -0,0 +1,42 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib, { type ScanResult } from '../src/index.js';
+
+// 100 keys of 1,000 subkeys each with 5 values; between rescans, 10 values are changed
+const root = 'HKCU\\Software\\winreglib\\bench-scan';
+const width = 100;
+const subkeys = 1_000;
+
+let previous: ScanResult;
+let counter = 0;
+
+beforeAll(async () => {
+	winreglib.setBackend('memory');
+	for (let i = 0; i < width; i++) {
+		const ops: Parameters<typeof winreglib.batch>[0] = [];
+		for (let j = 0; j < subkeys; j++) {
+			for (let v = 0; v < 5; v++) {
+				ops.push({ op: 'set', key: `${root}\\${i}\\${j}`, name: `value-${v}`, value: `data ${j}` });
+			}
+		}
+		winreglib.batch(ops);
+	}
+	previous = await winreglib.scan(root);
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe(`${width * subkeys + width} keys`, () => {
+	bench('scan()', async () => {
+		await winreglib.scan(root);
+	});
+
+	bench('rescan() with 10 changed keys', async () => {
+		for (let i = 0; i < 10; i++) {
+			winreglib.set(`${root}\\${i * 7}\\${i * 50}`, 'value-0', counter++);
+		}
+		previous = await winreglib.rescan(previous);
+	});
+});
@@ -0,0 +1,69 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib, {
+	type SharedCache,
+	type SharedCachePublisher
+} from '../src/index.js';
+
+// a config tree of 50 keys with 40 values each, read the way a process reads its config: list
+// the sections, then get the values it uses, either through the registry or a shared cache that
+// another process publishes
+const root = 'HKCU\\Software\\winreglib\\bench-shared';
+const keys = Array.from({ length: 50 }, (_, i) => `${root}\\section-${i}`);
+
+let publisher: SharedCachePublisher;
+let cache: SharedCache;
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		keys.flatMap(key =>
+			Array.from({ length: 40 }, (_, i) => ({
+				op: 'set' as const,
+				key,
+				name: `value-${i}`,
+				value: `${key} ${i}`
+			}))
+		)
+	);
+	publisher = winreglib.publishSharedCache(root, {
+		name: `bench-${process.pid}`,
+		watch: false
+	});
+	cache = winreglib.openSharedCache(`bench-${process.pid}`);
+});
+
+afterAll(() => {
+	cache.close();
+	publisher.close();
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe('list() and get() 10 values from each of 50 keys', () => {
+	bench('registry', () => {
+		for (const key of keys) {
+			winreglib.list(key);
+			for (let i = 0; i < 10; i++) {
+				winreglib.get(key, `value-${i}`);
+			}
+		}
+	});
+
+	bench('shared cache', () => {
+		for (const key of keys) {
+			cache.list(key);
+			for (let i = 0; i < 10; i++) {
+				cache.get(key, `value-${i}`);
+			}
+		}
+	});
+});
+
+describe('publish a change', () => {
+	let n = 0;
+
+	bench('set() and refresh() the key', () => {
+		winreglib.set(keys[0], 'value-0', `changed ${n++}`);
+		publisher.refresh(keys[0]);
+	});
+});
@@ -0,0 +1,37 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+
+// 1,000 gets and a list of a key with 1,000 values, with the timeline stopped and recording, to
+// show what leaving the timeline on costs
+const root = 'HKCU\\Software\\winreglib\\bench-timeline';
+const names = Array.from({ length: 1_000 }, (_, i) => `value-${i}`);
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		names.map(name => ({ op: 'set' as const, key: root, name, value: name }))
+	);
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+const workload = () => {
+	for (const name of names) {
+		winreglib.get(root, name);
+	}
+	winreglib.list(root);
+};
+
+describe('timeline stopped', () => {
+	bench('1,000 get() and list()', workload);
+});
+
+describe('timeline recording', () => {
+	beforeAll(() => winreglib.startTimeline());
+	afterAll(() => winreglib.stopTimeline());
+
+	bench('1,000 get() and list()', workload);
+});
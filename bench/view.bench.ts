@@ -0,0 +1,65 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib, { type RegistryView } from '../src/index.js';
+
+// a config tree of 50 keys with 40 values each, loaded eagerly with list() and get() the way
+// config loaders do at startup, and through a view that only reads the 10 values that are used
+const root = 'HKCU\\Software\\winreglib\\bench-view';
+const keys = Array.from({ length: 50 }, (_, i) => `section-${i}`);
+const used = keys.slice(0, 10).map(key => [key, 'value-0'] as const);
+
+let warm: RegistryView;
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		keys.flatMap(key =>
+			Array.from({ length: 40 }, (_, i) => ({
+				op: 'set' as const,
+				key: `${root}\\${key}`,
+				name: `value-${i}`,
+				value: `${key} ${i}`
+			}))
+		)
+	);
+	warm = winreglib.view(root, { watch: false });
+});
+
+afterAll(() => {
+	winreglib.closeView(warm);
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+const readUsed = (view: RegistryView) => {
+	for (const [key, name] of used) {
+		(view[key] as RegistryView)[name];
+	}
+};
+
+describe('config load, 10 of 2,000 values used', () => {
+	bench('list() and get() every value', () => {
+		const config: Record<string, Record<string, unknown>> = {};
+		for (const key of winreglib.list(root)!.subkeys) {
+			const values: Record<string, unknown> = (config[key] = {});
+			for (const name of winreglib.list(`${root}\\${key}`)!.values) {
+				values[name] = winreglib.get(`${root}\\${key}`, name);
+			}
+		}
+	});
+
+	bench('view()', () => {
+		const view = winreglib.view(root, { watch: false });
+		readUsed(view);
+		winreglib.closeView(view);
+	});
+
+	bench('view() with watching', () => {
+		const view = winreglib.view(root);
+		readUsed(view);
+		winreglib.closeView(view);
+	});
+
+	bench('cached view', () => {
+		readUsed(warm);
+	});
+});
@@ -0,0 +1,66 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib, { type WinRegLibWatchHandle } from '../src/index.js';
+
+// 100,000 existing keys spread across 100 parents. The memory a watch costs is reported once all
+// of them are watched.
+const root = 'HKCU\\Software\\winreglib\\bench-watch';
+const count = 100_000;
+const keys = Array.from({ length: count }, (_, i) => `${root}\\${i % 100}\\key-${i}`);
+
+let handles: WinRegLibWatchHandle[] = [];
+let counter = 0;
+
+const settle = () => new Promise(resolve => setTimeout(resolve, 100));
+
+beforeAll(async () => {
+	winreglib.setBackend('memory');
+	winreglib.batch(keys.map(key => ({ op: 'createKey' as const, key })));
+	await settle();
+
+	const before = process.memoryUsage().rss;
+	handles = keys.map(key => winreglib.watch(key));
+	await settle();
+	const perWatch = (process.memoryUsage().rss - before) / count;
+	console.log(`${count} watches: ${perWatch.toFixed(0)} bytes per watch`);
+});
+
+afterAll(() => {
+	for (const handle of handles) {
+		handle.stop();
+	}
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe(`${count} watched keys`, () => {
+	bench('watch() and stop() 1,000 more keys', () => {
+		const more = keys
+			.slice(0, 1_000)
+			.map(key => winreglib.watch(`${key}\\missing-${counter}`));
+		counter++;
+		for (const handle of more) {
+			handle.stop();
+		}
+	});
+
+	bench('1,000 change events', async () => {
+		let remaining = 1_000;
+		await new Promise<void>(resolve => {
+			const listener = () => {
+				if (--remaining === 0) {
+					for (let i = 0; i < 1_000; i++) {
+						handles[i * 100].off('change', listener);
+					}
+					resolve();
+				}
+			};
+			for (let i = 0; i < 1_000; i++) {
+				handles[i * 100].on('change', listener);
+			}
+			for (let i = 0; i < 1_000; i++) {
+				winreglib.set(keys[i * 100], 'value', counter);
+			}
+			counter++;
+		});
+	});
+});
@@ -0,0 +1,39 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+
+// 10,000 existing keys spread across 100 parents, watched 10 to 10,000 at a time either one
+// `watch()` per key or with a single `watchMany()`. Each run stops watching so the next one starts
+// from an empty tree.
+const root = 'HKCU\\Software\\winreglib\\bench-watchmany';
+const keys = Array.from({ length: 10_000 }, (_, i) => `${root}\\${i % 100}\\key-${i}`);
+
+const settle = () => new Promise(resolve => setTimeout(resolve, 100));
+
+beforeAll(async () => {
+	winreglib.setBackend('memory');
+	winreglib.batch(keys.map(key => ({ op: 'createKey' as const, key })));
+	await settle();
+});
+
+afterAll(() => {
+	winreglib.delete(root);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+for (const count of [10, 100, 1_000, 10_000]) {
+	const batch = keys.slice(0, count);
+
+	describe(`${count} keys`, () => {
+		bench('watch() each key', () => {
+			const handles = batch.map(key => winreglib.watch(key));
+			for (const handle of handles) {
+				handle.stop();
+			}
+		});
+
+		bench('watchMany()', async () => {
+			const handle = await winreglib.watchMany(batch);
+			handle.stop();
+		});
+	});
+}
@@ -0,0 +1,84 @@
+import { afterAll, beforeAll, bench, describe } from 'vitest';
+import winreglib from '../src/index.js';
+import { createRequire } from 'node:module';
+import { dirname } from 'node:path';
+import { fileURLToPath } from 'node:url';
+import { Worker } from 'node:worker_threads';
+
+// each worker loads its own copy of the binding, so this measures how well reads from several
+// environments scale when they share the process-wide backend and monitor thread
+const counts = [1, 2, 4];
+const opsPerWorker = 10_000;
+const key = 'HKCU\\Software\\winreglib\\bench-workers';
+
+const cwd = dirname(dirname(fileURLToPath(import.meta.url)));
+const nodeGypBuild = createRequire(import.meta.url).resolve(
+	'node-gyp-build/node-gyp-build.js'
+);
+
+const workerSource = `
+const { parentPort, workerData } = require('node:worker_threads');
+const binding = require(workerData.nodeGypBuild)(workerData.cwd);
+binding.init(() => {});
+parentPort.on('message', ops => {
+	for (let i = 0; i < ops; i++) {
+		binding.get(workerData.key, 'value-' + (i % 100), false);
+	}
+	parentPort.postMessage(ops);
+});
+`;
+
+const pools = new Map<number, Worker[]>();
+
+const run = (workers: Worker[]) =>
+	Promise.all(
+		workers.map(
+			worker =>
+				new Promise(resolve => {
+					worker.once('message', resolve);
+					worker.postMessage(opsPerWorker);
+				})
+		)
+	);
+
+beforeAll(() => {
+	winreglib.setBackend('memory');
+	winreglib.batch(
+		Array.from({ length: 100 }, (_, i) => ({
+			op: 'set' as const,
+			key,
+			name: `value-${i}`,
+			value: `data-${i}`
+		}))
+	);
+
+	for (const count of counts) {
+		pools.set(
+			count,
+			Array.from(
+				{ length: count },
+				() =>
+					new Worker(workerSource, {
+						eval: true,
+						workerData: { cwd, nodeGypBuild, key }
+					})
+			)
+		);
+	}
+});
+
+afterAll(async () => {
+	for (const workers of pools.values()) {
+		await Promise.all(workers.map(worker => worker.terminate()));
+	}
+	winreglib.delete(key);
+	winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory');
+});
+
+describe(`get() x ${opsPerWorker} per worker`, () => {
+	for (const count of counts) {
+		bench(`${count} worker${count === 1 ? '' : 's'}`, async () => {
+			await run(pools.get(count)!);
+		});
+	}
+});
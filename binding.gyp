@@ -1,20 +1,49 @@
 {
-	'conditions': [
-		['OS=="win"', {
-			'targets': [
-				{
-					'target_name': 'node_winreglib',
-					'include_dirs'  : [
-						'<!(node -e "require(\'napi-macros\')")'
-					],
-					'defines': [
-						"WINREGLIB_VERSION=\"<!(node -e \"console.log(require(\'./package.json\').version)\")\"",
-						"WINREGLIB_URL=\"<!(node -e \"console.log(require(\'./package.json\').homepage)\")\""
-					],
+	'targets': [
+		{
+			'target_name': 'node_winreglib',
+			'include_dirs'  : [
+				'<!(node -e "require(\'napi-macros\')")'
+			],
+			'defines': [
+				"WINREGLIB_VERSION=\"<!(node -e \"console.log(require(\'./package.json\').version)\")\"",
+				"WINREGLIB_URL=\"<!(node -e \"console.log(require(\'./package.json\').homepage)\")\""
+			],
+			'sources': [
+				'src/backend.cpp',
+				'src/batch.cpp',
+				'src/columns.cpp',
+				'src/cursor.cpp',
+				'src/exporter.cpp',
+				'src/fingerprint.cpp',
+				'src/instance.cpp',
+				'src/journal.cpp',
+				'src/memorybackend.cpp',
+				'src/monitor.cpp',
+				'src/perfdata.cpp',
+				'src/platform.cpp',
+				'src/poller.cpp',
+				'src/query.cpp',
+				'src/recordingbackend.cpp',
+				'src/replaybackend.cpp',
+				'src/scanner.cpp',
+				'src/sharedcache.cpp',
+				'src/timeline.cpp',
+				'src/view.cpp',
+				'src/watchnode.cpp',
+				'src/watchman.cpp',
+				'src/watchpattern.cpp',
+				'src/watchqueue.cpp',
+				'src/winreglib.cpp'
+			],
+			'conditions': [
+				['OS=="win"', {
 					'sources': [
-						'src/watchnode.cpp',
-						'src/watchman.cpp',
-						'src/winreglib.cpp'
+						'src/win32backend.cpp'
+					],
+					'libraries': [
+						'ktmw32.lib',
+						'ntdll.lib'
 					],
 					'msvs_settings': {
 						'VCCLCompilerTool': {
@@ -23,8 +52,16 @@
 							'ExceptionHandling': '2'
 						}
 					}
-				}
+				}, {
+					# non-Windows builds only have the in-memory backend and exist for testing
+					'cflags_cc!': [ '-fno-exceptions' ],
+					'cflags_cc': [ '-std=c++17' ],
+					'xcode_settings': {
+						'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
+						'CLANG_CXX_LANGUAGE_STANDARD': 'c++17'
+					}
+				}]
 			]
-		}]
+		}
 	]
 }
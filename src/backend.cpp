@@ -0,0 +1,47 @@
+#include "backend.h"
+#include "memorybackend.h"
+#include "replaybackend.h"
+#include <cwctype>
+#ifdef _WIN32
+	#include "win32backend.h"
+#endif
+
+namespace winreglib {
+	Backend* backend = getBackend(
+#ifdef _WIN32
+		L"win32"
+#else
+		L"memory"
+#endif
+	);
+
+	Backend* getBackend(const std::wstring& name) {
+#ifdef _WIN32
+		if (name == L"win32") {
+			static Win32Backend win32;
+			return &win32;
+		}
+#endif
+		if (name == L"memory") {
+			static MemoryBackend memory;
+			return &memory;
+		}
+		if (name == L"replay") {
+			static ReplayBackend replay;
+			return &replay;
+		}
+		return NULL;
+	}
+}
+
+bool winreglib::NameLess::operator()(const std::wstring& a, const std::wstring& b) const {
+	size_t len = a.length() < b.length() ? a.length() : b.length();
+	for (size_t i = 0; i < len; ++i) {
+		wchar_t x = foldName(a[i]);
+		wchar_t y = foldName(b[i]);
+		if (x != y) {
+			return x < y;
+		}
+	}
+	return a.length() < b.length();
+}
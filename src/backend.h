@@ -0,0 +1,79 @@
+#ifndef __BACKEND__
+#define __BACKEND__
+
+#include "platform.h"
+#include <string>
+
+namespace winreglib {
+
+/**
+ * Folds a UTF-16 code unit the way the registry compares names: ordinally, by uppercasing each
+ * code unit on its own with the system's upcase table rather than the current locale.
+ */
+inline wchar_t foldName(wchar_t c) {
+	if (c < 0x80) {
+		return c >= L'a' && c <= L'z' ? (wchar_t)(c - 32) : c;
+	}
+	return (wchar_t)::RtlUpcaseUnicodeChar((WCHAR)c);
+}
+
+/**
+ * Orders registry names the way the registry compares them: case-insensitively.
+ */
+struct NameLess {
+	bool operator()(const std::wstring& a, const std::wstring& b) const;
+};
+
+/**
+ * The registry operations the addon performs. Each method mirrors the Win32 function of the same
+ * name and returns a Win32 status code so that callers behave identically regardless of which
+ * backend is active.
+ *
+ * `tx` is a transaction handle returned by `beginTransaction()` or `NULL` for non-transacted
+ * operations.
+ */
+class Backend {
+public:
+	virtual ~Backend() {}
+
+	virtual const char* name() = 0;
+
+	virtual LSTATUS beginTransaction(HANDLE* tx) = 0;
+	virtual LSTATUS commitTransaction(HANDLE tx) = 0;
+	virtual LSTATUS rollbackTransaction(HANDLE tx) = 0;
+
+	virtual LSTATUS closeKey(HKEY hkey) = 0;
+	virtual LSTATUS createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) = 0;
+	virtual LSTATUS deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx) = 0;
+	virtual LSTATUS deleteValue(HKEY hkey, const wchar_t* name) = 0;
+	virtual LSTATUS enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize) = 0;
+	virtual LSTATUS enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize) = 0;
+	virtual LSTATUS getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize) = 0;
+	virtual LSTATUS notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent) = 0;
+	virtual LSTATUS openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) = 0;
+	virtual LSTATUS queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime) = 0;
+	virtual LSTATUS setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize) = 0;
+
+	/**
+	 * Called by the monitor thread when an event registered with `notifyChangeKeyValue()` is
+	 * signaled. Only backends that record calls care.
+	 */
+	virtual void signaled(HANDLE hevent) {}
+};
+
+/**
+ * The active backend. Defaults to the Win32 backend on Windows and the in-memory backend
+ * everywhere else.
+ */
+extern Backend* backend;
+
+/**
+ * Returns the backend with the given name ("win32", "memory", or "replay") or `NULL` if it is not
+ * available on this platform. Backends are created on first use and live for the life of the
+ * process.
+ */
+Backend* getBackend(const std::wstring& name);
+
+}
+
+#endif
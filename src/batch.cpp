@@ -0,0 +1,184 @@
+#include "batch.h"
+
+using namespace winreglib;
+
+Batch::~Batch() {
+	closeAll();
+}
+
+/**
+ * Applies every operation in the order given and records each one's outcome. Returns a non-success
+ * status only if the transaction itself could not be started or committed.
+ */
+LSTATUS Batch::apply(std::vector<BatchOp>& ops) {
+	LSTATUS status = ERROR_SUCCESS;
+
+	if (transacted) {
+		status = backend->beginTransaction(&tx);
+		if (status != ERROR_SUCCESS) {
+			for (auto& op : ops) {
+				op.state = Failed;
+				op.status = status;
+			}
+			return status;
+		}
+	}
+
+	bool failed = false;
+	for (auto& op : ops) {
+		if (failed && transacted) {
+			op.state = Aborted;
+			continue;
+		}
+		op.status = applyOp(op);
+		op.state = op.status == ERROR_SUCCESS ? Applied : Failed;
+		failed = failed || op.state == Failed;
+	}
+
+	// all handles must be closed before the transaction is resolved
+	closeAll();
+
+	if (transacted) {
+		if (failed) {
+			backend->rollbackTransaction(tx);
+			for (auto& op : ops) {
+				if (op.state == Applied) {
+					op.state = Aborted;
+				}
+			}
+		} else {
+			status = backend->commitTransaction(tx);
+			if (status != ERROR_SUCCESS) {
+				for (auto& op : ops) {
+					op.state = Failed;
+					op.status = status;
+				}
+			}
+		}
+		tx = NULL;
+	}
+
+	return status;
+}
+
+LSTATUS Batch::applyOp(BatchOp& op) {
+	HKEY hkey;
+	LSTATUS status;
+
+	switch (op.type) {
+		case SetValue:
+			status = open(op, true, &hkey);
+			if (status == ERROR_SUCCESS) {
+				status = backend->setValue(hkey, op.name.c_str(), op.valueType, op.data.data(), (DWORD)op.data.size());
+			}
+			return status;
+
+		case DeleteValue:
+			status = open(op, false, &hkey);
+			if (status == ERROR_SUCCESS) {
+				status = backend->deleteValue(hkey, op.name.c_str());
+			}
+			return status;
+
+		case CreateKey:
+			return open(op, true, &hkey);
+
+		case DeleteKey:
+			closeTree(op.key());
+			return deleteTree(op.root, op.subkey);
+	}
+
+	return ERROR_INVALID_PARAMETER;
+}
+
+void Batch::closeAll() {
+	for (auto const& it : handles) {
+		backend->closeKey(it.second);
+	}
+	handles.clear();
+}
+
+/**
+ * Closes the cached handles for `key` and every key beneath it before the tree is deleted.
+ */
+void Batch::closeTree(const std::wstring& key) {
+	NameLess less;
+	std::wstring prefix = key + L'\\';
+	for (auto it = handles.begin(); it != handles.end(); ) {
+		std::wstring head = it->first.substr(0, prefix.length());
+		bool equal = !less(it->first, key) && !less(key, it->first);
+		bool child = !less(head, prefix) && !less(prefix, head);
+		if (equal || child) {
+			backend->closeKey(it->second);
+			it = handles.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+/**
+ * Deletes a key and all of its subkeys, deepest first.
+ */
+LSTATUS Batch::deleteTree(HKEY root, const std::wstring& subkey) {
+	HKEY hkey;
+	LSTATUS status = backend->openKey(root, subkey.c_str(), KEY_READ, tx, &hkey);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	DWORD numSubkeys = 0;
+	DWORD maxSubkeyLength = 0;
+	status = backend->queryInfoKey(hkey, &numSubkeys, &maxSubkeyLength, NULL, NULL, NULL, NULL);
+
+	// collect the names first since deleting a subkey shifts the enumeration indices
+	std::vector<std::wstring> children;
+	if (status == ERROR_SUCCESS && numSubkeys > 0) {
+		std::vector<wchar_t> buffer(maxSubkeyLength + 1);
+		for (DWORD i = 0; ; ++i) {
+			DWORD size = (DWORD)buffer.size();
+			LSTATUS s = backend->enumKey(hkey, i, buffer.data(), &size);
+			if (s == ERROR_NO_MORE_ITEMS) {
+				break;
+			}
+			if (s != ERROR_SUCCESS) {
+				status = s;
+				break;
+			}
+			children.push_back(std::wstring(buffer.data(), size));
+		}
+	}
+	backend->closeKey(hkey);
+
+	for (auto const& child : children) {
+		if (status != ERROR_SUCCESS) {
+			break;
+		}
+		status = deleteTree(root, subkey + L'\\' + child);
+	}
+
+	if (status == ERROR_SUCCESS) {
+		status = backend->deleteKey(root, subkey.c_str(), tx);
+	}
+	return status;
+}
+
+/**
+ * Returns a cached handle for the operation's key, opening or creating it on first use.
+ */
+LSTATUS Batch::open(BatchOp& op, bool create, HKEY* hkey) {
+	std::wstring key = op.key();
+	auto it = handles.find(key);
+	if (it != handles.end()) {
+		*hkey = it->second;
+		return ERROR_SUCCESS;
+	}
+
+	LSTATUS status = create
+		? backend->createKey(op.root, op.subkey.c_str(), KEY_READ | KEY_WRITE, tx, hkey)
+		: backend->openKey(op.root, op.subkey.c_str(), KEY_READ | KEY_WRITE, tx, hkey);
+	if (status == ERROR_SUCCESS) {
+		handles.insert(std::make_pair(key, *hkey));
+	}
+	return status;
+}
@@ -0,0 +1,65 @@
+#ifndef __BATCH__
+#define __BATCH__
+
+#include "backend.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+enum BatchOpType { SetValue, DeleteValue, CreateKey, DeleteKey };
+
+enum BatchOpState {
+	Pending,  // not applied yet
+	Applied,  // applied (and committed if transacted)
+	Failed,   // the operation itself failed, see `status`
+	Aborted   // skipped or rolled back because another operation in the transaction failed
+};
+
+/**
+ * A single write in a batch along with its outcome.
+ */
+struct BatchOp {
+	BatchOp() : type(SetValue), root(NULL), valueType(REG_NONE), state(Pending), status(ERROR_SUCCESS) {}
+
+	std::wstring key() const { return rootName + L'\\' + subkey; }
+
+	BatchOpType type;
+	HKEY root;
+	std::wstring rootName;
+	std::wstring subkey;
+	std::wstring name;
+	DWORD valueType;
+	std::vector<BYTE> data;
+	BatchOpState state;
+	LSTATUS status;
+};
+
+/**
+ * Applies a list of writes in order, opening each distinct key at most once. When `transacted` is
+ * true, either every operation is committed or none are.
+ */
+class Batch {
+public:
+	Batch(Backend* backend, bool transacted) : backend(backend), transacted(transacted), tx(NULL) {}
+	~Batch();
+
+	LSTATUS apply(std::vector<BatchOp>& ops);
+
+private:
+	LSTATUS applyOp(BatchOp& op);
+	void closeAll();
+	void closeTree(const std::wstring& key);
+	LSTATUS deleteTree(HKEY root, const std::wstring& subkey);
+	LSTATUS open(BatchOp& op, bool create, HKEY* hkey);
+
+	Backend* backend;
+	bool transacted;
+	HANDLE tx;
+	std::map<std::wstring, HKEY, NameLess> handles;
+};
+
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef __CODEC__
+#define __CODEC__
+
+#include "winreglib.h"
+#include <array>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * The largest integer a JavaScript number can represent exactly (2^53 - 1).
+ */
+const uint64_t MAX_SAFE_INTEGER = 9007199254740991ULL;
+
+/**
+ * How the data of a registry value type is represented.
+ */
+enum ValueKind { NullValue, StringValue, MultiStringValue, Uint32Value, Uint64Value, BinaryValue };
+
+/**
+ * Describes a registry value type. Types without a specialization are binary.
+ */
+template<DWORD Type> struct ValueTraits                       { static constexpr ValueKind kind = BinaryValue;      static constexpr bool bigEndian = false; };
+template<> struct ValueTraits<REG_NONE>                       { static constexpr ValueKind kind = NullValue;        static constexpr bool bigEndian = false; };
+template<> struct ValueTraits<REG_SZ>                         { static constexpr ValueKind kind = StringValue;      static constexpr bool bigEndian = false; };
+template<> struct ValueTraits<REG_EXPAND_SZ>                  { static constexpr ValueKind kind = StringValue;      static constexpr bool bigEndian = false; };
+template<> struct ValueTraits<REG_LINK>                       { static constexpr ValueKind kind = StringValue;      static constexpr bool bigEndian = false; };
+template<> struct ValueTraits<REG_MULTI_SZ>                   { static constexpr ValueKind kind = MultiStringValue; static constexpr bool bigEndian = false; };
+template<> struct ValueTraits<REG_DWORD>                      { static constexpr ValueKind kind = Uint32Value;      static constexpr bool bigEndian = false; };
+template<> struct ValueTraits<REG_DWORD_BIG_ENDIAN>           { static constexpr ValueKind kind = Uint32Value;      static constexpr bool bigEndian = true; };
+template<> struct ValueTraits<REG_QWORD>                      { static constexpr ValueKind kind = Uint64Value;      static constexpr bool bigEndian = false; };
+
+/**
+ * The number of registry value types known to the codec, `REG_NONE` through `REG_QWORD`. Other
+ * types are treated as binary.
+ */
+const DWORD VALUE_TYPE_COUNT = REG_QWORD + 1;
+
+/**
+ * Builds a table with an entry for every known value type.
+ */
+template<typename Entry, template<DWORD> class Make, DWORD... Types>
+constexpr std::array<Entry, sizeof...(Types)> makeTypeTable(std::integer_sequence<DWORD, Types...>) {
+	return {{ Make<Types>::value... }};
+}
+
+/**
+ * Reverses the byte order of a 32-bit integer. Compilers turn this into a single `bswap`.
+ */
+constexpr uint32_t byteSwap32(uint32_t value) {
+	value = ((value & 0x00FF00FF) << 8) | ((value >> 8) & 0x00FF00FF);
+	return (value << 16) | (value >> 16);
+}
+
+/**
+ * Returns the number of characters before the first null terminator, reading at most `max`.
+ */
+inline size_t stringLength(const char16_t* str, size_t max) {
+	size_t len = 0;
+	while (len < max && str[len]) {
+		++len;
+	}
+	return len;
+}
+
+/**
+ * The strings of a `REG_MULTI_SZ` value. The data doesn't have to be terminated; a string that
+ * runs to the end of the data ends there, and the first empty string ends the list.
+ */
+class MultiString {
+public:
+	MultiString(const char16_t* chars, size_t numChars) : chars(chars), numChars(numChars) {}
+
+	template<typename Fn>
+	bool forEach(Fn fn) const {
+		size_t i = 0;
+		while (i < numChars && chars[i]) {
+			size_t len = stringLength(chars + i, numChars - i);
+			if (!fn(chars + i, len)) {
+				return false;
+			}
+			i += len + 1;
+		}
+		return true;
+	}
+
+	size_t size() const {
+		size_t count = 0;
+		forEach([&](const char16_t*, size_t) { ++count; return true; });
+		return count;
+	}
+
+private:
+	const char16_t* chars;
+	size_t numChars;
+};
+
+/**
+ * Decodes the data of a value whose type is known at compile time. Nothing is read beyond `size`;
+ * strings are cut at the end of the data if they aren't terminated, and integers that are too
+ * short are passed to the sink as binary data.
+ */
+template<DWORD Type, typename Sink>
+typename Sink::Result decodeAs(Sink& sink, const BYTE* data, size_t size) {
+	constexpr ValueKind kind = ValueTraits<Type>::kind;
+	const char16_t* chars = reinterpret_cast<const char16_t*>(data);
+	size_t numChars = size / sizeof(char16_t);
+
+	if constexpr (kind == NullValue) {
+		return sink.null();
+	} else if constexpr (kind == StringValue) {
+		return sink.string(chars, stringLength(chars, numChars));
+	} else if constexpr (kind == MultiStringValue) {
+		return sink.multiString(MultiString(chars, numChars));
+	} else if constexpr (kind == Uint32Value) {
+		if (size < sizeof(uint32_t)) {
+			return sink.binary(data, size);
+		}
+		uint32_t value;
+		::memcpy(&value, data, sizeof(value));
+		return sink.uint32(ValueTraits<Type>::bigEndian ? byteSwap32(value) : value);
+	} else if constexpr (kind == Uint64Value) {
+		if (size < sizeof(uint64_t)) {
+			return sink.binary(data, size);
+		}
+		uint64_t value;
+		::memcpy(&value, data, sizeof(value));
+		return sink.uint64(value);
+	} else {
+		return sink.binary(data, size);
+	}
+}
+
+template<typename Sink>
+struct Decoders {
+	typedef typename Sink::Result (*Decoder)(Sink& sink, const BYTE* data, size_t size);
+	template<DWORD Type> struct Make { static constexpr Decoder value = &decodeAs<Type, Sink>; };
+	static constexpr std::array<Decoder, VALUE_TYPE_COUNT> table =
+		makeTypeTable<Decoder, Make>(std::make_integer_sequence<DWORD, VALUE_TYPE_COUNT>());
+};
+
+/**
+ * Decodes registry data into a sink. The sink has a `Result` type and the methods `null()`,
+ * `string(chars, length)`, `multiString(strings)`, `uint32(value)`, `uint64(value)`, and
+ * `binary(data, size)`. Unknown types are binary.
+ */
+template<typename Sink>
+typename Sink::Result decodeValue(Sink& sink, DWORD type, const BYTE* data, size_t size) {
+	return type < VALUE_TYPE_COUNT ? Decoders<Sink>::table[type](sink, data, size) : sink.binary(data, size);
+}
+
+/**
+ * Encodes a value whose type is known at compile time. Strings are written with their null
+ * terminator and a `REG_MULTI_SZ` list with the extra terminator.
+ */
+template<DWORD Type, typename Source>
+bool encodeAs(Source& source, std::vector<BYTE>& data) {
+	constexpr ValueKind kind = ValueTraits<Type>::kind;
+
+	if constexpr (kind == StringValue) {
+		return source.appendString(data);
+	} else if constexpr (kind == MultiStringValue) {
+		if (!source.appendStrings(data)) {
+			return false;
+		}
+		data.resize(data.size() + sizeof(char16_t), 0);
+		return true;
+	} else if constexpr (kind == Uint32Value) {
+		uint32_t value;
+		if (!source.uint32(value)) {
+			return false;
+		}
+		value = ValueTraits<Type>::bigEndian ? byteSwap32(value) : value;
+		data.resize(sizeof(value));
+		::memcpy(data.data(), &value, sizeof(value));
+		return true;
+	} else if constexpr (kind == Uint64Value) {
+		uint64_t value;
+		if (!source.uint64(value)) {
+			return false;
+		}
+		data.resize(sizeof(value));
+		::memcpy(data.data(), &value, sizeof(value));
+		return true;
+	} else {
+		return source.binary(data);
+	}
+}
+
+template<typename Source>
+struct Encoders {
+	typedef bool (*Encoder)(Source& source, std::vector<BYTE>& data);
+	template<DWORD Type> struct Make { static constexpr Encoder value = &encodeAs<Type, Source>; };
+	static constexpr std::array<Encoder, VALUE_TYPE_COUNT> table =
+		makeTypeTable<Encoder, Make>(std::make_integer_sequence<DWORD, VALUE_TYPE_COUNT>());
+};
+
+/**
+ * Encodes a value from a source as registry data. The source has the methods
+ * `appendString(data)`, `appendStrings(data)`, `uint32(value)`, `uint64(value)`, and
+ * `binary(data)`, each returning false if the value can't be represented that way. Unknown types
+ * are binary.
+ */
+template<typename Source>
+bool encodeValue(Source& source, DWORD type, std::vector<BYTE>& data) {
+	return type < VALUE_TYPE_COUNT ? Encoders<Source>::table[type](source, data) : source.binary(data);
+}
+
+}
+
+#endif
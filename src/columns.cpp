@@ -0,0 +1,90 @@
+#include "columns.h"
+#include <cmath>
+
+using namespace winreglib;
+
+namespace {
+
+/**
+ * Decodes a value into the columns of a `ColumnBuilder`.
+ */
+struct ColumnSink {
+	typedef bool Result;
+
+	ColumnSink(ColumnBuilder& columns) : columns(columns) {}
+
+	bool binary(const BYTE* data, size_t size) {
+		columns.data.insert(columns.data.end(), data, data + size);
+		return add(ColumnBinary, NAN);
+	}
+
+	bool multiString(const MultiString& strings) {
+		bool first = true;
+		strings.forEach([&](const char16_t* str, size_t len) {
+			if (!first) {
+				columns.text.push_back(u'\0');
+			}
+			columns.text.append(str, len);
+			first = false;
+			return true;
+		});
+		return add(ColumnMultiString, NAN);
+	}
+
+	bool null() {
+		return add(ColumnNull, NAN);
+	}
+
+	bool string(const char16_t* str, size_t len) {
+		columns.text.append(str, len);
+		return add(ColumnString, NAN);
+	}
+
+	bool uint32(uint32_t value) {
+		return add(ColumnNumber, (double)value);
+	}
+
+	bool uint64(uint64_t value) {
+		if (value > MAX_SAFE_INTEGER) {
+			const BYTE* bytes = reinterpret_cast<const BYTE*>(&value);
+			columns.data.insert(columns.data.end(), bytes, bytes + sizeof(value));
+			return add(ColumnBigInt, NAN);
+		}
+		return add(ColumnNumber, (double)value);
+	}
+
+	bool add(ColumnKind kind, double number) {
+		columns.kinds.push_back(kind);
+		columns.numbers.push_back(number);
+		columns.textOffsets.push_back((uint32_t)columns.text.length());
+		columns.dataOffsets.push_back((uint32_t)columns.data.size());
+		return true;
+	}
+
+	ColumnBuilder& columns;
+};
+
+}
+
+void NameTable::add(const wchar_t* name, size_t length) {
+	// names are UTF-16 on every platform, wide strings just hold one code unit per element
+	units.append(name, name + length);
+	offsets.push_back((uint32_t)units.length());
+}
+
+/**
+ * Adds a value name and its type without its data.
+ */
+void ColumnBuilder::addValue(const wchar_t* name, size_t length, DWORD type) {
+	names.add(name, length);
+	types.push_back(type);
+}
+
+/**
+ * Adds a value, decoding its data the same way `get()` does.
+ */
+void ColumnBuilder::addValue(const wchar_t* name, size_t length, DWORD type, const BYTE* value, size_t size) {
+	addValue(name, length, type);
+	ColumnSink sink(*this);
+	decodeValue(sink, type, value, size);
+}
@@ -0,0 +1,64 @@
+#ifndef __COLUMNS__
+#define __COLUMNS__
+
+#include "codec.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * How a value in a columnar result is stored. Numbers are in the `numbers` column and strings in
+ * the `text` column, with the strings of a `REG_MULTI_SZ` separated by a null character.
+ * Everything else is in the `data` column: 64-bit integers too large for a number as 8
+ * little-endian bytes, and binary data as is.
+ */
+enum ColumnKind : uint8_t { ColumnNull, ColumnString, ColumnMultiString, ColumnNumber, ColumnBigInt, ColumnBinary };
+
+/**
+ * A list of names packed into one string of UTF-16 code units. Name `i` is the code units from
+ * `offsets[i]` to `offsets[i + 1]`.
+ */
+struct NameTable {
+	NameTable() : offsets(1, 0) {}
+
+	void add(const wchar_t* name, size_t length);
+	size_t size() const { return offsets.size() - 1; }
+
+	std::u16string units;
+	std::vector<uint32_t> offsets;
+};
+
+/**
+ * Collects enumeration results as columns instead of objects, so they can be handed to
+ * JavaScript as a few typed arrays over one `ArrayBuffer` no matter how many entries there are.
+ *
+ * `keys` holds key names and `names` value names. Each value name has an entry in `types` and,
+ * if its data was added, in `kinds`, `numbers`, `textOffsets`, and `dataOffsets`. The values of
+ * key `i` are `rows[i]` to `rows[i + 1]`.
+ */
+class ColumnBuilder {
+public:
+	ColumnBuilder() : rows(1, 0), textOffsets(1, 0), dataOffsets(1, 0) {}
+
+	void addKey(const std::wstring& key) { keys.add(key.c_str(), key.length()); }
+	void addValue(const wchar_t* name, size_t length, DWORD type);
+	void addValue(const wchar_t* name, size_t length, DWORD type, const BYTE* data, size_t size);
+	void endKey() { rows.push_back((uint32_t)names.size()); }
+
+	NameTable keys;
+	NameTable names;
+	std::vector<uint32_t> rows;
+	std::vector<uint32_t> types;
+	std::vector<uint8_t> kinds;
+	std::vector<double> numbers;
+	std::u16string text;
+	std::vector<uint32_t> textOffsets;
+	std::vector<BYTE> data;
+	std::vector<uint32_t> dataOffsets;
+};
+
+}
+
+#endif
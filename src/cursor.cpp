@@ -0,0 +1,246 @@
+#include "cursor.h"
+#include <map>
+
+using namespace winreglib;
+
+bool Cursor::Snapshot::operator!=(const Snapshot& other) const {
+	return numSubkeys != other.numSubkeys
+		|| numValues != other.numValues
+		|| lastWriteTime.dwLowDateTime != other.lastWriteTime.dwLowDateTime
+		|| lastWriteTime.dwHighDateTime != other.lastWriteTime.dwHighDateTime;
+}
+
+/**
+ * Takes ownership of an open key handle.
+ */
+Cursor::Cursor(Backend* backend, HKEY hkey) : busy(false), backend(backend), hkey(hkey), started(false) {
+	for (int i = 0; i < 2; ++i) {
+		position[i].index = 0;
+		position[i].exhausted = false;
+	}
+}
+
+Cursor::~Cursor() {
+	close();
+}
+
+void Cursor::close() {
+	if (hkey != NULL) {
+		backend->closeKey(hkey);
+		hkey = NULL;
+	}
+}
+
+/**
+ * Reads up to `pageSize` names into `page`, subkeys first. `page.done` is set once every subkey
+ * and value has been returned.
+ */
+void Cursor::next(DWORD pageSize, CursorPage& page) {
+	if (closed()) {
+		page.status = ERROR_INVALID_HANDLE;
+		return;
+	}
+
+	Snapshot before;
+	page.status = query(before);
+	if (page.status != ERROR_SUCCESS) {
+		return;
+	}
+
+	// the key changed since the last page, so the indices may have shifted
+	if (started && last != before) {
+		page.status = resume(false, before.numSubkeys);
+		if (page.status == ERROR_SUCCESS) {
+			page.status = resume(true, before.numValues);
+		}
+		if (page.status != ERROR_SUCCESS) {
+			return;
+		}
+	}
+	started = true;
+
+	Position start[2] = { position[0], position[1] };
+	while (true) {
+		page.status = fill(false, pageSize, page);
+		if (page.status == ERROR_SUCCESS) {
+			page.status = fill(true, pageSize, page);
+		}
+		if (page.status != ERROR_SUCCESS) {
+			return;
+		}
+
+		page.status = query(last);
+		if (page.status != ERROR_SUCCESS) {
+			return;
+		}
+		if (!(last != before)) {
+			break;
+		}
+
+		// the key changed while this page was being read, so an entry may have been skipped and
+		// the page is read again from where it started
+		page.subkeys.clear();
+		page.values.clear();
+		position[0] = start[0];
+		position[1] = start[1];
+		before = last;
+		page.status = resume(false, before.numSubkeys);
+		if (page.status == ERROR_SUCCESS) {
+			page.status = resume(true, before.numValues);
+		}
+		if (page.status != ERROR_SUCCESS) {
+			return;
+		}
+	}
+
+	page.done = position[0].exhausted && position[1].exhausted;
+}
+
+/**
+ * Reads the subkey or value name at `index`, growing the buffer if the name doesn't fit.
+ */
+LSTATUS Cursor::enumName(bool values, DWORD index, std::wstring& name) {
+	while (true) {
+		DWORD size = (DWORD)buffer.size();
+		LSTATUS status = values
+			? backend->enumValue(hkey, index, buffer.data(), &size, NULL, NULL, NULL)
+			: backend->enumKey(hkey, index, buffer.data(), &size);
+
+		if (status == ERROR_MORE_DATA) {
+			// a name longer than any when the key was queried was added, so grow and retry
+			buffer.resize(buffer.size() * 2);
+			continue;
+		}
+
+		if (status == ERROR_SUCCESS) {
+			name.assign(buffer.data(), size);
+		}
+		return status;
+	}
+}
+
+/**
+ * Enumerates subkey or value names into the page until the page is full or there are no more.
+ */
+LSTATUS Cursor::fill(bool values, DWORD pageSize, CursorPage& page) {
+	Position& p = position[values ? 1 : 0];
+	std::vector<std::wstring>& names = values ? page.values : page.subkeys;
+	std::wstring name;
+
+	while (!p.exhausted && page.subkeys.size() + page.values.size() < pageSize) {
+		LSTATUS status = enumName(values, p.index, name);
+		if (status == ERROR_NO_MORE_ITEMS) {
+			p.exhausted = true;
+			break;
+		}
+		if (status != ERROR_SUCCESS) {
+			return status;
+		}
+
+		++p.index;
+		names.push_back(name);
+	}
+
+	if (!names.empty()) {
+		p.recent = names;
+	}
+	return ERROR_SUCCESS;
+}
+
+/**
+ * Gets the key's current state and makes sure the name buffer can hold the longest name.
+ */
+LSTATUS Cursor::query(Snapshot& snapshot) {
+	DWORD maxSubkeyLength = 0;
+	DWORD maxValueNameLength = 0;
+	LSTATUS status = backend->queryInfoKey(hkey, &snapshot.numSubkeys, &maxSubkeyLength, &snapshot.numValues, &maxValueNameLength, NULL, &snapshot.lastWriteTime);
+	if (status == ERROR_SUCCESS) {
+		size_t size = (maxSubkeyLength > maxValueNameLength ? maxSubkeyLength : maxValueNameLength) + 1;
+		if (buffer.size() < size) {
+			buffer.resize(size);
+		}
+	}
+	return status;
+}
+
+/**
+ * Finds where the subkey or value enumeration left off after the key changed. `count` is the
+ * number of subkeys or values the key has now.
+ */
+LSTATUS Cursor::resume(bool values, DWORD count) {
+	Position& p = position[values ? 1 : 0];
+	p.exhausted = false;
+	if (p.recent.empty()) {
+		// nothing was returned yet, so the enumeration is still at the start
+		return ERROR_SUCCESS;
+	}
+
+	std::wstring name;
+	NameLess less;
+
+	if (!values) {
+		// subkeys are sorted, so skip every subkey up to the last one returned
+		const std::wstring& after = p.recent.back();
+		DWORD lo = 0;
+		DWORD hi = count;
+		while (lo < hi) {
+			DWORD mid = lo + (hi - lo) / 2;
+			LSTATUS status = enumName(false, mid, name);
+			if (status == ERROR_NO_MORE_ITEMS) {
+				hi = mid;
+				continue;
+			}
+			if (status != ERROR_SUCCESS) {
+				return status;
+			}
+			if (less(after, name)) {
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		p.index = lo;
+		return ERROR_SUCCESS;
+	}
+
+	// values keep their order, so look outwards from where the last page ended for the newest
+	// value it returned that still exists and resume after it
+	std::map<std::wstring, size_t, NameLess> ranks;
+	for (size_t r = 0; r < p.recent.size(); ++r) {
+		ranks[p.recent[r]] = r;
+	}
+
+	size_t newest = p.recent.size();
+	size_t index = 0;
+	size_t center = p.index ? p.index - 1 : 0;
+	for (size_t d = 0; newest + 1 != p.recent.size() && (center + d < count || d <= center); ++d) {
+		size_t candidates[2] = { center + d, d && d <= center ? center - d : count };
+		for (size_t candidate : candidates) {
+			if (candidate >= count) {
+				continue;
+			}
+			LSTATUS status = enumName(true, (DWORD)candidate, name);
+			if (status == ERROR_NO_MORE_ITEMS) {
+				continue;
+			}
+			if (status != ERROR_SUCCESS) {
+				return status;
+			}
+			auto it = ranks.find(name);
+			if (it != ranks.end() && (newest == p.recent.size() || it->second > newest)) {
+				newest = it->second;
+				index = candidate + 1;
+			}
+		}
+	}
+
+	if (newest == p.recent.size()) {
+		// every value of the last page was removed, so assume nothing else moved
+		index = p.index > p.recent.size() ? p.index - p.recent.size() : 0;
+		if (index > count) {
+			index = count;
+		}
+	}
+	p.index = (DWORD)index;
+	return ERROR_SUCCESS;
+}
@@ -0,0 +1,83 @@
+#ifndef __CURSOR__
+#define __CURSOR__
+
+#include "backend.h"
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * A page of subkey and value names read by a `Cursor`.
+ */
+struct CursorPage {
+	CursorPage() : done(false), status(ERROR_SUCCESS) {}
+
+	std::vector<std::wstring> subkeys;
+	std::vector<std::wstring> values;
+	bool done;
+	LSTATUS status;
+};
+
+/**
+ * Enumerates the subkeys, then the values, of an open key one page at a time.
+ *
+ * The registry enumerates by index, so adding or removing an entry between pages shifts the
+ * indices of the entries after it. The cursor detects modifications through the key's last write
+ * time and entry counts, and when the key changes it finds where it left off instead of starting
+ * over. Subkeys are kept sorted by name, so the cursor resumes after the last subkey it returned.
+ * Values are kept in the order they were added, so the cursor looks for the last values it
+ * returned near where they were. Every entry that exists for the whole iteration is returned
+ * exactly once, unless every value of the last page that read values is removed, in which case
+ * values around them may be repeated or missed. Entries added or removed during the iteration may
+ * or may not be returned.
+ *
+ * A cursor is not thread safe. Only one page may be read at a time, although pages may be read
+ * from different threads.
+ */
+class Cursor {
+public:
+	Cursor(Backend* backend, HKEY hkey);
+	~Cursor();
+
+	void close();
+	bool closed() { return hkey == NULL; }
+	void next(DWORD pageSize, CursorPage& page);
+
+	bool busy;
+
+private:
+	struct Snapshot {
+		DWORD numSubkeys;
+		DWORD numValues;
+		FILETIME lastWriteTime;
+
+		bool operator!=(const Snapshot& other) const;
+	};
+
+	/**
+	 * Where the subkey or value enumeration left off. `recent` holds the names returned by the
+	 * last page that read any, which are looked for when the key changes.
+	 */
+	struct Position {
+		DWORD index;
+		bool exhausted;
+		std::vector<std::wstring> recent;
+	};
+
+	LSTATUS enumName(bool values, DWORD index, std::wstring& name);
+	LSTATUS fill(bool values, DWORD pageSize, CursorPage& page);
+	LSTATUS query(Snapshot& snapshot);
+	LSTATUS resume(bool values, DWORD count);
+
+	Backend* backend;
+	HKEY hkey;
+	bool started;
+	Snapshot last;
+	Position position[2];
+	std::vector<wchar_t> buffer;
+};
+
+}
+
+#endif
@@ -0,0 +1,605 @@
+#include "exporter.h"
+#include "codec.h"
+#include <cstring>
+
+using namespace winreglib;
+
+static const char* const typeNames[] = {
+	"REG_NONE",
+	"REG_SZ",
+	"REG_EXPAND_SZ",
+	"REG_BINARY",
+	"REG_DWORD",
+	"REG_DWORD_BIG_ENDIAN",
+	"REG_LINK",
+	"REG_MULTI_SZ",
+	"REG_RESOURCE_LIST",
+	"REG_FULL_RESOURCE_DESCRIPTOR",
+	"REG_RESOURCE_REQUIREMENTS_LIST",
+	"REG_QWORD"
+};
+
+/**
+ * Binary format record tags.
+ */
+static const char TAG_END = 0;
+static const char TAG_KEY = 1;
+static const char TAG_VALUE = 2;
+
+/**
+ * Encodes UTF-16 (`char16_t` and `wchar_t` on Windows) or UTF-32 (`wchar_t` elsewhere) as UTF-8.
+ * Unpaired surrogates are replaced with U+FFFD.
+ */
+template<typename T>
+static void encodeUtf8(const T* str, size_t len, std::string& result) {
+	result.clear();
+	for (size_t i = 0; i < len; ++i) {
+		uint32_t c = (uint32_t)str[i];
+		if (c >= 0xD800 && c <= 0xDFFF) {
+			if (sizeof(T) == 2 && c <= 0xDBFF && i + 1 < len && (uint32_t)str[i + 1] >= 0xDC00 && (uint32_t)str[i + 1] <= 0xDFFF) {
+				c = 0x10000 + ((c - 0xD800) << 10) + ((uint32_t)str[++i] - 0xDC00);
+			} else {
+				c = 0xFFFD;
+			}
+		}
+		if (c < 0x80) {
+			result += (char)c;
+		} else if (c < 0x800) {
+			result += (char)(0xC0 | (c >> 6));
+			result += (char)(0x80 | (c & 0x3F));
+		} else if (c < 0x10000) {
+			result += (char)(0xE0 | (c >> 12));
+			result += (char)(0x80 | ((c >> 6) & 0x3F));
+			result += (char)(0x80 | (c & 0x3F));
+		} else {
+			result += (char)(0xF0 | (c >> 18));
+			result += (char)(0x80 | ((c >> 12) & 0x3F));
+			result += (char)(0x80 | ((c >> 6) & 0x3F));
+			result += (char)(0x80 | (c & 0x3F));
+		}
+	}
+}
+
+bool FileSink::write(std::vector<char>& chunk) {
+	size_t offset = 0;
+	while (offset < chunk.size()) {
+		uv_fs_t req;
+		uv_buf_t buf = uv_buf_init(chunk.data() + offset, (unsigned int)(chunk.size() - offset));
+		int result = ::uv_fs_write(loop, &req, fd, &buf, 1, -1, NULL);
+		::uv_fs_req_cleanup(&req);
+		if (result < 0) {
+			error = std::string("Failed to write export: ") + ::uv_strerror(result);
+			return false;
+		}
+		offset += (size_t)result;
+	}
+	chunk.clear();
+	return true;
+}
+
+CallbackSink::CallbackSink() : state(std::make_shared<State>()), tsfn(NULL), doneRef(NULL) {}
+
+/**
+ * Creates the thread-safe function that delivers chunks and the `done` function that is passed to
+ * the callback along with each chunk. Must be called on the main thread.
+ */
+napi_status CallbackSink::init(napi_env env, napi_value callback) {
+	napi_status status;
+	napi_value name, doneFn;
+
+	// the done function and the thread-safe function each hold a reference to the state
+	status = ::napi_create_function(env, "done", NAPI_AUTO_LENGTH, done, state.get(), &doneFn);
+	if (status != napi_ok) return status;
+	status = ::napi_add_finalizer(env, doneFn, new std::shared_ptr<State>(state), [](napi_env env, void* data, void* hint) {
+		delete static_cast<std::shared_ptr<State>*>(data);
+	}, NULL, NULL);
+	if (status != napi_ok) return status;
+	status = ::napi_create_reference(env, doneFn, 1, &doneRef);
+	if (status != napi_ok) return status;
+
+	status = ::napi_create_string_utf8(env, "winreglib.exportTree", NAPI_AUTO_LENGTH, &name);
+	if (status != napi_ok) return status;
+	return ::napi_create_threadsafe_function(
+		env,
+		callback,
+		NULL,
+		name,
+		0,
+		1,
+		new std::shared_ptr<State>(state),
+		[](napi_env env, void* data, void* hint) {
+			// nothing else will be delivered, so stop waiting for outstanding chunks
+			std::shared_ptr<State>* state = static_cast<std::shared_ptr<State>*>(data);
+			{
+				std::lock_guard<std::mutex> lock((*state)->lock);
+				(*state)->failed = (*state)->failed || (*state)->inFlight > 0;
+				(*state)->inFlight = 0;
+			}
+			(*state)->acked.notify_all();
+			delete state;
+		},
+		this,
+		callJs,
+		&tsfn
+	);
+}
+
+bool CallbackSink::write(std::vector<char>& chunk) {
+	{
+		std::unique_lock<std::mutex> lock(state->lock);
+		state->acked.wait(lock, [&]() { return state->failed || state->inFlight < 2; });
+		if (state->failed) {
+			error = "Failed to write export to stream";
+			return false;
+		}
+		++state->inFlight;
+	}
+
+	std::vector<char>* data = new std::vector<char>();
+	data->swap(chunk);
+	if (::napi_call_threadsafe_function(tsfn, data, napi_tsfn_blocking) != napi_ok) {
+		delete data;
+		state->ack(false);
+		error = "Failed to write export to stream";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Waits for the callback to consume every chunk, then releases the thread-safe function.
+ */
+bool CallbackSink::finish() {
+	bool ok;
+	{
+		std::unique_lock<std::mutex> lock(state->lock);
+		state->acked.wait(lock, [&]() { return state->inFlight == 0; });
+		ok = !state->failed;
+	}
+	if (tsfn) {
+		::napi_release_threadsafe_function(tsfn, napi_tsfn_release);
+		tsfn = NULL;
+	}
+	if (!ok && error.empty()) {
+		error = "Failed to write export to stream";
+	}
+	return ok;
+}
+
+void CallbackSink::close(napi_env env) {
+	if (tsfn) {
+		::napi_release_threadsafe_function(tsfn, napi_tsfn_release);
+		tsfn = NULL;
+	}
+	if (doneRef) {
+		::napi_delete_reference(env, doneRef);
+		doneRef = NULL;
+	}
+}
+
+void CallbackSink::State::ack(bool ok) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (inFlight > 0) {
+			--inFlight;
+		}
+		if (!ok) {
+			failed = true;
+		}
+	}
+	acked.notify_all();
+}
+
+/**
+ * Calls `write(chunk, done)` on the main thread. The chunk buffer takes ownership of the data.
+ */
+void CallbackSink::callJs(napi_env env, napi_value callback, void* context, void* data) {
+	CallbackSink* sink = static_cast<CallbackSink*>(context);
+	std::vector<char>* chunk = static_cast<std::vector<char>*>(data);
+
+	// the environment is shutting down
+	if (env == NULL) {
+		delete chunk;
+		return;
+	}
+
+	napi_value global, argv[2], rval;
+	napi_status status = ::napi_create_external_buffer(env, chunk->size(), chunk->data(), [](napi_env env, void* data, void* hint) {
+		delete static_cast<std::vector<char>*>(hint);
+	}, chunk, &argv[0]);
+	if (status == napi_no_external_buffers_allowed) {
+		status = ::napi_create_buffer_copy(env, chunk->size(), chunk->data(), NULL, &argv[0]);
+		delete chunk;
+	} else if (status != napi_ok) {
+		delete chunk;
+	}
+
+	if (status != napi_ok ||
+		::napi_get_reference_value(env, sink->doneRef, &argv[1]) != napi_ok ||
+		::napi_get_global(env, &global) != napi_ok ||
+		::napi_call_function(env, global, callback, 2, argv, &rval) != napi_ok
+	) {
+		bool pending = false;
+		::napi_is_exception_pending(env, &pending);
+		if (pending) {
+			napi_value error;
+			::napi_get_and_clear_last_exception(env, &error);
+		}
+		sink->state->ack(false);
+	}
+}
+
+/**
+ * The `done([failed])` function passed to the callback with each chunk.
+ */
+napi_value CallbackSink::done(napi_env env, napi_callback_info info) {
+	size_t argc = 1;
+	napi_value argv[1];
+	void* data = NULL;
+	bool failed = false;
+
+	if (::napi_get_cb_info(env, info, &argc, argv, NULL, &data) == napi_ok && argc > 0) {
+		napi_value coerced;
+		if (::napi_coerce_to_bool(env, argv[0], &coerced) == napi_ok) {
+			::napi_get_value_bool(env, coerced, &failed);
+		}
+	}
+
+	static_cast<State*>(data)->ack(!failed);
+	return NULL;
+}
+
+/**
+ * Takes ownership of an open key handle. `path` is the full path of the key including the root.
+ * `depth` is the number of levels of subkeys to export.
+ */
+Exporter::Exporter(Backend* backend, HKEY hkey, const std::wstring& path, ExportFormat format, DWORD depth, ExportSink* sink) :
+	backend(backend),
+	hkey(hkey),
+	path(path),
+	format(format),
+	depth(depth),
+	sink(sink),
+	nameBuffer(256),
+	failed(false)
+{
+	out.reserve(CHUNK_SIZE);
+}
+
+Exporter::~Exporter() {
+	if (hkey != NULL) {
+		backend->closeKey(hkey);
+	}
+}
+
+/**
+ * Exports the tree. Returns the status of the first failure to read the root key, or
+ * `ERROR_WRITE_FAULT` if the sink failed.
+ */
+LSTATUS Exporter::run() {
+	if (format == Binary) {
+		// magic and version
+		const char header[] = { 'W', 'R', 'E', 'G', 1 };
+		out.insert(out.end(), header, header + sizeof(header));
+	}
+
+	LSTATUS status = writeKey(hkey, 0, path);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	std::vector<Frame> stack;
+	stack.push_back({ hkey, 0, path.length() });
+
+	auto pop = [&]() {
+		if (stack.back().hkey != hkey) {
+			backend->closeKey(stack.back().hkey);
+		}
+		stack.pop_back();
+		if (!stack.empty()) {
+			path.resize(stack.back().pathLength);
+		}
+	};
+
+	while (!stack.empty()) {
+		Frame& frame = stack.back();
+		DWORD level = (DWORD)stack.size();
+
+		if (failed || level > depth) {
+			pop();
+			continue;
+		}
+
+		DWORD size = (DWORD)nameBuffer.size();
+		status = backend->enumKey(frame.hkey, frame.index, nameBuffer.data(), &size);
+		if (status == ERROR_MORE_DATA) {
+			nameBuffer.resize(nameBuffer.size() * 2);
+			continue;
+		}
+		if (status != ERROR_SUCCESS) {
+			// the key was deleted while it was being exported
+			if (status != ERROR_NO_MORE_ITEMS) {
+				++stats.skipped;
+			}
+			pop();
+			continue;
+		}
+		++frame.index;
+
+		std::wstring name(nameBuffer.data(), size);
+		HKEY child;
+		if (backend->openKey(frame.hkey, name.c_str(), KEY_READ, NULL, &child) != ERROR_SUCCESS) {
+			++stats.skipped;
+			continue;
+		}
+
+		path += L'\\';
+		path += name;
+		if (writeKey(child, level, name) != ERROR_SUCCESS) {
+			++stats.skipped;
+			backend->closeKey(child);
+			path.resize(frame.pathLength);
+			continue;
+		}
+		stack.push_back({ child, 0, path.length() });
+	}
+
+	if (format == Binary) {
+		out.push_back(TAG_END);
+	}
+	flush(true);
+
+	if (!sink->finish()) {
+		failed = true;
+	}
+	return failed ? ERROR_WRITE_FAULT : ERROR_SUCCESS;
+}
+
+/**
+ * Hands the buffered output to the sink once a chunk is full, or whenever there is output if
+ * `force` is set.
+ */
+bool Exporter::flush(bool force) {
+	if (failed || out.empty() || (!force && out.size() < CHUNK_SIZE)) {
+		return !failed;
+	}
+	stats.bytes += out.size();
+	if (!sink->write(out)) {
+		failed = true;
+	}
+	out.clear();
+	out.reserve(CHUNK_SIZE);
+	return !failed;
+}
+
+/**
+ * Writes a key record followed by its values. The root key is written with its full path, every
+ * other key with just its name in the binary format.
+ */
+LSTATUS Exporter::writeKey(HKEY key, DWORD level, const std::wstring& name) {
+	DWORD maxValueNameLength = 0;
+	DWORD maxValueLength = 0;
+	LSTATUS status = backend->queryInfoKey(key, NULL, NULL, NULL, &maxValueNameLength, &maxValueLength, NULL);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	++stats.keys;
+
+	if (format == Binary) {
+		out.push_back(TAG_KEY);
+		appendVarint(level);
+		const std::wstring& written = level == 0 ? path : name;
+		appendString(written.c_str(), written.length());
+	} else {
+		const char prefix[] = "{\"key\":";
+		out.insert(out.end(), prefix, prefix + sizeof(prefix) - 1);
+		appendJsonString(path.c_str(), path.length());
+		const char values[] = ",\"values\":[";
+		out.insert(out.end(), values, values + sizeof(values) - 1);
+	}
+
+	if (nameBuffer.size() <= maxValueNameLength) {
+		nameBuffer.resize(maxValueNameLength + 1);
+	}
+	if (dataBuffer.size() < maxValueLength) {
+		dataBuffer.resize(maxValueLength);
+	}
+
+	for (DWORD index = 0; !failed; ) {
+		DWORD nameSize = (DWORD)nameBuffer.size();
+		DWORD dataSize = (DWORD)dataBuffer.size();
+		DWORD type = REG_NONE;
+		status = backend->enumValue(key, index, nameBuffer.data(), &nameSize, &type, dataBuffer.data(), &dataSize);
+
+		if (status == ERROR_MORE_DATA) {
+			// the value grew since the key was queried
+			nameBuffer.resize(nameBuffer.size() * 2);
+			dataBuffer.resize(dataSize > dataBuffer.size() ? dataSize : dataBuffer.size() * 2 + 1);
+			continue;
+		}
+		if (status != ERROR_SUCCESS) {
+			// the key was deleted or can no longer be read, so the rest of its values are lost
+			if (status != ERROR_NO_MORE_ITEMS) {
+				++stats.skipped;
+			}
+			break;
+		}
+
+		if (format == Ndjson && index > 0) {
+			out.push_back(',');
+		}
+		writeValue(nameBuffer.data(), nameSize, type, dataBuffer.data(), dataSize);
+		++stats.values;
+		++index;
+		flush(false);
+	}
+
+	if (format == Ndjson) {
+		out.push_back(']');
+		out.push_back('}');
+		out.push_back('\n');
+	}
+
+	flush(false);
+	return ERROR_SUCCESS;
+}
+
+/**
+ * Writes decoded value data as JSON for `decodeValue()`.
+ */
+struct Exporter::JsonValue {
+	typedef void Result;
+
+	JsonValue(Exporter& exporter) : exporter(exporter) {}
+
+	void binary(const BYTE* data, size_t size) {
+		exporter.appendBase64(data, size);
+	}
+
+	void multiString(const MultiString& strings) {
+		exporter.out.push_back('[');
+		bool first = true;
+		strings.forEach([&](const char16_t* str, size_t len) {
+			if (!first) {
+				exporter.out.push_back(',');
+			}
+			first = false;
+			exporter.appendJsonString(str, len);
+			return true;
+		});
+		exporter.out.push_back(']');
+	}
+
+	void null() {
+		append("null");
+	}
+
+	void string(const char16_t* str, size_t len) {
+		exporter.appendJsonString(str, len);
+	}
+
+	void uint32(uint32_t value) {
+		append(std::to_string(value));
+	}
+
+	void uint64(uint64_t value) {
+		append("\"" + std::to_string(value) + "\"");
+	}
+
+	void append(const std::string& str) {
+		exporter.out.insert(exporter.out.end(), str.begin(), str.end());
+	}
+
+	Exporter& exporter;
+};
+
+/**
+ * Writes a value record. In the binary format the data is written as stored in the registry. In
+ * NDJSON, the data is converted to the same type `get()` returns, except that binary data is
+ * base64 encoded and 64-bit integers are always written as decimal strings so none lose
+ * precision.
+ */
+void Exporter::writeValue(const wchar_t* name, DWORD nameSize, DWORD type, const BYTE* data, DWORD dataSize) {
+	if (format == Binary) {
+		out.push_back(TAG_VALUE);
+		appendString(name, nameSize);
+		appendVarint(type);
+		appendVarint(dataSize);
+		out.insert(out.end(), data, data + dataSize);
+		return;
+	}
+
+	const char prefix[] = "{\"name\":";
+	out.insert(out.end(), prefix, prefix + sizeof(prefix) - 1);
+	appendJsonString(name, nameSize);
+
+	std::string str = ",\"type\":";
+	if (type < sizeof(typeNames) / sizeof(typeNames[0])) {
+		str = str + "\"" + typeNames[type] + "\"";
+	} else {
+		str += std::to_string(type);
+	}
+	str += ",\"data\":";
+	out.insert(out.end(), str.begin(), str.end());
+
+	JsonValue sink(*this);
+	decodeValue(sink, type, data, dataSize);
+	out.push_back('}');
+}
+
+/**
+ * Appends data as a base64 JSON string.
+ */
+void Exporter::appendBase64(const BYTE* data, size_t len) {
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	out.push_back('"');
+	size_t i = 0;
+	for (; i + 2 < len; i += 3) {
+		uint32_t n = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+		out.push_back(alphabet[(n >> 18) & 0x3F]);
+		out.push_back(alphabet[(n >> 12) & 0x3F]);
+		out.push_back(alphabet[(n >> 6) & 0x3F]);
+		out.push_back(alphabet[n & 0x3F]);
+	}
+	if (i < len) {
+		uint32_t n = data[i] << 16;
+		if (i + 1 < len) {
+			n |= data[i + 1] << 8;
+		}
+		out.push_back(alphabet[(n >> 18) & 0x3F]);
+		out.push_back(alphabet[(n >> 12) & 0x3F]);
+		out.push_back(i + 1 < len ? alphabet[(n >> 6) & 0x3F] : '=');
+		out.push_back('=');
+	}
+	out.push_back('"');
+}
+
+/**
+ * Appends a quoted and escaped JSON string.
+ */
+template<typename T>
+void Exporter::appendJsonString(const T* str, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	std::string utf8;
+	encodeUtf8(str, len, utf8);
+
+	out.push_back('"');
+	for (unsigned char c : utf8) {
+		if (c == '"' || c == '\\') {
+			out.push_back('\\');
+			out.push_back((char)c);
+		} else if (c < 0x20) {
+			const char escape[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+			out.insert(out.end(), escape, escape + sizeof(escape));
+		} else {
+			out.push_back((char)c);
+		}
+	}
+	out.push_back('"');
+}
+
+/**
+ * Appends a length-prefixed UTF-8 string for the binary format.
+ */
+void Exporter::appendString(const wchar_t* str, size_t len) {
+	std::string utf8;
+	encodeUtf8(str, len, utf8);
+	appendVarint(utf8.length());
+	out.insert(out.end(), utf8.begin(), utf8.end());
+}
+
+/**
+ * Appends an unsigned LEB128 integer for the binary format.
+ */
+void Exporter::appendVarint(uint64_t value) {
+	do {
+		char b = (char)(value & 0x7F);
+		value >>= 7;
+		if (value) {
+			b |= 0x80;
+		}
+		out.push_back(b);
+	} while (value);
+}
@@ -0,0 +1,164 @@
+#ifndef __EXPORTER__
+#define __EXPORTER__
+
+#include "backend.h"
+#include "winreglib.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <uv.h>
+#include <vector>
+
+namespace winreglib {
+
+enum ExportFormat { Ndjson, Binary };
+
+/**
+ * Receives the serialized output of an `Exporter` one chunk at a time. Sinks are written from a
+ * worker thread.
+ */
+class ExportSink {
+public:
+	virtual ~ExportSink() {}
+
+	/**
+	 * Takes the contents of the chunk, leaving it empty. Returns false if the output failed and
+	 * the export should stop.
+	 */
+	virtual bool write(std::vector<char>& chunk) = 0;
+
+	/**
+	 * Waits for every chunk to be written. Returns false if any write failed.
+	 */
+	virtual bool finish() { return true; }
+
+	/**
+	 * Releases resources that belong to the main thread. Called on the main thread once the export
+	 * is complete.
+	 */
+	virtual void close(napi_env env) {}
+
+	std::string error;
+};
+
+/**
+ * Writes chunks synchronously to a file descriptor.
+ */
+class FileSink : public ExportSink {
+public:
+	FileSink(uv_loop_t* loop, uv_file fd) : loop(loop), fd(fd) {}
+
+	bool write(std::vector<char>& chunk);
+
+private:
+	uv_loop_t* loop;
+	uv_file fd;
+};
+
+/**
+ * Passes chunks to a JavaScript function `write(chunk, done)` on the main thread. The function
+ * must call `done()` once the chunk has been consumed or `done(true)` if it failed. At most two
+ * chunks are outstanding at a time, so a slow consumer stalls the export instead of buffering the
+ * whole tree.
+ */
+class CallbackSink : public ExportSink {
+public:
+	CallbackSink();
+
+	void close(napi_env env);
+	bool finish();
+	napi_status init(napi_env env, napi_value callback);
+	bool write(std::vector<char>& chunk);
+
+private:
+	/**
+	 * The flow control state, which is shared with the `done` function and the thread-safe
+	 * function because either may outlive the sink.
+	 */
+	struct State {
+		State() : inFlight(0), failed(false) {}
+
+		void ack(bool ok);
+
+		std::mutex lock;
+		std::condition_variable acked;
+		uint32_t inFlight;
+		bool failed;
+	};
+
+	static void callJs(napi_env env, napi_value callback, void* context, void* data);
+	static napi_value done(napi_env env, napi_callback_info info);
+
+	std::shared_ptr<State> state;
+	napi_threadsafe_function tsfn;
+	napi_ref doneRef;
+};
+
+/**
+ * Counts of what was exported.
+ */
+struct ExportStats {
+	ExportStats() : keys(0), values(0), bytes(0), skipped(0) {}
+
+	uint64_t keys;
+	uint64_t values;
+	uint64_t bytes;
+	uint64_t skipped;
+};
+
+/**
+ * Serializes a key, its values, and its subkeys depth-first into an `ExportSink`.
+ *
+ * The tree is enumerated by index one entry at a time and only the keys from the root to the
+ * current key are held open, so memory use depends on the depth of the tree and the size of the
+ * largest value rather than the size of the tree. Output is buffered in chunks of `CHUNK_SIZE`
+ * bytes.
+ *
+ * Subkeys that can't be opened, for example because they were deleted during the export or access
+ * is denied, are counted as skipped.
+ */
+class Exporter {
+public:
+	static const size_t CHUNK_SIZE = 64 * 1024;
+
+	Exporter(Backend* backend, HKEY hkey, const std::wstring& path, ExportFormat format, DWORD depth, ExportSink* sink);
+	~Exporter();
+
+	LSTATUS run();
+
+	ExportStats stats;
+
+private:
+	struct JsonValue;
+
+	struct Frame {
+		HKEY hkey;
+		DWORD index;
+		size_t pathLength;
+	};
+
+	bool flush(bool force);
+	LSTATUS writeKey(HKEY hkey, DWORD level, const std::wstring& name);
+	void writeValue(const wchar_t* name, DWORD nameSize, DWORD type, const BYTE* data, DWORD dataSize);
+
+	void appendBase64(const BYTE* data, size_t len);
+	template<typename T> void appendJsonString(const T* str, size_t len);
+	void appendString(const wchar_t* str, size_t len);
+	void appendVarint(uint64_t value);
+
+	Backend* backend;
+	HKEY hkey;
+	std::wstring path;
+	ExportFormat format;
+	DWORD depth;
+	ExportSink* sink;
+	std::vector<char> out;
+	std::vector<wchar_t> nameBuffer;
+	std::vector<BYTE> dataBuffer;
+	bool failed;
+};
+
+}
+
+#endif
@@ -0,0 +1,495 @@
+#include "fingerprint.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace winreglib;
+
+/**
+ * Registry keys can't be nested deeper than this, so a snapshot that is nested deeper is
+ * malformed.
+ */
+#define MAX_DEPTH 512
+
+/**
+ * The size of the fixed fields at the start of a key record: hash, content hash, and size.
+ */
+#define KEY_HEADER_SIZE 40
+
+bool Hash::operator==(const Hash& other) const {
+	return ::memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static inline uint64_t readU64(const uint8_t* p) {
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; --i) {
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+static inline uint32_t readU32(const uint8_t* p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+Hash winreglib::hashBytes(const void* data, size_t len) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = 0;
+	uint64_t h2 = 0;
+	size_t nblocks = len / 16;
+
+	for (size_t i = 0; i < nblocks; ++i) {
+		uint64_t k1 = readU64(bytes + i * 16);
+		uint64_t k2 = readU64(bytes + i * 16 + 8);
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	const uint8_t* tail = bytes + nblocks * 16;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+	size_t rem = len & 15;
+
+	for (size_t i = rem; i > 8; --i) {
+		k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
+	}
+	if (rem > 8) {
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+	}
+	for (size_t i = rem < 8 ? rem : 8; i > 0; --i) {
+		k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+	}
+	if (rem > 0) {
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	Hash hash;
+	for (int i = 0; i < 8; ++i) {
+		hash.bytes[i] = (uint8_t)(h1 >> (i * 8));
+		hash.bytes[i + 8] = (uint8_t)(h2 >> (i * 8));
+	}
+	return hash;
+}
+
+static void putU32(std::vector<uint8_t>& out, uint32_t v) {
+	for (int i = 0; i < 4; ++i) {
+		out.push_back((uint8_t)(v >> (i * 8)));
+	}
+}
+
+static void putU64At(std::vector<uint8_t>& out, size_t pos, uint64_t v) {
+	for (int i = 0; i < 8; ++i) {
+		out[pos + i] = (uint8_t)(v >> (i * 8));
+	}
+}
+
+static void putHash(std::vector<uint8_t>& out, const Hash& hash) {
+	out.insert(out.end(), hash.bytes, hash.bytes + sizeof(hash.bytes));
+}
+
+/**
+ * Writes a name as UTF-16 code units. On platforms where `wchar_t` is 32 bits, names hold one
+ * code unit per character, so truncating is lossless.
+ */
+static void putString(std::vector<uint8_t>& out, const std::wstring& str) {
+	putU32(out, (uint32_t)str.length());
+	for (wchar_t c : str) {
+		out.push_back((uint8_t)(c & 0xFF));
+		out.push_back((uint8_t)((c >> 8) & 0xFF));
+	}
+}
+
+Fingerprinter::Fingerprinter(Backend* backend, HKEY hkey, const std::wstring& path) :
+	keys(0),
+	values(0),
+	skipped(0),
+	backend(backend),
+	hkey(hkey),
+	path(path),
+	nameBuffer(256)
+{}
+
+Fingerprinter::~Fingerprinter() {
+	if (hkey != NULL) {
+		backend->closeKey(hkey);
+	}
+}
+
+/**
+ * Builds the snapshot. Returns the status of the failure to read the root key, if any.
+ */
+LSTATUS Fingerprinter::run() {
+	const uint8_t header[] = { 'W', 'R', 'F', 'P', VERSION, 0, 0, 0 };
+	snapshot.assign(header, header + sizeof(header));
+
+	Hash hash;
+	LSTATUS status = writeKey(hkey, path, hash);
+	if (status != ERROR_SUCCESS) {
+		snapshot.clear();
+	}
+	return status;
+}
+
+/**
+ * Appends a key record and the records of its subkeys, then fills in the key's hashes and size.
+ */
+LSTATUS Fingerprinter::writeKey(HKEY key, const std::wstring& name, Hash& hash) {
+	DWORD maxSubkeyLength = 0;
+	DWORD maxValueNameLength = 0;
+	DWORD maxValueLength = 0;
+	LSTATUS status = backend->queryInfoKey(key, NULL, &maxSubkeyLength, NULL, &maxValueNameLength, &maxValueLength, NULL);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	++keys;
+
+	size_t start = snapshot.size();
+	snapshot.resize(start + KEY_HEADER_SIZE);
+	putString(snapshot, name);
+
+	if (nameBuffer.size() <= maxValueNameLength || nameBuffer.size() <= maxSubkeyLength) {
+		nameBuffer.resize((maxValueNameLength > maxSubkeyLength ? maxValueNameLength : maxSubkeyLength) + 1);
+	}
+	if (dataBuffer.size() < maxValueLength) {
+		dataBuffer.resize(maxValueLength);
+	}
+
+	struct Value {
+		std::wstring name;
+		DWORD type;
+		Hash hash;
+	};
+	std::vector<Value> valueList;
+
+	for (DWORD index = 0; ; ) {
+		DWORD nameSize = (DWORD)nameBuffer.size();
+		DWORD dataSize = (DWORD)dataBuffer.size();
+		DWORD type = REG_NONE;
+		status = backend->enumValue(key, index, nameBuffer.data(), &nameSize, &type, dataBuffer.data(), &dataSize);
+
+		if (status == ERROR_MORE_DATA) {
+			// the value grew since the key was queried
+			nameBuffer.resize(nameBuffer.size() * 2);
+			dataBuffer.resize(dataSize > dataBuffer.size() ? dataSize : dataBuffer.size() * 2 + 1);
+			continue;
+		}
+		if (status != ERROR_SUCCESS) {
+			break;
+		}
+
+		valueList.push_back({ std::wstring(nameBuffer.data(), nameSize), type, hashBytes(dataBuffer.data(), dataSize) });
+		++index;
+	}
+
+	NameLess less;
+	std::sort(valueList.begin(), valueList.end(), [&](const Value& a, const Value& b) { return less(a.name, b.name); });
+	values += valueList.size();
+
+	// the content hash covers the same bytes as the value records
+	size_t valuesStart = snapshot.size();
+	putU32(snapshot, (uint32_t)valueList.size());
+	for (const Value& value : valueList) {
+		putString(snapshot, value.name);
+		putU32(snapshot, value.type);
+		putHash(snapshot, value.hash);
+	}
+	Hash contentHash = hashBytes(snapshot.data() + valuesStart, snapshot.size() - valuesStart);
+
+	std::vector<std::wstring> subkeys;
+	for (DWORD index = 0; ; ) {
+		DWORD size = (DWORD)nameBuffer.size();
+		status = backend->enumKey(key, index, nameBuffer.data(), &size);
+		if (status == ERROR_MORE_DATA) {
+			nameBuffer.resize(nameBuffer.size() * 2);
+			continue;
+		}
+		if (status != ERROR_SUCCESS) {
+			// the key was deleted while it was being read
+			if (status != ERROR_NO_MORE_ITEMS) {
+				++skipped;
+			}
+			break;
+		}
+		subkeys.push_back(std::wstring(nameBuffer.data(), size));
+		++index;
+	}
+	std::sort(subkeys.begin(), subkeys.end(), less);
+
+	size_t countPos = snapshot.size();
+	putU32(snapshot, 0);
+
+	std::vector<uint8_t> merkle;
+	putHash(merkle, contentHash);
+	uint32_t count = 0;
+
+	for (const std::wstring& subkey : subkeys) {
+		HKEY child;
+		if (backend->openKey(key, subkey.c_str(), KEY_READ, NULL, &child) != ERROR_SUCCESS) {
+			++skipped;
+			continue;
+		}
+
+		Hash childHash;
+		status = writeKey(child, subkey, childHash);
+		backend->closeKey(child);
+		if (status != ERROR_SUCCESS) {
+			++skipped;
+			continue;
+		}
+
+		putString(merkle, subkey);
+		putHash(merkle, childHash);
+		++count;
+	}
+
+	for (int i = 0; i < 4; ++i) {
+		snapshot[countPos + i] = (uint8_t)(count >> (i * 8));
+	}
+
+	hash = hashBytes(merkle.data(), merkle.size());
+	::memcpy(snapshot.data() + start, hash.bytes, sizeof(hash.bytes));
+	::memcpy(snapshot.data() + start + 16, contentHash.bytes, sizeof(contentHash.bytes));
+	putU64At(snapshot, start + 32, snapshot.size() - start);
+
+	return ERROR_SUCCESS;
+}
+
+namespace {
+
+/**
+ * A bounds checked view of a key record in a snapshot.
+ */
+struct KeyRecord {
+	const uint8_t* hash;
+	const uint8_t* contentHash;
+	size_t end;
+	size_t valuesPos;
+	std::wstring name;
+};
+
+struct ValueRecord {
+	std::wstring name;
+	uint32_t type;
+	const uint8_t* hash;
+};
+
+class SnapshotReader {
+public:
+	SnapshotReader(const uint8_t* data, size_t len) : data(data), len(len) {}
+
+	bool readHeader() {
+		return len >= 8 && ::memcmp(data, "WRFP", 4) == 0 && data[4] == Fingerprinter::VERSION;
+	}
+
+	/**
+	 * Reads the fixed fields and name of the key record at `pos`, which must end by `limit`.
+	 */
+	bool readKey(size_t pos, size_t limit, KeyRecord& key) {
+		if (limit > len || pos > limit || limit - pos < KEY_HEADER_SIZE) {
+			return false;
+		}
+		uint64_t size = readU64(data + pos + 32);
+		if (size < KEY_HEADER_SIZE || size > limit - pos) {
+			return false;
+		}
+		key.hash = data + pos;
+		key.contentHash = data + pos + 16;
+		key.end = pos + (size_t)size;
+		key.valuesPos = pos + KEY_HEADER_SIZE;
+		return readString(key.valuesPos, key.end, key.name);
+	}
+
+	/**
+	 * Reads the values of a key and returns the position of its subkey count.
+	 */
+	bool readValues(const KeyRecord& key, std::vector<ValueRecord>* values, size_t& pos) {
+		pos = key.valuesPos;
+		uint32_t count;
+		if (!readU32At(pos, key.end, count)) {
+			return false;
+		}
+		ValueRecord value;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (!readString(pos, key.end, value.name) || !readU32At(pos, key.end, value.type) || key.end - pos < 16) {
+				return false;
+			}
+			value.hash = data + pos;
+			pos += 16;
+			if (values) {
+				values->push_back(value);
+			}
+		}
+		return true;
+	}
+
+	bool readU32At(size_t& pos, size_t limit, uint32_t& value) {
+		if (limit - pos < 4) {
+			return false;
+		}
+		value = readU32(data + pos);
+		pos += 4;
+		return true;
+	}
+
+	bool readString(size_t& pos, size_t limit, std::wstring& str) {
+		uint32_t length;
+		if (!readU32At(pos, limit, length) || (limit - pos) / 2 < length) {
+			return false;
+		}
+		str.resize(length);
+		for (uint32_t i = 0; i < length; ++i) {
+			str[i] = (wchar_t)(data[pos] | (data[pos + 1] << 8));
+			pos += 2;
+		}
+		return true;
+	}
+
+	const uint8_t* data;
+	size_t len;
+};
+
+class Differ {
+public:
+	Differ(const uint8_t* a, size_t aLen, const uint8_t* b, size_t bLen, std::vector<DiffEntry>& result) :
+		a(a, aLen), b(b, bLen), result(result) {}
+
+	bool run() {
+		if (!a.readHeader() || !b.readHeader()) {
+			return false;
+		}
+		KeyRecord ka, kb;
+		if (!a.readKey(8, a.len, ka) || ka.end != a.len || !b.readKey(8, b.len, kb) || kb.end != b.len) {
+			return false;
+		}
+		std::wstring path;
+		return diffKey(ka, kb, path, 0);
+	}
+
+private:
+	void add(DiffEntry::Type type, const std::wstring& key, const std::wstring* value) {
+		result.push_back({ type, key, value ? *value : std::wstring(), value != NULL });
+	}
+
+	/**
+	 * Reads the subkey records that follow the values of a key.
+	 */
+	bool readSubkeys(SnapshotReader& reader, const KeyRecord& key, size_t pos, std::vector<KeyRecord>& subkeys) {
+		uint32_t count;
+		// every key record holds at least its fixed fields and name length
+		if (!reader.readU32At(pos, key.end, count) || count > (key.end - pos) / (KEY_HEADER_SIZE + 4)) {
+			return false;
+		}
+		subkeys.resize(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			if (!reader.readKey(pos, key.end, subkeys[i])) {
+				return false;
+			}
+			pos = subkeys[i].end;
+		}
+		return pos == key.end;
+	}
+
+	bool diffKey(const KeyRecord& ka, const KeyRecord& kb, std::wstring& path, int depth) {
+		if (::memcmp(ka.hash, kb.hash, 16) == 0) {
+			return true;
+		}
+		if (depth > MAX_DEPTH) {
+			return false;
+		}
+
+		bool contentChanged = ::memcmp(ka.contentHash, kb.contentHash, 16) != 0;
+		std::vector<ValueRecord> va, vb;
+		size_t pa, pb;
+		if (!a.readValues(ka, contentChanged ? &va : NULL, pa) || !b.readValues(kb, contentChanged ? &vb : NULL, pb)) {
+			return false;
+		}
+
+		NameLess less;
+		if (contentChanged) {
+			size_t i = 0, j = 0;
+			while (i < va.size() || j < vb.size()) {
+				if (j == vb.size() || (i < va.size() && less(va[i].name, vb[j].name))) {
+					add(DiffEntry::Removed, path, &va[i++].name);
+				} else if (i == va.size() || less(vb[j].name, va[i].name)) {
+					add(DiffEntry::Added, path, &vb[j++].name);
+				} else {
+					if (va[i].type != vb[j].type || ::memcmp(va[i].hash, vb[j].hash, 16) != 0) {
+						add(DiffEntry::Modified, path, &vb[j].name);
+					}
+					++i;
+					++j;
+				}
+			}
+		}
+
+		std::vector<KeyRecord> sa, sb;
+		if (!readSubkeys(a, ka, pa, sa) || !readSubkeys(b, kb, pb, sb)) {
+			return false;
+		}
+
+		size_t pathLength = path.length();
+		auto childPath = [&](const std::wstring& name) -> std::wstring& {
+			path.resize(pathLength);
+			if (pathLength) {
+				path += L'\\';
+			}
+			path += name;
+			return path;
+		};
+
+		size_t i = 0, j = 0;
+		while (i < sa.size() || j < sb.size()) {
+			if (j == sb.size() || (i < sa.size() && less(sa[i].name, sb[j].name))) {
+				add(DiffEntry::Removed, childPath(sa[i++].name), NULL);
+			} else if (i == sa.size() || less(sb[j].name, sa[i].name)) {
+				add(DiffEntry::Added, childPath(sb[j++].name), NULL);
+			} else {
+				if (!diffKey(sa[i], sb[j], childPath(sb[j].name), depth + 1)) {
+					return false;
+				}
+				++i;
+				++j;
+			}
+		}
+		path.resize(pathLength);
+		return true;
+	}
+
+	SnapshotReader a;
+	SnapshotReader b;
+	std::vector<DiffEntry>& result;
+};
+
+}
+
+bool winreglib::diffSnapshots(const uint8_t* a, size_t aLen, const uint8_t* b, size_t bLen, std::vector<DiffEntry>& result) {
+	return Differ(a, aLen, b, bLen, result).run();
+}
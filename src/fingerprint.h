@@ -0,0 +1,98 @@
+#ifndef __FINGERPRINT__
+#define __FINGERPRINT__
+
+#include "backend.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * A 128-bit content hash.
+ */
+struct Hash {
+	uint8_t bytes[16];
+
+	bool operator==(const Hash& other) const;
+	bool operator!=(const Hash& other) const { return !(*this == other); }
+};
+
+/**
+ * Hashes a buffer with MurmurHash3 (x64, 128-bit).
+ */
+Hash hashBytes(const void* data, size_t len);
+
+/**
+ * Builds a snapshot of a key and its subkeys where every key carries a hash of its values and a
+ * Merkle hash of its values and subkeys.
+ *
+ * The snapshot is a flat buffer:
+ *
+ *   header:  "WRFP" version:u8 0 0 0
+ *   key:     hash:16 contentHash:16 size:u64 name:string
+ *            numValues:u32 { name:string type:u32 hash:16 }...
+ *            numSubkeys:u32 key...
+ *   string:  length:u32 UTF-16 code units
+ *
+ * Integers are little endian. `size` is the number of bytes from the start of the key record to
+ * the end of its last subkey, so a subtree can be skipped without reading it. Values and subkeys
+ * are sorted case-insensitively. A key's `hash` covers its values and the names and hashes of its
+ * subkeys, but not its own name, so two trees can be compared regardless of where they live.
+ *
+ * The root key record holds the full path of the key. Subkeys that can't be opened are left out
+ * and counted as skipped.
+ */
+class Fingerprinter {
+public:
+	static const uint8_t VERSION = 1;
+
+	/**
+	 * Takes ownership of an open key handle.
+	 */
+	Fingerprinter(Backend* backend, HKEY hkey, const std::wstring& path);
+	~Fingerprinter();
+
+	LSTATUS run();
+
+	std::vector<uint8_t> snapshot;
+	uint64_t keys;
+	uint64_t values;
+	uint64_t skipped;
+
+private:
+	LSTATUS writeKey(HKEY key, const std::wstring& name, Hash& hash);
+
+	Backend* backend;
+	HKEY hkey;
+	std::wstring path;
+	std::vector<wchar_t> nameBuffer;
+	std::vector<BYTE> dataBuffer;
+};
+
+/**
+ * A difference between two snapshots. `key` is relative to the root of the snapshots and is empty
+ * for the root itself. `value` is empty for keys that were added or removed.
+ */
+struct DiffEntry {
+	enum Type { Added, Removed, Modified };
+
+	Type type;
+	std::wstring key;
+	std::wstring value;
+	bool isValue;
+};
+
+/**
+ * Compares two snapshots and appends the keys and values that were added to, removed from, or
+ * modified in `b` relative to `a`. Subtrees whose hashes match are skipped without being read, so
+ * the cost depends on the number of differences rather than the size of the trees. When a key is
+ * added or removed, only the key itself is reported, not its values or subkeys.
+ *
+ * Returns false if either snapshot is malformed.
+ */
+bool diffSnapshots(const uint8_t* a, size_t aLen, const uint8_t* b, size_t bLen, std::vector<DiffEntry>& result);
+
+}
+
+#endif
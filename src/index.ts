@@ -1,5 +1,12 @@
 import { EventEmitter } from 'node:events';
-import { dirname } from 'node:path';
+import {
+	closeSync,
+	mkdirSync,
+	openSync,
+	readFileSync,
+	writeFileSync
+} from 'node:fs';
+import { dirname, resolve } from 'node:path';
 import { fileURLToPath } from 'node:url';
 import nodeGypBuild from 'node-gyp-build/node-gyp-build.js';
 import snooplogg, { type Logger } from 'snooplogg';
@@ -16,14 +23,535 @@ export class WinRegLibWatchHandle extends EventEmitter {
 	key: string;
 	stop: () => void;
 
-	constructor(key: string) {
+	constructor(key: string, pattern = false) {
 		super();
 		this.key = key;
 
 		const emitter = this.emit.bind(this);
-		binding.watch(key, emitter);
+		binding.watch(key, emitter, pattern);
 
-		this.stop = () => binding.unwatch(this.key, emitter);
+		this.stop = () => binding.unwatch(this.key, emitter, pattern);
+	}
+}
+
+/**
+ * A handle for watching many registry keys for changes, returned by `watchMany()`. The `key` of
+ * each event says which key changed.
+ */
+export class WinRegLibWatchManyHandle extends EventEmitter {
+	keys: string[];
+	ready: Promise<void>;
+	stop: () => void;
+
+	constructor(keys: string[], pattern = false) {
+		super();
+		this.keys = keys;
+
+		const emitter = this.emit.bind(this);
+		this.ready = binding.watchMany(keys, emitter, pattern);
+
+		this.stop = () => binding.unwatchMany(this.keys, emitter, pattern);
+	}
+}
+
+/**
+ * Samples performance counters from `HKEY_PERFORMANCE_DATA`. The sampler keeps its read buffer
+ * and parsed structures between samples, so sampling the same objects repeatedly allocates little
+ * more than the returned typed arrays.
+ */
+export class PerfSampler {
+	#reader: unknown;
+
+	constructor(query: string) {
+		this.#reader = binding.openPerfData(query);
+	}
+
+	/**
+	 * Reads and parses a sample.
+	 *
+	 * @returns {PerfSample} The sample.
+	 */
+	sample(): PerfSample {
+		return binding.readPerfData(this.#reader);
+	}
+
+	/**
+	 * Releases the performance data. The sampler can't be used after it has been closed.
+	 */
+	close(): void {
+		binding.closePerfData(this.#reader);
+	}
+}
+
+/**
+ * A durable journal of watch events. While it is open, every event emitted by a watch handle is
+ * appended with a sequence number, which is also set as the event's `seq`, so a consumer that
+ * restarts can catch up with `readSince()` instead of rescanning what it watches.
+ */
+export class Journal {
+	dir: string;
+	#closed = false;
+
+	constructor(dir: string) {
+		this.dir = dir;
+	}
+
+	/**
+	 * The sequence number of the oldest entry that hasn't been compacted.
+	 */
+	get firstSeq(): number {
+		return this.#info().firstSeq;
+	}
+
+	/**
+	 * The sequence number of the newest entry, or `0` if the journal is empty.
+	 */
+	get lastSeq(): number {
+		return this.#info().lastSeq;
+	}
+
+	/**
+	 * Reads the entries after a sequence number. Throws an error with the code
+	 * `ERR_WINREG_JOURNAL_COMPACTED` if some of them have been compacted, in which case the
+	 * consumer has to rescan.
+	 *
+	 * @param {Number} seq - The last sequence number the consumer has seen, or `0` for everything.
+	 * @param {Number} [limit] - The maximum number of entries to return.
+	 * @returns {Array.<JournalEntry>} The entries in order.
+	 */
+	readSince(seq: number, limit = Infinity): JournalEntry[] {
+		if (typeof seq !== 'number' || seq < 0) {
+			throw new TypeError('Expected sequence number to be a non-negative number');
+		}
+		if (typeof limit !== 'number' || limit < 0) {
+			throw new TypeError('Expected limit to be a non-negative number');
+		}
+		this.#check();
+		const entries: JournalEntry[] = binding.readJournal(seq, limit);
+		for (const entry of entries) {
+			for (const value of entry.values ?? []) {
+				value.type = valueTypeNames[value.type as unknown as number] ?? value.type;
+			}
+		}
+		return entries;
+	}
+
+	/**
+	 * Deletes the segments that only hold entries up to a sequence number, typically the one
+	 * every consumer has caught up to. The newest segment is always kept.
+	 *
+	 * @param {Number} seq - The sequence number.
+	 * @returns {Number} The number of segments deleted.
+	 */
+	compact(seq: number): number {
+		if (typeof seq !== 'number' || seq < 0) {
+			throw new TypeError('Expected sequence number to be a non-negative number');
+		}
+		this.#check();
+		return binding.compactJournal(seq);
+	}
+
+	/**
+	 * Writes and syncs the buffered entries regardless of the journal's `fsync` policy.
+	 */
+	flush(): void {
+		this.#check();
+		binding.flushJournal();
+	}
+
+	/**
+	 * Flushes the journal and stops recording events.
+	 */
+	close(): void {
+		if (!this.#closed) {
+			this.#closed = true;
+			binding.closeJournal();
+		}
+	}
+
+	#check(): void {
+		if (this.#closed) {
+			throw new Error('Journal has been closed');
+		}
+	}
+
+	#info(): { firstSeq: number; lastSeq: number } {
+		this.#check();
+		return binding.journalInfo();
+	}
+}
+
+/**
+ * A subtree mirrored into shared memory by `publishSharedCache()`. Every key in the subtree is
+ * watched and re-read when it changes, so other processes can read it with `openSharedCache()`
+ * instead of watching and reading it themselves. Emits `error` if a change couldn't be written.
+ */
+export class SharedCachePublisher extends EventEmitter {
+	name: string;
+	key: string;
+	#cache: unknown;
+	#handles: Map<string, WinRegLibWatchHandle> | null;
+
+	constructor(
+		name: string,
+		key: string,
+		cache: unknown,
+		added: string[],
+		watch: boolean
+	) {
+		super();
+		this.name = name;
+		this.key = key;
+		this.#cache = cache;
+		this.#handles = watch ? new Map() : null;
+		this.#track(added, []);
+	}
+
+	/**
+	 * Re-reads a key, and any subkeys that were added, without waiting for a watch event. Without
+	 * a key, re-reads the whole subtree. Needed when the publisher isn't watching.
+	 *
+	 * @param {String} [key] - The key to re-read.
+	 */
+	refresh(key?: string): void {
+		if (!this.#cache) {
+			throw new Error('Shared cache has been unpublished');
+		}
+		const { added, removed } = binding.syncSharedCache(
+			this.#cache,
+			key ?? this.key,
+			key === undefined
+		);
+		this.#track(added, removed);
+	}
+
+	/**
+	 * Stops watching and releases the shared memory. Readers that still have the cache open get
+	 * an error with the code `ERR_WINREG_SHARED_CACHE_CLOSED`.
+	 */
+	close(): void {
+		if (this.#cache) {
+			for (const handle of this.#handles?.values() ?? []) {
+				handle.stop();
+			}
+			this.#handles?.clear();
+			binding.unpublishSharedCache(this.#cache);
+			this.#cache = undefined;
+		}
+	}
+
+	#track(added: string[], removed: string[]): void {
+		if (!this.#handles) {
+			return;
+		}
+		for (const key of removed) {
+			const folded = key.toUpperCase();
+			this.#handles.get(folded)?.stop();
+			this.#handles.delete(folded);
+		}
+		for (const key of added) {
+			const handle = new WinRegLibWatchHandle(key);
+			handle.on('change', (evt: { key: string }) => {
+				try {
+					if (this.#cache) {
+						this.refresh(evt.key);
+					}
+				} catch (err) {
+					this.emit('error', err);
+				}
+			});
+			this.#handles.set(key.toUpperCase(), handle);
+		}
+	}
+}
+
+/**
+ * A read-only mapping of a subtree published by this or another process. Lookups copy from
+ * shared memory without calling into the registry.
+ */
+export class SharedCache {
+	name: string;
+	key: string;
+	#cache: unknown;
+
+	constructor(name: string, key: string, cache: unknown) {
+		this.name = name;
+		this.key = key;
+		this.#cache = cache;
+	}
+
+	/**
+	 * The number of times the publisher has written to the cache.
+	 */
+	get version(): number {
+		return binding.sharedCacheVersion(this.#check());
+	}
+
+	/**
+	 * Gets a value. Throws an error with the code `ERR_WINREG_KEY_NOT_SHARED` if the key is
+	 * outside of the published subtree.
+	 *
+	 * @param {String} key - The key beginning with the root.
+	 * @param {String} valueName - The name of the value.
+	 * @returns {*} The value, or `undefined` if the key or value doesn't exist.
+	 */
+	get(key: string, valueName: string): unknown {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+		if (typeof valueName !== 'string') {
+			throw new TypeError('Expected value name to be a string');
+		}
+		return binding.readSharedCache(this.#check(), key, valueName);
+	}
+
+	/**
+	 * Lists a key's subkeys and values.
+	 *
+	 * @param {String} key - The key beginning with the root.
+	 * @returns {RegistryKey} Contains the resolved `resolvedRoot`, `key`, `subkeys`, and `values`.
+	 */
+	list(key: string): RegistryKey | undefined {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+		return binding.listSharedCache(this.#check(), key);
+	}
+
+	/**
+	 * Unmaps the cache.
+	 */
+	close(): void {
+		if (this.#cache) {
+			binding.closeSharedCache(this.#cache);
+			this.#cache = undefined;
+		}
+	}
+
+	#check(): unknown {
+		if (!this.#cache) {
+			throw new Error('Shared cache has been closed');
+		}
+		return this.#cache;
+	}
+}
+
+/**
+ * Decodes a range of UTF-16 code units. Long ranges are decoded in chunks to stay within the
+ * engine's argument limit.
+ */
+const decodeUnits = (units: Uint16Array, start: number, end: number): string => {
+	let str = '';
+	for (let i = start; i < end; i += 8192) {
+		str += String.fromCharCode.apply(
+			null,
+			units.subarray(i, Math.min(end, i + 8192)) as unknown as number[]
+		);
+	}
+	return str;
+};
+
+/**
+ * A list of names packed into one array of UTF-16 code units. Strings are only created for the
+ * names that are read.
+ */
+export class NameColumn implements Iterable<string> {
+	/**
+	 * The code units of every name, one after another.
+	 */
+	readonly units: Uint16Array;
+
+	/**
+	 * Name `i` is `units[offsets[i]]` up to `units[offsets[i + 1]]`.
+	 */
+	readonly offsets: Uint32Array;
+
+	constructor(units: Uint16Array, offsets: Uint32Array) {
+		this.units = units;
+		this.offsets = offsets;
+	}
+
+	get length(): number {
+		return this.offsets.length - 1;
+	}
+
+	/**
+	 * Decodes a name. Negative indexes count back from the end.
+	 *
+	 * @param {Number} index - The index of the name.
+	 * @returns {String} The name, or `undefined` if the index is out of range.
+	 */
+	at(index: number): string | undefined {
+		const i = index < 0 ? this.length + index : index;
+		if (i < 0 || i >= this.length) {
+			return undefined;
+		}
+		return decodeUnits(this.units, this.offsets[i], this.offsets[i + 1]);
+	}
+
+	/**
+	 * Finds a name, ignoring case like the registry does. Only names of the same length are
+	 * decoded.
+	 *
+	 * @param {String} name - The name to find.
+	 * @returns {Number} The index of the name, or `-1` if it isn't in the column.
+	 */
+	indexOf(name: string): number {
+		const target = name.toLowerCase();
+		const { offsets, units } = this;
+		for (let i = 0; i < this.length; i++) {
+			if (
+				offsets[i + 1] - offsets[i] === name.length &&
+				decodeUnits(units, offsets[i], offsets[i + 1]).toLowerCase() === target
+			) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	*[Symbol.iterator](): Iterator<string> {
+		for (let i = 0; i < this.length; i++) {
+			yield decodeUnits(this.units, this.offsets[i], this.offsets[i + 1]);
+		}
+	}
+
+	/**
+	 * Decodes every name.
+	 *
+	 * @returns {Array<String>} The names.
+	 */
+	toArray(): string[] {
+		return Array.from(this);
+	}
+}
+
+// how each value is stored in a columnar result, matching `ColumnKind` in columns.h
+const ColumnKind = {
+	Null: 0,
+	String: 1,
+	MultiString: 2,
+	Number: 3,
+	BigInt: 4,
+	Binary: 5
+} as const;
+
+type NativeColumns = {
+	keys: Uint16Array;
+	keyOffsets: Uint32Array;
+	names: Uint16Array;
+	nameOffsets: Uint32Array;
+	rows: Uint32Array;
+	types: Uint32Array;
+	kinds: Uint8Array;
+	numbers: Float64Array;
+	text: Uint16Array;
+	textOffsets: Uint32Array;
+	data: Uint8Array;
+	dataOffsets: Uint32Array;
+};
+
+/**
+ * The rows of a columnar query result. Every value of every row is in one set of columns, and
+ * values are only converted when they are read.
+ */
+export class QueryColumns implements Iterable<QueryRow> {
+	/**
+	 * The matched keys.
+	 */
+	readonly keys: NameColumn;
+
+	/**
+	 * The names of the values of every row, one row after another.
+	 */
+	readonly valueNames: NameColumn;
+
+	/**
+	 * The type of each value, such as `1` for `REG_SZ`.
+	 */
+	readonly valueTypes: Uint32Array;
+
+	/**
+	 * Each value as a number, or `NaN` if it isn't a number that fits in one. Numeric values can
+	 * be read from here without converting anything.
+	 */
+	readonly numbers: Float64Array;
+
+	#columns: NativeColumns;
+
+	constructor(columns: NativeColumns) {
+		this.#columns = columns;
+		this.keys = new NameColumn(columns.keys, columns.keyOffsets);
+		this.valueNames = new NameColumn(columns.names, columns.nameOffsets);
+		this.valueTypes = columns.types;
+		this.numbers = columns.numbers;
+	}
+
+	get length(): number {
+		return this.keys.length;
+	}
+
+	/**
+	 * Returns the range of `valueNames`, `valueTypes`, and `numbers` that belongs to a row.
+	 *
+	 * @param {Number} row - The index of the row.
+	 * @returns {Object} The `start` (inclusive) and `end` (exclusive) indexes.
+	 */
+	rowValues(row: number): { start: number; end: number } {
+		const { rows } = this.#columns;
+		return { start: rows[row], end: rows[row + 1] };
+	}
+
+	/**
+	 * Converts a value the same way as `get()`. Binary data is a view of the result's buffer.
+	 *
+	 * @param {Number} index - The index of the value across all rows.
+	 * @returns {*} The value.
+	 */
+	value(index: number): RegistryValue {
+		const { kinds, text, textOffsets, data, dataOffsets } = this.#columns;
+		const start = dataOffsets[index];
+		const end = dataOffsets[index + 1];
+		switch (kinds[index]) {
+			case ColumnKind.String:
+				return decodeUnits(text, textOffsets[index], textOffsets[index + 1]);
+			case ColumnKind.MultiString: {
+				const joined = decodeUnits(text, textOffsets[index], textOffsets[index + 1]);
+				return joined ? joined.split('\0') : [];
+			}
+			case ColumnKind.Number:
+				return this.numbers[index];
+			case ColumnKind.BigInt:
+				// like `get()`, a number even though it loses precision
+				return Number(
+					new DataView(data.buffer, data.byteOffset + start, 8).getBigUint64(0, true)
+				);
+			case ColumnKind.Binary:
+				return Buffer.from(data.buffer, data.byteOffset + start, end - start);
+			default:
+				return null;
+		}
+	}
+
+	/**
+	 * Converts a row to the object `query()` returns without `columnar`.
+	 *
+	 * @param {Number} row - The index of the row.
+	 * @returns {QueryRow} The key and its values.
+	 */
+	row(row: number): QueryRow {
+		const { start, end } = this.rowValues(row);
+		const values: Record<string, unknown> = {};
+		for (let i = start; i < end; i++) {
+			values[this.valueNames.at(i) as string] = this.value(i);
+		}
+		return { key: this.keys.at(row) as string, values };
+	}
+
+	*[Symbol.iterator](): Iterator<QueryRow> {
+		for (let i = 0; i < this.length; i++) {
+			yield this.row(i);
+		}
 	}
 }
 
@@ -34,37 +562,1380 @@ export type RegistryKey = {
 	values: unknown[];
 };
 
-/**
- * Loads the `winreglib` native module and provides an API for interacting
- * with the Windows registry.
- */
-export class WinRegLib extends EventEmitter {
-	nss: Record<string, Logger> = {};
+export type RegistryValueType =
+	| 'REG_NONE'
+	| 'REG_SZ'
+	| 'REG_EXPAND_SZ'
+	| 'REG_BINARY'
+	| 'REG_DWORD'
+	| 'REG_DWORD_BIG_ENDIAN'
+	| 'REG_LINK'
+	| 'REG_MULTI_SZ'
+	| 'REG_RESOURCE_LIST'
+	| 'REG_FULL_RESOURCE_DESCRIPTOR'
+	| 'REG_RESOURCE_REQUIREMENTS_LIST'
+	| 'REG_QWORD';
+
+const valueTypes: Record<RegistryValueType, number> = {
+	REG_NONE: 0,
+	REG_SZ: 1,
+	REG_EXPAND_SZ: 2,
+	REG_BINARY: 3,
+	REG_DWORD: 4,
+	REG_DWORD_BIG_ENDIAN: 5,
+	REG_LINK: 6,
+	REG_MULTI_SZ: 7,
+	REG_RESOURCE_LIST: 8,
+	REG_FULL_RESOURCE_DESCRIPTOR: 9,
+	REG_RESOURCE_REQUIREMENTS_LIST: 10,
+	REG_QWORD: 11
+};
+
+const valueTypeNames = Object.fromEntries(
+	Object.entries(valueTypes).map(([name, type]) => [type, name])
+) as Record<number, RegistryValueType>;
+
+export type RegistryValue =
+	| string
+	| string[]
+	| number
+	| bigint
+	| Buffer
+	| ArrayBufferView
+	| null;
+
+export type BatchOperation =
+	| {
+			op: 'set';
+			key: string;
+			name: string;
+			value: RegistryValue;
+			type?: RegistryValueType;
+	  }
+	| { op: 'delete'; key: string; name?: string }
+	| { op: 'createKey'; key: string };
+
+export type BatchOptions = {
+	/**
+	 * When `true`, either every operation is applied or none are. On Windows, this uses a Kernel
+	 * Transaction Manager transaction.
+	 */
+	transaction?: boolean;
+
+	/**
+	 * When `true`, watch handles in this process will not emit change events caused by the batch.
+	 */
+	quiet?: boolean;
+};
+
+export type BatchResult = {
+	success: boolean;
+	error?: Error & { code: string };
+};
+
+export type RegistryBackend = 'win32' | 'memory';
+
+export type IterateKeyOptions = {
+	/**
+	 * The maximum number of subkey and value names per page. Defaults to `1000`.
+	 */
+	pageSize?: number;
+};
+
+export type RegistryKeyPage = {
+	subkeys: string[];
+	values: string[];
+};
+
+export type GetOptions = {
+	/**
+	 * When `true`, `REG_QWORD` values are returned as a `bigint`. By default, they are returned as
+	 * a `number`, which loses precision above `Number.MAX_SAFE_INTEGER`.
+	 */
+	bigint?: boolean;
+};
+
+export type WatchOptions = {
+	/**
+	 * When `true`, a subkey of `*` matches any one subkey and `**` any number of them. By default,
+	 * they are key names like any other, such as the `*` in `HKCR\*\shellex`.
+	 */
+	pattern?: boolean;
+};
+
+export type ExportTreeOptions = {
+	/**
+	 * `ndjson` writes one JSON object per key. `binary` writes the compact format described in the
+	 * README. Defaults to `ndjson`.
+	 */
+	format?: 'ndjson' | 'binary';
+
+	/**
+	 * The number of levels of subkeys to export. `0` exports only the key's values. Defaults to
+	 * `Infinity`.
+	 */
+	depth?: number;
+};
+
+export type ExportTreeResult = {
+	keys: number;
+	values: number;
+	bytes: number;
+	skipped: number;
+};
+
+export type DiffEntry = {
+	/**
+	 * Whether the key or value exists only in the second tree (`added`), only in the first tree
+	 * (`removed`), or in both with different data or types (`modified`).
+	 */
+	type: 'added' | 'removed' | 'modified';
+
+	/**
+	 * The path of the key relative to the compared keys. An empty string is the compared key
+	 * itself.
+	 */
+	key: string;
+
+	/**
+	 * The name of the value. Not set when a key was added or removed.
+	 */
+	value?: string;
+};
+
+export type KeyInfo = {
+	subkeys: number;
+	values: number;
+	maxSubkeyLength: number;
+	maxValueNameLength: number;
+	maxValueLength: number;
+	lastWriteTime: Date;
+};
+
+export type ScanValue = {
+	name: string;
+
+	/**
+	 * The value type, or its number if it isn't a known type.
+	 */
+	type: RegistryValueType | number;
+
+	/**
+	 * The data converted the same way as `get()`, except that binary data and integers with the
+	 * wrong length are returned as a `Buffer`.
+	 */
+	data: unknown;
+};
+
+export type ScanKey = {
+	/**
+	 * The name of the key, or for the scanned key, the key that was passed to `scan()`.
+	 */
+	name: string;
+	lastWriteTime: Date;
+	values: ScanValue[];
+	subkeys: ScanKey[];
+};
+
+export type ScanResult = {
+	key: string;
+	root: ScanKey;
+
+	/**
+	 * The number of keys that were visited.
+	 */
+	keys: number;
+
+	/**
+	 * The number of keys whose values and subkeys were read because they are new or their last
+	 * write time moved.
+	 */
+	changed: number;
+
+	/**
+	 * The number of subkeys that could not be read.
+	 */
+	skipped: number;
+};
+
+export type QueryOptions = {
+	/**
+	 * The names of the values to read from each matched key. Names may contain `*` and `?`. An
+	 * empty name is the key's default value. When omitted, no values are read.
+	 */
+	values?: string[];
+
+	/**
+	 * When `true`, `rows` is a `QueryColumns` instead of an array of objects.
+	 */
+	columnar?: boolean;
+};
+
+export type QueryRow = {
+	key: string;
+
+	/**
+	 * The requested values that exist, by name, converted the same way as `get()`.
+	 */
+	values: Record<string, unknown>;
+};
+
+export type QueryResult = {
+	/**
+	 * The matched keys, sorted by key.
+	 */
+	rows: QueryRow[];
+
+	/**
+	 * The number of keys that were visited.
+	 */
+	keys: number;
+
+	/**
+	 * The number of keys that could not be read.
+	 */
+	skipped: number;
+};
+
+export type ColumnarQueryResult = Omit<QueryResult, 'rows'> & {
+	rows: QueryColumns;
+};
+
+export type ListOptions = {
+	/**
+	 * When `true`, subkeys and values are returned as `NameColumn`s along with the value types.
+	 */
+	columnar?: boolean;
+};
+
+export type ColumnarRegistryKey = {
+	resolvedRoot: string;
+	key: string;
+	subkeys: NameColumn;
+	values: NameColumn;
+
+	/**
+	 * The type of each value, such as `1` for `REG_SZ`.
+	 */
+	types: Uint32Array;
+};
+
+export type ReplayOptions = {
+	/**
+	 * `recorded` makes each call take as long as it did when it was recorded and fires change
+	 * notifications after the recorded delays. `fast` returns every call immediately. Defaults to
+	 * `fast`.
+	 */
+	speed?: 'recorded' | 'fast';
+};
+
+export type PerfCounters = {
+	/**
+	 * The counter name indexes, which are looked up in the `Counter` value of
+	 * `HKEY_PERFORMANCE_TEXT`.
+	 */
+	index: Uint32Array;
+	helpIndex: Uint32Array;
+
+	/**
+	 * The `PERF_COUNTER_*` type flags, which determine how values are combined into a displayed
+	 * value.
+	 */
+	type: Uint32Array;
+	size: Uint32Array;
+
+	/**
+	 * The power of 10 each value is scaled by for display.
+	 */
+	scale: Int32Array;
+	detailLevel: Uint32Array;
+};
+
+export type PerfInstances = {
+	name: string[];
+	parentObject: Uint32Array;
+	parentInstance: Uint32Array;
+	uniqueId: Int32Array;
+};
+
+export type PerfObject = {
+	index: number;
+	helpIndex: number;
+	detailLevel: number;
+	defaultCounter: number;
+	time: number;
+	frequency: number;
+	counters: PerfCounters;
+
+	/**
+	 * The object's instances, or `null` if the object doesn't have instances.
+	 */
+	instances: PerfInstances | null;
+
+	/**
+	 * The raw counter values, one row of `counters.index.length` values per instance, or a single
+	 * row if the object doesn't have instances. Counters that aren't 4 or 8 bytes are `NaN`.
+	 */
+	values: Float64Array;
+};
+
+export type PerfSample = {
+	systemName: string;
+	systemTime: Date;
+
+	/**
+	 * The high-resolution performance counter time and frequency, and the time in 100 nanosecond
+	 * units.
+	 */
+	time: number;
+	frequency: number;
+	time100ns: number;
+	objects: PerfObject[];
+};
+
+export type ViewOptions = {
+	/**
+	 * When `true`, each key read through the view is watched and its cache is dropped when it
+	 * changes. When `false`, nothing is watched and values are read once. Defaults to `true`.
+	 */
+	watch?: boolean;
+};
+
+/**
+ * A read-only object whose properties are a key's values and subkeys. Subkeys are views too.
+ */
+export type RegistryView = { readonly [name: string]: unknown };
+
+export type ViewStats = {
+	/**
+	 * The number of lookups that were read from the registry.
+	 */
+	faults: number;
+
+	/**
+	 * The number of lookups that were answered from the cache.
+	 */
+	hits: number;
+};
+
+export type WatchStats = {
+	/**
+	 * The number of keys in the watcher tree, including the parents of watched keys.
+	 */
+	keys: number;
+
+	/**
+	 * The number of those keys that exist and have an open handle.
+	 */
+	handles: number;
+
+	/**
+	 * The number of open keys that can't be notified of changes and are polled instead.
+	 */
+	polled: number;
+
+	/**
+	 * The number of times a polled key has been checked.
+	 */
+	polls: number;
+
+	/**
+	 * The number of changed keys waiting to be dispatched.
+	 */
+	queued: number;
+
+	/**
+	 * The number of notifications folded into one already waiting for the same key.
+	 */
+	coalesced: number;
+
+	/**
+	 * The number of notifications that arrived while the queue was full.
+	 */
+	overflowed: number;
+
+	/**
+	 * The number of changed keys whose events were dropped because the queue was full.
+	 */
+	dropped: number;
+};
+
+export type WatchQueueOptions = {
+	/**
+	 * The most changed keys queued for the main thread. Defaults to `4096`.
+	 */
+	capacity?: number;
+
+	/**
+	 * What happens to a key that changes while the queue is full: `coalesce` sets it aside and
+	 * dispatches it after the queue, `drop-oldest` drops the events of the key queued the longest,
+	 * and `resync` drops the events of every queued key and emits a `resync` event for each watched
+	 * subtree to re-read instead. Defaults to `coalesce`.
+	 */
+	overflow?: 'coalesce' | 'drop-oldest' | 'resync';
+};
+
+export type JournalOptions = {
+	/**
+	 * When written entries are synced to disk: `always` after every batch of events, `interval`
+	 * at most once per `fsyncInterval`, or `never`, leaving it to the OS until the journal is
+	 * flushed or closed. Defaults to `interval`.
+	 */
+	fsync?: 'always' | 'interval' | 'never';
+
+	/**
+	 * The minimum milliseconds between syncs with the `interval` policy. Entries written after a
+	 * sync are synced once the interval is up, even if no other event arrives. Defaults to `1000`.
+	 */
+	fsyncInterval?: number;
+
+	/**
+	 * The size in bytes after which a new segment file is started. Compaction deletes whole
+	 * segments. Defaults to 4 MB.
+	 */
+	segmentSize?: number;
+
+	/**
+	 * When `true`, the values of watched keys are kept so each entry records which values were
+	 * added, changed, or deleted. Defaults to `false`.
+	 */
+	values?: boolean;
+};
+
+export type JournalValueChange = {
+	name: string;
+	change: 'add' | 'change' | 'delete';
+	type: RegistryValueType;
+
+	/**
+	 * The new data, or `undefined` if the value was deleted.
+	 */
+	data?: unknown;
+};
+
+export type JournalEntry = {
+	seq: number;
+	time: Date;
+	type: 'add' | 'change' | 'delete';
+	key: string;
+
+	/**
+	 * The values that changed, when the journal records values and had a copy of the key's
+	 * previous values.
+	 */
+	values?: JournalValueChange[];
+};
+
+export type SharedCacheOptions = {
+	/**
+	 * The name readers open the cache with. Letters, digits, `.`, `_`, and `-` only.
+	 */
+	name: string;
+
+	/**
+	 * The size of the shared memory in bytes. An eighth goes to the hash table and the rest holds
+	 * the keys and values. Defaults to 16 MB.
+	 */
+	size?: number;
+
+	/**
+	 * When `true`, every key in the subtree is watched and re-read when it changes. When `false`,
+	 * the cache is only updated by `refresh()`. Defaults to `true`.
+	 */
+	watch?: boolean;
+};
+
+export type TimelineOptions = {
+	/**
+	 * How many spans each thread keeps. Once a thread's buffer is full, its oldest spans are
+	 * overwritten. Defaults to 16,384.
+	 */
+	capacity?: number;
+};
+
+type NativeScanChange = {
+	path: string;
+	lastWriteTime: Date;
+	values?: { name: string; type: number; data: unknown }[];
+	subkeys: string[];
+};
+
+/**
+ * The native cache for each scan result, which is passed back to the binding to rescan.
+ */
+const scanCaches = new WeakMap<ScanResult, unknown>();
+
+/**
+ * The native cache, watch handles, and nodes shared by every node of a view.
+ */
+type ViewState = {
+	view: unknown;
+	key: string;
+	watch: boolean;
+	nodes: Map<string, RegistryView>;
+	handles: WinRegLibWatchHandle[];
+};
+
+const viewStates = new WeakMap<object, ViewState>();
+
+const sharedCacheName = /^[\w.-]+$/;
+
+const readOnlyView = () => {
+	throw new TypeError('Registry views are read-only');
+};
+
+/**
+ * Gets or creates the proxy for a key in a view. The proxy reads nothing until a property is
+ * accessed, and then asks the native cache, which only reads the registry the first time. Values
+ * take precedence over subkeys with the same name.
+ */
+function viewNode(state: ViewState, path: string): RegistryView {
+	const folded = path.toUpperCase();
+	let node = state.nodes.get(folded);
+	if (node) {
+		return node;
+	}
+
+	if (state.watch) {
+		const handle = new WinRegLibWatchHandle(path ? `${state.key}\\${path}` : state.key);
+		handle.on('change', (evt: { type: string }) => {
+			if (state.view) {
+				binding.invalidateView(state.view, path, evt.type !== 'change');
+			}
+		});
+		state.handles.push(handle);
+	}
+
+	const view = () => {
+		if (!state.view) {
+			throw new Error('View has been closed');
+		}
+		return state.view;
+	};
+	const subkey = (name: string) => (path ? `${path}\\${name}` : name);
+	const isSubkey = (name: string) =>
+		!name.includes('\\') && binding.hasViewKey(view(), subkey(name));
+
+	node = new Proxy(Object.create(null), {
+		get(_target, prop) {
+			if (typeof prop !== 'string') {
+				return undefined;
+			}
+			const value = binding.readView(view(), path, prop);
+			if (value === undefined && isSubkey(prop)) {
+				return viewNode(state, subkey(prop));
+			}
+			return value;
+		},
+		has(_target, prop) {
+			return (
+				typeof prop === 'string' &&
+				(binding.readView(view(), path, prop) !== undefined || isSubkey(prop))
+			);
+		},
+		ownKeys() {
+			const names = binding.listView(view(), path);
+			if (!names) {
+				return [];
+			}
+			const seen = new Set(names.values.map((name: string) => name.toUpperCase()));
+			return [
+				...names.values,
+				...names.subkeys.filter((name: string) => !seen.has(name.toUpperCase()))
+			];
+		},
+		getOwnPropertyDescriptor(target, prop) {
+			const value = this.get!(target, prop, undefined);
+			return value === undefined && !this.has!(target, prop)
+				? undefined
+				: { value, writable: false, enumerable: true, configurable: true };
+		},
+		set: readOnlyView,
+		defineProperty: readOnlyView,
+		deleteProperty: readOnlyView
+	});
+
+	state.nodes.set(folded, node);
+	viewStates.set(node, state);
+	return node;
+}
+
+/**
+ * Determines the registry value type for a value when one was not explicitly specified.
+ */
+function inferValueType(value: RegistryValue): RegistryValueType {
+	if (value === null) {
+		return 'REG_NONE';
+	}
+	if (typeof value === 'string') {
+		return 'REG_SZ';
+	}
+	if (Array.isArray(value)) {
+		return 'REG_MULTI_SZ';
+	}
+	if (typeof value === 'bigint') {
+		return 'REG_QWORD';
+	}
+	if (typeof value === 'number') {
+		return value >= 0 && value <= 0xffffffff ? 'REG_DWORD' : 'REG_QWORD';
+	}
+	if (ArrayBuffer.isView(value)) {
+		return 'REG_BINARY';
+	}
+	throw new TypeError('Unsupported value type');
+}
+
+/**
+ * Loads the `winreglib` native module and provides an API for interacting
+ * with the Windows registry.
+ */
+export class WinRegLib extends EventEmitter {
+	nss: Record<string, Logger> = {};
+	#traceFd: number | undefined;
+
+	constructor() {
+		super();
+
+		binding.init((ns: string, msg: string) => {
+			this.emit('log', msg);
+			if (ns) {
+				if (!this.nss[ns]) {
+					this.nss[ns] = logger(ns);
+				}
+				this.nss[ns].log(msg);
+			} else {
+				logger.log(msg);
+			}
+		});
+	}
+
+	/**
+	 * Applies a list of set, delete, and create key operations in a single native call. Each key
+	 * is opened once regardless of how many operations target it.
+	 *
+	 * @param {Array.<BatchOperation>} ops - The operations to apply in order.
+	 * @param {BatchOptions} [opts] - Transaction and notification options.
+	 * @returns {Array.<BatchResult>} The outcome of each operation.
+	 */
+	batch(ops: BatchOperation[], opts: BatchOptions = {}): BatchResult[] {
+		if (!Array.isArray(ops)) {
+			throw new TypeError('Expected operations to be an array');
+		}
+
+		const native = ops.map(op => {
+			if (!op || typeof op !== 'object') {
+				throw new TypeError('Expected operation to be an object');
+			}
+			if (!op.key || typeof op.key !== 'string') {
+				throw new TypeError('Expected key to be a non-empty string');
+			}
+			switch (op.op) {
+				case 'set': {
+					if (!op.name || typeof op.name !== 'string') {
+						throw new TypeError(
+							'Expected value name to be a non-empty string'
+						);
+					}
+					const type = op.type ?? inferValueType(op.value);
+					if (valueTypes[type] === undefined) {
+						throw new TypeError(`Invalid value type "${type}"`);
+					}
+					const { value } = op;
+					return {
+						op: 'set',
+						key: op.key,
+						name: op.name,
+						type: valueTypes[type],
+						value:
+							ArrayBuffer.isView(value) && !Buffer.isBuffer(value)
+								? Buffer.from(
+										value.buffer,
+										value.byteOffset,
+										value.byteLength
+									)
+								: value
+					};
+				}
+				case 'delete':
+					if (
+						op.name !== undefined &&
+						(!op.name || typeof op.name !== 'string')
+					) {
+						throw new TypeError(
+							'Expected value name to be a non-empty string'
+						);
+					}
+					return { op: 'delete', key: op.key, name: op.name };
+				case 'createKey':
+					return { op: 'createKey', key: op.key };
+			}
+			throw new TypeError(
+				`Invalid operation "${(op as { op: string }).op}"`
+			);
+		});
+
+		return binding.batch(native, !!opts.transaction, !!opts.quiet);
+	}
+
+	/**
+	 * Stops watching the keys read through a view and releases its cache. Any node of the view may
+	 * be passed. The view can't be used after it has been closed.
+	 *
+	 * @param {RegistryView} view - The view.
+	 */
+	closeView(view: RegistryView): void {
+		const state = viewStates.get(view);
+		if (!state) {
+			throw new TypeError('Expected a registry view');
+		}
+		for (const handle of state.handles.splice(0)) {
+			handle.stop();
+		}
+		state.nodes.clear();
+		state.view = undefined;
+	}
+
+	/**
+	 * Creates a key and any missing parent keys.
+	 *
+	 * @param {String} key - The key to create.
+	 */
+	createKey(key: string): void {
+		this.#apply({ op: 'createKey', key });
+	}
+
+	/**
+	 * Deletes a value or, if no value name is specified, a key and all of its subkeys.
+	 *
+	 * @param {String} key - The key.
+	 * @param {String} [valueName] - The name of the value to delete.
+	 */
+	delete(key: string, valueName?: string): void {
+		this.#apply({ op: 'delete', key, name: valueName });
+	}
+
+	/**
+	 * Compares two trees and returns the keys and values that were added, removed, or modified in
+	 * `b` relative to `a`. Each tree is either a key, which is fingerprinted first, or a snapshot
+	 * returned by `fingerprint()`. Subtrees with matching fingerprints are skipped, so comparing
+	 * two snapshots costs time proportional to the number of differences.
+	 *
+	 * An added or removed key is reported once; its values and subkeys are not listed.
+	 *
+	 * @param {String|Buffer} a - The original key or snapshot.
+	 * @param {String|Buffer} b - The new key or snapshot.
+	 * @returns {Promise<Array.<DiffEntry>>} The differences in depth-first order.
+	 */
+	async diff(a: string | Buffer, b: string | Buffer): Promise<DiffEntry[]> {
+		const [snapshotA, snapshotB] = await Promise.all(
+			[a, b].map(tree => (typeof tree === 'string' ? this.fingerprint(tree) : tree))
+		);
+		return binding.diff(snapshotA, snapshotB);
+	}
+
+	/**
+	 * Gets the spans recorded since `startTimeline()` as Chrome trace-event JSON, which Perfetto
+	 * (https://ui.perfetto.dev) and `chrome://tracing` open directly. Recording continues, so a
+	 * long-running process can dump the timeline when it notices a latency spike.
+	 *
+	 * @param {String} [file] - A path to also write the trace to.
+	 * @returns {String} The trace.
+	 */
+	exportTimeline(file?: string): string {
+		if (file !== undefined && (!file || typeof file !== 'string')) {
+			throw new TypeError('Expected file to be a non-empty string');
+		}
+
+		const json = binding.exportTimeline();
+		if (file) {
+			writeFileSync(file, json);
+		}
+		return json;
+	}
+
+	/**
+	 * Serializes a key, its values, and its subkeys to a file descriptor or writable stream. The
+	 * tree is enumerated and serialized on a worker thread in fixed size chunks, so memory use
+	 * does not grow with the size of the tree. When writing to a stream, the export waits for each
+	 * chunk to be flushed before producing more than one more.
+	 *
+	 * The file descriptor or stream is not closed.
+	 *
+	 * @param {String} key - The key to export.
+	 * @param {Number|Writable} dest - A file descriptor or writable stream.
+	 * @param {ExportTreeOptions} [opts] - The output format and depth.
+	 * @returns {Promise<ExportTreeResult>} Resolves the number of `keys`, `values`, and `bytes`
+	 * written, and the number of subkeys that were `skipped` because they could not be read.
+	 */
+	async exportTree(
+		key: string,
+		dest: number | NodeJS.WritableStream,
+		opts: ExportTreeOptions = {}
+	): Promise<ExportTreeResult> {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+
+		const { depth = Infinity, format = 'ndjson' } = opts;
+		if (format !== 'ndjson' && format !== 'binary') {
+			throw new TypeError(`Invalid format "${format}"`);
+		}
+		if (depth !== Infinity && (!Number.isInteger(depth) || depth < 0)) {
+			throw new TypeError('Expected depth to be a non-negative integer');
+		}
+		const nativeDepth = Math.min(depth, 0xffffffff);
+
+		if (typeof dest === 'number') {
+			if (!Number.isInteger(dest) || dest < 0) {
+				throw new TypeError('Expected a file descriptor or writable stream');
+			}
+			return binding.exportTree(key, dest, format === 'binary', nativeDepth);
+		}
+
+		if (!dest || typeof dest.write !== 'function') {
+			throw new TypeError('Expected a file descriptor or writable stream');
+		}
+
+		let streamError: Error | undefined;
+		const write = (chunk: Buffer, done: (failed?: boolean) => void) => {
+			dest.write(chunk, (err?: Error | null) => {
+				if (err) {
+					streamError ??= err;
+				}
+				done(!!err);
+			});
+		};
+
+		try {
+			return await binding.exportTree(
+				key,
+				write,
+				format === 'binary',
+				nativeDepth
+			);
+		} catch (err) {
+			throw streamError ?? err;
+		}
+	}
+
+	/**
+	 * Hashes a key, its values, and its subkeys on a worker thread and returns a snapshot that
+	 * holds a hash of each key's values and a Merkle hash of each subtree. Snapshots can be stored
+	 * and later compared with `diff()`.
+	 *
+	 * @param {String} key - The key to fingerprint.
+	 * @returns {Promise<Buffer>} The snapshot.
+	 */
+	async fingerprint(key: string): Promise<Buffer> {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+		return binding.fingerprint(key);
+	}
+
+	/**
+	 * Gets the value for a specific key value.
+	 *
+	 * @param {String} key - The key.
+	 * @param {String} valueName - The name of the value to get.
+	 * @param {Object} [opts] - Various options.
+	 * @param {Boolean} [opts.bigint] - When `true`, returns `REG_QWORD` values as a bigint.
+	 * @returns {*} The value reflects the data type from the registry.
+	 */
+	get(key: string, valueName: string, opts: GetOptions = {}): unknown {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+
+		if (!valueName || typeof valueName !== 'string') {
+			throw new TypeError('Expected value name to be a non-empty string');
+		}
 
-	constructor() {
-		super();
+		return binding.get(key, valueName, !!opts.bigint);
+	}
 
-		binding.init((ns: string, msg: string) => {
-			this.emit('log', msg);
-			if (ns) {
-				if (!this.nss[ns]) {
-					this.nss[ns] = logger(ns);
+	/**
+	 * Checks if a key exists or, when a value name is passed, if the key has that value. Missing
+	 * keys and values return `false` without throwing.
+	 *
+	 * @param {String} key - The key.
+	 * @param {String} [valueName] - The name of the value to check for.
+	 * @returns {Boolean} `true` if the key or value exists.
+	 */
+	has(key: string, valueName?: string): boolean {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+
+		if (valueName !== undefined && typeof valueName !== 'string') {
+			throw new TypeError('Expected value name to be a string');
+		}
+
+		return binding.has(key, valueName);
+	}
+
+	/**
+	 * Checks which of a key's values exist. The key is opened once for all of the names, and if it
+	 * doesn't exist, none of the values do.
+	 *
+	 * @param {String} key - The key.
+	 * @param {Array.<String>} valueNames - The names of the values to check for.
+	 * @returns {Array.<Boolean>} Whether each value exists, in the same order as the names.
+	 */
+	hasMany(key: string, valueNames: string[]): boolean[] {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+
+		if (
+			!Array.isArray(valueNames) ||
+			valueNames.some(name => typeof name !== 'string')
+		) {
+			throw new TypeError('Expected value names to be an array of strings');
+		}
+
+		return binding.hasMany(key, valueNames);
+	}
+
+	/**
+	 * Enumerates the subkeys, then the values, of a key one page at a time. Each page is read on a
+	 * worker thread and the next page is not read until the current one has been consumed.
+	 *
+	 * Every subkey and value that exists for the whole iteration is returned exactly once, even if
+	 * the key is modified while it is being iterated.
+	 *
+	 * @param {String} key - The key to enumerate.
+	 * @param {Object} [opts] - Various options.
+	 * @param {Number} [opts.pageSize=1000] - The maximum number of names per page.
+	 * @returns {AsyncGenerator<RegistryKeyPage>} Yields pages of `subkeys` and `values`.
+	 */
+	async *iterateKey(
+		key: string,
+		opts: IterateKeyOptions = {}
+	): AsyncGenerator<RegistryKeyPage> {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+
+		const { pageSize = 1000 } = opts;
+		if (!Number.isInteger(pageSize) || pageSize < 1 || pageSize > 0xffffffff) {
+			throw new TypeError('Expected page size to be a positive integer');
+		}
+
+		const cursor = binding.openCursor(key);
+		try {
+			while (true) {
+				const { subkeys, values, done } = await binding.readCursor(
+					cursor,
+					pageSize
+				);
+				if (subkeys.length || values.length) {
+					yield { subkeys, values };
+				}
+				if (done) {
+					break;
 				}
-				this.nss[ns].log(msg);
-			} else {
-				logger.log(msg);
 			}
-		});
+		} finally {
+			binding.closeCursor(cursor);
+		}
 	}
 
 	/**
-	 * Gets the value for a specific key value.
+	 * Gets the number of subkeys and values, the length of the longest subkey name, value name, and
+	 * value data, and the last write time of a key without enumerating it.
+	 *
+	 * @param {String} key - The key.
+	 * @returns {KeyInfo} The key's metadata.
+	 */
+	info(key: string): KeyInfo {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+
+		return binding.info(key);
+	}
+
+	/**
+	 * Lists all subkeys and values for a specific key. With `columnar`, the names are packed into
+	 * a couple of typed arrays and only become strings when they are read, which keeps listing
+	 * large keys from filling the heap.
+	 *
+	 * @param {String} key - The key to list.
+	 * @param {ListOptions} [opts] - Whether to return columns.
+	 * @returns {RegistryKey} Contains the resolved `resolvedRoot`, `key`, `subkeys`, and `values`.
+	 */
+	list(key: string): RegistryKey | undefined;
+	list(
+		key: string,
+		opts: ListOptions & { columnar: true }
+	): ColumnarRegistryKey | undefined;
+	list(key: string, opts?: ListOptions): RegistryKey | undefined;
+	list(
+		key: string,
+		opts: ListOptions = {}
+	): RegistryKey | ColumnarRegistryKey | undefined {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+
+		if (!opts.columnar) {
+			return binding.list(key);
+		}
+
+		const columns = binding.list(key, true);
+		return columns && {
+			resolvedRoot: columns.resolvedRoot,
+			key: columns.key,
+			subkeys: new NameColumn(columns.keys, columns.keyOffsets),
+			values: new NameColumn(columns.names, columns.nameOffsets),
+			types: columns.types
+		};
+	}
+
+	/**
+	 * Opens a journal that durably records every watch event of this thread, creating the
+	 * directory if needed. Entries left by a previous process are kept, and numbering continues
+	 * from the last one. Only one journal can be open at a time.
+	 *
+	 * @param {String} dir - The directory holding the journal's segment files.
+	 * @param {JournalOptions} [opts] - Sync, segment, and value diff options.
+	 * @returns {Journal} The journal.
+	 */
+	openJournal(dir: string, opts: JournalOptions = {}): Journal {
+		if (!dir || typeof dir !== 'string') {
+			throw new TypeError('Expected dir to be a non-empty string');
+		}
+		const {
+			fsync = 'interval',
+			fsyncInterval = 1000,
+			segmentSize = 4 * 1024 * 1024,
+			values = false
+		} = opts;
+		const policy = ['always', 'interval', 'never'].indexOf(fsync);
+		if (policy === -1) {
+			throw new TypeError(`Invalid fsync policy "${fsync}"`);
+		}
+		if (typeof fsyncInterval !== 'number' || fsyncInterval < 0) {
+			throw new TypeError('Expected fsync interval to be a non-negative number');
+		}
+		if (typeof segmentSize !== 'number' || segmentSize <= 0) {
+			throw new TypeError('Expected segment size to be a positive number');
+		}
+
+		const path = resolve(dir);
+		mkdirSync(path, { recursive: true });
+		binding.openJournal(path, policy, fsyncInterval, segmentSize, !!values);
+		return new Journal(path);
+	}
+
+	/**
+	 * Opens a sampler for performance counters. The query is passed to `HKEY_PERFORMANCE_DATA` as
+	 * is: `Global` for most objects, `Costly` for expensive ones, or a space-separated list of
+	 * object indexes.
+	 *
+	 * @param {String} [query='Global'] - The objects to sample.
+	 * @returns {PerfSampler} The sampler.
+	 */
+	openPerfSampler(query = 'Global'): PerfSampler {
+		if (!query || typeof query !== 'string') {
+			throw new TypeError('Expected query to be a non-empty string');
+		}
+
+		return new PerfSampler(query);
+	}
+
+	/**
+	 * Opens a subtree that this or another process published with `publishSharedCache()`. Throws
+	 * an error with the code `ERR_WINREG_SHARED_CACHE_NOT_FOUND` if nothing is published under
+	 * the name.
+	 *
+	 * @param {String} name - The name the cache was published with.
+	 * @returns {SharedCache} The cache.
+	 */
+	openSharedCache(name: string): SharedCache {
+		if (!name || typeof name !== 'string' || !sharedCacheName.test(name)) {
+			throw new TypeError(
+				'Expected name to be a non-empty string of letters, digits, ".", "_", and "-"'
+			);
+		}
+
+		const { cache, key } = binding.openSharedCache(name);
+		return new SharedCache(name, key, cache);
+	}
+
+	/**
+	 * Parses captured performance data, such as a value read from `HKEY_PERFORMANCE_DATA` with
+	 * `get()`. Works on every platform.
+	 *
+	 * @param {Buffer} data - The `PERF_DATA_BLOCK` and its objects.
+	 * @returns {PerfSample} The parsed sample.
+	 */
+	parsePerfData(data: Buffer): PerfSample {
+		if (!Buffer.isBuffer(data)) {
+			throw new TypeError('Expected data to be a buffer');
+		}
+
+		return binding.parsePerfData(data);
+	}
+
+	/**
+	 * Mirrors a subtree into shared memory so that other processes on the same machine can read it
+	 * with `openSharedCache()` without watching or reading the registry themselves. Only one
+	 * process can publish a name at a time.
+	 *
+	 * @param {String} key - The key beginning with the root.
+	 * @param {SharedCacheOptions} opts - The name, size, and whether to watch for changes.
+	 * @returns {SharedCachePublisher} The publisher.
+	 */
+	publishSharedCache(key: string, opts: SharedCacheOptions): SharedCachePublisher {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+		const { name, size = 16 * 1024 * 1024, watch = true } = opts ?? {};
+		if (!name || typeof name !== 'string' || !sharedCacheName.test(name)) {
+			throw new TypeError(
+				'Expected name to be a non-empty string of letters, digits, ".", "_", and "-"'
+			);
+		}
+		if (typeof size !== 'number' || size <= 0) {
+			throw new TypeError('Expected size to be a positive number');
+		}
+
+		const { cache, key: resolved, added } = binding.publishSharedCache(name, key, size);
+		return new SharedCachePublisher(name, resolved, cache, added, watch !== false);
+	}
+
+	/**
+	 * Finds every key that matches a pattern and reads the requested values from each one in a
+	 * single call. The pattern is matched case-insensitively and supports `*` and `?` within a
+	 * name, `**` for any number of keys, and `{a,b}` alternatives, which may span several keys.
+	 *
+	 * With `columnar`, the rows are returned as a `QueryColumns`, whose names and values are
+	 * packed into typed arrays and only converted when they are read.
+	 *
+	 * @param {String} pattern - The pattern, beginning with the root, which may also be a glob.
+	 * @param {QueryOptions} [opts] - The values to read and whether to return columns.
+	 * @returns {Promise<QueryResult>} The matched keys and their values.
+	 */
+	query(
+		pattern: string,
+		opts: QueryOptions & { columnar: true }
+	): Promise<ColumnarQueryResult>;
+	query(pattern: string, opts?: QueryOptions): Promise<QueryResult>;
+	async query(
+		pattern: string,
+		opts: QueryOptions = {}
+	): Promise<QueryResult | ColumnarQueryResult> {
+		if (!pattern || typeof pattern !== 'string') {
+			throw new TypeError('Expected pattern to be a non-empty string');
+		}
+		if (
+			opts.values !== undefined &&
+			(!Array.isArray(opts.values) ||
+				opts.values.some(name => typeof name !== 'string'))
+		) {
+			throw new TypeError('Expected values to be an array of strings');
+		}
+
+		if (!opts.columnar) {
+			return binding.query(pattern, opts.values);
+		}
+
+		const result = await binding.query(pattern, opts.values, true);
+		return { ...result, rows: new QueryColumns(result.rows) };
+	}
+
+	/**
+	 * Loads a trace written while recording and switches to a backend that answers every call from
+	 * it, so a workload recorded on one machine can be replayed on any platform. Switch back with
+	 * `setBackend()`.
+	 *
+	 * @param {String} file - The path of the trace.
+	 * @param {ReplayOptions} [opts] - How fast to replay the calls.
+	 */
+	replay(file: string, opts: ReplayOptions = {}): void {
+		if (!file || typeof file !== 'string') {
+			throw new TypeError('Expected file to be a non-empty string');
+		}
+		const { speed = 'fast' } = opts;
+		if (speed !== 'recorded' && speed !== 'fast') {
+			throw new TypeError(`Invalid speed "${speed}"`);
+		}
+
+		binding.replay(readFileSync(file), speed === 'recorded');
+	}
+
+	/**
+	 * Scans the tree again, only reading the values and subkeys of keys whose last write time
+	 * moved since the previous result. Objects for keys that didn't change, and for subtrees in
+	 * which nothing changed, are reused from the previous result.
+	 *
+	 * @param {ScanResult} previous - A result returned by `scan()` or `rescan()`.
+	 * @returns {Promise<ScanResult>} The key, its values, and its subkeys.
+	 */
+	async rescan(previous: ScanResult): Promise<ScanResult> {
+		const cache = scanCaches.get(previous);
+		if (!cache) {
+			throw new TypeError('Expected a result returned by scan() or rescan()');
+		}
+		return this.#scan(previous.key, previous.root, cache);
+	}
+
+	/**
+	 * Reads a key, its values, and all of its subkeys on a worker thread. Pass the result to
+	 * `rescan()` to cheaply bring it up to date later.
+	 *
+	 * @param {String} key - The key to scan.
+	 * @returns {Promise<ScanResult>} The key, its values, and its subkeys.
+	 */
+	async scan(key: string): Promise<ScanResult> {
+		if (!key || typeof key !== 'string') {
+			throw new TypeError('Expected key to be a non-empty string');
+		}
+		return this.#scan(key);
+	}
+
+	/**
+	 * Sets a value, creating the key if it does not exist.
+	 *
+	 * @param {String} key - The key.
+	 * @param {String} valueName - The name of the value to set.
+	 * @param {*} value - The data to write.
+	 * @param {RegistryValueType} [type] - The value type. Inferred from the value when omitted.
+	 */
+	set(
+		key: string,
+		valueName: string,
+		value: RegistryValue,
+		type?: RegistryValueType
+	): void {
+		this.#apply({ op: 'set', key, name: valueName, value, type });
+	}
+
+	/**
+	 * Selects the registry implementation used by every API. `win32` is only available on
+	 * Windows. `memory` is an empty, in-process registry intended for testing.
+	 *
+	 * @param {String} name - The backend name.
+	 */
+	setBackend(name: RegistryBackend): void {
+		if (!name || typeof name !== 'string') {
+			throw new TypeError('Expected backend name to be a non-empty string');
+		}
+
+		binding.setBackend(name);
+	}
+
+	/**
+	 * Freezes the clock the in-memory backend uses for last write times, or restores the system
+	 * clock when called without a time. Meant for tests. Writes still advance a key's last write
+	 * time by at least 100 nanoseconds, so changes are always detected. Polled watches are scheduled
+	 * by the frozen clock too, and setting it runs the polls that came due.
+	 *
+	 * @param {Date|Number} [time] - The time to freeze the clock at.
+	 */
+	setMemoryClock(time?: Date | number): void {
+		if (time === undefined) {
+			binding.setMemoryClock(-1);
+			return;
+		}
+		const ms = +time;
+		if (!Number.isFinite(ms) || ms < 0) {
+			throw new TypeError('Expected time to be a valid date');
+		}
+		binding.setMemoryClock(ms);
+	}
+
+	/**
+	 * Bounds the queue of changed keys waiting for the main thread and chooses what happens to the
+	 * keys that change while it is full, so a storm of changes while the event loop is busy can't
+	 * grow it without limit. A key is only ever queued once, repeated changes are coalesced.
+	 *
+	 * @param {WatchQueueOptions} [opts] - The capacity and overflow policy.
+	 */
+	setWatchQueue(opts?: WatchQueueOptions): void {
+		const { capacity = 4096, overflow = 'coalesce' } = opts ?? {};
+		if (!Number.isInteger(capacity) || capacity < 1) {
+			throw new TypeError('Expected capacity to be a positive integer');
+		}
+		if (!['coalesce', 'drop-oldest', 'resync'].includes(overflow)) {
+			throw new TypeError('Expected overflow to be "coalesce", "drop-oldest", or "resync"');
+		}
+		binding.setWatchQueue(capacity, overflow);
+	}
+
+	/**
+	 * Records every call the active backend makes, with its arguments, results, and timing, and
+	 * every change notification to a trace file that `replay()` can play back.
+	 *
+	 * @param {String} file - The path of the trace to write.
+	 */
+	startRecording(file: string): void {
+		if (!file || typeof file !== 'string') {
+			throw new TypeError('Expected file to be a non-empty string');
+		}
+
+		const fd = openSync(file, 'w');
+		try {
+			binding.startRecording(fd);
+		} catch (err) {
+			closeSync(fd);
+			throw err;
+		}
+		this.#traceFd = fd;
+	}
+
+	/**
+	 * Starts recording a timeline of the addon's native work in every thread: registry calls made
+	 * by `get()` and `list()`, opening and watching keys, the watcher thread waking up and queuing
+	 * changes, and dispatching them to listeners. Each thread records into its own ring buffer, so
+	 * the overhead is a couple of clock reads per span. Starting again discards what was recorded.
+	 *
+	 * @param {TimelineOptions} [opts] - The number of spans to keep per thread.
+	 */
+	startTimeline(opts: TimelineOptions = {}): void {
+		const { capacity = 16384 } = opts;
+		if (!Number.isInteger(capacity) || capacity < 1 || capacity > 0xffffffff) {
+			throw new TypeError('Expected capacity to be a positive integer');
+		}
+		binding.startTimeline(capacity);
+	}
+
+	/**
+	 * Writes the rest of the trace, closes it, and goes back to the backend that was recorded.
+	 */
+	stopRecording(): void {
+		const fd = this.#traceFd;
+		if (fd === undefined) {
+			return;
+		}
+		this.#traceFd = undefined;
+		try {
+			binding.stopRecording();
+		} finally {
+			closeSync(fd);
+		}
+	}
+
+	/**
+	 * Stops recording the timeline and discards the recorded spans.
+	 */
+	stopTimeline(): void {
+		binding.stopTimeline();
+	}
+
+	/**
+	 * Gets the value for a specific key value like `get()`, but returns `undefined` instead of
+	 * throwing when the key or value doesn't exist.
 	 *
 	 * @param {String} key - The key.
 	 * @param {String} valueName - The name of the value to get.
-	 * @returns {*} The value reflects the data type from the registry.
+	 * @param {Object} [opts] - Various options.
+	 * @param {Boolean} [opts.bigint] - When `true`, returns `REG_QWORD` values as a bigint.
+	 * @returns {*} The value, or `undefined` if it doesn't exist.
 	 */
-	get(key: string, valueName: string): unknown {
+	tryGet(key: string, valueName: string, opts: GetOptions = {}): unknown {
 		if (!key || typeof key !== 'string') {
 			throw new TypeError('Expected key to be a non-empty string');
 		}
@@ -73,36 +1944,186 @@ export class WinRegLib extends EventEmitter {
 			throw new TypeError('Expected value name to be a non-empty string');
 		}
 
-		return binding.get(key, valueName);
+		return binding.tryGet(key, valueName, !!opts.bigint);
 	}
 
 	/**
-	 * Lists all subkeys and values for a specific key.
+	 * Creates a read-only view of a key whose properties are the key's values and subkeys. Nothing
+	 * is read until a property is accessed, and each key and value is then read once and cached
+	 * natively until the key changes, so the cost depends on what is used rather than on the size
+	 * of the subtree.
 	 *
-	 * @param {String} key - The key to list.
-	 * @returns {RegistryKey} Contains the resolved `resolvedRoot`, `key`, `subkeys`, and `values`.
+	 * @param {String} key - The key beginning with the root.
+	 * @param {ViewOptions} [opts] - Whether to watch for changes.
+	 * @returns {RegistryView} The view.
 	 */
-	list(key: string): RegistryKey | undefined {
+	view(key: string, opts: ViewOptions = {}): RegistryView {
 		if (!key || typeof key !== 'string') {
 			throw new TypeError('Expected key to be a non-empty string');
 		}
 
-		return binding.list(key);
+		const { view, key: resolved } = binding.openView(key);
+		return viewNode(
+			{ view, key: resolved, watch: opts.watch !== false, nodes: new Map(), handles: [] },
+			''
+		);
+	}
+
+	/**
+	 * Gets how many lookups through a view were read from the registry and how many were
+	 * answered from its cache.
+	 *
+	 * @param {RegistryView} view - The view.
+	 * @returns {ViewStats} The counters.
+	 */
+	viewStats(view: RegistryView): ViewStats {
+		const state = viewStates.get(view);
+		if (!state?.view) {
+			throw new TypeError('Expected an open registry view');
+		}
+		return binding.viewStats(state.view);
 	}
 
 	/**
-	 * Watches a key for changes to subkeys and values.
+	 * Watches a key for changes to subkeys and values. With `opts.pattern`, a subkey of `*` matches
+	 * any one subkey and `**` any number of them, in which case every key that matches is watched
+	 * as it appears.
 	 *
-	 * @param {String} key - The key to watch.
+	 * @param {String} key - The key or pattern to watch.
+	 * @param {Object} [opts] - Various options.
+	 * @param {Boolean} [opts.pattern] - When `true`, `*` and `**` subkeys are wildcards.
 	 * @returns {EventEmitter} The handle to wire up listeners and stop watching.
 	 * @emits {change} Emits an event object containing the `key` that changed.
 	 */
-	watch(key: string): WinRegLibWatchHandle {
+	watch(key: string, opts: WatchOptions = {}): WinRegLibWatchHandle {
 		if (!key || typeof key !== 'string') {
 			throw new TypeError('Expected key to be a non-empty string');
 		}
 
-		return new WinRegLibWatchHandle(key);
+		return new WinRegLibWatchHandle(key, !!opts.pattern);
+	}
+
+	/**
+	 * Watches many keys for changes with one listener. The watcher tree is built in one pass and
+	 * the keys are opened on a worker thread, so watching thousands of keys doesn't block the event
+	 * loop for each one. With `opts.pattern`, keys may be patterns, like with `watch()`.
+	 *
+	 * @param {Array.<String>} keys - The keys or patterns to watch.
+	 * @param {Object} [opts] - Various options.
+	 * @param {Boolean} [opts.pattern] - When `true`, `*` and `**` subkeys are wildcards.
+	 * @returns {Promise<EventEmitter>} Resolves the handle once the keys that exist are watched.
+	 * @emits {change} Emits an event object containing the `key` that changed.
+	 */
+	async watchMany(keys: string[], opts: WatchOptions = {}): Promise<WinRegLibWatchManyHandle> {
+		if (!Array.isArray(keys) || keys.some(key => !key || typeof key !== 'string')) {
+			throw new TypeError('Expected keys to be an array of non-empty strings');
+		}
+
+		const handle = new WinRegLibWatchManyHandle(keys.slice(), !!opts.pattern);
+		await handle.ready;
+		return handle;
+	}
+
+	/**
+	 * Counts the keys this thread is watching and the key handles they hold open. Keys are
+	 * matched case-insensitively, so watching one key with different spellings counts it once.
+	 *
+	 * @returns {WatchStats} The counters.
+	 */
+	watchStats(): WatchStats {
+		return binding.watchStats();
+	}
+
+	/**
+	 * Runs a scan and applies the keys that changed to the previous result's tree.
+	 */
+	async #scan(
+		key: string,
+		previousRoot?: ScanKey,
+		previousCache?: unknown
+	): Promise<ScanResult> {
+		const { cache, changes, keys, skipped } = await binding.scan(key, previousCache);
+
+		// keys are matched case-insensitively like the registry does, every ancestor of a changed
+		// key is rebuilt, everything else is reused
+		const changed = new Map<string, NativeScanChange>();
+		const dirty = new Set<string>();
+		let read = 0;
+		for (const change of changes as NativeScanChange[]) {
+			let path = change.path.toLowerCase();
+			changed.set(path, change);
+			if (change.values) {
+				read++;
+			}
+			while (!dirty.has(path)) {
+				dirty.add(path);
+				if (!path) {
+					break;
+				}
+				const i = path.lastIndexOf('\\');
+				path = i === -1 ? '' : path.substring(0, i);
+			}
+		}
+
+		const build = (
+			previous: ScanKey | undefined,
+			name: string,
+			path: string
+		): ScanKey => {
+			const id = path.toLowerCase();
+			if (previous && !dirty.has(id)) {
+				return previous;
+			}
+
+			const change = changed.get(id);
+			const previousSubkeys = new Map(
+				previous?.subkeys.map(subkey => [subkey.name.toLowerCase(), subkey])
+			);
+			const names = change
+				? change.subkeys
+				: (previous as ScanKey).subkeys.map(subkey => subkey.name);
+
+			return {
+				name,
+				lastWriteTime: change
+					? change.lastWriteTime
+					: (previous as ScanKey).lastWriteTime,
+				values: change?.values
+					? change.values.map(({ name, type, data }) => ({
+							name,
+							type: valueTypeNames[type] ?? type,
+							data
+						}))
+					: (previous as ScanKey).values,
+				subkeys: names.map(subkey =>
+					build(
+						previousSubkeys.get(subkey.toLowerCase()),
+						subkey,
+						path ? `${path}\\${subkey}` : subkey
+					)
+				)
+			};
+		};
+
+		const result: ScanResult = {
+			key,
+			root: build(previousRoot, key, ''),
+			keys,
+			changed: read,
+			skipped
+		};
+		scanCaches.set(result, cache);
+		return result;
+	}
+
+	/**
+	 * Applies a single operation and throws if it failed.
+	 */
+	#apply(op: BatchOperation): void {
+		const [result] = this.batch([op]);
+		if (!result.success) {
+			throw result.error;
+		}
 	}
 }
 
@@ -0,0 +1,43 @@
+#include "winreglib.h"
+
+using namespace winreglib;
+
+/**
+ * Every environment runs JavaScript on its own thread, so the thread identifies the instance that
+ * log messages belong to.
+ */
+static thread_local Instance* currentInstance = NULL;
+
+/**
+ * Returns the instance for the environment running on the current thread or `NULL` if the
+ * current thread is not acting on behalf of an environment.
+ */
+Instance* Instance::current() {
+	return currentInstance;
+}
+
+/**
+ * Returns the instance stored in the environment's instance data.
+ */
+Instance* Instance::get(napi_env env) {
+	void* data = NULL;
+	::napi_get_instance_data(env, &data);
+	return static_cast<Instance*>(data);
+}
+
+void Instance::setCurrent(Instance* instance) {
+	currentInstance = instance;
+}
+
+/**
+ * Queues a log message and wakes up the environment's event loop to emit it.
+ */
+void Instance::log(const char* ns, const std::wstring& msg) {
+	std::u16string u16msg(msg.begin(), msg.end());
+	std::shared_ptr<LogMessage> obj = std::make_shared<LogMessage>(ns, u16msg);
+	std::lock_guard<std::mutex> lock(logLock);
+	logQueue.push(obj);
+	if (logNotify) {
+		::uv_async_send(logNotify);
+	}
+}
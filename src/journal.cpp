@@ -0,0 +1,744 @@
+#include "journal.h"
+#include "winreglib.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifndef _WIN32
+	#include <sys/mman.h>
+#endif
+
+using namespace winreglib;
+
+namespace {
+
+/**
+ * Computes the CRC-32 (IEEE) of a record body.
+ */
+uint32_t crc32(const BYTE* data, size_t length) {
+	static const struct Table {
+		Table() {
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; ++k) {
+					c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+				}
+				entries[i] = c;
+			}
+		}
+		uint32_t entries[256];
+	} table;
+
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < length; ++i) {
+		crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFF;
+}
+
+void put32(std::string& buffer, uint32_t value) {
+	for (int i = 0; i < 4; ++i) {
+		buffer.push_back((char)(value >> (i * 8)));
+	}
+}
+
+void put64(std::string& buffer, uint64_t value) {
+	for (int i = 0; i < 8; ++i) {
+		buffer.push_back((char)(value >> (i * 8)));
+	}
+}
+
+/**
+ * Writes a string as UTF-16 code units, splitting characters outside the BMP into surrogate
+ * pairs where `wchar_t` is 32 bits.
+ */
+void putString(std::string& buffer, const std::wstring& value) {
+	size_t start = buffer.size();
+	put32(buffer, 0);
+	uint32_t units = 0;
+	for (wchar_t ch : value) {
+		uint32_t c = (uint32_t)ch;
+		if (c > 0xFFFF) {
+			c -= 0x10000;
+			uint32_t high = 0xD800 + (c >> 10);
+			buffer.push_back((char)high);
+			buffer.push_back((char)(high >> 8));
+			c = 0xDC00 + (c & 0x3FF);
+			++units;
+		}
+		buffer.push_back((char)c);
+		buffer.push_back((char)(c >> 8));
+		++units;
+	}
+	for (int i = 0; i < 4; ++i) {
+		buffer[start + i] = (char)(units >> (i * 8));
+	}
+}
+
+/**
+ * Reads the little-endian fields of a record.
+ */
+struct RecordReader {
+	RecordReader(const BYTE* data, size_t length) : p(data), end(data + length), ok(true) {}
+
+	bool has(size_t n) {
+		ok = ok && (size_t)(end - p) >= n;
+		return ok;
+	}
+
+	uint64_t uint(int n) {
+		if (!has(n)) {
+			return 0;
+		}
+		uint64_t value = 0;
+		for (int i = 0; i < n; ++i) {
+			value |= (uint64_t)*p++ << (i * 8);
+		}
+		return value;
+	}
+
+	uint8_t u8() { return (uint8_t)uint(1); }
+	uint32_t u32() { return (uint32_t)uint(4); }
+	uint64_t u64() { return uint(8); }
+
+	bool str(std::wstring& value) {
+		uint32_t units = u32();
+		if (!has((size_t)units * 2)) {
+			return false;
+		}
+		value.clear();
+		value.reserve(units);
+		for (uint32_t i = 0; i < units; ++i) {
+			uint32_t c = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+			p += 2;
+			if (sizeof(wchar_t) == 4 && c >= 0xD800 && c <= 0xDBFF && i + 1 < units) {
+				uint32_t low = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+				if (low >= 0xDC00 && low <= 0xDFFF) {
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+					p += 2;
+					++i;
+				}
+			}
+			value.push_back((wchar_t)c);
+		}
+		return true;
+	}
+
+	const BYTE* p;
+	const BYTE* end;
+	bool ok;
+};
+
+/**
+ * Parses a record body. Returns false if the body is malformed.
+ */
+bool parseEntry(const BYTE* body, size_t length, JournalEntry& entry) {
+	RecordReader r(body, length);
+	entry.seq = r.u64();
+	entry.time = r.u64();
+	entry.event = r.u8();
+	r.str(entry.key);
+	uint32_t count = r.u32();
+	entry.hasValues = count != JOURNAL_NO_VALUES;
+	if (!entry.hasValues) {
+		count = 0;
+	}
+	for (uint32_t i = 0; r.ok && i < count; ++i) {
+		JournalValue value;
+		value.change = r.u8();
+		r.str(value.name);
+		value.type = r.u32();
+		uint32_t size = r.u32();
+		if (r.has(size)) {
+			value.data.assign(r.p, r.p + size);
+			r.p += size;
+		}
+		entry.values.push_back(std::move(value));
+	}
+	return r.ok;
+}
+
+inline uint32_t read32(const BYTE* p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t read64(const BYTE* p) {
+	return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32);
+}
+
+uint64_t now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()
+	).count();
+}
+
+}
+
+Journal::Journal(uv_loop_t* loop, const std::string& dir, const JournalOptions& options) :
+	loop(loop),
+	dir(dir),
+	options(options),
+	fd(-1),
+	nextSeq(1),
+	bufferSeq(0),
+	dirty(false),
+	lastSync(std::chrono::steady_clock::now())
+{
+	// syncs the last records of a burst with the "interval" policy, it doesn't keep Node alive
+	syncTimer = new uv_timer_t;
+	syncTimer->data = (void*)this;
+	::uv_timer_init(loop, syncTimer);
+	::uv_unref((uv_handle_t*)syncTimer);
+}
+
+/**
+ * Writes anything still buffered and releases the segment maps.
+ */
+Journal::~Journal() {
+	std::string ignored;
+	close(ignored);
+	::uv_close(reinterpret_cast<uv_handle_t*>(syncTimer), [](uv_handle_t* handle) {
+		delete reinterpret_cast<uv_timer_t*>(handle);
+	});
+}
+
+/**
+ * Finds the segments in the journal's directory and recovers the newest one. The directory must
+ * exist.
+ */
+bool Journal::open(std::string& error) {
+	uv_fs_t req;
+	int result = ::uv_fs_scandir(loop, &req, dir.c_str(), 0, NULL);
+	if (result < 0) {
+		::uv_fs_req_cleanup(&req);
+		error = std::string("Failed to read journal directory: ") + ::uv_strerror(result);
+		return false;
+	}
+
+	uv_dirent_t entry;
+	while (::uv_fs_scandir_next(&req, &entry) != UV_EOF) {
+		std::string name(entry.name);
+		if (name.length() != 24 || name.compare(16, 8, ".journal") != 0 ||
+			name.find_first_not_of("0123456789abcdef") < 16
+		) {
+			continue;
+		}
+		uint64_t firstSeq = std::strtoull(name.substr(0, 16).c_str(), NULL, 16);
+		segments.push_back(JournalSegment{ firstSeq, dir + "/" + name, 0, NULL, 0 });
+	}
+	::uv_fs_req_cleanup(&req);
+
+	std::sort(segments.begin(), segments.end(), [](const JournalSegment& a, const JournalSegment& b) {
+		return a.firstSeq < b.firstSeq;
+	});
+
+	for (JournalSegment& segment : segments) {
+		result = ::uv_fs_stat(loop, &req, segment.path.c_str(), NULL);
+		segment.size = result < 0 ? 0 : req.statbuf.st_size;
+		::uv_fs_req_cleanup(&req);
+		if (result < 0) {
+			error = std::string("Failed to read journal segment: ") + ::uv_strerror(result);
+			return false;
+		}
+	}
+
+	// a segment whose header was never written is left behind when the process died right after
+	// creating it
+	while (!segments.empty() && segments.back().size < JOURNAL_HEADER_LENGTH) {
+		::uv_fs_unlink(loop, &req, segments.back().path.c_str(), NULL);
+		::uv_fs_req_cleanup(&req);
+		segments.pop_back();
+	}
+
+	if (segments.empty()) {
+		return true;
+	}
+
+	JournalSegment& last = segments.back();
+	if (!recover(last, error)) {
+		return false;
+	}
+
+	if (last.size < options.segmentSize) {
+		result = ::uv_fs_open(loop, &req, last.path.c_str(), UV_FS_O_WRONLY | UV_FS_O_APPEND, 0, NULL);
+		::uv_fs_req_cleanup(&req);
+		if (result < 0) {
+			error = std::string("Failed to open journal segment: ") + ::uv_strerror(result);
+			return false;
+		}
+		fd = result;
+	}
+
+	LOG_DEBUG_2("Journal::open", L"Opened journal with %ld segments, last sequence %lld", (long)segments.size(), (long long)lastSeq())
+	return true;
+}
+
+/**
+ * Checks every record of the newest segment and truncates the segment at the first record that
+ * was cut short or is corrupt. Sets the next sequence number.
+ */
+bool Journal::recover(JournalSegment& segment, std::string& error) {
+	if (!map(segment, error)) {
+		return false;
+	}
+
+	const BYTE* data = segment.data;
+	if (std::memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH) != 0 ||
+		read64(data + JOURNAL_MAGIC_LENGTH) != segment.firstSeq
+	) {
+		error = "Invalid journal segment " + segment.path;
+		return false;
+	}
+
+	nextSeq = segment.firstSeq;
+	size_t offset = JOURNAL_HEADER_LENGTH;
+	while (segment.size - offset >= 8) {
+		uint32_t length = read32(data + offset);
+		if (length < 8 || segment.size - offset - 8 < length ||
+			crc32(data + offset + 8, length) != read32(data + offset + 4)
+		) {
+			break;
+		}
+		nextSeq = read64(data + offset + 8) + 1;
+		offset += 8 + (size_t)length;
+	}
+
+	if (offset < segment.size) {
+		LOG_DEBUG_2("Journal::recover", L"Truncating %lld bytes of an unfinished write from \"%hs\"", (long long)(segment.size - offset), segment.path.c_str())
+		unmap(segment);
+
+		uv_fs_t req;
+		int result = ::uv_fs_open(loop, &req, segment.path.c_str(), UV_FS_O_WRONLY, 0, NULL);
+		::uv_fs_req_cleanup(&req);
+		if (result >= 0) {
+			uv_file file = result;
+			result = ::uv_fs_ftruncate(loop, &req, file, (int64_t)offset, NULL);
+			::uv_fs_req_cleanup(&req);
+			::uv_fs_close(loop, &req, file, NULL);
+			::uv_fs_req_cleanup(&req);
+		}
+		if (result < 0) {
+			error = std::string("Failed to truncate journal segment: ") + ::uv_strerror(result);
+			return false;
+		}
+		segment.size = offset;
+	}
+	return true;
+}
+
+/**
+ * Reads the values of a key for diffing. Returns false if the key can't be read.
+ */
+bool Journal::readValues(const std::wstring& key, Snapshot& values) {
+	std::wstring::size_type p = key.find(L'\\');
+	auto root = rootKeys.find(key.substr(0, p));
+	if (root == rootKeys.end()) {
+		return false;
+	}
+
+	HKEY hkey;
+	std::wstring subkey = p == std::wstring::npos ? L"" : key.substr(p + 1);
+	if (backend->openKey(root->second, subkey.c_str(), KEY_QUERY_VALUE, NULL, &hkey) != ERROR_SUCCESS) {
+		return false;
+	}
+
+	DWORD numValues = 0;
+	DWORD maxNameLength = 0;
+	DWORD maxValueLength = 0;
+	LSTATUS status = backend->queryInfoKey(hkey, NULL, NULL, &numValues, &maxNameLength, &maxValueLength, NULL);
+	std::vector<wchar_t> name(maxNameLength + 1);
+	std::vector<BYTE> data(maxValueLength);
+
+	for (DWORD i = 0; status == ERROR_SUCCESS && i < numValues; ++i) {
+		DWORD nameSize = (DWORD)name.size();
+		DWORD dataSize = (DWORD)data.size();
+		DWORD type;
+		status = backend->enumValue(hkey, i, name.data(), &nameSize, &type, data.data(), &dataSize);
+		if (status == ERROR_NO_MORE_ITEMS) {
+			// the key was modified since it was queried
+			status = ERROR_SUCCESS;
+			break;
+		}
+		if (status == ERROR_SUCCESS) {
+			std::wstring valueName(name.data(), nameSize);
+			values.emplace(valueName, JournalValue{ JournalAdd, valueName, type, std::vector<BYTE>(data.begin(), data.begin() + dataSize) });
+		}
+	}
+	backend->closeKey(hkey);
+	return status == ERROR_SUCCESS;
+}
+
+/**
+ * Remembers the values of a key that is being watched, so the first event for it records what
+ * changed.
+ */
+void Journal::baseline(const std::wstring& key) {
+	if (!options.values || snapshots.find(key) != snapshots.end()) {
+		return;
+	}
+	Snapshot values;
+	if (readValues(key, values)) {
+		snapshots.emplace(key, std::move(values));
+	}
+}
+
+/**
+ * Buffers the record for an event and returns its sequence number, or 0 if the journal has
+ * stopped recording after a write error. The record is written by the next `commit()`.
+ */
+uint64_t Journal::append(const char* event, const std::wstring& key) {
+	if (!error.empty()) {
+		return 0;
+	}
+
+	uint8_t type = event[0] == 'a' ? JournalAdd : event[0] == 'c' ? JournalChange : JournalDelete;
+	bool hasValues = false;
+	std::vector<JournalValue> changes;
+
+	if (options.values) {
+		auto it = snapshots.find(key);
+		if (type == JournalDelete) {
+			if (it != snapshots.end()) {
+				hasValues = true;
+				for (auto& value : it->second) {
+					changes.push_back(JournalValue{ JournalDelete, value.first, value.second.type, {} });
+				}
+				snapshots.erase(it);
+			}
+		} else {
+			Snapshot current;
+			if (readValues(key, current)) {
+				// a key that was just added had no values, otherwise the values can only be diffed
+				// against a copy taken earlier
+				if (it != snapshots.end() || type == JournalAdd) {
+					static const Snapshot none;
+					const Snapshot& previous = it != snapshots.end() ? it->second : none;
+					NameLess less;
+					auto a = previous.begin();
+					auto b = current.begin();
+					while (a != previous.end() || b != current.end()) {
+						if (b == current.end() || (a != previous.end() && less(a->first, b->first))) {
+							changes.push_back(JournalValue{ JournalDelete, a->first, a->second.type, {} });
+							++a;
+						} else if (a == previous.end() || less(b->first, a->first)) {
+							changes.push_back(JournalValue{ JournalAdd, b->first, b->second.type, b->second.data });
+							++b;
+						} else {
+							if (a->second.type != b->second.type || a->second.data != b->second.data) {
+								changes.push_back(JournalValue{ JournalChange, b->first, b->second.type, b->second.data });
+							}
+							++a;
+							++b;
+						}
+					}
+					hasValues = true;
+				}
+				snapshots[key] = std::move(current);
+			}
+		}
+	}
+
+	uint64_t seq = nextSeq++;
+	if (buffer.empty()) {
+		bufferSeq = seq;
+	}
+
+	size_t start = buffer.size();
+	put32(buffer, 0);
+	put32(buffer, 0);
+	put64(buffer, seq);
+	put64(buffer, now());
+	buffer.push_back((char)type);
+	putString(buffer, key);
+	if (hasValues) {
+		put32(buffer, (uint32_t)changes.size());
+		for (const JournalValue& value : changes) {
+			buffer.push_back((char)value.change);
+			putString(buffer, value.name);
+			put32(buffer, value.type);
+			put32(buffer, (uint32_t)value.data.size());
+			buffer.append(reinterpret_cast<const char*>(value.data.data()), value.data.size());
+		}
+	} else {
+		put32(buffer, JOURNAL_NO_VALUES);
+	}
+
+	uint32_t length = (uint32_t)(buffer.size() - start - 8);
+	uint32_t crc = crc32(reinterpret_cast<const BYTE*>(buffer.data()) + start + 8, length);
+	for (int i = 0; i < 4; ++i) {
+		buffer[start + i] = (char)(length >> (i * 8));
+		buffer[start + 4 + i] = (char)(crc >> (i * 8));
+	}
+	return seq;
+}
+
+/**
+ * Writes the buffered records, syncs them according to the journal's policy, and starts a new
+ * segment once the current one is full. Called after each dispatch.
+ */
+bool Journal::commit() {
+	if (!write()) {
+		return false;
+	}
+	if (dirty && (options.sync == JournalSyncAlways || (options.sync == JournalSyncInterval &&
+		std::chrono::steady_clock::now() - lastSync >= std::chrono::milliseconds(options.syncInterval)))
+	) {
+		sync();
+	}
+	if (fd >= 0 && segments.back().size >= options.segmentSize) {
+		seal();
+	}
+	if (dirty && options.sync == JournalSyncInterval) {
+		scheduleSync();
+	}
+	return error.empty();
+}
+
+/**
+ * Arms the sync timer for when the interval since the last sync is up, so the last records of a
+ * burst are synced even if no other event is dispatched.
+ */
+void Journal::scheduleSync() {
+	if (::uv_is_active(reinterpret_cast<uv_handle_t*>(syncTimer))) {
+		return;
+	}
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lastSync).count();
+	uint64_t timeout = elapsed < (int64_t)options.syncInterval ? options.syncInterval - (uint64_t)elapsed : 0;
+	::uv_timer_start(syncTimer, [](uv_timer_t* handle) {
+		Journal* journal = (Journal*)handle->data;
+		if (journal->dirty && journal->fd >= 0 && journal->error.empty()) {
+			journal->sync();
+		}
+	}, timeout, 0);
+}
+
+/**
+ * Writes the buffered records with a single write, creating a segment for them if needed.
+ */
+bool Journal::write() {
+	if (buffer.empty() || !error.empty()) {
+		return error.empty();
+	}
+
+	uv_fs_t req;
+	if (fd < 0) {
+		char name[32];
+		::snprintf(name, sizeof(name), "%016llx.journal", (unsigned long long)bufferSeq);
+		std::string path = dir + "/" + name;
+		int result = ::uv_fs_open(loop, &req, path.c_str(), UV_FS_O_WRONLY | UV_FS_O_CREAT | UV_FS_O_TRUNC, 0644, NULL);
+		::uv_fs_req_cleanup(&req);
+		if (result < 0) {
+			return fail("Failed to create journal segment", result);
+		}
+		fd = result;
+
+		std::string header(JOURNAL_MAGIC, JOURNAL_MAGIC_LENGTH);
+		put64(header, bufferSeq);
+		buffer.insert(0, header);
+		segments.push_back(JournalSegment{ bufferSeq, path, 0, NULL, 0 });
+	}
+
+	size_t offset = 0;
+	while (offset < buffer.size()) {
+		uv_buf_t buf = uv_buf_init(&buffer[offset], (unsigned int)(buffer.size() - offset));
+		int result = ::uv_fs_write(loop, &req, fd, &buf, 1, -1, NULL);
+		::uv_fs_req_cleanup(&req);
+		if (result < 0) {
+			return fail("Failed to write journal", result);
+		}
+		offset += (size_t)result;
+	}
+
+	segments.back().size += buffer.size();
+	buffer.clear();
+	dirty = true;
+	return true;
+}
+
+/**
+ * Flushes the written records to disk.
+ */
+bool Journal::sync() {
+	uv_fs_t req;
+	int result = ::uv_fs_fsync(loop, &req, fd, NULL);
+	::uv_fs_req_cleanup(&req);
+	dirty = false;
+	lastSync = std::chrono::steady_clock::now();
+	::uv_timer_stop(syncTimer);
+	return result < 0 ? fail("Failed to sync journal", result) : true;
+}
+
+/**
+ * Closes the current segment. The next write starts a new one.
+ */
+void Journal::seal() {
+	if (dirty && options.sync != JournalSyncNever) {
+		sync();
+	}
+	uv_fs_t req;
+	::uv_fs_close(loop, &req, fd, NULL);
+	::uv_fs_req_cleanup(&req);
+	fd = -1;
+}
+
+/**
+ * Stops recording after a write error. The error is reported by `flush()` and `close()`.
+ */
+bool Journal::fail(const std::string& message, int result) {
+	error = message + ": " + ::uv_strerror(result);
+	LOG_DEBUG_1("Journal::fail", L"%hs", error.c_str())
+	buffer.clear();
+	return false;
+}
+
+/**
+ * Writes the buffered records and flushes them to disk regardless of the journal's policy.
+ */
+bool Journal::flush(std::string& error) {
+	if (write() && fd >= 0 && dirty) {
+		sync();
+	}
+	error = this->error;
+	return error.empty();
+}
+
+/**
+ * Flushes and closes the current segment and releases the segment maps.
+ */
+bool Journal::close(std::string& error) {
+	bool result = flush(error);
+	if (fd >= 0) {
+		uv_fs_t req;
+		::uv_fs_close(loop, &req, fd, NULL);
+		::uv_fs_req_cleanup(&req);
+		fd = -1;
+	}
+	for (JournalSegment& segment : segments) {
+		unmap(segment);
+	}
+	return result;
+}
+
+/**
+ * Maps a segment into memory, or remaps it if it has grown since it was mapped.
+ */
+bool Journal::map(JournalSegment& segment, std::string& error) {
+	if (segment.data && segment.mapped == segment.size) {
+		return true;
+	}
+	unmap(segment);
+
+	uv_fs_t req;
+	int result = ::uv_fs_open(loop, &req, segment.path.c_str(), UV_FS_O_RDONLY, 0, NULL);
+	::uv_fs_req_cleanup(&req);
+	if (result < 0) {
+		error = std::string("Failed to open journal segment: ") + ::uv_strerror(result);
+		return false;
+	}
+
+	uv_file file = result;
+#ifdef _WIN32
+	HANDLE mapping = ::CreateFileMappingW((HANDLE)::uv_get_osfhandle(file), NULL, PAGE_READONLY, 0, 0, NULL);
+	void* view = mapping ? ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, (SIZE_T)segment.size) : NULL;
+	if (mapping) {
+		::CloseHandle(mapping);
+	}
+#else
+	void* view = ::mmap(NULL, (size_t)segment.size, PROT_READ, MAP_SHARED, file, 0);
+	if (view == MAP_FAILED) {
+		view = NULL;
+	}
+#endif
+	::uv_fs_close(loop, &req, file, NULL);
+	::uv_fs_req_cleanup(&req);
+
+	if (!view) {
+		error = "Failed to map journal segment " + segment.path;
+		return false;
+	}
+	segment.data = static_cast<const BYTE*>(view);
+	segment.mapped = (size_t)segment.size;
+	return true;
+}
+
+void Journal::unmap(JournalSegment& segment) {
+	if (segment.data) {
+#ifdef _WIN32
+		::UnmapViewOfFile(segment.data);
+#else
+		::munmap(const_cast<BYTE*>(segment.data), segment.mapped);
+#endif
+		segment.data = NULL;
+		segment.mapped = 0;
+	}
+}
+
+/**
+ * Reads up to `limit` records after the sequence number `seq`. Buffered records are written
+ * first. Reading starts at the segment holding the next record, found by its name, and records
+ * before it are skipped without being checked or decoded.
+ */
+bool Journal::readSince(uint64_t seq, size_t limit, std::vector<JournalEntry>& result, std::string& error) {
+	if (!write()) {
+		error = this->error;
+		return false;
+	}
+
+	auto it = std::upper_bound(segments.begin(), segments.end(), seq + 1, [](uint64_t s, const JournalSegment& segment) {
+		return s < segment.firstSeq;
+	});
+	if (it != segments.begin()) {
+		--it;
+	}
+
+	for (; it != segments.end() && result.size() < limit; ++it) {
+		if (!map(*it, error)) {
+			return false;
+		}
+
+		const BYTE* data = it->data;
+		size_t offset = JOURNAL_HEADER_LENGTH;
+		while (offset < it->size && result.size() < limit) {
+			uint32_t length = it->size - offset >= 8 ? read32(data + offset) : 0;
+			if (length < 8 || it->size - offset - 8 < length) {
+				error = "Journal segment " + it->path + " is corrupt";
+				return false;
+			}
+			const BYTE* body = data + offset + 8;
+			offset += 8 + (size_t)length;
+			if (read64(body) <= seq) {
+				continue;
+			}
+
+			JournalEntry entry;
+			if (crc32(body, length) != read32(body - 4) || !parseEntry(body, length, entry)) {
+				error = "Journal segment " + it->path + " is corrupt";
+				return false;
+			}
+			result.push_back(std::move(entry));
+		}
+	}
+	return true;
+}
+
+/**
+ * Deletes the segments whose records all have a sequence number up to `seq`. The newest segment
+ * is never deleted.
+ */
+bool Journal::compact(uint64_t seq, uint32_t& removed, std::string& error) {
+	removed = 0;
+	while (segments.size() > 1 && segments[1].firstSeq <= seq + 1) {
+		unmap(segments.front());
+		uv_fs_t req;
+		int result = ::uv_fs_unlink(loop, &req, segments.front().path.c_str(), NULL);
+		::uv_fs_req_cleanup(&req);
+		if (result < 0) {
+			error = std::string("Failed to delete journal segment: ") + ::uv_strerror(result);
+			return false;
+		}
+		segments.erase(segments.begin());
+		++removed;
+	}
+	return true;
+}
@@ -0,0 +1,151 @@
+#ifndef __JOURNAL__
+#define __JOURNAL__
+
+#include "backend.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <uv.h>
+#include <vector>
+
+namespace winreglib {
+
+extern const std::map<std::wstring, HKEY> rootKeys;
+
+/**
+ * Change journals written by `Journal`.
+ *
+ * A journal is a directory of segment files named after the sequence number of their first record
+ * as 16 hex digits with a `.journal` extension. A segment starts with the 8 byte magic and the u64
+ * first sequence number, followed by records:
+ *
+ *   u32 length, u32 crc32 of the body, then the body:
+ *   u64 seq, u64 time (ms since the epoch), u8 event, str key, u32 value count
+ *
+ * followed by that many value changes, or nothing when the count is `JOURNAL_NO_VALUES`:
+ *
+ *   u8 change, str name, u32 type, u32 data length, data
+ *
+ * Integers are little-endian. Strings are a u32 number of UTF-16 code units followed by the code
+ * units. A record that was cut short or fails its checksum at the end of the newest segment is a
+ * write that never finished and is truncated when the journal is opened.
+ */
+
+#define JOURNAL_MAGIC "WRJRNL01"
+#define JOURNAL_MAGIC_LENGTH 8
+#define JOURNAL_HEADER_LENGTH 16
+#define JOURNAL_NO_VALUES 0xFFFFFFFF
+
+enum JournalEvent : uint8_t { JournalAdd = 1, JournalChange, JournalDelete };
+
+enum JournalSync { JournalSyncAlways, JournalSyncInterval, JournalSyncNever };
+
+struct JournalOptions {
+	/**
+	 * When the written records are flushed to disk: after every batch of events, at most once per
+	 * `syncInterval` milliseconds, or only when the journal is flushed or closed.
+	 */
+	JournalSync sync;
+	uint32_t syncInterval;
+
+	/**
+	 * A segment is closed and a new one started once it is at least this many bytes.
+	 */
+	uint64_t segmentSize;
+
+	/**
+	 * When true, the values of every watched key are kept so each event records the values that
+	 * were added, changed, or deleted.
+	 */
+	bool values;
+};
+
+/**
+ * A value that was added, changed, or deleted. Deleted values have no data.
+ */
+struct JournalValue {
+	uint8_t change;
+	std::wstring name;
+	DWORD type;
+	std::vector<BYTE> data;
+};
+
+struct JournalEntry {
+	uint64_t seq;
+	uint64_t time;
+	uint8_t event;
+	std::wstring key;
+	bool hasValues;
+	std::vector<JournalValue> values;
+};
+
+/**
+ * A segment file. Segments are memory-mapped the first time they are read and stay mapped until
+ * they are compacted or the journal is closed. The newest segment is remapped when it has grown.
+ */
+struct JournalSegment {
+	uint64_t firstSeq;
+	std::string path;
+	uint64_t size;
+	const BYTE* data;
+	size_t mapped;
+};
+
+/**
+ * An append-only journal of watch events. Events are appended as they are dispatched and each
+ * dispatch is written with a single write, then synced according to the journal's policy.
+ * Consumers that restart catch up with `readSince()` instead of rescanning the keys they watch.
+ *
+ * Records are written to a file descriptor and read through memory maps. A journal is not thread
+ * safe and is only used on the main thread. Write errors stop the journal from recording and are
+ * reported by the next `flush()` or `close()`.
+ */
+class Journal {
+public:
+	Journal(uv_loop_t* loop, const std::string& dir, const JournalOptions& options);
+	~Journal();
+
+	uint64_t append(const char* event, const std::wstring& key);
+	void baseline(const std::wstring& key);
+	bool close(std::string& error);
+	bool commit();
+	bool compact(uint64_t seq, uint32_t& removed, std::string& error);
+	uint64_t firstSeq() const { return segments.empty() ? nextSeq : segments.front().firstSeq; }
+	bool flush(std::string& error);
+	uint64_t lastSeq() const { return nextSeq - 1; }
+	bool open(std::string& error);
+	bool readSince(uint64_t seq, size_t limit, std::vector<JournalEntry>& result, std::string& error);
+	size_t segmentCount() const { return segments.size(); }
+
+private:
+	typedef std::map<std::wstring, JournalValue, NameLess> Snapshot;
+
+	bool fail(const std::string& message, int result);
+	bool map(JournalSegment& segment, std::string& error);
+	bool readValues(const std::wstring& key, Snapshot& values);
+	bool recover(JournalSegment& segment, std::string& error);
+	void scheduleSync();
+	void seal();
+	bool sync();
+	void unmap(JournalSegment& segment);
+	bool write();
+
+	uv_loop_t* loop;
+	std::string dir;
+	JournalOptions options;
+	std::vector<JournalSegment> segments;
+	uv_file fd;
+	uint64_t nextSeq;
+	uint64_t bufferSeq;
+	std::string buffer;
+	std::string error;
+	bool dirty;
+	std::chrono::steady_clock::time_point lastSync;
+	uv_timer_t* syncTimer;
+	std::map<std::wstring, Snapshot, NameLess> snapshots;
+};
+
+}
+
+#endif
@@ -0,0 +1,554 @@
+#include "memorybackend.h"
+#include <chrono>
+#include <cstring>
+
+using namespace winreglib;
+
+namespace winreglib {
+	/**
+	 * The handle returned for every opened or created key.
+	 */
+	struct MemoryHandle {
+		std::shared_ptr<MemoryKey> key;
+		MemoryTransaction* tx;
+	};
+
+	/**
+	 * The undo log for a transaction. Rolling back runs the entries in reverse order.
+	 */
+	struct MemoryTransaction {
+		std::vector<std::function<void()>> undo;
+	};
+}
+
+FILETIME MemoryBackend::now() {
+	// FILETIME is the number of 100ns intervals since January 1, 1601 (UTC)
+	uint64_t ticks = clock;
+	if (ticks == 0) {
+		ticks = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()
+		).count() * 10 + 116444736000000000ULL;
+	}
+	FILETIME ft;
+	ft.dwLowDateTime = (DWORD)ticks;
+	ft.dwHighDateTime = (DWORD)(ticks >> 32);
+	return ft;
+}
+
+const std::vector<MemoryKey*>& MemoryKey::subkeyIndex() {
+	reindex();
+	return subkeysByIndex;
+}
+
+const std::vector<MemoryValue*>& MemoryKey::valueIndex() {
+	reindex();
+	return valuesByIndex;
+}
+
+/**
+ * Rebuilds the enumeration index after a subkey or value was added or removed.
+ */
+void MemoryKey::reindex() {
+	if (!dirty) {
+		return;
+	}
+	subkeysByIndex.clear();
+	subkeysByIndex.reserve(subkeys.size());
+	for (auto const& it : subkeys) {
+		subkeysByIndex.push_back(it.second.get());
+	}
+	valuesByIndex.clear();
+	valuesByIndex.reserve(values.size());
+	for (auto& it : values) {
+		valuesByIndex.push_back(&it.second);
+	}
+	dirty = false;
+}
+
+/**
+ * Creates the predefined root keys.
+ */
+MemoryBackend::MemoryBackend() : clock(0) {
+	const std::pair<HKEY, const wchar_t*> predefined[] = {
+		{ HKEY_CLASSES_ROOT,                L"HKEY_CLASSES_ROOT" },
+		{ HKEY_CURRENT_CONFIG,              L"HKEY_CURRENT_CONFIG" },
+		{ HKEY_CURRENT_USER,                L"HKEY_CURRENT_USER" },
+		{ HKEY_CURRENT_USER_LOCAL_SETTINGS, L"HKEY_CURRENT_USER_LOCAL_SETTINGS" },
+		{ HKEY_LOCAL_MACHINE,               L"HKEY_LOCAL_MACHINE" },
+		{ HKEY_PERFORMANCE_DATA,            L"HKEY_PERFORMANCE_DATA" },
+		{ HKEY_PERFORMANCE_NLSTEXT,         L"HKEY_PERFORMANCE_NLSTEXT" },
+		{ HKEY_PERFORMANCE_TEXT,            L"HKEY_PERFORMANCE_TEXT" },
+		{ HKEY_USERS,                       L"HKEY_USERS" }
+	};
+	for (auto const& it : predefined) {
+		auto key = std::make_shared<MemoryKey>(it.second, (MemoryKey*)NULL);
+		key->lastWriteTime = now();
+		roots.insert(std::make_pair(it.first, key));
+	}
+}
+
+MemoryBackend::~MemoryBackend() {}
+
+LSTATUS MemoryBackend::beginTransaction(HANDLE* tx) {
+	*tx = new MemoryTransaction;
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::commitTransaction(HANDLE tx) {
+	if (!tx) {
+		return ERROR_INVALID_HANDLE;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	delete (MemoryTransaction*)tx;
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::rollbackTransaction(HANDLE tx) {
+	if (!tx) {
+		return ERROR_INVALID_HANDLE;
+	}
+	std::lock_guard<std::mutex> guard(lock);
+	MemoryTransaction* t = (MemoryTransaction*)tx;
+	for (auto it = t->undo.rbegin(); it != t->undo.rend(); ++it) {
+		(*it)();
+	}
+	delete t;
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::closeKey(HKEY hkey) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (roots.find(hkey) != roots.end()) {
+		return ERROR_SUCCESS;
+	}
+	if (!hkey) {
+		return ERROR_INVALID_HANDLE;
+	}
+
+	// drop any pending notifications so we never signal an event the caller is about to close
+	MemoryHandle* handle = (MemoryHandle*)hkey;
+	auto& list = handle->key->notifications;
+	for (auto it = list.begin(); it != list.end(); ) {
+		if (it->handle == handle) {
+			it = list.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	delete handle;
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	LSTATUS status = resolve(parent, key);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	std::wstring path(subkey ? subkey : L"");
+	std::wstring::size_type start = 0;
+	while (start <= path.length()) {
+		std::wstring::size_type end = path.find(L'\\', start);
+		if (end == std::wstring::npos) {
+			end = path.length();
+		}
+		if (end > start) {
+			std::wstring name = path.substr(start, end - start);
+			auto it = key->subkeys.find(name);
+			if (it == key->subkeys.end()) {
+				auto child = std::make_shared<MemoryKey>(name, key.get());
+				child->lastWriteTime = now();
+				key->subkeys.insert(std::make_pair(name, child));
+				key->dirty = true;
+				touch(key.get());
+				notify(key.get(), REG_NOTIFY_CHANGE_NAME);
+				if (tx) {
+					std::shared_ptr<MemoryKey> p = key;
+					((MemoryTransaction*)tx)->undo.push_back([p, child]() {
+						p->subkeys.erase(child->name);
+						p->dirty = true;
+						child->deleted = true;
+					});
+				}
+				key = child;
+			} else {
+				key = it->second;
+			}
+		}
+		start = end + 1;
+	}
+
+	*result = (HKEY)new MemoryHandle{ key, (MemoryTransaction*)tx };
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	LSTATUS status = resolve(parent, key);
+	if (status == ERROR_SUCCESS) {
+		status = walk(key, subkey);
+	}
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+	if (!key->parent) {
+		return ERROR_ACCESS_DENIED;
+	}
+	if (key->subkeys.size() > 0) {
+		return ERROR_ACCESS_DENIED;
+	}
+
+	MemoryKey* p = key->parent;
+	p->subkeys.erase(key->name);
+	p->dirty = true;
+	key->deleted = true;
+	touch(p);
+	notifyDeleted(key.get());
+	notify(p, REG_NOTIFY_CHANGE_NAME);
+
+	if (tx) {
+		((MemoryTransaction*)tx)->undo.push_back([p, key]() {
+			key->deleted = false;
+			p->subkeys.insert(std::make_pair(key->name, key));
+			p->dirty = true;
+		});
+	}
+
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::deleteValue(HKEY hkey, const wchar_t* name) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	MemoryTransaction* tx = NULL;
+	LSTATUS status = resolve(hkey, key, &tx);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	auto it = key->values.find(name ? name : L"");
+	if (it == key->values.end()) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	if (tx) {
+		MemoryValue prev = it->second;
+		tx->undo.push_back([key, prev]() {
+			key->values[prev.name] = prev;
+			key->dirty = true;
+		});
+	}
+
+	key->values.erase(it);
+	key->dirty = true;
+	touch(key.get());
+	notify(key.get(), REG_NOTIFY_CHANGE_LAST_SET);
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	LSTATUS status = resolve(hkey, key);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	auto& entries = key->subkeyIndex();
+	if (index >= entries.size()) {
+		return ERROR_NO_MORE_ITEMS;
+	}
+
+	const std::wstring& str = entries[index]->name;
+	if (*nameSize <= str.length()) {
+		*nameSize = (DWORD)str.length() + 1;
+		return ERROR_MORE_DATA;
+	}
+	::wmemcpy(name, str.c_str(), str.length() + 1);
+	*nameSize = (DWORD)str.length();
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	LSTATUS status = resolve(hkey, key);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	auto& entries = key->valueIndex();
+	if (index >= entries.size()) {
+		return ERROR_NO_MORE_ITEMS;
+	}
+
+	MemoryValue* value = entries[index];
+	if (*nameSize <= value->name.length()) {
+		*nameSize = (DWORD)value->name.length() + 1;
+		return ERROR_MORE_DATA;
+	}
+	::wmemcpy(name, value->name.c_str(), value->name.length() + 1);
+	*nameSize = (DWORD)value->name.length();
+
+	if (type) {
+		*type = value->type;
+	}
+	if (dataSize) {
+		DWORD size = (DWORD)value->data.size();
+		if (data && *dataSize < size) {
+			*dataSize = size;
+			return ERROR_MORE_DATA;
+		}
+		if (data && size) {
+			::memcpy(data, value->data.data(), size);
+		}
+		*dataSize = size;
+	}
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	LSTATUS status = resolve(hkey, key);
+	if (status == ERROR_SUCCESS) {
+		status = walk(key, subkey);
+	}
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	auto it = key->values.find(name ? name : L"");
+	if (it == key->values.end()) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	DWORD size = (DWORD)it->second.data.size();
+	if (type) {
+		*type = it->second.type;
+	}
+
+	// like Windows, performance data doesn't report the size it needs, the caller has to keep
+	// growing the buffer until it fits
+	if (hkey == HKEY_PERFORMANCE_DATA && (!data || !dataSize || *dataSize < size)) {
+		return ERROR_MORE_DATA;
+	}
+
+	if (data && (!dataSize || *dataSize < size)) {
+		if (dataSize) {
+			*dataSize = size;
+		}
+		return ERROR_MORE_DATA;
+	}
+	if (data && size) {
+		::memcpy(data, it->second.data.data(), size);
+	}
+	if (dataSize) {
+		*dataSize = size;
+	}
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	LSTATUS status = resolve(hkey, key);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	// like the registry, the performance data keys can't be notified
+	MemoryKey* root = key.get();
+	while (root->parent) {
+		root = root->parent;
+	}
+	for (HKEY perf : { HKEY_PERFORMANCE_DATA, HKEY_PERFORMANCE_NLSTEXT, HKEY_PERFORMANCE_TEXT }) {
+		if (roots[perf].get() == root) {
+			return ERROR_INVALID_HANDLE;
+		}
+	}
+
+	MemoryHandle* handle = roots.find(hkey) == roots.end() ? (MemoryHandle*)hkey : NULL;
+	for (auto& it : key->notifications) {
+		if (it.handle == handle && it.hevent == hevent) {
+			it.subtree = watchSubtree != FALSE;
+			it.filter = filter;
+			return ERROR_SUCCESS;
+		}
+	}
+	key->notifications.push_back(MemoryNotification{ handle, hevent, watchSubtree != FALSE, filter });
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	LSTATUS status = resolve(parent, key);
+	if (status == ERROR_SUCCESS) {
+		status = walk(key, subkey);
+	}
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+	*result = (HKEY)new MemoryHandle{ key, (MemoryTransaction*)tx };
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	LSTATUS status = resolve(hkey, key);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	DWORD maxSubkey = 0, maxName = 0, maxData = 0;
+	for (auto const& it : key->subkeys) {
+		if (it.first.length() > maxSubkey) maxSubkey = (DWORD)it.first.length();
+	}
+	for (auto const& it : key->values) {
+		if (it.first.length() > maxName) maxName = (DWORD)it.first.length();
+		if (it.second.data.size() > maxData) maxData = (DWORD)it.second.data.size();
+	}
+
+	if (numSubkeys) *numSubkeys = (DWORD)key->subkeys.size();
+	if (maxSubkeyLength) *maxSubkeyLength = maxSubkey;
+	if (numValues) *numValues = (DWORD)key->values.size();
+	if (maxValueNameLength) *maxValueNameLength = maxName;
+	if (maxValueLength) *maxValueLength = maxData;
+	if (lastWriteTime) *lastWriteTime = key->lastWriteTime;
+	return ERROR_SUCCESS;
+}
+
+LSTATUS MemoryBackend::setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<MemoryKey> key;
+	MemoryTransaction* tx = NULL;
+	LSTATUS status = resolve(hkey, key, &tx);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	std::wstring valueName(name ? name : L"");
+	auto it = key->values.find(valueName);
+
+	if (tx) {
+		if (it == key->values.end()) {
+			tx->undo.push_back([key, valueName]() {
+				key->values.erase(valueName);
+				key->dirty = true;
+			});
+		} else {
+			MemoryValue prev = it->second;
+			tx->undo.push_back([key, prev]() {
+				key->values[prev.name] = prev;
+			});
+		}
+	}
+
+	if (it == key->values.end()) {
+		it = key->values.insert(std::make_pair(valueName, MemoryValue{ valueName, type, {} })).first;
+		key->dirty = true;
+	}
+	it->second.type = type;
+	it->second.data.assign(data, data + dataSize);
+
+	touch(key.get());
+	notify(key.get(), REG_NOTIFY_CHANGE_LAST_SET);
+	return ERROR_SUCCESS;
+}
+
+/**
+ * Resolves a predefined root key or an opened key handle to its key.
+ */
+LSTATUS MemoryBackend::resolve(HKEY hkey, std::shared_ptr<MemoryKey>& key, MemoryTransaction** tx) {
+	auto it = roots.find(hkey);
+	if (it != roots.end()) {
+		key = it->second;
+		return ERROR_SUCCESS;
+	}
+	if (!hkey) {
+		return ERROR_INVALID_HANDLE;
+	}
+	MemoryHandle* handle = (MemoryHandle*)hkey;
+	if (handle->key->deleted) {
+		return ERROR_KEY_DELETED;
+	}
+	key = handle->key;
+	if (tx) {
+		*tx = handle->tx;
+	}
+	return ERROR_SUCCESS;
+}
+
+/**
+ * Descends from `key` through each backslash separated segment of `subkey`.
+ */
+LSTATUS MemoryBackend::walk(std::shared_ptr<MemoryKey>& key, const wchar_t* subkey) {
+	if (!subkey) {
+		return ERROR_SUCCESS;
+	}
+	const wchar_t* start = subkey;
+	while (*start) {
+		const wchar_t* end = start;
+		while (*end && *end != L'\\') {
+			++end;
+		}
+		if (end > start) {
+			auto it = key->subkeys.find(std::wstring(start, end - start));
+			if (it == key->subkeys.end()) {
+				return ERROR_FILE_NOT_FOUND;
+			}
+			key = it->second;
+		}
+		start = *end ? end + 1 : end;
+	}
+	return ERROR_SUCCESS;
+}
+
+/**
+ * Signals and removes the notifications registered on `key` that match `filter` as well as any
+ * subtree notifications registered on its ancestors. Registry notifications are one-shot.
+ */
+void MemoryBackend::notify(MemoryKey* key, DWORD filter) {
+	for (MemoryKey* k = key; k; k = k->parent) {
+		auto& list = k->notifications;
+		for (auto it = list.begin(); it != list.end(); ) {
+			if ((it->filter & filter) && (k == key || it->subtree)) {
+				::SetEvent(it->hevent);
+				it = list.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+}
+
+/**
+ * Signals every notification registered on a deleted key regardless of filter.
+ */
+void MemoryBackend::notifyDeleted(MemoryKey* key) {
+	for (auto const& it : key->notifications) {
+		::SetEvent(it.hevent);
+	}
+	key->notifications.clear();
+}
+
+/**
+ * Updates the key's last write time. The time always advances, even for writes within the same
+ * clock tick, so that readers can rely on it to detect modifications.
+ */
+void MemoryBackend::touch(MemoryKey* key) {
+	FILETIME ft = now();
+	uint64_t ticks = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	uint64_t last = ((uint64_t)key->lastWriteTime.dwHighDateTime << 32) | key->lastWriteTime.dwLowDateTime;
+	if (ticks <= last) {
+		ticks = last + 1;
+	}
+	key->lastWriteTime.dwLowDateTime = (DWORD)ticks;
+	key->lastWriteTime.dwHighDateTime = (DWORD)(ticks >> 32);
+}
@@ -0,0 +1,116 @@
+#ifndef __MEMORYBACKEND__
+#define __MEMORYBACKEND__
+
+#include "backend.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace winreglib {
+
+struct MemoryHandle;
+struct MemoryTransaction;
+
+/**
+ * A value stored in a `MemoryKey`.
+ */
+struct MemoryValue {
+	std::wstring name;
+	DWORD type;
+	std::vector<BYTE> data;
+};
+
+/**
+ * A pending change notification registered with `notifyChangeKeyValue()`.
+ */
+struct MemoryNotification {
+	MemoryHandle* handle;
+	HANDLE hevent;
+	bool subtree;
+	DWORD filter;
+};
+
+/**
+ * A key in the in-memory registry. Subkeys and values are kept in case-insensitive maps and
+ * enumerated through an index that is rebuilt lazily whenever an entry is added or removed.
+ */
+struct MemoryKey {
+	MemoryKey(const std::wstring& name, MemoryKey* parent) : name(name), parent(parent), deleted(false), dirty(false) {}
+
+	const std::vector<MemoryKey*>& subkeyIndex();
+	const std::vector<MemoryValue*>& valueIndex();
+
+	std::wstring name;
+	MemoryKey* parent;
+	bool deleted;
+	FILETIME lastWriteTime;
+	std::map<std::wstring, std::shared_ptr<MemoryKey>, NameLess> subkeys;
+	std::map<std::wstring, MemoryValue, NameLess> values;
+	std::vector<MemoryNotification> notifications;
+
+private:
+	void reindex();
+
+	bool dirty;
+	std::vector<MemoryKey*> subkeysByIndex;
+	std::vector<MemoryValue*> valuesByIndex;
+
+	friend class MemoryBackend;
+};
+
+/**
+ * A registry that lives entirely in memory. It is used on platforms without a Windows Registry so
+ * that the addon can be tested and benchmarked, and it can be selected on Windows too.
+ *
+ * Transactions are implemented with an undo log. They provide atomicity, but not isolation:
+ * uncommitted changes are visible to non-transacted readers.
+ */
+class MemoryBackend : public Backend {
+public:
+	MemoryBackend();
+	~MemoryBackend();
+
+	const char* name() { return "memory"; }
+
+	LSTATUS beginTransaction(HANDLE* tx);
+	LSTATUS commitTransaction(HANDLE tx);
+	LSTATUS rollbackTransaction(HANDLE tx);
+
+	LSTATUS closeKey(HKEY hkey);
+	LSTATUS createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result);
+	LSTATUS deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx);
+	LSTATUS deleteValue(HKEY hkey, const wchar_t* name);
+	LSTATUS enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize);
+	LSTATUS enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize);
+	LSTATUS getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize);
+	LSTATUS notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent);
+	LSTATUS openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result);
+	LSTATUS queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime);
+	LSTATUS setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize);
+
+	/**
+	 * Freezes the clock used for last write times at `ticks` (a FILETIME value) so that tests can
+	 * control them. `0` restores the system clock. Writes still advance a key's last write time by
+	 * at least one tick.
+	 */
+	void setClock(uint64_t ticks) { clock = ticks; }
+
+private:
+	FILETIME now();
+	LSTATUS resolve(HKEY hkey, std::shared_ptr<MemoryKey>& key, MemoryTransaction** tx = NULL);
+	LSTATUS walk(std::shared_ptr<MemoryKey>& key, const wchar_t* subkey);
+	void notify(MemoryKey* key, DWORD filter);
+	void notifyDeleted(MemoryKey* key);
+	void touch(MemoryKey* key);
+
+	std::atomic<uint64_t> clock;
+	std::mutex lock;
+	std::map<HKEY, std::shared_ptr<MemoryKey>> roots;
+};
+
+}
+
+#endif
@@ -0,0 +1,298 @@
+#include "monitor.h"
+#include "timeline.h"
+#include "watchman.h"
+#include <algorithm>
+
+using namespace winreglib;
+
+/**
+ * Returns the process-wide monitor.
+ */
+Monitor& Monitor::get() {
+	static Monitor monitor;
+	return monitor;
+}
+
+Monitor::Monitor() : requested(0), completed(0) {
+	term = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+	wake = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+Monitor::~Monitor() {
+	std::lock_guard<std::mutex> serialize(control);
+	stop();
+	::CloseHandle(term);
+	::CloseHandle(wake);
+}
+
+/**
+ * Starts waiting on the watchman's active nodes, starting the thread if needed.
+ */
+void Monitor::add(Watchman* watchman) {
+	std::lock_guard<std::mutex> serialize(control);
+	std::unique_lock<std::mutex> guard(lock);
+	if (std::find(watchmen.begin(), watchmen.end(), watchman) == watchmen.end()) {
+		watchmen.push_back(watchman);
+	}
+
+	if (!thread.joinable()) {
+		LOG_DEBUG_THREAD_ID("Monitor::add", L"Starting background thread")
+		::ResetEvent(term);
+		thread = std::thread(&Monitor::run, this);
+	}
+
+	sync(guard);
+}
+
+/**
+ * Returns true if no environment is watching any keys.
+ */
+bool Monitor::idle() {
+	std::lock_guard<std::mutex> guard(lock);
+	return watchmen.empty();
+}
+
+/**
+ * Stops waiting on the watchman's nodes. Blocks until the thread no longer references the
+ * watchman, then stops the thread if no other watchman is active.
+ */
+void Monitor::remove(Watchman* watchman) {
+	std::lock_guard<std::mutex> serialize(control);
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		auto it = std::find(watchmen.begin(), watchmen.end(), watchman);
+		if (it == watchmen.end()) {
+			return;
+		}
+		watchmen.erase(it);
+
+		if (!watchmen.empty()) {
+			sync(guard);
+			return;
+		}
+	}
+
+	stop();
+}
+
+/**
+ * Asks the thread to rebuild its list of handles without waiting for it. Returns the generation to
+ * check with `caughtUp()`. Watchmen are told through `rebuilt()` when the thread catches up.
+ */
+uint64_t Monitor::request() {
+	std::lock_guard<std::mutex> guard(lock);
+	if (!thread.joinable()) {
+		return 0;
+	}
+	uint64_t generation = ++requested;
+	::SetEvent(wake);
+	return generation;
+}
+
+/**
+ * Returns true if the thread has rebuilt its list of handles since the given generation was
+ * requested.
+ */
+bool Monitor::caughtUp(uint64_t generation) {
+	std::lock_guard<std::mutex> guard(lock);
+	return completed >= generation;
+}
+
+/**
+ * Notifies the watchman that owns a signaled node.
+ */
+void Monitor::notify(HANDLE handle, const std::pair<Watchman*, WatchRef>& node) {
+	TimelineSpan span("monitor", "Monitor::wake");
+	backend->signaled(handle);
+
+	std::lock_guard<std::mutex> guard(lock);
+	// the watchman may have been removed while we were waiting
+	if (std::find(watchmen.begin(), watchmen.end(), node.first) != watchmen.end()) {
+		// log on behalf of the watchman's environment
+		Instance::setCurrent(node.first->instance);
+		node.first->signal(node.second);
+		Instance::setCurrent(NULL);
+	}
+}
+
+/**
+ * Waits for an event to be signaled and notifies the watchman that owns it. Nodes that don't fit
+ * in this thread's wait are split into groups waited on by their own thread.
+ */
+void Monitor::run() {
+	LOG_DEBUG_THREAD_ID("Monitor::run", L"Initializing run loop")
+	Timeline::setThreadName("winreglib monitor");
+
+	std::vector<HANDLE> handles;
+	std::vector<std::pair<Watchman*, WatchRef>> nodes;
+	std::vector<std::unique_ptr<WaitGroup>> groups;
+	uint64_t generation = 0;
+	bool stale = true;
+
+	while (1) {
+		// rebuild the list of handles when a watchman's nodes changed, the first two are the term
+		// and wake events
+		std::vector<std::unique_ptr<WaitGroup>> retired;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			if (stale || requested != generation) {
+				generation = requested;
+				std::vector<HANDLE> all;
+				std::vector<std::pair<Watchman*, WatchRef>> owners;
+				for (auto const& watchman : watchmen) {
+					watchman->collect(all, owners);
+				}
+
+				size_t own = std::min(all.size(), (size_t)MAXIMUM_WAIT_OBJECTS - 2);
+				handles.clear();
+				handles.push_back(term);
+				handles.push_back(wake);
+				handles.insert(handles.end(), all.begin(), all.begin() + own);
+				nodes.assign(owners.begin(), owners.begin() + own);
+
+				// hand the rest to the waiter threads, starting more or retiring the extra ones
+				size_t needed = 0;
+				for (size_t i = own; i < all.size(); i += MAXIMUM_WAIT_OBJECTS - 1, ++needed) {
+					size_t n = std::min(all.size() - i, (size_t)MAXIMUM_WAIT_OBJECTS - 1);
+					if (needed == groups.size()) {
+						groups.emplace_back(new WaitGroup());
+						groups.back()->refresh = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+						groups.back()->exit = false;
+						groups.back()->thread = std::thread(&Monitor::wait, this, groups.back().get());
+					}
+					WaitGroup* group = groups[needed].get();
+					group->handles.assign(1, group->refresh);
+					group->handles.insert(group->handles.end(), all.begin() + i, all.begin() + i + n);
+					group->nodes.assign(owners.begin() + i, owners.begin() + i + n);
+					group->dirty = true;
+					::SetEvent(group->refresh);
+				}
+				for (size_t i = needed; i < groups.size(); ++i) {
+					groups[i]->exit = true;
+					groups[i]->dirty = true;
+					::SetEvent(groups[i]->refresh);
+				}
+
+				// the old handles may be closed once we're caught up, so every group has to have let
+				// go of them first
+				regrouped.wait(guard, [&]() {
+					return std::none_of(groups.begin(), groups.end(), [](const std::unique_ptr<WaitGroup>& group) {
+						return group->dirty;
+					});
+				});
+				for (size_t i = needed; i < groups.size(); ++i) {
+					retired.push_back(std::move(groups[i]));
+				}
+				groups.resize(needed);
+
+				completed = generation;
+				for (auto const& watchman : watchmen) {
+					watchman->rebuilt(generation);
+				}
+				stale = false;
+			}
+		}
+		synced.notify_all();
+
+		for (auto const& group : retired) {
+			group->thread.join();
+			::CloseHandle(group->refresh);
+		}
+
+		DWORD result;
+		{
+			TimelineSpan span("monitor", "WaitForMultipleObjects");
+			result = ::WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, INFINITE);
+		}
+
+		if (result == WAIT_OBJECT_0) {
+			break;
+		}
+
+		if (result == WAIT_FAILED) {
+			// nothing we can do but wait to be told to rebuild the handles
+			::WaitForMultipleObjects(2, handles.data(), FALSE, INFINITE);
+			continue;
+		}
+
+		DWORD idx = result - WAIT_OBJECT_0;
+		if (idx >= 2 && idx < handles.size()) {
+			notify(handles[idx], nodes[idx - 2]);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto const& group : groups) {
+			group->exit = true;
+			::SetEvent(group->refresh);
+		}
+	}
+	for (auto const& group : groups) {
+		group->thread.join();
+		::CloseHandle(group->refresh);
+	}
+}
+
+/**
+ * Waits on a group of nodes the monitor thread couldn't fit in its own wait.
+ */
+void Monitor::wait(WaitGroup* group) {
+	Timeline::setThreadName("winreglib monitor");
+
+	std::vector<HANDLE> handles;
+	std::vector<std::pair<Watchman*, WatchRef>> nodes;
+
+	while (1) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (group->exit) {
+				group->dirty = false;
+				regrouped.notify_all();
+				return;
+			}
+			if (group->dirty) {
+				handles.swap(group->handles);
+				nodes.swap(group->nodes);
+				group->dirty = false;
+				regrouped.notify_all();
+			}
+		}
+
+		DWORD result;
+		{
+			TimelineSpan span("monitor", "WaitForMultipleObjects");
+			result = ::WaitForMultipleObjects((DWORD)handles.size(), handles.data(), FALSE, INFINITE);
+		}
+
+		if (result == WAIT_FAILED) {
+			// wait to be handed a new list of handles
+			::WaitForMultipleObjects(1, handles.data(), FALSE, INFINITE);
+			continue;
+		}
+
+		DWORD idx = result - WAIT_OBJECT_0;
+		if (idx >= 1 && idx < handles.size()) {
+			notify(handles[idx], nodes[idx - 1]);
+		}
+	}
+}
+
+/**
+ * Stops the thread and waits for it to exit. The caller must hold the control lock.
+ */
+void Monitor::stop() {
+	if (thread.joinable()) {
+		::SetEvent(term);
+		thread.join();
+	}
+}
+
+/**
+ * Wakes the thread and waits until it has rebuilt its list of handles.
+ */
+void Monitor::sync(std::unique_lock<std::mutex>& guard) {
+	uint64_t generation = ++requested;
+	::SetEvent(wake);
+	synced.wait(guard, [&]() { return completed >= generation; });
+}
@@ -0,0 +1,74 @@
+#ifndef __MONITOR__
+#define __MONITOR__
+
+#include "winreglib.h"
+#include "watchnode.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace winreglib {
+
+class Watchman;
+
+/**
+ * The background thread that waits for registry change notifications on behalf of every
+ * environment's `Watchman`. Sharing one thread means watching keys from several worker threads
+ * doesn't tie up a thread per worker. The thread is started when the first `Watchman` has a
+ * watched key and stopped when the last one has none.
+ *
+ * One wait can hold at most `MAXIMUM_WAIT_OBJECTS` handles, so the thread waits on the first 62
+ * nodes itself and hands the rest to a waiter thread per 63 nodes.
+ */
+class Monitor {
+public:
+	static Monitor& get();
+
+	~Monitor();
+
+	void add(Watchman* watchman);
+	bool caughtUp(uint64_t generation);
+	bool idle();
+	void remove(Watchman* watchman);
+	uint64_t request();
+
+private:
+	/**
+	 * A waiter thread and the nodes it waits on. The monitor thread hands it a new list of handles
+	 * by setting `dirty` and signaling `refresh`, the first handle of every list. The thread clears
+	 * `dirty` once it's no longer waiting on the old list, and returns instead if `exit` is set.
+	 */
+	struct WaitGroup {
+		HANDLE refresh;
+		std::vector<HANDLE> handles;
+		std::vector<std::pair<Watchman*, WatchRef>> nodes;
+		std::thread thread;
+		bool dirty;
+		bool exit;
+	};
+
+	Monitor();
+
+	void notify(HANDLE handle, const std::pair<Watchman*, WatchRef>& node);
+	void run();
+	void stop();
+	void sync(std::unique_lock<std::mutex>& lock);
+	void wait(WaitGroup* group);
+
+	std::mutex control;
+	std::mutex lock;
+	std::condition_variable regrouped;
+	std::condition_variable synced;
+	std::vector<Watchman*> watchmen;
+	std::thread thread;
+	HANDLE term;
+	HANDLE wake;
+	uint64_t requested;
+	uint64_t completed;
+};
+
+}
+
+#endif
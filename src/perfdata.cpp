@@ -0,0 +1,288 @@
+#include "perfdata.h"
+#include <cmath>
+#include <cstring>
+
+using namespace winreglib;
+
+/**
+ * The size of the first read, and the most a read may grow to.
+ */
+#define PERF_BUFFER_INITIAL 65536
+#define PERF_BUFFER_LIMIT (256 * 1024 * 1024)
+
+/**
+ * The sizes of the fixed parts of the structures. They are the same in 32 and 64-bit processes.
+ */
+#define PERF_DATA_BLOCK_SIZE 88
+#define PERF_OBJECT_TYPE_SIZE 64
+#define PERF_COUNTER_DEFINITION_SIZE 40
+#define PERF_INSTANCE_DEFINITION_SIZE 24
+#define PERF_COUNTER_BLOCK_SIZE 4
+
+#define PERF_NO_INSTANCES -1
+
+namespace {
+
+inline uint16_t read16(const BYTE* p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t read32(const BYTE* p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t read64(const BYTE* p) {
+	return (uint64_t)read32(p) | ((uint64_t)read32(p + 4) << 32);
+}
+
+/**
+ * Reads a null-terminated UTF-16 name of at most `length` bytes, or a name in the object's code
+ * page, which is treated as Latin-1.
+ */
+void readName(const BYTE* p, size_t length, bool wide, std::wstring& name) {
+	name.clear();
+	if (wide) {
+		for (size_t i = 0; i + 1 < length; i += 2) {
+			wchar_t c = (wchar_t)read16(p + i);
+			if (!c) {
+				break;
+			}
+			name += c;
+		}
+	} else {
+		for (size_t i = 0; i < length && p[i]; ++i) {
+			name += (wchar_t)p[i];
+		}
+	}
+}
+
+/**
+ * Appends a row of counter values from the `PERF_COUNTER_BLOCK` at `offset` within the object.
+ * Returns the block's length, or 0 if it doesn't fit.
+ */
+DWORD readCounterBlock(const BYTE* object, DWORD offset, DWORD objectLength, PerfObject& obj) {
+	if ((uint64_t)offset + PERF_COUNTER_BLOCK_SIZE > objectLength) {
+		return 0;
+	}
+	DWORD length = read32(object + offset);
+	if (length < PERF_COUNTER_BLOCK_SIZE || (uint64_t)offset + length > objectLength) {
+		return 0;
+	}
+
+	const BYTE* block = object + offset;
+	for (auto const& counter : obj.counters) {
+		bool fits = (uint64_t)counter.offset + counter.size <= length;
+		if (fits && counter.size == 4) {
+			obj.values.push_back((double)read32(block + counter.offset));
+		} else if (fits && counter.size == 8) {
+			obj.values.push_back((double)read64(block + counter.offset));
+		} else {
+			obj.values.push_back(NAN);
+		}
+	}
+	return length;
+}
+
+}
+
+bool winreglib::parsePerfData(const BYTE* data, size_t length, PerfData& result, std::string& error) {
+	if (length < PERF_DATA_BLOCK_SIZE || ::memcmp(data, "P\0E\0R\0F\0", 8) != 0) {
+		error = "Invalid performance data signature";
+		return false;
+	}
+	if (read32(data + 8) != 1) {
+		error = "Big-endian performance data is not supported";
+		return false;
+	}
+
+	DWORD total = read32(data + 20);
+	DWORD headerLength = read32(data + 24);
+	DWORD numObjects = read32(data + 28);
+	if (total > length || headerLength < PERF_DATA_BLOCK_SIZE || headerLength > total) {
+		error = "Truncated performance data";
+		return false;
+	}
+
+	for (int i = 0; i < 8; ++i) {
+		result.systemTime[i] = read16(data + 36 + i * 2);
+	}
+	result.time = read64(data + 56);
+	result.frequency = read64(data + 64);
+	result.time100ns = read64(data + 72);
+
+	DWORD nameLength = read32(data + 80);
+	DWORD nameOffset = read32(data + 84);
+	if (nameLength && (uint64_t)nameOffset + nameLength <= total) {
+		readName(data + nameOffset, nameLength, true, result.systemName);
+	} else {
+		result.systemName.clear();
+	}
+
+	// objects and their vectors are reused, only the count shrinks
+	if (result.objects.size() < numObjects && numObjects <= total / PERF_OBJECT_TYPE_SIZE) {
+		result.objects.resize(numObjects);
+	}
+	result.objectCount = 0;
+
+	size_t offset = headerLength;
+	for (DWORD i = 0; i < numObjects; ++i) {
+		if (offset + PERF_OBJECT_TYPE_SIZE > total || i >= result.objects.size()) {
+			error = "Truncated performance object";
+			return false;
+		}
+
+		const BYTE* o = data + offset;
+		DWORD objectLength = read32(o);
+		DWORD definitionLength = read32(o + 4);
+		DWORD objectHeaderLength = read32(o + 8);
+		if (
+			objectLength < PERF_OBJECT_TYPE_SIZE
+			|| offset + objectLength > total
+			|| objectHeaderLength < PERF_OBJECT_TYPE_SIZE
+			|| definitionLength < objectHeaderLength
+			|| definitionLength > objectLength
+		) {
+			error = "Invalid performance object";
+			return false;
+		}
+
+		// every counter definition takes at least its fixed size
+		DWORD numCounters = read32(o + 32);
+		if (numCounters > (definitionLength - objectHeaderLength) / PERF_COUNTER_DEFINITION_SIZE) {
+			error = "Invalid performance object";
+			return false;
+		}
+
+		PerfObject& obj = result.objects[i];
+		obj.nameIndex = read32(o + 12);
+		obj.helpIndex = read32(o + 20);
+		obj.detailLevel = read32(o + 28);
+		obj.defaultCounter = (LONG)read32(o + 36);
+		LONG numInstances = (LONG)read32(o + 40);
+		bool wide = read32(o + 44) == 0;
+		obj.time = read64(o + 48);
+		obj.frequency = read64(o + 56);
+		obj.hasInstances = numInstances != PERF_NO_INSTANCES;
+		obj.values.clear();
+
+		// counter definitions follow the object header
+		obj.counters.clear();
+		obj.counters.reserve(numCounters);
+		DWORD pos = objectHeaderLength;
+		for (DWORD c = 0; c < numCounters; ++c) {
+			if ((uint64_t)pos + PERF_COUNTER_DEFINITION_SIZE > definitionLength) {
+				error = "Truncated performance counter definition";
+				return false;
+			}
+			const BYTE* d = o + pos;
+			DWORD byteLength = read32(d);
+			if (byteLength < PERF_COUNTER_DEFINITION_SIZE || (uint64_t)byteLength > (uint64_t)definitionLength - pos) {
+				error = "Invalid performance counter definition";
+				return false;
+			}
+			obj.counters.push_back(PerfCounter{
+				read32(d + 4),
+				read32(d + 12),
+				(LONG)read32(d + 20),
+				read32(d + 24),
+				read32(d + 28),
+				read32(d + 32),
+				read32(d + 36)
+			});
+			pos += byteLength;
+		}
+
+		// instances follow the definitions, each followed by its counter block, otherwise there is
+		// a single counter block
+		size_t count = 0;
+		if (!obj.hasInstances) {
+			if (!readCounterBlock(o, definitionLength, objectLength, obj)) {
+				error = "Truncated performance counter block";
+				return false;
+			}
+		} else {
+			pos = definitionLength;
+			for (LONG n = 0; n < numInstances; ++n) {
+				if ((uint64_t)pos + PERF_INSTANCE_DEFINITION_SIZE > objectLength) {
+					error = "Truncated performance instance";
+					return false;
+				}
+				const BYTE* d = o + pos;
+				DWORD byteLength = read32(d);
+				DWORD instanceNameOffset = read32(d + 16);
+				DWORD instanceNameLength = read32(d + 20);
+				if (
+					byteLength < PERF_INSTANCE_DEFINITION_SIZE
+					|| (uint64_t)pos + byteLength > objectLength
+					|| (uint64_t)instanceNameOffset + instanceNameLength > byteLength
+				) {
+					error = "Invalid performance instance";
+					return false;
+				}
+
+				if (count == obj.instances.size()) {
+					obj.instances.emplace_back();
+				}
+				PerfInstance& instance = obj.instances[count++];
+				instance.parentObject = read32(d + 4);
+				instance.parentInstance = read32(d + 8);
+				instance.uniqueId = (LONG)read32(d + 12);
+				readName(d + instanceNameOffset, instanceNameLength, wide, instance.name);
+
+				DWORD blockLength = readCounterBlock(o, pos + byteLength, objectLength, obj);
+				if (!blockLength) {
+					error = "Truncated performance counter block";
+					return false;
+				}
+				pos += byteLength + blockLength;
+			}
+		}
+		obj.instances.resize(count);
+
+		result.objectCount = i + 1;
+		offset += objectLength;
+	}
+
+	return true;
+}
+
+/**
+ * Tells the registry the performance data is no longer needed, which unloads the providers.
+ */
+void PerfReader::close(Backend* backend) {
+	if (!closed) {
+		closed = true;
+		backend->closeKey(HKEY_PERFORMANCE_DATA);
+		std::vector<BYTE>().swap(buffer);
+		size = 0;
+	}
+}
+
+/**
+ * Reads and parses a sample. Returns `ERROR_INVALID_DATA` and sets `error` if the data can't be
+ * parsed.
+ */
+LSTATUS PerfReader::read(Backend* backend, std::string& error) {
+	LSTATUS status = readPerfValue(backend, HKEY_PERFORMANCE_DATA, NULL, query.c_str(), buffer, size, NULL);
+	if (status == ERROR_SUCCESS && !parsePerfData(buffer.data(), size, parsed, error)) {
+		status = ERROR_INVALID_DATA;
+	}
+	return status;
+}
+
+LSTATUS winreglib::readPerfValue(Backend* backend, HKEY hkey, const wchar_t* subkey, const wchar_t* name, std::vector<BYTE>& buffer, DWORD& size, DWORD* type) {
+	if (buffer.empty()) {
+		buffer.resize(PERF_BUFFER_INITIAL);
+	}
+	while (true) {
+		size = (DWORD)buffer.size();
+		LSTATUS status = backend->getValue(hkey, subkey, name, RRF_RT_ANY, type, buffer.data(), &size);
+		if (status != ERROR_MORE_DATA) {
+			return status;
+		}
+		if (buffer.size() >= PERF_BUFFER_LIMIT) {
+			return ERROR_OUTOFMEMORY;
+		}
+		buffer.resize(buffer.size() * 2);
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef __PERFDATA__
+#define __PERFDATA__
+
+#include "backend.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * A `PERF_COUNTER_DEFINITION`.
+ */
+struct PerfCounter {
+	DWORD nameIndex;
+	DWORD helpIndex;
+	LONG scale;
+	DWORD detailLevel;
+	DWORD type;
+	DWORD size;
+	DWORD offset;
+};
+
+/**
+ * A `PERF_INSTANCE_DEFINITION`.
+ */
+struct PerfInstance {
+	std::wstring name;
+	DWORD parentObject;
+	DWORD parentInstance;
+	LONG uniqueId;
+};
+
+/**
+ * A `PERF_OBJECT_TYPE` with its counter definitions and values. `values` holds one row of counter
+ * values per instance, or a single row if the object has no instances. Counters that aren't 4 or 8
+ * bytes, such as text counters, are `NaN`.
+ */
+struct PerfObject {
+	DWORD nameIndex;
+	DWORD helpIndex;
+	DWORD detailLevel;
+	LONG defaultCounter;
+	bool hasInstances;
+	uint64_t time;
+	uint64_t frequency;
+	std::vector<PerfCounter> counters;
+	std::vector<PerfInstance> instances;
+	std::vector<double> values;
+};
+
+/**
+ * A parsed `PERF_DATA_BLOCK`. Parsing into the same instance again reuses its vectors, so repeated
+ * samples of the same objects don't allocate once the first one has been parsed.
+ */
+struct PerfData {
+	PerfData() : objectCount(0) {}
+
+	std::wstring systemName;
+	uint16_t systemTime[8];
+	uint64_t time;
+	uint64_t frequency;
+	uint64_t time100ns;
+	std::vector<PerfObject> objects;
+	size_t objectCount;
+};
+
+/**
+ * Parses performance data as returned by `HKEY_PERFORMANCE_DATA`. The structures are read at
+ * fixed little-endian offsets rather than through the Windows headers, so captured data can be
+ * parsed on any platform. Returns false if the data is truncated or inconsistent.
+ */
+bool parsePerfData(const BYTE* data, size_t length, PerfData& result, std::string& error);
+
+/**
+ * Reads a value into `buffer`, doubling it for as long as the backend returns `ERROR_MORE_DATA`.
+ * `HKEY_PERFORMANCE_DATA` doesn't report the size it needs, so this is the only way to read it.
+ * On success, `size` is the number of bytes read.
+ */
+LSTATUS readPerfValue(Backend* backend, HKEY hkey, const wchar_t* subkey, const wchar_t* name, std::vector<BYTE>& buffer, DWORD& size, DWORD* type);
+
+/**
+ * Reads performance data for a query such as "Global", "Costly", or a space-separated list of
+ * object indexes. The buffer grows until the data fits and is kept between reads, and the parsed
+ * sample reuses its vectors, so sampling the same objects repeatedly doesn't allocate.
+ */
+class PerfReader {
+public:
+	PerfReader(const std::wstring& query) : query(query), size(0), closed(false) {}
+
+	void close(Backend* backend);
+	LSTATUS read(Backend* backend, std::string& error);
+
+	std::wstring query;
+	std::vector<BYTE> buffer;
+	DWORD size;
+	PerfData parsed;
+	bool closed;
+};
+
+}
+
+#endif
@@ -0,0 +1,201 @@
+#include "platform.h"
+
+#ifdef _WIN32
+
+#include <map>
+#include <mutex>
+
+std::wstring winreglib::formatSystemMessage(DWORD status) {
+	// FormatMessage() searches the system message table every time, so each status is only
+	// formatted once, errors are also created on worker threads
+	static std::mutex lock;
+	static std::map<DWORD, std::wstring> messages;
+
+	std::lock_guard<std::mutex> guard(lock);
+	auto it = messages.find(status);
+	if (it != messages.end()) {
+		return it->second;
+	}
+
+	wchar_t msg[512];
+	DWORD len = ::FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, NULL, status, 0, msg, 512, NULL);
+	while (len > 0 && (msg[len - 1] == L'\r' || msg[len - 1] == L'\n' || msg[len - 1] == L' ')) {
+		--len;
+	}
+	return messages.emplace(status, std::wstring(msg, len)).first->second;
+}
+
+#else
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+namespace winreglib {
+	/**
+	 * All emulated events share one lock and condition variable. Waits are rare and short-lived
+	 * (the watcher thread is the only waiter), so waking every waiter on every signal is fine.
+	 */
+	struct Event {
+		bool manualReset;
+		bool signaled;
+	};
+
+	static std::mutex eventsLock;
+	static std::condition_variable eventsSignal;
+	static DWORD lastError = ERROR_SUCCESS;
+
+	std::wstring formatSystemMessage(DWORD status) {
+		switch (status) {
+			case ERROR_SUCCESS:           return L"The operation completed successfully.";
+			case ERROR_FILE_NOT_FOUND:    return L"The system cannot find the file specified.";
+			case ERROR_ACCESS_DENIED:     return L"Access is denied.";
+			case ERROR_INVALID_HANDLE:    return L"The handle is invalid.";
+			case ERROR_INVALID_DATA:      return L"The data is invalid.";
+			case ERROR_OUTOFMEMORY:       return L"Not enough memory resources are available to complete this operation.";
+			case ERROR_WRITE_FAULT:       return L"The system cannot write to the specified device.";
+			case ERROR_INVALID_PARAMETER: return L"The parameter is incorrect.";
+			case ERROR_MORE_DATA:         return L"More data is available.";
+			case ERROR_NO_MORE_ITEMS:     return L"No more data is available.";
+			case ERROR_KEY_DELETED:       return L"Illegal operation attempted on a registry key that has been marked for deletion.";
+			case ERROR_KEY_HAS_CHILDREN:  return L"Cannot create a symbolic link in a registry key that already has subkeys or values.";
+		}
+		return L"Unknown error " + std::to_wstring(status);
+	}
+}
+
+using namespace winreglib;
+
+HANDLE CreateEvent(void* attributes, BOOL manualReset, BOOL initialState, const wchar_t* name) {
+	return new Event{ manualReset != FALSE, initialState != FALSE };
+}
+
+BOOL SetEvent(HANDLE handle) {
+	if (!handle) {
+		lastError = ERROR_INVALID_HANDLE;
+		return FALSE;
+	}
+	{
+		std::lock_guard<std::mutex> lock(eventsLock);
+		((Event*)handle)->signaled = true;
+	}
+	eventsSignal.notify_all();
+	return TRUE;
+}
+
+BOOL ResetEvent(HANDLE handle) {
+	if (!handle) {
+		lastError = ERROR_INVALID_HANDLE;
+		return FALSE;
+	}
+	std::lock_guard<std::mutex> lock(eventsLock);
+	((Event*)handle)->signaled = false;
+	return TRUE;
+}
+
+BOOL CloseHandle(HANDLE handle) {
+	if (!handle) {
+		lastError = ERROR_INVALID_HANDLE;
+		return FALSE;
+	}
+	std::lock_guard<std::mutex> lock(eventsLock);
+	delete (Event*)handle;
+	return TRUE;
+}
+
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD milliseconds) {
+	// like Windows, a wait holds at most MAXIMUM_WAIT_OBJECTS handles
+	if (count == 0 || count > MAXIMUM_WAIT_OBJECTS || waitAll) {
+		lastError = ERROR_INVALID_PARAMETER;
+		return WAIT_FAILED;
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+	std::unique_lock<std::mutex> lock(eventsLock);
+
+	while (1) {
+		for (DWORD i = 0; i < count; ++i) {
+			Event* evt = (Event*)handles[i];
+			if (evt && evt->signaled) {
+				if (!evt->manualReset) {
+					evt->signaled = false;
+				}
+				return WAIT_OBJECT_0 + i;
+			}
+		}
+
+		if (milliseconds == INFINITE) {
+			eventsSignal.wait(lock);
+		} else if (eventsSignal.wait_until(lock, deadline) == std::cv_status::timeout) {
+			return WAIT_TIMEOUT;
+		}
+	}
+}
+
+DWORD GetLastError() {
+	return lastError;
+}
+
+WCHAR RtlUpcaseUnicodeChar(WCHAR c) {
+	if (c < 0x80) {
+		return c >= L'a' && c <= L'z' ? (WCHAR)(c - 0x20) : c;
+	}
+
+	// Latin-1, the letters are 0x20 apart except for the division sign and y with diaeresis
+	if (c >= 0xE0 && c <= 0xFE && c != 0xF7) {
+		return (WCHAR)(c - 0x20);
+	}
+	if (c == 0xFF) {
+		return 0x178;
+	}
+
+	// Latin Extended-A pairs each uppercase letter with the lowercase one after it, the dotted and
+	// dotless i and the long s have no pair
+	if ((c >= 0x100 && c <= 0x12F) || (c >= 0x132 && c <= 0x137) || (c >= 0x14A && c <= 0x177)) {
+		return (c & 1) ? (WCHAR)(c - 1) : c;
+	}
+	if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) {
+		return (c & 1) ? c : (WCHAR)(c - 1);
+	}
+
+	// Greek, the final sigma uppercases like sigma
+	if (c == 0x3C2) {
+		return 0x3A3;
+	}
+	if (c >= 0x3B1 && c <= 0x3CB) {
+		return (WCHAR)(c - 0x20);
+	}
+	if (c == 0x3AC) {
+		return 0x386;
+	}
+	if (c >= 0x3AD && c <= 0x3AF) {
+		return (WCHAR)(c - 0x25);
+	}
+	if (c == 0x3CC) {
+		return 0x38C;
+	}
+	if (c == 0x3CD || c == 0x3CE) {
+		return (WCHAR)(c - 0x3F);
+	}
+
+	// Cyrillic
+	if (c >= 0x430 && c <= 0x44F) {
+		return (WCHAR)(c - 0x20);
+	}
+	if (c >= 0x450 && c <= 0x45F) {
+		return (WCHAR)(c - 0x50);
+	}
+	if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || (c >= 0x4D0 && c <= 0x4FF)) {
+		return (c & 1) ? (WCHAR)(c - 1) : c;
+	}
+
+	// fullwidth Latin
+	if (c >= 0xFF41 && c <= 0xFF5A) {
+		return (WCHAR)(c - 0x20);
+	}
+
+	return c;
+}
+
+#endif
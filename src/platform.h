@@ -0,0 +1,135 @@
+#ifndef __PLATFORM__
+#define __PLATFORM__
+
+/**
+ * Everything outside of the Win32 backend is written against the Win32 registry types, constants,
+ * and event primitives. On Windows these come straight from <windows.h>. Everywhere else, this
+ * header defines just enough of them so that the addon can be compiled against the in-memory
+ * backend for testing and benchmarking.
+ */
+
+#ifdef _WIN32
+	#include <windows.h>
+
+	/**
+	 * Uppercases a UTF-16 code unit with the system's upcase table, the one the registry compares
+	 * names with. Exported by ntdll.
+	 */
+	extern "C" __declspec(dllimport) WCHAR NTAPI RtlUpcaseUnicodeChar(WCHAR c);
+#else
+	#include <cstddef>
+	#include <cstdint>
+
+	typedef uint8_t BYTE;
+	typedef int BOOL;
+	typedef uint32_t DWORD;
+	typedef wchar_t WCHAR;
+	typedef int32_t LONG;
+	typedef LONG LSTATUS;
+	typedef uint64_t ULONGLONG;
+	typedef DWORD REGSAM;
+	typedef void* HANDLE;
+	typedef struct HKEY__* HKEY;
+
+	typedef struct _FILETIME {
+		DWORD dwLowDateTime;
+		DWORD dwHighDateTime;
+	} FILETIME;
+
+	#ifndef FALSE
+		#define FALSE 0
+	#endif
+	#ifndef TRUE
+		#define TRUE 1
+	#endif
+
+	#define HKEY_CLASSES_ROOT                ((HKEY)(uintptr_t)0x80000000)
+	#define HKEY_CURRENT_USER                ((HKEY)(uintptr_t)0x80000001)
+	#define HKEY_LOCAL_MACHINE               ((HKEY)(uintptr_t)0x80000002)
+	#define HKEY_USERS                       ((HKEY)(uintptr_t)0x80000003)
+	#define HKEY_PERFORMANCE_DATA            ((HKEY)(uintptr_t)0x80000004)
+	#define HKEY_CURRENT_CONFIG              ((HKEY)(uintptr_t)0x80000005)
+	#define HKEY_CURRENT_USER_LOCAL_SETTINGS ((HKEY)(uintptr_t)0x80000007)
+	#define HKEY_PERFORMANCE_TEXT            ((HKEY)(uintptr_t)0x80000050)
+	#define HKEY_PERFORMANCE_NLSTEXT         ((HKEY)(uintptr_t)0x80000060)
+
+	#define ERROR_SUCCESS           0L
+	#define ERROR_FILE_NOT_FOUND    2L
+	#define ERROR_ACCESS_DENIED     5L
+	#define ERROR_INVALID_HANDLE    6L
+	#define ERROR_INVALID_DATA      13L
+	#define ERROR_OUTOFMEMORY       14L
+	#define ERROR_WRITE_FAULT       29L
+	#define ERROR_INVALID_PARAMETER 87L
+	#define ERROR_MORE_DATA         234L
+	#define ERROR_NO_MORE_ITEMS     259L
+	#define ERROR_KEY_DELETED       1018L
+	#define ERROR_KEY_HAS_CHILDREN  1020L
+
+	#define REG_NONE                       0
+	#define REG_SZ                         1
+	#define REG_EXPAND_SZ                  2
+	#define REG_BINARY                     3
+	#define REG_DWORD                      4
+	#define REG_DWORD_LITTLE_ENDIAN        4
+	#define REG_DWORD_BIG_ENDIAN           5
+	#define REG_LINK                       6
+	#define REG_MULTI_SZ                   7
+	#define REG_RESOURCE_LIST              8
+	#define REG_FULL_RESOURCE_DESCRIPTOR   9
+	#define REG_RESOURCE_REQUIREMENTS_LIST 10
+	#define REG_QWORD                      11
+	#define REG_QWORD_LITTLE_ENDIAN        11
+
+	#define REG_NOTIFY_CHANGE_NAME       0x00000001L
+	#define REG_NOTIFY_CHANGE_ATTRIBUTES 0x00000002L
+	#define REG_NOTIFY_CHANGE_LAST_SET   0x00000004L
+	#define REG_NOTIFY_CHANGE_SECURITY   0x00000008L
+
+	#define KEY_QUERY_VALUE        0x0001
+	#define KEY_SET_VALUE          0x0002
+	#define KEY_CREATE_SUB_KEY     0x0004
+	#define KEY_ENUMERATE_SUB_KEYS 0x0008
+	#define KEY_NOTIFY             0x0010
+	#define KEY_READ               0x20019
+	#define KEY_WRITE              0x20006
+	#define DELETE                 0x00010000L
+	#define MAXIMUM_ALLOWED        0x02000000L
+
+	#define RRF_RT_ANY      0x0000ffff
+	#define RRF_NOEXPAND    0x10000000
+
+	#define INFINITE             0xFFFFFFFF
+	#define MAXIMUM_WAIT_OBJECTS 64
+	#define WAIT_OBJECT_0        0x00000000L
+	#define WAIT_TIMEOUT         258L
+	#define WAIT_FAILED          ((DWORD)0xFFFFFFFF)
+
+	/**
+	 * Minimal auto/manual reset event emulation used by the watcher thread.
+	 */
+	HANDLE CreateEvent(void* attributes, BOOL manualReset, BOOL initialState, const wchar_t* name);
+	BOOL SetEvent(HANDLE handle);
+	BOOL ResetEvent(HANDLE handle);
+	BOOL CloseHandle(HANDLE handle);
+	DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD milliseconds);
+	DWORD GetLastError();
+
+	/**
+	 * Uppercases a UTF-16 code unit regardless of the locale. Emulates the system's upcase table
+	 * for the Latin, Greek, Cyrillic, and fullwidth Latin letters.
+	 */
+	WCHAR RtlUpcaseUnicodeChar(WCHAR c);
+#endif
+
+#include <string>
+
+namespace winreglib {
+	/**
+	 * Returns the system message for a Win32 error code without the trailing line break. Messages
+	 * are cached, so formatting the same error again is cheap.
+	 */
+	std::wstring formatSystemMessage(DWORD status);
+}
+
+#endif
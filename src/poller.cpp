@@ -0,0 +1,304 @@
+#include "poller.h"
+#include "backend.h"
+#include "fingerprint.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+using namespace winreglib;
+
+namespace {
+
+/**
+ * The frozen time in milliseconds, or 0 to use the steady clock.
+ */
+std::atomic<uint64_t> simulatedClock(0);
+
+}
+
+/**
+ * Schedules an entry at a tick. Entries that are already due fire on the next tick.
+ */
+void TimerWheel::add(const WatchRef& ref, uint64_t due) {
+	if (due <= current) {
+		due = current + 1;
+	}
+	place(PollEntry{ ref, due });
+	++count;
+}
+
+/**
+ * Moves the wheel forward to `tick`, appending the entries that came due. Stretches without
+ * entries are skipped rather than stepped through.
+ */
+void TimerWheel::advance(uint64_t tick, std::vector<PollEntry>& expired) {
+	while (current < tick) {
+		uint64_t step = next();
+		if (!step || step > tick) {
+			current = tick;
+			break;
+		}
+
+		current = step;
+		if ((current & (SLOTS - 1)) == 0) {
+			if (((current >> SLOT_BITS) & (SLOTS - 1)) == 0) {
+				cascade(2);
+			}
+			cascade(1);
+		}
+
+		std::vector<PollEntry>& slot = slots[0][current & (SLOTS - 1)];
+		count -= slot.size();
+		expired.insert(expired.end(), slot.begin(), slot.end());
+		slot.clear();
+	}
+}
+
+/**
+ * Moves the entries of the current slot of a level down to the levels below it.
+ */
+void TimerWheel::cascade(size_t level) {
+	std::vector<PollEntry> entries;
+	entries.swap(slots[level][(current >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+	for (auto const& entry : entries) {
+		place(entry);
+	}
+}
+
+/**
+ * Returns the next tick the wheel has to stop at, either to expire entries or to move entries down
+ * a level, or 0 if it is empty.
+ */
+uint64_t TimerWheel::next() const {
+	if (!count) {
+		return 0;
+	}
+
+	uint64_t boundary = (current | (SLOTS - 1)) + 1;
+	bool coarse = false;
+	for (size_t level = 1; level < LEVELS && !coarse; ++level) {
+		for (size_t i = 0; i < SLOTS && !coarse; ++i) {
+			coarse = !slots[level][i].empty();
+		}
+	}
+
+	for (uint64_t tick = current + 1; tick < current + SLOTS; ++tick) {
+		if (tick == boundary && coarse) {
+			return tick;
+		}
+		if (!slots[0][tick & (SLOTS - 1)].empty()) {
+			return tick;
+		}
+	}
+	return boundary;
+}
+
+/**
+ * Puts an entry in the finest level whose slots reach its tick. Ticks beyond the last level, which
+ * poll intervals never are, are held in its farthest slot.
+ */
+void TimerWheel::place(const PollEntry& entry) {
+	uint64_t delta = entry.due > current ? entry.due - current : 0;
+	size_t level = 0;
+	while (level < LEVELS - 1 && delta >= ((uint64_t)1 << (SLOT_BITS * (level + 1)))) {
+		++level;
+	}
+	uint64_t due = entry.due;
+	if (delta >= ((uint64_t)1 << (SLOT_BITS * LEVELS))) {
+		due = current + ((uint64_t)1 << (SLOT_BITS * LEVELS)) - 1;
+	}
+	slots[level][(due >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(entry);
+}
+
+/**
+ * Restarts an empty wheel at a tick.
+ */
+void TimerWheel::reset(uint64_t tick) {
+	if (!count) {
+		current = tick;
+	}
+}
+
+/**
+ * Starts polling a node's key, remembering how it looks now.
+ */
+void Poller::add(const WatchRef& ref, HKEY hkey, uint64_t now) {
+	if (targets.find(id(ref)) != targets.end()) {
+		return;
+	}
+
+	Target& target = targets[id(ref)];
+	if (stamp(hkey, target.stamp) != ERROR_SUCCESS) {
+		::memset(&target.stamp, 0, sizeof(target.stamp));
+	}
+	target.interval = POLL_MIN_INTERVAL;
+	schedule(ref, target, now);
+}
+
+/**
+ * Checks if a node's key changed since it was last polled and schedules the next poll. A key that
+ * can't be read is reported as changed so that the watchman finds out why.
+ */
+bool Poller::check(const WatchRef& ref, HKEY hkey, uint64_t now) {
+	auto it = targets.find(id(ref));
+	if (it == targets.end()) {
+		return false;
+	}
+
+	++polls;
+	Target& target = it->second;
+	PollStamp current;
+	LSTATUS status = stamp(hkey, current);
+	bool changed = status == ERROR_SUCCESS && current != target.stamp;
+
+	if (changed) {
+		target.stamp = current;
+		target.interval = POLL_MIN_INTERVAL;
+	} else {
+		target.interval = target.interval * 2 > POLL_MAX_INTERVAL ? POLL_MAX_INTERVAL : target.interval * 2;
+	}
+	schedule(ref, target, now);
+
+	return changed || status != ERROR_SUCCESS;
+}
+
+/**
+ * Collects the nodes that are due to be polled, at most `POLL_BATCH` of them. The rest wait for
+ * the next tick.
+ */
+void Poller::due(uint64_t now, std::vector<WatchRef>& refs) {
+	rebase(now);
+
+	std::vector<PollEntry> expired;
+	wheel.advance(now / POLL_TICK, expired);
+	backlog.insert(backlog.end(), expired.begin(), expired.end());
+
+	while (!backlog.empty() && refs.size() < POLL_BATCH) {
+		PollEntry entry = backlog.front();
+		backlog.pop_front();
+
+		// skip nodes that stopped being polled or were rescheduled
+		auto it = targets.find(id(entry.ref));
+		if (it != targets.end() && it->second.due == entry.due) {
+			refs.push_back(entry.ref);
+		}
+	}
+}
+
+/**
+ * Returns the time in milliseconds of the next tick with polls to run, or 0 if nothing is polled.
+ */
+uint64_t Poller::next(uint64_t now) {
+	rebase(now);
+
+	// the keys left over are checked on the tick after the one that ran
+	if (!backlog.empty()) {
+		return (wheel.tick() + 1) * POLL_TICK;
+	}
+	uint64_t tick = wheel.next();
+	return tick ? tick * POLL_TICK : 0;
+}
+
+/**
+ * Returns the current time in milliseconds.
+ */
+uint64_t Poller::now() {
+	uint64_t ms = simulatedClock;
+	if (ms) {
+		return ms;
+	}
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Reschedules every key from now when the clock was switched between the steady clock and a
+ * simulated one, or was set back, since the ticks already scheduled mean nothing anymore.
+ */
+void Poller::rebase(uint64_t now) {
+	if (simulatedTime == simulated() && now / POLL_TICK >= wheel.tick()) {
+		return;
+	}
+
+	simulatedTime = simulated();
+	wheel = TimerWheel();
+	backlog.clear();
+	for (auto& it : targets) {
+		schedule(WatchRef{ (uint32_t)(it.first >> 32), (uint32_t)it.first }, it.second, now);
+	}
+}
+
+/**
+ * Stops polling a node's key. Its entry stays in the wheel and is skipped when it comes due.
+ */
+void Poller::remove(const WatchRef& ref) {
+	targets.erase(id(ref));
+}
+
+/**
+ * Schedules a target's next poll `interval` from now.
+ */
+void Poller::schedule(const WatchRef& ref, Target& target, uint64_t now) {
+	wheel.reset(now / POLL_TICK);
+	target.due = (now + target.interval + POLL_TICK - 1) / POLL_TICK;
+	wheel.add(ref, target.due);
+}
+
+/**
+ * Sets the time polls are scheduled by in milliseconds, or 0 to go back to the steady clock.
+ */
+void Poller::setClock(uint64_t ms) {
+	simulatedClock = ms;
+}
+
+/**
+ * Returns true if the time is set by `setClock()`.
+ */
+bool Poller::simulated() {
+	return simulatedClock != 0;
+}
+
+/**
+ * Reads what a poll compares. The values are only read for keys without a last write time.
+ */
+LSTATUS Poller::stamp(HKEY hkey, PollStamp& result) {
+	DWORD info[5];
+	FILETIME lastWriteTime;
+	LSTATUS status = backend->queryInfoKey(hkey, &info[0], &info[1], &info[2], &info[3], &info[4], &lastWriteTime);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	Hash hash = hashBytes(info, sizeof(info));
+	result.lastWriteTime = ((uint64_t)lastWriteTime.dwHighDateTime << 32) | lastWriteTime.dwLowDateTime;
+	::memcpy(&result.shape, hash.bytes, sizeof(result.shape));
+	result.values = 0;
+
+	if (result.lastWriteTime || !info[2]) {
+		return ERROR_SUCCESS;
+	}
+
+	std::vector<BYTE> data;
+	std::vector<wchar_t> name(info[3] + 1);
+	std::vector<BYTE> buffer(info[4]);
+	for (DWORD i = 0; i < info[2]; ++i) {
+		DWORD nameSize = (DWORD)name.size();
+		DWORD dataSize = (DWORD)buffer.size();
+		DWORD type;
+		status = backend->enumValue(hkey, i, name.data(), &nameSize, &type, buffer.data(), &dataSize);
+		if (status == ERROR_NO_MORE_ITEMS) {
+			break;
+		}
+		if (status != ERROR_SUCCESS) {
+			// the values changed while they were being read, the next poll will see the difference
+			data.push_back(0xFF);
+			break;
+		}
+		data.insert(data.end(), (BYTE*)name.data(), (BYTE*)(name.data() + nameSize));
+		data.insert(data.end(), (BYTE*)&type, (BYTE*)&type + sizeof(type));
+		data.insert(data.end(), buffer.data(), buffer.data() + dataSize);
+	}
+	hash = hashBytes(data.data(), data.size());
+	::memcpy(&result.values, hash.bytes, sizeof(result.values));
+	return ERROR_SUCCESS;
+}
@@ -0,0 +1,131 @@
+#ifndef __POLLER__
+#define __POLLER__
+
+#include "watchnode.h"
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * The resolution of the poll schedule in milliseconds.
+ */
+#define POLL_TICK 100
+
+/**
+ * How often a polled key is checked right after it is watched or changed, and how far the interval
+ * backs off while it doesn't change, in milliseconds.
+ */
+#define POLL_MIN_INTERVAL 500
+#define POLL_MAX_INTERVAL 30000
+
+/**
+ * The most keys checked per tick. Keys that come due while the budget is spent are checked on the
+ * following ticks, so polling thousands of keys costs a bounded number of calls per tick.
+ */
+#define POLL_BATCH 64
+
+/**
+ * A node scheduled to be polled at a tick.
+ */
+struct PollEntry {
+	WatchRef ref;
+	uint64_t due;
+};
+
+/**
+ * A hierarchical timer wheel. Each level has 64 slots, a slot of a level spanning all of the slots
+ * of the level below it, so the three levels cover 64^3 ticks. Entries far out sit in a coarse slot
+ * and are moved down a level each time the wheel reaches their slot, which keeps adding and
+ * expiring an entry constant time no matter how many are scheduled.
+ *
+ * Entries can't be removed; the owner ignores entries that no longer match what it scheduled.
+ */
+class TimerWheel {
+public:
+	TimerWheel() : current(0), count(0) {}
+
+	void add(const WatchRef& ref, uint64_t due);
+	void advance(uint64_t tick, std::vector<PollEntry>& expired);
+	uint64_t next() const;
+	void reset(uint64_t tick);
+	size_t size() const { return count; }
+	uint64_t tick() const { return current; }
+
+private:
+	static const size_t LEVELS = 3;
+	static const size_t SLOT_BITS = 6;
+	static const size_t SLOTS = 1 << SLOT_BITS;
+
+	void cascade(size_t level);
+	void place(const PollEntry& entry);
+
+	std::vector<PollEntry> slots[LEVELS][SLOTS];
+	uint64_t current;
+	size_t count;
+};
+
+/**
+ * What a poll compares to tell whether a key changed: its last write time and a fingerprint of its
+ * subkey and value counts and sizes, all from a single `RegQueryInfoKey()`. Keys that don't keep a
+ * last write time, such as the performance data keys, also fingerprint their values.
+ */
+struct PollStamp {
+	uint64_t lastWriteTime;
+	uint64_t shape;
+	uint64_t values;
+
+	bool operator==(const PollStamp& other) const {
+		return lastWriteTime == other.lastWriteTime && shape == other.shape && values == other.values;
+	}
+	bool operator!=(const PollStamp& other) const { return !(*this == other); }
+};
+
+/**
+ * Polls the keys of an environment that can't be notified of changes. A key is checked
+ * `POLL_MIN_INTERVAL` after it is watched and after each change, and the interval doubles up to
+ * `POLL_MAX_INTERVAL` every time it is found unchanged.
+ *
+ * The time comes from `now()`, which follows the memory backend's clock while it is frozen so that
+ * tests can step through a schedule.
+ */
+class Poller {
+public:
+	Poller() : polls(0), simulatedTime(false) {}
+
+	void add(const WatchRef& ref, HKEY hkey, uint64_t now);
+	bool check(const WatchRef& ref, HKEY hkey, uint64_t now);
+	void due(uint64_t now, std::vector<WatchRef>& refs);
+	uint64_t next(uint64_t now);
+	void remove(const WatchRef& ref);
+	size_t size() const { return targets.size(); }
+
+	static uint64_t now();
+	static bool simulated();
+	static void setClock(uint64_t ms);
+
+	uint64_t polls;
+
+private:
+	struct Target {
+		PollStamp stamp;
+		uint32_t interval;
+		uint64_t due;
+	};
+
+	static uint64_t id(const WatchRef& ref) { return ((uint64_t)ref.index << 32) | ref.generation; }
+	void rebase(uint64_t now);
+	void schedule(const WatchRef& ref, Target& target, uint64_t now);
+	static LSTATUS stamp(HKEY hkey, PollStamp& result);
+
+	TimerWheel wheel;
+	std::deque<PollEntry> backlog;
+	std::unordered_map<uint64_t, Target> targets;
+	bool simulatedTime;
+};
+
+}
+
+#endif
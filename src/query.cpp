@@ -0,0 +1,503 @@
+#include "query.h"
+#include <algorithm>
+
+using namespace winreglib;
+
+/**
+ * The most paths a pattern's alternations may expand to.
+ */
+#define MAX_EXPANSIONS 4096
+
+Glob::Glob(const std::wstring& pattern) :
+	pattern(pattern),
+	folded(pattern),
+	literal(pattern.find_first_of(L"*?") == std::wstring::npos)
+{
+	for (auto& c : folded) {
+		c = foldName(c);
+	}
+}
+
+/**
+ * Matches a name against the pattern. A `*` is retried one character further each time the rest
+ * of the pattern fails to match, which is linear for the patterns used in practice.
+ */
+bool Glob::matches(const wchar_t* name, size_t length) const {
+	size_t p = 0;
+	size_t n = 0;
+	size_t star = std::wstring::npos;
+	size_t mark = 0;
+	size_t plen = folded.length();
+
+	if (literal) {
+		if (length != plen) {
+			return false;
+		}
+		for (; n < length; ++n) {
+			if (folded[n] != foldName(name[n])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	while (n < length) {
+		if (p < plen && folded[p] == L'*') {
+			star = p++;
+			mark = n;
+		} else if (p < plen && (folded[p] == L'?' || folded[p] == foldName(name[n]))) {
+			++p;
+			++n;
+		} else if (star != std::wstring::npos) {
+			p = star + 1;
+			n = ++mark;
+		} else {
+			return false;
+		}
+	}
+	while (p < plen && folded[p] == L'*') {
+		++p;
+	}
+	return p == plen;
+}
+
+/**
+ * Compiles a pattern. The first segment names the root key, either by its full or short name, or
+ * as a glob over the full and short names. Globs never match the performance data roots, which
+ * aren't trees. On failure, `code` and `error` describe the problem.
+ */
+bool QueryPlan::compile(const std::wstring& pattern, const char*& code, std::wstring& error) {
+	code = "ERR_WINREG_INVALID_PATTERN";
+	std::vector<std::wstring> paths;
+	if (!expand(pattern, paths, error)) {
+		return false;
+	}
+
+	for (auto const& path : paths) {
+		std::vector<std::wstring> segments;
+		for (size_t start = 0; start <= path.length(); ) {
+			size_t end = path.find(L'\\', start);
+			if (end == std::wstring::npos) {
+				end = path.length();
+			}
+			// empty names can't exist, so doubled separators left by an empty alternative collapse
+			if (end > start) {
+				segments.push_back(path.substr(start, end - start));
+			}
+			start = end + 1;
+		}
+		if (segments.empty()) {
+			error = L"Expected pattern to contain a root key";
+			return false;
+		}
+
+		Glob rootGlob(segments[0]);
+		if (segments[0] == L"**") {
+			error = L"Expected pattern to start with a root key";
+			return false;
+		}
+
+		size_t matched = 0;
+		for (auto const& it : rootKeys) {
+			bool match = rootGlob.matches(it.first.c_str(), it.first.length());
+			for (auto const& alias : rootMap) {
+				if (!match && alias.second == it.first) {
+					match = rootGlob.matches(alias.first.c_str(), alias.first.length());
+				}
+			}
+			if (!match || (!rootGlob.isLiteral() && it.first.find(L"PERFORMANCE") != std::wstring::npos)) {
+				continue;
+			}
+
+			++matched;
+			auto root = std::find_if(roots.begin(), roots.end(), [&](const QueryRoot& r) { return r.hkey == it.second; });
+			if (root == roots.end()) {
+				roots.push_back({ it.first, it.second, std::unique_ptr<QueryStep>(new QueryStep()) });
+				root = roots.end() - 1;
+				++steps;
+			}
+			insert(root->step.get(), segments, 1);
+		}
+
+		if (!matched) {
+			code = "ERR_WINREG_INVALID_ROOT";
+			error = L"Invalid registry root key \"" + segments[0] + L"\"";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Expands the first `{a,b,...}` alternation in a pattern and recursively the ones in each result.
+ * Alternatives may be empty and may contain separators.
+ */
+bool QueryPlan::expand(const std::wstring& pattern, std::vector<std::wstring>& result, std::wstring& error) {
+	size_t open = pattern.find(L'{');
+	size_t stray = pattern.find(L'}');
+	if (stray != std::wstring::npos && (open == std::wstring::npos || stray < open)) {
+		error = L"Unbalanced \"}\" in pattern";
+		return false;
+	}
+	if (open == std::wstring::npos) {
+		if (result.size() >= MAX_EXPANSIONS) {
+			error = L"Pattern expands to too many paths";
+			return false;
+		}
+		result.push_back(pattern);
+		return true;
+	}
+
+	std::vector<size_t> bounds = { open };
+	size_t depth = 0;
+	size_t close = std::wstring::npos;
+	for (size_t i = open; i < pattern.length() && close == std::wstring::npos; ++i) {
+		if (pattern[i] == L'{') {
+			++depth;
+		} else if (pattern[i] == L'}' && --depth == 0) {
+			close = i;
+		} else if (pattern[i] == L',' && depth == 1) {
+			bounds.push_back(i);
+		}
+	}
+	if (close == std::wstring::npos) {
+		error = L"Unbalanced \"{\" in pattern";
+		return false;
+	}
+	bounds.push_back(close);
+
+	std::wstring prefix = pattern.substr(0, open);
+	std::wstring suffix = pattern.substr(close + 1);
+	for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+		std::wstring alternative = pattern.substr(bounds[i] + 1, bounds[i + 1] - bounds[i] - 1);
+		if (!expand(prefix + alternative + suffix, result, error)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Merges the segments of one expanded path into the tree of steps.
+ */
+void QueryPlan::insert(QueryStep* step, const std::vector<std::wstring>& segments, size_t index) {
+	for (; index < segments.size(); ++index) {
+		const std::wstring& segment = segments[index];
+
+		if (segment == L"**") {
+			// `**\**` is the same as `**`
+			if (index > 1 && segments[index - 1] == L"**") {
+				continue;
+			}
+			if (!step->globstar) {
+				step->globstar.reset(new QueryStep());
+				step->globstar->deep = true;
+				++steps;
+			}
+			step = step->globstar.get();
+			continue;
+		}
+
+		Glob glob(segment);
+		if (glob.isLiteral()) {
+			std::unique_ptr<QueryStep>& next = step->literals[segment];
+			if (!next) {
+				next.reset(new QueryStep());
+				++steps;
+			}
+			step = next.get();
+			continue;
+		}
+
+		auto it = std::find_if(step->globs.begin(), step->globs.end(), [&](const std::pair<Glob, std::unique_ptr<QueryStep>>& g) { return g.first.pattern == segment; });
+		if (it == step->globs.end()) {
+			step->globs.emplace_back(glob, std::unique_ptr<QueryStep>(new QueryStep()));
+			it = step->globs.end() - 1;
+			++steps;
+		}
+		step = it->second.get();
+	}
+
+	step->match = true;
+}
+
+/**
+ * Sets the names of the values to read from each matched key. Names may be globs. An empty name is
+ * the key's default value.
+ */
+void QueryPlan::setValues(const std::vector<std::wstring>& names) {
+	readValues = true;
+	for (auto const& name : names) {
+		values.push_back(Glob(name));
+	}
+}
+
+Query::Query(Backend* backend, std::shared_ptr<const QueryPlan> plan) :
+	keys(0),
+	skipped(0),
+	backend(backend),
+	plan(plan),
+	pending(0),
+	idle(0)
+{}
+
+/**
+ * Adds the steps that follow a `**` segment, which also match the key the `**` matched, and
+ * removes duplicates.
+ */
+void Query::closure(States& states) {
+	for (size_t i = 0; i < states.size(); ++i) {
+		if (states[i]->globstar) {
+			states.push_back(states[i]->globstar.get());
+		}
+	}
+	std::sort(states.begin(), states.end());
+	states.erase(std::unique(states.begin(), states.end()), states.end());
+}
+
+/**
+ * Opens a subkey and queues it to be matched against `states`.
+ */
+void Query::openChild(Worker& worker, const Task& parent, const std::wstring& name, States& states) {
+	HKEY hkey;
+	LSTATUS status = backend->openKey(parent.hkey, name.c_str(), KEY_READ, NULL, &hkey);
+	if (status != ERROR_SUCCESS) {
+		if (status != ERROR_FILE_NOT_FOUND) {
+			++worker.skipped;
+		}
+		return;
+	}
+
+	closure(states);
+	push({ hkey, true, parent.path + L'\\' + name, std::move(states) });
+}
+
+/**
+ * Emits a row if the key matches and opens the subkeys that can still match. When the remaining
+ * steps only name literal subkeys, they are opened directly instead of enumerating the key.
+ */
+void Query::process(Worker& worker, Task& task) {
+	++worker.keys;
+
+	bool match = false;
+	bool enumerate = false;
+	for (const QueryStep* step : task.states) {
+		match = match || step->match;
+		enumerate = enumerate || step->deep || !step->globs.empty();
+	}
+
+	if (match) {
+		worker.rows.push_back({ task.path, {} });
+		if (plan->readValues) {
+			readValues(worker, task.hkey, worker.rows.back());
+		}
+	}
+
+	if (enumerate) {
+		std::vector<std::wstring> names;
+		for (DWORD index = 0; ; ) {
+			DWORD size = (DWORD)worker.nameBuffer.size();
+			LSTATUS status = backend->enumKey(task.hkey, index, worker.nameBuffer.data(), &size);
+			if (status == ERROR_MORE_DATA) {
+				worker.nameBuffer.resize(worker.nameBuffer.size() * 2);
+				continue;
+			}
+			if (status != ERROR_SUCCESS) {
+				break;
+			}
+			names.push_back(std::wstring(worker.nameBuffer.data(), size));
+			++index;
+		}
+
+		for (auto const& name : names) {
+			States next;
+			for (const QueryStep* step : task.states) {
+				auto it = step->literals.find(name);
+				if (it != step->literals.end()) {
+					next.push_back(it->second.get());
+				}
+				for (auto const& glob : step->globs) {
+					if (glob.first.matches(name.c_str(), name.length())) {
+						next.push_back(glob.second.get());
+					}
+				}
+				if (step->deep) {
+					next.push_back(step);
+				}
+			}
+			if (!next.empty()) {
+				openChild(worker, task, name, next);
+			}
+		}
+	} else {
+		std::map<std::wstring, States, NameLess> children;
+		for (const QueryStep* step : task.states) {
+			for (auto const& it : step->literals) {
+				children[it.first].push_back(it.second.get());
+			}
+		}
+		for (auto& it : children) {
+			openChild(worker, task, it.first, it.second);
+		}
+	}
+
+	if (task.close) {
+		backend->closeKey(task.hkey);
+	}
+}
+
+/**
+ * Queues a key. If every thread is busy and there is more work than threads, another thread is
+ * started.
+ */
+void Query::push(Task&& task) {
+	std::lock_guard<std::mutex> guard(lock);
+	tasks.push_back(std::move(task));
+	++pending;
+
+	if (idle > 0) {
+		ready.notify_one();
+	} else if (threads.size() + 1 < MAX_THREADS && tasks.size() > 1) {
+		workers.emplace_back();
+		Worker& worker = workers.back();
+		threads.emplace_back([this, &worker]() { work(worker); });
+	}
+}
+
+/**
+ * Reads the requested values of a matched key. Literal names are read directly, globs enumerate
+ * the key's values.
+ */
+void Query::readValues(Worker& worker, HKEY hkey, QueryRow& row) {
+	bool enumerate = false;
+	for (auto const& glob : plan->values) {
+		enumerate = enumerate || !glob.isLiteral();
+	}
+
+	if (!enumerate) {
+		for (auto const& glob : plan->values) {
+			DWORD type = REG_NONE;
+			DWORD size = (DWORD)worker.dataBuffer.size();
+			LSTATUS status = backend->getValue(hkey, NULL, glob.pattern.c_str(), RRF_RT_ANY, &type, worker.dataBuffer.data(), &size);
+			if (status == ERROR_MORE_DATA) {
+				worker.dataBuffer.resize(size);
+				status = backend->getValue(hkey, NULL, glob.pattern.c_str(), RRF_RT_ANY, &type, worker.dataBuffer.data(), &size);
+			}
+			if (status == ERROR_SUCCESS) {
+				row.values.push_back({ glob.pattern, type, std::vector<BYTE>(worker.dataBuffer.data(), worker.dataBuffer.data() + size) });
+			}
+		}
+		return;
+	}
+
+	DWORD maxValueNameLength = 0;
+	DWORD maxValueLength = 0;
+	if (backend->queryInfoKey(hkey, NULL, NULL, NULL, &maxValueNameLength, &maxValueLength, NULL) != ERROR_SUCCESS) {
+		return;
+	}
+	if (worker.nameBuffer.size() <= maxValueNameLength) {
+		worker.nameBuffer.resize(maxValueNameLength + 1);
+	}
+	if (worker.dataBuffer.size() < maxValueLength) {
+		worker.dataBuffer.resize(maxValueLength);
+	}
+
+	for (DWORD index = 0; ; ) {
+		DWORD nameSize = (DWORD)worker.nameBuffer.size();
+		DWORD dataSize = (DWORD)worker.dataBuffer.size();
+		DWORD type = REG_NONE;
+		LSTATUS status = backend->enumValue(hkey, index, worker.nameBuffer.data(), &nameSize, &type, worker.dataBuffer.data(), &dataSize);
+
+		if (status == ERROR_MORE_DATA) {
+			// the value grew since the key was queried
+			worker.nameBuffer.resize(worker.nameBuffer.size() * 2);
+			worker.dataBuffer.resize(dataSize > worker.dataBuffer.size() ? dataSize : worker.dataBuffer.size() * 2 + 1);
+			continue;
+		}
+		if (status != ERROR_SUCCESS) {
+			break;
+		}
+
+		const wchar_t* name = worker.nameBuffer.data();
+		for (auto const& glob : plan->values) {
+			if (glob.matches(name, nameSize)) {
+				row.values.push_back({ std::wstring(name, nameSize), type, std::vector<BYTE>(worker.dataBuffer.data(), worker.dataBuffer.data() + dataSize) });
+				break;
+			}
+		}
+		++index;
+	}
+}
+
+/**
+ * Runs the query on the calling thread and as many helper threads as there is parallel work for,
+ * then sorts the rows by key.
+ */
+void Query::run() {
+	workers.emplace_back();
+	for (auto const& root : plan->roots) {
+		States states = { root.step.get() };
+		closure(states);
+		push({ root.hkey, false, root.name, std::move(states) });
+	}
+
+	work(workers.front());
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	for (auto& worker : workers) {
+		keys += worker.keys;
+		skipped += worker.skipped;
+		rows.insert(rows.end(), std::make_move_iterator(worker.rows.begin()), std::make_move_iterator(worker.rows.end()));
+	}
+
+	// keys compare case-insensitively and a key sorts before its subkeys, so each key is folded
+	// once and the separators are mapped below every other character
+	std::vector<std::pair<std::wstring, size_t>> order;
+	order.reserve(rows.size());
+	for (size_t i = 0; i < rows.size(); ++i) {
+		std::wstring folded(rows[i].key);
+		for (auto& c : folded) {
+			c = c == L'\\' ? 0 : foldName(c);
+		}
+		order.emplace_back(std::move(folded), i);
+	}
+	std::sort(order.begin(), order.end());
+
+	std::vector<QueryRow> sorted;
+	sorted.reserve(rows.size());
+	for (auto const& entry : order) {
+		sorted.push_back(std::move(rows[entry.second]));
+	}
+	rows.swap(sorted);
+}
+
+/**
+ * Processes queued keys until every key has been processed.
+ */
+void Query::work(Worker& worker) {
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		if (tasks.empty()) {
+			if (pending == 0) {
+				break;
+			}
+			++idle;
+			ready.wait(guard, [this]() { return !tasks.empty() || pending == 0; });
+			--idle;
+			continue;
+		}
+
+		Task task = std::move(tasks.front());
+		tasks.pop_front();
+		guard.unlock();
+		process(worker, task);
+		guard.lock();
+
+		if (--pending == 0) {
+			ready.notify_all();
+		}
+	}
+}
@@ -0,0 +1,165 @@
+#ifndef __QUERY__
+#define __QUERY__
+
+#include "backend.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace winreglib {
+
+extern const std::map<std::wstring, HKEY> rootKeys;
+extern const std::map<std::wstring, std::wstring> rootMap;
+
+/**
+ * Matches a key or value name against one segment of a pattern, case-insensitively. `*` matches
+ * any run of characters and `?` matches any one character.
+ */
+class Glob {
+public:
+	Glob(const std::wstring& pattern);
+
+	bool isLiteral() const { return literal; }
+	bool matches(const wchar_t* name, size_t length) const;
+
+	std::wstring pattern;
+
+private:
+	std::wstring folded;
+	bool literal;
+};
+
+/**
+ * A state of a compiled query. A key is matched by a set of steps; its subkeys are matched by
+ * the steps they lead to. Subkeys named by `literals` are opened directly, while `globs` and `deep`
+ * steps need the subkeys to be enumerated.
+ */
+struct QueryStep {
+	QueryStep() : match(false), deep(false) {}
+
+	std::map<std::wstring, std::unique_ptr<QueryStep>, NameLess> literals;
+	std::vector<std::pair<Glob, std::unique_ptr<QueryStep>>> globs;
+
+	/**
+	 * The step after a `**` segment. It applies to this key and every key below it.
+	 */
+	std::unique_ptr<QueryStep> globstar;
+
+	/**
+	 * Keys matched by this step are results.
+	 */
+	bool match;
+
+	/**
+	 * This step follows a `**`, so it also applies to every subkey of the keys it matches.
+	 */
+	bool deep;
+};
+
+/**
+ * A root key the query starts at and the step that matches it.
+ */
+struct QueryRoot {
+	std::wstring name;
+	HKEY hkey;
+	std::unique_ptr<QueryStep> step;
+};
+
+/**
+ * A compiled pattern. Alternations are expanded first, then every expanded path is merged into one
+ * tree of steps per root key, so patterns that share a prefix only walk it once.
+ */
+class QueryPlan {
+public:
+	QueryPlan() : readValues(false), steps(0) {}
+
+	bool compile(const std::wstring& pattern, const char*& code, std::wstring& error);
+	void setValues(const std::vector<std::wstring>& names);
+
+	std::vector<QueryRoot> roots;
+	std::vector<Glob> values;
+	bool readValues;
+	size_t steps;
+
+private:
+	bool expand(const std::wstring& pattern, std::vector<std::wstring>& result, std::wstring& error);
+	void insert(QueryStep* step, const std::vector<std::wstring>& segments, size_t index);
+};
+
+struct QueryValue {
+	std::wstring name;
+	DWORD type;
+	std::vector<BYTE> data;
+};
+
+struct QueryRow {
+	std::wstring key;
+	std::vector<QueryValue> values;
+};
+
+/**
+ * Runs a plan against the registry. Keys are visited by up to `MAX_THREADS` threads at once,
+ * each taking the next key from a shared queue, so independent branches of the tree are read in
+ * parallel. Rows are sorted by key once every branch is done.
+ *
+ * Keys that can't be opened, other than keys that don't exist, are counted as skipped.
+ */
+class Query {
+public:
+	static const size_t MAX_THREADS = 4;
+
+	Query(Backend* backend, std::shared_ptr<const QueryPlan> plan);
+
+	void run();
+
+	std::vector<QueryRow> rows;
+	uint64_t keys;
+	uint64_t skipped;
+
+private:
+	typedef std::vector<const QueryStep*> States;
+
+	struct Task {
+		HKEY hkey;
+		bool close;
+		std::wstring path;
+		States states;
+	};
+
+	struct Worker {
+		Worker() : nameBuffer(256), dataBuffer(256), keys(0), skipped(0) {}
+
+		std::vector<QueryRow> rows;
+		std::vector<wchar_t> nameBuffer;
+		std::vector<BYTE> dataBuffer;
+		uint64_t keys;
+		uint64_t skipped;
+	};
+
+	static void closure(States& states);
+	void openChild(Worker& worker, const Task& parent, const std::wstring& name, States& states);
+	void process(Worker& worker, Task& task);
+	void push(Task&& task);
+	void readValues(Worker& worker, HKEY hkey, QueryRow& row);
+	void work(Worker& worker);
+
+	Backend* backend;
+	std::shared_ptr<const QueryPlan> plan;
+	std::mutex lock;
+	std::condition_variable ready;
+	std::deque<Task> tasks;
+	size_t pending;
+	size_t idle;
+	std::vector<std::thread> threads;
+	std::deque<Worker> workers;
+};
+
+}
+
+#endif
@@ -0,0 +1,401 @@
+#include "recordingbackend.h"
+
+using namespace winreglib;
+
+/**
+ * Records are written once this many bytes are buffered.
+ */
+#define FLUSH_THRESHOLD 65536
+
+/**
+ * Calls the inner backend, times the call, then locks the trace for the record.
+ */
+#define TIMED_CALL(call) \
+	Clock::time_point started = Clock::now(); \
+	LSTATUS status = inner->call; \
+	Clock::time_point finished = Clock::now(); \
+	std::lock_guard<std::mutex> guard(lock);
+
+/**
+ * Returns the process-wide recorder.
+ */
+RecordingBackend& RecordingBackend::get() {
+	static RecordingBackend recorder;
+	return recorder;
+}
+
+/**
+ * Returns true while calls are being written to a trace.
+ */
+bool RecordingBackend::recording() {
+	std::lock_guard<std::mutex> guard(lock);
+	return fd >= 0;
+}
+
+/**
+ * Starts recording calls to `backend` to the file descriptor. The caller must make `this` the
+ * active backend.
+ */
+bool RecordingBackend::start(Backend* backend, uv_loop_t* loop, uv_file fd, std::string& error) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (this->fd >= 0) {
+		error = "Already recording";
+		return false;
+	}
+
+	inner = backend;
+	this->loop = loop;
+	this->fd = fd;
+	this->error.clear();
+	origin = Clock::now();
+	ids.clear();
+	threads.clear();
+	nextId = 1;
+	for (auto const& it : rootKeys) {
+		ids[it.second] = (uint32_t)(uintptr_t)it.second;
+	}
+
+	buffer.assign(TRACE_MAGIC, TRACE_MAGIC_LENGTH);
+	if (!flush()) {
+		error = this->error;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Writes the buffered records and stops recording. Returns false if any write failed.
+ */
+bool RecordingBackend::stop(std::string& error) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (fd >= 0) {
+		flush();
+		fd = -1;
+	}
+	ids.clear();
+	threads.clear();
+	error = this->error;
+	return error.empty();
+}
+
+/**
+ * Writes a record header. Returns false if not recording, in which case the record is skipped.
+ */
+bool RecordingBackend::begin(TraceOp op, Clock::time_point started, Clock::time_point finished, LSTATUS status) {
+	if (fd < 0) {
+		return false;
+	}
+	if (buffer.size() >= FLUSH_THRESHOLD && !flush()) {
+		return false;
+	}
+
+	auto it = threads.find(std::this_thread::get_id());
+	if (it == threads.end()) {
+		it = threads.emplace(std::this_thread::get_id(), (uint16_t)threads.size()).first;
+	}
+
+	int64_t start = std::chrono::duration_cast<std::chrono::nanoseconds>(started - origin).count();
+	int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(finished - started).count();
+
+	u8(op);
+	u16(it->second);
+	u64(start < 0 ? 0 : (uint64_t)start);
+	u32(duration > 0xFFFFFFFFLL ? 0xFFFFFFFF : (uint32_t)duration);
+	u32((uint32_t)status);
+	return true;
+}
+
+/**
+ * Writes the buffered records to the file descriptor. A failed write stops recording.
+ */
+bool RecordingBackend::flush() {
+	size_t offset = 0;
+	while (offset < buffer.size()) {
+		uv_fs_t req;
+		uv_buf_t buf = uv_buf_init(&buffer[offset], (unsigned int)(buffer.size() - offset));
+		int result = ::uv_fs_write(loop, &req, fd, &buf, 1, -1, NULL);
+		::uv_fs_req_cleanup(&req);
+		if (result < 0) {
+			error = std::string("Failed to write trace: ") + ::uv_strerror(result);
+			buffer.clear();
+			fd = -1;
+			return false;
+		}
+		offset += (size_t)result;
+	}
+	buffer.clear();
+	return true;
+}
+
+/**
+ * Returns the id of a handle. A handle returned by the call being recorded always gets a new id,
+ * as does a handle that was opened before recording started.
+ */
+uint32_t RecordingBackend::id(const void* handle, bool add) {
+	if (!handle) {
+		return 0;
+	}
+	if (!add) {
+		auto it = ids.find(handle);
+		if (it != ids.end()) {
+			return it->second;
+		}
+	}
+	return ids[handle] = nextId++;
+}
+
+/**
+ * Drops a closed handle so that a new handle with the same value gets a new id. Root keys keep
+ * theirs.
+ */
+void RecordingBackend::forget(const void* handle) {
+	auto it = ids.find(handle);
+	if (it != ids.end() && it->second != (uint32_t)(uintptr_t)handle) {
+		ids.erase(it);
+	}
+}
+
+void RecordingBackend::u16(uint16_t value) {
+	buffer.push_back((char)(value & 0xFF));
+	buffer.push_back((char)(value >> 8));
+}
+
+void RecordingBackend::u32(uint32_t value) {
+	for (int i = 0; i < 4; ++i) {
+		buffer.push_back((char)((value >> (i * 8)) & 0xFF));
+	}
+}
+
+void RecordingBackend::u64(uint64_t value) {
+	for (int i = 0; i < 8; ++i) {
+		buffer.push_back((char)((value >> (i * 8)) & 0xFF));
+	}
+}
+
+void RecordingBackend::str(const wchar_t* value) {
+	str(value, value ? ::wcslen(value) : 0);
+}
+
+/**
+ * Writes a string as UTF-16 code units, splitting characters outside the BMP into surrogate pairs
+ * where `wchar_t` is 32 bits.
+ */
+void RecordingBackend::str(const wchar_t* value, size_t length) {
+	if (!value) {
+		u32(TRACE_NULL);
+		return;
+	}
+
+	size_t at = buffer.size();
+	u32(0);
+	uint32_t units = 0;
+	for (size_t i = 0; i < length; ++i) {
+		uint32_t c = (uint32_t)value[i];
+		if (c > 0xFFFF) {
+			c -= 0x10000;
+			u16((uint16_t)(0xD800 + (c >> 10)));
+			u16((uint16_t)(0xDC00 + (c & 0x3FF)));
+			units += 2;
+		} else {
+			u16((uint16_t)c);
+			++units;
+		}
+	}
+	for (int i = 0; i < 4; ++i) {
+		buffer[at + i] = (char)((units >> (i * 8)) & 0xFF);
+	}
+}
+
+void RecordingBackend::bytes(const void* value, DWORD length) {
+	if (!value) {
+		u32(TRACE_NULL);
+		return;
+	}
+	u32(length);
+	buffer.append((const char*)value, length);
+}
+
+LSTATUS RecordingBackend::beginTransaction(HANDLE* tx) {
+	TIMED_CALL(beginTransaction(tx))
+	if (begin(TraceBeginTransaction, started, finished, status)) {
+		u32(status == ERROR_SUCCESS ? id(*tx, true) : 0);
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::commitTransaction(HANDLE tx) {
+	TIMED_CALL(commitTransaction(tx))
+	if (begin(TraceCommitTransaction, started, finished, status)) {
+		u32(id(tx));
+	}
+	forget(tx);
+	return status;
+}
+
+LSTATUS RecordingBackend::rollbackTransaction(HANDLE tx) {
+	TIMED_CALL(rollbackTransaction(tx))
+	if (begin(TraceRollbackTransaction, started, finished, status)) {
+		u32(id(tx));
+	}
+	forget(tx);
+	return status;
+}
+
+LSTATUS RecordingBackend::closeKey(HKEY hkey) {
+	TIMED_CALL(closeKey(hkey))
+	if (begin(TraceCloseKey, started, finished, status)) {
+		u32(id(hkey));
+	}
+	forget(hkey);
+	return status;
+}
+
+LSTATUS RecordingBackend::createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) {
+	TIMED_CALL(createKey(parent, subkey, sam, tx, result))
+	if (begin(TraceCreateKey, started, finished, status)) {
+		u32(id(parent));
+		str(subkey);
+		u32(sam);
+		u32(id(tx));
+		u32(status == ERROR_SUCCESS ? id(*result, true) : 0);
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx) {
+	TIMED_CALL(deleteKey(parent, subkey, tx))
+	if (begin(TraceDeleteKey, started, finished, status)) {
+		u32(id(parent));
+		str(subkey);
+		u32(id(tx));
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::deleteValue(HKEY hkey, const wchar_t* name) {
+	TIMED_CALL(deleteValue(hkey, name))
+	if (begin(TraceDeleteValue, started, finished, status)) {
+		u32(id(hkey));
+		str(name);
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize) {
+	DWORD nameCapacity = *nameSize;
+	TIMED_CALL(enumKey(hkey, index, name, nameSize))
+	if (begin(TraceEnumKey, started, finished, status)) {
+		u32(id(hkey));
+		u32(index);
+		u32(nameCapacity);
+		str(status == ERROR_SUCCESS ? name : NULL, *nameSize);
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize) {
+	DWORD nameCapacity = *nameSize;
+	DWORD dataCapacity = dataSize ? *dataSize : 0;
+	TIMED_CALL(enumValue(hkey, index, name, nameSize, type, data, dataSize))
+	if (begin(TraceEnumValue, started, finished, status)) {
+		bool success = status == ERROR_SUCCESS;
+		u32(id(hkey));
+		u32(index);
+		u8((type ? TRACE_WANTS_TYPE : 0) | (data ? TRACE_WANTS_DATA : 0) | (dataSize ? TRACE_WANTS_SIZE : 0));
+		u32(nameCapacity);
+		u32(dataCapacity);
+		str(success ? name : NULL, *nameSize);
+		u32(success && type ? *type : 0);
+		u32(dataSize ? *dataSize : 0);
+		bytes(success && data && dataSize ? data : NULL, dataSize ? *dataSize : 0);
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize) {
+	DWORD dataCapacity = dataSize ? *dataSize : 0;
+	TIMED_CALL(getValue(hkey, subkey, name, flags, type, data, dataSize))
+	if (begin(TraceGetValue, started, finished, status)) {
+		bool success = status == ERROR_SUCCESS;
+		u32(id(hkey));
+		str(subkey);
+		str(name);
+		u32(flags);
+		u8((type ? TRACE_WANTS_TYPE : 0) | (data ? TRACE_WANTS_DATA : 0) | (dataSize ? TRACE_WANTS_SIZE : 0));
+		u32(dataCapacity);
+		u32(success && type ? *type : 0);
+		u32(dataSize ? *dataSize : 0);
+		bytes(success && data && dataSize ? data : NULL, dataSize ? *dataSize : 0);
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent) {
+	TIMED_CALL(notifyChangeKeyValue(hkey, watchSubtree, filter, hevent))
+	if (begin(TraceNotifyChangeKeyValue, started, finished, status)) {
+		u32(id(hkey));
+		u8(watchSubtree ? 1 : 0);
+		u32(filter);
+		u32(id(hevent));
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) {
+	TIMED_CALL(openKey(parent, subkey, sam, tx, result))
+	if (begin(TraceOpenKey, started, finished, status)) {
+		u32(id(parent));
+		str(subkey);
+		u32(sam);
+		u32(id(tx));
+		u32(status == ERROR_SUCCESS ? id(*result, true) : 0);
+	}
+	return status;
+}
+
+/**
+ * Always asks for every field so that the replayed call can answer any combination of them.
+ */
+LSTATUS RecordingBackend::queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime) {
+	DWORD info[5] = { 0, 0, 0, 0, 0 };
+	FILETIME time = { 0, 0 };
+	TIMED_CALL(queryInfoKey(hkey, &info[0], &info[1], &info[2], &info[3], &info[4], &time))
+	if (begin(TraceQueryInfoKey, started, finished, status)) {
+		u32(id(hkey));
+		for (DWORD value : info) {
+			u32(value);
+		}
+		u64(((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime);
+	}
+
+	if (status == ERROR_SUCCESS) {
+		if (numSubkeys) *numSubkeys = info[0];
+		if (maxSubkeyLength) *maxSubkeyLength = info[1];
+		if (numValues) *numValues = info[2];
+		if (maxValueNameLength) *maxValueNameLength = info[3];
+		if (maxValueLength) *maxValueLength = info[4];
+		if (lastWriteTime) *lastWriteTime = time;
+	}
+	return status;
+}
+
+LSTATUS RecordingBackend::setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize) {
+	TIMED_CALL(setValue(hkey, name, type, data, dataSize))
+	if (begin(TraceSetValue, started, finished, status)) {
+		u32(id(hkey));
+		str(name);
+		u32(type);
+		bytes(data ? data : (const BYTE*)"", dataSize);
+	}
+	return status;
+}
+
+void RecordingBackend::signaled(HANDLE hevent) {
+	inner->signaled(hevent);
+
+	Clock::time_point now = Clock::now();
+	std::lock_guard<std::mutex> guard(lock);
+	if (begin(TraceSignal, now, now, ERROR_SUCCESS)) {
+		u32(id(hevent));
+	}
+}
@@ -0,0 +1,87 @@
+#ifndef __RECORDINGBACKEND__
+#define __RECORDINGBACKEND__
+
+#include "backend.h"
+#include "trace.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <uv.h>
+
+namespace winreglib {
+
+extern const std::map<std::wstring, HKEY> rootKeys;
+
+/**
+ * Passes every operation through to another backend and records the call, its arguments, its
+ * results, and how long it took to a trace that `ReplayBackend` can play back. Events signaled
+ * for `notifyChangeKeyValue()` are recorded too, so replayed watchers see the same changes at the
+ * same times.
+ *
+ * Records are buffered and written to a file descriptor in chunks. Once stopped, the backend keeps
+ * passing calls through, so work that started while recording can finish safely.
+ */
+class RecordingBackend : public Backend {
+public:
+	static RecordingBackend& get();
+
+	const char* name() { return inner->name(); }
+
+	bool recording();
+	bool start(Backend* backend, uv_loop_t* loop, uv_file fd, std::string& error);
+	bool stop(std::string& error);
+
+	Backend* inner;
+
+	LSTATUS beginTransaction(HANDLE* tx);
+	LSTATUS commitTransaction(HANDLE tx);
+	LSTATUS rollbackTransaction(HANDLE tx);
+
+	LSTATUS closeKey(HKEY hkey);
+	LSTATUS createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result);
+	LSTATUS deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx);
+	LSTATUS deleteValue(HKEY hkey, const wchar_t* name);
+	LSTATUS enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize);
+	LSTATUS enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize);
+	LSTATUS getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize);
+	LSTATUS notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent);
+	LSTATUS openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result);
+	LSTATUS queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime);
+	LSTATUS setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize);
+
+	void signaled(HANDLE hevent);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	RecordingBackend() : inner(NULL), loop(NULL), fd(-1), nextId(1) {}
+
+	bool begin(TraceOp op, Clock::time_point started, Clock::time_point finished, LSTATUS status);
+	bool flush();
+	uint32_t id(const void* handle, bool add = false);
+	void forget(const void* handle);
+
+	void u8(uint8_t value) { buffer.push_back((char)value); }
+	void u16(uint16_t value);
+	void u32(uint32_t value);
+	void u64(uint64_t value);
+	void str(const wchar_t* value);
+	void str(const wchar_t* value, size_t length);
+	void bytes(const void* value, DWORD length);
+
+	std::mutex lock;
+	uv_loop_t* loop;
+	uv_file fd;
+	std::string buffer;
+	std::string error;
+	Clock::time_point origin;
+	std::map<const void*, uint32_t> ids;
+	std::map<std::thread::id, uint16_t> threads;
+	uint32_t nextId;
+};
+
+}
+
+#endif
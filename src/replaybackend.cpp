@@ -0,0 +1,626 @@
+#include "replaybackend.h"
+#include <cstring>
+
+using namespace winreglib;
+
+namespace {
+
+/**
+ * Reads the little-endian fields of a trace. A record cut short by a recording that never
+ * finished ends the trace.
+ */
+struct TraceReader {
+	TraceReader(const BYTE* data, size_t length) : p(data), end(data + length), ok(true) {}
+
+	bool has(size_t n) {
+		ok = ok && (size_t)(end - p) >= n;
+		return ok;
+	}
+
+	uint64_t uint(int n) {
+		if (!has(n)) {
+			return 0;
+		}
+		uint64_t value = 0;
+		for (int i = 0; i < n; ++i) {
+			value |= (uint64_t)*p++ << (i * 8);
+		}
+		return value;
+	}
+
+	uint8_t u8() { return (uint8_t)uint(1); }
+	uint16_t u16() { return (uint16_t)uint(2); }
+	uint32_t u32() { return (uint32_t)uint(4); }
+	uint64_t u64() { return uint(8); }
+
+	/**
+	 * Reads UTF-16 code units, joining surrogate pairs where `wchar_t` is 32 bits.
+	 */
+	bool str(std::wstring& value) {
+		value.clear();
+		uint32_t units = u32();
+		if (!ok || units == TRACE_NULL) {
+			return false;
+		}
+		if (!has((size_t)units * 2)) {
+			return false;
+		}
+		value.reserve(units);
+		for (uint32_t i = 0; i < units; ++i) {
+			uint32_t c = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+			p += 2;
+			if (sizeof(wchar_t) == 4 && c >= 0xD800 && c <= 0xDBFF && i + 1 < units) {
+				uint32_t low = (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+				if (low >= 0xDC00 && low <= 0xDFFF) {
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+					p += 2;
+					++i;
+				}
+			}
+			value += (wchar_t)c;
+		}
+		return true;
+	}
+
+	bool bytes(std::vector<BYTE>& value) {
+		value.clear();
+		uint32_t length = u32();
+		if (!ok || length == TRACE_NULL || !has(length)) {
+			return false;
+		}
+		value.assign(p, p + length);
+		p += length;
+		return true;
+	}
+
+	const BYTE* p;
+	const BYTE* end;
+	bool ok;
+};
+
+/**
+ * Uppercases a name so that calls match the way the registry compares names. A null name is
+ * distinct from an empty one.
+ */
+std::wstring fold(const wchar_t* str) {
+	if (!str) {
+		return std::wstring(1, L'\1');
+	}
+	std::wstring result(str);
+	for (auto& c : result) {
+		c = foldName(c);
+	}
+	return result;
+}
+
+/**
+ * Appends a subkey to a key path.
+ */
+std::wstring join(const std::wstring& path, const wchar_t* subkey) {
+	if (!subkey || !*subkey) {
+		return path;
+	}
+	return path + L'\\' + fold(subkey);
+}
+
+}
+
+ReplayBackend::ReplayBackend() : realtime(false), stopping(false), nextHandle(1) {}
+
+ReplayBackend::~ReplayBackend() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	if (timer.joinable()) {
+		timer.join();
+	}
+}
+
+std::wstring ReplayBackend::callKey(TraceOp op, const std::wstring& path, const std::wstring& args) {
+	std::wstring key(1, (wchar_t)op);
+	key += path;
+	key += L'\n';
+	key += args;
+	return key;
+}
+
+/**
+ * Parses a trace and replaces the one being replayed. Keys opened from the previous trace are no
+ * longer valid.
+ */
+bool ReplayBackend::load(const BYTE* data, size_t length, bool realtime, std::string& error) {
+	if (length < TRACE_MAGIC_LENGTH || ::memcmp(data, TRACE_MAGIC, TRACE_MAGIC_LENGTH) != 0) {
+		error = "Invalid trace";
+		return false;
+	}
+
+	std::vector<Record> records;
+	std::unordered_map<std::wstring, Calls> calls;
+	std::map<uint32_t, std::wstring> paths;
+	std::map<uint32_t, size_t> armed;
+	for (auto const& it : rootKeys) {
+		paths[(uint32_t)(uintptr_t)it.second] = it.first;
+	}
+
+	auto path = [&paths](uint32_t id) {
+		auto it = paths.find(id);
+		return it == paths.end() ? std::wstring(L"?") : it->second;
+	};
+
+	TraceReader in(data + TRACE_MAGIC_LENGTH, length - TRACE_MAGIC_LENGTH);
+	while (in.p < in.end && in.has(TRACE_HEADER_LENGTH)) {
+		Record r;
+		r.op = (TraceOp)in.u8();
+		in.u16();
+		r.start = in.u64();
+		r.duration = in.u32();
+		r.status = (LSTATUS)in.u32();
+
+		std::wstring key;
+		std::wstring str;
+		std::vector<BYTE> bytes;
+
+		switch (r.op) {
+			case TraceBeginTransaction:
+			case TraceCommitTransaction:
+			case TraceRollbackTransaction:
+				in.u32();
+				key = callKey(r.op, L"", L"");
+				break;
+
+			case TraceCloseKey:
+				in.u32();
+				break;
+
+			case TraceCreateKey:
+			case TraceOpenKey:
+			{
+				std::wstring parent = path(in.u32());
+				bool hasSubkey = in.str(str);
+				in.u32();
+				in.u32();
+				uint32_t result = in.u32();
+				key = callKey(r.op, parent, fold(hasSubkey ? str.c_str() : NULL));
+				if (r.status == ERROR_SUCCESS) {
+					paths[result] = join(parent, hasSubkey ? str.c_str() : NULL);
+				}
+				break;
+			}
+
+			case TraceDeleteKey:
+			{
+				std::wstring parent = path(in.u32());
+				bool hasSubkey = in.str(str);
+				in.u32();
+				key = callKey(r.op, parent, fold(hasSubkey ? str.c_str() : NULL));
+				break;
+			}
+
+			case TraceDeleteValue:
+			{
+				std::wstring parent = path(in.u32());
+				bool hasName = in.str(str);
+				key = callKey(r.op, parent, fold(hasName ? str.c_str() : NULL));
+				break;
+			}
+
+			case TraceEnumKey:
+			{
+				std::wstring parent = path(in.u32());
+				uint32_t index = in.u32();
+				in.u32();
+				r.hasName = in.str(r.name);
+				key = callKey(r.op, parent, std::to_wstring(index));
+				break;
+			}
+
+			case TraceEnumValue:
+			{
+				std::wstring parent = path(in.u32());
+				uint32_t index = in.u32();
+				uint8_t wants = in.u8();
+				in.u32();
+				in.u32();
+				r.hasName = in.str(r.name);
+				r.type = in.u32();
+				r.dataSize = in.u32();
+				in.bytes(r.data);
+				key = callKey(r.op, parent, std::to_wstring(index) + L'|' + std::to_wstring(wants));
+				break;
+			}
+
+			case TraceGetValue:
+			{
+				std::wstring parent = path(in.u32());
+				bool hasSubkey = in.str(str);
+				std::wstring subkey = fold(hasSubkey ? str.c_str() : NULL);
+				bool hasName = in.str(str);
+				std::wstring name = fold(hasName ? str.c_str() : NULL);
+				in.u32();
+				uint8_t wants = in.u8();
+				in.u32();
+				r.type = in.u32();
+				r.dataSize = in.u32();
+				in.bytes(r.data);
+				key = callKey(r.op, parent, subkey + L'|' + name + L'|' + std::to_wstring(wants));
+				break;
+			}
+
+			case TraceNotifyChangeKeyValue:
+			{
+				std::wstring parent = path(in.u32());
+				in.u8();
+				uint32_t filter = in.u32();
+				uint32_t event = in.u32();
+				key = callKey(r.op, parent, std::to_wstring(filter));
+				if (r.status == ERROR_SUCCESS) {
+					armed[event] = records.size();
+				}
+				break;
+			}
+
+			case TraceQueryInfoKey:
+			{
+				std::wstring parent = path(in.u32());
+				for (auto& value : r.info) {
+					value = in.u32();
+				}
+				r.lastWriteTime = in.u64();
+				key = callKey(r.op, parent, L"");
+				break;
+			}
+
+			case TraceSetValue:
+			{
+				std::wstring parent = path(in.u32());
+				bool hasName = in.str(str);
+				in.u32();
+				in.bytes(bytes);
+				key = callKey(r.op, parent, fold(hasName ? str.c_str() : NULL));
+				break;
+			}
+
+			case TraceSignal:
+			{
+				// the signal belongs to the last notification registered with the event
+				auto it = armed.find(in.u32());
+				if (in.ok && it != armed.end()) {
+					Record& notify = records[it->second];
+					notify.signalDelay = r.start > notify.start ? (int64_t)(r.start - notify.start) : 0;
+					armed.erase(it);
+				}
+				break;
+			}
+
+			default:
+				error = "Invalid trace record";
+				return false;
+		}
+
+		if (!in.ok) {
+			break;
+		}
+		if (!key.empty()) {
+			calls[key].records.push_back(records.size());
+		}
+		records.push_back(std::move(r));
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	this->realtime = realtime;
+	this->records.swap(records);
+	this->calls.swap(calls);
+	handles.clear();
+	for (auto const& it : rootKeys) {
+		handles[it.second] = it.first;
+	}
+	pending.clear();
+	return true;
+}
+
+/**
+ * Finds the next recorded result of a call. `first` is set to false once the recorded results
+ * have run out and the last one is being repeated. The lock must be held.
+ */
+const ReplayBackend::Record* ReplayBackend::match(TraceOp op, HKEY hkey, const std::wstring& args, bool* first) {
+	std::wstring path;
+	if (op != TraceBeginTransaction && op != TraceCommitTransaction && op != TraceRollbackTransaction) {
+		auto it = handles.find(hkey);
+		if (it == handles.end()) {
+			return NULL;
+		}
+		path = it->second;
+	}
+
+	auto it = calls.find(callKey(op, path, args));
+	if (it == calls.end()) {
+		return NULL;
+	}
+
+	Calls& c = it->second;
+	if (first) {
+		*first = c.next < c.records.size();
+	}
+	size_t index = c.records[c.next < c.records.size() ? c.next : c.records.size() - 1];
+	++c.next;
+	return &records[index];
+}
+
+/**
+ * Opens or creates a key. The new handle resolves to the parent's path plus the subkey.
+ */
+LSTATUS ReplayBackend::open(TraceOp op, HKEY parent, const wchar_t* subkey, HKEY* result) {
+	Clock::time_point started = Clock::now();
+	std::unique_lock<std::mutex> guard(lock);
+	const Record* r = match(op, parent, fold(subkey));
+	if (!r) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	LSTATUS status = r->status;
+	uint32_t duration = r->duration;
+	if (status == ERROR_SUCCESS) {
+		*result = (HKEY)nextHandle++;
+		handles[*result] = join(handles[parent], subkey);
+	}
+	guard.unlock();
+
+	pace(started, duration);
+	return status;
+}
+
+/**
+ * In realtime mode, waits until a call has taken as long as it did when it was recorded. Spinning
+ * keeps short calls accurate.
+ */
+void ReplayBackend::pace(Clock::time_point started, uint32_t duration) {
+	if (!realtime) {
+		return;
+	}
+	Clock::time_point until = started + std::chrono::nanoseconds(duration);
+	while (Clock::now() < until) {
+		std::this_thread::yield();
+	}
+}
+
+/**
+ * Signals the events of replayed change notifications when they are due.
+ */
+void ReplayBackend::run() {
+	std::unique_lock<std::mutex> guard(lock);
+	while (!stopping) {
+		if (pending.empty()) {
+			wake.wait(guard);
+			continue;
+		}
+		auto it = pending.begin();
+		if (it->first > Clock::now()) {
+			wake.wait_until(guard, it->first);
+			continue;
+		}
+		::SetEvent(it->second.hevent);
+		pending.erase(it);
+	}
+}
+
+/**
+ * Replays a call that only returns a status.
+ */
+LSTATUS ReplayBackend::status(TraceOp op, HKEY hkey, const std::wstring& args) {
+	Clock::time_point started = Clock::now();
+	std::unique_lock<std::mutex> guard(lock);
+	const Record* r = match(op, hkey, args);
+	if (!r) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+	LSTATUS status = r->status;
+	uint32_t duration = r->duration;
+	guard.unlock();
+
+	pace(started, duration);
+	return status;
+}
+
+LSTATUS ReplayBackend::beginTransaction(HANDLE* tx) {
+	LSTATUS result = status(TraceBeginTransaction, NULL, L"");
+	if (result == ERROR_SUCCESS) {
+		std::lock_guard<std::mutex> guard(lock);
+		*tx = (HANDLE)nextHandle++;
+	}
+	return result;
+}
+
+LSTATUS ReplayBackend::commitTransaction(HANDLE tx) {
+	return status(TraceCommitTransaction, NULL, L"");
+}
+
+LSTATUS ReplayBackend::rollbackTransaction(HANDLE tx) {
+	return status(TraceRollbackTransaction, NULL, L"");
+}
+
+/**
+ * Forgets the handle and drops notifications that haven't fired yet, since their events may be
+ * closed next.
+ */
+LSTATUS ReplayBackend::closeKey(HKEY hkey) {
+	std::lock_guard<std::mutex> guard(lock);
+	for (auto it = pending.begin(); it != pending.end(); ) {
+		it = it->second.hkey == hkey ? pending.erase(it) : std::next(it);
+	}
+	auto it = handles.find(hkey);
+	if (it == handles.end()) {
+		return ERROR_INVALID_HANDLE;
+	}
+	if (rootKeys.find(it->second) == rootKeys.end()) {
+		handles.erase(it);
+	}
+	return ERROR_SUCCESS;
+}
+
+LSTATUS ReplayBackend::createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) {
+	return open(TraceCreateKey, parent, subkey, result);
+}
+
+LSTATUS ReplayBackend::deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx) {
+	return status(TraceDeleteKey, parent, fold(subkey));
+}
+
+LSTATUS ReplayBackend::deleteValue(HKEY hkey, const wchar_t* name) {
+	return status(TraceDeleteValue, hkey, fold(name));
+}
+
+LSTATUS ReplayBackend::enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize) {
+	Clock::time_point started = Clock::now();
+	std::unique_lock<std::mutex> guard(lock);
+	const Record* r = match(TraceEnumKey, hkey, std::to_wstring(index));
+	if (!r) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	LSTATUS status = r->status;
+	uint32_t duration = r->duration;
+	if (status == ERROR_SUCCESS) {
+		if (r->name.length() >= *nameSize) {
+			status = ERROR_MORE_DATA;
+		} else {
+			::wmemcpy(name, r->name.c_str(), r->name.length() + 1);
+			*nameSize = (DWORD)r->name.length();
+		}
+	}
+	guard.unlock();
+
+	pace(started, duration);
+	return status;
+}
+
+LSTATUS ReplayBackend::enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize) {
+	uint8_t wants = (type ? TRACE_WANTS_TYPE : 0) | (data ? TRACE_WANTS_DATA : 0) | (dataSize ? TRACE_WANTS_SIZE : 0);
+	Clock::time_point started = Clock::now();
+	std::unique_lock<std::mutex> guard(lock);
+	const Record* r = match(TraceEnumValue, hkey, std::to_wstring(index) + L'|' + std::to_wstring(wants));
+	if (!r) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	LSTATUS status = r->status;
+	uint32_t duration = r->duration;
+	if (status == ERROR_SUCCESS) {
+		if (r->name.length() >= *nameSize || (data && dataSize && *dataSize < r->dataSize)) {
+			status = ERROR_MORE_DATA;
+		} else {
+			::wmemcpy(name, r->name.c_str(), r->name.length() + 1);
+			*nameSize = (DWORD)r->name.length();
+			if (type) {
+				*type = r->type;
+			}
+			if (data && dataSize && !r->data.empty()) {
+				::memcpy(data, r->data.data(), r->data.size());
+			}
+		}
+	}
+	if ((status == ERROR_SUCCESS || status == ERROR_MORE_DATA) && dataSize) {
+		*dataSize = r->dataSize;
+	}
+	guard.unlock();
+
+	pace(started, duration);
+	return status;
+}
+
+LSTATUS ReplayBackend::getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize) {
+	uint8_t wants = (type ? TRACE_WANTS_TYPE : 0) | (data ? TRACE_WANTS_DATA : 0) | (dataSize ? TRACE_WANTS_SIZE : 0);
+	Clock::time_point started = Clock::now();
+	std::unique_lock<std::mutex> guard(lock);
+	const Record* r = match(TraceGetValue, hkey, fold(subkey) + L'|' + fold(name) + L'|' + std::to_wstring(wants));
+	if (!r) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	LSTATUS status = r->status;
+	uint32_t duration = r->duration;
+	if (status == ERROR_SUCCESS) {
+		if (data && dataSize && *dataSize < r->dataSize) {
+			status = ERROR_MORE_DATA;
+		} else {
+			if (type) {
+				*type = r->type;
+			}
+			if (data && !r->data.empty()) {
+				::memcpy(data, r->data.data(), r->data.size());
+			}
+		}
+	}
+	if ((status == ERROR_SUCCESS || status == ERROR_MORE_DATA) && dataSize) {
+		*dataSize = r->dataSize;
+	}
+	guard.unlock();
+
+	pace(started, duration);
+	return status;
+}
+
+/**
+ * Arms the event to be signaled when the recorded notification fired. Repeated calls past the end
+ * of the recording never fire.
+ */
+LSTATUS ReplayBackend::notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent) {
+	Clock::time_point started = Clock::now();
+	std::unique_lock<std::mutex> guard(lock);
+	bool first = false;
+	const Record* r = match(TraceNotifyChangeKeyValue, hkey, std::to_wstring(filter), &first);
+	if (!r) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	LSTATUS status = r->status;
+	uint32_t duration = r->duration;
+	if (first && status == ERROR_SUCCESS && r->signalDelay >= 0) {
+		Clock::time_point due = realtime ? started + std::chrono::nanoseconds(r->signalDelay) : started;
+		pending.emplace(due, Pending{ hkey, hevent });
+		if (!timer.joinable()) {
+			timer = std::thread(&ReplayBackend::run, this);
+		}
+		wake.notify_one();
+	}
+	guard.unlock();
+
+	pace(started, duration);
+	return status;
+}
+
+LSTATUS ReplayBackend::openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) {
+	return open(TraceOpenKey, parent, subkey, result);
+}
+
+LSTATUS ReplayBackend::queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime) {
+	Clock::time_point started = Clock::now();
+	std::unique_lock<std::mutex> guard(lock);
+	const Record* r = match(TraceQueryInfoKey, hkey, L"");
+	if (!r) {
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	LSTATUS status = r->status;
+	uint32_t duration = r->duration;
+	if (status == ERROR_SUCCESS) {
+		if (numSubkeys) *numSubkeys = r->info[0];
+		if (maxSubkeyLength) *maxSubkeyLength = r->info[1];
+		if (numValues) *numValues = r->info[2];
+		if (maxValueNameLength) *maxValueNameLength = r->info[3];
+		if (maxValueLength) *maxValueLength = r->info[4];
+		if (lastWriteTime) {
+			lastWriteTime->dwLowDateTime = (DWORD)(r->lastWriteTime & 0xFFFFFFFF);
+			lastWriteTime->dwHighDateTime = (DWORD)(r->lastWriteTime >> 32);
+		}
+	}
+	guard.unlock();
+
+	pace(started, duration);
+	return status;
+}
+
+LSTATUS ReplayBackend::setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize) {
+	return status(TraceSetValue, hkey, fold(name));
+}
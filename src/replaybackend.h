@@ -0,0 +1,115 @@
+#ifndef __REPLAYBACKEND__
+#define __REPLAYBACKEND__
+
+#include "backend.h"
+#include "trace.h"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace winreglib {
+
+extern const std::map<std::wstring, HKEY> rootKeys;
+
+/**
+ * Answers registry calls from a trace written by `RecordingBackend`, so a workload recorded on a
+ * Windows machine can be replayed on any platform.
+ *
+ * Calls are matched by operation, key path, and arguments rather than by position in the trace,
+ * so threads may interleave differently than they did when recording. Repeated calls get the
+ * recorded results in order, and the last result once they run out. Calls that weren't recorded
+ * fail with `ERROR_FILE_NOT_FOUND`.
+ *
+ * In realtime mode each call takes as long as it did when it was recorded. Otherwise calls return
+ * immediately. Change notifications fire after the recorded delay in realtime mode and right away
+ * otherwise.
+ */
+class ReplayBackend : public Backend {
+public:
+	ReplayBackend();
+	~ReplayBackend();
+
+	const char* name() { return "replay"; }
+
+	bool load(const BYTE* data, size_t length, bool realtime, std::string& error);
+
+	LSTATUS beginTransaction(HANDLE* tx);
+	LSTATUS commitTransaction(HANDLE tx);
+	LSTATUS rollbackTransaction(HANDLE tx);
+
+	LSTATUS closeKey(HKEY hkey);
+	LSTATUS createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result);
+	LSTATUS deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx);
+	LSTATUS deleteValue(HKEY hkey, const wchar_t* name);
+	LSTATUS enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize);
+	LSTATUS enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize);
+	LSTATUS getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize);
+	LSTATUS notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent);
+	LSTATUS openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result);
+	LSTATUS queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime);
+	LSTATUS setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Record {
+		Record() : op((TraceOp)0), start(0), duration(0), status(0), hasName(false), type(0), dataSize(0), lastWriteTime(0), signalDelay(-1) {}
+
+		TraceOp op;
+		uint64_t start;
+		uint32_t duration;
+		LSTATUS status;
+		std::wstring name;
+		bool hasName;
+		DWORD type;
+		DWORD dataSize;
+		std::vector<BYTE> data;
+		DWORD info[5];
+		uint64_t lastWriteTime;
+
+		/**
+		 * Nanoseconds from a `notifyChangeKeyValue()` call until its event was signaled, or -1 if
+		 * it never was.
+		 */
+		int64_t signalDelay;
+	};
+
+	struct Calls {
+		Calls() : next(0) {}
+		std::vector<size_t> records;
+		size_t next;
+	};
+
+	struct Pending {
+		HKEY hkey;
+		HANDLE hevent;
+	};
+
+	static std::wstring callKey(TraceOp op, const std::wstring& path, const std::wstring& args);
+
+	const Record* match(TraceOp op, HKEY hkey, const std::wstring& args, bool* first = NULL);
+	LSTATUS open(TraceOp op, HKEY parent, const wchar_t* subkey, HKEY* result);
+	void pace(Clock::time_point started, uint32_t duration);
+	void run();
+	LSTATUS status(TraceOp op, HKEY hkey, const std::wstring& args);
+
+	std::mutex lock;
+	std::condition_variable wake;
+	bool realtime;
+	bool stopping;
+	std::vector<Record> records;
+	std::unordered_map<std::wstring, Calls> calls;
+	std::map<HKEY, std::wstring> handles;
+	uintptr_t nextHandle;
+	std::multimap<Clock::time_point, Pending> pending;
+	std::thread timer;
+};
+
+}
+
+#endif
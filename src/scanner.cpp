@@ -0,0 +1,189 @@
+#include "scanner.h"
+#include <map>
+
+using namespace winreglib;
+
+static inline bool sameTime(const FILETIME& a, const FILETIME& b) {
+	return a.dwLowDateTime == b.dwLowDateTime && a.dwHighDateTime == b.dwHighDateTime;
+}
+
+Scanner::Scanner(Backend* backend, HKEY hkey, std::shared_ptr<const ScanNode> previous) :
+	keys(0),
+	skipped(0),
+	backend(backend),
+	hkey(hkey),
+	previous(previous),
+	nameBuffer(256)
+{}
+
+Scanner::~Scanner() {
+	if (hkey != NULL) {
+		backend->closeKey(hkey);
+	}
+}
+
+/**
+ * Scans the tree. Returns the status of the failure to read the root key, if any.
+ */
+LSTATUS Scanner::run() {
+	LSTATUS status;
+	root = scanKey(hkey, L"", previous, status);
+	return root ? ERROR_SUCCESS : status;
+}
+
+/**
+ * Scans a key and its subkeys. Returns `previous` if nothing in the subtree changed, or `NULL` and
+ * the failed status if the key couldn't be queried.
+ */
+std::shared_ptr<const ScanNode> Scanner::scanKey(HKEY key, const std::wstring& name, const std::shared_ptr<const ScanNode>& previous, LSTATUS& status) {
+	FILETIME lastWriteTime;
+	status = backend->queryInfoKey(key, NULL, NULL, NULL, NULL, NULL, &lastWriteTime);
+	if (status != ERROR_SUCCESS) {
+		return NULL;
+	}
+
+	++keys;
+
+	// an unchanged key has the same values and subkeys as before, so the previous scan's list of
+	// subkeys is used instead of enumerating them
+	bool unchanged = previous && sameTime(previous->lastWriteTime, lastWriteTime);
+	size_t changeIndex = 0;
+	std::vector<std::wstring> names;
+	std::map<std::wstring, std::shared_ptr<const ScanNode>, NameLess> previousSubkeys;
+
+	if (!unchanged) {
+		changeIndex = changes.size();
+		changes.push_back({ path, lastWriteTime, true, {}, {} });
+		readKey(key, changes.back());
+		names.swap(changes.back().subkeys);
+		if (previous) {
+			for (auto const& subkey : previous->subkeys) {
+				previousSubkeys.insert(std::make_pair(subkey->name, subkey));
+			}
+		}
+	}
+
+	size_t count = unchanged ? previous->subkeys.size() : names.size();
+	std::shared_ptr<ScanNode> node = std::make_shared<ScanNode>();
+	node->name = name;
+	node->lastWriteTime = lastWriteTime;
+	node->subkeys.reserve(count);
+
+	bool subkeysChanged = false;
+	bool descendantsChanged = false;
+	size_t pathLength = path.length();
+
+	for (size_t i = 0; i < count; ++i) {
+		std::shared_ptr<const ScanNode> previousSubkey;
+		if (unchanged) {
+			previousSubkey = previous->subkeys[i];
+		} else {
+			auto it = previousSubkeys.find(names[i]);
+			if (it != previousSubkeys.end()) {
+				previousSubkey = it->second;
+			}
+		}
+		const std::wstring& subkeyName = unchanged ? previousSubkey->name : names[i];
+
+		HKEY child;
+		if (backend->openKey(key, subkeyName.c_str(), KEY_READ, NULL, &child) != ERROR_SUCCESS) {
+			++skipped;
+			subkeysChanged = true;
+			continue;
+		}
+
+		if (pathLength) {
+			path += L'\\';
+		}
+		path += subkeyName;
+
+		LSTATUS childStatus;
+		std::shared_ptr<const ScanNode> subkey = scanKey(child, subkeyName, previousSubkey, childStatus);
+		backend->closeKey(child);
+		path.resize(pathLength);
+
+		if (!subkey) {
+			++skipped;
+			subkeysChanged = true;
+			continue;
+		}
+		if (subkey != previousSubkey) {
+			descendantsChanged = true;
+		}
+		node->subkeys.push_back(subkey);
+	}
+
+	if (unchanged && !subkeysChanged && !descendantsChanged) {
+		return previous;
+	}
+
+	if (!unchanged || subkeysChanged) {
+		if (unchanged) {
+			// the values didn't change, but a subkey that was read before can't be read now
+			changeIndex = changes.size();
+			changes.push_back({ path, lastWriteTime, false, {}, {} });
+		}
+		std::vector<std::wstring>& subkeys = changes[changeIndex].subkeys;
+		subkeys.reserve(node->subkeys.size());
+		for (auto const& subkey : node->subkeys) {
+			subkeys.push_back(subkey->name);
+		}
+	}
+
+	return node;
+}
+
+/**
+ * Reads the values and subkey names of a key. If the key is deleted while it is being read, the
+ * names read so far are kept.
+ */
+void Scanner::readKey(HKEY key, ScanChange& change) {
+	DWORD maxSubkeyLength = 0;
+	DWORD maxValueNameLength = 0;
+	DWORD maxValueLength = 0;
+	if (backend->queryInfoKey(key, NULL, &maxSubkeyLength, NULL, &maxValueNameLength, &maxValueLength, NULL) != ERROR_SUCCESS) {
+		return;
+	}
+
+	DWORD maxNameLength = maxValueNameLength > maxSubkeyLength ? maxValueNameLength : maxSubkeyLength;
+	if (nameBuffer.size() <= maxNameLength) {
+		nameBuffer.resize(maxNameLength + 1);
+	}
+	if (dataBuffer.size() < maxValueLength) {
+		dataBuffer.resize(maxValueLength);
+	}
+
+	for (DWORD index = 0; ; ) {
+		DWORD nameSize = (DWORD)nameBuffer.size();
+		DWORD dataSize = (DWORD)dataBuffer.size();
+		DWORD type = REG_NONE;
+		LSTATUS status = backend->enumValue(key, index, nameBuffer.data(), &nameSize, &type, dataBuffer.data(), &dataSize);
+
+		if (status == ERROR_MORE_DATA) {
+			// the value grew since the key was queried
+			nameBuffer.resize(nameBuffer.size() * 2);
+			dataBuffer.resize(dataSize > dataBuffer.size() ? dataSize : dataBuffer.size() * 2 + 1);
+			continue;
+		}
+		if (status != ERROR_SUCCESS) {
+			break;
+		}
+
+		change.values.push_back({ std::wstring(nameBuffer.data(), nameSize), type, std::vector<BYTE>(dataBuffer.data(), dataBuffer.data() + dataSize) });
+		++index;
+	}
+
+	for (DWORD index = 0; ; ) {
+		DWORD size = (DWORD)nameBuffer.size();
+		LSTATUS status = backend->enumKey(key, index, nameBuffer.data(), &size);
+		if (status == ERROR_MORE_DATA) {
+			nameBuffer.resize(nameBuffer.size() * 2);
+			continue;
+		}
+		if (status != ERROR_SUCCESS) {
+			break;
+		}
+		change.subkeys.push_back(std::wstring(nameBuffer.data(), size));
+		++index;
+	}
+}
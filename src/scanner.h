@@ -0,0 +1,83 @@
+#ifndef __SCANNER__
+#define __SCANNER__
+
+#include "backend.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * What a scan remembers about a key: its last write time and its subkeys. Nodes are never
+ * modified once a scan completes, so a rescan shares the nodes of untouched subtrees with the
+ * previous result and several rescans of the same result can run at once.
+ */
+struct ScanNode {
+	std::wstring name;
+	FILETIME lastWriteTime;
+	std::vector<std::shared_ptr<const ScanNode>> subkeys;
+};
+
+struct ScanValue {
+	std::wstring name;
+	DWORD type;
+	std::vector<BYTE> data;
+};
+
+/**
+ * A key that is new or changed since the previous scan. `path` is relative to the scanned key and
+ * is empty for the key itself. When only the set of subkeys that could be read changed, the values
+ * are not read and `valuesRead` is false.
+ */
+struct ScanChange {
+	std::wstring path;
+	FILETIME lastWriteTime;
+	bool valuesRead;
+	std::vector<ScanValue> values;
+	std::vector<std::wstring> subkeys;
+};
+
+/**
+ * Inventories a key, its values, and its subkeys, reusing a previous scan where possible.
+ *
+ * The registry updates a key's last write time when one of its values is written or deleted or a
+ * direct subkey is created or deleted, but not when something deeper in the tree changes. Every key
+ * is still opened and queried, but values and subkey names are only read for keys whose last write
+ * time moved, so the cost of a rescan depends on the number of changed keys rather than the
+ * amount of data in the tree.
+ *
+ * Subkeys that can't be opened are left out and counted as skipped.
+ */
+class Scanner {
+public:
+	/**
+	 * Takes ownership of an open key handle. `previous` is the root of the previous scan of the
+	 * same key, or `NULL` for a full scan.
+	 */
+	Scanner(Backend* backend, HKEY hkey, std::shared_ptr<const ScanNode> previous);
+	~Scanner();
+
+	LSTATUS run();
+
+	std::shared_ptr<const ScanNode> root;
+	std::vector<ScanChange> changes;
+	uint64_t keys;
+	uint64_t skipped;
+
+private:
+	std::shared_ptr<const ScanNode> scanKey(HKEY key, const std::wstring& name, const std::shared_ptr<const ScanNode>& previous, LSTATUS& status);
+	void readKey(HKEY key, ScanChange& change);
+
+	Backend* backend;
+	HKEY hkey;
+	std::shared_ptr<const ScanNode> previous;
+	std::wstring path;
+	std::vector<wchar_t> nameBuffer;
+	std::vector<BYTE> dataBuffer;
+};
+
+}
+
+#endif
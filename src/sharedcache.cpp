@@ -0,0 +1,809 @@
+#include "sharedcache.h"
+#include <cstring>
+#include <new>
+#include <cwctype>
+#include <thread>
+#ifdef _WIN32
+	#include <process.h>
+#else
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+using namespace winreglib;
+
+/**
+ * How many times a reader retries a lookup that raced the publisher before giving up. Readers
+ * yield between retries, so this is only reached if the publisher died in the middle of a write.
+ */
+#define SHARED_MAX_ATTEMPTS (1 << 20)
+
+namespace {
+
+inline uint64_t align8(uint64_t n) {
+	return (n + 7) & ~(uint64_t)7;
+}
+
+/**
+ * Matches the folding `NameLess` uses, one UTF-16 code unit at a time.
+ */
+inline char16_t fold(char16_t c) {
+	return (char16_t)foldName((wchar_t)c);
+}
+
+std::u16string toUtf16(const std::wstring& str) {
+	std::u16string result;
+	result.reserve(str.length());
+	for (wchar_t ch : str) {
+		uint32_t c = (uint32_t)ch;
+		if (c > 0xFFFF) {
+			c -= 0x10000;
+			result.push_back((char16_t)(0xD800 + (c >> 10)));
+			result.push_back((char16_t)(0xDC00 + (c & 0x3FF)));
+		} else {
+			result.push_back((char16_t)c);
+		}
+	}
+	return result;
+}
+
+std::wstring fromUtf16(const BYTE* data, size_t length) {
+	std::wstring result;
+	result.reserve(length);
+	for (size_t i = 0; i < length; ++i) {
+		char16_t c;
+		memcpy(&c, data + i * 2, 2);
+#ifndef _WIN32
+		if (c >= 0xD800 && c <= 0xDBFF && i + 1 < length) {
+			char16_t d;
+			memcpy(&d, data + (i + 1) * 2, 2);
+			if (d >= 0xDC00 && d <= 0xDFFF) {
+				result.push_back((wchar_t)(0x10000 + ((c - 0xD800) << 10) + (d - 0xDC00)));
+				++i;
+				continue;
+			}
+		}
+#endif
+		result.push_back((wchar_t)c);
+	}
+	return result;
+}
+
+/**
+ * FNV-1a over the entry kind and the case-folded path and name.
+ */
+uint64_t hashEntry(uint32_t kind, const std::u16string& path, const std::u16string& name) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	auto mix = [&hash](uint32_t c) {
+		hash ^= c & 0xFF;
+		hash *= 0x100000001B3ULL;
+		hash ^= c >> 8;
+		hash *= 0x100000001B3ULL;
+	};
+	mix(kind);
+	for (char16_t c : path) {
+		mix(fold(c));
+	}
+	mix(0);
+	for (char16_t c : name) {
+		mix(fold(c));
+	}
+	return hash;
+}
+
+bool foldedEqual(const BYTE* data, const std::u16string& str) {
+	for (size_t i = 0; i < str.length(); ++i) {
+		char16_t c;
+		memcpy(&c, data + i * 2, 2);
+		if (fold(c) != fold(str[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void putString(std::string& buffer, const std::u16string& str) {
+	buffer.append(reinterpret_cast<const char*>(str.data()), str.length() * 2);
+}
+
+void putName(std::string& buffer, const std::wstring& name) {
+	std::u16string str = toUtf16(name);
+	uint32_t length = (uint32_t)str.length();
+	buffer.append(reinterpret_cast<const char*>(&length), 4);
+	putString(buffer, str);
+}
+
+std::string encodeEntry(uint32_t kind, const std::u16string& path, const std::u16string& name, uint32_t type, uint32_t count, const std::string& data) {
+	SharedEntry entry{ kind, (uint32_t)path.length(), (uint32_t)name.length(), type, count, (uint32_t)data.length() };
+	std::string buffer(reinterpret_cast<const char*>(&entry), sizeof(entry));
+	putString(buffer, path);
+	putString(buffer, name);
+	buffer += data;
+	return buffer;
+}
+
+/**
+ * Decodes the names of a key entry that was copied out of the segment, returning false if it's
+ * malformed.
+ */
+bool decodeNames(const std::vector<BYTE>& entry, std::vector<std::wstring>& subkeys, std::vector<std::wstring>& values) {
+	SharedEntry header;
+	memcpy(&header, entry.data(), sizeof(header));
+	size_t pos = sizeof(header) + ((size_t)header.pathLength + header.nameLength) * 2;
+	for (uint64_t i = 0; i < (uint64_t)header.type + header.count; ++i) {
+		uint32_t length;
+		if (pos + 4 > entry.size()) {
+			return false;
+		}
+		memcpy(&length, entry.data() + pos, 4);
+		pos += 4;
+		if ((uint64_t)length * 2 > entry.size() - pos) {
+			return false;
+		}
+		(i < header.type ? subkeys : values).push_back(fromUtf16(entry.data() + pos, length));
+		pos += (size_t)length * 2;
+	}
+	return true;
+}
+
+}
+
+SharedCache::SharedCache() :
+	header(NULL),
+	buckets(NULL),
+	data(NULL),
+	bucketCount(0),
+	dataSize(0),
+	mappedSize(0),
+	owner(false)
+#ifdef _WIN32
+	, mapping(NULL)
+#endif
+{}
+
+SharedCache::~SharedCache() {
+	close();
+}
+
+/**
+ * Creates and maps a new segment for the given root key. Fails if another live publisher already
+ * uses the name. A segment left behind by a publisher that exited without closing it is replaced.
+ */
+bool SharedCache::create(const std::string& name, const std::wstring& root, uint64_t size, std::string& error) {
+	std::u16string root16 = toUtf16(root);
+	if (root16.length() > SHARED_CACHE_ROOT_MAX) {
+		error = "Key is too long to be shared";
+		return false;
+	}
+
+	// an eighth of the segment goes to the table, the rest to the data
+	uint64_t count = 64;
+	while (count * 2 * sizeof(SharedBucket) * 8 <= size) {
+		count *= 2;
+	}
+	uint64_t dataOffset = align8(sizeof(SharedHeader) + count * sizeof(SharedBucket));
+	if (size < dataOffset + 4096 || size - dataOffset > 0xFFFFFFF0ULL) {
+		error = "Invalid shared cache size";
+		return false;
+	}
+
+	void* view = NULL;
+#ifdef _WIN32
+	std::wstring wname = L"Local\\winreglib-" + std::wstring(name.begin(), name.end());
+	mapping = ::CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, wname.c_str());
+	if (!mapping) {
+		error = "CreateFileMapping() failed";
+		return false;
+	}
+	if (::GetLastError() == ERROR_ALREADY_EXISTS) {
+		::CloseHandle(mapping);
+		mapping = NULL;
+		error = "Shared cache \"" + name + "\" is already published";
+		return false;
+	}
+	view = ::MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+	if (!view) {
+		::CloseHandle(mapping);
+		mapping = NULL;
+		error = "MapViewOfFile() failed";
+		return false;
+	}
+#else
+	// the segment mirrors values readable only by the publisher's user, so only that user may open it
+	std::string path = "/winreglib-" + name;
+	int fd = ::shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0 && errno == EEXIST) {
+		// only replace the segment if its publisher is gone
+		SharedCache existing;
+		std::string ignored;
+		bool live = existing.open(name, ignored) && existing.header->state == SharedLive &&
+			(::kill((pid_t)existing.header->pid, 0) == 0 || errno != ESRCH);
+		existing.close();
+		if (live) {
+			error = "Shared cache \"" + name + "\" is already published";
+			return false;
+		}
+		::shm_unlink(path.c_str());
+		fd = ::shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	}
+	if (fd < 0) {
+		error = std::string("shm_open() failed: ") + ::strerror(errno);
+		return false;
+	}
+	if (::ftruncate(fd, (off_t)size) != 0) {
+		error = std::string("ftruncate() failed: ") + ::strerror(errno);
+		::close(fd);
+		::shm_unlink(path.c_str());
+		return false;
+	}
+	view = ::mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED) {
+		error = std::string("mmap() failed: ") + ::strerror(errno);
+		::shm_unlink(path.c_str());
+		return false;
+	}
+	shmName = path;
+#endif
+
+	// the segment is zero filled, so the table starts out empty
+	SharedHeader* h = static_cast<SharedHeader*>(view);
+	new (&h->seq) std::atomic<uint64_t>(0);
+	h->bucketCount = (uint32_t)count;
+	h->state = SharedLive;
+	h->size = size;
+	h->dataOffset = dataOffset;
+	h->dataSize = size - dataOffset;
+	h->dataUsed = 8;
+#ifdef _WIN32
+	h->pid = (uint32_t)::_getpid();
+#else
+	h->pid = (uint32_t)::getpid();
+#endif
+	h->rootLength = (uint32_t)root16.length();
+	memcpy(h->root, root16.data(), root16.length() * 2);
+
+	// readers check the magic first, so it's written last
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(h->magic, SHARED_CACHE_MAGIC, SHARED_CACHE_MAGIC_LENGTH);
+
+	owner = true;
+	return map(view, size, error);
+}
+
+/**
+ * Maps an existing segment read-only.
+ */
+bool SharedCache::open(const std::string& name, std::string& error) {
+	void* view = NULL;
+	uint64_t size = 0;
+#ifdef _WIN32
+	std::wstring wname = L"Local\\winreglib-" + std::wstring(name.begin(), name.end());
+	mapping = ::OpenFileMappingW(FILE_MAP_READ, FALSE, wname.c_str());
+	if (!mapping) {
+		error = "not found";
+		return false;
+	}
+	view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (!view || !::VirtualQuery(view, &info, sizeof(info))) {
+		if (view) {
+			::UnmapViewOfFile(view);
+		}
+		::CloseHandle(mapping);
+		mapping = NULL;
+		error = "MapViewOfFile() failed";
+		return false;
+	}
+	size = info.RegionSize;
+#else
+	std::string path = "/winreglib-" + name;
+	int fd = ::shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		error = errno == ENOENT ? "not found" : std::string("shm_open() failed: ") + ::strerror(errno);
+		return false;
+	}
+	struct stat st;
+	if (::fstat(fd, &st) != 0) {
+		error = std::string("fstat() failed: ") + ::strerror(errno);
+		::close(fd);
+		return false;
+	}
+	size = (uint64_t)st.st_size;
+	if (size < sizeof(SharedHeader)) {
+		::close(fd);
+		error = "not found";
+		return false;
+	}
+	view = ::mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED) {
+		error = std::string("mmap() failed: ") + ::strerror(errno);
+		return false;
+	}
+#endif
+	return map(view, size, error);
+}
+
+/**
+ * Checks the header of a mapped segment and remembers where the table and data are. These never
+ * change once the segment is created, so readers only have to validate them once.
+ */
+bool SharedCache::map(void* view, uint64_t size, std::string& error) {
+	header = static_cast<SharedHeader*>(view);
+	mappedSize = size;
+
+	const SharedHeader* h = header;
+	uint64_t count = h->bucketCount;
+	if (memcmp(h->magic, SHARED_CACHE_MAGIC, SHARED_CACHE_MAGIC_LENGTH) != 0 ||
+		h->size > size ||
+		count == 0 || (count & (count - 1)) != 0 ||
+		h->dataOffset < sizeof(SharedHeader) + count * sizeof(SharedBucket) ||
+		h->dataOffset > h->size ||
+		h->dataSize != h->size - h->dataOffset ||
+		h->rootLength > SHARED_CACHE_ROOT_MAX
+	) {
+		close();
+		error = "Invalid shared cache";
+		return false;
+	}
+
+	bucketCount = count;
+	buckets = reinterpret_cast<SharedBucket*>(reinterpret_cast<BYTE*>(view) + sizeof(SharedHeader));
+	data = reinterpret_cast<BYTE*>(view) + h->dataOffset;
+	dataSize = h->dataSize;
+	rootKey = fromUtf16(reinterpret_cast<const BYTE*>(h->root), h->rootLength);
+	return true;
+}
+
+/**
+ * Unmaps the segment. When the publisher closes, readers are told the cache is stale and the name
+ * is released.
+ */
+void SharedCache::close() {
+	if (!header) {
+		return;
+	}
+	if (owner) {
+		retire();
+	}
+#ifdef _WIN32
+	::UnmapViewOfFile(header);
+	::CloseHandle(mapping);
+	mapping = NULL;
+#else
+	::munmap(header, (size_t)mappedSize);
+	if (owner) {
+		::shm_unlink(shmName.c_str());
+	}
+#endif
+	header = NULL;
+	buckets = NULL;
+	data = NULL;
+	owner = false;
+}
+
+/**
+ * Finds the slot of an entry by probing linearly from its hash, or -1 if it isn't there. With
+ * `insert`, returns the first free slot instead when the entry doesn't exist. Reads that race the
+ * publisher can see any bytes, so offsets are checked against the data area before anything is
+ * read from it.
+ */
+int64_t SharedCache::probe(uint32_t kind, uint64_t hash, const std::u16string& path, const std::u16string& name, bool insert) const {
+	uint64_t mask = bucketCount - 1;
+	int64_t free = -1;
+	for (uint64_t i = 0; i < bucketCount; ++i) {
+		uint64_t slot = (hash + i) & mask;
+		SharedBucket bucket;
+		memcpy(&bucket, &buckets[slot], sizeof(bucket));
+
+		if (bucket.offset == SHARED_EMPTY) {
+			return insert ? (free >= 0 ? free : (int64_t)slot) : -1;
+		}
+		if (bucket.offset == SHARED_TOMBSTONE) {
+			if (free < 0) {
+				free = (int64_t)slot;
+			}
+			continue;
+		}
+		if (bucket.hash != hash || bucket.length < sizeof(SharedEntry) || (uint64_t)bucket.offset + bucket.length > dataSize) {
+			continue;
+		}
+
+		SharedEntry entry;
+		const BYTE* p = data + bucket.offset;
+		memcpy(&entry, p, sizeof(entry));
+		if (entry.kind == kind &&
+			entry.pathLength == path.length() &&
+			entry.nameLength == name.length() &&
+			sizeof(entry) + ((uint64_t)entry.pathLength + entry.nameLength) * 2 <= bucket.length &&
+			foldedEqual(p + sizeof(entry), path) &&
+			foldedEqual(p + sizeof(entry) + path.length() * 2, name)
+		) {
+			return (int64_t)slot;
+		}
+	}
+	return insert ? free : -1;
+}
+
+/**
+ * Copies an entry out of the segment. The copy is only used if no write started or finished while
+ * it was being made, otherwise the lookup is retried.
+ */
+SharedRead SharedCache::fetch(uint32_t kind, const std::u16string& path, const std::u16string& name, std::vector<BYTE>& entry) const {
+	uint64_t hash = hashEntry(kind, path, name);
+	for (uint32_t attempt = 0; attempt < SHARED_MAX_ATTEMPTS; ++attempt) {
+		uint64_t before = header->seq.load(std::memory_order_acquire);
+		if (before & 1) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		uint32_t state = header->state;
+		int64_t slot = probe(kind, hash, path, name, false);
+		entry.clear();
+		if (slot >= 0) {
+			SharedBucket bucket;
+			memcpy(&bucket, &buckets[slot], sizeof(bucket));
+			if (bucket.offset != SHARED_TOMBSTONE && bucket.length >= sizeof(SharedEntry) && (uint64_t)bucket.offset + bucket.length <= dataSize) {
+				entry.assign(data + bucket.offset, data + bucket.offset + bucket.length);
+			}
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (header->seq.load(std::memory_order_relaxed) != before) {
+			continue;
+		}
+		if (state != SharedLive) {
+			return SharedStale;
+		}
+		return entry.empty() ? SharedMissing : SharedFound;
+	}
+	return SharedBusy;
+}
+
+SharedRead SharedCache::list(const std::wstring& path, std::vector<std::wstring>& subkeys, std::vector<std::wstring>& values) const {
+	std::vector<BYTE> entry;
+	SharedRead result = fetch(SharedKeyEntry, toUtf16(path), u"", entry);
+	if (result == SharedFound && !decodeNames(entry, subkeys, values)) {
+		result = SharedMissing;
+	}
+	return result;
+}
+
+SharedRead SharedCache::read(const std::wstring& path, const std::wstring& name, DWORD& type, std::vector<BYTE>& value) const {
+	std::vector<BYTE> entry;
+	SharedRead result = fetch(SharedValueEntry, toUtf16(path), toUtf16(name), entry);
+	if (result == SharedFound) {
+		SharedEntry header;
+		memcpy(&header, entry.data(), sizeof(header));
+		size_t pos = sizeof(header) + ((size_t)header.pathLength + header.nameLength) * 2;
+		if (pos + header.dataLength > entry.size()) {
+			return SharedMissing;
+		}
+		type = header.type;
+		value.assign(entry.begin() + pos, entry.begin() + pos + header.dataLength);
+	}
+	return result;
+}
+
+/**
+ * Starts a write. Readers retry any lookup that overlaps it.
+ */
+void SharedCache::begin() {
+	uint64_t seq = header->seq.load(std::memory_order_relaxed);
+	header->seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedCache::end() {
+	uint64_t seq = header->seq.load(std::memory_order_relaxed);
+	header->seq.store(seq + 1, std::memory_order_release);
+}
+
+void SharedCache::clear() {
+	memset(buckets, 0, bucketCount * sizeof(SharedBucket));
+	header->dataUsed = 8;
+	header->entries = 0;
+	header->tombstones = 0;
+}
+
+/**
+ * Appends an entry and points its bucket at it. Returns false if the data area or the table is
+ * full and the cache has to be rebuilt.
+ */
+bool SharedCache::put(const std::u16string& path, const std::u16string& name, uint32_t kind, const std::string& entry) {
+	uint64_t hash = hashEntry(kind, path, name);
+	int64_t slot = probe(kind, hash, path, name, true);
+	if (slot < 0) {
+		return false;
+	}
+
+	SharedBucket& bucket = buckets[slot];
+	bool replacing = bucket.offset != SHARED_EMPTY && bucket.offset != SHARED_TOMBSTONE;
+	if (!replacing && bucket.offset == SHARED_EMPTY && (uint64_t)header->entries + header->tombstones + 1 > bucketCount * 3 / 4) {
+		return false;
+	}
+	uint64_t length = align8(entry.length());
+	if (header->dataUsed + length > dataSize) {
+		return false;
+	}
+
+	uint32_t offset = (uint32_t)header->dataUsed;
+	memcpy(data + offset, entry.data(), entry.length());
+	header->dataUsed += length;
+
+	if (!replacing) {
+		if (bucket.offset == SHARED_TOMBSTONE) {
+			--header->tombstones;
+		}
+		++header->entries;
+	}
+	bucket.hash = hash;
+	bucket.length = (uint32_t)entry.length();
+	bucket.offset = offset;
+	return true;
+}
+
+void SharedCache::remove(const std::u16string& path, const std::u16string& name, uint32_t kind) {
+	int64_t slot = probe(kind, hashEntry(kind, path, name), path, name, false);
+	if (slot >= 0) {
+		buckets[slot].offset = SHARED_TOMBSTONE;
+		--header->entries;
+		++header->tombstones;
+	}
+}
+
+/**
+ * Marks the cache as no longer maintained. Readers that still have it mapped get `SharedStale`.
+ */
+void SharedCache::retire() {
+	begin();
+	header->state = SharedClosed;
+	end();
+}
+
+/**
+ * Checks if a full key path is the shared key or below it.
+ */
+bool SharedCache::contains(const std::wstring& path) const {
+	if (path.length() < rootKey.length() || (path.length() > rootKey.length() && path[rootKey.length()] != L'\\')) {
+		return false;
+	}
+	for (size_t i = 0; i < rootKey.length(); ++i) {
+		if (path[i] != rootKey[i] && (path[i] > 0xFFFF || rootKey[i] > 0xFFFF || fold((char16_t)path[i]) != fold((char16_t)rootKey[i]))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Reads a key's subkey names and values from the registry.
+ */
+LSTATUS SharedCacheWriter::readKey(const std::wstring& path, SharedKey& key) {
+	HKEY hkey;
+	std::wstring relative = path.substr(rootName.length() + 1);
+	LSTATUS status = backend->openKey(hroot, relative.c_str(), KEY_READ, NULL, &hkey);
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	DWORD numSubkeys = 0;
+	DWORD maxSubkeyLength = 0;
+	DWORD numValues = 0;
+	DWORD maxNameLength = 0;
+	DWORD maxValueLength = 0;
+	status = backend->queryInfoKey(hkey, &numSubkeys, &maxSubkeyLength, &numValues, &maxNameLength, &maxValueLength, NULL);
+	std::vector<wchar_t> name((maxSubkeyLength > maxNameLength ? maxSubkeyLength : maxNameLength) + 1);
+	std::vector<BYTE> data(maxValueLength);
+
+	key.path = path;
+	for (DWORD i = 0; status == ERROR_SUCCESS && i < numSubkeys; ++i) {
+		DWORD nameSize = (DWORD)name.size();
+		status = backend->enumKey(hkey, i, name.data(), &nameSize);
+		if (status == ERROR_SUCCESS) {
+			key.subkeys.emplace_back(name.data(), nameSize);
+		}
+	}
+	for (DWORD i = 0; status == ERROR_SUCCESS && i < numValues; ++i) {
+		DWORD nameSize = (DWORD)name.size();
+		DWORD dataSize = (DWORD)data.size();
+		DWORD type;
+		status = backend->enumValue(hkey, i, name.data(), &nameSize, &type, data.data(), &dataSize);
+		if (status == ERROR_SUCCESS) {
+			key.values.push_back(SharedValue{ std::wstring(name.data(), nameSize), type, std::vector<BYTE>(data.begin(), data.begin() + dataSize) });
+		}
+	}
+	backend->closeKey(hkey);
+
+	// the key was modified since it was queried, the next event will pick up the rest
+	return status == ERROR_NO_MORE_ITEMS ? ERROR_SUCCESS : status;
+}
+
+/**
+ * Re-reads a key and records what has to be written. Subkeys that appeared are read recursively,
+ * as is every subkey with `deep`, and subkeys that vanished are removed with everything below
+ * them. The paths of added and
+ * removed keys are returned so the caller can watch them.
+ */
+LSTATUS SharedCacheWriter::refresh(const std::wstring& path, bool deep, Changes& changes, std::vector<std::wstring>& added, std::vector<std::wstring>& removed) {
+	SharedKey key;
+	LSTATUS status = readKey(path, key);
+	if (status == ERROR_FILE_NOT_FOUND || status == ERROR_KEY_DELETED) {
+		removeTree(path, changes, removed);
+		return ERROR_SUCCESS;
+	}
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	auto it = keys.find(path);
+	Change change{ path, true, {} };
+	std::vector<std::wstring> newSubkeys;
+
+	if (it == keys.end()) {
+		added.push_back(path);
+		newSubkeys = key.subkeys;
+		for (size_t i = 0; i < key.values.size(); ++i) {
+			change.values.push_back(i);
+		}
+	} else {
+		const SharedKey& old = it->second;
+		change.names = old.subkeys != key.subkeys || old.values.size() != key.values.size();
+
+		std::map<std::wstring, const SharedValue*, NameLess> oldValues;
+		for (const SharedValue& value : old.values) {
+			oldValues.emplace(value.name, &value);
+		}
+		for (size_t i = 0; i < key.values.size(); ++i) {
+			auto prev = oldValues.find(key.values[i].name);
+			if (prev == oldValues.end()) {
+				change.values.push_back(i);
+				change.names = true;
+				continue;
+			}
+			if (prev->second->type != key.values[i].type || prev->second->data != key.values[i].data || prev->second->name != key.values[i].name) {
+				change.values.push_back(i);
+				change.names = change.names || prev->second->name != key.values[i].name;
+			}
+			oldValues.erase(prev);
+		}
+		for (auto& gone : oldValues) {
+			changes.removedValues.emplace_back(path, gone.first);
+			change.names = true;
+		}
+
+		std::map<std::wstring, bool, NameLess> current;
+		for (const std::wstring& name : key.subkeys) {
+			current.emplace(name, true);
+		}
+		for (const std::wstring& name : old.subkeys) {
+			if (current.erase(name) == 0) {
+				removeTree(path + L'\\' + name, changes, removed);
+			}
+		}
+		for (const std::wstring& name : key.subkeys) {
+			if (deep || (current.count(name) && keys.find(path + L'\\' + name) == keys.end())) {
+				newSubkeys.push_back(name);
+			}
+		}
+	}
+
+	keys[path] = std::move(key);
+	if (change.names || !change.values.empty()) {
+		changes.updated.push_back(std::move(change));
+	}
+
+	for (const std::wstring& name : newSubkeys) {
+		status = refresh(path + L'\\' + name, deep, changes, added, removed);
+		if (status != ERROR_SUCCESS) {
+			return status;
+		}
+	}
+	return ERROR_SUCCESS;
+}
+
+/**
+ * Forgets a key and everything below it.
+ */
+void SharedCacheWriter::removeTree(const std::wstring& path, Changes& changes, std::vector<std::wstring>& removed) {
+	auto it = keys.find(path);
+	if (it == keys.end()) {
+		return;
+	}
+	SharedKey key = std::move(it->second);
+	keys.erase(it);
+	for (const std::wstring& name : key.subkeys) {
+		removeTree(path + L'\\' + name, changes, removed);
+	}
+	removed.push_back(path);
+	changes.removedKeys.push_back(std::move(key));
+}
+
+bool SharedCacheWriter::writeKey(const SharedKey& key) {
+	std::string names;
+	for (const std::wstring& name : key.subkeys) {
+		putName(names, name);
+	}
+	for (const SharedValue& value : key.values) {
+		putName(names, value.name);
+	}
+	std::u16string path = toUtf16(key.path);
+	return cache.put(path, u"", SharedKeyEntry, encodeEntry(SharedKeyEntry, path, u"", (uint32_t)key.subkeys.size(), (uint32_t)key.values.size(), names));
+}
+
+bool SharedCacheWriter::writeValue(const SharedKey& key, const SharedValue& value) {
+	std::u16string path = toUtf16(key.path);
+	std::u16string name = toUtf16(value.name);
+	std::string data(value.data.begin(), value.data.end());
+	return cache.put(path, name, SharedValueEntry, encodeEntry(SharedValueEntry, path, name, value.type, 0, data));
+}
+
+/**
+ * Rewrites the whole cache from the publisher's copy, dropping superseded entries and tombstones.
+ */
+bool SharedCacheWriter::rebuild() {
+	cache.clear();
+	for (auto& it : keys) {
+		if (!writeKey(it.second)) {
+			return false;
+		}
+		for (const SharedValue& value : it.second.values) {
+			if (!writeValue(it.second, value)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Brings a key of the shared subtree, or with `deep` everything below it too, up to date. `full` is set if the subtree no longer fits in
+ * the cache, in which case the cache is retired so readers fall back to the registry.
+ */
+LSTATUS SharedCacheWriter::sync(const std::wstring& path, bool deep, std::vector<std::wstring>& added, std::vector<std::wstring>& removed, bool& full) {
+	Changes changes;
+	LSTATUS status = refresh(path, deep, changes, added, removed);
+	full = false;
+
+	cache.begin();
+	bool ok = true;
+	for (const SharedKey& key : changes.removedKeys) {
+		std::u16string path16 = toUtf16(key.path);
+		cache.remove(path16, u"", SharedKeyEntry);
+		for (const SharedValue& value : key.values) {
+			cache.remove(path16, toUtf16(value.name), SharedValueEntry);
+		}
+	}
+	for (auto& value : changes.removedValues) {
+		cache.remove(toUtf16(value.first), toUtf16(value.second), SharedValueEntry);
+	}
+	for (const Change& change : changes.updated) {
+		auto it = keys.find(change.path);
+		if (it == keys.end()) {
+			continue;
+		}
+		if (change.names) {
+			ok = ok && writeKey(it->second);
+		}
+		for (size_t i : change.values) {
+			ok = ok && writeValue(it->second, it->second.values[i]);
+		}
+	}
+	if (!ok && !rebuild()) {
+		cache.clear();
+		full = true;
+	}
+	cache.end();
+
+	if (full) {
+		cache.retire();
+	}
+
+	return status;
+}
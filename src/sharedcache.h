@@ -0,0 +1,204 @@
+#ifndef __SHAREDCACHE__
+#define __SHAREDCACHE__
+
+#include "backend.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * A mirror of a subtree in a named shared memory segment. One process publishes the segment and
+ * keeps it up to date; any number of processes map it read-only and look up keys and values
+ * without calling into the registry.
+ *
+ * The segment starts with a `SharedHeader`, followed by an open addressing table of
+ * `SharedBucket`s and the data area the buckets point into. Every key and every value is an entry
+ * in the data area, found by the hash of its case-folded path (and name for values). Entries are
+ * never modified in place: a changed entry is appended and its bucket is pointed at it. When the
+ * data area or the table fills up, everything is rewritten from the publisher's copy.
+ *
+ * Writes are guarded by a seqlock. The publisher makes `seq` odd before it touches the table and
+ * even again once it's done. Readers copy the entry they need and retry if `seq` was odd or moved
+ * while they read, so they never block the publisher and never see a half-written table. Every
+ * read is bounds checked against the fixed size of the segment since a read that races a write
+ * can see anything.
+ */
+
+#define SHARED_CACHE_MAGIC "WRSHMC01"
+#define SHARED_CACHE_MAGIC_LENGTH 8
+#define SHARED_CACHE_ROOT_MAX 512
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The seqlock must be lock-free to be shared between processes");
+
+enum SharedState : uint32_t { SharedLive = 1, SharedClosed };
+
+struct SharedHeader {
+	char magic[SHARED_CACHE_MAGIC_LENGTH];
+	uint32_t bucketCount;
+	uint32_t state;
+	uint64_t size;
+	std::atomic<uint64_t> seq;
+	uint64_t dataOffset;
+	uint64_t dataSize;
+	uint64_t dataUsed;
+	uint32_t entries;
+	uint32_t tombstones;
+	uint32_t pid;
+	uint32_t rootLength;
+	char16_t root[SHARED_CACHE_ROOT_MAX];
+};
+
+/**
+ * A slot in the table. `offset` is relative to the data area, 0 is an empty slot and
+ * `SHARED_TOMBSTONE` a removed entry.
+ */
+struct SharedBucket {
+	uint64_t hash;
+	uint32_t offset;
+	uint32_t length;
+};
+
+#define SHARED_EMPTY 0
+#define SHARED_TOMBSTONE 0xFFFFFFFF
+
+enum SharedEntryKind : uint32_t { SharedKeyEntry = 1, SharedValueEntry };
+
+/**
+ * The start of an entry, followed by the path and name as UTF-16 code units, then the data. The
+ * data of a key entry is its subkey names followed by its value names, each a u32 number of code
+ * units followed by the code units.
+ */
+struct SharedEntry {
+	uint32_t kind;
+	uint32_t pathLength;
+	uint32_t nameLength;
+
+	/**
+	 * The value's type, or the number of subkeys of a key.
+	 */
+	uint32_t type;
+
+	/**
+	 * The number of values of a key.
+	 */
+	uint32_t count;
+	uint32_t dataLength;
+};
+
+enum SharedRead { SharedFound, SharedMissing, SharedBusy, SharedStale };
+
+/**
+ * A mapping of a shared cache segment, read-only unless it was created.
+ */
+class SharedCache {
+public:
+	SharedCache();
+	~SharedCache();
+
+	bool create(const std::string& name, const std::wstring& root, uint64_t size, std::string& error);
+	bool open(const std::string& name, std::string& error);
+	void close();
+	bool contains(const std::wstring& path) const;
+
+	SharedRead list(const std::wstring& path, std::vector<std::wstring>& subkeys, std::vector<std::wstring>& values) const;
+	SharedRead read(const std::wstring& path, const std::wstring& name, DWORD& type, std::vector<BYTE>& data) const;
+	const std::wstring& root() const { return rootKey; }
+	uint64_t version() const { return header->seq.load(std::memory_order_acquire) / 2; }
+
+	// publisher only
+	void begin();
+	void end();
+	void clear();
+	bool put(const std::u16string& path, const std::u16string& name, uint32_t kind, const std::string& entry);
+	void remove(const std::u16string& path, const std::u16string& name, uint32_t kind);
+	void retire();
+
+private:
+	bool map(void* view, uint64_t size, std::string& error);
+	int64_t probe(uint32_t kind, uint64_t hash, const std::u16string& path, const std::u16string& name, bool insert) const;
+	SharedRead fetch(uint32_t kind, const std::u16string& path, const std::u16string& name, std::vector<BYTE>& entry) const;
+
+	SharedHeader* header;
+	SharedBucket* buckets;
+	BYTE* data;
+	uint64_t bucketCount;
+	uint64_t dataSize;
+	uint64_t mappedSize;
+	std::wstring rootKey;
+	std::string shmName;
+	bool owner;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+};
+
+struct SharedValue {
+	std::wstring name;
+	DWORD type;
+	std::vector<BYTE> data;
+};
+
+struct SharedKey {
+	std::wstring path;
+	std::vector<std::wstring> subkeys;
+	std::vector<SharedValue> values;
+};
+
+/**
+ * Mirrors a subtree into a shared cache it creates. The publisher keeps its own copy of every key
+ * so it only writes what changed and can rewrite the whole cache when it fills up.
+ *
+ * Keys are read from the registry before the seqlock is taken, so readers only retry for as long
+ * as it takes to copy the changed entries.
+ */
+class SharedCacheWriter {
+public:
+	SharedCacheWriter(Backend* backend, HKEY hroot, const std::wstring& rootName, const std::wstring& subkey) :
+		backend(backend), hroot(hroot), rootName(rootName), subkey(subkey) {}
+
+	bool create(const std::string& name, uint64_t size, std::string& error) {
+		return cache.create(name, rootName + L'\\' + subkey, size, error);
+	}
+	void close() { cache.close(); }
+	const SharedCache& shared() const { return cache; }
+	LSTATUS sync(const std::wstring& path, bool deep, std::vector<std::wstring>& added, std::vector<std::wstring>& removed, bool& full);
+
+private:
+	/**
+	 * The entries a sync has to write: a key, whether its names changed, and the indexes of the
+	 * values that were added or changed.
+	 */
+	struct Change {
+		std::wstring path;
+		bool names;
+		std::vector<size_t> values;
+	};
+
+	struct Changes {
+		std::vector<Change> updated;
+		std::vector<SharedKey> removedKeys;
+		std::vector<std::pair<std::wstring, std::wstring>> removedValues;
+	};
+
+	LSTATUS readKey(const std::wstring& path, SharedKey& key);
+	LSTATUS refresh(const std::wstring& path, bool deep, Changes& changes, std::vector<std::wstring>& added, std::vector<std::wstring>& removed);
+	void removeTree(const std::wstring& path, Changes& changes, std::vector<std::wstring>& removed);
+	bool rebuild();
+	bool writeKey(const SharedKey& key);
+	bool writeValue(const SharedKey& key, const SharedValue& value);
+
+	Backend* backend;
+	HKEY hroot;
+	std::wstring rootName;
+	std::wstring subkey;
+	SharedCache cache;
+	std::map<std::wstring, SharedKey, NameLess> keys;
+};
+
+}
+
+#endif
@@ -0,0 +1,330 @@
+#include "timeline.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <uv.h>
+
+using namespace winreglib;
+
+std::atomic<bool> Timeline::active(false);
+
+namespace {
+
+/**
+ * The buffers of the current recording and the names of the threads that wrote to them. Buffers
+ * are shared with the threads that write to them, so stopping or restarting never frees a buffer
+ * out from under a span that is being recorded.
+ */
+struct TimelineState {
+	std::mutex lock;
+	std::vector<std::shared_ptr<TimelineBuffer>> buffers;
+	std::map<uint32_t, std::string> threadNames;
+	std::atomic<uint64_t> generation{ 0 };
+	std::atomic<uint64_t> flows{ 0 };
+	std::atomic<uint32_t> threads{ 0 };
+	size_t capacity = TIMELINE_DEFAULT_CAPACITY;
+	uint64_t origin = 0;
+};
+
+TimelineState& state() {
+	static TimelineState s;
+	return s;
+}
+
+/**
+ * The current thread's buffer. When the thread exits, the buffer is left for the next thread that
+ * records a span.
+ */
+struct ThreadSlot {
+	~ThreadSlot() {
+		if (buffer) {
+			buffer->owned = false;
+		}
+	}
+
+	std::shared_ptr<TimelineBuffer> buffer;
+	uint64_t generation = 0;
+	uint32_t tid = 0;
+};
+
+thread_local ThreadSlot slot;
+
+uint32_t threadId() {
+	if (!slot.tid) {
+		slot.tid = ++state().threads;
+	}
+	return slot.tid;
+}
+
+/**
+ * Writes a string as a JSON string literal. Everything outside of printable ASCII is escaped, so
+ * the output is ASCII no matter what the key names contain.
+ */
+void appendJsonString(std::string& out, const char16_t* str, size_t length) {
+	char escape[8];
+	out += '"';
+	for (size_t i = 0; i < length; ++i) {
+		char16_t c = str[i];
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += (char)c;
+		} else if (c >= 0x20 && c < 0x7F) {
+			out += (char)c;
+		} else {
+			::snprintf(escape, sizeof(escape), "\\u%04x", (unsigned)c);
+			out += escape;
+		}
+	}
+	out += '"';
+}
+
+void appendJsonString(std::string& out, const char* str) {
+	std::u16string units(str, str + ::strlen(str));
+	appendJsonString(out, units.c_str(), units.length());
+}
+
+/**
+ * Writes a time in nanoseconds as microseconds, the unit of the trace-event format.
+ */
+void appendMicros(std::string& out, uint64_t ns) {
+	char buf[32];
+	::snprintf(buf, sizeof(buf), "%llu.%03u", (unsigned long long)(ns / 1000), (unsigned)(ns % 1000));
+	out += buf;
+}
+
+}
+
+/**
+ * Returns a new flow id for connecting spans across threads.
+ */
+uint64_t Timeline::nextFlow() {
+	return ++state().flows;
+}
+
+/**
+ * Returns the current time in nanoseconds. Never returns 0, which spans use to mean that the
+ * timeline wasn't recording.
+ */
+uint64_t Timeline::now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() | 1;
+}
+
+/**
+ * Returns the current thread's buffer for this recording, taking over a buffer left by a thread
+ * that exited or adding a new one.
+ */
+TimelineBuffer* Timeline::local() {
+	TimelineState& s = state();
+	uint64_t generation = s.generation.load(std::memory_order_acquire);
+	if (slot.buffer && slot.generation == generation) {
+		return slot.buffer.get();
+	}
+
+	if (slot.buffer) {
+		slot.buffer->owned = false;
+	}
+
+	std::lock_guard<std::mutex> guard(s.lock);
+	slot.buffer.reset();
+	for (auto const& buffer : s.buffers) {
+		bool expected = false;
+		if (buffer->owned.compare_exchange_strong(expected, true)) {
+			slot.buffer = buffer;
+			break;
+		}
+	}
+	if (!slot.buffer) {
+		slot.buffer = std::make_shared<TimelineBuffer>(s.capacity);
+		slot.buffer->owned = true;
+		s.buffers.push_back(slot.buffer);
+	}
+	slot.generation = s.generation.load(std::memory_order_relaxed);
+	return slot.buffer.get();
+}
+
+/**
+ * Starts a span on the current thread.
+ */
+void Timeline::begin(TimelineEvent& event, const char* category, const char* name, const wchar_t* detail, size_t length, uint64_t flow) {
+	event.category = category;
+	event.name = name;
+	event.flow = flow;
+
+	// keep the tail of long details, it's the most specific part of a key
+	if (length > TIMELINE_DETAIL_LENGTH) {
+		detail += length - TIMELINE_DETAIL_LENGTH;
+		length = TIMELINE_DETAIL_LENGTH;
+	}
+	event.detailLength = (uint16_t)length;
+	for (size_t i = 0; i < length; ++i) {
+		event.detail[i] = (char16_t)detail[i];
+	}
+
+	event.start = now();
+}
+
+/**
+ * Ends a span and adds it to the current thread's buffer, unless recording stopped in the
+ * meantime.
+ */
+void Timeline::end(TimelineEvent& event) {
+	if (!enabled()) {
+		return;
+	}
+	event.duration = now() - event.start;
+	event.tid = threadId();
+	local()->push(event);
+}
+
+/**
+ * Names the current thread in exported traces.
+ */
+void Timeline::setThreadName(const char* name) {
+	TimelineState& s = state();
+	uint32_t tid = threadId();
+	std::lock_guard<std::mutex> guard(s.lock);
+	s.threadNames[tid] = name;
+}
+
+/**
+ * Clears any recorded spans and starts recording with room for `capacity` spans per thread.
+ */
+void Timeline::start(size_t capacity) {
+	TimelineState& s = state();
+	std::lock_guard<std::mutex> guard(s.lock);
+	s.buffers.clear();
+	s.capacity = capacity ? capacity : TIMELINE_DEFAULT_CAPACITY;
+	s.origin = now();
+	++s.generation;
+	active = true;
+}
+
+/**
+ * Stops recording and frees the recorded spans once the threads that recorded them let go.
+ */
+void Timeline::stop() {
+	TimelineState& s = state();
+	std::lock_guard<std::mutex> guard(s.lock);
+	active = false;
+	s.buffers.clear();
+	++s.generation;
+}
+
+/**
+ * Exports the spans recorded so far as Chrome trace-event JSON without stopping. Every span is a
+ * complete ("X") event and spans that share a flow id are chained with flow events, the first
+ * starting the flow and the last ending it. Flows that lost their other spans to a full ring are
+ * left out.
+ */
+std::string Timeline::exportJson() {
+	TimelineState& s = state();
+	std::vector<TimelineEvent> events;
+	std::map<uint32_t, std::string> threadNames;
+	uint64_t origin;
+
+	{
+		std::lock_guard<std::mutex> guard(s.lock);
+		origin = s.origin;
+		threadNames = s.threadNames;
+		for (auto const& buffer : s.buffers) {
+			size_t capacity = buffer->events.size();
+			uint64_t head = buffer->head.load(std::memory_order_acquire);
+			uint64_t first = head > capacity ? head - capacity : 0;
+			size_t copied = events.size();
+			for (uint64_t i = first; i < head; ++i) {
+				events.push_back(buffer->events[i % capacity]);
+			}
+
+			// drop the spans the writer overwrote while they were being copied, including the
+			// one it may be writing now
+			uint64_t after = buffer->head.load(std::memory_order_acquire) + 1;
+			if (after > capacity && after - capacity > first) {
+				size_t lost = (size_t)std::min<uint64_t>(after - capacity - first, head - first);
+				events.erase(events.begin() + copied, events.begin() + copied + lost);
+			}
+		}
+	}
+
+	std::sort(events.begin(), events.end(), [](const TimelineEvent& a, const TimelineEvent& b) {
+		return a.start < b.start;
+	});
+
+	// the first and last span of each flow
+	std::unordered_map<uint64_t, std::pair<size_t, size_t>> flows;
+	for (size_t i = 0; i < events.size(); ++i) {
+		if (events[i].flow && events[i].start >= origin) {
+			auto it = flows.find(events[i].flow);
+			if (it == flows.end()) {
+				flows.emplace(events[i].flow, std::make_pair(i, i));
+			} else {
+				it->second.second = i;
+			}
+		}
+	}
+
+	char pid[32];
+	::snprintf(pid, sizeof(pid), "%d", (int)uv_os_getpid());
+
+	std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	auto begin = [&](const char* ph, const char* name, uint32_t tid) {
+		char buf[64];
+		out += first ? "\n{" : ",\n{";
+		first = false;
+		out += "\"ph\":\"";
+		out += ph;
+		out += "\",\"name\":";
+		appendJsonString(out, name);
+		::snprintf(buf, sizeof(buf), ",\"pid\":%s,\"tid\":%u", pid, tid);
+		out += buf;
+	};
+
+	for (auto const& it : threadNames) {
+		begin("M", "thread_name", it.first);
+		out += ",\"args\":{\"name\":";
+		appendJsonString(out, it.second.c_str());
+		out += "}}";
+	}
+
+	for (size_t i = 0; i < events.size(); ++i) {
+		const TimelineEvent& e = events[i];
+		if (e.start < origin) {
+			// started before this recording
+			continue;
+		}
+
+		begin("X", e.name, e.tid);
+		out += ",\"cat\":";
+		appendJsonString(out, e.category);
+		out += ",\"ts\":";
+		appendMicros(out, e.start - origin);
+		out += ",\"dur\":";
+		appendMicros(out, e.duration);
+		if (e.detailLength) {
+			out += ",\"args\":{\"detail\":";
+			appendJsonString(out, e.detail, e.detailLength);
+			out += "}";
+		}
+		out += "}";
+
+		auto flow = e.flow ? flows.find(e.flow) : flows.end();
+		if (flow != flows.end() && flow->second.first != flow->second.second) {
+			char buf[64];
+			const char* ph = i == flow->second.first ? "s" : i == flow->second.second ? "f" : "t";
+			begin(ph, "change", e.tid);
+			::snprintf(buf, sizeof(buf), ",\"cat\":\"flow\",\"id\":%llu,\"ts\":", (unsigned long long)e.flow);
+			out += buf;
+			appendMicros(out, e.start - origin);
+			// bind the end of the flow to the span it points at rather than the next one
+			out += *ph == 'f' ? ",\"bp\":\"e\"}" : "}";
+		}
+	}
+
+	out += "\n]}\n";
+	return out;
+}
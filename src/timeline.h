@@ -0,0 +1,121 @@
+#ifndef __TIMELINE__
+#define __TIMELINE__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * How many UTF-16 code units of a span's detail, such as a key name, are kept. Longer details
+ * keep their tail, which is the most specific part of a key.
+ */
+#define TIMELINE_DETAIL_LENGTH 48
+
+/**
+ * The default number of spans each thread keeps.
+ */
+#define TIMELINE_DEFAULT_CAPACITY 16384
+
+/**
+ * A completed span. `category` and `name` must be string literals. Spans with the same non-zero
+ * `flow` are connected by flow arrows in the order they started.
+ */
+struct TimelineEvent {
+	const char* category;
+	const char* name;
+	uint64_t start;
+	uint64_t duration;
+	uint64_t flow;
+	uint32_t tid;
+	uint16_t detailLength;
+	char16_t detail[TIMELINE_DETAIL_LENGTH];
+};
+
+/**
+ * A fixed-size ring of spans written by one thread at a time and read by `Timeline::exportJson()`.
+ * The writer publishes a span by bumping `head` after filling it in; the reader copies the ring
+ * and then drops whatever the writer overwrote while it was copying.
+ */
+struct TimelineBuffer {
+	TimelineBuffer(size_t capacity) : events(capacity), head(0), owned(false) {}
+
+	void push(const TimelineEvent& event) {
+		uint64_t h = head.load(std::memory_order_relaxed);
+		events[h % events.size()] = event;
+		head.store(h + 1, std::memory_order_release);
+	}
+
+	std::vector<TimelineEvent> events;
+	std::atomic<uint64_t> head;
+	std::atomic<bool> owned;
+};
+
+/**
+ * An opt-in, process-wide recorder of timed spans for finding where the addon spends its time.
+ * Each thread writes to its own ring buffer, so recording a span never takes a lock, and a buffer
+ * left behind by a thread that exited is picked up by the next new thread. When recording is off,
+ * a span costs one atomic load.
+ *
+ * The spans are exported as Chrome trace-event JSON, which Perfetto and `chrome://tracing` open
+ * directly.
+ */
+class Timeline {
+public:
+	static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+	static void begin(TimelineEvent& event, const char* category, const char* name, const wchar_t* detail, size_t length, uint64_t flow);
+	static void end(TimelineEvent& event);
+	static std::string exportJson();
+	static uint64_t nextFlow();
+	static uint64_t now();
+	static void setThreadName(const char* name);
+	static void start(size_t capacity);
+	static void stop();
+
+private:
+	static TimelineBuffer* local();
+
+	static std::atomic<bool> active;
+};
+
+/**
+ * Records the time from its construction to its destruction as a span on the current thread, if
+ * the timeline was recording when it was constructed. The detail is copied right away, so it may
+ * change before the span ends.
+ */
+class TimelineSpan {
+public:
+	TimelineSpan(const char* category, const char* name, uint64_t flow = 0) {
+		event.start = 0;
+		if (Timeline::enabled()) {
+			Timeline::begin(event, category, name, NULL, 0, flow);
+		}
+	}
+
+	TimelineSpan(const char* category, const char* name, const std::wstring& detail, uint64_t flow = 0) {
+		event.start = 0;
+		if (Timeline::enabled()) {
+			Timeline::begin(event, category, name, detail.c_str(), detail.length(), flow);
+		}
+	}
+
+	~TimelineSpan() {
+		if (event.start) {
+			Timeline::end(event);
+		}
+	}
+
+	TimelineSpan(const TimelineSpan&) = delete;
+	TimelineSpan& operator=(const TimelineSpan&) = delete;
+
+	TimelineEvent event;
+};
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __TRACE__
+#define __TRACE__
+
+#include <cstdint>
+
+namespace winreglib {
+
+/**
+ * Registry call traces written by `RecordingBackend` and read by `ReplayBackend`.
+ *
+ * A trace starts with the 8 byte magic followed by a sequence of records. Every record starts with
+ * a header:
+ *
+ *   u8 op, u16 thread, u64 start (ns since the recording started), u32 duration (ns), i32 status
+ *
+ * followed by the operation's arguments and results. Integers are little-endian. Strings are a u32
+ * number of UTF-16 code units (`TRACE_NULL` for a null pointer) followed by the code units, and
+ * data is a u32 length (`TRACE_NULL` when not requested) followed by the bytes.
+ *
+ * Handles are recorded as ids. Predefined root keys keep their low 32 bits, every other key,
+ * transaction, and event handle gets the next id when it is first seen, so ids are never reused
+ * within a trace.
+ */
+
+#define TRACE_MAGIC "WRTRACE1"
+#define TRACE_MAGIC_LENGTH 8
+#define TRACE_HEADER_LENGTH 19
+#define TRACE_NULL 0xFFFFFFFF
+
+/**
+ * The flags recorded with `enumValue()` and `getValue()` calls for the output pointers the caller
+ * passed.
+ */
+#define TRACE_WANTS_TYPE 1
+#define TRACE_WANTS_DATA 2
+#define TRACE_WANTS_SIZE 4
+
+enum TraceOp : uint8_t {
+	// u32 tx
+	TraceBeginTransaction = 1,
+	TraceCommitTransaction,
+	TraceRollbackTransaction,
+	// u32 key
+	TraceCloseKey,
+	// u32 parent, str subkey, u32 sam, u32 tx, u32 result
+	TraceCreateKey,
+	TraceOpenKey,
+	// u32 parent, str subkey, u32 tx
+	TraceDeleteKey,
+	// u32 key, str name
+	TraceDeleteValue,
+	// u32 key, u32 index, u32 name size, str name
+	TraceEnumKey,
+	// u32 key, u32 index, u8 wants, u32 name size, u32 data size, str name, u32 type, u32 data size, data
+	TraceEnumValue,
+	// u32 key, str subkey, str name, u32 flags, u8 wants, u32 data size, u32 type, u32 data size, data
+	TraceGetValue,
+	// u32 key, u8 subtree, u32 filter, u32 event
+	TraceNotifyChangeKeyValue,
+	// u32 key, u32 subkeys, u32 max subkey length, u32 values, u32 max value name length,
+	// u32 max value length, u64 last write time
+	TraceQueryInfoKey,
+	// u32 key, str name, u32 type, data
+	TraceSetValue,
+	// u32 event
+	TraceSignal
+};
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "view.h"
+
+using namespace winreglib;
+
+/**
+ * Finds the node for a path, optionally creating it and the nodes leading to it.
+ */
+ViewNode* View::find(const std::wstring& path, bool create) {
+	ViewNode* node = &root;
+	std::wstring::size_type start = 0;
+	while (node && start < path.length()) {
+		std::wstring::size_type end = path.find(L'\\', start);
+		if (end == std::wstring::npos) {
+			end = path.length();
+		}
+		if (end > start) {
+			std::wstring name = path.substr(start, end - start);
+			auto it = node->children.find(name);
+			if (it != node->children.end()) {
+				node = it->second.get();
+			} else if (create) {
+				node = node->children.emplace(name, std::unique_ptr<ViewNode>(new ViewNode())).first->second.get();
+			} else {
+				node = NULL;
+			}
+		}
+		start = end + 1;
+	}
+	return node;
+}
+
+std::wstring View::fullPath(const std::wstring& path) {
+	if (path.empty()) {
+		return subkey;
+	}
+	return subkey.empty() ? path : subkey + L'\\' + path;
+}
+
+/**
+ * Checks if the key at a path exists.
+ */
+LSTATUS View::exists(const std::wstring& path, bool& result) {
+	ViewNode* node = find(path, true);
+	if (node->state == ViewKeyUnknown) {
+		++faults;
+		HKEY hkey;
+		LSTATUS status = backend->openKey(hroot, fullPath(path).c_str(), KEY_QUERY_VALUE, NULL, &hkey);
+		if (status == ERROR_SUCCESS) {
+			backend->closeKey(hkey);
+			node->state = ViewKeyExists;
+		} else if (status == ERROR_FILE_NOT_FOUND) {
+			node->state = ViewKeyMissing;
+		} else {
+			return status;
+		}
+	} else {
+		++hits;
+	}
+	result = node->state == ViewKeyExists;
+	return ERROR_SUCCESS;
+}
+
+/**
+ * Gets the node for a path with its subkey and value names, or `NULL` if the key doesn't exist.
+ */
+LSTATUS View::list(const std::wstring& path, const ViewNode*& result) {
+	ViewNode* node = find(path, true);
+	result = NULL;
+	if ((node->listed && node->state == ViewKeyExists) || node->state == ViewKeyMissing) {
+		++hits;
+		result = node->state == ViewKeyMissing ? NULL : node;
+		return ERROR_SUCCESS;
+	}
+
+	++faults;
+	HKEY hkey;
+	LSTATUS status = backend->openKey(hroot, fullPath(path).c_str(), KEY_READ, NULL, &hkey);
+	if (status == ERROR_FILE_NOT_FOUND) {
+		node->state = ViewKeyMissing;
+		return ERROR_SUCCESS;
+	}
+	if (status != ERROR_SUCCESS) {
+		return status;
+	}
+
+	DWORD numSubkeys = 0;
+	DWORD maxSubkeyLength = 0;
+	DWORD numValues = 0;
+	DWORD maxValueLength = 0;
+	status = backend->queryInfoKey(hkey, &numSubkeys, &maxSubkeyLength, &numValues, &maxValueLength, NULL, NULL);
+
+	std::vector<wchar_t> buffer((maxSubkeyLength > maxValueLength ? maxSubkeyLength : maxValueLength) + 1);
+	node->subkeys.clear();
+	node->values.clear();
+	for (int pass = 0; pass < 2 && status == ERROR_SUCCESS; ++pass) {
+		DWORD count = pass ? numValues : numSubkeys;
+		std::vector<std::wstring>& names = pass ? node->values : node->subkeys;
+		for (DWORD i = 0; i < count; ++i) {
+			DWORD size = (DWORD)buffer.size();
+			status = pass
+				? backend->enumValue(hkey, i, buffer.data(), &size, NULL, NULL, NULL)
+				: backend->enumKey(hkey, i, buffer.data(), &size);
+			if (status != ERROR_SUCCESS) {
+				// the key was modified since it was queried
+				if (status == ERROR_NO_MORE_ITEMS) {
+					status = ERROR_SUCCESS;
+				}
+				break;
+			}
+			names.emplace_back(buffer.data(), size);
+		}
+	}
+	backend->closeKey(hkey);
+
+	if (status == ERROR_SUCCESS) {
+		node->state = ViewKeyExists;
+		node->listed = true;
+		result = node;
+	}
+	return status;
+}
+
+/**
+ * Gets a value, reading it from the registry the first time. Missing keys and values are cached
+ * as misses.
+ */
+LSTATUS View::value(const std::wstring& path, const std::wstring& name, const ViewValue*& result) {
+	ViewNode* node = find(path, true);
+	auto it = node->cache.find(name);
+	if (it != node->cache.end()) {
+		++hits;
+		result = &it->second;
+		return ERROR_SUCCESS;
+	}
+
+	++faults;
+	ViewValue value = { false, REG_NONE, {} };
+	if (node->state != ViewKeyMissing) {
+		std::wstring key = fullPath(path);
+		DWORD size = 0;
+		LSTATUS status = backend->getValue(hroot, key.c_str(), name.c_str(), RRF_RT_ANY, &value.type, NULL, &size);
+		if (status == ERROR_SUCCESS) {
+			value.data.resize(size);
+			status = backend->getValue(hroot, key.c_str(), name.c_str(), RRF_RT_ANY, NULL, value.data.data(), &size);
+			value.data.resize(size);
+		}
+		if (status == ERROR_SUCCESS) {
+			value.exists = true;
+		} else if (status != ERROR_FILE_NOT_FOUND) {
+			return status;
+		}
+	}
+
+	result = &node->cache.emplace(name, std::move(value)).first->second;
+	return ERROR_SUCCESS;
+}
+
+/**
+ * Drops the cached names and values of a key after it changed. Its subkeys may have been added or
+ * removed, so whether each one exists is checked again, but their own values are kept since they
+ * are invalidated separately. When `subtree` is true, such as when the key was added or deleted,
+ * everything under the key is dropped as well.
+ */
+void View::invalidate(const std::wstring& path, bool subtree) {
+	ViewNode* node = find(path, false);
+	if (!node) {
+		return;
+	}
+
+	node->listed = false;
+	node->subkeys.clear();
+	node->values.clear();
+	node->cache.clear();
+
+	if (subtree) {
+		node->state = ViewKeyUnknown;
+		node->children.clear();
+	} else {
+		for (auto& it : node->children) {
+			// misses cached while a subkey didn't exist are wrong once it has been added
+			ViewNode* child = it.second.get();
+			if (child->state == ViewKeyMissing) {
+				child->cache.clear();
+				child->children.clear();
+			}
+			child->state = ViewKeyUnknown;
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef __VIEW__
+#define __VIEW__
+
+#include "backend.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * A value read by a view, or a cached miss when `exists` is false.
+ */
+struct ViewValue {
+	bool exists;
+	DWORD type;
+	std::vector<BYTE> data;
+};
+
+enum ViewKeyState { ViewKeyUnknown, ViewKeyExists, ViewKeyMissing };
+
+/**
+ * A key in a view's cache. Nodes are only created for keys that have been accessed, and each
+ * part of a node is only filled in when it is first used: whether the key exists, its names, and
+ * each value.
+ */
+struct ViewNode {
+	ViewNode() : state(ViewKeyUnknown), listed(false) {}
+
+	ViewKeyState state;
+	bool listed;
+	std::vector<std::wstring> subkeys;
+	std::vector<std::wstring> values;
+	std::map<std::wstring, ViewValue, NameLess> cache;
+	std::map<std::wstring, std::unique_ptr<ViewNode>, NameLess> children;
+};
+
+/**
+ * A lazily read, cached view of a subtree. Paths are relative to the view's key, with an empty
+ * path for the key itself. Nothing is read from the registry until it is asked for, and then only
+ * once until the key is invalidated, which happens when a watched key changes.
+ *
+ * A view is not thread safe and is only used on the main thread.
+ */
+class View {
+public:
+	View(Backend* backend, HKEY hroot, const std::wstring& subkey) :
+		faults(0), hits(0), backend(backend), hroot(hroot), subkey(subkey) {}
+
+	LSTATUS exists(const std::wstring& path, bool& result);
+	LSTATUS list(const std::wstring& path, const ViewNode*& result);
+	LSTATUS value(const std::wstring& path, const std::wstring& name, const ViewValue*& result);
+	void invalidate(const std::wstring& path, bool subtree);
+
+	/**
+	 * The number of lookups that were read from the registry and that were answered from the
+	 * cache.
+	 */
+	uint64_t faults;
+	uint64_t hits;
+
+private:
+	ViewNode* find(const std::wstring& path, bool create);
+	std::wstring fullPath(const std::wstring& path);
+
+	Backend* backend;
+	HKEY hroot;
+	std::wstring subkey;
+	ViewNode root;
+};
+
+}
+
+#endif
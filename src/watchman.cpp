@@ -1,38 +1,33 @@
 #include "watchman.h"
+#include "journal.h"
+#include "monitor.h"
+#include "timeline.h"
+#include <algorithm>
 #include <list>
 #include <node_api.h>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace winreglib;
 
-static void execute(napi_env env, void* data) {
-	((Watchman*)data)->run();
-}
-
-static void complete(napi_env env, napi_status status, void* data) {
-	if (status != napi_ok) {
-		const napi_extended_error_info* error;
-		::napi_get_last_error_info(env, &error);
-		LOG_DEBUG_2("Watchman::complete", L"Watchman::complete: Worker thread failed (status=%d) %hs", status, error->error_message)
-	} else {
-		LOG_DEBUG_1("Watchman::complete", L"Worker thread exited (status=%d)", status)
-	}
-	((Watchman*)data)->stopWorker();
-}
-
 /**
- * Creates the default signal events, initializes the subkeys in the watcher tree, initializes the
- * background thread, and wires up the notification callback when a registry change occurs.
+ * Initializes the subkeys in the watcher tree and wires up the notification callback when a
+ * registry change occurs.
  */
-Watchman::Watchman(napi_env env) : env(env), asyncWork(NULL) {
-	// create the built-in events for controlling the background thread
-	term = ::CreateEvent(NULL, FALSE, FALSE, NULL);
-	refresh = ::CreateEvent(NULL, FALSE, FALSE, NULL);
-
-	// initialize the root subkeys
-	root = std::make_shared<WatchNode>(env);
+Watchman::Watchman(napi_env env, Instance* instance) :
+	instance(instance),
+	env(env),
+	activeChanged(false),
+	monitored(false),
+	dispatching(false),
+	pendingGeneration(0)
+{
+	// initialize the root subkeys, the root of the pattern trie names them
+	tree.root->patterns.push_back(&patterns.root);
+	tree.root->bound = true;
 	for (auto const& it : rootKeys) {
-		root->addSubkey(it.first, it.second);
+		tree.add(tree.root, it.first, it.second)->bound = true;
 	}
 
 	// wire up our dispatch change handler into Node's event loop, then unref it so that we don't
@@ -49,25 +44,124 @@ Watchman::Watchman(napi_env env) : env(env), asyncWork(NULL) {
 		}
 	});
 	::uv_unref((uv_handle_t*)notifyChange);
+
+	// polls keys that can't be notified, it doesn't keep Node alive either
+	pollTimer = new uv_timer_t;
+	pollTimer->data = (void*)this;
+	::uv_timer_init(loop, pollTimer);
+	::uv_unref((uv_handle_t*)pollTimer);
 }
 
 /**
- * Stops the background thread and closes all handles.
+ * Stops waiting on this environment's nodes, closes the notify handle, and closes every node's
+ * handles.
  */
 Watchman::~Watchman() {
-	stopWorker();
-	::CloseHandle(term);
-	::CloseHandle(refresh);
+	Monitor::get().remove(this);
 
 	::uv_close(reinterpret_cast<uv_handle_t*>(notifyChange), [](uv_handle_t* handle) {
 		uv_async_t* async = reinterpret_cast<uv_async_t*>(handle);
 		delete async;
 	});
+	::uv_close(reinterpret_cast<uv_handle_t*>(pollTimer), [](uv_handle_t* handle) {
+		delete reinterpret_cast<uv_timer_t*>(handle);
+	});
+
+	tree.forEach([this](WatchNode& node) {
+		for (auto const& ref : node.listeners) {
+			::napi_delete_reference(env, ref);
+		}
+		node.listeners.clear();
+		// the root keys are predefined handles
+		if (node.parent == tree.root) {
+			node.hkey = NULL;
+		}
+		tree.free(&node);
+	});
+
+	patterns.forEach([this](PatternNode& pattern) {
+		for (auto const& ref : pattern.listeners) {
+			::napi_delete_reference(env, ref);
+		}
+		pattern.listeners.clear();
+	});
+}
+
+/**
+ * Adds a JS listener function to a node or a pattern.
+ */
+void Watchman::addListener(std::vector<napi_ref>& listeners, napi_value listener) {
+	napi_ref ref;
+	if (::napi_create_reference(env, listener, 1, &ref) != napi_ok) {
+		napi_throw_error(env, NULL, "Watchman::addListener: napi_create_reference failed");
+		return;
+	}
+	listeners.push_back(ref);
+}
+
+/**
+ * Adds a node for a subkey to the tree and matches it against the watched patterns.
+ */
+WatchNode* Watchman::addNode(WatchNode* parent, const std::wstring& name) {
+	WatchNode* node = tree.add(parent, name);
+	match(node);
+	return node;
+}
+
+/**
+ * Starts or stops waiting on the nodes whose keys were opened or closed while processing a
+ * change, or polling them if they can't be notified. The events of closed nodes are released by
+ * the next `update()`.
+ */
+void Watchman::apply(WatchChanges& changes) {
+	// keys opened under a pattern may open more keys, which are matched in turn
+	while (!changes.expanded.empty()) {
+		WatchNode* node = changes.expanded.back();
+		changes.expanded.pop_back();
+		// skip nodes an earlier expansion removed
+		if (tree.contains(node)) {
+			expand(node, changes);
+		}
+	}
+
+	if (changes.touched.empty()) {
+		return;
+	}
+
+	uint64_t now = Poller::now();
+	for (WatchNode* node : changes.touched) {
+		bool open = node->isOpen() && node->hevent && !node->polled;
+		setActive(node, open);
+		if (node->isOpen() && node->polled) {
+			poller.add(WatchRef{ node->index, node->generation }, node->hkey, now);
+		} else {
+			poller.remove(WatchRef{ node->index, node->generation });
+		}
+		if (!node->isOpen() && node->hevent) {
+			released.push_back(node);
+		}
+	}
+	changes.touched.clear();
+	schedulePoll();
+}
+
+/**
+ * Copies the event handles of the active nodes for the monitor thread to wait on.
+ */
+void Watchman::collect(std::vector<HANDLE>& handles, std::vector<std::pair<Watchman*, WatchRef>>& nodes) {
+	std::lock_guard<std::mutex> lock(activeLock);
+	for (auto const& it : active) {
+		handles.push_back(it.first);
+		nodes.push_back(std::make_pair(this, it.second));
+	}
 }
 
 /**
- * Constructs the watcher tree and adds the listener callback to the watched node. Starts the
- * background thread that waits for win32 to signal an event.
+ * Constructs the watcher tree and adds the listener callback to the watched node. Registers with
+ * the monitor thread that waits for win32 to signal an event.
+ *
+ * The nodes for missing keys are added to the tree, but only the first one is opened. The rest are
+ * opened as their parent keys appear.
  */
 void Watchman::config(const std::wstring& key, napi_value listener, WatchAction action) {
 	if (action == Watch) {
@@ -76,86 +170,166 @@ void Watchman::config(const std::wstring& key, napi_value listener, WatchAction
 		LOG_DEBUG_1("Watchman::config", L"Removing \"%ls\"", key.c_str())
 	}
 
-	std::shared_ptr<WatchNode> node(root);
+	WatchNode* node = tree.root;
+	WatchNode* added = NULL;
+	WatchChanges changes;
 	std::wstring name;
 	std::wstringstream wss(key);
-	DWORD beforeCount = 0;
-	DWORD afterCount = 0;
-
-	{
-		std::lock_guard<std::mutex> lock(activeLock);
-		afterCount = beforeCount = active.size();
-	}
 
 	// parse the key while walking the watcher tree
 	while (std::getline(wss, name, L'\\')) {
-		auto it = node->subkeys.find(name);
-		if (it == node->subkeys.end()) {
+		WatchNode* child = tree.find(node, name);
+		if (!child) {
 			// not found
 			if (action == Watch) {
 				// we're watching, so add the node
-				node = node->addSubkey(name, node);
-				++afterCount;
-				std::lock_guard<std::mutex> lock(activeLock);
-				active.push_back(std::weak_ptr<WatchNode>(node));
+				child = addNode(node, name);
+				if (!added) {
+					added = child;
+				}
 			} else {
 				// node does not exist, nothing to remove
 				LOG_DEBUG_1("Watchman::config", L"Node \"%ls\" does not exist", name.c_str())
 				return;
 			}
-		} else {
-			node = it->second;
 		}
+		node = child;
 	}
 
 	if (action == Watch) {
 		// add the listener to the node
-		node->addListener(listener);
+		addListener(node->listeners, listener);
+
+		// the journal diffs the values of the key's first event against what they are now
+		if (instance->journal) {
+			instance->journal->baseline(node->key);
+		}
+
+		// the key was only watched for subkeys coming and going, now value changes matter too
+		if (node->isOpen() && node->listeners.size() == 1 && !node->patternListeners) {
+			node->watch(changes);
+		}
+
+		// open the new nodes as far down as the keys exist
+		if (added) {
+			added->load(changes);
+		}
 	} else {
 		// remove the listener from the node
-		node->removeListener(listener);
+		removeListener(node->listeners, listener);
 
 		// prune the tree by blowing away an
-		while (node->parent && node->listeners.size() == 0 && node->subkeys.size() == 0) {
-			LOG_DEBUG_1("Watchman::config", L"Erasing node \"%ls\" from parent", node->name.c_str())
+		while (prunable(node)) {
+			WatchNode* parent = node->parent;
+			retire(node);
 
-			// remove from the active list
-			std::lock_guard<std::mutex> lock(activeLock);
-			for (auto it = active.begin(); it != active.end(); ) {
-				auto activeNode = (*it).lock();
-				if (activeNode && activeNode != node) {
-					++it;
-				} else {
-					it = active.erase(it);
-					--afterCount;
+			node = parent;
+			LOG_DEBUG_2("Watchman::config", L"Parent \"%ls\" %ls subkeys", node->name(), node->firstChild ? L"still has" : L"has no")
+		}
+	}
+
+	// events aren't emitted for keys that already exist when they are watched
+	apply(changes);
+	update();
+
+	printTree();
+}
+
+/**
+ * Adds or removes a listener for many keys in one pass over the watcher tree, then refreshes the
+ * monitor once. The nodes a watch adds aren't loaded here. Instead, the keys to open are appended
+ * to `opens` so that `openMany()` opens them off the main thread before `loadMany()` loads them.
+ *
+ * A key whose parent is open is opened from its root key, since the parent's handle may be closed
+ * while the batch is being opened. The subkeys of a key added by the same batch are opened from
+ * its handle.
+ */
+void Watchman::configMany(const std::vector<std::wstring>& keys, napi_value listener, WatchAction action, std::vector<WatchOpen>& opens) {
+	TimelineSpan span("watch", "Watchman::configMany");
+	if (action == Watch) {
+		LOG_DEBUG_1("Watchman::configMany", L"Adding %ld keys", (uint32_t)keys.size())
+	} else {
+		LOG_DEBUG_1("Watchman::configMany", L"Removing %ld keys", (uint32_t)keys.size())
+	}
+
+	WatchChanges changes;
+	std::unordered_map<WatchNode*, int32_t> entries;
+	std::unordered_set<WatchNode*> seen;
+
+	for (auto const& key : keys) {
+		WatchNode* node = tree.root;
+		WatchNode* rootKey = NULL;
+		std::wstring name;
+		std::wstringstream wss(key);
+
+		// parse the key while walking the watcher tree
+		while (node && std::getline(wss, name, L'\\')) {
+			WatchNode* child = tree.find(node, name);
+			if (!child && action == Watch) {
+				child = addNode(node, name);
+				auto it = entries.find(node);
+				if (it != entries.end()) {
+					entries[child] = (int32_t)opens.size();
+					opens.push_back(WatchOpen{ WatchRef{ child->index, child->generation }, it->second, NULL, child->name(), NULL, ERROR_SUCCESS });
+				} else if (node->isOpen()) {
+					entries[child] = (int32_t)opens.size();
+					opens.push_back(WatchOpen{ WatchRef{ child->index, child->generation }, -1, rootKey->hkey, child->key.substr(rootKey->key.length() + 1), NULL, ERROR_SUCCESS });
 				}
 			}
+			if (node == tree.root) {
+				rootKey = child;
+			}
+			node = child;
+		}
 
-			// remove the node from its parent's subkeys map
-			node->parent->subkeys.erase(node->name);
+		if (!node) {
+			// node does not exist, nothing to remove
+			continue;
+		}
+
+		if (action == Watch) {
+			// a key listed twice is only listened to once
+			if (!seen.insert(node).second) {
+				continue;
+			}
 
-			node = node->parent;
-			LOG_DEBUG_2("Watchman::config", L"Parent \"%ls\" now has %ld subkeys", node->name.c_str(), (uint32_t)node->subkeys.size())
+			addListener(node->listeners, listener);
+
+			// the journal diffs the values of the key's first event against what they are now
+			if (instance->journal) {
+				instance->journal->baseline(node->key);
+			}
+
+			// the key was only watched for subkeys coming and going, now value changes matter too
+			if (node->isOpen() && node->listeners.size() == 1 && !node->patternListeners) {
+				node->watch(changes);
+			}
+		} else {
+			removeListener(node->listeners, listener);
+
+			while (prunable(node)) {
+				WatchNode* parent = node->parent;
+				retire(node);
+				node = parent;
+			}
 		}
 	}
 
-	// if we have any active listeners and the number of listeners changed,
-	// then signal the refresh
-	if (afterCount > 0 && beforeCount != afterCount) {
-		LOG_DEBUG_THREAD_ID("Watchman::config", L"Signaling refresh event")
-		::SetEvent(refresh);
-	}
+	apply(changes);
+	update();
 
-	if (beforeCount == 0 && afterCount > 0) {
-		startWorker();
-	} else if (beforeCount > 0 && afterCount == 0) {
-		stopWorker();
-	} else if (beforeCount != afterCount) {
-		LOG_DEBUG_THREAD_ID("Watchman::config", L"Signalling refresh event")
-		::SetEvent(refresh);
+	if (action == Unwatch) {
+		printTree();
 	}
+}
 
-	printTree();
+/**
+ * Sets how many changed keys are queued for the main thread and what happens to the keys that
+ * change while the queue is full.
+ */
+void Watchman::configQueue(size_t capacity, WatchOverflow policy) {
+	LOG_DEBUG_2("Watchman::configQueue", L"capacity=%ld policy=%d", (uint32_t)capacity, (int)policy)
+	changed.configure(capacity, policy);
 }
 
 /**
@@ -164,176 +338,697 @@ void Watchman::config(const std::wstring& key, napi_value listener, WatchAction
  */
 void Watchman::dispatch() {
 	LOG_DEBUG_THREAD_ID("Watchman::dispatch", L"Dispatching changes")
+	TimelineSpan span("watch", "Watchman::dispatch");
 
-	while (1) {
-		std::shared_ptr<WatchNode> node;
-		DWORD remaining = 0;
+	// listeners may stop watching, nodes removed from the tree are kept until we're done
+	dispatching = true;
 
-		// check if there are any changed nodes left...
-		// the first time we loop, we know there's at least one
-		{
-			std::lock_guard<std::mutex> lock(changedNodesLock);
+	std::vector<ChangedNode> aside;
+	std::vector<WatchNode*> resyncs;
 
-			if (changedNodes.empty()) {
-				return;
+	while (1) {
+		ChangedNode entry;
+		size_t remaining = 0;
+
+		// check if there are any changed nodes left, then for the nodes set aside while the queue
+		// was full
+		if (!changed.pop(entry, remaining)) {
+			if (aside.empty()) {
+				changed.takeAside(aside);
+				if (aside.empty()) {
+					break;
+				}
 			}
+			entry = aside.back();
+			aside.pop_back();
+			remaining = aside.size() + 1;
+		}
 
-			remaining = changedNodes.size();
-			node = changedNodes.front();
-			changedNodes.pop_front();
+		WatchNode* node = tree.get(entry.ref);
+		if (!node) {
+			LOG_DEBUG_1("Watchman::dispatch", L"Skipping removed node (%d remaining)", (uint32_t)--remaining)
+			continue;
+		}
+
+		LOG_DEBUG_2("Watchman::dispatch", L"Dispatching change event for \"%ls\" (%d remaining)", node->name(), (uint32_t)--remaining)
+		TimelineSpan nodeSpan("watch", "WatchNode::onChange", node->key, entry.flow);
+		WatchChanges changes;
+		bool muted = isMuted(node->key, entry.seen);
+		bool loaded = node->onChange(changes);
+		apply(changes);
+
+		if (muted || entry.quiet) {
+			// the node is still dispatched so that it is notified again
+			LOG_DEBUG_2("Watchman::dispatch", L"Suppressing %ld callbacks for \"%ls\"", (uint32_t)changes.callbacks.size(), node->name())
+		} else {
+			record(changes.callbacks);
+			emit(changes.callbacks, entry.flow);
+		}
+		// a quiet batch only mutes its own writes, not the events dropped with them
+		if (entry.resync) {
+			resyncs.push_back(node);
 		}
 
-		LOG_DEBUG_2("Watchman::dispatch", L"Dispatching change event for \"%ls\" (%d remaining)", node->name.c_str(), --remaining)
-		if (node->onChange()) {
+		if (loaded) {
 			printTree();
 		}
 	}
+
+	if (!resyncs.empty()) {
+		resync(resyncs);
+	}
+
+	dispatching = false;
+
+	// everything dispatched is written to the journal at once
+	if (instance->journal) {
+		instance->journal->commit();
+	}
+
+	// keys may have been created or deleted
+	update();
+}
+
+/**
+ * Calls the listeners of a single callback, or only the given ones of them. Errors are thrown as
+ * JavaScript exceptions.
+ */
+void Watchman::emit(const Callback& cb, uint64_t flow, const std::vector<napi_ref>* only) {
+	WatchNode* node = cb.node;
+	napi_value global, type, key, argv[2], listener, rval;
+
+	NAPI_THROW("Watchman::emit", "ERR_NAPI_GET_GLOBAL", ::napi_get_global(env, &global))
+	NAPI_THROW("Watchman::emit", "ERR_NAPI_CREATE_STRING", ::napi_create_string_utf8(env, "change", NAPI_AUTO_LENGTH, &argv[0]))
+	NAPI_THROW("Watchman::emit", "ERR_NAPI_CREATE_OBJECT", ::napi_create_object(env, &argv[1]))
+	NAPI_THROW("Watchman::emit", "ERR_NAPI_CREATE_STRING", ::napi_create_string_utf8(env, cb.type, NAPI_AUTO_LENGTH, &type))
+	NAPI_THROW("Watchman::emit", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, node->key.c_str(), node->key.length(), &key))
+	NAPI_THROW("Watchman::emit", "ERR_NAPI_SET_NAMED_PROPERTY", ::napi_set_named_property(env, argv[1], "type", type))
+	NAPI_THROW("Watchman::emit", "ERR_NAPI_SET_NAMED_PROPERTY", ::napi_set_named_property(env, argv[1], "key", key))
+	if (cb.seq) {
+		napi_value seq;
+		NAPI_THROW("Watchman::emit", "ERR_NAPI_CREATE_DOUBLE", ::napi_create_double(env, (double)cb.seq, &seq))
+		NAPI_THROW("Watchman::emit", "ERR_NAPI_SET_NAMED_PROPERTY", ::napi_set_named_property(env, argv[1], "seq", seq))
+	}
+
+	// a listener may stop watching, which deletes its reference
+	std::vector<napi_ref> listeners;
+	if (only) {
+		listeners = *only;
+	} else {
+		listeners = node->listeners;
+		for (PatternNode* pattern : node->patterns) {
+			listeners.insert(listeners.end(), pattern->listeners.begin(), pattern->listeners.end());
+		}
+	}
+
+	LOG_DEBUG_1("Watchman::emit", L"Calling %ld listeners", (uint32_t)listeners.size())
+	for (auto const& ref : listeners) {
+		if (!node->hasListener(ref)) {
+			continue;
+		}
+		NAPI_THROW("Watchman::emit", "ERR_NAPI_GET_REFERENCE_VALUE", ::napi_get_reference_value(env, ref, &listener))
+		if (listener != NULL) {
+			TimelineSpan span("watch", "listener", node->key, flow);
+			NAPI_THROW("Watchman::emit", "ERR_NAPI_MAKE_CALLBACK", ::napi_make_callback(env, NULL, global, listener, 2, argv, &rval))
+		}
+	}
+}
+
+/**
+ * Fires the callbacks for each change that was discovered.
+ */
+void Watchman::emit(std::queue<Callback>& callbacks, uint64_t flow) {
+	napi_handle_scope scope;
+	NAPI_THROW("Watchman::emit", "ERR_NAPI_OPEN_HANDLE_SCOPE", ::napi_open_handle_scope(env, &scope))
+
+	LOG_DEBUG_1("Watchman::emit", L"Calling %ld callbacks", (uint32_t)callbacks.size())
+
+	// the scope must be closed even if a callback fails, for example when a worker is being
+	// terminated
+	bool failed = false;
+	while (!callbacks.empty() && !failed) {
+		emit(callbacks.front(), flow);
+		callbacks.pop();
+		::napi_is_exception_pending(env, &failed);
+	}
+
+	::napi_close_handle_scope(env, scope);
+}
+
+/**
+ * Matches the subkeys of a node against the patterns its key matches. Subkeys a pattern names are
+ * added whether they exist or not, like the parents of a watched key. Subkeys a wildcard matches
+ * are found by listing the key and added if they aren't in the tree yet, so a subkey that comes or
+ * goes only costs listing its parent. Subkeys that were deleted are removed unless a pattern names
+ * them.
+ */
+void Watchman::expand(WatchNode* node, WatchChanges& changes) {
+	TimelineSpan span("watch", "Watchman::expand", node->key);
+	std::vector<WatchNode*> added;
+	bool wild = false;
+
+	for (PatternNode* pattern : node->patterns) {
+		wild = wild || pattern->recursive || pattern->star;
+		if (node->bound || node->isOpen()) {
+			for (auto const& it : pattern->literals) {
+				if (!tree.find(node, it.first)) {
+					added.push_back(addNode(node, it.first));
+				}
+			}
+		}
+	}
+
+	if (wild && node->isOpen()) {
+		// the node's own handle may only be allowed to be notified, so the subkeys are listed
+		// through another one
+		HKEY hkey = node->hkey;
+		if (node->parent != tree.root && backend->openKey(node->parent->hkey, node->name(), KEY_ENUMERATE_SUB_KEYS, NULL, &hkey) != ERROR_SUCCESS) {
+			hkey = NULL;
+		}
+
+		DWORD numSubkeys = 0;
+		DWORD maxSubkeyLength = 0;
+		if (hkey && backend->queryInfoKey(hkey, &numSubkeys, &maxSubkeyLength, NULL, NULL, NULL, NULL) == ERROR_SUCCESS && numSubkeys > 0) {
+			std::vector<wchar_t> buffer(maxSubkeyLength + 1);
+			std::vector<PatternNode*> held;
+			for (DWORD i = 0; ; ++i) {
+				DWORD size = (DWORD)buffer.size();
+				// a subkey added while listing is picked up by the change it causes
+				if (backend->enumKey(hkey, i, buffer.data(), &size) != ERROR_SUCCESS) {
+					break;
+				}
+				std::wstring name(buffer.data(), size);
+				held.clear();
+				PatternTrie::match(node->patterns, name, held);
+				if (!held.empty() && !tree.find(node, name)) {
+					added.push_back(addNode(node, name));
+				}
+			}
+		}
+
+		if (hkey && hkey != node->hkey) {
+			backend->closeKey(hkey);
+		}
+	}
+
+	if (!added.empty()) {
+		LOG_DEBUG_2("Watchman::expand", L"Matched %ld subkeys of \"%ls\"", (uint32_t)added.size(), node->name())
+	}
+	for (WatchNode* child : added) {
+		child->load(changes);
+	}
+
+	for (WatchNode* child = node->firstChild; child; ) {
+		WatchNode* next = child->nextSibling;
+		if (!child->isOpen()) {
+			prune(child);
+		}
+		child = next;
+	}
+}
+
+/**
+ * Checks if a key's notification is the first one seen since a quiet write to the key, in which
+ * case it is the write's own and the mute is used up. A notification seen before the write
+ * leaves the mute for the write's notification.
+ */
+bool Watchman::isMuted(const std::wstring& key, std::chrono::steady_clock::time_point seen) {
+	auto it = muted.find(key);
+	if (it == muted.end() || seen < it->second) {
+		return false;
+	}
+	muted.erase(it);
+	LOG_DEBUG_1("Watchman::isMuted", L"Suppressing change event for \"%ls\"", key.c_str())
+	return true;
+}
+
+/**
+ * Loads the keys of a `watchMany()` batch after `openMany()` opened them, or opens them here if they
+ * weren't opened with the current backend. Nodes that were loaded, unwatched, or whose parent went
+ * away in the meantime are skipped, and the handles opened for them are closed.
+ *
+ * Like watching one key, no events are emitted for the keys that already exist.
+ */
+void Watchman::loadMany(std::vector<WatchOpen>& opens, bool prepared) {
+	TimelineSpan span("watch", "Watchman::loadMany");
+	LOG_DEBUG_1("Watchman::loadMany", L"Loading %ld keys", (uint32_t)opens.size())
+
+	WatchChanges changes;
+	std::vector<WatchNode*> heads;
+	for (auto& open : opens) {
+		WatchNode* node = tree.get(open.ref);
+		if (!node || !tree.contains(node) || node->isOpen()) {
+			continue;
+		}
+		if (open.parent == -1) {
+			heads.push_back(node);
+		}
+		// a key whose parent couldn't be opened wasn't attempted
+		if (prepared && (open.hkey || open.status != ERROR_SUCCESS)) {
+			changes.opened[node] = std::make_pair(open.hkey, open.status);
+			open.hkey = NULL;
+		}
+	}
+
+	// loading a key loads the subkeys the batch added under it
+	for (WatchNode* node : heads) {
+		node->load(changes);
+	}
+
+	for (auto const& it : changes.opened) {
+		if (it.second.first) {
+			backend->closeKey(it.second.first);
+		}
+	}
+	changes.opened.clear();
+
+	// events aren't emitted for keys that already exist when they are watched
+	apply(changes);
+	update();
+
+	printTree();
+}
+
+/**
+ * Suppresses the change event of the first notification seen for each of the given keys since
+ * `start`, when a quiet write began. This is called on the main thread after a quiet write so that
+ * we don't notify ourselves.
+ */
+void Watchman::mute(const std::vector<std::wstring>& keys, std::chrono::steady_clock::time_point start) {
+	for (auto const& key : keys) {
+		// only keys with an open node are notified, any other mute would never be used up
+		WatchNode* node = tree.root;
+		std::wstring name;
+		std::wstringstream wss(key);
+		while (node && std::getline(wss, name, L'\\')) {
+			node = tree.find(node, name);
+		}
+		if (!node || !node->isOpen()) {
+			continue;
+		}
+
+		// a key written again before its notification is seen stays muted since the first write
+		muted.emplace(key, start);
+	}
+}
+
+/**
+ * Finds the patterns a node's key matches from the ones its parent's key matches.
+ */
+void Watchman::match(WatchNode* node) {
+	node->patterns.clear();
+	node->literal = !node->parent->patterns.empty() && PatternTrie::match(node->parent->patterns, node->name(), node->patterns);
+	node->bound = node->parent == tree.root || (node->literal && node->parent->bound);
+	node->patternListeners = false;
+	for (PatternNode* pattern : node->patterns) {
+		if (!pattern->listeners.empty()) {
+			node->patternListeners = true;
+			break;
+		}
+	}
+}
+
+/**
+ * Opens the keys of a `watchMany()` batch. This function is called on a worker thread, so it only
+ * touches the batch, never the watcher tree. A key whose parent couldn't be opened is left as is.
+ */
+void Watchman::openMany(Backend* backend, std::vector<WatchOpen>& opens) {
+	TimelineSpan span("watch", "Watchman::openMany");
+	for (auto& open : opens) {
+		HKEY parent = open.parent == -1 ? open.root : opens[open.parent].hkey;
+		if (parent) {
+			open.status = backend->openKey(parent, open.path.c_str(), KEY_NOTIFY, NULL, &open.hkey);
+			if (open.status != ERROR_SUCCESS) {
+				open.hkey = NULL;
+			}
+		}
+	}
+}
+
+/**
+ * Checks the polled keys that are due and queues the ones that changed to be dispatched like a
+ * notification. Called by the poll timer on the main thread.
+ */
+void Watchman::poll() {
+	TimelineSpan span("watch", "Watchman::poll");
+	uint64_t now = Poller::now();
+	std::vector<WatchRef> due;
+	poller.due(now, due);
+
+	for (auto const& ref : due) {
+		WatchNode* node = tree.get(ref);
+		if (!node || !node->polled || !node->hkey) {
+			poller.remove(ref);
+			continue;
+		}
+		if (poller.check(ref, node->hkey, now)) {
+			LOG_DEBUG_1("Watchman::poll", L"\"%ls\" changed", node->name())
+			signal(ref);
+		}
+	}
+
+	schedulePoll();
 }
 
 /**
- * Prints the watcher tree for debugging.
+ * Prints the watcher tree for debugging. Large trees are summarized, printing them after every
+ * change would cost far more than the change itself.
  */
 void Watchman::printTree() {
+	if (tree.size() > 256) {
+		LOG_DEBUG_1("Watchman::printTree", L"Watching %ld nodes", (uint32_t)tree.size())
+		return;
+	}
+
 	std::wstringstream wss(L"");
 	std::wstring line;
-	root->print(wss);
+	tree.root->print(wss);
 	while (std::getline(wss, line, L'\n')) {
 		WLOG_DEBUG("Watchman::printTree", line)
 	}
 }
 
 /**
- * The background thread that waits for an event (e.g. registry change) to be signaled and notifies
- * the main thread of changed nodes to emit events for.
+ * Removes the nodes of a subtree that are no longer needed, subkeys first.
  */
-void Watchman::run() {
-	LOG_DEBUG_THREAD_ID("Watchman::run", L"Initializing run loop")
+void Watchman::prune(WatchNode* node) {
+	for (WatchNode* child = node->firstChild; child; ) {
+		WatchNode* next = child->nextSibling;
+		prune(child);
+		child = next;
+	}
+	if (prunable(node)) {
+		retire(node);
+	}
+}
 
-	HANDLE* handles = NULL;
-	DWORD count = 0;
-	DWORD idx = 0;
-	std::vector<std::weak_ptr<WatchNode>> activeCopy;
+/**
+ * Returns true if nothing listens to a node and it has no subkeys in the tree, and either no
+ * pattern matches it, or its key doesn't exist and isn't worth waiting for: a pattern doesn't name
+ * it, or its parent doesn't exist and isn't waited for either.
+ */
+bool Watchman::prunable(WatchNode* node) {
+	if (!node->parent || node->parent == tree.root || !node->listeners.empty() || node->firstChild) {
+		return false;
+	}
+	if (node->patterns.empty()) {
+		return true;
+	}
+	if (node->isOpen()) {
+		return false;
+	}
+	return !node->literal || (!node->parent->bound && !node->parent->isOpen());
+}
 
-	// make a copy of all active nodes since we need to preserve the order to know which node
-	// changed based on the handle index
-	{
-		std::lock_guard<std::mutex> lock(activeLock);
-		LOG_DEBUG_1("Watchman::run", L"Populating active copy (count=%ld)", (uint32_t)active.size())
-		activeCopy = active;
+/**
+ * Appends the callbacks to the journal, if one is open, and gives each one its sequence number.
+ * They are appended before any listener runs, so a listener that throws doesn't lose the events
+ * after it.
+ */
+void Watchman::record(std::queue<Callback>& callbacks) {
+	Journal* journal = instance->journal;
+	if (!journal) {
+		return;
 	}
+	for (size_t i = 0, n = callbacks.size(); i < n; ++i) {
+		Callback cb = callbacks.front();
+		callbacks.pop();
+		cb.seq = journal->append(cb.type, cb.node->key);
+		callbacks.push(cb);
+	}
+}
 
-	while (1) {
-		if (handles != NULL) {
-			delete[] handles;
-		}
-
-		// WaitForMultipleObjects() wants an array of handles, so we must construct one
-		idx = 0;
-		count = activeCopy.size() + 2;
-		handles = new HANDLE[count];
-		handles[idx++] = term;
-		handles[idx++] = refresh;
-		for (auto it = activeCopy.begin(); it != activeCopy.end(); ) {
-			if (auto node = (*it).lock()) {
-				handles[idx++] = node->hevent;
-				++it;
-			} else {
-				it = activeCopy.erase(it);
-				--count;
-			}
+/**
+ * Rematches the subkeys of a node after the patterns changed and queues the nodes whose subkeys may
+ * match. A key that was only notified of its subkeys coming and going is rearmed once a pattern
+ * listens to it.
+ */
+void Watchman::refresh(WatchNode* node, WatchChanges& changes) {
+	for (WatchNode* child = node->firstChild; child; child = child->nextSibling) {
+		bool notified = child->hasListeners();
+		match(child);
+		if (!notified && child->hasListeners() && child->isOpen()) {
+			child->watch(changes);
 		}
+		refresh(child, changes);
+	}
+	if (node->expands()) {
+		changes.expanded.push_back(node);
+	}
+}
 
-		LOG_DEBUG_1("Watchman::run", L"Waiting on %ld objects...", count)
-		DWORD result = ::WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+/**
+ * Removes a JS listener function from a node or a pattern. Returns true if it was found.
+ */
+bool Watchman::removeListener(std::vector<napi_ref>& listeners, napi_value listener) {
+	bool found = false;
+	for (auto it = listeners.begin(); it != listeners.end(); ) {
+		napi_value callback;
+		NAPI_THROW_RETURN("Watchman::removeListener", "ERR_NAPI_GET_REFERENCE_VALUE", ::napi_get_reference_value(env, *it, &callback), found)
 
-		if (result == WAIT_OBJECT_0) {
-			// terminate
-			LOG_DEBUG("Watchman::run", L"Received terminate signal")
-			break;
-		}
+		bool same;
+		NAPI_THROW_RETURN("Watchman::removeListener", "ERR_NAPI_STRICT_EQUALS", ::napi_strict_equals(env, callback, listener, &same), found)
 
-		if (result == WAIT_FAILED) {
-			LOG_DEBUG_WIN32_ERROR("Watchman::run", L"WaitForMultipleObjects failed: ", ::GetLastError())
+		if (same) {
+			LOG_DEBUG("Watchman::removeListener", L"Removing listener")
+			::napi_delete_reference(env, *it);
+			it = listeners.erase(it);
+			found = true;
 		} else {
-			idx = result - WAIT_OBJECT_0;
-			if (idx > 0 && idx < count) {
-				if (result == WAIT_OBJECT_0 + 1) {
-					// doing a refresh
-					{
-						std::lock_guard<std::mutex> lock(activeLock);
-						LOG_DEBUG_1("Watchman::run", L"Refreshing %ld handles", (uint32_t)active.size())
-						activeCopy = active;
-					}
-				} else {
-					// something changed
-
-					// first two indices are the term and refresh events, so skip those
-					idx -= 2;
-
-					if (auto node = activeCopy[idx].lock()) {
-						LOG_DEBUG_2("Watchman::run", L"Detected change \"%ls\" [%ld]", node->name.c_str(), idx)
-
-						{
-							std::lock_guard<std::mutex> lock(changedNodesLock);
-							if (std::find(changedNodes.begin(), changedNodes.end(), node) != changedNodes.end()) {
-								LOG_DEBUG_1("Watchman::run", L"Node \"%ls\" is already in the changed list", node->name.c_str())
-							} else {
-								LOG_DEBUG_1("Watchman::run", L"Adding node \"%ls\" to the changed list", node->name.c_str())
-								changedNodes.push_back(node);
-							}
-						}
-
-						::uv_async_send(notifyChange);
-					}
-				}
+			++it;
+		}
+	}
+	LOG_DEBUG_1("Watchman::removeListener", L"%ld listeners left", (uint32_t)listeners.size())
+	return found;
+}
+
+/**
+ * Emits a `resync` event for each node whose events were dropped when the queue overflowed. A
+ * listener isn't told about a node when a node above it is resynced for that listener too, since
+ * re-reading that subtree covers it. The events aren't journaled, just like the events they
+ * replace.
+ */
+void Watchman::resync(const std::vector<WatchNode*>& nodes) {
+	napi_handle_scope scope;
+	NAPI_THROW("Watchman::resync", "ERR_NAPI_OPEN_HANDLE_SCOPE", ::napi_open_handle_scope(env, &scope))
+
+	std::unordered_set<WatchNode*> resynced(nodes.begin(), nodes.end());
+	bool failed = false;
+
+	for (auto it = nodes.begin(); it != nodes.end() && !failed; ++it) {
+		WatchNode* node = *it;
+		if (!tree.contains(node)) {
+			continue;
+		}
+
+		std::vector<napi_ref> listeners(node->listeners);
+		for (PatternNode* pattern : node->patterns) {
+			listeners.insert(listeners.end(), pattern->listeners.begin(), pattern->listeners.end());
+		}
+		for (WatchNode* parent = node->parent; parent && !listeners.empty(); parent = parent->parent) {
+			if (resynced.count(parent) && tree.contains(parent)) {
+				listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [&](napi_ref ref) {
+					return parent->hasListener(ref);
+				}), listeners.end());
 			}
 		}
+
+		if (!listeners.empty()) {
+			LOG_DEBUG_2("Watchman::resync", L"Resyncing \"%ls\" for %ld listeners", node->key.c_str(), (uint32_t)listeners.size())
+			emit(Callback{ "resync", node, 0 }, 0, &listeners);
+			::napi_is_exception_pending(env, &failed);
+		}
 	}
 
-	delete[] handles;
+	::napi_close_handle_scope(env, scope);
+}
+
+/**
+ * Removes a node from the tree, but keeps its handles until the monitor thread has stopped waiting
+ * on its event.
+ */
+void Watchman::retire(WatchNode* node) {
+	LOG_DEBUG_1("Watchman::retire", L"Erasing node \"%ls\" from parent", node->name())
+	tree.unlink(node);
+	setActive(node, false);
+	poller.remove(WatchRef{ node->index, node->generation });
+	muted.erase(node->key);
+	retired.push_back(node);
 }
 
 /**
- * Start the background thread that waits for win32 events.
- * This function is called when adding the first watch listener.
+ * Adds a node to or removes it from the list of nodes the monitor waits on. Nodes know their
+ * position in the list, so both are constant time.
  */
-void Watchman::startWorker() {
-	if (asyncWork != NULL) {
-		LOG_DEBUG_THREAD_ID("Watchman::startWorker", L"Async work already exists!")
+void Watchman::setActive(WatchNode* node, bool enable) {
+	if (enable == (node->activeIndex != NOT_ACTIVE)) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(activeLock);
+	if (enable) {
+		node->activeIndex = (uint32_t)active.size();
+		active.push_back(std::make_pair(node->hevent, WatchRef{ node->index, node->generation }));
 	} else {
-		// initialize the background thread that waits for win32 events
-		LOG_DEBUG_THREAD_ID("Watchman::startWorker", L"Initializing async work")
-		napi_value name;
-		NAPI_THROW("Watchman::startWorker", "ERR_NAPI_CREATE_STRING", ::napi_create_string_utf8(
-			env,
-			"winreglib.runloop",
-			NAPI_AUTO_LENGTH,
-			&name
-		))
-
-		NAPI_THROW("Watchman::startWorker", "ERR_NAPI_CREATE_ASYNC_WORK", ::napi_create_async_work(
-			env,
-			NULL,
-			name,
-			execute,
-			complete,
-			this,
-			&asyncWork
-		))
-
-		LOG_DEBUG_THREAD_ID("Watchman::startWorker", L"Starting background thread")
-		NAPI_THROW("Watchman::startWorker", "ERR_NAPI_QUEUE_ASYNC_WORK", ::napi_queue_async_work(env, asyncWork))
-	}
-}
-
-/**
- * Stops the background thread.
- * This function is called when removing the last watch listener.
- */
-void Watchman::stopWorker() {
-	if (asyncWork != NULL) {
-		LOG_DEBUG_THREAD_ID("Watchman::stopWorker", L"Deleting async work")
-		::napi_delete_async_work(env, asyncWork);
-		asyncWork = NULL;
+		uint32_t i = node->activeIndex;
+		if (i + 1 < active.size()) {
+			active[i] = active.back();
+			tree.at(active[i].second.index).activeIndex = i;
+		}
+		active.pop_back();
+		node->activeIndex = NOT_ACTIVE;
+	}
+	activeChanged = true;
+}
+
+/**
+ * Arms the poll timer for the next tick with keys to check. While the clock is simulated, time only
+ * moves when it is set, so the polls it made due run right away, one batch each time it is set.
+ */
+void Watchman::schedulePoll() {
+	uint64_t now = Poller::now();
+	uint64_t next = poller.next(now);
+	if (!next || Poller::simulated()) {
+		::uv_timer_stop(pollTimer);
+		if (next && next <= now) {
+			poll();
+		}
+		return;
+	}
+
+	::uv_timer_start(pollTimer, [](uv_timer_t* handle) {
+		((Watchman*)handle->data)->poll();
+	}, next > now ? next - now : 0, 0);
+}
+
+/**
+ * Queues a changed node and wakes up the main thread to dispatch it. This function is called on
+ * the monitor thread, or on the main thread for a polled key. A node that is already queued shares
+ * its timeline flow with the pending dispatch. When the queue is full, its overflow policy decides
+ * what happens to the node.
+ */
+void Watchman::signal(const WatchRef& ref) {
+	TimelineSpan span("watch", "Watchman::signal");
+	LOG_DEBUG_1("Watchman::signal", L"Queuing node %ld", ref.index)
+	span.event.flow = changed.push(ref, span.event.start != 0);
+
+	::uv_async_send(notifyChange);
+}
+
+/**
+ * Counts the keys in the watcher tree and their open handles. Nodes that were removed but are
+ * still waited on by the monitor thread are counted until they are freed.
+ */
+WatchStats Watchman::stats() {
+	WatchStats result = { 0, 0, poller.size(), poller.polls, changed.stats() };
+	tree.forEach([&](WatchNode& node) {
+		if (node.parent && node.parent != tree.root) {
+			++result.keys;
+			if (node.hkey) {
+				++result.handles;
+			}
+		}
+	});
+	return result;
+}
+
+/**
+ * Adds or removes a listener for the keys a pattern matches, then rematches the watcher tree. Keys
+ * that already match are watched without emitting events, like a watched key that already exists.
+ */
+void Watchman::subscribe(const std::wstring& key, napi_value listener, WatchAction action) {
+	std::vector<std::wstring> segments;
+	PatternTrie::split(key, segments);
+
+	if (action == Watch) {
+		LOG_DEBUG_1("Watchman::subscribe", L"Adding \"%ls\"", key.c_str())
+		addListener(patterns.add(segments)->listeners, listener);
+	} else {
+		LOG_DEBUG_1("Watchman::subscribe", L"Removing \"%ls\"", key.c_str())
+		PatternNode* pattern = patterns.find(segments);
+		if (!pattern || !removeListener(pattern->listeners, listener)) {
+			return;
+		}
+		patterns.prune(pattern);
+	}
+
+	WatchChanges changes;
+	TimelineSpan span("watch", "Watchman::subscribe", key);
+	refresh(tree.root, changes);
+	apply(changes);
+	if (action == Unwatch) {
+		prune(tree.root);
+	}
+	update();
+
+	printTree();
+}
+
+/**
+ * Called by the monitor thread after it rebuilt its list of handles. Wakes up the main thread if it
+ * is waiting to free nodes the monitor was waiting on.
+ */
+void Watchman::rebuilt(uint64_t generation) {
+	uint64_t pending = pendingGeneration;
+	if (pending && generation >= pending) {
+		::uv_async_send(notifyChange);
+	}
+}
+
+/**
+ * Tells the monitor about changes to the list of nodes to wait on, then releases the events of
+ * nodes whose keys were deleted and frees the nodes removed from the tree once the monitor has
+ * stopped waiting on them.
+ *
+ * The monitor rebuilds its list in the background so that watching or unwatching many keys
+ * doesn't wait for a rebuild per key. Until it catches up, the removed nodes are kept.
+ */
+void Watchman::update() {
+	if (activeChanged) {
+		activeChanged = false;
+
+		size_t count;
+		{
+			std::lock_guard<std::mutex> lock(activeLock);
+			count = active.size();
+		}
+
+		LOG_DEBUG_1("Watchman::update", L"Waiting on %ld nodes", (uint32_t)count)
+
+		if (count > 0 && !monitored) {
+			Monitor::get().add(this);
+			monitored = true;
+		} else if (count == 0 && monitored) {
+			Monitor::get().remove(this);
+			monitored = false;
+		} else if (monitored) {
+			LOG_DEBUG_THREAD_ID("Watchman::update", L"Refreshing monitor")
+			pendingGeneration = Monitor::get().request();
+		}
+	}
+
+	if (released.empty() && retired.empty()) {
+		// no removed node is left that could point at a removed pattern
+		patterns.sweep();
+		return;
+	}
+
+	if (monitored && !Monitor::get().caughtUp(pendingGeneration)) {
+		LOG_DEBUG_2("Watchman::update", L"Keeping %ld released and %ld removed nodes until the monitor catches up", (uint32_t)released.size(), (uint32_t)retired.size())
+		return;
+	}
+
+	for (WatchNode* node : released) {
+		node->release();
+	}
+	released.clear();
+
+	if (!dispatching) {
+		for (WatchNode* node : retired) {
+			tree.free(node);
+		}
+		retired.clear();
+		patterns.sweep();
+		pendingGeneration = 0;
 	}
 }
@@ -2,8 +2,13 @@
 #define __WATCHMAN__
 
 #include "winreglib.h"
+#include "backend.h"
+#include "poller.h"
 #include "watchnode.h"
-#include <deque>
+#include "watchpattern.h"
+#include "watchqueue.h"
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -12,38 +17,104 @@
 
 namespace winreglib {
 
-LOG_DEBUG_EXTERN_VARS
 extern const std::map<std::wstring, HKEY> rootKeys;
 
 enum WatchAction { Watch, Unwatch };
 
 /**
- * Maintains state for the nodes being watched and emits change events.
+ * A key of a `watchMany()` batch to open on a worker thread. It is opened relative to the handle
+ * opened for the entry of its parent, or when `parent` is -1, `path` is opened from the root key
+ * `root`.
+ */
+struct WatchOpen {
+	WatchRef ref;
+	int32_t parent;
+	HKEY root;
+	std::wstring path;
+	HKEY hkey;
+	LSTATUS status;
+};
+
+/**
+ * How many keys are in an environment's watcher tree and how many of them have an open key
+ * handle, not counting the root keys, how many of those are polled, and how many polls ran, along
+ * with the counters of the queue of changed keys.
+ */
+struct WatchStats {
+	size_t keys;
+	size_t handles;
+	size_t polled;
+	uint64_t polls;
+	WatchQueueStats queue;
+};
+
+/**
+ * Maintains state for the nodes being watched in a single environment and emits change events.
+ * The environment's nodes are waited on by the shared `Monitor` thread, except for keys that can't
+ * be notified, which are polled on the main thread.
+ *
+ * Keys watched with `*` or `**` segments are subscribed to the pattern trie. The subkeys they match
+ * are added to the watcher tree as they are found, and removed once they are deleted.
  */
 class Watchman {
 public:
-	Watchman(napi_env env);
+	Watchman(napi_env env, Instance* instance);
 	~Watchman();
 
+	void collect(std::vector<HANDLE>& handles, std::vector<std::pair<Watchman*, WatchRef>>& nodes);
 	void config(const std::wstring& key, napi_value listener, WatchAction action);
-	void run();
-	void startWorker();
-	void stopWorker();
+	void configMany(const std::vector<std::wstring>& keys, napi_value listener, WatchAction action, std::vector<WatchOpen>& opens);
+	void configQueue(size_t capacity, WatchOverflow policy);
+	void loadMany(std::vector<WatchOpen>& opens, bool prepared);
+	void mute(const std::vector<std::wstring>& keys, std::chrono::steady_clock::time_point start);
+	void rebuilt(uint64_t generation);
+	void schedulePoll();
+	void signal(const WatchRef& ref);
+	WatchStats stats();
+	void subscribe(const std::wstring& key, napi_value listener, WatchAction action);
+
+	static void openMany(Backend* backend, std::vector<WatchOpen>& opens);
+
+	Instance* instance;
 
 private:
+	void addListener(std::vector<napi_ref>& listeners, napi_value listener);
+	WatchNode* addNode(WatchNode* parent, const std::wstring& name);
+	void apply(WatchChanges& changes);
 	void dispatch();
+	void emit(const Callback& cb, uint64_t flow, const std::vector<napi_ref>* only = NULL);
+	void emit(std::queue<Callback>& callbacks, uint64_t flow);
+	void expand(WatchNode* node, WatchChanges& changes);
+	bool isMuted(const std::wstring& key, std::chrono::steady_clock::time_point seen);
+	void match(WatchNode* node);
+	void poll();
 	void printTree();
+	void prune(WatchNode* node);
+	bool prunable(WatchNode* node);
+	void record(std::queue<Callback>& callbacks);
+	void refresh(WatchNode* node, WatchChanges& changes);
+	bool removeListener(std::vector<napi_ref>& listeners, napi_value listener);
+	void resync(const std::vector<WatchNode*>& nodes);
+	void retire(WatchNode* node);
+	void setActive(WatchNode* node, bool enable);
+	void update();
 
 	napi_env env;
-	napi_async_work asyncWork;
-	std::shared_ptr<WatchNode> root;
-	HANDLE term;
-	HANDLE refresh;
+	WatchTree tree;
+	PatternTrie patterns;
 	std::mutex activeLock;
-	std::vector<std::weak_ptr<WatchNode>> active;
+	std::vector<std::pair<HANDLE, WatchRef>> active;
+	bool activeChanged;
+	bool monitored;
+	bool dispatching;
+	std::atomic<uint64_t> pendingGeneration;
+	std::vector<WatchNode*> released;
+	std::vector<WatchNode*> retired;
 	uv_async_t* notifyChange;
-	std::deque<std::shared_ptr<WatchNode>> changedNodes;
-	std::mutex changedNodesLock;
+	uv_timer_t* pollTimer;
+	Poller poller;
+	WatchQueue changed;
+	std::map<std::wstring, std::chrono::steady_clock::time_point, NameLess> muted;
 };
 
 }
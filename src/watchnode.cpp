@@ -1,203 +1,165 @@
 #include "watchnode.h"
+#include "backend.h"
+#include "timeline.h"
 #include "winreglib.h"
+#include <algorithm>
+#include <cwchar>
 
 using namespace winreglib;
 
-/**
- * Creates the event handle for when this node registers for change notifications and attempts to
- * load the registry key.
- */
-WatchNode::WatchNode(napi_env env, const std::wstring& name, std::shared_ptr<WatchNode> parent) :
-	env(env),
+WatchNode::WatchNode() :
 	hevent(NULL),
 	hkey(NULL),
-	name(name),
-	parent(parent)
-{
-	hevent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
-	if (hevent == NULL) {
-		LOG_DEBUG_WIN32_ERROR("WatchNode", L"CreateEvent failed: ", ::GetLastError())
-	}
-
-	load(NULL);
-}
-
-/**
- * Shutsdown the node.
- */
-WatchNode::~WatchNode() {
-	LOG_DEBUG_1("WatchNode::~WatchNode", L"Destroying node \"%ls\"", name.c_str())
-	parent.reset();
-	if (hevent) ::CloseHandle(hevent);
-	if (hkey) ::RegCloseKey(hkey);
-	std::lock_guard<std::mutex> lock(listenersLock);
-	for (auto const& ref : listeners) ::napi_delete_reference(env, ref);
-}
+	parent(NULL),
+	firstChild(NULL),
+	nextSibling(NULL),
+	prevSibling(NULL),
+	nameOffset(0),
+	hash(0),
+	index(0),
+	generation(0),
+	activeIndex(NOT_ACTIVE),
+	polled(false),
+	bound(false),
+	literal(false),
+	patternListeners(false)
+{}
 
 /**
- * Adds a JS listener function to the list.
+ * Returns true if the patterns this node's key matches go on to match its subkeys.
  */
-void WatchNode::addListener(napi_value listener) {
-	napi_ref ref;
-	if (::napi_create_reference(env, listener, 1, &ref) == napi_ok) {
-		std::lock_guard<std::mutex> lock(listenersLock);
-		listeners.push_back(ref);
-	} else {
-		napi_throw_error(env, NULL, "WatchNode::addListener: napi_create_reference failed");
+bool WatchNode::expands() const {
+	for (PatternNode* pattern : patterns) {
+		if (pattern->recursive || pattern->star || !pattern->literals.empty()) {
+			return true;
+		}
 	}
+	return false;
 }
 
 /**
- * Adds a subkey by name and the key handle. This is used to wire up the built-in root keys.
- */
-std::shared_ptr<WatchNode> WatchNode::addSubkey(const std::wstring& name, HKEY hkey) {
-	std::shared_ptr<WatchNode> node = std::make_shared<WatchNode>(env, name, hkey);
-	subkeys.insert(std::make_pair(name, node));
-	return node;
-}
-
-/**
- * Adds a subkey by name.
- */
-std::shared_ptr<WatchNode> WatchNode::addSubkey(const std::wstring& name, std::shared_ptr<WatchNode> parent) {
-	// note: parent == this, but we need the shared_ptr
-	std::shared_ptr<WatchNode> node = std::make_shared<WatchNode>(env, name, parent);
-	subkeys.insert(std::make_pair(name, node));
-	return node;
-}
-
-/**
- * Walks parent nodes to construct the full key.
+ * Returns true if a listener is still registered for this node, either for its key or for a
+ * pattern it matches.
  */
-std::u16string WatchNode::getKey() {
-	std::wstring wkey = name;
-	for (auto tmp = parent; tmp; tmp = tmp->parent) {
-		wkey.insert(0, 1, '\\');
-		wkey.insert(0, tmp->name);
-	}
-	std::u16string u16key(wkey.begin(), wkey.end());
-	return u16key;
+bool WatchNode::hasListener(napi_ref ref) const {
+	if (std::find(listeners.begin(), listeners.end(), ref) != listeners.end()) {
+		return true;
+	}
+	for (PatternNode* pattern : patterns) {
+		if (std::find(pattern->listeners.begin(), pattern->listeners.end(), ref) != pattern->listeners.end()) {
+			return true;
+		}
+	}
+	return false;
 }
 
 /**
- * Attempts to open this node's registry key and watch it.
+ * Attempts to open this node's registry key and watch it. Only the first missing key of a chain is
+ * opened; its subkeys are loaded once it exists.
  *
- * Returns true if something changed.
+ * Returns true if the key was opened.
  */
-bool WatchNode::load(CallbackQueue* pending) {
-	bool result = false;
+bool WatchNode::load(WatchChanges& changes) {
+	if (hkey || !parent || !parent->hkey) {
+		return false;
+	}
 
-	if (!parent) {
-		return result;
+	TimelineSpan span("watch", "WatchNode::load", key);
+	LSTATUS status;
+	auto it = changes.opened.find(this);
+	if (it != changes.opened.end()) {
+		// `watchMany()` opened the key on a worker thread
+		hkey = it->second.first;
+		status = it->second.second;
+		changes.opened.erase(it);
+	} else {
+		LOG_DEBUG_1("WatchNode::load", L"Opening \"%ls\"", name())
+		status = backend->openKey(parent->hkey, name(), KEY_NOTIFY, NULL, &hkey);
+	}
+	if (status != ERROR_SUCCESS) {
+		hkey = NULL;
+		LOG_DEBUG_WIN32_ERROR("WatchNode::load", L"RegOpenKeyExW failed: ", status)
+		// a key we may read but not be notified about can still be polled
+		if (status != ERROR_ACCESS_DENIED || !reopenForPolling()) {
+			return false;
+		}
 	}
 
-	if (hkey) {
-		// verify this node is still valid
-		HKEY tmp;
-		LSTATUS status = ::RegOpenKeyW(parent->hkey, name.c_str(), &tmp);
-		if (status == ERROR_SUCCESS) {
-			// we're still good
-			::RegCloseKey(tmp);
-			LOG_DEBUG_1("WatchNode::load", L"\"%ls\" hkey is still valid", name.c_str())
-		} else {
-			// no longer valid!
-			result = true;
+	LOG_DEBUG_1("WatchNode::load", L"Key \"%ls\" was just created, registering watcher", name())
+
+	// the event outlives the key handle until the watchman releases it, so a key that comes back
+	// reuses it
+	if (hevent == NULL && !polled) {
+		hevent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (hevent == NULL) {
+			LOG_DEBUG_WIN32_ERROR("WatchNode::load", L"CreateEvent failed: ", ::GetLastError())
 		}
-	} else {
-		LOG_DEBUG_1("WatchNode::load", L"Opening \"%ls\"", name.c_str())
-		LSTATUS status = ::RegOpenKeyExW(parent->hkey, name.c_str(), 0, KEY_NOTIFY, &hkey);
-		if (status == ERROR_SUCCESS) {
-			LOG_DEBUG_1("WatchNode::load", L"Key \"%ls\" was just created, registering watcher", name.c_str())
+	}
+	changes.touched.push_back(this);
 
-			watch(pending);
+	watch(changes);
 
-			if (pending) {
-				PUSH_CALLBACK(*pending, "add", getKey(), listeners)
-			}
+	PUSH_CALLBACK(changes, "add", this)
 
-			for (auto const& it : subkeys) {
-				it.second->load(pending);
-			}
+	if (expands()) {
+		changes.expanded.push_back(this);
+	}
 
-			result = true;
-		} else {
-			hkey = NULL;
-			LOG_DEBUG_WIN32_ERROR("WatchNode::load", L"RegOpenKeyExW failed: ", status)
-		}
+	for (WatchNode* child = firstChild; child; child = child->nextSibling) {
+		child->load(changes);
 	}
 
-	return result;
+	return true;
 }
 
 /**
  * This function is called on the main thread when a registry key changes. It rewatches the changed
  * key and walks the subkeys to see if any subkeys were added or deleted.
+ *
+ * Returns true if a subkey was opened.
  */
-bool WatchNode::onChange() {
+bool WatchNode::onChange(WatchChanges& changes) {
 	// if our hkey is good, then a registry subkey or value was changed
 	//
 	// if our hkey is bad, then this node's key has been deleted and we can assume the listeners
 	// have been notified
 
 	bool changed = false;
-	CallbackQueue pending;
 
 	if (hkey) {
-		if (watch(&pending)) {
+		if (watch(changes)) {
 			// hkey should be valid, check if subkeys are ok
-			LOG_DEBUG_1("WatchNode::onChange", L"Checking if subkeys under \"%ls\" are still valid", name.c_str())
-			for (auto const& it : subkeys) {
+			LOG_DEBUG_1("WatchNode::onChange", L"Checking if subkeys under \"%ls\" are still valid", name())
+			for (WatchNode* child = firstChild; child; child = child->nextSibling) {
+				if (!child->hkey) {
+					continue;
+				}
 				HKEY tmp;
-				LSTATUS status = ::RegOpenKeyW(hkey, it.second->name.c_str(), &tmp);
-				if (status != ERROR_SUCCESS) {
-					LOG_DEBUG_1("WatchNode::onChange", L"\"%ls\" hkey is no longer valid", it.second->name.c_str())
-					it.second->unload(&pending);
+				LSTATUS status = backend->openKey(hkey, child->name(), MAXIMUM_ALLOWED, NULL, &tmp);
+				if (status == ERROR_SUCCESS) {
+					backend->closeKey(tmp);
+				} else {
+					LOG_DEBUG_1("WatchNode::onChange", L"\"%ls\" hkey is no longer valid", child->name())
+					child->unload(changes);
 				}
 			}
 
-			PUSH_CALLBACK(pending, "change", getKey(), listeners)
-		}
+			PUSH_CALLBACK(changes, "change", this)
 
-		for (auto const& it : subkeys) {
-			if (it.second->load(&pending)) {
-				changed = true;
+			// subkeys may have come or gone that a pattern matches
+			if (expands()) {
+				changes.expanded.push_back(this);
 			}
 		}
-	}
-
-	// this node and it's subkeys are processed, now fire the callbacks for each change we discovered
-
-	napi_handle_scope scope;
-	napi_value global, type, key, argv[2], listener, rval;
-
-	NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_OPEN_HANDLE_SCOPE", ::napi_open_handle_scope(env, &scope), false)
-	NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_GET_GLOBAL", ::napi_get_global(env, &global), false)
-	NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_CREATE_STRING", ::napi_create_string_utf8(env, "change", NAPI_AUTO_LENGTH, &argv[0]), false)
-	NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_CREATE_OBJECT", ::napi_create_object(env, &argv[1]), false)
-
-	LOG_DEBUG_1("WatchNode::onChange", L"Calling %ld callbacks", (uint32_t)pending.size())
 
-	while (!pending.empty()) {
-		auto cb = pending.front();
-		pending.pop();
-
-		NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_CREATE_STRING", ::napi_create_string_utf8(env, cb->type, NAPI_AUTO_LENGTH, &type), false)
-		NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_CREATE_STRING", ::napi_create_string_utf16(env, cb->key.c_str(), NAPI_AUTO_LENGTH, &key), false)
-		NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_SET_NAMED_PROPERTY", ::napi_set_named_property(env, argv[1], "type", type), false)
-		NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_SET_NAMED_PROPERTY", ::napi_set_named_property(env, argv[1], "key", key), false)
-
-		LOG_DEBUG_1("WatchNode::onChange", L"Calling %ld listeners", (uint32_t)cb->listeners.size())
-
-		for (auto const& ref : cb->listeners) {
-			NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_GET_REFERENCE_VALUE", ::napi_get_reference_value(env, ref, &listener), false)
-			if (listener != NULL) {
-				NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_MAKE_CALLBACK", ::napi_make_callback(env, NULL, global, listener, 2, argv, &rval), false)
+		// a missing subkey has no event of its own, so this is the only time we look for it
+		for (WatchNode* child = firstChild; child; child = child->nextSibling) {
+			if (child->load(changes)) {
+				changed = true;
 			}
 		}
 	}
 
-	NAPI_THROW_RETURN("WatchNode::onChange", "ERR_NAPI_CLOSE_HANDLE_SCOPE", ::napi_close_handle_scope(env, scope), false)
-
 	return changed;
 }
 
@@ -216,72 +178,305 @@ void WatchNode::print(std::wstringstream& wss, uint8_t indent) {
 		}
 	}
 
-	wss << name << " (" << std::to_wstring(listeners.size()) << " listener" << (listeners.size() == 1 ? ")\n" : "s)\n");
+	wss << (parent ? name() : L"ROOT") << " (" << std::to_wstring(listeners.size()) << " listener" << (listeners.size() == 1 ? ")\n" : "s)\n");
 
-	for (auto const& it : subkeys) {
-		it.second->print(wss, indent + 1);
+	for (WatchNode* child = firstChild; child; child = child->nextSibling) {
+		child->print(wss, indent + 1);
 	}
 }
 
 /**
- * Removes a JS listener function from the list.
+ * Closes the event handle of a node whose key is no longer open. The caller must make sure the
+ * monitor thread has stopped waiting on it.
  */
-void WatchNode::removeListener(napi_value listener) {
-	std::lock_guard<std::mutex> lock(listenersLock);
-	for (auto it = listeners.begin(); it != listeners.end(); ) {
-		napi_value callback;
-		NAPI_THROW("WatchNode::removeListener", "ERR_NAPI_GET_REFERENCE_VALUE", ::napi_get_reference_value(env, *it, &callback))
-
-		bool same;
-		NAPI_THROW("WatchNode::removeListener", "ERR_NAPI_STRICT_EQUALS", ::napi_strict_equals(env, callback, listener, &same))
-
-		if (same) {
-			LOG_DEBUG_1("WatchNode::removeListener", L"Removing listener from \"%ls\"", name.c_str())
-			it = listeners.erase(it);
-		} else {
-			++it;
-		}
+void WatchNode::release() {
+	if (hevent && !hkey) {
+		::CloseHandle(hevent);
+		hevent = NULL;
+	}
+}
+
+/**
+ * Reopens this node's key for reading so that the watchman can poll it when it can't be notified.
+ * Returns false if the key can't be read either.
+ */
+bool WatchNode::reopenForPolling() {
+	HKEY tmp;
+	LSTATUS status = backend->openKey(parent->hkey, name(), KEY_QUERY_VALUE, NULL, &tmp);
+	if (status != ERROR_SUCCESS) {
+		LOG_DEBUG_WIN32_ERROR("WatchNode::reopenForPolling", L"RegOpenKeyExW failed: ", status)
+		return false;
 	}
-	LOG_DEBUG_2("WatchNode::removeListener", L"Node \"%ls\" now has %ld listeners", name.c_str(), (uint32_t)listeners.size())
+
+	LOG_DEBUG_1("WatchNode::reopenForPolling", L"Polling \"%ls\" for changes", name())
+	if (hkey) {
+		backend->closeKey(hkey);
+	}
+	hkey = tmp;
+	polled = true;
+	return true;
 }
 
 /**
  * Closes this node's registry key handle and its subkey's key handles.
  */
-void WatchNode::unload(CallbackQueue* pending) {
-	for (auto const& it : subkeys) {
-		it.second->unload(pending);
+void WatchNode::unload(WatchChanges& changes) {
+	TimelineSpan span("watch", "WatchNode::unload", key);
+	for (WatchNode* child = firstChild; child; child = child->nextSibling) {
+		child->unload(changes);
 	}
 
 	if (hkey) {
-		LOG_DEBUG_1("WatchNode::unload", L"Unloading \"%ls\" hkey", name.c_str())
+		LOG_DEBUG_1("WatchNode::unload", L"Unloading \"%ls\" hkey", name())
 
-		::RegCloseKey(hkey);
+		backend->closeKey(hkey);
 		hkey = NULL;
+		// a key that comes back gets another chance to be notified
+		polled = false;
+		changes.touched.push_back(this);
 
-		if (pending) {
-			PUSH_CALLBACK(*pending, "delete", getKey(), listeners)
-		}
+		PUSH_CALLBACK(changes, "delete", this)
 	}
 }
 
 /**
- * Wires up the Windows Registry change notification event asynchronously.
+ * Wires up the Windows Registry change notification event asynchronously. A key without listeners
+ * is only in the tree to track its subkeys, so it is only notified when a subkey is created or
+ * deleted. A key that can't be notified is handed to the watchman to poll.
  *
  * Returns true if the key is valid and the watcher was successfully registered.
  */
-bool WatchNode::watch(CallbackQueue* pending) {
+bool WatchNode::watch(WatchChanges& changes) {
 	if (hkey) {
-		LSTATUS status = ::RegNotifyChangeKeyValue(hkey, FALSE, filter, hevent, TRUE);
+		TimelineSpan span("watch", "WatchNode::watch", key);
+		// a polled key has nothing to rearm, but it still has to exist
+		LSTATUS status = polled
+			? backend->queryInfoKey(hkey, NULL, NULL, NULL, NULL, NULL, NULL)
+			: backend->notifyChangeKeyValue(hkey, FALSE, hasListeners() ? filter : REG_NOTIFY_CHANGE_NAME, hevent);
 		if (status == ERROR_SUCCESS) {
 			return true;
 		}
 		if (status == 1018) {
 			// key has been marked for deletion
-			unload(pending);
+			unload(changes);
+		} else if (polled) {
+			LOG_DEBUG_WIN32_ERROR("WatchNode::watch", L"RegQueryInfoKey failed: ", status);
 		} else {
 			LOG_DEBUG_WIN32_ERROR("WatchNode::watch", L"RegNotifyChangeKeyValue failed: ", status);
+			// fall back to polling so that the watch still fires
+			if (reopenForPolling()) {
+				changes.touched.push_back(this);
+				return true;
+			}
 		}
 	}
 	return false;
 }
+
+/**
+ * Creates the tree with the node that the root keys hang off of.
+ */
+WatchTree::WatchTree() : root(NULL), allocated(0), count(0) {
+	root = add(NULL, L"");
+}
+
+/**
+ * Allocates a node for a subkey of `parent` and links it into the tree. The root keys pass their
+ * predefined handle.
+ */
+WatchNode* WatchTree::add(WatchNode* parent, const std::wstring& name, HKEY hkey) {
+	WatchNode* node;
+	if (freeNodes.empty()) {
+		if (allocated == chunks.size() * CHUNK_SIZE) {
+			chunks.emplace_back(new WatchNode[CHUNK_SIZE]);
+		}
+		node = &at((uint32_t)allocated);
+		node->index = (uint32_t)allocated++;
+	} else {
+		node = freeNodes.back();
+		freeNodes.pop_back();
+	}
+
+	// odd generations are in use
+	++node->generation;
+	node->hkey = hkey;
+	node->parent = parent;
+
+	// the root keys hang off of the root node, but their keys don't include it
+	if (parent && parent->parent) {
+		node->key.reserve(parent->key.length() + 1 + name.length());
+		node->key = parent->key;
+		node->key += L'\\';
+		node->nameOffset = (uint32_t)node->key.length();
+		node->key += name;
+	} else {
+		node->key = name;
+		node->nameOffset = 0;
+	}
+
+	if (parent) {
+		node->nextSibling = parent->firstChild;
+		if (parent->firstChild) {
+			parent->firstChild->prevSibling = node;
+		}
+		parent->firstChild = node;
+
+		node->hash = hashName(parent, name.c_str(), name.length());
+		insert(node);
+	}
+
+	return node;
+}
+
+/**
+ * Finds the subkey of `parent` with the given name. Names are compared the way the registry
+ * compares them, so every spelling of a key finds the same node.
+ */
+WatchNode* WatchTree::find(WatchNode* parent, const std::wstring& name) const {
+	if (table.empty()) {
+		return NULL;
+	}
+
+	uint32_t hash = hashName(parent, name.c_str(), name.length());
+	size_t mask = table.size() - 1;
+	for (size_t i = hash & mask; table[i]; i = (i + 1) & mask) {
+		WatchNode* node = table[i];
+		if (node->hash == hash
+			&& node->parent == parent
+			&& node->key.length() - node->nameOffset == name.length()
+			&& sameName(node->name(), name.c_str(), name.length())
+		) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Closes a node's handles and returns it to the pool. The node must have been unlinked, have no
+ * listeners, and no longer be waited on by the monitor thread.
+ */
+void WatchTree::free(WatchNode* node) {
+	if (node->hkey) {
+		// close the key first so that a pending notification can't signal a closed event
+		backend->closeKey(node->hkey);
+		node->hkey = NULL;
+	}
+	if (node->hevent) {
+		::CloseHandle(node->hevent);
+		node->hevent = NULL;
+	}
+	std::wstring().swap(node->key);
+	std::vector<napi_ref>().swap(node->listeners);
+	std::vector<PatternNode*>().swap(node->patterns);
+	node->parent = node->firstChild = node->nextSibling = node->prevSibling = NULL;
+	node->activeIndex = NOT_ACTIVE;
+	node->polled = false;
+	node->bound = node->literal = node->patternListeners = false;
+
+	// even generations are free, so references to the node held by the monitor thread no longer
+	// resolve
+	++node->generation;
+	freeNodes.push_back(node);
+}
+
+/**
+ * Resolves a reference to a node, or returns `NULL` if the node has been freed.
+ */
+WatchNode* WatchTree::get(const WatchRef& ref) {
+	if (ref.index >= allocated) {
+		return NULL;
+	}
+	WatchNode* node = &at(ref.index);
+	return node->generation == ref.generation ? node : NULL;
+}
+
+/**
+ * Hashes a node name, case-folded, together with its parent. Each node's hash is computed once
+ * when it is added. This only needs to spread names across the table, it is not exposed.
+ */
+uint32_t WatchTree::hashName(const WatchNode* parent, const wchar_t* name, size_t length) {
+	// FNV-1a
+	uint32_t hash = 2166136261u ^ parent->index;
+	for (size_t i = 0; i < length; ++i) {
+		hash = (hash ^ (uint32_t)foldName(name[i])) * 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * Adds a node to the child table, doubling the table to keep it at most half full.
+ */
+void WatchTree::insert(WatchNode* node) {
+	if ((count + 1) * 2 > table.size()) {
+		std::vector<WatchNode*> old(table.empty() ? 64 : table.size() * 2, NULL);
+		old.swap(table);
+		size_t mask = table.size() - 1;
+		for (WatchNode* it : old) {
+			if (it) {
+				size_t i = it->hash & mask;
+				while (table[i]) {
+					i = (i + 1) & mask;
+				}
+				table[i] = it;
+			}
+		}
+	}
+
+	size_t mask = table.size() - 1;
+	size_t i = node->hash & mask;
+	while (table[i]) {
+		i = (i + 1) & mask;
+	}
+	table[i] = node;
+	++count;
+}
+
+/**
+ * Compares two names of the same length case-insensitively. Names that hash the same are almost
+ * always the same name, so this is usually the only full comparison a lookup makes.
+ */
+bool WatchTree::sameName(const wchar_t* a, const wchar_t* b, size_t length) {
+	for (size_t i = 0; i < length; ++i) {
+		if (a[i] != b[i] && foldName(a[i]) != foldName(b[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Removes a node from the tree so that it can no longer be found. The node keeps its handles
+ * until it is freed.
+ */
+void WatchTree::unlink(WatchNode* node) {
+	if (!node->parent) {
+		return;
+	}
+
+	if (node->prevSibling) {
+		node->prevSibling->nextSibling = node->nextSibling;
+	} else {
+		node->parent->firstChild = node->nextSibling;
+	}
+	if (node->nextSibling) {
+		node->nextSibling->prevSibling = node->prevSibling;
+	}
+	node->nextSibling = node->prevSibling = NULL;
+
+	// remove the node from the table and shift back the entries that probed past it
+	size_t mask = table.size() - 1;
+	size_t i = node->hash & mask;
+	while (table[i] != node) {
+		i = (i + 1) & mask;
+	}
+	for (size_t j = (i + 1) & mask; table[j]; j = (j + 1) & mask) {
+		size_t home = table[j]->hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			table[i] = table[j];
+			i = j;
+		}
+	}
+	table[i] = NULL;
+	--count;
+}
@@ -2,84 +2,171 @@
 #define __WATCHNODE__
 
 #include "winreglib.h"
-#include <list>
+#include "watchpattern.h"
 #include <memory>
-#include <mutex>
 #include <queue>
 #include <sstream>
-#include <uv.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace winreglib {
 
-LOG_DEBUG_EXTERN_VARS
-
 const DWORD filter = REG_NOTIFY_CHANGE_NAME |
 					 REG_NOTIFY_CHANGE_ATTRIBUTES |
 					 REG_NOTIFY_CHANGE_LAST_SET |
 					 REG_NOTIFY_CHANGE_SECURITY;
 
-#define PUSH_CALLBACK(list, evtType, key, listeners) \
-	if (listeners.size() > 0) { \
-		const char* type = evtType; \
-		(list).push(std::make_shared<Callback>(type, key, listeners)); \
+/**
+ * Marks a node that is not in the watchman's active list.
+ */
+const uint32_t NOT_ACTIVE = 0xFFFFFFFF;
+
+#define PUSH_CALLBACK(changes, evtType, node) \
+	if ((node)->hasListeners()) { \
+		(changes).callbacks.push(Callback{ evtType, node, 0 }); \
 	}
 
+class WatchNode;
+
 /**
- * Holds everything needed to emit a change event for a given node.
+ * Holds everything needed to emit a change event for a given node. Nodes are not freed while
+ * change events are being dispatched, so the node's key and listeners are read when it is emitted.
+ * `seq` is the event's sequence number in the journal, or 0 when it isn't journaled.
  */
 struct Callback {
-	Callback(const char* type, std::u16string key, std::list<napi_ref> listeners) :
-		key(key), listeners(listeners)
-	{
-		strncpy(this->type, type, 10);
-	}
+	const char* type;
+	WatchNode* node;
+	uint64_t seq;
+};
 
-	char type[10];
-	std::u16string key;
-	std::list<napi_ref> listeners;
+/**
+ * What processing a change produced: the events to emit, the nodes whose keys were opened or
+ * closed, which the watchman starts or stops waiting on, and the nodes whose subkeys have to be
+ * matched against the watched patterns.
+ *
+ * `opened` holds the keys that were already opened off the main thread and the status they were
+ * opened with, which loading a node takes instead of opening its key again.
+ */
+struct WatchChanges {
+	std::queue<Callback> callbacks;
+	std::vector<WatchNode*> touched;
+	std::vector<WatchNode*> expanded;
+	std::unordered_map<WatchNode*, std::pair<HKEY, LSTATUS>> opened;
 };
 
 /**
- * Datatype for passing the callback list around easier.
+ * Identifies a node across threads. The monitor thread never touches a node, it hands the
+ * reference back to the watchman, which ignores it if the node was freed in the meantime.
  */
-typedef std::queue<std::shared_ptr<Callback>> CallbackQueue;
+struct WatchRef {
+	uint32_t index;
+	uint32_t generation;
+
+	bool operator==(const WatchRef& other) const {
+		return index == other.index && generation == other.generation;
+	}
+};
 
 /**
  * Represents a node in the watcher tree. Each node is responsible its corresponding registry key
  * and wiring up the change notification event.
+ *
+ * Nodes for keys that don't exist yet have neither a key handle nor an event. They are checked
+ * when the nearest existing ancestor changes, so watching a deep path that doesn't exist costs one
+ * notification on that ancestor.
+ *
+ * Keys that can't be notified, such as the performance data keys or keys the user may read but not
+ * be notified about, are `polled` by the watchman instead.
+ *
+ * A node also holds the nodes of the pattern trie its key matches. Their listeners are called along
+ * with the node's own. A node is `bound` when every segment from the root key down to it is named
+ * by a pattern, so it is kept while it doesn't exist, and `literal` when its own name is.
+ *
+ * Nodes are owned by a `WatchTree` and link to each other with plain pointers. The full key is
+ * built once when the node is created; the node's name is the tail of it.
  */
 class WatchNode {
 public:
-	WatchNode() : env(NULL), hevent(NULL), hkey(NULL), name(L"ROOT"), parent(NULL) {}
-	WatchNode(napi_env env) : env(env), hevent(NULL), hkey(NULL), name(L"ROOT"), parent(NULL) {}
-	WatchNode(napi_env env, const std::wstring& name, HKEY hkey) : env(env), hevent(NULL), hkey(hkey), name(name), parent(NULL) {}
-	WatchNode(napi_env env, const std::wstring& name, std::shared_ptr<WatchNode> parent);
-	~WatchNode();
-
-	void addListener(napi_value listener);
-	std::shared_ptr<WatchNode> addSubkey(const std::wstring& name, HKEY hkey);
-	std::shared_ptr<WatchNode> addSubkey(const std::wstring& name, std::shared_ptr<WatchNode> parent);
-	bool onChange();
+	WatchNode();
+
+	bool expands() const;
+	bool hasListener(napi_ref ref) const;
+	bool hasListeners() const { return !listeners.empty() || patternListeners; }
+	bool isOpen() const { return hkey != NULL; }
+	bool load(WatchChanges& changes);
+	const wchar_t* name() const { return key.c_str() + nameOffset; }
+	bool onChange(WatchChanges& changes);
 	void print(std::wstringstream& wss, uint8_t indent = 0);
-	void removeListener(napi_value listener);
+	void release();
+	bool reopenForPolling();
+	void unload(WatchChanges& changes);
+	bool watch(WatchChanges& changes);
 
-private:
-	std::u16string getKey();
-	bool load(CallbackQueue* pending);
-	void unload(CallbackQueue* pending);
-	bool watch(CallbackQueue* pending);
+	std::wstring key;
+	HANDLE hevent;
+	HKEY hkey;
+	WatchNode* parent;
+	WatchNode* firstChild;
+	WatchNode* nextSibling;
+	WatchNode* prevSibling;
+	std::vector<napi_ref> listeners;
+	std::vector<PatternNode*> patterns;
+	uint32_t nameOffset;
+	uint32_t hash;
+	uint32_t index;
+	uint32_t generation;
+	uint32_t activeIndex;
+	bool polled;
+	bool bound;
+	bool literal;
+	bool patternListeners;
+};
 
+/**
+ * Owns the nodes of a watcher tree. Nodes are allocated in chunks that never move, so nodes can
+ * point at each other, and freed nodes are reused. Instead of a map per node, children are found
+ * through a single open addressing table keyed by the parent and the child's case-folded name, so
+ * a key watched with different spellings is one node with one handle. A node keeps the spelling
+ * it was first added with.
+ */
+class WatchTree {
 public:
-	HANDLE hevent;
-	std::wstring name;
-	std::map<std::wstring, std::shared_ptr<WatchNode>> subkeys;
-	std::shared_ptr<WatchNode> parent;
-	std::list<napi_ref> listeners;
+	WatchTree();
+
+	WatchNode* add(WatchNode* parent, const std::wstring& name, HKEY hkey = NULL);
+	WatchNode& at(uint32_t index) { return chunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+	bool contains(WatchNode* node) const { return node == root || find(node->parent, node->name()) == node; }
+	WatchNode* find(WatchNode* parent, const std::wstring& name) const;
+	void free(WatchNode* node);
+	WatchNode* get(const WatchRef& ref);
+	size_t size() const { return allocated - freeNodes.size(); }
+	void unlink(WatchNode* node);
+
+	template <typename Fn>
+	void forEach(Fn fn) {
+		for (size_t i = 0; i < allocated; ++i) {
+			WatchNode& node = at((uint32_t)i);
+			if (node.generation & 1) {
+				fn(node);
+			}
+		}
+	}
+
+	WatchNode* root;
 
 private:
-	napi_env env;
-	HKEY hkey;
-	std::mutex listenersLock;
+	static const size_t CHUNK_SIZE = 256;
+
+	static uint32_t hashName(const WatchNode* parent, const wchar_t* name, size_t length);
+	void insert(WatchNode* node);
+	static bool sameName(const wchar_t* a, const wchar_t* b, size_t length);
+
+	std::vector<std::unique_ptr<WatchNode[]>> chunks;
+	size_t allocated;
+	std::vector<WatchNode*> freeNodes;
+	std::vector<WatchNode*> table;
+	size_t count;
 };
 
 }
@@ -0,0 +1,166 @@
+#include "watchpattern.h"
+#include <algorithm>
+#include <sstream>
+
+using namespace winreglib;
+
+/**
+ * Adds the nodes of a pattern that aren't in the trie yet and returns the node it ends at. A `**`
+ * right after another one matches nothing more, so it shares its node.
+ */
+PatternNode* PatternTrie::add(const std::vector<std::wstring>& segments) {
+	PatternNode* node = &root;
+	for (auto const& segment : segments) {
+		if (segment == L"**") {
+			if (!node->recursive) {
+				if (!node->globstar) {
+					node->globstar.reset(new PatternNode(node, true));
+				}
+				node = node->globstar.get();
+			}
+		} else if (segment == L"*") {
+			if (!node->star) {
+				node->star.reset(new PatternNode(node, false));
+			}
+			node = node->star.get();
+		} else {
+			std::unique_ptr<PatternNode>& child = node->literals[segment];
+			if (!child) {
+				child.reset(new PatternNode(node, false));
+			}
+			node = child.get();
+		}
+	}
+	return node;
+}
+
+/**
+ * Finds the node a pattern ends at, or returns `NULL` if it isn't in the trie.
+ */
+PatternNode* PatternTrie::find(const std::vector<std::wstring>& segments) {
+	PatternNode* node = &root;
+	for (auto const& segment : segments) {
+		if (segment == L"**") {
+			if (!node->recursive) {
+				node = node->globstar.get();
+			}
+		} else if (segment == L"*") {
+			node = node->star.get();
+		} else {
+			auto it = node->literals.find(segment);
+			node = it == node->literals.end() ? NULL : it->second.get();
+		}
+		if (!node) {
+			return NULL;
+		}
+	}
+	return node;
+}
+
+/**
+ * Calls a function for every node of the trie.
+ */
+void PatternTrie::forEach(const std::function<void(PatternNode&)>& fn) {
+	std::vector<PatternNode*> stack{ &root };
+	while (!stack.empty()) {
+		PatternNode* node = stack.back();
+		stack.pop_back();
+		fn(*node);
+		for (auto const& it : node->literals) {
+			stack.push_back(it.second.get());
+		}
+		if (node->star) {
+			stack.push_back(node->star.get());
+		}
+		if (node->globstar) {
+			stack.push_back(node->globstar.get());
+		}
+	}
+}
+
+/**
+ * Adds a node to the nodes a key holds, along with the `**` nodes that follow it, since those
+ * match the key without consuming a subkey.
+ */
+void PatternTrie::hold(PatternNode* node, std::vector<PatternNode*>& held) {
+	while (node) {
+		if (std::find(held.begin(), held.end(), node) != held.end()) {
+			return;
+		}
+		held.push_back(node);
+		node = node->globstar.get();
+	}
+}
+
+/**
+ * Returns true if a key has a `*` or `**` segment.
+ */
+bool PatternTrie::isPattern(const std::wstring& key) {
+	std::vector<std::wstring> segments;
+	split(key, segments);
+	for (auto const& segment : segments) {
+		if (segment == L"*" || segment == L"**") {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Finds the nodes a subkey holds given the nodes its parent holds. Returns true if the subkey was
+ * matched by name rather than only by a wildcard, in which case it is worth waiting for when it
+ * doesn't exist.
+ */
+bool PatternTrie::match(const std::vector<PatternNode*>& held, const std::wstring& name, std::vector<PatternNode*>& result) {
+	bool literal = false;
+	for (PatternNode* node : held) {
+		if (node->recursive) {
+			hold(node, result);
+		}
+		auto it = node->literals.find(name);
+		if (it != node->literals.end()) {
+			hold(it->second.get(), result);
+			literal = true;
+		}
+		if (node->star) {
+			hold(node->star.get(), result);
+		}
+	}
+	return literal;
+}
+
+/**
+ * Removes a node that no longer leads to any listener, and the ancestors that only led to it.
+ */
+void PatternTrie::prune(PatternNode* node) {
+	while (node != &root && node->empty()) {
+		PatternNode* parent = node->parent;
+		std::unique_ptr<PatternNode> owned;
+		if (parent->star.get() == node) {
+			owned.swap(parent->star);
+		} else if (parent->globstar.get() == node) {
+			owned.swap(parent->globstar);
+		} else {
+			for (auto it = parent->literals.begin(); it != parent->literals.end(); ++it) {
+				if (it->second.get() == node) {
+					owned.swap(it->second);
+					parent->literals.erase(it);
+					break;
+				}
+			}
+		}
+		removed.push_back(std::move(owned));
+		node = parent;
+	}
+}
+
+/**
+ * Splits a key into its segments.
+ */
+void PatternTrie::split(const std::wstring& key, std::vector<std::wstring>& segments) {
+	std::wstring segment;
+	std::wstringstream wss(key);
+	while (std::getline(wss, segment, L'\\')) {
+		segments.push_back(segment);
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef __WATCHPATTERN__
+#define __WATCHPATTERN__
+
+#include "winreglib.h"
+#include "backend.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * A segment of a watched pattern. Each node is a pattern prefix, so patterns that start the same
+ * share their nodes. A `*` segment matches any one subkey and a `**` segment matches any number of
+ * subkeys, including none. The listeners are those of the patterns that end at this node.
+ */
+struct PatternNode {
+	PatternNode(PatternNode* parent, bool recursive) : parent(parent), recursive(recursive) {}
+
+	bool empty() const { return listeners.empty() && literals.empty() && !star && !globstar; }
+
+	PatternNode* parent;
+	bool recursive;
+	std::vector<napi_ref> listeners;
+	std::map<std::wstring, std::unique_ptr<PatternNode>, NameLess> literals;
+	std::unique_ptr<PatternNode> star;
+	std::unique_ptr<PatternNode> globstar;
+};
+
+/**
+ * The patterns watched in an environment, compiled into a trie that the watcher tree is matched
+ * against one subkey at a time. A node of the watcher tree holds the trie nodes its key matches, so
+ * the patterns a subkey matches only depend on its parent's and its name, and a subkey that comes
+ * or goes only re-evaluates the patterns of its parent.
+ *
+ * Trie nodes that are removed are kept until `sweep()`, since nodes of the watcher tree that were
+ * removed but not freed yet may still point at them.
+ */
+class PatternTrie {
+public:
+	PatternTrie() : root(NULL, false) {}
+
+	PatternNode* add(const std::vector<std::wstring>& segments);
+	PatternNode* find(const std::vector<std::wstring>& segments);
+	void forEach(const std::function<void(PatternNode&)>& fn);
+	void prune(PatternNode* node);
+	void sweep() { removed.clear(); }
+
+	static void hold(PatternNode* node, std::vector<PatternNode*>& held);
+	static bool isPattern(const std::wstring& key);
+	static bool match(const std::vector<PatternNode*>& held, const std::wstring& name, std::vector<PatternNode*>& result);
+	static void split(const std::wstring& key, std::vector<std::wstring>& segments);
+
+	PatternNode root;
+
+private:
+	std::vector<std::unique_ptr<PatternNode>> removed;
+};
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include "watchqueue.h"
+#include "timeline.h"
+
+using namespace winreglib;
+
+/**
+ * Sets the capacity and overflow policy. Nodes already queued beyond a smaller capacity stay
+ * queued, the policy applies to the nodes pushed next.
+ */
+void WatchQueue::configure(size_t capacity, WatchOverflow policy) {
+	std::lock_guard<std::mutex> guard(lock);
+	this->capacity = capacity;
+	this->policy = policy;
+}
+
+/**
+ * Takes the node queued the longest and how many nodes were queued, including it. Returns false if
+ * the queue is empty.
+ */
+bool WatchQueue::pop(ChangedNode& entry, size_t& remaining) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (entries.empty()) {
+		return false;
+	}
+	remaining = entries.size();
+	entry = entries.front();
+	entries.pop_front();
+	queued.erase(id(entry.ref));
+	return true;
+}
+
+/**
+ * Queues a changed node unless it is already pending and returns the timeline flow its
+ * notification joins. A node that is pushed while the queue is full is handled according to the
+ * overflow policy.
+ */
+uint64_t WatchQueue::push(const WatchRef& ref, bool trace) {
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto now = std::chrono::steady_clock::now();
+	auto it = queued.find(id(ref));
+	if (it != queued.end()) {
+		it->second->seen = now;
+		++coalesced;
+		return it->second->flow;
+	}
+	if (ref.index < slots.size() && slots[ref.index].generation == ref.generation) {
+		// a node whose events were dropped has changed again since, so this change is emitted
+		slots[ref.index].quiet = false;
+		slots[ref.index].seen = now;
+		++coalesced;
+		return 0;
+	}
+
+	if (entries.size() >= capacity) {
+		++overflowed;
+		if (policy == Coalesce) {
+			setAside(ChangedNode{ ref, 0, false, false, now });
+			return 0;
+		}
+		if (policy == Resync) {
+			// which keys changed is no longer tracked event by event, only which ones to re-read
+			for (auto const& entry : entries) {
+				setAside(ChangedNode{ entry.ref, 0, true, true, entry.seen });
+			}
+			dropped += entries.size() + 1;
+			entries.clear();
+			queued.clear();
+			setAside(ChangedNode{ ref, 0, true, true, now });
+			return 0;
+		}
+		setAside(ChangedNode{ entries.front().ref, 0, true, false, entries.front().seen });
+		queued.erase(id(entries.front().ref));
+		entries.pop_front();
+		++dropped;
+	}
+
+	// references to the ends of a deque stay valid as it grows and shrinks
+	uint64_t flow = trace ? Timeline::nextFlow() : 0;
+	entries.push_back(ChangedNode{ ref, flow, false, false, now });
+	queued[id(ref)] = &entries.back();
+	return flow;
+}
+
+/**
+ * Sets a node aside in the slot of its index. A slot left by a node that was freed since is
+ * reused.
+ */
+void WatchQueue::setAside(const ChangedNode& entry) {
+	if (entry.ref.index >= slots.size()) {
+		slots.resize(entry.ref.index + 1, Slot{ 0, false, false, {} });
+	}
+	Slot& slot = slots[entry.ref.index];
+	if (!slot.generation) {
+		++aside;
+	}
+	slot = Slot{ entry.ref.generation, entry.quiet, entry.resync, entry.seen };
+}
+
+/**
+ * Counts the queued nodes and the notifications that didn't queue a node of their own.
+ */
+WatchQueueStats WatchQueue::stats() {
+	std::lock_guard<std::mutex> guard(lock);
+	return WatchQueueStats{ entries.size() + aside, coalesced, overflowed, dropped };
+}
+
+/**
+ * Takes the nodes set aside while the queue was full, in the order of their indexes.
+ */
+void WatchQueue::takeAside(std::vector<ChangedNode>& result) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (!aside) {
+		return;
+	}
+	for (uint32_t i = 0; i < (uint32_t)slots.size(); ++i) {
+		Slot& slot = slots[i];
+		if (slot.generation) {
+			result.push_back(ChangedNode{ WatchRef{ i, slot.generation }, 0, slot.quiet, slot.resync, slot.seen });
+			slot = Slot{ 0, false, false, {} };
+		}
+	}
+	aside = 0;
+}
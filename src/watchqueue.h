@@ -0,0 +1,105 @@
+#ifndef __WATCHQUEUE__
+#define __WATCHQUEUE__
+
+#include "watchnode.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace winreglib {
+
+/**
+ * The default number of changed keys queued for the main thread before the overflow policy kicks
+ * in.
+ */
+#define WATCH_QUEUE_CAPACITY 4096
+
+/**
+ * What happens to a key that changes while the queue is full.
+ *
+ * - `Coalesce` sets the key aside and dispatches it after the queue, with the keys set aside
+ *   folded into one pass. No event is lost, but they are no longer in order.
+ * - `DropOldest` makes room by dropping the events of the key queued the longest.
+ * - `Resync` drops the events of every queued key and emits one `resync` event per watched subtree
+ *   instead, telling the listener to re-read it.
+ *
+ * A key whose events are dropped is still dispatched without them so that it is notified again.
+ */
+enum WatchOverflow { Coalesce, DropOldest, Resync };
+
+/**
+ * A node waiting to be dispatched and the timeline flow that connects its notification to the
+ * listeners it calls, or 0 when the timeline isn't recording. A node whose events were dropped is
+ * `quiet` until it changes again, and `resync` if a resync event replaces them. `seen` is when the
+ * latest notification coalesced into it was pushed.
+ */
+struct ChangedNode {
+	WatchRef ref;
+	uint64_t flow;
+	bool quiet;
+	bool resync;
+	std::chrono::steady_clock::time_point seen;
+};
+
+/**
+ * How many keys are queued and how many notifications were coalesced into one already pending,
+ * set aside because the queue was full, or whose events were dropped.
+ */
+struct WatchQueueStats {
+	size_t queued;
+	uint64_t coalesced;
+	uint64_t overflowed;
+	uint64_t dropped;
+};
+
+/**
+ * The changed nodes of an environment waiting for the main thread. Nodes are pushed by the monitor
+ * thread, or the main thread for polled keys, and are queued at most once until they are
+ * dispatched, so repeated notifications of a key coalesce.
+ *
+ * The queue holds at most `capacity` nodes. The nodes set aside when it's full are kept in a slot
+ * per node index rather than in the queue, so the memory they take is bounded by the size of the
+ * watcher tree and no longer grows with the number of notifications.
+ */
+class WatchQueue {
+public:
+	WatchQueue() : capacity(WATCH_QUEUE_CAPACITY), policy(Coalesce), aside(0), coalesced(0), overflowed(0), dropped(0) {}
+
+	void configure(size_t capacity, WatchOverflow policy);
+	bool pop(ChangedNode& entry, size_t& remaining);
+	uint64_t push(const WatchRef& ref, bool trace);
+	WatchQueueStats stats();
+	void takeAside(std::vector<ChangedNode>& result);
+
+private:
+	/**
+	 * A node set aside, or an empty slot when `generation` is 0, which is never in use.
+	 */
+	struct Slot {
+		uint32_t generation;
+		bool quiet;
+		bool resync;
+		std::chrono::steady_clock::time_point seen;
+	};
+
+	static uint64_t id(const WatchRef& ref) { return ((uint64_t)ref.index << 32) | ref.generation; }
+	void setAside(const ChangedNode& entry);
+
+	std::mutex lock;
+	std::deque<ChangedNode> entries;
+	std::unordered_map<uint64_t, ChangedNode*> queued;
+	std::vector<Slot> slots;
+	size_t capacity;
+	WatchOverflow policy;
+	size_t aside;
+	uint64_t coalesced;
+	uint64_t overflowed;
+	uint64_t dropped;
+};
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include "win32backend.h"
+#include <ktmw32.h>
+
+using namespace winreglib;
+
+LSTATUS Win32Backend::beginTransaction(HANDLE* tx) {
+	*tx = ::CreateTransaction(NULL, NULL, 0, 0, 0, 0, NULL);
+	if (*tx == INVALID_HANDLE_VALUE) {
+		*tx = NULL;
+		return (LSTATUS)::GetLastError();
+	}
+	return ERROR_SUCCESS;
+}
+
+LSTATUS Win32Backend::commitTransaction(HANDLE tx) {
+	LSTATUS status = ::CommitTransaction(tx) ? ERROR_SUCCESS : (LSTATUS)::GetLastError();
+	::CloseHandle(tx);
+	return status;
+}
+
+LSTATUS Win32Backend::rollbackTransaction(HANDLE tx) {
+	LSTATUS status = ::RollbackTransaction(tx) ? ERROR_SUCCESS : (LSTATUS)::GetLastError();
+	::CloseHandle(tx);
+	return status;
+}
+
+LSTATUS Win32Backend::closeKey(HKEY hkey) {
+	return ::RegCloseKey(hkey);
+}
+
+LSTATUS Win32Backend::createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) {
+	if (tx) {
+		return ::RegCreateKeyTransactedW(parent, subkey, 0, NULL, REG_OPTION_NON_VOLATILE, sam, NULL, result, NULL, tx, NULL);
+	}
+	return ::RegCreateKeyExW(parent, subkey, 0, NULL, REG_OPTION_NON_VOLATILE, sam, NULL, result, NULL);
+}
+
+LSTATUS Win32Backend::deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx) {
+	if (tx) {
+		return ::RegDeleteKeyTransactedW(parent, subkey, 0, 0, tx, NULL);
+	}
+	return ::RegDeleteKeyExW(parent, subkey, 0, 0);
+}
+
+LSTATUS Win32Backend::deleteValue(HKEY hkey, const wchar_t* name) {
+	return ::RegDeleteValueW(hkey, name);
+}
+
+LSTATUS Win32Backend::enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize) {
+	return ::RegEnumKeyExW(hkey, index, name, nameSize, NULL, NULL, NULL, NULL);
+}
+
+LSTATUS Win32Backend::enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize) {
+	return ::RegEnumValueW(hkey, index, name, nameSize, NULL, type, data, dataSize);
+}
+
+LSTATUS Win32Backend::getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize) {
+	return ::RegGetValueW(hkey, subkey, name, flags, type, data, dataSize);
+}
+
+LSTATUS Win32Backend::notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent) {
+	return ::RegNotifyChangeKeyValue(hkey, watchSubtree, filter, hevent, TRUE);
+}
+
+LSTATUS Win32Backend::openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result) {
+	if (tx) {
+		return ::RegOpenKeyTransactedW(parent, subkey, 0, sam, result, tx, NULL);
+	}
+	return ::RegOpenKeyExW(parent, subkey, 0, sam, result);
+}
+
+LSTATUS Win32Backend::queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime) {
+	return ::RegQueryInfoKeyW(hkey, NULL, NULL, NULL, numSubkeys, maxSubkeyLength, NULL, numValues, maxValueNameLength, maxValueLength, NULL, lastWriteTime);
+}
+
+LSTATUS Win32Backend::setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize) {
+	return ::RegSetValueExW(hkey, name, 0, type, data, dataSize);
+}
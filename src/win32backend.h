@@ -0,0 +1,35 @@
+#ifndef __WIN32BACKEND__
+#define __WIN32BACKEND__
+
+#include "backend.h"
+
+namespace winreglib {
+
+/**
+ * Passes every operation through to the Windows Registry. Transactions are Kernel Transaction
+ * Manager transactions.
+ */
+class Win32Backend : public Backend {
+public:
+	const char* name() { return "win32"; }
+
+	LSTATUS beginTransaction(HANDLE* tx);
+	LSTATUS commitTransaction(HANDLE tx);
+	LSTATUS rollbackTransaction(HANDLE tx);
+
+	LSTATUS closeKey(HKEY hkey);
+	LSTATUS createKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result);
+	LSTATUS deleteKey(HKEY parent, const wchar_t* subkey, HANDLE tx);
+	LSTATUS deleteValue(HKEY hkey, const wchar_t* name);
+	LSTATUS enumKey(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize);
+	LSTATUS enumValue(HKEY hkey, DWORD index, wchar_t* name, DWORD* nameSize, DWORD* type, BYTE* data, DWORD* dataSize);
+	LSTATUS getValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, DWORD flags, DWORD* type, void* data, DWORD* dataSize);
+	LSTATUS notifyChangeKeyValue(HKEY hkey, BOOL watchSubtree, DWORD filter, HANDLE hevent);
+	LSTATUS openKey(HKEY parent, const wchar_t* subkey, REGSAM sam, HANDLE tx, HKEY* result);
+	LSTATUS queryInfoKey(HKEY hkey, DWORD* numSubkeys, DWORD* maxSubkeyLength, DWORD* numValues, DWORD* maxValueNameLength, DWORD* maxValueLength, FILETIME* lastWriteTime);
+	LSTATUS setValue(HKEY hkey, const wchar_t* name, DWORD type, const BYTE* data, DWORD dataSize);
+};
+
+}
+
+#endif
@@ -1,11 +1,30 @@
 #include "winreglib.h"
+#include "backend.h"
+#include "batch.h"
+#include "codec.h"
+#include "columns.h"
+#include "cursor.h"
+#include "exporter.h"
+#include "fingerprint.h"
+#include "journal.h"
+#include "memorybackend.h"
+#include "monitor.h"
+#include "perfdata.h"
+#include "poller.h"
+#include "query.h"
+#include "recordingbackend.h"
+#include "replaybackend.h"
+#include "scanner.h"
+#include "sharedcache.h"
+#include "timeline.h"
+#include "view.h"
 #include "watchman.h"
-#include <windows.h>
+#include <chrono>
+#include <cmath>
 #include <memory>
+#include <unordered_map>
 
 namespace winreglib {
-	winreglib::Watchman* watchman = NULL;
-
 	const std::map<std::wstring, HKEY> rootKeys = {
 		{ L"HKEY_CLASSES_ROOT",                HKEY_CLASSES_ROOT },
 		{ L"HKEY_CURRENT_CONFIG",              HKEY_CURRENT_CONFIG },
@@ -36,223 +55,479 @@ namespace winreglib {
 		std::wstring* resolvedRoot = resolveRootName(key);
 
 		if (!resolvedRoot) {
-			THROW_ERROR_1("ERR_WINREG_INVALID_ROOT", L"Invalid registry root key \"%s\"", key.c_str())
+			THROW_ERROR_1("ERR_WINREG_INVALID_ROOT", L"Invalid registry root key \"%ls\"", key.c_str())
 			return NULL;
 		}
 
 		return rootKeys.find(*resolvedRoot)->second;
 	}
 
-	napi_ref logRef = NULL;
-	LOG_DEBUG_VARS
 }
 
 /**
- * get() implementation for getting a value for the given key and valueName.
+ * Creates (but does not throw) an error for a failed registry operation. If `status` is
+ * `ERROR_SUCCESS`, the message is used as is.
  */
-NAPI_METHOD(get) {
-	NAPI_ARGV(2)
-	NAPI_ARGV_WSTRING(key, 1024, 0)
-	NAPI_ARGV_WSTRING(valueName, 256, 1)
+static napi_value createWin32Error(napi_env env, LSTATUS status, const char* code, const wchar_t* message) {
+	std::wstring wmsg;
+	if (status == ERROR_SUCCESS) {
+		wmsg = message;
+	} else if (status == ERROR_FILE_NOT_FOUND) {
+		code = "ERR_WINREG_NOT_FOUND";
+		wmsg = L"Registry key or value not found";
+	} else {
+		wmsg = std::wstring(message) + L": " + winreglib::formatSystemMessage(status) + L" (code " + std::to_wstring(status) + L")";
+	}
+	std::u16string u16msg(wmsg.begin(), wmsg.end());
 
-	std::string::size_type p = key.find('\\');
-	if (p == std::string::npos) {
-		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+	napi_value error, errCode, errMessage;
+	if (napi_create_string_utf8(env, code, NAPI_AUTO_LENGTH, &errCode) != napi_ok ||
+		napi_create_string_utf16(env, u16msg.c_str(), u16msg.length(), &errMessage) != napi_ok ||
+		napi_create_error(env, errCode, errMessage, &error) != napi_ok
+	) {
 		return NULL;
 	}
+	return error;
+}
 
-	std::wstring subkey = key.substr(p + 1);
-	key.erase(p);
+/**
+ * Reads a string property from an object. Returns false if the property is not a string.
+ */
+static bool getStringProperty(napi_env env, napi_value obj, const char* prop, std::wstring& result) {
+	napi_value value;
+	size_t len = 0;
+	if (napi_get_named_property(env, obj, prop, &value) != napi_ok ||
+		napi_get_value_string_utf16(env, value, NULL, 0, &len) != napi_ok
+	) {
+		return false;
+	}
+	std::u16string str(len, u'\0');
+	if (napi_get_value_string_utf16(env, value, &str[0], len + 1, &len) != napi_ok) {
+		return false;
+	}
+	result.assign(str.begin(), str.end());
+	return true;
+}
 
-	LOG_DEBUG_3("get", L"key=\"%ls\" subkey=\"%ls\" valueName=\"%ls\"", key.c_str(), subkey.c_str(), valueName.c_str())
+/**
+ * Reads registry data out of a JS value for `winreglib::encodeValue()`.
+ */
+struct ValueSource {
+	ValueSource(napi_env env, napi_value value) : env(env), value(value), valueType(napi_undefined) {
+		napi_typeof(env, value, &valueType);
+	}
 
-	HKEY hroot = winreglib::resolveRootKey(env, key);
-	DWORD keyType = 0;
-	DWORD dataSize = 0;
+	bool appendString(std::vector<BYTE>& data) {
+		return valueType == napi_string && appendString(data, value);
+	}
 
-	LSTATUS status = RegGetValueW(hroot, subkey.c_str(), valueName.c_str(), RRF_RT_ANY, &keyType, NULL, &dataSize);
-	ASSERT_WIN32_STATUS(status, "ERR_WINREG_GET_VALUE", L"RegGetValue() failed")
+	bool appendString(std::vector<BYTE>& data, napi_value str) {
+		size_t len = 0;
+		if (napi_get_value_string_utf16(env, str, NULL, 0, &len) != napi_ok) {
+			return false;
+		}
+		size_t offset = data.size();
+		data.resize(offset + (len + 1) * sizeof(char16_t));
+		return napi_get_value_string_utf16(env, str, reinterpret_cast<char16_t*>(&data[offset]), len + 1, &len) == napi_ok;
+	}
 
-	LOG_DEBUG_2("get", L"Type=%ld Size=%ld", keyType, dataSize);
+	bool appendStrings(std::vector<BYTE>& data) {
+		uint32_t len = 0;
+		if (napi_get_array_length(env, value, &len) != napi_ok) {
+			return false;
+		}
+		for (uint32_t i = 0; i < len; ++i) {
+			napi_value str;
+			size_t offset = data.size();
+			if (napi_get_element(env, value, i, &str) != napi_ok || !appendString(data, str)) {
+				return false;
+			}
+			// an empty string would end the list early
+			if (data.size() - offset == sizeof(char16_t)) {
+				napi_throw_range_error(env, NULL, "Expected REG_MULTI_SZ strings to be non-empty");
+				return false;
+			}
+		}
+		return true;
+	}
 
-	BYTE* data = new BYTE[dataSize];
-	status = RegGetValueW(hroot, subkey.c_str(), valueName.c_str(), RRF_RT_ANY, NULL, data, &dataSize);
-	if (status != ERROR_SUCCESS) {
-		FORMAT_ERROR(status, "ERR_WINREG_GET_VALUE", L"RegGetValue() failed")
-		delete[] data;
-		return NULL;
+	bool binary(std::vector<BYTE>& data) {
+		if (valueType == napi_null || valueType == napi_undefined) {
+			return true;
+		}
+		void* buffer;
+		size_t len;
+		if (napi_get_buffer_info(env, value, &buffer, &len) != napi_ok) {
+			return false;
+		}
+		data.assign((BYTE*)buffer, (BYTE*)buffer + len);
+		return true;
 	}
 
-	napi_value rval;
+	bool uint32(uint32_t& num) {
+		double d;
+		if (valueType != napi_number || napi_get_value_double(env, value, &d) != napi_ok) {
+			return false;
+		}
+		if (d < 0 || d > 4294967295.0 || d != std::floor(d)) {
+			napi_throw_range_error(env, NULL, "Expected value to be an integer between 0 and 4294967295");
+			return false;
+		}
+		num = (uint32_t)d;
+		return true;
+	}
 
-	switch (keyType) {
-		case REG_SZ:
-		case REG_EXPAND_SZ:
-		case REG_LINK:
-			{
-				std::wstring data_wstr(reinterpret_cast<wchar_t*>(data));
-				std::u16string data_str16(data_wstr.begin(), data_wstr.end());
-				NAPI_THROW_RETURN("get", "ERR_NAPI_CREATE_STRING", napi_create_string_utf16(env, data_str16.c_str(), NAPI_AUTO_LENGTH, &rval), NULL)
-				break;
+	bool uint64(uint64_t& num) {
+		if (valueType == napi_bigint) {
+			bool lossless = true;
+			if (napi_get_value_bigint_uint64(env, value, &num, &lossless) != napi_ok) {
+				return false;
+			}
+			if (!lossless) {
+				napi_throw_range_error(env, NULL, "Expected value to be a bigint between 0 and 18446744073709551615");
+				return false;
 			}
+			return true;
+		}
+		double d;
+		if (valueType != napi_number || napi_get_value_double(env, value, &d) != napi_ok) {
+			return false;
+		}
+		// larger numbers may already have lost precision, those need to be passed as a bigint
+		if (d < 0 || d > (double)winreglib::MAX_SAFE_INTEGER || d != std::floor(d)) {
+			napi_throw_range_error(env, NULL, "Expected value to be an integer between 0 and Number.MAX_SAFE_INTEGER, use a bigint for larger values");
+			return false;
+		}
+		num = (uint64_t)d;
+		return true;
+	}
 
-		case REG_DWORD: // same as REG_DWORD_LITTLE_ENDIAN
-			NAPI_THROW_RETURN("get", "ERR_NAPI_CREATE_UINT32", napi_create_uint32(env, *((uint32_t*)data), &rval), NULL)
-			break;
+	napi_env env;
+	napi_value value;
+	napi_valuetype valueType;
+};
 
-		case REG_DWORD_BIG_ENDIAN:
-			{
-				uint32_t in = *((uint32_t*)data);
-				uint32_t out = ((in & 0x000000FF) << 16) |
-					((in & 0x0000FF00) << 8) |
-					((in & 0x00FF0000) >> 8) |
-					((in & 0xFF000000) >> 16);
-				NAPI_THROW_RETURN("get", "ERR_NAPI_CREATE_UINT32", napi_create_uint32(env, out, &rval), NULL)
-				break;
-			}
+/**
+ * Encodes a JS value as registry data of the given type. A buffer is written as is regardless of
+ * the type. Returns false if the value can't be represented as that type.
+ */
+static bool encodeValue(napi_env env, napi_value value, DWORD type, std::vector<BYTE>& data) {
+	ValueSource source(env, value);
+	bool isBuffer = false;
+	if (napi_is_buffer(env, value, &isBuffer) == napi_ok && isBuffer) {
+		return source.binary(data);
+	}
+	return winreglib::encodeValue(source, type, data);
+}
 
-		case REG_QWORD: // same as REG_QWORD_LITTLE_ENDIAN
-			NAPI_THROW_RETURN("get", "ERR_NAPI_CREATE_INT64", napi_create_int64(env, *((uint64_t*)data), &rval), NULL)
-			break;
+/**
+ * Frees a registry value read by `get()` once its external buffer is garbage collected.
+ */
+static void freeData(napi_env env, void* data, void* hint) {
+	delete[] static_cast<BYTE*>(data);
+}
 
-		case REG_BINARY:
-		case REG_FULL_RESOURCE_DESCRIPTOR:
-		case REG_RESOURCE_LIST:
-		case REG_RESOURCE_REQUIREMENTS_LIST:
-			NAPI_THROW_RETURN("get", "ERR_NAPI_CREATE_BUFFER", napi_create_buffer(env, dataSize, (void**)data, &rval), NULL)
-			break;
+/**
+ * Creates the JavaScript value for registry data with `winreglib::decodeValue()`: a string, an
+ * array of strings, a number, or a bigint for 64-bit integers when asked for, `null`, or a buffer
+ * for binary and malformed data.
+ */
+struct ValueSink {
+	typedef napi_status Result;
+
+	ValueSink(napi_env env, napi_value* result, bool bigint = false) : env(env), result(result), bigint(bigint) {}
+
+	napi_status binary(const BYTE* data, size_t size) {
+		if (owned && data == owned.get()) {
+			// the buffer takes ownership of the data so that large values aren't copied
+			napi_status status = napi_create_external_buffer(env, size, owned.get(), freeData, NULL, result);
+			if (status == napi_ok) {
+				owned.release();
+				return status;
+			}
+			if (status != napi_no_external_buffers_allowed) {
+				return status;
+			}
+			// some runtimes (e.g. Electron) don't allow external buffers, so copy instead
+			LOG_DEBUG("get", L"External buffers not allowed, copying data")
+		}
+		return napi_create_buffer_copy(env, size, data, NULL, result);
+	}
 
-		case REG_NONE:
-			NAPI_THROW_RETURN("get", "ERR_NAPI_GET_NULL", napi_get_null(env, &rval), NULL)
-			break;
+	napi_status multiString(const winreglib::MultiString& strings) {
+		napi_status status = napi_create_array_with_length(env, strings.size(), result);
+		uint32_t i = 0;
+		strings.forEach([&](const char16_t* str, size_t len) {
+			napi_value value;
+			if (status == napi_ok) status = napi_create_string_utf16(env, str, len, &value);
+			if (status == napi_ok) status = napi_set_element(env, *result, i++, value);
+			return status == napi_ok;
+		});
+		return status;
+	}
 
-		case REG_MULTI_SZ:
-			{
-				BYTE* ptr = data;
-				napi_value push;
+	napi_status null() {
+		return napi_get_null(env, result);
+	}
 
-				NAPI_THROW_RETURN("get", "ERR_NAPI_CREATE_ARRAY", napi_create_array(env, &rval), NULL)
-				NAPI_THROW_RETURN("get", "ERR_NAPI_GET_NAMED_PROPERTY", napi_get_named_property(env, rval, "push", &push), NULL)
+	napi_status string(const char16_t* str, size_t len) {
+		// registry strings are always UTF-16
+		return napi_create_string_utf16(env, str, len, result);
+	}
 
-				while (*ptr) {
-					std::wstring data_wstr(reinterpret_cast<wchar_t*>(ptr));
-					size_t len = data_wstr.length();
-					if (len == 0) {
-						break;
-					}
-					std::u16string data_str16(data_wstr.begin(), data_wstr.end());
-					napi_value str;
-					NAPI_THROW_RETURN("get", "ERR_NAPI_CREATE_STRING", napi_create_string_utf16(env, data_str16.c_str(), data_str16.length(), &str), NULL)
-					NAPI_THROW_RETURN("get", "ERR_NAPI_CALL_FUNCTION", napi_call_function(env, rval, push, 1, &str, NULL), NULL)
-					ptr += len + 1;
-				}
-			}
-			break;
+	napi_status uint32(uint32_t value) {
+		return napi_create_uint32(env, value, result);
+	}
 
-		default:
-			THROW_ERROR_1("ERR_WINREG_UNSUPPORTED_KEY_TYPE", L"Unsupported key type: %d", keyType)
+	napi_status uint64(uint64_t value) {
+		// the type only depends on the option, a number loses precision above 2^53
+		return bigint
+			? napi_create_bigint_uint64(env, value, result)
+			: napi_create_double(env, (double)value, result);
 	}
 
-	delete[] data;
+	napi_env env;
+	napi_value* result;
+	bool bigint;
 
-	return rval;
-}
+	/**
+	 * Data read by `get()` that a binary value may take over instead of copying.
+	 */
+	std::unique_ptr<BYTE[]> owned;
+};
 
 /**
- * Emits queued log messages.
+ * batch() implementation for applying a list of set, delete, and create key operations in a
+ * single call. Returns an array with the outcome of each operation.
  */
-static void dispatchLog(uv_async_t* handle) {
-	napi_env env = (napi_env)handle->data;
-	napi_handle_scope scope;
-	napi_value global, logFn, rval;
+NAPI_METHOD(batch) {
+	NAPI_ARGV(3)
+	bool transacted = false;
+	bool quiet = false;
+	uint32_t count = 0;
+
+	NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_ARRAY_LENGTH", napi_get_array_length(env, argv[0], &count), NULL)
+	NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[1], &transacted), NULL)
+	NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &quiet), NULL)
+
+	std::vector<winreglib::BatchOp> ops(count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		winreglib::BatchOp& op = ops[i];
+		napi_value obj, prop;
+		napi_valuetype propType;
+		char opName[16];
+		size_t opNameLen;
+		std::wstring key;
+
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_ELEMENT", napi_get_element(env, argv[0], i, &obj), NULL)
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_NAMED_PROPERTY", napi_get_named_property(env, obj, "op", &prop), NULL)
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf8(env, prop, opName, sizeof(opName), &opNameLen), NULL)
+
+		if (!getStringProperty(env, obj, "key", key)) {
+			napi_throw_type_error(env, NULL, "Expected key to be a non-empty string");
+			return NULL;
+		}
 
-	NAPI_FATAL("dispatchLog", napi_open_handle_scope(env, &scope))
+		std::string::size_type p = key.find('\\');
+		if (p == std::string::npos) {
+			napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+			return NULL;
+		}
 
-	if (!winreglib::logRef) {
-		return;
-	}
+		std::wstring root = key.substr(0, p);
+		op.root = winreglib::resolveRootKey(env, root);
+		if (!op.root) {
+			return NULL;
+		}
+		op.rootName = *winreglib::resolveRootName(root);
+		op.subkey = key.substr(p + 1);
 
-	NAPI_FATAL("dispatchLog", napi_get_reference_value(env, winreglib::logRef, &logFn))
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_NAMED_PROPERTY", napi_get_named_property(env, obj, "name", &prop), NULL)
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_TYPEOF", napi_typeof(env, prop, &propType), NULL)
+		if (propType == napi_string) {
+			getStringProperty(env, obj, "name", op.name);
+		}
 
-	if (logFn == NULL) {
-		return;
+		if (::strcmp(opName, "set") == 0) {
+			op.type = winreglib::SetValue;
+			NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_NAMED_PROPERTY", napi_get_named_property(env, obj, "type", &prop), NULL)
+			NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_VALUE_UINT32", napi_get_value_uint32(env, prop, &op.valueType), NULL)
+			NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_NAMED_PROPERTY", napi_get_named_property(env, obj, "value", &prop), NULL)
+			if (!encodeValue(env, prop, op.valueType, op.data)) {
+				// a value out of range has already thrown a more specific error
+				bool pending = false;
+				napi_is_exception_pending(env, &pending);
+				if (pending) {
+					return NULL;
+				}
+				THROW_ERROR_2("ERR_WINREG_INVALID_VALUE", L"Invalid data for value \"%ls\" (type %d)", op.name.c_str(), op.valueType)
+				return NULL;
+			}
+		} else if (::strcmp(opName, "delete") == 0) {
+			op.type = propType == napi_string ? winreglib::DeleteValue : winreglib::DeleteKey;
+		} else if (::strcmp(opName, "createKey") == 0) {
+			op.type = winreglib::CreateKey;
+		} else {
+			THROW_ERROR_1("ERR_WINREG_INVALID_OPERATION", L"Invalid batch operation \"%hs\"", opName)
+			return NULL;
+		}
 	}
 
-	NAPI_FATAL("dispatchLog", napi_get_global(env, &global))
+	LOG_DEBUG_2("batch", L"Applying %ld operations (transacted=%d)", count, (int)transacted)
 
-	std::lock_guard<std::mutex> lock(winreglib::logLock);
+	// notifications for the writes can be seen as soon as they're applied
+	auto start = std::chrono::steady_clock::now();
+	winreglib::Batch batch(winreglib::backend, transacted);
+	batch.apply(ops);
 
-	while (!winreglib::logQueue.empty()) {
-		std::shared_ptr<winreglib::LogMessage> obj = winreglib::logQueue.front();
-		winreglib::logQueue.pop();
-		napi_value argv[2];
+	if (quiet) {
+		std::vector<std::wstring> keys;
+		for (auto const& op : ops) {
+			if (op.state != winreglib::Applied) {
+				continue;
+			}
+			std::wstring key = op.key();
+			keys.push_back(key);
+			if (op.type == winreglib::CreateKey || op.type == winreglib::DeleteKey) {
+				// creating or deleting a key notifies the parent and possibly intermediate keys
+				for (std::string::size_type p = key.rfind('\\'); p != std::string::npos && p > op.rootName.length(); p = key.rfind('\\', p - 1)) {
+					keys.push_back(key.substr(0, p));
+					if (op.type == winreglib::DeleteKey) {
+						break;
+					}
+				}
+			}
+		}
+		winreglib::Instance::get(env)->watchman->mute(keys, start);
+	}
 
-		if (obj->ns.length()) {
-			NAPI_FATAL("dispatchLog", napi_create_string_utf8(env, obj->ns.c_str(), obj->ns.length(), &argv[0]))
-		} else {
-			NAPI_FATAL("dispatchLog", napi_get_null(env, &argv[0]))
+	napi_value results;
+	NAPI_THROW_RETURN("batch", "ERR_NAPI_CREATE_ARRAY", napi_create_array_with_length(env, count, &results), NULL)
+
+	for (uint32_t i = 0; i < count; ++i) {
+		winreglib::BatchOp& op = ops[i];
+		napi_value result, success, error = NULL;
+
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &result), NULL)
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_GET_BOOLEAN", napi_get_boolean(env, op.state == winreglib::Applied, &success), NULL)
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "success", success), NULL)
+
+		if (op.state == winreglib::Aborted) {
+			error = createWin32Error(env, ERROR_SUCCESS, "ERR_WINREG_TRANSACTION_ABORTED", L"Operation was not applied because another operation in the transaction failed");
+		} else if (op.state == winreglib::Failed) {
+			switch (op.type) {
+				case winreglib::SetValue:    error = createWin32Error(env, op.status, "ERR_WINREG_SET_VALUE", L"RegSetValueEx() failed"); break;
+				case winreglib::DeleteValue: error = createWin32Error(env, op.status, "ERR_WINREG_DELETE_VALUE", L"RegDeleteValue() failed"); break;
+				case winreglib::CreateKey:   error = createWin32Error(env, op.status, "ERR_WINREG_CREATE_KEY", L"RegCreateKeyEx() failed"); break;
+				case winreglib::DeleteKey:   error = createWin32Error(env, op.status, "ERR_WINREG_DELETE_KEY", L"RegDeleteKeyEx() failed"); break;
+			}
+		}
+		if (error) {
+			NAPI_THROW_RETURN("batch", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "error", error), NULL)
 		}
-		NAPI_FATAL("dispatchLog", napi_create_string_utf16(env, obj->msg.c_str(), obj->msg.length(), &argv[1]))
 
-		// we have to create an async context to prevent domain.enter error
-		napi_value resName;
-		NAPI_FATAL("dispatchLog", napi_create_string_utf8(env, "winreglib.log", NAPI_AUTO_LENGTH, &resName))
-		napi_async_context ctx;
-		NAPI_FATAL("dispatchLog", napi_async_init(env, NULL, resName, &ctx))
+		NAPI_THROW_RETURN("batch", "ERR_NAPI_SET_ELEMENT", napi_set_element(env, results, i, result), NULL)
+	}
 
-		// emit the log message
-		napi_status status = napi_make_callback(env, ctx, global, logFn, 2, argv, &rval);
+	return results;
+}
 
-		napi_async_destroy(env, ctx);
+/**
+ * State for a cursor page being read on a worker thread.
+ */
+struct CursorRead {
+	winreglib::Cursor* cursor;
+	DWORD pageSize;
+	winreglib::CursorPage page;
+	napi_ref ref;
+	napi_deferred deferred;
+	napi_async_work work;
+};
 
-		NAPI_FATAL("dispatchLog", status)
+/**
+ * Gets the native cursor from the external returned by `openCursor()`.
+ */
+static winreglib::Cursor* getCursor(napi_env env, napi_value value) {
+	napi_valuetype type;
+	void* cursor = NULL;
+	if (napi_typeof(env, value, &type) != napi_ok || type != napi_external ||
+		napi_get_value_external(env, value, &cursor) != napi_ok
+	) {
+		napi_throw_type_error(env, "ERR_WINREG_INVALID_CURSOR", "Invalid cursor");
+		return NULL;
 	}
-
-	NAPI_FATAL("dispatchLog", napi_close_handle_scope(env, scope))
+	return static_cast<winreglib::Cursor*>(cursor);
 }
 
 /**
- * init() implementation for wiring up the log message notification handler and printing the
- * winreglib banner.
+ * Creates an array of strings from a list of registry names.
  */
-NAPI_METHOD(init) {
-	NAPI_ARGV(1);
-	napi_value logFn = argv[0];
-
-	// wire up the log notification handler
-	uv_loop_t* loop;
-	napi_get_uv_event_loop(env, &loop);
-	if (!winreglib::logNotify) {
-		winreglib::logNotify = new uv_async_t;
+static napi_value createNameArray(napi_env env, const std::vector<std::wstring>& names) {
+	napi_value result;
+	NAPI_THROW_RETURN("readCursor", "ERR_NAPI_CREATE_ARRAY", napi_create_array_with_length(env, names.size(), &result), NULL)
+	for (uint32_t i = 0; i < names.size(); ++i) {
+		napi_value name;
+		NAPI_THROW_RETURN("readCursor", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, names[i].c_str(), names[i].length(), &name), NULL)
+		NAPI_THROW_RETURN("readCursor", "ERR_NAPI_SET_ELEMENT", napi_set_element(env, result, i, name), NULL)
 	}
-	winreglib::logNotify->data = env;
-	uv_async_init(loop, (uv_async_t*)winreglib::logNotify, &dispatchLog);
-	uv_unref((uv_handle_t*)winreglib::logNotify);
+	return result;
+}
 
-	// create the reference for the emit log callback so it doesn't get GC'd
-	NAPI_THROW_RETURN("init", "ERR_NAPI_CREATE_REFERENCE", napi_create_reference(env, logFn, 1, &winreglib::logRef), NULL)
+/**
+ * Reads a cursor page on a worker thread.
+ */
+static void readCursorExecute(napi_env env, void* data) {
+	CursorRead* read = static_cast<CursorRead*>(data);
+	read->cursor->next(read->pageSize, read->page);
+}
 
-	// print the banner
-	napi_value global, result, args[2];
-	uint32_t apiVersion;
-	char banner[128];
-	const napi_node_version* ver;
-	NAPI_THROW_RETURN("init", "ERR_NAPI_GET_GLOBAL", napi_get_global(env, &global), NULL)
-	NAPI_THROW_RETURN("init", "ERR_NAPI_GET_NULL", napi_get_null(env, &args[0]), NULL)
-	NAPI_THROW_RETURN("init", "ERR_NAPI_GET_VERSION", napi_get_version(env, &apiVersion), NULL)
-	NAPI_THROW_RETURN("init", "ERR_NAPI_GET_NODE_VERSION", napi_get_node_version(env, &ver), NULL)
-	snprintf(banner, 128, "v" WINREGLIB_VERSION " <" WINREGLIB_URL "> (%s %d.%d.%d/n-api %d)", ver->release, ver->major, ver->minor, ver->patch, apiVersion);
-	NAPI_THROW_RETURN("init", "ERR_NAPI_CREATE_STRING", napi_create_string_utf8(env, banner, strlen(banner), &args[1]), NULL)
-	NAPI_THROW_RETURN("init", "ERR_NAPI_CALL_FUNCTION", napi_call_function(env, global, logFn, 2, args, &result), NULL)
+/**
+ * Settles the promise returned by `readCursor()` on the main thread.
+ */
+static void readCursorComplete(napi_env env, napi_status status, void* data) {
+	CursorRead* read = static_cast<CursorRead*>(data);
+	read->cursor->busy = false;
+
+	napi_value result = NULL;
+	if (read->page.status != ERROR_SUCCESS) {
+		LOG_DEBUG_1("readCursor", L"Failed to read page (status=%d)", read->page.status)
+		napi_reject_deferred(env, read->deferred, createWin32Error(env, read->page.status, "ERR_WINREG_ENUM_KEY", L"Failed to enumerate key"));
+	} else {
+		napi_value subkeys = createNameArray(env, read->page.subkeys);
+		napi_value values = subkeys ? createNameArray(env, read->page.values) : NULL;
+		napi_value done;
+		if (values &&
+			napi_create_object(env, &result) == napi_ok &&
+			napi_get_boolean(env, read->page.done, &done) == napi_ok &&
+			napi_set_named_property(env, result, "subkeys", subkeys) == napi_ok &&
+			napi_set_named_property(env, result, "values", values) == napi_ok &&
+			napi_set_named_property(env, result, "done", done) == napi_ok
+		) {
+			napi_resolve_deferred(env, read->deferred, result);
+		} else {
+			napi_value error;
+			bool pending = false;
+			napi_is_exception_pending(env, &pending);
+			if (pending && napi_get_and_clear_last_exception(env, &error) == napi_ok) {
+				napi_reject_deferred(env, read->deferred, error);
+			} else {
+				napi_reject_deferred(env, read->deferred, createWin32Error(env, ERROR_SUCCESS, "ERR_WINREG_READ_CURSOR", L"Failed to create page"));
+			}
+		}
+	}
 
-	NAPI_RETURN_UNDEFINED("init")
+	napi_delete_reference(env, read->ref);
+	napi_delete_async_work(env, read->work);
+	delete read;
 }
 
 /**
- * list() implementation for retrieving all subkeys and values for a given key.
+ * openCursor() implementation for opening a key to be enumerated a page at a time by
+ * `readCursor()`. Returns an external that closes the key when garbage collected.
  */
-NAPI_METHOD(list) {
-	NAPI_ARGV(1);
+NAPI_METHOD(openCursor) {
+	NAPI_ARGV(1)
 	NAPI_ARGV_WSTRING(key, 1024, 0)
 
 	std::string::size_type p = key.find('\\');
@@ -264,79 +539,169 @@ NAPI_METHOD(list) {
 	std::wstring root = key.substr(0, p);
 	std::wstring subkey = key.substr(p + 1);
 
-	LOG_DEBUG_2("list", L"key=\"%ls\" subkey=\"%ls\"", root.c_str(), subkey.c_str())
+	LOG_DEBUG_2("openCursor", L"key=\"%ls\" subkey=\"%ls\"", root.c_str(), subkey.c_str())
 
 	HKEY hroot = winreglib::resolveRootKey(env, root);
+	if (!hroot) {
+		return NULL;
+	}
+
 	HKEY hkey;
-	LSTATUS status = RegOpenKeyExW(hroot, subkey.c_str(), 0, KEY_READ, &hkey);
+	LSTATUS status = winreglib::backend->openKey(hroot, subkey.c_str(), KEY_READ, NULL, &hkey);
 	ASSERT_WIN32_STATUS(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
 
-	std::wstring* resolvedRoot = winreglib::resolveRootName(root);
-	if (!resolvedRoot) {
-		THROW_ERROR_1("ERR_WINREG_INVALID_ROOT", L"Invalid registry root key \"%s\"", key.c_str())
+	winreglib::Cursor* cursor = new winreglib::Cursor(winreglib::backend, hkey);
+	napi_value result;
+	napi_status s = napi_create_external(env, cursor, [](napi_env env, void* data, void* hint) {
+		delete static_cast<winreglib::Cursor*>(data);
+	}, NULL, &result);
+	if (s != napi_ok) {
+		delete cursor;
+		NAPI_THROW_RETURN("openCursor", "ERR_NAPI_CREATE_EXTERNAL", s, NULL)
+	}
+	return result;
+}
+
+/**
+ * readCursor() implementation for reading the next page of names on a worker thread. Returns a
+ * promise that resolves `{ subkeys, values, done }`.
+ */
+NAPI_METHOD(readCursor) {
+	NAPI_ARGV(2)
+	NAPI_ARGV_UINT32(pageSize, 1)
+
+	winreglib::Cursor* cursor = getCursor(env, argv[0]);
+	if (!cursor) {
 		return NULL;
 	}
 
-	// add back the resolved root
-	key = *resolvedRoot + L'\\' + subkey;
+	if (cursor->closed()) {
+		THROW_ERROR("ERR_WINREG_CURSOR_CLOSED", L"Cursor has been closed")
+		return NULL;
+	}
 
-	napi_value rval;
-	napi_value subkeys;
-	napi_value subkeysPush;
-	napi_value values;
-	napi_value valuesPush;
+	if (cursor->busy) {
+		THROW_ERROR("ERR_WINREG_CURSOR_BUSY", L"Cursor is already reading a page")
+		return NULL;
+	}
 
-	NAPI_THROW_RETURN("list", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
-	NAPI_THROW_RETURN("list", "ERR_NAPI_CREATE_ARRAY", napi_create_array(env, &subkeys), NULL)
-	NAPI_THROW_RETURN("list", "ERR_NAPI_CREATE_ARRAY", napi_create_array(env, &values), NULL)
-	SET_PROP_FROM_WSTRING(rval, "resolvedRoot", resolvedRoot)
-	SET_PROP_FROM_WSTRING(rval, "key", &key)
-	NAPI_THROW_RETURN("list", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "subkeys", subkeys), NULL)
-	NAPI_THROW_RETURN("list", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "values", values), NULL)
-	NAPI_THROW_RETURN("list", "ERR_NAPI_GET_NAMED_PROPERTY", napi_get_named_property(env, subkeys, "push", &subkeysPush), NULL)
-	NAPI_THROW_RETURN("list", "ERR_NAPI_GET_NAMED_PROPERTY", napi_get_named_property(env, values, "push", &valuesPush), NULL)
+	// the reference keeps the cursor from being garbage collected while the page is being read
+	std::unique_ptr<CursorRead> read(new CursorRead());
+	read->cursor = cursor;
+	read->pageSize = pageSize > 0 ? pageSize : 1;
+
+	napi_value promise, name;
+	NAPI_THROW_RETURN("readCursor", "ERR_NAPI_CREATE_REFERENCE", napi_create_reference(env, argv[0], 1, &read->ref), NULL)
+	NAPI_THROW_RETURN("readCursor", "ERR_NAPI_CREATE_PROMISE", napi_create_promise(env, &read->deferred, &promise), NULL)
+	NAPI_THROW_RETURN("readCursor", "ERR_NAPI_CREATE_STRING", napi_create_string_utf8(env, "winreglib.readCursor", NAPI_AUTO_LENGTH, &name), NULL)
+
+	NAPI_THROW_RETURN("readCursor", "ERR_NAPI_CREATE_ASYNC_WORK", napi_create_async_work(
+		env,
+		NULL,
+		name,
+		readCursorExecute,
+		readCursorComplete,
+		read.get(),
+		&read->work
+	), NULL)
+
+	NAPI_THROW_RETURN("readCursor", "ERR_NAPI_QUEUE_ASYNC_WORK", napi_queue_async_work(env, read->work), NULL)
+	cursor->busy = true;
+	read.release();
+
+	return promise;
+}
 
-	DWORD numSubkeys = 0;
-	DWORD maxSubkeyLength = 0;
-	DWORD numValues = 0;
-	DWORD maxValueLength = 0;
+/**
+ * closeCursor() implementation for closing a cursor's key before it is garbage collected.
+ */
+NAPI_METHOD(closeCursor) {
+	NAPI_ARGV(1)
 
-	status = RegQueryInfoKeyW(hkey, NULL, NULL, NULL, &numSubkeys, &maxSubkeyLength, NULL, &numValues, &maxValueLength, NULL, NULL, NULL);
-	if (status != ERROR_SUCCESS) {
-		FORMAT_ERROR(status, "ERR_WINREG_QUERY_INFO_KEY", L"RegQueryInfoKey() failed")
-		RegCloseKey(hkey);
+	winreglib::Cursor* cursor = getCursor(env, argv[0]);
+	if (!cursor) {
 		return NULL;
 	}
 
-	LOG_DEBUG_4("list", L"%d keys (max %d), %d values (max %d)", numSubkeys, maxSubkeyLength, numValues, maxValueLength)
+	if (cursor->busy) {
+		THROW_ERROR("ERR_WINREG_CURSOR_BUSY", L"Cannot close a cursor while it is reading a page")
+		return NULL;
+	}
 
-	DWORD maxSize = (maxSubkeyLength > maxValueLength ? maxSubkeyLength : maxValueLength) + 1;
-	wchar_t* buffer = new wchar_t[maxSize];
+	cursor->close();
 
-	try {
-		for (DWORD i = 0; i < numSubkeys; ++i) {
-			SET_FROM_REGISTRY(RegEnumKeyExW, hkey, i, buffer, maxSize, "ERR_WINREG_ENUM_KEY", subkeys, subkeysPush)
-		}
+	NAPI_RETURN_UNDEFINED("closeCursor")
+}
+
+struct ExportWork {
+	winreglib::Exporter* exporter;
+	winreglib::ExportSink* sink;
+	LSTATUS status;
+	napi_deferred deferred;
+	napi_async_work work;
+};
+
+/**
+ * Exports the tree on a worker thread.
+ */
+static void exportTreeExecute(napi_env env, void* data) {
+	ExportWork* work = static_cast<ExportWork*>(data);
+	work->status = work->exporter->run();
+}
 
-		for (DWORD i = 0; i < numValues; ++i) {
-			SET_FROM_REGISTRY(RegEnumValueW, hkey, i, buffer, maxSize, "ERR_WINREG_ENUM_VALUE", values, valuesPush)
+/**
+ * Settles the promise returned by `exportTree()` on the main thread.
+ */
+static void exportTreeComplete(napi_env env, napi_status status, void* data) {
+	ExportWork* work = static_cast<ExportWork*>(data);
+	work->sink->close(env);
+
+	if (work->status == ERROR_WRITE_FAULT && !work->sink->error.empty()) {
+		std::wstring message(work->sink->error.begin(), work->sink->error.end());
+		napi_reject_deferred(env, work->deferred, createWin32Error(env, ERROR_SUCCESS, "ERR_WINREG_EXPORT_WRITE", message.c_str()));
+	} else if (work->status != ERROR_SUCCESS) {
+		LOG_DEBUG_1("exportTree", L"Failed to export (status=%d)", work->status)
+		napi_reject_deferred(env, work->deferred, createWin32Error(env, work->status, "ERR_WINREG_EXPORT", L"Failed to export key"));
+	} else {
+		winreglib::ExportStats& stats = work->exporter->stats;
+		napi_value result, keys, values, bytes, skipped;
+		if (napi_create_object(env, &result) == napi_ok &&
+			napi_create_double(env, (double)stats.keys, &keys) == napi_ok &&
+			napi_create_double(env, (double)stats.values, &values) == napi_ok &&
+			napi_create_double(env, (double)stats.bytes, &bytes) == napi_ok &&
+			napi_create_double(env, (double)stats.skipped, &skipped) == napi_ok &&
+			napi_set_named_property(env, result, "keys", keys) == napi_ok &&
+			napi_set_named_property(env, result, "values", values) == napi_ok &&
+			napi_set_named_property(env, result, "bytes", bytes) == napi_ok &&
+			napi_set_named_property(env, result, "skipped", skipped) == napi_ok
+		) {
+			napi_resolve_deferred(env, work->deferred, result);
+		} else {
+			napi_reject_deferred(env, work->deferred, createWin32Error(env, ERROR_SUCCESS, "ERR_WINREG_EXPORT", L"Failed to create export result"));
 		}
-	} catch (...) {
-		rval = NULL;
 	}
 
-	delete[] buffer;
-	RegCloseKey(hkey);
-	return rval;
+	napi_delete_async_work(env, work->work);
+	delete work->exporter;
+	delete work->sink;
+	delete work;
 }
 
 /**
- * Common watch/unwatch boilerplate.
+ * exportTree() implementation for serializing a key and its subkeys on a worker thread. Output is
+ * written to a file descriptor or passed to a `write(chunk, done)` callback. Returns a promise
+ * that resolves `{ keys, values, bytes, skipped }`.
  */
-napi_value watchHelper(napi_env env, napi_callback_info info, winreglib::WatchAction action) {
-	NAPI_ARGV(2);
+NAPI_METHOD(exportTree) {
+	NAPI_ARGV(4)
 	NAPI_ARGV_WSTRING(key, 1024, 0)
-	napi_value listener = argv[1];
+	bool binary = false;
+	uint32_t depth = 0;
+	napi_valuetype targetType;
+
+	NAPI_THROW_RETURN("exportTree", "ERR_NAPI_TYPEOF", napi_typeof(env, argv[1], &targetType), NULL)
+	NAPI_THROW_RETURN("exportTree", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &binary), NULL)
+	NAPI_THROW_RETURN("exportTree", "ERR_NAPI_GET_VALUE_UINT32", napi_get_value_uint32(env, argv[3], &depth), NULL)
 
 	std::string::size_type p = key.find('\\');
 	if (p == std::string::npos) {
@@ -345,78 +710,2814 @@ napi_value watchHelper(napi_env env, napi_callback_info info, winreglib::WatchAc
 	}
 
 	std::wstring root = key.substr(0, p);
-	auto it = winreglib::rootMap.find(root);
-	if (it != winreglib::rootMap.end()) {
-		root = it->second;
+	std::wstring subkey = key.substr(p + 1);
+
+	LOG_DEBUG_3("exportTree", L"key=\"%ls\" subkey=\"%ls\" depth=%u", root.c_str(), subkey.c_str(), depth)
+
+	HKEY hroot = winreglib::resolveRootKey(env, root);
+	if (!hroot) {
+		return NULL;
 	}
-	auto it2 = winreglib::rootKeys.find(root);
-	if (it2 == winreglib::rootKeys.end()) {
-		THROW_ERROR_1("ERR_WINREG_INVALID_ROOT", L"Invalid registry root key \"%s\"", root.c_str())
+
+	std::unique_ptr<winreglib::ExportSink> sink;
+	if (targetType == napi_number) {
+		int32_t fd;
+		uv_loop_t* loop;
+		NAPI_THROW_RETURN("exportTree", "ERR_NAPI_GET_VALUE_INT32", napi_get_value_int32(env, argv[1], &fd), NULL)
+		NAPI_THROW_RETURN("exportTree", "ERR_NAPI_GET_UV_EVENT_LOOP", napi_get_uv_event_loop(env, &loop), NULL)
+		sink.reset(new winreglib::FileSink(loop, fd));
+	} else if (targetType == napi_function) {
+		winreglib::CallbackSink* callbackSink = new winreglib::CallbackSink();
+		sink.reset(callbackSink);
+		napi_status s = callbackSink->init(env, argv[1]);
+		if (s != napi_ok) {
+			sink->close(env);
+			NAPI_THROW_RETURN("exportTree", "ERR_NAPI_CREATE_THREADSAFE_FUNCTION", s, NULL)
+		}
+	} else {
+		napi_throw_type_error(env, NULL, "Expected a file descriptor or write function");
 		return NULL;
 	}
-	key = root + key.substr(p);
 
-	const char* ns = action == winreglib::Watch ? "watch" : "unwatch";
-	LOG_DEBUG_1(ns, L"key=\"%ls\"", key.c_str())
+	HKEY hkey;
+	LSTATUS status = winreglib::backend->openKey(hroot, subkey.c_str(), KEY_READ, NULL, &hkey);
+	if (status != ERROR_SUCCESS) {
+		sink->close(env);
+	}
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
 
-	winreglib::watchman->config(key, listener, action);
+	std::wstring path = *winreglib::resolveRootName(root) + L"\\" + subkey;
+	std::unique_ptr<ExportWork> work(new ExportWork());
+	work->sink = sink.get();
+	work->exporter = new winreglib::Exporter(winreglib::backend, hkey, path, binary ? winreglib::Binary : winreglib::Ndjson, depth, sink.get());
+	work->status = ERROR_SUCCESS;
 
-	NAPI_RETURN_UNDEFINED(ns)
+	napi_value promise, name;
+	napi_status s = napi_create_promise(env, &work->deferred, &promise);
+	if (s == napi_ok) {
+		s = napi_create_string_utf8(env, "winreglib.exportTree", NAPI_AUTO_LENGTH, &name);
+	}
+	if (s == napi_ok) {
+		s = napi_create_async_work(env, NULL, name, exportTreeExecute, exportTreeComplete, work.get(), &work->work);
+	}
+	if (s == napi_ok) {
+		s = napi_queue_async_work(env, work->work);
+	}
+	if (s != napi_ok) {
+		sink->close(env);
+		delete work->exporter;
+		NAPI_THROW_RETURN("exportTree", "ERR_NAPI_QUEUE_ASYNC_WORK", s, NULL)
+	}
+
+	sink.release();
+	work.release();
+	return promise;
 }
 
+struct FingerprintWork {
+	winreglib::Fingerprinter* fingerprinter;
+	LSTATUS status;
+	napi_deferred deferred;
+	napi_async_work work;
+};
+
 /**
- * watch() implementation to watch a key for changes.
+ * Builds the snapshot on a worker thread.
  */
-NAPI_METHOD(watch) {
-	return watchHelper(env, info, winreglib::Watch);
+static void fingerprintExecute(napi_env env, void* data) {
+	FingerprintWork* work = static_cast<FingerprintWork*>(data);
+	work->status = work->fingerprinter->run();
 }
 
 /**
- * unwatch() implementation to stop watching a key for changes.
+ * Resolves the promise returned by `fingerprint()` with the snapshot buffer on the main thread.
  */
-NAPI_METHOD(unwatch) {
-	return watchHelper(env, info, winreglib::Unwatch);
+static void fingerprintComplete(napi_env env, napi_status status, void* data) {
+	FingerprintWork* work = static_cast<FingerprintWork*>(data);
+
+	if (work->status != ERROR_SUCCESS) {
+		LOG_DEBUG_1("fingerprint", L"Failed to fingerprint (status=%d)", work->status)
+		napi_reject_deferred(env, work->deferred, createWin32Error(env, work->status, "ERR_WINREG_FINGERPRINT", L"Failed to fingerprint key"));
+	} else {
+		LOG_DEBUG_3("fingerprint", L"Fingerprinted %llu keys, %llu values, skipped %llu keys",
+			(unsigned long long)work->fingerprinter->keys,
+			(unsigned long long)work->fingerprinter->values,
+			(unsigned long long)work->fingerprinter->skipped)
+
+		// the buffer takes ownership of the snapshot
+		std::vector<uint8_t>* snapshot = new std::vector<uint8_t>();
+		snapshot->swap(work->fingerprinter->snapshot);
+		napi_value result;
+		napi_status s = napi_create_external_buffer(env, snapshot->size(), snapshot->data(), [](napi_env env, void* data, void* hint) {
+			delete static_cast<std::vector<uint8_t>*>(hint);
+		}, snapshot, &result);
+		if (s == napi_no_external_buffers_allowed) {
+			s = napi_create_buffer_copy(env, snapshot->size(), snapshot->data(), NULL, &result);
+			delete snapshot;
+		} else if (s != napi_ok) {
+			delete snapshot;
+		}
+
+		if (s == napi_ok) {
+			napi_resolve_deferred(env, work->deferred, result);
+		} else {
+			napi_reject_deferred(env, work->deferred, createWin32Error(env, ERROR_SUCCESS, "ERR_WINREG_FINGERPRINT", L"Failed to create snapshot buffer"));
+		}
+	}
+
+	napi_delete_async_work(env, work->work);
+	delete work->fingerprinter;
+	delete work;
 }
 
 /**
- * Destroys the Watchman instance, log ref handle, and notify handle.
+ * fingerprint() implementation for hashing a key and its subkeys on a worker thread. Returns a
+ * promise that resolves a snapshot buffer that can be passed to `diff()`.
  */
-static void cleanup(napi_async_cleanup_hook_handle handle, void* env) {
-	if (winreglib::watchman != NULL) {
-		delete winreglib::watchman;
-	}
+NAPI_METHOD(fingerprint) {
+	NAPI_ARGV(1)
+	NAPI_ARGV_WSTRING(key, 1024, 0)
 
-	if (winreglib::logRef != NULL) {
-		napi_delete_reference((napi_env)env, winreglib::logRef);
-		winreglib::logRef = NULL;
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
 	}
 
-	if (winreglib::logNotify != NULL) {
-		uv_close((uv_handle_t*)winreglib::logNotify, [](uv_handle_t* handle) {
-			if (handle) {
-				delete handle;
-			}
-		});
+	std::wstring root = key.substr(0, p);
+	std::wstring subkey = key.substr(p + 1);
+
+	LOG_DEBUG_2("fingerprint", L"key=\"%ls\" subkey=\"%ls\"", root.c_str(), subkey.c_str())
+
+	HKEY hroot = winreglib::resolveRootKey(env, root);
+	if (!hroot) {
+		return NULL;
 	}
 
-	napi_remove_async_cleanup_hook(handle);
-}
+	HKEY hkey;
+	LSTATUS status = winreglib::backend->openKey(hroot, subkey.c_str(), KEY_READ, NULL, &hkey);
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+
+	std::wstring path = *winreglib::resolveRootName(root) + L"\\" + subkey;
+	std::unique_ptr<FingerprintWork> work(new FingerprintWork());
+	work->fingerprinter = new winreglib::Fingerprinter(winreglib::backend, hkey, path);
+	work->status = ERROR_SUCCESS;
+
+	napi_value promise, name;
+	napi_status s = napi_create_promise(env, &work->deferred, &promise);
+	if (s == napi_ok) {
+		s = napi_create_string_utf8(env, "winreglib.fingerprint", NAPI_AUTO_LENGTH, &name);
+	}
+	if (s == napi_ok) {
+		s = napi_create_async_work(env, NULL, name, fingerprintExecute, fingerprintComplete, work.get(), &work->work);
+	}
+	if (s == napi_ok) {
+		s = napi_queue_async_work(env, work->work);
+	}
+	if (s != napi_ok) {
+		delete work->fingerprinter;
+		NAPI_THROW_RETURN("fingerprint", "ERR_NAPI_QUEUE_ASYNC_WORK", s, NULL)
+	}
+
+	work.release();
+	return promise;
+}
+
+/**
+ * Gets the contents of a snapshot buffer.
+ */
+static bool getSnapshot(napi_env env, napi_value value, const uint8_t** data, size_t* len) {
+	bool isBuffer = false;
+	void* buffer = NULL;
+	if (napi_is_buffer(env, value, &isBuffer) != napi_ok || !isBuffer ||
+		napi_get_buffer_info(env, value, &buffer, len) != napi_ok
+	) {
+		napi_throw_type_error(env, "ERR_WINREG_INVALID_SNAPSHOT", "Expected snapshot to be a buffer");
+		return false;
+	}
+	*data = static_cast<const uint8_t*>(buffer);
+	return true;
+}
+
+/**
+ * diff() implementation for comparing two snapshots. Returns an array of
+ * `{ type, key, value? }` objects.
+ */
+NAPI_METHOD(diff) {
+	NAPI_ARGV(2)
+	const uint8_t* a;
+	const uint8_t* b;
+	size_t aLen, bLen;
+
+	if (!getSnapshot(env, argv[0], &a, &aLen) || !getSnapshot(env, argv[1], &b, &bLen)) {
+		return NULL;
+	}
+
+	std::vector<winreglib::DiffEntry> entries;
+	if (!winreglib::diffSnapshots(a, aLen, b, bLen, entries)) {
+		THROW_ERROR("ERR_WINREG_INVALID_SNAPSHOT", L"Invalid snapshot")
+		return NULL;
+	}
+
+	LOG_DEBUG_1("diff", L"Found %llu differences", (unsigned long long)entries.size())
+
+	static const char* const types[] = { "added", "removed", "modified" };
+	napi_value result;
+	NAPI_THROW_RETURN("diff", "ERR_NAPI_CREATE_ARRAY", napi_create_array_with_length(env, entries.size(), &result), NULL)
+
+	for (uint32_t i = 0; i < entries.size(); ++i) {
+		winreglib::DiffEntry& entry = entries[i];
+		napi_value obj, type, key;
+		NAPI_THROW_RETURN("diff", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &obj), NULL)
+		NAPI_THROW_RETURN("diff", "ERR_NAPI_CREATE_STRING", napi_create_string_utf8(env, types[entry.type], NAPI_AUTO_LENGTH, &type), NULL)
+		NAPI_THROW_RETURN("diff", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, entry.key.c_str(), entry.key.length(), &key), NULL)
+		NAPI_THROW_RETURN("diff", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, obj, "type", type), NULL)
+		NAPI_THROW_RETURN("diff", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, obj, "key", key), NULL)
+		if (entry.isValue) {
+			napi_value value;
+			NAPI_THROW_RETURN("diff", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, entry.value.c_str(), entry.value.length(), &value), NULL)
+			NAPI_THROW_RETURN("diff", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, obj, "value", value), NULL)
+		}
+		NAPI_THROW_RETURN("diff", "ERR_NAPI_SET_ELEMENT", napi_set_element(env, result, i, obj), NULL)
+	}
+
+	return result;
+}
+
+/**
+ * Common get/tryGet boilerplate. When `probe` is true, a missing key or value returns `undefined`
+ * instead of throwing.
+ */
+static napi_value getHelper(napi_env env, napi_callback_info info, bool probe) {
+	const char* ns = probe ? "tryGet" : "get";
+	NAPI_ARGV(3)
+	NAPI_ARGV_WSTRING(key, 1024, 0)
+	NAPI_ARGV_WSTRING(valueName, 256, 1)
+
+	bool bigint = false;
+	if (argc > 2) {
+		NAPI_THROW_RETURN(ns, "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &bigint), NULL)
+	}
+
+	winreglib::TimelineSpan span("api", ns, key);
+
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
+	}
+
+	std::wstring subkey = key.substr(p + 1);
+	key.erase(p);
+
+	LOG_DEBUG_3(ns, L"key=\"%ls\" subkey=\"%ls\" valueName=\"%ls\"", key.c_str(), subkey.c_str(), valueName.c_str())
+
+	HKEY hroot = winreglib::resolveRootKey(env, key);
+	if (!hroot) {
+		return NULL;
+	}
+
+	DWORD keyType = 0;
+	DWORD dataSize = 0;
+	std::unique_ptr<BYTE[]> data;
+	LSTATUS status;
+
+	if (hroot == HKEY_PERFORMANCE_DATA) {
+		// performance data doesn't report its size, so read it into a growing buffer
+		std::vector<BYTE> buffer;
+		status = winreglib::readPerfValue(winreglib::backend, hroot, subkey.c_str(), valueName.c_str(), buffer, dataSize, &keyType);
+		if (status == ERROR_SUCCESS) {
+			data.reset(new BYTE[dataSize]);
+			::memcpy(data.get(), buffer.data(), dataSize);
+		}
+	} else {
+		{
+			winreglib::TimelineSpan call("registry", "RegGetValue", valueName);
+			status = winreglib::backend->getValue(hroot, subkey.c_str(), valueName.c_str(), RRF_RT_ANY, &keyType, NULL, &dataSize);
+		}
+		if (status == ERROR_SUCCESS) {
+			LOG_DEBUG_2(ns, L"Type=%ld Size=%ld", keyType, dataSize);
+
+			// owned by a unique_ptr so that it is freed on every error path, binary values release
+			// it to the returned buffer
+			data.reset(new BYTE[dataSize]);
+			winreglib::TimelineSpan call("registry", "RegGetValue", valueName);
+			status = winreglib::backend->getValue(hroot, subkey.c_str(), valueName.c_str(), RRF_RT_ANY, NULL, data.get(), &dataSize);
+		}
+	}
+
+	// a probe that misses skips building an error altogether
+	if (probe && status == ERROR_FILE_NOT_FOUND) {
+		NAPI_RETURN_UNDEFINED(ns)
+	}
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_GET_VALUE", L"RegGetValue() failed")
+
+	napi_value rval;
+	ValueSink sink(env, &rval, bigint);
+	sink.owned = std::move(data);
+	NAPI_THROW_RETURN(ns, "ERR_NAPI_CREATE_VALUE", winreglib::decodeValue(sink, keyType, sink.owned.get(), dataSize), NULL)
+
+	return rval;
+}
+
+/**
+ * get() implementation for getting a value for the given key and valueName.
+ */
+NAPI_METHOD(get) {
+	return getHelper(env, info, false);
+}
+
+/**
+ * tryGet() implementation for getting a value, or `undefined` if the key or value doesn't exist.
+ */
+NAPI_METHOD(tryGet) {
+	return getHelper(env, info, true);
+}
+
+/**
+ * Checks if a value exists without reading its data. Performance data can't be sized, so
+ * `ERROR_MORE_DATA` also means the value exists.
+ */
+static LSTATUS probeValue(HKEY hkey, const wchar_t* subkey, const wchar_t* name, bool& exists) {
+	LSTATUS status = winreglib::backend->getValue(hkey, subkey, name, RRF_RT_ANY, NULL, NULL, NULL);
+	exists = status == ERROR_SUCCESS || status == ERROR_MORE_DATA;
+	return exists || status == ERROR_FILE_NOT_FOUND ? ERROR_SUCCESS : status;
+}
+
+/**
+ * has() implementation for checking if a key, or a value when a name is passed, exists. Missing
+ * keys and values return false, other failures such as access being denied still throw.
+ */
+NAPI_METHOD(has) {
+	NAPI_ARGV(2)
+	NAPI_ARGV_WSTRING(key, 1024, 0)
+
+	napi_valuetype type;
+	NAPI_THROW_RETURN("has", "ERR_NAPI_TYPEOF", napi_typeof(env, argv[1], &type), NULL)
+
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
+	}
+
+	std::wstring subkey = key.substr(p + 1);
+	key.erase(p);
+
+	HKEY hroot = winreglib::resolveRootKey(env, key);
+	if (!hroot) {
+		return NULL;
+	}
+
+	bool exists = false;
+	if (type == napi_string) {
+		NAPI_ARGV_WSTRING(valueName, 256, 1)
+		LSTATUS status = probeValue(hroot, subkey.c_str(), valueName.c_str(), exists);
+		ASSERT_WIN32_STATUS(status, "ERR_WINREG_GET_VALUE", L"RegGetValue() failed")
+	} else {
+		HKEY hkey;
+		LSTATUS status = winreglib::backend->openKey(hroot, subkey.c_str(), KEY_QUERY_VALUE, NULL, &hkey);
+		if (status == ERROR_SUCCESS) {
+			exists = true;
+			winreglib::backend->closeKey(hkey);
+		} else if (status != ERROR_FILE_NOT_FOUND) {
+			FORMAT_ERROR(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+			return NULL;
+		}
+	}
+
+	napi_value rval;
+	NAPI_THROW_RETURN("has", "ERR_NAPI_GET_BOOLEAN", napi_get_boolean(env, exists, &rval), NULL)
+	return rval;
+}
+
+/**
+ * hasMany() implementation for checking which of a key's values exist. The key is opened once and
+ * a missing key means none of the values exist.
+ */
+NAPI_METHOD(hasMany) {
+	NAPI_ARGV(2)
+	NAPI_ARGV_WSTRING(key, 1024, 0)
+
+	uint32_t count = 0;
+	std::vector<std::wstring> names;
+	NAPI_THROW_RETURN("hasMany", "ERR_NAPI_GET_ARRAY_LENGTH", napi_get_array_length(env, argv[1], &count), NULL)
+	for (uint32_t i = 0; i < count; ++i) {
+		napi_value element;
+		size_t len = 0;
+		NAPI_THROW_RETURN("hasMany", "ERR_NAPI_GET_ELEMENT", napi_get_element(env, argv[1], i, &element), NULL)
+		NAPI_THROW_RETURN("hasMany", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf16(env, element, NULL, 0, &len), NULL)
+		std::u16string name(len, u'\0');
+		NAPI_THROW_RETURN("hasMany", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf16(env, element, &name[0], len + 1, &len), NULL)
+		names.push_back(std::wstring(name.begin(), name.end()));
+	}
+
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
+	}
+
+	std::wstring subkey = key.substr(p + 1);
+	key.erase(p);
+
+	HKEY hroot = winreglib::resolveRootKey(env, key);
+	if (!hroot) {
+		return NULL;
+	}
+
+	std::vector<bool> exists(count, false);
+	HKEY hkey;
+	LSTATUS status = winreglib::backend->openKey(hroot, subkey.c_str(), KEY_QUERY_VALUE, NULL, &hkey);
+	if (status == ERROR_SUCCESS) {
+		for (uint32_t i = 0; status == ERROR_SUCCESS && i < count; ++i) {
+			bool found = false;
+			status = probeValue(hkey, NULL, names[i].c_str(), found);
+			exists[i] = found;
+		}
+		winreglib::backend->closeKey(hkey);
+		ASSERT_WIN32_STATUS(status, "ERR_WINREG_GET_VALUE", L"RegGetValue() failed")
+	} else if (status != ERROR_FILE_NOT_FOUND) {
+		FORMAT_ERROR(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+		return NULL;
+	}
+
+	napi_value results;
+	NAPI_THROW_RETURN("hasMany", "ERR_NAPI_CREATE_ARRAY", napi_create_array_with_length(env, count, &results), NULL)
+	for (uint32_t i = 0; i < count; ++i) {
+		napi_value result;
+		NAPI_THROW_RETURN("hasMany", "ERR_NAPI_GET_BOOLEAN", napi_get_boolean(env, exists[i], &result), NULL)
+		NAPI_THROW_RETURN("hasMany", "ERR_NAPI_SET_ELEMENT", napi_set_element(env, results, i, result), NULL)
+	}
+
+	return results;
+}
+
+/**
+ * Emits a single log message. A failure is reported as a fatal exception.
+ */
+static void emitLog(napi_env env, napi_value global, napi_value logFn, std::shared_ptr<winreglib::LogMessage> obj) {
+	napi_value argv[2], rval;
+
+	if (obj->ns.length()) {
+		NAPI_FATAL("dispatchLog", napi_create_string_utf8(env, obj->ns.c_str(), obj->ns.length(), &argv[0]))
+	} else {
+		NAPI_FATAL("dispatchLog", napi_get_null(env, &argv[0]))
+	}
+	NAPI_FATAL("dispatchLog", napi_create_string_utf16(env, obj->msg.c_str(), obj->msg.length(), &argv[1]))
+
+	// we have to create an async context to prevent domain.enter error
+	napi_value resName;
+	NAPI_FATAL("dispatchLog", napi_create_string_utf8(env, "winreglib.log", NAPI_AUTO_LENGTH, &resName))
+	napi_async_context ctx;
+	NAPI_FATAL("dispatchLog", napi_async_init(env, NULL, resName, &ctx))
+
+	// emit the log message
+	napi_status status = napi_make_callback(env, ctx, global, logFn, 2, argv, &rval);
+
+	napi_async_destroy(env, ctx);
+
+	NAPI_FATAL("dispatchLog", status)
+}
+
+/**
+ * Emits queued log messages.
+ */
+static void dispatchLog(uv_async_t* handle) {
+	winreglib::Instance* instance = (winreglib::Instance*)handle->data;
+	napi_env env = instance->env;
+	napi_handle_scope scope;
+	napi_value global, logFn;
+
+	if (!instance->logRef) {
+		return;
+	}
+
+	// take the queued messages so that the lock isn't held while calling into JavaScript
+	std::queue<std::shared_ptr<winreglib::LogMessage>> messages;
+	{
+		std::lock_guard<std::mutex> lock(instance->logLock);
+		std::swap(messages, instance->logQueue);
+	}
+
+	NAPI_FATAL("dispatchLog", napi_open_handle_scope(env, &scope))
+
+	// the scope must be closed even if a message could not be emitted, for example when a worker
+	// is being terminated
+	if (napi_get_reference_value(env, instance->logRef, &logFn) == napi_ok && logFn != NULL && napi_get_global(env, &global) == napi_ok) {
+		bool pending = false;
+		while (!messages.empty() && !pending) {
+			emitLog(env, global, logFn, messages.front());
+			messages.pop();
+			napi_is_exception_pending(env, &pending);
+		}
+	}
+
+	napi_close_handle_scope(env, scope);
+}
+
+/**
+ * Converts a FILETIME to milliseconds since January 1, 1970 (UTC).
+ */
+static double fileTimeToMs(const FILETIME& ft) {
+	uint64_t ticks = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+	return ((double)ticks - 116444736000000000.0) / 10000.0;
+}
+
+/**
+ * info() implementation for getting the subkey and value counts, maximum name and data lengths,
+ * and last write time of a key.
+ */
+NAPI_METHOD(info) {
+	NAPI_ARGV(1)
+	NAPI_ARGV_WSTRING(key, 1024, 0)
+
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
+	}
+
+	std::wstring root = key.substr(0, p);
+	std::wstring subkey = key.substr(p + 1);
+
+	LOG_DEBUG_2("info", L"key=\"%ls\" subkey=\"%ls\"", root.c_str(), subkey.c_str())
+
+	HKEY hroot = winreglib::resolveRootKey(env, root);
+	if (!hroot) {
+		return NULL;
+	}
+
+	HKEY hkey;
+	LSTATUS status = winreglib::backend->openKey(hroot, subkey.c_str(), KEY_READ, NULL, &hkey);
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+
+	DWORD numSubkeys = 0;
+	DWORD maxSubkeyLength = 0;
+	DWORD numValues = 0;
+	DWORD maxValueNameLength = 0;
+	DWORD maxValueLength = 0;
+	FILETIME lastWriteTime;
+
+	status = winreglib::backend->queryInfoKey(hkey, &numSubkeys, &maxSubkeyLength, &numValues, &maxValueNameLength, &maxValueLength, &lastWriteTime);
+	winreglib::backend->closeKey(hkey);
+	if (status != ERROR_SUCCESS) {
+		FORMAT_ERROR(status, "ERR_WINREG_QUERY_INFO_KEY", L"RegQueryInfoKey() failed")
+		return NULL;
+	}
+
+	const std::pair<const char*, DWORD> counts[] = {
+		{ "subkeys",            numSubkeys },
+		{ "values",             numValues },
+		{ "maxSubkeyLength",    maxSubkeyLength },
+		{ "maxValueNameLength", maxValueNameLength },
+		{ "maxValueLength",     maxValueLength }
+	};
+
+	napi_value rval, date;
+	NAPI_THROW_RETURN("info", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
+	for (auto const& it : counts) {
+		napi_value count;
+		NAPI_THROW_RETURN("info", "ERR_NAPI_CREATE_UINT32", napi_create_uint32(env, it.second, &count), NULL)
+		NAPI_THROW_RETURN("info", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, it.first, count), NULL)
+	}
+	NAPI_THROW_RETURN("info", "ERR_NAPI_CREATE_DATE", napi_create_date(env, fileTimeToMs(lastWriteTime), &date), NULL)
+	NAPI_THROW_RETURN("info", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "lastWriteTime", date), NULL)
+
+	return rval;
+}
+
+/**
+ * init() implementation for wiring up the log message notification handler and printing the
+ * winreglib banner.
+ */
+NAPI_METHOD(init) {
+	NAPI_ARGV(1);
+	napi_value logFn = argv[0];
+
+	winreglib::Instance* instance = winreglib::Instance::get(env);
+	winreglib::Timeline::setThreadName("JavaScript");
+
+	// create the reference for the emit log callback so it doesn't get GC'd
+	if (instance->logRef) {
+		napi_delete_reference(env, instance->logRef);
+		instance->logRef = NULL;
+	}
+	NAPI_THROW_RETURN("init", "ERR_NAPI_CREATE_REFERENCE", napi_create_reference(env, logFn, 1, &instance->logRef), NULL)
+
+	// print the banner
+	napi_value global, result, args[2];
+	uint32_t apiVersion;
+	char banner[128];
+	const napi_node_version* ver;
+	NAPI_THROW_RETURN("init", "ERR_NAPI_GET_GLOBAL", napi_get_global(env, &global), NULL)
+	NAPI_THROW_RETURN("init", "ERR_NAPI_GET_NULL", napi_get_null(env, &args[0]), NULL)
+	NAPI_THROW_RETURN("init", "ERR_NAPI_GET_VERSION", napi_get_version(env, &apiVersion), NULL)
+	NAPI_THROW_RETURN("init", "ERR_NAPI_GET_NODE_VERSION", napi_get_node_version(env, &ver), NULL)
+	snprintf(banner, 128, "v" WINREGLIB_VERSION " <" WINREGLIB_URL "> (%s %d.%d.%d/n-api %d)", ver->release, ver->major, ver->minor, ver->patch, apiVersion);
+	NAPI_THROW_RETURN("init", "ERR_NAPI_CREATE_STRING", napi_create_string_utf8(env, banner, strlen(banner), &args[1]), NULL)
+	NAPI_THROW_RETURN("init", "ERR_NAPI_CALL_FUNCTION", napi_call_function(env, global, logFn, 2, args, &result), NULL)
+
+	NAPI_RETURN_UNDEFINED("init")
+}
+
+/**
+ * Creates a typed array over the next `length` elements of a buffer.
+ */
+static napi_status createColumn(napi_env env, napi_typedarray_type type, size_t length, napi_value buffer, size_t& offset, napi_value* result) {
+	napi_status status = napi_create_typedarray(env, type, length, buffer, offset, result);
+	switch (type) {
+		case napi_float64_array: offset += length * sizeof(double); break;
+		case napi_uint16_array:  offset += length * sizeof(char16_t); break;
+		case napi_uint8_array:   offset += length; break;
+		default:                 offset += length * sizeof(uint32_t);
+	}
+	return status;
+}
+
+/**
+ * Creates the object for a columnar result. Every column is a typed array over a single
+ * `ArrayBuffer`, ordered by element size so that each one is aligned, which leaves the garbage
+ * collector a dozen objects to track instead of one per name and value.
+ */
+static napi_status createColumns(napi_env env, const winreglib::ColumnBuilder& columns, napi_value* result) {
+	const std::vector<uint32_t>* u32[] = { &columns.keys.offsets, &columns.names.offsets, &columns.rows, &columns.types, &columns.textOffsets, &columns.dataOffsets };
+	const char* u32Names[] = { "keyOffsets", "nameOffsets", "rows", "types", "textOffsets", "dataOffsets" };
+	const std::u16string* u16[] = { &columns.keys.units, &columns.names.units, &columns.text };
+	const char* u16Names[] = { "keys", "names", "text" };
+
+	size_t total = columns.numbers.size() * sizeof(double)
+		+ (columns.keys.units.length() + columns.names.units.length() + columns.text.length()) * sizeof(char16_t)
+		+ columns.data.size()
+		+ columns.kinds.size();
+	for (const std::vector<uint32_t>* column : u32) {
+		total += column->size() * sizeof(uint32_t);
+	}
+
+	void* ptr = NULL;
+	napi_value buffer, column;
+	napi_status s = napi_create_arraybuffer(env, total, &ptr, &buffer);
+	if (s == napi_ok) s = napi_create_object(env, result);
+
+	BYTE* dest = static_cast<BYTE*>(ptr);
+	size_t offset = 0;
+	auto copy = [&](const void* src, size_t size) {
+		if (size) {
+			::memcpy(dest + offset, src, size);
+		}
+	};
+
+	if (s == napi_ok) {
+		copy(columns.numbers.data(), columns.numbers.size() * sizeof(double));
+		s = createColumn(env, napi_float64_array, columns.numbers.size(), buffer, offset, &column);
+	}
+	if (s == napi_ok) s = napi_set_named_property(env, *result, "numbers", column);
+	for (size_t i = 0; s == napi_ok && i < sizeof(u32) / sizeof(u32[0]); ++i) {
+		copy(u32[i]->data(), u32[i]->size() * sizeof(uint32_t));
+		s = createColumn(env, napi_uint32_array, u32[i]->size(), buffer, offset, &column);
+		if (s == napi_ok) s = napi_set_named_property(env, *result, u32Names[i], column);
+	}
+	for (size_t i = 0; s == napi_ok && i < sizeof(u16) / sizeof(u16[0]); ++i) {
+		copy(u16[i]->data(), u16[i]->length() * sizeof(char16_t));
+		s = createColumn(env, napi_uint16_array, u16[i]->length(), buffer, offset, &column);
+		if (s == napi_ok) s = napi_set_named_property(env, *result, u16Names[i], column);
+	}
+	if (s == napi_ok) {
+		copy(columns.data.data(), columns.data.size());
+		s = createColumn(env, napi_uint8_array, columns.data.size(), buffer, offset, &column);
+	}
+	if (s == napi_ok) s = napi_set_named_property(env, *result, "data", column);
+	if (s == napi_ok) {
+		copy(columns.kinds.data(), columns.kinds.size());
+		s = createColumn(env, napi_uint8_array, columns.kinds.size(), buffer, offset, &column);
+	}
+	if (s == napi_ok) s = napi_set_named_property(env, *result, "kinds", column);
+
+	return s;
+}
+
+/**
+ * Enumerates a key's subkeys and values, with their types, into columns.
+ */
+static bool enumColumns(napi_env env, HKEY hkey, DWORD numSubkeys, DWORD numValues, std::vector<wchar_t>& buffer, winreglib::ColumnBuilder& columns) {
+	for (DWORD i = 0; i < numSubkeys; ++i) {
+		DWORD size = (DWORD)buffer.size();
+		LSTATUS status;
+		{
+			winreglib::TimelineSpan call("registry", "RegEnumKeyEx");
+			status = winreglib::backend->enumKey(hkey, i, buffer.data(), &size);
+		}
+		if (status == ERROR_NO_MORE_ITEMS) {
+			break;
+		}
+		if (status != ERROR_SUCCESS) {
+			FORMAT_ERROR(status, "ERR_WINREG_ENUM_KEY", L"RegEnumKeyExW failed")
+			return false;
+		}
+		columns.keys.add(buffer.data(), size);
+	}
+
+	for (DWORD i = 0; i < numValues; ++i) {
+		DWORD size = (DWORD)buffer.size();
+		DWORD type = REG_NONE;
+		LSTATUS status;
+		{
+			winreglib::TimelineSpan call("registry", "RegEnumValue");
+			status = winreglib::backend->enumValue(hkey, i, buffer.data(), &size, &type, NULL, NULL);
+		}
+		if (status == ERROR_NO_MORE_ITEMS) {
+			break;
+		}
+		if (status != ERROR_SUCCESS) {
+			FORMAT_ERROR(status, "ERR_WINREG_ENUM_VALUE", L"RegEnumValueW failed")
+			return false;
+		}
+		columns.addValue(buffer.data(), size, type);
+	}
+
+	columns.endKey();
+	return true;
+}
+
+/**
+ * Enumerates the names of a key's subkeys or values into an array preallocated to `count`
+ * elements. Returns `false` if an exception was thrown.
+ */
+static bool enumNames(napi_env env, HKEY hkey, bool values, DWORD count, std::vector<wchar_t>& buffer, napi_value* result) {
+	NAPI_THROW_RETURN("list", "ERR_NAPI_CREATE_ARRAY", napi_create_array_with_length(env, count, result), false)
+
+	for (DWORD i = 0; i < count; ++i) {
+		DWORD size = (DWORD)buffer.size();
+		LSTATUS status;
+		{
+			winreglib::TimelineSpan call("registry", values ? "RegEnumValue" : "RegEnumKeyEx");
+			status = values
+				? winreglib::backend->enumValue(hkey, i, buffer.data(), &size, NULL, NULL, NULL)
+				: winreglib::backend->enumKey(hkey, i, buffer.data(), &size);
+		}
+
+		if (status == ERROR_NO_MORE_ITEMS) {
+			// the key was modified since it was queried, so trim the array
+			napi_value length;
+			NAPI_THROW_RETURN("list", "ERR_NAPI_CREATE_UINT32", napi_create_uint32(env, i, &length), false)
+			NAPI_THROW_RETURN("list", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, *result, "length", length), false)
+			break;
+		}
+
+		if (status != ERROR_SUCCESS) {
+			if (values) {
+				FORMAT_ERROR(status, "ERR_WINREG_ENUM_VALUE", L"RegEnumValueW failed")
+			} else {
+				FORMAT_ERROR(status, "ERR_WINREG_ENUM_KEY", L"RegEnumKeyExW failed")
+			}
+			return false;
+		}
+
+		napi_value name;
+		NAPI_THROW_RETURN("list", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, buffer.data(), size, &name), false)
+		NAPI_THROW_RETURN("list", "ERR_NAPI_SET_ELEMENT", napi_set_element(env, *result, i, name), false)
+	}
+
+	return true;
+}
+
+/**
+ * list() implementation for retrieving all subkeys and values for a given key. When `columnar`
+ * is true, the names are returned as columns along with the value types.
+ */
+NAPI_METHOD(list) {
+	NAPI_ARGV(2);
+	NAPI_ARGV_WSTRING(key, 1024, 0)
+
+	bool columnar = false;
+	napi_valuetype columnarType;
+	NAPI_THROW_RETURN("list", "ERR_NAPI_TYPEOF", napi_typeof(env, argv[1], &columnarType), NULL)
+	if (columnarType == napi_boolean) {
+		NAPI_THROW_RETURN("list", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[1], &columnar), NULL)
+	}
+
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
+	}
+
+	std::wstring root = key.substr(0, p);
+	std::wstring subkey = key.substr(p + 1);
+
+	LOG_DEBUG_2("list", L"key=\"%ls\" subkey=\"%ls\"", root.c_str(), subkey.c_str())
+	winreglib::TimelineSpan span("api", "list", key);
+
+	HKEY hroot = winreglib::resolveRootKey(env, root);
+	if (!hroot) {
+		return NULL;
+	}
+
+	HKEY hkey;
+	LSTATUS status;
+	{
+		winreglib::TimelineSpan call("registry", "RegOpenKeyEx", subkey);
+		status = winreglib::backend->openKey(hroot, subkey.c_str(), KEY_READ, NULL, &hkey);
+	}
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+
+	std::wstring* resolvedRoot = winreglib::resolveRootName(root);
+	if (!resolvedRoot) {
+		THROW_ERROR_1("ERR_WINREG_INVALID_ROOT", L"Invalid registry root key \"%ls\"", key.c_str())
+		return NULL;
+	}
+
+	// add back the resolved root
+	key = *resolvedRoot + L'\\' + subkey;
+
+	napi_value rval;
+	napi_value subkeys;
+	napi_value values;
+
+	DWORD numSubkeys = 0;
+	DWORD maxSubkeyLength = 0;
+	DWORD numValues = 0;
+	DWORD maxValueLength = 0;
+
+	auto closeKey = [&]() {
+		winreglib::TimelineSpan call("registry", "RegCloseKey");
+		winreglib::backend->closeKey(hkey);
+	};
+
+	{
+		winreglib::TimelineSpan call("registry", "RegQueryInfoKey");
+		status = winreglib::backend->queryInfoKey(hkey, &numSubkeys, &maxSubkeyLength, &numValues, &maxValueLength, NULL, NULL);
+	}
+	if (status != ERROR_SUCCESS) {
+		FORMAT_ERROR(status, "ERR_WINREG_QUERY_INFO_KEY", L"RegQueryInfoKey() failed")
+		closeKey();
+		return NULL;
+	}
+
+	LOG_DEBUG_4("list", L"%d keys (max %d), %d values (max %d)", numSubkeys, maxSubkeyLength, numValues, maxValueLength)
+
+	DWORD maxSize = (maxSubkeyLength > maxValueLength ? maxSubkeyLength : maxValueLength) + 1;
+	std::vector<wchar_t> buffer(maxSize);
+
+	if (columnar) {
+		winreglib::ColumnBuilder columns;
+		bool success = enumColumns(env, hkey, numSubkeys, numValues, buffer, columns);
+		closeKey();
+		if (!success) {
+			return NULL;
+		}
+
+		NAPI_THROW_RETURN("list", "ERR_NAPI_CREATE_OBJECT", createColumns(env, columns, &rval), NULL)
+		SET_PROP_FROM_WSTRING(rval, "resolvedRoot", resolvedRoot)
+		SET_PROP_FROM_WSTRING(rval, "key", &key)
+		return rval;
+	}
+
+	bool success = enumNames(env, hkey, false, numSubkeys, buffer, &subkeys)
+		&& enumNames(env, hkey, true, numValues, buffer, &values);
+	closeKey();
+	if (!success) {
+		return NULL;
+	}
+
+	NAPI_THROW_RETURN("list", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
+	SET_PROP_FROM_WSTRING(rval, "resolvedRoot", resolvedRoot)
+	SET_PROP_FROM_WSTRING(rval, "key", &key)
+	NAPI_THROW_RETURN("list", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "subkeys", subkeys), NULL)
+	NAPI_THROW_RETURN("list", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "values", values), NULL)
+
+	return rval;
+}
+
+/**
+ * Converts a `SYSTEMTIME` in UTC to milliseconds since the epoch, or NaN if it isn't valid.
+ */
+static double systemTimeToMs(const uint16_t* st) {
+	if (st[1] < 1 || st[1] > 12) {
+		return NAN;
+	}
+
+	// days since the epoch from the civil date, shifted so the year starts in March
+	int y = (int)st[0] - (st[1] <= 2 ? 1 : 0);
+	int era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned)(y - era * 400);
+	unsigned doy = (153 * (st[1] > 2 ? st[1] - 3 : st[1] + 9) + 2) / 5 + st[3] - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	double days = era * 146097.0 + doe - 719468.0;
+
+	return ((days * 24 + st[4]) * 60 + st[5]) * 60000.0 + st[6] * 1000.0 + st[7];
+}
+
+/**
+ * Creates the object for a parsed performance data sample. Counter definitions, instance ids,
+ * and values are typed arrays over a single `ArrayBuffer`, so a sample costs a handful of
+ * allocations no matter how many counters it has. The values of every object come first so that
+ * the 8-byte columns are aligned.
+ */
+static napi_value createPerfSample(napi_env env, const winreglib::PerfData& data) {
+	size_t total = 0;
+	size_t valuesLength = 0;
+	for (size_t i = 0; i < data.objectCount; ++i) {
+		const winreglib::PerfObject& obj = data.objects[i];
+		valuesLength += obj.values.size() * sizeof(double);
+		total += (obj.counters.size() * 6 + obj.instances.size() * 3) * sizeof(uint32_t);
+	}
+	total += valuesLength;
+
+	napi_value result, buffer, objects, value;
+	void* bytes = NULL;
+	NAPI_THROW_RETURN("readPerfData", "ERR_NAPI_CREATE_ARRAYBUFFER", napi_create_arraybuffer(env, total, &bytes, &buffer), NULL)
+	NAPI_THROW_RETURN("readPerfData", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &result), NULL)
+	NAPI_THROW_RETURN("readPerfData", "ERR_NAPI_CREATE_ARRAY", napi_create_array_with_length(env, data.objectCount, &objects), NULL)
+
+	napi_status s = winreglib::createWideString(env, data.systemName.c_str(), data.systemName.length(), &value);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "systemName", value);
+	if (s == napi_ok) s = napi_create_date(env, systemTimeToMs(data.systemTime), &value);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "systemTime", value);
+	if (s == napi_ok) s = napi_create_double(env, (double)data.time, &value);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "time", value);
+	if (s == napi_ok) s = napi_create_double(env, (double)data.frequency, &value);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "frequency", value);
+	if (s == napi_ok) s = napi_create_double(env, (double)data.time100ns, &value);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "time100ns", value);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "objects", objects);
+
+	BYTE* base = (BYTE*)bytes;
+	size_t valuesOffset = 0;
+	size_t offset = valuesLength;
+
+	for (uint32_t i = 0; s == napi_ok && i < data.objectCount; ++i) {
+		const winreglib::PerfObject& obj = data.objects[i];
+		size_t numCounters = obj.counters.size();
+		size_t numInstances = obj.instances.size();
+		napi_value o, counters, instances, column;
+
+		s = napi_create_object(env, &o);
+		if (s == napi_ok) s = napi_create_uint32(env, obj.nameIndex, &value);
+		if (s == napi_ok) s = napi_set_named_property(env, o, "index", value);
+		if (s == napi_ok) s = napi_create_uint32(env, obj.helpIndex, &value);
+		if (s == napi_ok) s = napi_set_named_property(env, o, "helpIndex", value);
+		if (s == napi_ok) s = napi_create_uint32(env, obj.detailLevel, &value);
+		if (s == napi_ok) s = napi_set_named_property(env, o, "detailLevel", value);
+		if (s == napi_ok) s = napi_create_int32(env, obj.defaultCounter, &value);
+		if (s == napi_ok) s = napi_set_named_property(env, o, "defaultCounter", value);
+		if (s == napi_ok) s = napi_create_double(env, (double)obj.time, &value);
+		if (s == napi_ok) s = napi_set_named_property(env, o, "time", value);
+		if (s == napi_ok) s = napi_create_double(env, (double)obj.frequency, &value);
+		if (s == napi_ok) s = napi_set_named_property(env, o, "frequency", value);
+
+		// counter definitions, one column per field
+		if (s == napi_ok) s = napi_create_object(env, &counters);
+		const char* names[] = { "index", "helpIndex", "type", "size", "scale", "detailLevel" };
+		for (int c = 0; s == napi_ok && c < 6; ++c) {
+			uint32_t* dest = (uint32_t*)(base + offset);
+			for (size_t n = 0; n < numCounters; ++n) {
+				const winreglib::PerfCounter& counter = obj.counters[n];
+				switch (c) {
+					case 0: dest[n] = counter.nameIndex; break;
+					case 1: dest[n] = counter.helpIndex; break;
+					case 2: dest[n] = counter.type; break;
+					case 3: dest[n] = counter.size; break;
+					case 4: dest[n] = (uint32_t)counter.scale; break;
+					case 5: dest[n] = counter.detailLevel; break;
+				}
+			}
+			s = createColumn(env, c == 4 ? napi_int32_array : napi_uint32_array, numCounters, buffer, offset, &column);
+			if (s == napi_ok) s = napi_set_named_property(env, counters, names[c], column);
+		}
+		if (s == napi_ok) s = napi_set_named_property(env, o, "counters", counters);
+
+		// instances, also one column per field, or null if the object doesn't have any
+		if (s == napi_ok && !obj.hasInstances) {
+			s = napi_get_null(env, &instances);
+		} else if (s == napi_ok) {
+			napi_value instanceNames;
+			s = napi_create_object(env, &instances);
+			if (s == napi_ok) s = napi_create_array_with_length(env, numInstances, &instanceNames);
+			for (uint32_t n = 0; s == napi_ok && n < numInstances; ++n) {
+				const std::wstring& name = obj.instances[n].name;
+				s = winreglib::createWideString(env, name.c_str(), name.length(), &value);
+				if (s == napi_ok) s = napi_set_element(env, instanceNames, n, value);
+			}
+			if (s == napi_ok) s = napi_set_named_property(env, instances, "name", instanceNames);
+
+			const char* fields[] = { "parentObject", "parentInstance", "uniqueId" };
+			for (int c = 0; s == napi_ok && c < 3; ++c) {
+				uint32_t* dest = (uint32_t*)(base + offset);
+				for (size_t n = 0; n < numInstances; ++n) {
+					const winreglib::PerfInstance& instance = obj.instances[n];
+					dest[n] = c == 0 ? instance.parentObject : c == 1 ? instance.parentInstance : (uint32_t)instance.uniqueId;
+				}
+				s = createColumn(env, c == 2 ? napi_int32_array : napi_uint32_array, numInstances, buffer, offset, &column);
+				if (s == napi_ok) s = napi_set_named_property(env, instances, fields[c], column);
+			}
+		}
+		if (s == napi_ok) s = napi_set_named_property(env, o, "instances", instances);
+
+		// one row of counter values per instance
+		if (s == napi_ok && obj.values.size()) {
+			::memcpy(base + valuesOffset, obj.values.data(), obj.values.size() * sizeof(double));
+		}
+		if (s == napi_ok) s = createColumn(env, napi_float64_array, obj.values.size(), buffer, valuesOffset, &column);
+		if (s == napi_ok) s = napi_set_named_property(env, o, "values", column);
+
+		if (s == napi_ok) s = napi_set_element(env, objects, i, o);
+	}
+
+	NAPI_THROW_RETURN("readPerfData", "ERR_NAPI_CREATE_OBJECT", s, NULL)
+	return result;
+}
+
+/**
+ * Gets the native reader from the external returned by `openPerfData()`.
+ */
+static winreglib::PerfReader* getPerfReader(napi_env env, napi_value value) {
+	napi_valuetype type;
+	void* reader = NULL;
+	if (napi_typeof(env, value, &type) != napi_ok || type != napi_external ||
+		napi_get_value_external(env, value, &reader) != napi_ok
+	) {
+		napi_throw_type_error(env, "ERR_WINREG_INVALID_PERF_SAMPLER", "Invalid performance sampler");
+		return NULL;
+	}
+	return static_cast<winreglib::PerfReader*>(reader);
+}
+
+/**
+ * openPerfData() implementation for creating a reader that samples `HKEY_PERFORMANCE_DATA` for a
+ * query. Returns an external that releases the performance data when garbage collected.
+ */
+NAPI_METHOD(openPerfData) {
+	NAPI_ARGV(1)
+	NAPI_ARGV_WSTRING(query, 1024, 0)
+
+	LOG_DEBUG_1("openPerfData", L"query=\"%ls\"", query.c_str())
+
+	winreglib::PerfReader* reader = new winreglib::PerfReader(query);
+	napi_value result;
+	napi_status s = napi_create_external(env, reader, [](napi_env env, void* data, void* hint) {
+		winreglib::PerfReader* reader = static_cast<winreglib::PerfReader*>(data);
+		reader->close(winreglib::backend);
+		delete reader;
+	}, NULL, &result);
+	if (s != napi_ok) {
+		delete reader;
+		NAPI_THROW_RETURN("openPerfData", "ERR_NAPI_CREATE_EXTERNAL", s, NULL)
+	}
+	return result;
+}
+
+/**
+ * readPerfData() implementation for reading and parsing a performance data sample.
+ */
+NAPI_METHOD(readPerfData) {
+	NAPI_ARGV(1)
+
+	winreglib::PerfReader* reader = getPerfReader(env, argv[0]);
+	if (!reader) {
+		return NULL;
+	}
+
+	if (reader->closed) {
+		THROW_ERROR("ERR_WINREG_PERF_SAMPLER_CLOSED", L"Performance sampler has been closed")
+		return NULL;
+	}
+
+	std::string reason;
+	LSTATUS status = reader->read(winreglib::backend, reason);
+	if (status == ERROR_INVALID_DATA && reason.length()) {
+		THROW_ERROR_1("ERR_WINREG_INVALID_PERF_DATA", L"%hs", reason.c_str())
+		return NULL;
+	}
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_GET_VALUE", L"RegQueryValueEx() failed")
+
+	LOG_DEBUG_2("readPerfData", L"Read %ld bytes, %ld objects", (long)reader->size, (long)reader->parsed.objectCount)
+
+	return createPerfSample(env, reader->parsed);
+}
+
+/**
+ * closePerfData() implementation for releasing the performance data before the reader is garbage
+ * collected.
+ */
+NAPI_METHOD(closePerfData) {
+	NAPI_ARGV(1)
+
+	winreglib::PerfReader* reader = getPerfReader(env, argv[0]);
+	if (!reader) {
+		return NULL;
+	}
+
+	reader->close(winreglib::backend);
+
+	NAPI_RETURN_UNDEFINED("closePerfData")
+}
+
+/**
+ * parsePerfData() implementation for parsing captured performance data, such as a buffer returned
+ * by `get()` for `HKEY_PERFORMANCE_DATA`.
+ */
+NAPI_METHOD(parsePerfData) {
+	NAPI_ARGV(1)
+	void* data;
+	size_t length;
+	NAPI_THROW_RETURN("parsePerfData", "ERR_NAPI_GET_BUFFER_INFO", napi_get_buffer_info(env, argv[0], &data, &length), NULL)
+
+	winreglib::PerfData parsed;
+	std::string reason;
+	if (!winreglib::parsePerfData((const BYTE*)data, length, parsed, reason)) {
+		THROW_ERROR_1("ERR_WINREG_INVALID_PERF_DATA", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	return createPerfSample(env, parsed);
+}
+
+struct QueryWork {
+	winreglib::Query* query;
+	winreglib::ColumnBuilder* columns;
+	napi_deferred deferred;
+	napi_async_work work;
+};
+
+/**
+ * Runs the query on a worker thread. Columnar results are built here too, so the main thread
+ * only has to copy them into a buffer.
+ */
+static void queryExecute(napi_env env, void* data) {
+	QueryWork* work = static_cast<QueryWork*>(data);
+	work->query->run();
+
+	if (work->columns) {
+		for (const winreglib::QueryRow& row : work->query->rows) {
+			work->columns->addKey(row.key);
+			for (const winreglib::QueryValue& value : row.values) {
+				work->columns->addValue(value.name.c_str(), value.name.length(), value.type, value.data.data(), value.data.size());
+			}
+			work->columns->endKey();
+		}
+		work->query->rows.clear();
+		work->query->rows.shrink_to_fit();
+	}
+}
+
+/**
+ * Creates the `{ key, values }` object for a matched key. `values` maps value names to their data.
+ */
+static napi_status createQueryRow(napi_env env, const winreglib::QueryRow& row, napi_value* result) {
+	napi_value key, values;
+	napi_status status = napi_create_object(env, result);
+	if (status == napi_ok) status = winreglib::createWideString(env, row.key.c_str(), row.key.length(), &key);
+	if (status == napi_ok) status = napi_set_named_property(env, *result, "key", key);
+	if (status == napi_ok) status = napi_create_object(env, &values);
+	for (size_t i = 0; status == napi_ok && i < row.values.size(); ++i) {
+		const winreglib::QueryValue& value = row.values[i];
+		napi_value name, data;
+		ValueSink sink(env, &data);
+		status = winreglib::createWideString(env, value.name.c_str(), value.name.length(), &name);
+		if (status == napi_ok) status = winreglib::decodeValue(sink, value.type, value.data.data(), value.data.size());
+		if (status == napi_ok) status = napi_set_property(env, values, name, data);
+	}
+	if (status == napi_ok) status = napi_set_named_property(env, *result, "values", values);
+	return status;
+}
+
+/**
+ * Resolves the promise returned by `query()` with `{ rows, keys, skipped }` on the main thread.
+ */
+static void queryComplete(napi_env env, napi_status status, void* data) {
+	QueryWork* work = static_cast<QueryWork*>(data);
+	winreglib::Query* query = work->query;
+
+	LOG_DEBUG_3("query", L"Visited %llu keys, matched %llu, skipped %llu",
+		(unsigned long long)query->keys,
+		(unsigned long long)query->rows.size(),
+		(unsigned long long)query->skipped)
+
+	napi_value result, rows, keys, skipped;
+	napi_status s = napi_create_object(env, &result);
+	if (s == napi_ok) s = work->columns
+		? createColumns(env, *work->columns, &rows)
+		: napi_create_array_with_length(env, query->rows.size(), &rows);
+	for (uint32_t i = 0; s == napi_ok && i < query->rows.size(); ++i) {
+		napi_value row;
+		s = createQueryRow(env, query->rows[i], &row);
+		if (s == napi_ok) s = napi_set_element(env, rows, i, row);
+	}
+	if (s == napi_ok) s = napi_create_double(env, (double)query->keys, &keys);
+	if (s == napi_ok) s = napi_create_double(env, (double)query->skipped, &skipped);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "rows", rows);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "keys", keys);
+	if (s == napi_ok) s = napi_set_named_property(env, result, "skipped", skipped);
+
+	if (s == napi_ok) {
+		napi_resolve_deferred(env, work->deferred, result);
+	} else {
+		bool pending = false;
+		napi_is_exception_pending(env, &pending);
+		if (pending) {
+			napi_value error;
+			napi_get_and_clear_last_exception(env, &error);
+		}
+		napi_reject_deferred(env, work->deferred, createWin32Error(env, ERROR_SUCCESS, "ERR_WINREG_QUERY", L"Failed to create query result"));
+	}
+
+	napi_delete_async_work(env, work->work);
+	delete work->query;
+	delete work->columns;
+	delete work;
+}
+
+/**
+ * query() implementation for finding the keys that match a pattern and reading their values on
+ * worker threads. The pattern is compiled up front so that syntax errors are thrown right away.
+ * When `columnar` is true, the rows are returned as columns.
+ */
+NAPI_METHOD(query) {
+	NAPI_ARGV(3)
+	NAPI_ARGV_WSTRING(pattern, 4096, 0)
+
+	std::shared_ptr<winreglib::QueryPlan> plan = std::make_shared<winreglib::QueryPlan>();
+	const char* code;
+	std::wstring reason;
+	if (!plan->compile(pattern, code, reason)) {
+		THROW_ERROR(code, reason)
+		return NULL;
+	}
+
+	bool isArray = false;
+	NAPI_THROW_RETURN("query", "ERR_NAPI_IS_ARRAY", napi_is_array(env, argv[1], &isArray), NULL)
+	if (isArray) {
+		uint32_t count = 0;
+		std::vector<std::wstring> names;
+		NAPI_THROW_RETURN("query", "ERR_NAPI_GET_ARRAY_LENGTH", napi_get_array_length(env, argv[1], &count), NULL)
+		for (uint32_t i = 0; i < count; ++i) {
+			napi_value element;
+			size_t len = 0;
+			NAPI_THROW_RETURN("query", "ERR_NAPI_GET_ELEMENT", napi_get_element(env, argv[1], i, &element), NULL)
+			NAPI_THROW_RETURN("query", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf16(env, element, NULL, 0, &len), NULL)
+			std::u16string name(len, u'\0');
+			NAPI_THROW_RETURN("query", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf16(env, element, &name[0], len + 1, &len), NULL)
+			names.push_back(std::wstring(name.begin(), name.end()));
+		}
+		plan->setValues(names);
+	}
+
+	LOG_DEBUG_3("query", L"pattern=\"%ls\" roots=%ld steps=%ld", pattern.c_str(), (long)plan->roots.size(), (long)plan->steps)
+
+	bool columnar = false;
+	napi_valuetype columnarType;
+	NAPI_THROW_RETURN("query", "ERR_NAPI_TYPEOF", napi_typeof(env, argv[2], &columnarType), NULL)
+	if (columnarType == napi_boolean) {
+		NAPI_THROW_RETURN("query", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &columnar), NULL)
+	}
+
+	std::unique_ptr<QueryWork> work(new QueryWork());
+	work->query = new winreglib::Query(winreglib::backend, plan);
+	work->columns = columnar ? new winreglib::ColumnBuilder() : NULL;
+
+	napi_value promise, name;
+	napi_status s = napi_create_promise(env, &work->deferred, &promise);
+	if (s == napi_ok) {
+		s = napi_create_string_utf8(env, "winreglib.query", NAPI_AUTO_LENGTH, &name);
+	}
+	if (s == napi_ok) {
+		s = napi_create_async_work(env, NULL, name, queryExecute, queryComplete, work.get(), &work->work);
+	}
+	if (s == napi_ok) {
+		s = napi_queue_async_work(env, work->work);
+	}
+	if (s != napi_ok) {
+		delete work->query;
+		delete work->columns;
+		NAPI_THROW_RETURN("query", "ERR_NAPI_QUEUE_ASYNC_WORK", s, NULL)
+	}
+
+	work.release();
+	return promise;
+}
+
+struct ScanWork {
+	winreglib::Scanner* scanner;
+	LSTATUS status;
+	napi_deferred deferred;
+	napi_async_work work;
+};
+
+/**
+ * Scans the tree on a worker thread.
+ */
+static void scanExecute(napi_env env, void* data) {
+	ScanWork* work = static_cast<ScanWork*>(data);
+	work->status = work->scanner->run();
+}
+
+/**
+ * Creates the `{ path, lastWriteTime, values?, subkeys }` object for a changed key.
+ */
+static napi_status createScanChange(napi_env env, const winreglib::ScanChange& change, napi_value* result) {
+	napi_value path, date, values, subkeys;
+	napi_status status = napi_create_object(env, result);
+	if (status == napi_ok) status = winreglib::createWideString(env, change.path.c_str(), change.path.length(), &path);
+	if (status == napi_ok) status = napi_set_named_property(env, *result, "path", path);
+	if (status == napi_ok) status = napi_create_date(env, fileTimeToMs(change.lastWriteTime), &date);
+	if (status == napi_ok) status = napi_set_named_property(env, *result, "lastWriteTime", date);
+
+	if (status == napi_ok && change.valuesRead) {
+		status = napi_create_array_with_length(env, change.values.size(), &values);
+		for (uint32_t i = 0; status == napi_ok && i < change.values.size(); ++i) {
+			const winreglib::ScanValue& value = change.values[i];
+			napi_value obj, name, type, data;
+			status = napi_create_object(env, &obj);
+			if (status == napi_ok) status = winreglib::createWideString(env, value.name.c_str(), value.name.length(), &name);
+			if (status == napi_ok) status = napi_create_uint32(env, value.type, &type);
+			ValueSink sink(env, &data);
+			if (status == napi_ok) status = winreglib::decodeValue(sink, value.type, value.data.data(), value.data.size());
+			if (status == napi_ok) status = napi_set_named_property(env, obj, "name", name);
+			if (status == napi_ok) status = napi_set_named_property(env, obj, "type", type);
+			if (status == napi_ok) status = napi_set_named_property(env, obj, "data", data);
+			if (status == napi_ok) status = napi_set_element(env, values, i, obj);
+		}
+		if (status == napi_ok) status = napi_set_named_property(env, *result, "values", values);
+	}
+
+	if (status == napi_ok) status = napi_create_array_with_length(env, change.subkeys.size(), &subkeys);
+	for (uint32_t i = 0; status == napi_ok && i < change.subkeys.size(); ++i) {
+		napi_value name;
+		status = winreglib::createWideString(env, change.subkeys[i].c_str(), change.subkeys[i].length(), &name);
+		if (status == napi_ok) status = napi_set_element(env, subkeys, i, name);
+	}
+	if (status == napi_ok) status = napi_set_named_property(env, *result, "subkeys", subkeys);
+	return status;
+}
+
+/**
+ * Resolves the promise returned by `scan()` with `{ cache, changes, keys, skipped }` on the main
+ * thread. `cache` is passed back to `scan()` to rescan the key.
+ */
+static void scanComplete(napi_env env, napi_status status, void* data) {
+	ScanWork* work = static_cast<ScanWork*>(data);
+	winreglib::Scanner* scanner = work->scanner;
+
+	if (work->status != ERROR_SUCCESS) {
+		LOG_DEBUG_1("scan", L"Failed to scan (status=%d)", work->status)
+		napi_reject_deferred(env, work->deferred, createWin32Error(env, work->status, "ERR_WINREG_SCAN", L"Failed to scan key"));
+	} else {
+		LOG_DEBUG_3("scan", L"Scanned %llu keys, %llu changed, skipped %llu keys",
+			(unsigned long long)scanner->keys,
+			(unsigned long long)scanner->changes.size(),
+			(unsigned long long)scanner->skipped)
+
+		napi_value result, cache, changes, keys, skipped;
+		napi_status s = napi_create_object(env, &result);
+		if (s == napi_ok) {
+			s = napi_create_external(env, new std::shared_ptr<const winreglib::ScanNode>(scanner->root), [](napi_env env, void* data, void* hint) {
+				delete static_cast<std::shared_ptr<const winreglib::ScanNode>*>(data);
+			}, NULL, &cache);
+		}
+		if (s == napi_ok) s = napi_create_array_with_length(env, scanner->changes.size(), &changes);
+		for (uint32_t i = 0; s == napi_ok && i < scanner->changes.size(); ++i) {
+			napi_value change;
+			s = createScanChange(env, scanner->changes[i], &change);
+			if (s == napi_ok) s = napi_set_element(env, changes, i, change);
+		}
+		if (s == napi_ok) s = napi_create_double(env, (double)scanner->keys, &keys);
+		if (s == napi_ok) s = napi_create_double(env, (double)scanner->skipped, &skipped);
+		if (s == napi_ok) s = napi_set_named_property(env, result, "cache", cache);
+		if (s == napi_ok) s = napi_set_named_property(env, result, "changes", changes);
+		if (s == napi_ok) s = napi_set_named_property(env, result, "keys", keys);
+		if (s == napi_ok) s = napi_set_named_property(env, result, "skipped", skipped);
+
+		if (s == napi_ok) {
+			napi_resolve_deferred(env, work->deferred, result);
+		} else {
+			bool pending = false;
+			napi_is_exception_pending(env, &pending);
+			if (pending) {
+				napi_value error;
+				napi_get_and_clear_last_exception(env, &error);
+			}
+			napi_reject_deferred(env, work->deferred, createWin32Error(env, ERROR_SUCCESS, "ERR_WINREG_SCAN", L"Failed to create scan result"));
+		}
+	}
+
+	napi_delete_async_work(env, work->work);
+	delete work->scanner;
+	delete work;
+}
+
+/**
+ * scan() implementation for inventorying a key and its subkeys on a worker thread. When the cache
+ * from a previous scan of the same key is passed, only keys whose last write time moved are read.
+ */
+NAPI_METHOD(scan) {
+	NAPI_ARGV(2)
+	NAPI_ARGV_WSTRING(key, 1024, 0)
+
+	std::shared_ptr<const winreglib::ScanNode> previous;
+	napi_valuetype cacheType;
+	NAPI_THROW_RETURN("scan", "ERR_NAPI_TYPEOF", napi_typeof(env, argv[1], &cacheType), NULL)
+	if (cacheType == napi_external) {
+		void* cache;
+		NAPI_THROW_RETURN("scan", "ERR_NAPI_GET_VALUE_EXTERNAL", napi_get_value_external(env, argv[1], &cache), NULL)
+		previous = *static_cast<std::shared_ptr<const winreglib::ScanNode>*>(cache);
+	} else if (cacheType != napi_undefined) {
+		napi_throw_type_error(env, "ERR_WINREG_INVALID_SCAN", "Invalid scan cache");
+		return NULL;
+	}
+
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
+	}
+
+	std::wstring root = key.substr(0, p);
+	std::wstring subkey = key.substr(p + 1);
+
+	LOG_DEBUG_3("scan", L"key=\"%ls\" subkey=\"%ls\" incremental=%d", root.c_str(), subkey.c_str(), previous ? 1 : 0)
+
+	HKEY hroot = winreglib::resolveRootKey(env, root);
+	if (!hroot) {
+		return NULL;
+	}
+
+	HKEY hkey;
+	LSTATUS status = winreglib::backend->openKey(hroot, subkey.c_str(), KEY_READ, NULL, &hkey);
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+
+	std::unique_ptr<ScanWork> work(new ScanWork());
+	work->scanner = new winreglib::Scanner(winreglib::backend, hkey, previous);
+	work->status = ERROR_SUCCESS;
+
+	napi_value promise, name;
+	napi_status s = napi_create_promise(env, &work->deferred, &promise);
+	if (s == napi_ok) {
+		s = napi_create_string_utf8(env, "winreglib.scan", NAPI_AUTO_LENGTH, &name);
+	}
+	if (s == napi_ok) {
+		s = napi_create_async_work(env, NULL, name, scanExecute, scanComplete, work.get(), &work->work);
+	}
+	if (s == napi_ok) {
+		s = napi_queue_async_work(env, work->work);
+	}
+	if (s != napi_ok) {
+		delete work->scanner;
+		NAPI_THROW_RETURN("scan", "ERR_NAPI_QUEUE_ASYNC_WORK", s, NULL)
+	}
+
+	work.release();
+	return promise;
+}
+
+/**
+ * setBackend() implementation for switching between the Win32 and in-memory registry backends.
+ */
+NAPI_METHOD(setBackend) {
+	NAPI_ARGV(1)
+	NAPI_ARGV_WSTRING(name, 32, 0)
+
+	winreglib::Backend* backend = winreglib::getBackend(name);
+	if (!backend) {
+		THROW_ERROR_1("ERR_WINREG_INVALID_BACKEND", L"Invalid registry backend \"%ls\"", name.c_str())
+		return NULL;
+	}
+
+	if (backend != winreglib::backend) {
+		// open watch handles belong to the current backend, the backend is shared by every
+		// environment in the process
+		if (!winreglib::Monitor::get().idle()) {
+			THROW_ERROR("ERR_WINREG_BACKEND_BUSY", L"Cannot change the registry backend while keys are being watched")
+			return NULL;
+		}
+		if (winreglib::RecordingBackend::get().recording()) {
+			THROW_ERROR("ERR_WINREG_BACKEND_BUSY", L"Cannot change the registry backend while recording")
+			return NULL;
+		}
+		LOG_DEBUG_1("setBackend", L"Switching to the %hs backend", backend->name())
+		winreglib::backend = backend;
+	}
+
+	NAPI_RETURN_UNDEFINED("setBackend")
+}
+
+/**
+ * setMemoryClock() implementation for freezing the in-memory backend's clock at a time in
+ * milliseconds since January 1, 1970 (UTC), or restoring the system clock when the time is
+ * negative.
+ */
+NAPI_METHOD(setMemoryClock) {
+	NAPI_ARGV(1)
+	double ms;
+	NAPI_THROW_RETURN("setMemoryClock", "ERR_NAPI_GET_VALUE_DOUBLE", napi_get_value_double(env, argv[0], &ms), NULL)
+
+	winreglib::MemoryBackend* memory = static_cast<winreglib::MemoryBackend*>(winreglib::getBackend(L"memory"));
+	memory->setClock(ms < 0 ? 0 : (uint64_t)(ms * 10000.0) + 116444736000000000ULL);
+
+	// polled watches follow the frozen clock, run the polls that came due
+	winreglib::Poller::setClock(ms < 0 ? 0 : (uint64_t)ms);
+	winreglib::Instance::get(env)->watchman->schedulePoll();
+
+	NAPI_RETURN_UNDEFINED("setMemoryClock")
+}
+
+/**
+ * setWatchQueue() implementation for bounding the queue of changed keys waiting for the main thread
+ * and choosing what happens to the keys that change while it is full.
+ */
+NAPI_METHOD(setWatchQueue) {
+	NAPI_ARGV(2)
+	NAPI_ARGV_WSTRING(overflow, 32, 1)
+	double capacity;
+	NAPI_THROW_RETURN("setWatchQueue", "ERR_NAPI_GET_VALUE_DOUBLE", napi_get_value_double(env, argv[0], &capacity), NULL)
+
+	winreglib::WatchOverflow policy;
+	if (overflow == L"coalesce") {
+		policy = winreglib::Coalesce;
+	} else if (overflow == L"drop-oldest") {
+		policy = winreglib::DropOldest;
+	} else if (overflow == L"resync") {
+		policy = winreglib::Resync;
+	} else {
+		THROW_ERROR_1("ERR_WINREG_INVALID_OVERFLOW", L"Invalid overflow policy \"%ls\"", overflow.c_str())
+		return NULL;
+	}
+
+	winreglib::Instance::get(env)->watchman->configQueue(capacity < 1 ? 1 : (size_t)capacity, policy);
+
+	NAPI_RETURN_UNDEFINED("setWatchQueue")
+}
+
+/**
+ * startRecording() implementation for recording every call to the active backend to a trace file.
+ */
+NAPI_METHOD(startRecording) {
+	NAPI_ARGV(1)
+	int32_t fd;
+	uv_loop_t* loop;
+	NAPI_THROW_RETURN("startRecording", "ERR_NAPI_GET_VALUE_INT32", napi_get_value_int32(env, argv[0], &fd), NULL)
+	NAPI_THROW_RETURN("startRecording", "ERR_NAPI_GET_UV_EVENT_LOOP", napi_get_uv_event_loop(env, &loop), NULL)
+
+	// keys opened before recording starts can't be replayed
+	if (!winreglib::Monitor::get().idle()) {
+		THROW_ERROR("ERR_WINREG_BACKEND_BUSY", L"Cannot start recording while keys are being watched")
+		return NULL;
+	}
+
+	winreglib::RecordingBackend& recorder = winreglib::RecordingBackend::get();
+	if (recorder.recording()) {
+		THROW_ERROR("ERR_WINREG_BACKEND_BUSY", L"Already recording")
+		return NULL;
+	}
+
+	std::string reason;
+	if (!recorder.start(winreglib::backend, loop, fd, reason)) {
+		THROW_ERROR_1("ERR_WINREG_TRACE", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	LOG_DEBUG_1("startRecording", L"Recording calls to the %hs backend", recorder.inner->name())
+	winreglib::backend = &recorder;
+
+	NAPI_RETURN_UNDEFINED("startRecording")
+}
+
+/**
+ * stopRecording() implementation for writing the rest of the trace and restoring the recorded
+ * backend.
+ */
+NAPI_METHOD(stopRecording) {
+	winreglib::RecordingBackend& recorder = winreglib::RecordingBackend::get();
+	if (winreglib::backend == &recorder) {
+		winreglib::backend = recorder.inner;
+	}
+
+	std::string reason;
+	if (!recorder.stop(reason)) {
+		THROW_ERROR_1("ERR_WINREG_TRACE", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	LOG_DEBUG("stopRecording", L"Stopped recording")
+	NAPI_RETURN_UNDEFINED("stopRecording")
+}
+
+/**
+ * startTimeline() implementation for recording spans of native work with room for `capacity`
+ * spans per thread. Restarting discards the spans recorded so far.
+ */
+NAPI_METHOD(startTimeline) {
+	NAPI_ARGV(1)
+	uint32_t capacity;
+	NAPI_THROW_RETURN("startTimeline", "ERR_NAPI_GET_VALUE_UINT32", napi_get_value_uint32(env, argv[0], &capacity), NULL)
+
+	LOG_DEBUG_1("startTimeline", L"Recording up to %ld spans per thread", capacity)
+	winreglib::Timeline::start(capacity);
+
+	NAPI_RETURN_UNDEFINED("startTimeline")
+}
+
+/**
+ * stopTimeline() implementation for discarding the recorded spans.
+ */
+NAPI_METHOD(stopTimeline) {
+	winreglib::Timeline::stop();
+	NAPI_RETURN_UNDEFINED("stopTimeline")
+}
+
+/**
+ * exportTimeline() implementation for getting the recorded spans as Chrome trace-event JSON.
+ */
+NAPI_METHOD(exportTimeline) {
+	std::string json = winreglib::Timeline::exportJson();
+	napi_value result;
+	NAPI_THROW_RETURN("exportTimeline", "ERR_NAPI_CREATE_STRING", napi_create_string_utf8(env, json.c_str(), json.length(), &result), NULL)
+	return result;
+}
+
+/**
+ * replay() implementation for loading a trace into the replay backend and switching to it.
+ */
+NAPI_METHOD(replay) {
+	NAPI_ARGV(2)
+	void* data;
+	size_t length;
+	bool realtime;
+	NAPI_THROW_RETURN("replay", "ERR_NAPI_GET_BUFFER_INFO", napi_get_buffer_info(env, argv[0], &data, &length), NULL)
+	NAPI_THROW_RETURN("replay", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[1], &realtime), NULL)
+
+	if (!winreglib::Monitor::get().idle()) {
+		THROW_ERROR("ERR_WINREG_BACKEND_BUSY", L"Cannot change the registry backend while keys are being watched")
+		return NULL;
+	}
+	if (winreglib::RecordingBackend::get().recording()) {
+		THROW_ERROR("ERR_WINREG_BACKEND_BUSY", L"Cannot change the registry backend while recording")
+		return NULL;
+	}
+
+	winreglib::ReplayBackend* replay = static_cast<winreglib::ReplayBackend*>(winreglib::getBackend(L"replay"));
+	std::string reason;
+	if (!replay->load((const BYTE*)data, length, realtime, reason)) {
+		THROW_ERROR_1("ERR_WINREG_INVALID_TRACE", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	LOG_DEBUG_1("replay", L"Replaying %ld byte trace", (long)length)
+	winreglib::backend = replay;
+
+	NAPI_RETURN_UNDEFINED("replay")
+}
+
+/**
+ * Gets the native view from the external returned by `openView()`.
+ */
+static winreglib::View* getView(napi_env env, napi_value value) {
+	napi_valuetype type;
+	void* view = NULL;
+	if (napi_typeof(env, value, &type) != napi_ok || type != napi_external ||
+		napi_get_value_external(env, value, &view) != napi_ok
+	) {
+		napi_throw_type_error(env, "ERR_WINREG_INVALID_VIEW", "Invalid view");
+		return NULL;
+	}
+	return static_cast<winreglib::View*>(view);
+}
+
+/**
+ * openView() implementation for creating the native cache behind a registry view. Returns
+ * `{ view, key }` where `view` is an external that frees the cache when garbage collected and
+ * `key` is the key with its resolved root.
+ */
+NAPI_METHOD(openView) {
+	NAPI_ARGV(1)
+	NAPI_ARGV_WSTRING(key, 1024, 0)
+
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
+	}
+
+	std::wstring root = key.substr(0, p);
+	std::wstring subkey = key.substr(p + 1);
+	while (subkey.length() && subkey.back() == L'\\') {
+		subkey.pop_back();
+	}
+
+	LOG_DEBUG_2("openView", L"key=\"%ls\" subkey=\"%ls\"", root.c_str(), subkey.c_str())
+
+	HKEY hroot = winreglib::resolveRootKey(env, root);
+	if (!hroot) {
+		return NULL;
+	}
+
+	std::unique_ptr<winreglib::View> view(new winreglib::View(winreglib::backend, hroot, subkey));
+	bool exists = false;
+	LSTATUS status = view->exists(L"", exists);
+	ASSERT_WIN32_STATUS(exists ? status : ERROR_FILE_NOT_FOUND, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+
+	key = *winreglib::resolveRootName(root) + L'\\' + subkey;
+
+	napi_value result, external, resolved;
+	NAPI_THROW_RETURN("openView", "ERR_NAPI_CREATE_EXTERNAL", napi_create_external(env, view.get(), [](napi_env env, void* data, void* hint) {
+		delete static_cast<winreglib::View*>(data);
+	}, NULL, &external), NULL)
+	view.release();
+
+	NAPI_THROW_RETURN("openView", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &result), NULL)
+	NAPI_THROW_RETURN("openView", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, key.c_str(), key.length(), &resolved), NULL)
+	NAPI_THROW_RETURN("openView", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "view", external), NULL)
+	NAPI_THROW_RETURN("openView", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "key", resolved), NULL)
+	return result;
+}
+
+/**
+ * readView() implementation for getting a value through a view's cache. Returns `undefined` if
+ * the key or value doesn't exist.
+ */
+NAPI_METHOD(readView) {
+	NAPI_ARGV(3)
+	NAPI_ARGV_WSTRING(path, 1024, 1)
+	NAPI_ARGV_WSTRING(name, 256, 2)
+
+	winreglib::View* view = getView(env, argv[0]);
+	if (!view) {
+		return NULL;
+	}
+
+	const winreglib::ViewValue* value;
+	LSTATUS status = view->value(path, name, value);
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_GET_VALUE", L"RegGetValue() failed")
+
+	if (!value->exists) {
+		NAPI_RETURN_UNDEFINED("readView")
+	}
+
+	napi_value rval;
+	ValueSink sink(env, &rval);
+	NAPI_THROW_RETURN("readView", "ERR_NAPI_CREATE_VALUE", winreglib::decodeValue(sink, value->type, value->data.data(), value->data.size()), NULL)
+	return rval;
+}
+
+/**
+ * listView() implementation for getting a key's subkey and value names through a view's cache.
+ * Returns `{ subkeys, values }`, or `undefined` if the key doesn't exist.
+ */
+NAPI_METHOD(listView) {
+	NAPI_ARGV(2)
+	NAPI_ARGV_WSTRING(path, 1024, 1)
+
+	winreglib::View* view = getView(env, argv[0]);
+	if (!view) {
+		return NULL;
+	}
+
+	const winreglib::ViewNode* node;
+	LSTATUS status = view->list(path, node);
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_ENUM_KEY", L"Failed to enumerate key")
+
+	if (!node) {
+		NAPI_RETURN_UNDEFINED("listView")
+	}
+
+	napi_value rval;
+	napi_value subkeys = createNameArray(env, node->subkeys);
+	napi_value values = subkeys ? createNameArray(env, node->values) : NULL;
+	if (!values) {
+		return NULL;
+	}
+	NAPI_THROW_RETURN("listView", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
+	NAPI_THROW_RETURN("listView", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "subkeys", subkeys), NULL)
+	NAPI_THROW_RETURN("listView", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "values", values), NULL)
+	return rval;
+}
+
+/**
+ * hasViewKey() implementation for checking if a subkey exists through a view's cache.
+ */
+NAPI_METHOD(hasViewKey) {
+	NAPI_ARGV(2)
+	NAPI_ARGV_WSTRING(path, 1024, 1)
+
+	winreglib::View* view = getView(env, argv[0]);
+	if (!view) {
+		return NULL;
+	}
+
+	bool exists = false;
+	LSTATUS status = view->exists(path, exists);
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+
+	napi_value rval;
+	NAPI_THROW_RETURN("hasViewKey", "ERR_NAPI_GET_BOOLEAN", napi_get_boolean(env, exists, &rval), NULL)
+	return rval;
+}
+
+/**
+ * invalidateView() implementation for dropping the cache of a key that changed.
+ */
+NAPI_METHOD(invalidateView) {
+	NAPI_ARGV(3)
+	NAPI_ARGV_WSTRING(path, 1024, 1)
+
+	winreglib::View* view = getView(env, argv[0]);
+	if (!view) {
+		return NULL;
+	}
+
+	bool subtree = false;
+	NAPI_THROW_RETURN("invalidateView", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &subtree), NULL)
+
+	LOG_DEBUG_2("invalidateView", L"path=\"%ls\" subtree=%d", path.c_str(), (int)subtree)
+	view->invalidate(path, subtree);
+
+	NAPI_RETURN_UNDEFINED("invalidateView")
+}
+
+/**
+ * viewStats() implementation for getting how many lookups a view read from the registry and how
+ * many it answered from its cache.
+ */
+NAPI_METHOD(viewStats) {
+	NAPI_ARGV(1)
+
+	winreglib::View* view = getView(env, argv[0]);
+	if (!view) {
+		return NULL;
+	}
+
+	napi_value rval, faults, hits;
+	NAPI_THROW_RETURN("viewStats", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
+	NAPI_THROW_RETURN("viewStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)view->faults, &faults), NULL)
+	NAPI_THROW_RETURN("viewStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)view->hits, &hits), NULL)
+	NAPI_THROW_RETURN("viewStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "faults", faults), NULL)
+	NAPI_THROW_RETURN("viewStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "hits", hits), NULL)
+	return rval;
+}
+
+/**
+ * Gets the environment's journal, throwing if none is open.
+ */
+static winreglib::Journal* getJournal(napi_env env) {
+	winreglib::Journal* journal = winreglib::Instance::get(env)->journal;
+	if (!journal) {
+		THROW_ERROR("ERR_WINREG_JOURNAL_CLOSED", L"No journal is open")
+	}
+	return journal;
+}
+
+/**
+ * openJournal() implementation for recording the environment's watch events to a journal in an
+ * existing directory. Only one journal can be open at a time.
+ */
+NAPI_METHOD(openJournal) {
+	NAPI_ARGV(5)
+	size_t length;
+	int32_t sync;
+	uint32_t syncInterval;
+	double segmentSize;
+	bool values;
+	uv_loop_t* loop;
+	NAPI_THROW_RETURN("openJournal", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf8(env, argv[0], NULL, 0, &length), NULL)
+	std::string dir(length, '\0');
+	NAPI_THROW_RETURN("openJournal", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf8(env, argv[0], &dir[0], length + 1, &length), NULL)
+	NAPI_THROW_RETURN("openJournal", "ERR_NAPI_GET_VALUE_INT32", napi_get_value_int32(env, argv[1], &sync), NULL)
+	NAPI_THROW_RETURN("openJournal", "ERR_NAPI_GET_VALUE_UINT32", napi_get_value_uint32(env, argv[2], &syncInterval), NULL)
+	NAPI_THROW_RETURN("openJournal", "ERR_NAPI_GET_VALUE_DOUBLE", napi_get_value_double(env, argv[3], &segmentSize), NULL)
+	NAPI_THROW_RETURN("openJournal", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[4], &values), NULL)
+	NAPI_THROW_RETURN("openJournal", "ERR_NAPI_GET_UV_EVENT_LOOP", napi_get_uv_event_loop(env, &loop), NULL)
+
+	winreglib::Instance* instance = winreglib::Instance::get(env);
+	if (instance->journal) {
+		THROW_ERROR("ERR_WINREG_JOURNAL_OPEN", L"A journal is already open")
+		return NULL;
+	}
+
+	winreglib::JournalOptions options = {
+		(winreglib::JournalSync)sync,
+		syncInterval,
+		segmentSize < 1 ? 1 : (uint64_t)segmentSize,
+		values
+	};
+	std::unique_ptr<winreglib::Journal> journal(new winreglib::Journal(loop, dir, options));
+	std::string reason;
+	if (!journal->open(reason)) {
+		THROW_ERROR_1("ERR_WINREG_JOURNAL", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	instance->journal = journal.release();
+	NAPI_RETURN_UNDEFINED("openJournal")
+}
+
+/**
+ * The property names and event type strings of journal entries, created once per read instead of
+ * once per entry. The same few keys and value names tend to change over and over, so their strings
+ * are only created the first time they are seen in a read too.
+ */
+struct JournalNames {
+	napi_status init(napi_env env) {
+		static const char* const names[] = { "seq", "time", "type", "key", "values", "name", "change", "data", "", "add", "change", "delete" };
+		napi_status status = napi_ok;
+		for (size_t i = 0; status == napi_ok && i < 12; ++i) {
+			status = napi_create_string_utf8(env, names[i], NAPI_AUTO_LENGTH, &strings[i]);
+		}
+		return status;
+	}
+
+	napi_value event(uint8_t event) const { return strings[8 + (event & 3)]; }
+
+	napi_status string(napi_env env, const std::wstring& str, napi_value* result) {
+		auto it = cache.find(str);
+		if (it != cache.end()) {
+			*result = it->second;
+			return napi_ok;
+		}
+		napi_status status = winreglib::createWideString(env, str.c_str(), str.length(), result);
+		if (status == napi_ok) {
+			cache.emplace(str, *result);
+		}
+		return status;
+	}
+
+	// seq, time, type, key, values, name, change, data, then the event types
+	napi_value strings[12];
+	std::unordered_map<std::wstring, napi_value> cache;
+};
+
+static napi_property_descriptor journalProperty(napi_value name, napi_value value) {
+	return { NULL, name, NULL, NULL, NULL, value, napi_default_jsproperty, NULL };
+}
+
+/**
+ * Creates the `{ seq, time, type, key, values? }` object for a journal entry.
+ */
+static napi_status createJournalEntry(napi_env env, JournalNames& names, const winreglib::JournalEntry& entry, napi_value* result) {
+	const napi_value* n = names.strings;
+	napi_value seq, time, key, values = NULL;
+	napi_status status = napi_create_object(env, result);
+	if (status == napi_ok) status = napi_create_double(env, (double)entry.seq, &seq);
+	if (status == napi_ok) status = napi_create_date(env, (double)entry.time, &time);
+	if (status == napi_ok) status = names.string(env, entry.key, &key);
+
+	if (status == napi_ok && entry.hasValues) {
+		status = napi_create_array_with_length(env, entry.values.size(), &values);
+		for (uint32_t i = 0; status == napi_ok && i < entry.values.size(); ++i) {
+			const winreglib::JournalValue& value = entry.values[i];
+			napi_value obj, name, valueType, data = NULL;
+			status = napi_create_object(env, &obj);
+			if (status == napi_ok) status = names.string(env, value.name, &name);
+			if (status == napi_ok) status = napi_create_uint32(env, value.type, &valueType);
+			bool deleted = value.change == winreglib::JournalDelete;
+			if (status == napi_ok && !deleted) {
+				ValueSink sink(env, &data);
+				status = winreglib::decodeValue(sink, value.type, value.data.data(), value.data.size());
+			}
+			napi_property_descriptor props[] = {
+				journalProperty(n[5], name),
+				journalProperty(n[6], names.event(value.change)),
+				journalProperty(n[2], valueType),
+				journalProperty(n[7], data)
+			};
+			if (status == napi_ok) status = napi_define_properties(env, obj, deleted ? 3 : 4, props);
+			if (status == napi_ok) status = napi_set_element(env, values, i, obj);
+		}
+	}
+
+	napi_property_descriptor props[] = {
+		journalProperty(n[0], seq),
+		journalProperty(n[1], time),
+		journalProperty(n[2], names.event(entry.event)),
+		journalProperty(n[3], key),
+		journalProperty(n[4], values)
+	};
+	if (status == napi_ok) status = napi_define_properties(env, *result, entry.hasValues ? 5 : 4, props);
+	return status;
+}
+
+/**
+ * readJournal() implementation for reading up to `limit` journal entries after a sequence number.
+ * Throws `ERR_WINREG_JOURNAL_COMPACTED` if some of the entries have been compacted away.
+ */
+NAPI_METHOD(readJournal) {
+	NAPI_ARGV(2)
+	double since;
+	double limit;
+	NAPI_THROW_RETURN("readJournal", "ERR_NAPI_GET_VALUE_DOUBLE", napi_get_value_double(env, argv[0], &since), NULL)
+	NAPI_THROW_RETURN("readJournal", "ERR_NAPI_GET_VALUE_DOUBLE", napi_get_value_double(env, argv[1], &limit), NULL)
+
+	winreglib::Journal* journal = getJournal(env);
+	if (!journal) {
+		return NULL;
+	}
+
+	uint64_t seq = since < 0 ? 0 : (uint64_t)since;
+	if (seq + 1 < journal->firstSeq()) {
+		THROW_ERROR_1("ERR_WINREG_JOURNAL_COMPACTED", L"Events after sequence %lld have been compacted", (long long)seq)
+		return NULL;
+	}
+
+	std::vector<winreglib::JournalEntry> entries;
+	std::string reason;
+	if (!journal->readSince(seq, limit >= (double)SIZE_MAX ? SIZE_MAX : (size_t)limit, entries, reason)) {
+		THROW_ERROR_1("ERR_WINREG_JOURNAL", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	napi_value rval;
+	JournalNames names;
+	NAPI_THROW_RETURN("readJournal", "ERR_NAPI_CREATE_STRING", names.init(env), NULL)
+	NAPI_THROW_RETURN("readJournal", "ERR_NAPI_CREATE_ARRAY", napi_create_array_with_length(env, entries.size(), &rval), NULL)
+	for (uint32_t i = 0; i < entries.size(); ++i) {
+		napi_value entry;
+		NAPI_THROW_RETURN("readJournal", "ERR_NAPI_CREATE_OBJECT", createJournalEntry(env, names, entries[i], &entry), NULL)
+		NAPI_THROW_RETURN("readJournal", "ERR_NAPI_SET_ELEMENT", napi_set_element(env, rval, i, entry), NULL)
+	}
+	return rval;
+}
+
+/**
+ * compactJournal() implementation for deleting the segments that only hold entries up to a
+ * sequence number. Returns the number of segments deleted.
+ */
+NAPI_METHOD(compactJournal) {
+	NAPI_ARGV(1)
+	double seq;
+	NAPI_THROW_RETURN("compactJournal", "ERR_NAPI_GET_VALUE_DOUBLE", napi_get_value_double(env, argv[0], &seq), NULL)
+
+	winreglib::Journal* journal = getJournal(env);
+	if (!journal) {
+		return NULL;
+	}
+
+	uint32_t removed = 0;
+	std::string reason;
+	if (!journal->compact(seq < 0 ? 0 : (uint64_t)seq, removed, reason)) {
+		THROW_ERROR_1("ERR_WINREG_JOURNAL", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	napi_value rval;
+	NAPI_THROW_RETURN("compactJournal", "ERR_NAPI_CREATE_UINT32", napi_create_uint32(env, removed, &rval), NULL)
+	return rval;
+}
+
+/**
+ * flushJournal() implementation for writing and syncing the buffered entries.
+ */
+NAPI_METHOD(flushJournal) {
+	winreglib::Journal* journal = getJournal(env);
+	if (!journal) {
+		return NULL;
+	}
+
+	std::string reason;
+	if (!journal->flush(reason)) {
+		THROW_ERROR_1("ERR_WINREG_JOURNAL", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	NAPI_RETURN_UNDEFINED("flushJournal")
+}
+
+/**
+ * closeJournal() implementation for flushing and closing the journal. Watch events are no longer
+ * recorded.
+ */
+NAPI_METHOD(closeJournal) {
+	winreglib::Instance* instance = winreglib::Instance::get(env);
+	std::unique_ptr<winreglib::Journal> journal(instance->journal);
+	instance->journal = NULL;
+
+	std::string reason;
+	if (journal && !journal->close(reason)) {
+		THROW_ERROR_1("ERR_WINREG_JOURNAL", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	NAPI_RETURN_UNDEFINED("closeJournal")
+}
+
+/**
+ * journalInfo() implementation that returns the journal's `{ firstSeq, lastSeq, segments }`.
+ */
+NAPI_METHOD(journalInfo) {
+	winreglib::Journal* journal = getJournal(env);
+	if (!journal) {
+		return NULL;
+	}
+
+	napi_value rval, firstSeq, lastSeq, segments;
+	NAPI_THROW_RETURN("journalInfo", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
+	NAPI_THROW_RETURN("journalInfo", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)journal->firstSeq(), &firstSeq), NULL)
+	NAPI_THROW_RETURN("journalInfo", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)journal->lastSeq(), &lastSeq), NULL)
+	NAPI_THROW_RETURN("journalInfo", "ERR_NAPI_CREATE_UINT32", napi_create_uint32(env, (uint32_t)journal->segmentCount(), &segments), NULL)
+	NAPI_THROW_RETURN("journalInfo", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "firstSeq", firstSeq), NULL)
+	NAPI_THROW_RETURN("journalInfo", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "lastSeq", lastSeq), NULL)
+	NAPI_THROW_RETURN("journalInfo", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "segments", segments), NULL)
+	return rval;
+}
+
+/**
+ * Gets the native shared cache from an external returned by `openSharedCache()`, or the publisher
+ * from one returned by `publishSharedCache()`.
+ */
+template<typename T>
+static T* getShared(napi_env env, napi_value value) {
+	napi_valuetype type;
+	void* cache = NULL;
+	if (napi_typeof(env, value, &type) != napi_ok || type != napi_external ||
+		napi_get_value_external(env, value, &cache) != napi_ok
+	) {
+		napi_throw_type_error(env, "ERR_WINREG_INVALID_SHARED_CACHE", "Invalid shared cache");
+		return NULL;
+	}
+	return static_cast<T*>(cache);
+}
+
+/**
+ * Resolves the root of a key and checks that it's in the shared subtree.
+ */
+static bool resolveSharedKey(napi_env env, const winreglib::SharedCache& cache, std::wstring& key) {
+	std::wstring::size_type p = key.find('\\');
+	std::wstring root = key.substr(0, p);
+	std::wstring* resolvedRoot = winreglib::resolveRootName(root);
+	if (resolvedRoot) {
+		key = p == std::wstring::npos ? *resolvedRoot : *resolvedRoot + key.substr(p);
+		while (key.length() && key.back() == L'\\') {
+			key.pop_back();
+		}
+	}
+	if (!resolvedRoot || !cache.contains(key)) {
+		THROW_ERROR_1("ERR_WINREG_KEY_NOT_SHARED", L"Key \"%ls\" is not in the shared cache", key.c_str())
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Throws if a shared cache lookup didn't get an answer.
+ */
+static bool checkSharedRead(napi_env env, winreglib::SharedRead result) {
+	if (result == winreglib::SharedBusy) {
+		THROW_ERROR("ERR_WINREG_SHARED_CACHE_BUSY", L"Timed out waiting for the shared cache publisher")
+		return false;
+	}
+	if (result == winreglib::SharedStale) {
+		THROW_ERROR("ERR_WINREG_SHARED_CACHE_CLOSED", L"The shared cache is no longer published")
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Creates the `{ added, removed }` result of a publisher sync, throwing if the sync failed.
+ */
+static napi_value syncSharedResult(napi_env env, winreglib::SharedCacheWriter* writer, const std::wstring& key, bool deep) {
+	std::vector<std::wstring> added;
+	std::vector<std::wstring> removed;
+	bool full = false;
+	LSTATUS status = writer->sync(key, deep, added, removed, full);
+	if (full) {
+		THROW_ERROR("ERR_WINREG_SHARED_CACHE_FULL", L"The shared subtree does not fit in the shared cache")
+		return NULL;
+	}
+	ASSERT_WIN32_STATUS(status, "ERR_WINREG_ENUM_KEY", L"Failed to enumerate key")
+
+	napi_value rval;
+	napi_value addedArr = createNameArray(env, added);
+	napi_value removedArr = addedArr ? createNameArray(env, removed) : NULL;
+	if (!removedArr) {
+		return NULL;
+	}
+	NAPI_THROW_RETURN("syncSharedCache", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
+	NAPI_THROW_RETURN("syncSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "added", addedArr), NULL)
+	NAPI_THROW_RETURN("syncSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "removed", removedArr), NULL)
+	return rval;
+}
+
+/**
+ * publishSharedCache() implementation for creating a shared memory segment named `name` of `size`
+ * bytes and loading the subtree of `key` into it. Returns `{ cache, key, added }` where `cache` is
+ * an external that unpublishes the cache when garbage collected, `key` is the key with its
+ * resolved root, and `added` is every key that was loaded.
+ */
+NAPI_METHOD(publishSharedCache) {
+	NAPI_ARGV(3)
+	size_t length;
+	double size;
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf8(env, argv[0], NULL, 0, &length), NULL)
+	std::string name(length, '\0');
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf8(env, argv[0], &name[0], length + 1, &length), NULL)
+	NAPI_ARGV_WSTRING(key, 1024, 1)
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_GET_VALUE_DOUBLE", napi_get_value_double(env, argv[2], &size), NULL)
+
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return NULL;
+	}
+
+	std::wstring root = key.substr(0, p);
+	std::wstring subkey = key.substr(p + 1);
+	while (subkey.length() && subkey.back() == L'\\') {
+		subkey.pop_back();
+	}
+
+	LOG_DEBUG_3("publishSharedCache", L"name=\"%hs\" key=\"%ls\" subkey=\"%ls\"", name.c_str(), root.c_str(), subkey.c_str())
+
+	HKEY hroot = winreglib::resolveRootKey(env, root);
+	if (!hroot) {
+		return NULL;
+	}
+
+	key = *winreglib::resolveRootName(root) + L'\\' + subkey;
+	std::unique_ptr<winreglib::SharedCacheWriter> writer(new winreglib::SharedCacheWriter(winreglib::backend, hroot, *winreglib::resolveRootName(root), subkey));
+	std::string reason;
+	if (!writer->create(name, size < 0 ? 0 : (uint64_t)size, reason)) {
+		THROW_ERROR_1("ERR_WINREG_SHARED_CACHE", L"%hs", reason.c_str())
+		return NULL;
+	}
+
+	napi_value synced = syncSharedResult(env, writer.get(), key, false);
+	if (!synced) {
+		return NULL;
+	}
+
+	napi_value added;
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_GET_NAMED_PROPERTY", napi_get_named_property(env, synced, "added", &added), NULL)
+	uint32_t count = 0;
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_GET_ARRAY_LENGTH", napi_get_array_length(env, added, &count), NULL)
+	ASSERT_WIN32_STATUS(count ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND, "ERR_WINREG_OPEN_KEY", L"RegOpenKeyEx() failed")
+
+	napi_value result, external, resolved;
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_CREATE_EXTERNAL", napi_create_external(env, writer.get(), [](napi_env env, void* data, void* hint) {
+		delete static_cast<winreglib::SharedCacheWriter*>(data);
+	}, NULL, &external), NULL)
+	writer.release();
+
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &result), NULL)
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, key.c_str(), key.length(), &resolved), NULL)
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "cache", external), NULL)
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "key", resolved), NULL)
+	NAPI_THROW_RETURN("publishSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "added", added), NULL)
+	return result;
+}
+
+/**
+ * syncSharedCache() implementation for re-reading a published key after it changed, and with
+ * `deep` every key below it. Returns the `{ added, removed }` keys so the caller can start and
+ * stop watching them.
+ */
+NAPI_METHOD(syncSharedCache) {
+	NAPI_ARGV(3)
+	NAPI_ARGV_WSTRING(key, 1024, 1)
+	bool deep = false;
+	NAPI_THROW_RETURN("syncSharedCache", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &deep), NULL)
+
+	winreglib::SharedCacheWriter* writer = getShared<winreglib::SharedCacheWriter>(env, argv[0]);
+	if (!writer) {
+		return NULL;
+	}
+
+	LOG_DEBUG_2("syncSharedCache", L"key=\"%ls\" deep=%d", key.c_str(), (int)deep)
+	if (!resolveSharedKey(env, writer->shared(), key)) {
+		return NULL;
+	}
+	return syncSharedResult(env, writer, key, deep);
+}
+
+/**
+ * unpublishSharedCache() implementation for releasing a published cache. Readers that still have
+ * it open get an error instead of stale values.
+ */
+NAPI_METHOD(unpublishSharedCache) {
+	NAPI_ARGV(1)
+
+	winreglib::SharedCacheWriter* writer = getShared<winreglib::SharedCacheWriter>(env, argv[0]);
+	if (!writer) {
+		return NULL;
+	}
+	writer->close();
+
+	NAPI_RETURN_UNDEFINED("unpublishSharedCache")
+}
+
+/**
+ * openSharedCache() implementation for mapping a cache published by this or another process.
+ * Returns `{ cache, key }` where `cache` is an external that unmaps the cache when garbage
+ * collected and `key` is the published key.
+ */
+NAPI_METHOD(openSharedCache) {
+	NAPI_ARGV(1)
+	size_t length;
+	NAPI_THROW_RETURN("openSharedCache", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf8(env, argv[0], NULL, 0, &length), NULL)
+	std::string name(length, '\0');
+	NAPI_THROW_RETURN("openSharedCache", "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf8(env, argv[0], &name[0], length + 1, &length), NULL)
+
+	LOG_DEBUG_1("openSharedCache", L"name=\"%hs\"", name.c_str())
+
+	std::unique_ptr<winreglib::SharedCache> cache(new winreglib::SharedCache());
+	std::string reason;
+	if (!cache->open(name, reason)) {
+		if (reason == "not found") {
+			THROW_ERROR_1("ERR_WINREG_SHARED_CACHE_NOT_FOUND", L"Shared cache \"%hs\" is not published", name.c_str())
+		} else {
+			THROW_ERROR_1("ERR_WINREG_SHARED_CACHE", L"%hs", reason.c_str())
+		}
+		return NULL;
+	}
+
+	const std::wstring& key = cache->root();
+	napi_value result, external, resolved;
+	NAPI_THROW_RETURN("openSharedCache", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, key.c_str(), key.length(), &resolved), NULL)
+	NAPI_THROW_RETURN("openSharedCache", "ERR_NAPI_CREATE_EXTERNAL", napi_create_external(env, cache.get(), [](napi_env env, void* data, void* hint) {
+		delete static_cast<winreglib::SharedCache*>(data);
+	}, NULL, &external), NULL)
+	cache.release();
+
+	NAPI_THROW_RETURN("openSharedCache", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &result), NULL)
+	NAPI_THROW_RETURN("openSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "cache", external), NULL)
+	NAPI_THROW_RETURN("openSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, result, "key", resolved), NULL)
+	return result;
+}
+
+/**
+ * readSharedCache() implementation for getting a value from a shared cache. Returns `undefined`
+ * if the key or value doesn't exist.
+ */
+NAPI_METHOD(readSharedCache) {
+	NAPI_ARGV(3)
+	NAPI_ARGV_WSTRING(key, 1024, 1)
+	NAPI_ARGV_WSTRING(name, 256, 2)
+
+	winreglib::SharedCache* cache = getShared<winreglib::SharedCache>(env, argv[0]);
+	if (!cache || !resolveSharedKey(env, *cache, key)) {
+		return NULL;
+	}
+
+	DWORD type = 0;
+	std::vector<BYTE> data;
+	winreglib::SharedRead result = cache->read(key, name, type, data);
+	if (!checkSharedRead(env, result)) {
+		return NULL;
+	}
+	if (result == winreglib::SharedMissing) {
+		NAPI_RETURN_UNDEFINED("readSharedCache")
+	}
+
+	napi_value rval;
+	ValueSink sink(env, &rval);
+	NAPI_THROW_RETURN("readSharedCache", "ERR_NAPI_CREATE_VALUE", winreglib::decodeValue(sink, type, data.data(), data.size()), NULL)
+	return rval;
+}
+
+/**
+ * listSharedCache() implementation for getting a key's subkey and value names from a shared
+ * cache. Returns `{ resolvedRoot, key, subkeys, values }`, or `undefined` if the key doesn't
+ * exist.
+ */
+NAPI_METHOD(listSharedCache) {
+	NAPI_ARGV(2)
+	NAPI_ARGV_WSTRING(key, 1024, 1)
+
+	winreglib::SharedCache* cache = getShared<winreglib::SharedCache>(env, argv[0]);
+	if (!cache || !resolveSharedKey(env, *cache, key)) {
+		return NULL;
+	}
+
+	std::vector<std::wstring> subkeyNames;
+	std::vector<std::wstring> valueNames;
+	winreglib::SharedRead result = cache->list(key, subkeyNames, valueNames);
+	if (!checkSharedRead(env, result)) {
+		return NULL;
+	}
+	if (result == winreglib::SharedMissing) {
+		NAPI_RETURN_UNDEFINED("listSharedCache")
+	}
+
+	std::wstring::size_type p = key.find(L'\\');
+	std::wstring root = key.substr(0, p);
+	napi_value rval, resolvedRoot, resolvedKey;
+	napi_value subkeys = createNameArray(env, subkeyNames);
+	napi_value values = subkeys ? createNameArray(env, valueNames) : NULL;
+	if (!values) {
+		return NULL;
+	}
+	NAPI_THROW_RETURN("listSharedCache", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
+	NAPI_THROW_RETURN("listSharedCache", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, root.c_str(), root.length(), &resolvedRoot), NULL)
+	NAPI_THROW_RETURN("listSharedCache", "ERR_NAPI_CREATE_STRING", winreglib::createWideString(env, key.c_str(), key.length(), &resolvedKey), NULL)
+	NAPI_THROW_RETURN("listSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "resolvedRoot", resolvedRoot), NULL)
+	NAPI_THROW_RETURN("listSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "key", resolvedKey), NULL)
+	NAPI_THROW_RETURN("listSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "subkeys", subkeys), NULL)
+	NAPI_THROW_RETURN("listSharedCache", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "values", values), NULL)
+	return rval;
+}
+
+/**
+ * sharedCacheVersion() implementation that returns how many times the publisher has written to
+ * the cache.
+ */
+NAPI_METHOD(sharedCacheVersion) {
+	NAPI_ARGV(1)
+
+	winreglib::SharedCache* cache = getShared<winreglib::SharedCache>(env, argv[0]);
+	if (!cache) {
+		return NULL;
+	}
+
+	napi_value rval;
+	NAPI_THROW_RETURN("sharedCacheVersion", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)cache->version(), &rval), NULL)
+	return rval;
+}
+
+/**
+ * closeSharedCache() implementation for unmapping a shared cache.
+ */
+NAPI_METHOD(closeSharedCache) {
+	NAPI_ARGV(1)
+
+	winreglib::SharedCache* cache = getShared<winreglib::SharedCache>(env, argv[0]);
+	if (!cache) {
+		return NULL;
+	}
+	cache->close();
+
+	NAPI_RETURN_UNDEFINED("closeSharedCache")
+}
+
+/**
+ * Checks that a key to watch has both a root and a subkey and spells out its root. Returns false
+ * with an error thrown if it doesn't.
+ */
+static bool resolveWatchKey(napi_env env, std::wstring& key) {
+	std::string::size_type p = key.find('\\');
+	if (p == std::string::npos) {
+		napi_throw_error(env, "ERR_NO_SUBKEY", "Expected key to contain both a root and subkey");
+		return false;
+	}
+
+	std::wstring root = key.substr(0, p);
+	auto it = winreglib::rootMap.find(root);
+	if (it != winreglib::rootMap.end()) {
+		root = it->second;
+	}
+	auto it2 = winreglib::rootKeys.find(root);
+	if (it2 == winreglib::rootKeys.end()) {
+		THROW_ERROR_1("ERR_WINREG_INVALID_ROOT", L"Invalid registry root key \"%ls\"", root.c_str())
+		return false;
+	}
+	key = root + key.substr(p);
+	return true;
+}
+
+/**
+ * Common watch/unwatch boilerplate. A key is only treated as a pattern when `pattern` is passed,
+ * otherwise `*` and `**` are key names like any other.
+ */
+napi_value watchHelper(napi_env env, napi_callback_info info, winreglib::WatchAction action) {
+	const char* ns = action == winreglib::Watch ? "watch" : "unwatch";
+	NAPI_ARGV(3);
+	NAPI_ARGV_WSTRING(key, 1024, 0)
+	napi_value listener = argv[1];
+
+	bool pattern = false;
+	if (argc > 2) {
+		NAPI_THROW_RETURN(ns, "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &pattern), NULL)
+	}
+
+	if (!resolveWatchKey(env, key)) {
+		return NULL;
+	}
+
+	LOG_DEBUG_2(ns, L"key=\"%ls\" pattern=%d", key.c_str(), (int)pattern)
+
+	// keys with wildcard segments are subscribed to the pattern trie
+	if (pattern && winreglib::PatternTrie::isPattern(key)) {
+		winreglib::Instance::get(env)->watchman->subscribe(key, listener, action);
+	} else {
+		winreglib::Instance::get(env)->watchman->config(key, listener, action);
+	}
+
+	NAPI_RETURN_UNDEFINED(ns)
+}
+
+/**
+ * Common watchMany/unwatchMany boilerplate. Reads the keys and spells out their roots, then, when
+ * `pattern` is set, adds or removes the listener for the keys with wildcard segments, since each
+ * pattern is matched against the whole tree. The rest are returned in `keys`. Returns false with
+ * an error thrown if a key is invalid, in which case nothing was watched or unwatched.
+ */
+static bool watchManyHelper(napi_env env, napi_value value, napi_value listener, winreglib::WatchAction action, bool pattern, std::vector<std::wstring>& keys) {
+	const char* ns = action == winreglib::Watch ? "watchMany" : "unwatchMany";
+
+	uint32_t count = 0;
+	std::vector<std::wstring> patterns;
+	NAPI_THROW_RETURN(ns, "ERR_NAPI_GET_ARRAY_LENGTH", napi_get_array_length(env, value, &count), false)
+	for (uint32_t i = 0; i < count; ++i) {
+		napi_value element;
+		size_t len = 0;
+		NAPI_THROW_RETURN(ns, "ERR_NAPI_GET_ELEMENT", napi_get_element(env, value, i, &element), false)
+		NAPI_THROW_RETURN(ns, "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf16(env, element, NULL, 0, &len), false)
+		std::u16string str(len, u'\0');
+		NAPI_THROW_RETURN(ns, "ERR_NAPI_GET_VALUE_STRING", napi_get_value_string_utf16(env, element, &str[0], len + 1, &len), false)
+		std::wstring key(str.begin(), str.end());
+		if (!resolveWatchKey(env, key)) {
+			return false;
+		}
+		if (pattern && winreglib::PatternTrie::isPattern(key)) {
+			patterns.push_back(key);
+		} else {
+			keys.push_back(key);
+		}
+	}
+
+	LOG_DEBUG_2(ns, L"%ld keys, %ld patterns", (uint32_t)keys.size(), (uint32_t)patterns.size())
+
+	winreglib::Watchman* watchman = winreglib::Instance::get(env)->watchman;
+	for (auto const& pattern : patterns) {
+		watchman->subscribe(pattern, listener, action);
+	}
+	return true;
+}
+
+struct WatchManyWork {
+	winreglib::Backend* backend;
+	std::vector<winreglib::WatchOpen> opens;
+	napi_deferred deferred;
+	napi_async_work work;
+};
+
+/**
+ * Opens the keys of a `watchMany()` batch on a worker thread.
+ */
+static void watchManyExecute(napi_env env, void* data) {
+	WatchManyWork* work = static_cast<WatchManyWork*>(data);
+	winreglib::Watchman::openMany(work->backend, work->opens);
+}
+
+/**
+ * Loads the opened keys into the watcher tree on the main thread and resolves the promise returned
+ * by `watchMany()`. If the backend was switched in the meantime, the keys are opened again with the
+ * new one.
+ */
+static void watchManyComplete(napi_env env, napi_status status, void* data) {
+	WatchManyWork* work = static_cast<WatchManyWork*>(data);
+
+	winreglib::Instance* instance = winreglib::Instance::get(env);
+	if (status == napi_ok && instance && instance->watchman) {
+		instance->watchman->loadMany(work->opens, work->backend == winreglib::backend);
+	}
+
+	// close the handles that weren't loaded
+	for (auto const& open : work->opens) {
+		if (open.hkey) {
+			work->backend->closeKey(open.hkey);
+		}
+	}
+
+	napi_value undefined;
+	napi_get_undefined(env, &undefined);
+	napi_resolve_deferred(env, work->deferred, undefined);
+
+	napi_delete_async_work(env, work->work);
+	delete work;
+}
+
+/**
+ * watchStats() implementation for counting the keys this environment is watching and the key
+ * handles it has open.
+ */
+NAPI_METHOD(watchStats) {
+	winreglib::WatchStats stats = winreglib::Instance::get(env)->watchman->stats();
+
+	napi_value rval, keys, handles, polled, polls, queued, coalesced, overflowed, dropped;
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_OBJECT", napi_create_object(env, &rval), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)stats.keys, &keys), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)stats.handles, &handles), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)stats.polled, &polled), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)stats.polls, &polls), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)stats.queue.queued, &queued), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)stats.queue.coalesced, &coalesced), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)stats.queue.overflowed, &overflowed), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_CREATE_DOUBLE", napi_create_double(env, (double)stats.queue.dropped, &dropped), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "keys", keys), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "handles", handles), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "polled", polled), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "polls", polls), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "queued", queued), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "coalesced", coalesced), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "overflowed", overflowed), NULL)
+	NAPI_THROW_RETURN("watchStats", "ERR_NAPI_SET_NAMED_PROPERTY", napi_set_named_property(env, rval, "dropped", dropped), NULL)
+	return rval;
+}
+
+/**
+ * watch() implementation to watch a key for changes.
+ */
+NAPI_METHOD(watch) {
+	return watchHelper(env, info, winreglib::Watch);
+}
+
+/**
+ * unwatch() implementation to stop watching a key for changes.
+ */
+NAPI_METHOD(unwatch) {
+	return watchHelper(env, info, winreglib::Unwatch);
+}
+
+/**
+ * watchMany() implementation to watch many keys for changes at once. The watcher tree is built in
+ * one pass and the keys are opened on a worker thread. Returns a promise that resolves once the
+ * keys that exist are watched.
+ */
+NAPI_METHOD(watchMany) {
+	NAPI_ARGV(3)
+	napi_value listener = argv[1];
+
+	bool pattern = false;
+	if (argc > 2) {
+		NAPI_THROW_RETURN("watchMany", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &pattern), NULL)
+	}
+
+	std::vector<std::wstring> keys;
+	if (!watchManyHelper(env, argv[0], listener, winreglib::Watch, pattern, keys)) {
+		return NULL;
+	}
+
+	winreglib::Watchman* watchman = winreglib::Instance::get(env)->watchman;
+	std::unique_ptr<WatchManyWork> work(new WatchManyWork());
+	work->backend = winreglib::backend;
+	watchman->configMany(keys, listener, winreglib::Watch, work->opens);
+
+	napi_value promise, name;
+	napi_status s = napi_create_promise(env, &work->deferred, &promise);
+	if (s == napi_ok) {
+		s = napi_create_string_utf8(env, "winreglib.watchMany", NAPI_AUTO_LENGTH, &name);
+	}
+	if (s == napi_ok) {
+		s = napi_create_async_work(env, NULL, name, watchManyExecute, watchManyComplete, work.get(), &work->work);
+	}
+	if (s == napi_ok) {
+		s = napi_queue_async_work(env, work->work);
+	}
+	if (s != napi_ok) {
+		// the keys are watched either way, so open them here
+		watchman->loadMany(work->opens, false);
+		NAPI_THROW_RETURN("watchMany", "ERR_NAPI_QUEUE_ASYNC_WORK", s, NULL)
+	}
+
+	work.release();
+	return promise;
+}
 
 /**
- * Wire up the public API, cleanup handler, and creates the Watchman instance.
+ * unwatchMany() implementation to stop watching many keys for changes at once.
+ */
+NAPI_METHOD(unwatchMany) {
+	NAPI_ARGV(3)
+	napi_value listener = argv[1];
+
+	bool pattern = false;
+	if (argc > 2) {
+		NAPI_THROW_RETURN("unwatchMany", "ERR_NAPI_GET_VALUE_BOOL", napi_get_value_bool(env, argv[2], &pattern), NULL)
+	}
+
+	std::vector<std::wstring> keys;
+	if (!watchManyHelper(env, argv[0], listener, winreglib::Unwatch, pattern, keys)) {
+		return NULL;
+	}
+
+	std::vector<winreglib::WatchOpen> opens;
+	winreglib::Instance::get(env)->watchman->configMany(keys, listener, winreglib::Unwatch, opens);
+
+	NAPI_RETURN_UNDEFINED("unwatchMany")
+}
+
+/**
+ * Destroys the environment's Watchman instance, log ref handle, and notify handle.
+ */
+static void cleanup(napi_async_cleanup_hook_handle handle, void* arg) {
+	winreglib::Instance* instance = (winreglib::Instance*)arg;
+
+	if (instance->logRef != NULL) {
+		napi_delete_reference(instance->env, instance->logRef);
+		instance->logRef = NULL;
+	}
+
+	// stops the monitor thread from waiting on this environment's keys and closes the change
+	// notification handle
+	delete instance->watchman;
+	instance->watchman = NULL;
+
+	// writes whatever the journal still has buffered
+	delete instance->journal;
+	instance->journal = NULL;
+
+	if (winreglib::Instance::current() == instance) {
+		winreglib::Instance::setCurrent(NULL);
+	}
+	napi_set_instance_data(instance->env, NULL, NULL, NULL);
+
+	// close callbacks are called in order, so the cleanup is complete once the log notify handle
+	// is closed
+	uv_async_t* logNotify;
+	{
+		std::lock_guard<std::mutex> lock(instance->logLock);
+		logNotify = instance->logNotify;
+		instance->logNotify = NULL;
+	}
+	logNotify->data = handle;
+	uv_close((uv_handle_t*)logNotify, [](uv_handle_t* h) {
+		napi_remove_async_cleanup_hook((napi_async_cleanup_hook_handle)h->data);
+		delete reinterpret_cast<uv_async_t*>(h);
+	});
+
+	delete instance;
+}
+
+/**
+ * Wire up the public API, cleanup handler, and creates the environment's instance data and
+ * Watchman instance.
  */
 NAPI_INIT() {
+	NAPI_EXPORT_FUNCTION(batch);
+	NAPI_EXPORT_FUNCTION(closeCursor);
+	NAPI_EXPORT_FUNCTION(closeJournal);
+	NAPI_EXPORT_FUNCTION(closePerfData);
+	NAPI_EXPORT_FUNCTION(closeSharedCache);
+	NAPI_EXPORT_FUNCTION(compactJournal);
+	NAPI_EXPORT_FUNCTION(diff);
+	NAPI_EXPORT_FUNCTION(exportTimeline);
+	NAPI_EXPORT_FUNCTION(exportTree);
+	NAPI_EXPORT_FUNCTION(fingerprint);
+	NAPI_EXPORT_FUNCTION(flushJournal);
 	NAPI_EXPORT_FUNCTION(get);
+	NAPI_EXPORT_FUNCTION(has);
+	NAPI_EXPORT_FUNCTION(hasMany);
+	NAPI_EXPORT_FUNCTION(hasViewKey);
+	NAPI_EXPORT_FUNCTION(info);
 	NAPI_EXPORT_FUNCTION(init);
+	NAPI_EXPORT_FUNCTION(invalidateView);
+	NAPI_EXPORT_FUNCTION(journalInfo);
 	NAPI_EXPORT_FUNCTION(list);
+	NAPI_EXPORT_FUNCTION(listSharedCache);
+	NAPI_EXPORT_FUNCTION(listView);
+	NAPI_EXPORT_FUNCTION(openCursor);
+	NAPI_EXPORT_FUNCTION(openJournal);
+	NAPI_EXPORT_FUNCTION(openPerfData);
+	NAPI_EXPORT_FUNCTION(openSharedCache);
+	NAPI_EXPORT_FUNCTION(openView);
+	NAPI_EXPORT_FUNCTION(parsePerfData);
+	NAPI_EXPORT_FUNCTION(publishSharedCache);
+	NAPI_EXPORT_FUNCTION(query);
+	NAPI_EXPORT_FUNCTION(readCursor);
+	NAPI_EXPORT_FUNCTION(readJournal);
+	NAPI_EXPORT_FUNCTION(readPerfData);
+	NAPI_EXPORT_FUNCTION(readSharedCache);
+	NAPI_EXPORT_FUNCTION(readView);
+	NAPI_EXPORT_FUNCTION(replay);
+	NAPI_EXPORT_FUNCTION(scan);
+	NAPI_EXPORT_FUNCTION(setBackend);
+	NAPI_EXPORT_FUNCTION(setMemoryClock);
+	NAPI_EXPORT_FUNCTION(setWatchQueue);
+	NAPI_EXPORT_FUNCTION(sharedCacheVersion);
+	NAPI_EXPORT_FUNCTION(startRecording);
+	NAPI_EXPORT_FUNCTION(startTimeline);
+	NAPI_EXPORT_FUNCTION(stopRecording);
+	NAPI_EXPORT_FUNCTION(stopTimeline);
+	NAPI_EXPORT_FUNCTION(syncSharedCache);
+	NAPI_EXPORT_FUNCTION(tryGet);
+	NAPI_EXPORT_FUNCTION(unpublishSharedCache);
+	NAPI_EXPORT_FUNCTION(viewStats);
+	NAPI_EXPORT_FUNCTION(watchStats);
 	NAPI_EXPORT_FUNCTION(watch);
 	NAPI_EXPORT_FUNCTION(unwatch);
+	NAPI_EXPORT_FUNCTION(watchMany);
+	NAPI_EXPORT_FUNCTION(unwatchMany);
+
+	winreglib::Instance* instance = new winreglib::Instance(env);
+	winreglib::Instance::setCurrent(instance);
+
+	NAPI_THROW(
+		"init",
+		"ERR_NAPI_SET_INSTANCE_DATA",
+		napi_set_instance_data(env, instance, NULL, NULL)
+	)
 
 	NAPI_THROW(
 		"init",
 		"ERR_NAPI_ADD_ASYNC_CLEANUP_HOOK",
-		napi_add_async_cleanup_hook(env, cleanup, env, NULL)
+		napi_add_async_cleanup_hook(env, cleanup, instance, NULL)
 	)
 
-	winreglib::watchman = new winreglib::Watchman(env);
+	// wire up the log notification handler
+	uv_loop_t* loop;
+	NAPI_THROW("init", "ERR_NAPI_GET_UV_EVENT_LOOP", napi_get_uv_event_loop(env, &loop))
+	instance->logNotify = new uv_async_t;
+	instance->logNotify->data = instance;
+	uv_async_init(loop, instance->logNotify, &dispatchLog);
+	uv_unref((uv_handle_t*)instance->logNotify);
+
+	instance->watchman = new winreglib::Watchman(env, instance);
 }
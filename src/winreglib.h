@@ -7,28 +7,63 @@
 // v12.22.0+, v14.17.0+, v15.12.0+, 16.0.0 and all later versions
 #define NAPI_VERSION 8
 
+#include "platform.h"
 #include <map>
+#include <memory>
+#include <mutex>
 #include <napi-macros.h>
 #include <node_api.h>
 #include <queue>
 #include <string>
+#include <uv.h>
 
 namespace winreglib {
+	class Journal;
+	class Watchman;
+
 	struct LogMessage {
 		LogMessage() {}
 		LogMessage(const std::string ns, const std::u16string msg) : ns(ns), msg(msg) {}
 		std::string ns;
 		std::u16string msg;
 	};
-}
 
-#define TRIM_EXTRA_LINES(str) \
-	{ \
-		char* nl = ::strchr(str, '\r'); \
-		if (nl != NULL) { \
-			*nl = '\0'; \
-		} \
+	/**
+	 * The addon's state for a single Node.js environment, that is the main thread or a worker
+	 * thread. Stored as the environment's instance data so that every worker gets its own watcher
+	 * tree and log channel.
+	 */
+	struct Instance {
+		Instance(napi_env env) : env(env), watchman(NULL), journal(NULL), logRef(NULL), logNotify(NULL) {}
+
+		static Instance* current();
+		static Instance* get(napi_env env);
+		static void setCurrent(Instance* instance);
+
+		void log(const char* ns, const std::wstring& msg);
+
+		napi_env env;
+		Watchman* watchman;
+		Journal* journal;
+		napi_ref logRef;
+		uv_async_t* logNotify;
+		std::mutex logLock;
+		std::queue<std::shared_ptr<LogMessage>> logQueue;
+	};
+
+	/**
+	 * Creates a JavaScript string from a registry name. On Windows, `wchar_t` is already UTF-16 and
+	 * is passed through without a copy.
+	 */
+	inline napi_status createWideString(napi_env env, const wchar_t* str, size_t length, napi_value* result) {
+#ifdef _WIN32
+		return ::napi_create_string_utf16(env, reinterpret_cast<const char16_t*>(str), length, result);
+#else
+		std::u16string tmp(str, str + length);
+		return ::napi_create_string_utf16(env, tmp.c_str(), tmp.length(), result);
+#endif
 	}
+}
 
 #define NAPI_THROW_RETURN_CODE(ns, code, call, retCode) \
 	{ \
@@ -147,10 +182,8 @@ namespace winreglib {
 	}
 
 #define FORMAT_ERROR(status, code, message) \
-	char msg[512]; \
-	::FormatMessage(FORMAT_MESSAGE_FROM_SYSTEM, NULL, status, NULL, (LPTSTR)&msg, 512, NULL); \
-	TRIM_EXTRA_LINES(msg); \
-	THROW_ERROR_2(code, message ": %hs (code %d)", msg, status);
+	std::wstring msg = winreglib::formatSystemMessage(status); \
+	THROW_ERROR_2(code, message ": %ls (code %d)", msg.c_str(), status);
 
 #define ASSERT_WIN32_STATUS(status, code, message) \
 	if (status != ERROR_SUCCESS) { \
@@ -162,27 +195,6 @@ namespace winreglib {
 		return NULL; \
 	}
 
-#define SET_FROM_REGISTRY(fn, key, idx, buffer, maxSize, code, dest, push) \
-	DWORD size = maxSize; \
-	LSTATUS status = fn(key, idx, buffer, &size, NULL, NULL, NULL, NULL); \
-	if (status != ERROR_SUCCESS) { \
-		FORMAT_ERROR(status, code, L"" #fn " failed") \
-		throw; \
-	} \
-	\
-	std::wstring subkey_wstr(buffer); \
-	std::u16string subkey_str16(subkey_wstr.begin(), subkey_wstr.end()); \
-	\
-	napi_value result; \
-	if (napi_create_string_utf16(env, subkey_str16.c_str(), NAPI_AUTO_LENGTH, &result) != napi_ok) { \
-		napi_throw_error(env, NULL, "napi_create_string_utf16 failed"); \
-		throw; \
-	} \
-	if (napi_call_function(env, dest, push, 1, &result, NULL) != napi_ok) { \
-		napi_throw_error(env, NULL, "napi_call_function failed"); \
-		throw; \
-	}
-
 #define SET_PROP_FROM_WSTRING(obj, prop, str) \
 	{ \
 		std::wstring* tmp = str; \
@@ -192,16 +204,6 @@ namespace winreglib {
 		NAPI_STATUS_THROWS(napi_set_named_property(env, obj, prop, value)) \
 	}
 
-#define LOG_DEBUG_VARS \
-	std::mutex logLock; \
-	uv_async_t* logNotify; \
-	std::queue<std::shared_ptr<winreglib::LogMessage>> logQueue;
-
-#define LOG_DEBUG_EXTERN_VARS \
-	extern std::mutex logLock; \
-	extern uv_async_t* logNotify; \
-	extern std::queue<std::shared_ptr<winreglib::LogMessage>> logQueue;
-
 #ifdef ENABLE_RAW_DEBUGGING
 	#define LOG_DEBUG(ns, msg) \
 		{ \
@@ -212,33 +214,22 @@ namespace winreglib {
 	#define WLOG_DEBUG(ns, wmsg) \
 		::wprintf(L"%hs: %s\n", ns, wmsg.c_str());
 #else
+	// log messages go to the environment running on the current thread, messages logged from other
+	// threads are dropped unless the thread is acting on behalf of an environment
 	#define LOG_DEBUG(ns, msg) \
 		{ \
-			std::wstring wbuffer(msg); \
-			std::u16string u16buffer(wbuffer.begin(), wbuffer.end()); \
-			std::shared_ptr<winreglib::LogMessage> obj = std::make_shared<winreglib::LogMessage>(ns, u16buffer); \
-			std::lock_guard<std::mutex> lock(winreglib::logLock); \
-			winreglib::logQueue.push(obj); \
-			if (winreglib::logNotify) { \
-				::uv_async_send(winreglib::logNotify); \
+			winreglib::Instance* _instance = winreglib::Instance::current(); \
+			if (_instance) { \
+				_instance->log(ns, msg); \
 			} \
 		}
 
-	#define WLOG_DEBUG(ns, wmsg) \
-		{ \
-			std::u16string u16buffer(wmsg.begin(), wmsg.end()); \
-			std::shared_ptr<winreglib::LogMessage> obj = std::make_shared<winreglib::LogMessage>(ns, u16buffer); \
-			std::lock_guard<std::mutex> lock(winreglib::logLock); \
-			winreglib::logQueue.push(obj); \
-			if (winreglib::logNotify) { \
-				::uv_async_send(winreglib::logNotify); \
-			} \
-		}
+	#define WLOG_DEBUG(ns, wmsg) LOG_DEBUG(ns, wmsg)
 #endif
 
 #define LOG_DEBUG_FORMAT(ns, code) \
 	{ \
-		wchar_t* buffer = new wchar_t[1024]; \
+		wchar_t buffer[1024]; \
 		::code; \
 		LOG_DEBUG(ns, buffer) \
 	}
@@ -253,10 +244,8 @@ namespace winreglib {
 
 #define LOG_DEBUG_WIN32_ERROR(ns, message, code) \
 	if (code != ERROR_SUCCESS) { \
-		char errorMsg[512]; \
-		::FormatMessage(FORMAT_MESSAGE_FROM_SYSTEM, NULL, code, NULL, (LPTSTR)&errorMsg, 512, NULL); \
-		TRIM_EXTRA_LINES(errorMsg); \
-		LOG_DEBUG_2(ns, message "%hs (code %d)", errorMsg, code); \
+		std::wstring errorMsg = winreglib::formatSystemMessage(code); \
+		LOG_DEBUG_2(ns, message "%ls (code %d)", errorMsg.c_str(), code); \
 	}
 
 #endif
@@ -0,0 +1,289 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+import { randomBytes } from 'node:crypto';
+
+useMemoryBackend();
+
+describe('set()', () => {
+	it('should error if key is not specified', () => {
+		expect(() => {
+			winreglib.set(undefined as any, 'foo', 'bar');
+		}).toThrowError(new TypeError('Expected key to be a non-empty string'));
+	});
+
+	it('should error if value name is not specified', () => {
+		expect(() => {
+			winreglib.set('HKCU\\Software', undefined as any, 'bar');
+		}).toThrowError(
+			new TypeError('Expected value name to be a non-empty string')
+		);
+	});
+
+	it('should error if key is not valid', () => {
+		const err: Error & { code?: string } = new Error(
+			'Invalid registry root key "foo"'
+		);
+		err.code = 'ERR_WINREG_INVALID_ROOT';
+		expect(() => {
+			winreglib.set('foo\\bar', 'baz', 'wiz');
+		}).toThrowError(err);
+	});
+
+	it('should error if the data does not match the type', () => {
+		const err: Error & { code?: string } = new Error(
+			'Invalid data for value "foo" (type 4)'
+		);
+		err.code = 'ERR_WINREG_INVALID_VALUE';
+		expect(() => {
+			winreglib.set(testKey(), 'foo', 'bar', 'REG_DWORD');
+		}).toThrowError(err);
+	});
+
+	it('should write and read back each value type', () => {
+		const key = testKey();
+
+		winreglib.set(key, 'sz', 'hello');
+		winreglib.set(key, 'expand', '%TEMP%\\foo', 'REG_EXPAND_SZ');
+		winreglib.set(key, 'multi', ['a', 'bc', 'def']);
+		winreglib.set(key, 'dword', 0xdeadbeef);
+		winreglib.set(key, 'qword', 1234567890123);
+		winreglib.set(key, 'binary', Buffer.from([1, 2, 3, 4]));
+		winreglib.set(key, 'none', null);
+
+		expect(winreglib.get(key, 'sz')).toBe('hello');
+		expect(winreglib.get(key, 'expand')).toBe('%TEMP%\\foo');
+		expect(winreglib.get(key, 'multi')).toEqual(['a', 'bc', 'def']);
+		expect(winreglib.get(key, 'dword')).toBe(0xdeadbeef);
+		expect(winreglib.get(key, 'qword')).toBe(1234567890123);
+		expect(winreglib.get(key, 'binary')).toEqual(Buffer.from([1, 2, 3, 4]));
+		expect(winreglib.get(key, 'none')).toBeNull();
+		expect(winreglib.list(key)?.values).toHaveLength(7);
+	});
+
+	it('should read back a 64-bit integer as a number unless asked for a bigint', () => {
+		const key = testKey();
+		winreglib.set(key, 'small', 42n);
+		winreglib.set(key, 'large', 0xfedcba9876543210n);
+
+		expect(winreglib.get(key, 'small')).toBe(42);
+		expect(winreglib.get(key, 'large')).toBe(Number(0xfedcba9876543210n));
+		expect(winreglib.get(key, 'small', { bigint: true })).toBe(42n);
+		expect(winreglib.get(key, 'large', { bigint: true })).toBe(0xfedcba9876543210n);
+	});
+
+	it('should read back a large binary value', () => {
+		const key = testKey();
+		const data = randomBytes(4 * 1024 * 1024);
+		winreglib.set(key, 'blob', data);
+		expect((winreglib.get(key, 'blob') as Buffer).equals(data)).toBe(true);
+	});
+
+	it('should overwrite an existing value', () => {
+		const key = testKey();
+		winreglib.set(key, 'foo', 'bar');
+		winreglib.set(key, 'FOO', 'baz');
+		expect(winreglib.get(key, 'foo')).toBe('baz');
+		expect(winreglib.list(key)?.values).toHaveLength(1);
+	});
+});
+
+describe('createKey()', () => {
+	it('should create a key and its missing parents', () => {
+		const key = testKey();
+		winreglib.createKey(`${key}\\foo\\bar`);
+		expect(winreglib.list(key)?.subkeys).toEqual(['foo']);
+		expect(winreglib.list(`${key}\\foo`)?.subkeys).toEqual(['bar']);
+	});
+
+	it('should succeed if the key already exists', () => {
+		const key = testKey();
+		winreglib.createKey(key);
+		winreglib.createKey(key);
+		expect(winreglib.list(key)?.subkeys).toEqual([]);
+	});
+});
+
+describe('delete()', () => {
+	it('should delete a value', () => {
+		const key = testKey();
+		winreglib.set(key, 'foo', 'bar');
+		winreglib.delete(key, 'foo');
+		expect(winreglib.list(key)?.values).toEqual([]);
+	});
+
+	it('should error if the value does not exist', () => {
+		const err: Error & { code?: string } = new Error(
+			'Registry key or value not found'
+		);
+		err.code = 'ERR_WINREG_NOT_FOUND';
+		const key = testKey();
+		winreglib.createKey(key);
+		expect(() => {
+			winreglib.delete(key, 'foo');
+		}).toThrowError(err);
+	});
+
+	it('should delete a key and all of its subkeys', () => {
+		const key = testKey();
+		winreglib.set(`${key}\\foo\\bar`, 'baz', 'wiz');
+		winreglib.createKey(`${key}\\foo\\bar\\qux`);
+		winreglib.delete(`${key}\\foo`);
+		expect(winreglib.list(key)?.subkeys).toEqual([]);
+	});
+});
+
+describe('batch()', () => {
+	it('should error if operations is not an array', () => {
+		expect(() => {
+			winreglib.batch(undefined as any);
+		}).toThrowError(new TypeError('Expected operations to be an array'));
+	});
+
+	it('should error if an operation is invalid', () => {
+		expect(() => {
+			winreglib.batch([{ op: 'foo', key: testKey() } as any]);
+		}).toThrowError(new TypeError('Invalid operation "foo"'));
+	});
+
+	it('should apply operations in order', () => {
+		const key = testKey();
+		const results = winreglib.batch([
+			{ op: 'createKey', key: `${key}\\a` },
+			{ op: 'set', key: `${key}\\a`, name: 'x', value: 'one' },
+			{ op: 'set', key: `${key}\\a`, name: 'x', value: 'two' },
+			{ op: 'set', key: `${key}\\b`, name: 'y', value: 1 },
+			{ op: 'delete', key: `${key}\\b` },
+			{ op: 'set', key: `${key}\\a`, name: 'z', value: 2 }
+		]);
+		expect(results).toEqual(Array(6).fill({ success: true }));
+		expect(winreglib.get(`${key}\\a`, 'x')).toBe('two');
+		expect(winreglib.get(`${key}\\a`, 'z')).toBe(2);
+		expect(winreglib.list(key)?.subkeys).toEqual(['a']);
+	});
+
+	it('should report the status of each operation', () => {
+		const key = testKey();
+		const results = winreglib.batch([
+			{ op: 'set', key, name: 'foo', value: 'bar' },
+			{ op: 'delete', key, name: 'missing' },
+			{ op: 'set', key, name: 'baz', value: 'wiz' }
+		]);
+		expect(results[0]).toEqual({ success: true });
+		expect(results[1].success).toBe(false);
+		expect(results[1].error).toBeInstanceOf(Error);
+		expect(results[1].error?.code).toBe('ERR_WINREG_NOT_FOUND');
+		expect(results[2]).toEqual({ success: true });
+		expect(winreglib.list(key)?.values).toHaveLength(2);
+	});
+
+	it('should roll back a failed transaction', () => {
+		const key = testKey();
+		winreglib.set(key, 'foo', 'original');
+
+		const results = winreglib.batch(
+			[
+				{ op: 'set', key, name: 'foo', value: 'changed' },
+				{ op: 'set', key: `${key}\\sub`, name: 'bar', value: 1 },
+				{ op: 'delete', key, name: 'missing' },
+				{ op: 'set', key, name: 'baz', value: 'wiz' }
+			],
+			{ transaction: true }
+		);
+
+		expect(results.map(r => r.success)).toEqual([
+			false,
+			false,
+			false,
+			false
+		]);
+		expect(results[0].error?.code).toBe('ERR_WINREG_TRANSACTION_ABORTED');
+		expect(results[1].error?.code).toBe('ERR_WINREG_TRANSACTION_ABORTED');
+		expect(results[2].error?.code).toBe('ERR_WINREG_NOT_FOUND');
+		expect(results[3].error?.code).toBe('ERR_WINREG_TRANSACTION_ABORTED');
+
+		expect(winreglib.get(key, 'foo')).toBe('original');
+		expect(winreglib.list(key)?.subkeys).toEqual([]);
+		expect(winreglib.list(key)?.values).toEqual(['foo']);
+	});
+
+	it('should commit a successful transaction', () => {
+		const key = testKey();
+		const results = winreglib.batch(
+			[
+				{ op: 'set', key, name: 'foo', value: 'bar' },
+				{ op: 'createKey', key: `${key}\\sub` }
+			],
+			{ transaction: true }
+		);
+		expect(results).toEqual([{ success: true }, { success: true }]);
+		expect(winreglib.get(key, 'foo')).toBe('bar');
+		expect(winreglib.list(key)?.subkeys).toEqual(['sub']);
+	});
+
+	it('should not notify our own watchers when quiet', async () => {
+		const key = testKey();
+		winreglib.createKey(key);
+
+		const handle = winreglib.watch(key);
+		const events: unknown[] = [];
+		handle.on('change', evt => events.push(evt));
+
+		try {
+			winreglib.batch([{ op: 'set', key, name: 'foo', value: 'bar' }], {
+				quiet: true
+			});
+			await new Promise(resolve => setTimeout(resolve, 250));
+			expect(events).toEqual([]);
+
+			winreglib.set(key, 'foo', 'baz');
+			await new Promise(resolve => setTimeout(resolve, 250));
+			expect(events).toEqual([{ type: 'change', key: `HKEY_CURRENT_USER${key.substring(4)}` }]);
+		} finally {
+			handle.stop();
+		}
+	});
+
+	it('should not notify our own watchers when quiet while the event loop is busy', async () => {
+		const key = testKey();
+		winreglib.createKey(key);
+
+		const handle = winreglib.watch(key);
+		const events: unknown[] = [];
+		handle.on('change', evt => events.push(evt));
+
+		try {
+			// the notification is dispatched long after the write
+			winreglib.batch([{ op: 'set', key, name: 'foo', value: 'bar' }], {
+				quiet: true
+			});
+			const deadline = Date.now() + 1500;
+			while (Date.now() < deadline) {
+				// busy
+			}
+			await new Promise(resolve => setTimeout(resolve, 250));
+			expect(events).toEqual([]);
+		} finally {
+			handle.stop();
+		}
+	});
+
+	it('should not mute keys that were not watched when quiet', async () => {
+		const key = testKey();
+		winreglib.batch([{ op: 'set', key, name: 'foo', value: 'bar' }], {
+			quiet: true
+		});
+
+		const handle = winreglib.watch(key);
+		const events: unknown[] = [];
+		handle.on('change', evt => events.push(evt));
+
+		try {
+			winreglib.set(key, 'foo', 'baz');
+			await new Promise(resolve => setTimeout(resolve, 250));
+			expect(events).toEqual([{ type: 'change', key: `HKEY_CURRENT_USER${key.substring(4)}` }]);
+		} finally {
+			handle.stop();
+		}
+	});
+});
@@ -0,0 +1,173 @@
+import { beforeAll, describe, expect, it } from 'vitest';
+import winreglib, { type RegistryValueType } from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+import { Writable } from 'node:stream';
+
+useMemoryBackend();
+
+const utf16 = (str: string) => Buffer.from(str, 'utf16le');
+
+const exportValues = async (key: string) => {
+	const chunks: Buffer[] = [];
+	const out = new Writable({
+		write(chunk, _encoding, callback) {
+			chunks.push(chunk);
+			callback();
+		}
+	});
+	await winreglib.exportTree(key, out);
+	const [line] = Buffer.concat(chunks).toString('utf8').trim().split('\n');
+	return JSON.parse(line).values as { name: string; data: unknown }[];
+};
+
+const toJson = (value: unknown) => (Buffer.isBuffer(value) ? value.toString('base64') : value);
+
+// raw data as it could be stored by another program, and what every read path decodes it to,
+// except export when it differs, which writes every REG_QWORD as a decimal string
+const cases: {
+	name: string;
+	type: RegistryValueType;
+	raw: Buffer;
+	expected: unknown;
+	exported?: unknown;
+}[] = [
+	{ name: 'sz', type: 'REG_SZ', raw: utf16('hello\0'), expected: 'hello' },
+	{ name: 'sz unterminated', type: 'REG_SZ', raw: utf16('hello'), expected: 'hello' },
+	{ name: 'sz embedded null', type: 'REG_SZ', raw: utf16('ab\0cd\0'), expected: 'ab' },
+	{ name: 'sz odd length', type: 'REG_SZ', raw: Buffer.concat([utf16('hi'), Buffer.from([0x41])]), expected: 'hi' },
+	{ name: 'sz empty', type: 'REG_SZ', raw: Buffer.alloc(0), expected: '' },
+	{ name: 'expand unterminated', type: 'REG_EXPAND_SZ', raw: utf16('%TEMP%'), expected: '%TEMP%' },
+	{ name: 'link unterminated', type: 'REG_LINK', raw: utf16('\\Registry'), expected: '\\Registry' },
+	{ name: 'multi', type: 'REG_MULTI_SZ', raw: utf16('a\0bc\0\0'), expected: ['a', 'bc'] },
+	{ name: 'multi missing list terminator', type: 'REG_MULTI_SZ', raw: utf16('a\0bc\0'), expected: ['a', 'bc'] },
+	{ name: 'multi unterminated', type: 'REG_MULTI_SZ', raw: utf16('a\0bc'), expected: ['a', 'bc'] },
+	{ name: 'multi stops at empty string', type: 'REG_MULTI_SZ', raw: utf16('a\0\0b\0\0'), expected: ['a'] },
+	{ name: 'multi odd length', type: 'REG_MULTI_SZ', raw: Buffer.concat([utf16('a\0'), Buffer.from([0x41])]), expected: ['a'] },
+	{ name: 'multi empty', type: 'REG_MULTI_SZ', raw: Buffer.alloc(0), expected: [] },
+	{ name: 'dword', type: 'REG_DWORD', raw: Buffer.from([0x78, 0x56, 0x34, 0x12]), expected: 0x12345678 },
+	{ name: 'dword extra bytes', type: 'REG_DWORD', raw: Buffer.from([1, 0, 0, 0, 9]), expected: 1 },
+	{ name: 'dword short', type: 'REG_DWORD', raw: Buffer.from([1, 2]), expected: Buffer.from([1, 2]) },
+	{ name: 'big endian', type: 'REG_DWORD_BIG_ENDIAN', raw: Buffer.from([0x12, 0x34, 0x56, 0x78]), expected: 0x12345678 },
+	{ name: 'big endian high bit', type: 'REG_DWORD_BIG_ENDIAN', raw: Buffer.from([0xde, 0xad, 0xbe, 0xef]), expected: 0xdeadbeef },
+	{ name: 'big endian short', type: 'REG_DWORD_BIG_ENDIAN', raw: Buffer.from([1, 2, 3]), expected: Buffer.from([1, 2, 3]) },
+	{ name: 'qword', type: 'REG_QWORD', raw: Buffer.from([1, 2, 3, 4, 5, 6, 0, 0]), expected: 0x060504030201, exported: String(0x060504030201) },
+	{ name: 'qword large', type: 'REG_QWORD', raw: Buffer.from([0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe]), expected: Number(0xfedcba9876543210n), exported: '18364758544493064720' },
+	{ name: 'qword short', type: 'REG_QWORD', raw: Buffer.from([1, 2, 3, 4]), expected: Buffer.from([1, 2, 3, 4]) },
+	{ name: 'none with data', type: 'REG_NONE', raw: Buffer.from([1]), expected: null },
+	{ name: 'binary', type: 'REG_BINARY', raw: Buffer.from([0, 1, 2]), expected: Buffer.from([0, 1, 2]) },
+	{ name: 'resource list', type: 'REG_RESOURCE_LIST', raw: Buffer.from([3]), expected: Buffer.from([3]) },
+	{ name: 'full resource descriptor', type: 'REG_FULL_RESOURCE_DESCRIPTOR', raw: Buffer.from([4]), expected: Buffer.from([4]) },
+	{ name: 'resource requirements list', type: 'REG_RESOURCE_REQUIREMENTS_LIST', raw: Buffer.from([5]), expected: Buffer.from([5]) }
+];
+
+describe('value codec', () => {
+	const key = testKey();
+
+	beforeAll(() => {
+		winreglib.batch(
+			cases.map(({ name, type, raw }) => ({ op: 'set' as const, key, name, value: raw, type }))
+		);
+	});
+
+	for (const { name, type, expected, exported: json = toJson(expected) } of cases) {
+		it(`should decode ${name} (${type}) the same way everywhere`, async () => {
+			expect(winreglib.get(key, name)).toEqual(expected);
+
+			const { root } = await winreglib.scan(key);
+			const scanned = root.values.find(value => value.name === name);
+			expect(scanned).toEqual({ name, type, data: expected });
+
+			const exported = (await exportValues(key)).find(value => value.name === name);
+			expect(exported?.data).toEqual(json);
+		});
+	}
+
+	it('should encode every value type', () => {
+		const key = testKey();
+		winreglib.batch([
+			{ op: 'set', key, name: 'sz', value: 'héllo', type: 'REG_SZ' },
+			{ op: 'set', key, name: 'expand', value: '%TEMP%', type: 'REG_EXPAND_SZ' },
+			{ op: 'set', key, name: 'link', value: '\\Registry', type: 'REG_LINK' },
+			{ op: 'set', key, name: 'multi', value: ['a', 'b'], type: 'REG_MULTI_SZ' },
+			{ op: 'set', key, name: 'dword', value: 0xdeadbeef, type: 'REG_DWORD' },
+			{ op: 'set', key, name: 'be', value: 0x12345678, type: 'REG_DWORD_BIG_ENDIAN' },
+			{ op: 'set', key, name: 'qword', value: 0xfedcba9876543210n, type: 'REG_QWORD' },
+			{ op: 'set', key, name: 'none', value: null, type: 'REG_NONE' },
+			{ op: 'set', key, name: 'binary', value: null, type: 'REG_BINARY' }
+		]);
+
+		expect(winreglib.get(key, 'sz')).toBe('héllo');
+		expect(winreglib.get(key, 'expand')).toBe('%TEMP%');
+		expect(winreglib.get(key, 'link')).toBe('\\Registry');
+		expect(winreglib.get(key, 'multi')).toEqual(['a', 'b']);
+		expect(winreglib.get(key, 'dword')).toBe(0xdeadbeef);
+		expect(winreglib.get(key, 'be')).toBe(0x12345678);
+		expect(winreglib.get(key, 'qword', { bigint: true })).toBe(0xfedcba9876543210n);
+		expect(winreglib.get(key, 'none')).toBe(null);
+		expect(winreglib.get(key, 'binary')).toEqual(Buffer.alloc(0));
+	});
+
+	it('should store big endian values in network byte order', async () => {
+		const key = testKey();
+		winreglib.set(key, 'be', 0x12345678, 'REG_DWORD_BIG_ENDIAN');
+
+		const chunks: Buffer[] = [];
+		await winreglib.exportTree(
+			key,
+			new Writable({
+				write(chunk, _encoding, callback) {
+					chunks.push(chunk);
+					callback();
+				}
+			}),
+			{ format: 'binary' }
+		);
+		const data = Buffer.concat(chunks);
+		expect(data.includes(Buffer.from([0x12, 0x34, 0x56, 0x78]))).toBe(true);
+	});
+
+	it('should write a buffer as is for any type', () => {
+		const key = testKey();
+		winreglib.set(key, 'sz', utf16('raw'), 'REG_SZ');
+		expect(winreglib.get(key, 'sz')).toBe('raw');
+	});
+
+	it('should error if a number does not fit a DWORD', () => {
+		const key = testKey();
+		const err = new RangeError('Expected value to be an integer between 0 and 4294967295');
+		for (const value of [-1, 1.5, 2 ** 32, NaN]) {
+			expect(() => winreglib.set(key, 'dword', value, 'REG_DWORD')).toThrowError(err);
+			expect(() => winreglib.set(key, 'be', value, 'REG_DWORD_BIG_ENDIAN')).toThrowError(err);
+		}
+		expect(winreglib.tryGet(key, 'dword')).toBeUndefined();
+	});
+
+	it('should error if a number does not fit a QWORD exactly', () => {
+		const key = testKey();
+		const err = new RangeError(
+			'Expected value to be an integer between 0 and Number.MAX_SAFE_INTEGER, use a bigint for larger values'
+		);
+		for (const value of [-1, 1.5, 2 ** 53, Infinity]) {
+			expect(() => winreglib.set(key, 'qword', value, 'REG_QWORD')).toThrowError(err);
+		}
+		// an inferred type is a QWORD when the number doesn't fit in 32 bits
+		expect(() => winreglib.set(key, 'qword', -1)).toThrowError(err);
+		expect(() => winreglib.set(key, 'qword', -1n)).toThrowError(
+			new RangeError('Expected value to be a bigint between 0 and 18446744073709551615')
+		);
+		expect(() => winreglib.set(key, 'qword', 2n ** 64n)).toThrowError(
+			new RangeError('Expected value to be a bigint between 0 and 18446744073709551615')
+		);
+
+		winreglib.set(key, 'qword', Number.MAX_SAFE_INTEGER, 'REG_QWORD');
+		expect(winreglib.get(key, 'qword')).toBe(Number.MAX_SAFE_INTEGER);
+	});
+
+	it('should error if a REG_MULTI_SZ string is empty', () => {
+		const key = testKey();
+		expect(() => winreglib.set(key, 'multi', ['a', '', 'b'])).toThrowError(
+			new RangeError('Expected REG_MULTI_SZ strings to be non-empty')
+		);
+		expect(winreglib.tryGet(key, 'multi')).toBeUndefined();
+	});
+});
@@ -0,0 +1,109 @@
+import { describe, expect, it } from 'vitest';
+import winreglib, { NameColumn } from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+describe('list() with columnar', () => {
+	it('should pack names into columns', () => {
+		const key = testKey();
+		winreglib.set(`${key}\\Child`, 'x', 1);
+		winreglib.set(`${key}\\Ünïcödé \u{1F600}`, 'x', 1);
+		winreglib.set(key, 'str', 'hello');
+		winreglib.set(key, 'num', 42);
+		winreglib.set(key, 'bin', Buffer.from([1, 2, 3]));
+		try {
+			const result = winreglib.list(key, { columnar: true });
+			const plain = winreglib.list(key);
+			expect(result?.resolvedRoot).toBe('HKEY_CURRENT_USER');
+			expect(result?.key).toBe(plain?.key);
+			expect(result?.subkeys).toBeInstanceOf(NameColumn);
+			expect(result?.subkeys.toArray()).toEqual(plain?.subkeys);
+			expect(result?.values.toArray()).toEqual(plain?.values);
+			expect(result?.values.length).toBe(3);
+			expect(result?.subkeys.at(-1)).toBe(plain?.subkeys[1]);
+			expect(result?.subkeys.at(2)).toBeUndefined();
+			expect(result?.values.indexOf('NUM')).toBe(plain?.values.indexOf('num'));
+			expect(result?.values.indexOf('missing')).toBe(-1);
+			expect(
+				Object.fromEntries(
+					Array.from(result!.types, (type, i) => [result!.values.at(i), type])
+				)
+			).toEqual({ str: 1, num: 4, bin: 3 });
+
+			// every column shares one buffer
+			expect(result?.subkeys.units.buffer).toBe(result?.types.buffer);
+			expect(result?.values.offsets.buffer).toBe(result?.types.buffer);
+		} finally {
+			winreglib.delete(key);
+		}
+	});
+
+	it('should return empty columns for an empty key', () => {
+		const key = testKey();
+		winreglib.createKey(key);
+		try {
+			const result = winreglib.list(key, { columnar: true });
+			expect(result?.subkeys.length).toBe(0);
+			expect(result?.values.length).toBe(0);
+			expect([...result!.subkeys]).toEqual([]);
+			expect(result?.types.length).toBe(0);
+		} finally {
+			winreglib.delete(key);
+		}
+	});
+});
+
+describe('query() with columnar', () => {
+	it('should return the same rows as objects', async () => {
+		const key = testKey();
+		winreglib.set(`${key}\\A`, 'str', 'a'.repeat(9000));
+		winreglib.set(`${key}\\A`, 'multi', ['x', 'yy', 'zzz']);
+		winreglib.set(`${key}\\A`, 'empty', []);
+		winreglib.set(`${key}\\B`, 'dword', 7);
+		winreglib.set(`${key}\\B`, 'small', 5n, 'REG_QWORD');
+		winreglib.set(`${key}\\B`, 'big', 2n ** 60n + 1n, 'REG_QWORD');
+		winreglib.set(`${key}\\B\\C`, 'odd', Buffer.from([9]));
+		winreglib.set(`${key}\\B\\C`, 'str', 'after odd');
+		winreglib.set(`${key}\\B\\C`, 'none', null, 'REG_NONE');
+		winreglib.createKey(`${key}\\D`);
+		try {
+			const pattern = `${key}\\**`;
+			const values = ['*'];
+			const plain = await winreglib.query(pattern, { values });
+			const result = await winreglib.query(pattern, { values, columnar: true });
+
+			expect(result.keys).toBe(plain.keys);
+			expect(result.skipped).toBe(plain.skipped);
+			expect(result.rows.length).toBe(plain.rows.length);
+			expect([...result.rows]).toEqual(plain.rows);
+			expect(result.rows.keys.toArray()).toEqual(plain.rows.map(row => row.key));
+
+			const b = result.rows.keys.indexOf(
+				`${key}\\B`.replace('HKCU', 'HKEY_CURRENT_USER')
+			);
+			const { start, end } = result.rows.rowValues(b);
+			expect(end - start).toBe(3);
+			for (let i = start; i < end; i++) {
+				const name = result.rows.valueNames.at(i);
+				if (name === 'dword') {
+					expect(result.rows.numbers[i]).toBe(7);
+					expect(result.rows.valueTypes[i]).toBe(4);
+				} else if (name === 'small') {
+					expect(result.rows.numbers[i]).toBe(5);
+				} else {
+					expect(Number.isNaN(result.rows.numbers[i])).toBe(true);
+					expect(result.rows.value(i)).toBe(Number(2n ** 60n + 1n));
+				}
+			}
+		} finally {
+			winreglib.delete(key);
+		}
+	});
+
+	it('should return no rows when nothing matches', async () => {
+		const result = await winreglib.query(`${testKey()}\\*`, { columnar: true });
+		expect(result.rows.length).toBe(0);
+		expect([...result.rows]).toEqual([]);
+	});
+});
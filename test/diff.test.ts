@@ -0,0 +1,172 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+const populate = (key: string) => {
+	winreglib.batch([
+		{ op: 'set', key, name: 'sz', value: 'foo' },
+		{ op: 'set', key, name: 'dword', value: 42 },
+		{ op: 'set', key, name: 'binary', value: Buffer.from([1, 2, 3]) },
+		{ op: 'set', key: `${key}\\a\\b`, name: 'x', value: 'y' },
+		{ op: 'set', key: `${key}\\a\\c`, name: 'x', value: 'z' },
+		{ op: 'createKey', key: `${key}\\d` }
+	]);
+};
+
+// the Merkle hash of the whole tree follows the 8 byte header
+const rootHash = (snapshot: Buffer) => snapshot.subarray(8, 24);
+
+describe('fingerprint()', () => {
+	it('should error if key is not specified', async () => {
+		await expect(winreglib.fingerprint(undefined as any)).rejects.toThrowError(
+			new TypeError('Expected key to be a non-empty string')
+		);
+	});
+
+	it('should error if key is not found', async () => {
+		const err: Error & { code?: string } = new Error(
+			'Registry key or value not found'
+		);
+		err.code = 'ERR_WINREG_NOT_FOUND';
+		await expect(winreglib.fingerprint(testKey())).rejects.toThrowError(err);
+	});
+
+	it('should produce the same hash for identical trees', async () => {
+		const a = testKey();
+		const b = testKey();
+		populate(a);
+		populate(b);
+
+		const snapshotA = await winreglib.fingerprint(a);
+		const snapshotB = await winreglib.fingerprint(b);
+		expect(Buffer.isBuffer(snapshotA)).toBe(true);
+		expect(rootHash(snapshotA)).toEqual(rootHash(snapshotB));
+
+		winreglib.set(`${b}\\a\\c`, 'x', 'changed');
+		expect(rootHash(await winreglib.fingerprint(b))).not.toEqual(rootHash(snapshotA));
+	});
+
+	it('should not depend on the order keys and values were created in', async () => {
+		const a = testKey();
+		const b = testKey();
+		winreglib.batch([
+			{ op: 'set', key: a, name: 'one', value: 1 },
+			{ op: 'set', key: a, name: 'two', value: 2 },
+			{ op: 'createKey', key: `${a}\\x` },
+			{ op: 'createKey', key: `${a}\\y` }
+		]);
+		winreglib.batch([
+			{ op: 'createKey', key: `${b}\\y` },
+			{ op: 'createKey', key: `${b}\\x` },
+			{ op: 'set', key: b, name: 'two', value: 2 },
+			{ op: 'set', key: b, name: 'one', value: 1 }
+		]);
+
+		expect(rootHash(await winreglib.fingerprint(a))).toEqual(
+			rootHash(await winreglib.fingerprint(b))
+		);
+	});
+});
+
+describe('diff()', () => {
+	it('should return nothing for identical trees', async () => {
+		const a = testKey();
+		const b = testKey();
+		populate(a);
+		populate(b);
+
+		expect(await winreglib.diff(a, b)).toEqual([]);
+	});
+
+	it('should report added, removed, and modified values', async () => {
+		const a = testKey();
+		const b = testKey();
+		populate(a);
+		populate(b);
+		winreglib.batch([
+			{ op: 'set', key: b, name: 'sz', value: 'bar' },
+			{ op: 'set', key: b, name: 'dword', value: 42, type: 'REG_QWORD' },
+			{ op: 'delete', key: b, name: 'binary' },
+			{ op: 'set', key: `${b}\\a\\b`, name: 'new', value: 1 }
+		]);
+
+		expect(await winreglib.diff(a, b)).toEqual([
+			{ type: 'removed', key: '', value: 'binary' },
+			{ type: 'modified', key: '', value: 'dword' },
+			{ type: 'modified', key: '', value: 'sz' },
+			{ type: 'added', key: 'a\\b', value: 'new' }
+		]);
+	});
+
+	it('should report added and removed keys once', async () => {
+		const a = testKey();
+		const b = testKey();
+		populate(a);
+		populate(b);
+		winreglib.batch([
+			{ op: 'delete', key: `${b}\\a` },
+			{ op: 'set', key: `${b}\\d\\e\\f`, name: 'x', value: 'y' },
+			{ op: 'createKey', key: `${b}\\g` }
+		]);
+
+		expect(await winreglib.diff(a, b)).toEqual([
+			{ type: 'removed', key: 'a' },
+			{ type: 'added', key: 'd\\e' },
+			{ type: 'added', key: 'g' }
+		]);
+	});
+
+	it('should compare a stored snapshot with a live key', async () => {
+		const key = testKey();
+		populate(key);
+		const snapshot = Buffer.from(await winreglib.fingerprint(key));
+
+		winreglib.set(`${key}\\a\\c`, 'x', 'changed');
+		expect(await winreglib.diff(snapshot, key)).toEqual([
+			{ type: 'modified', key: 'a\\c', value: 'x' }
+		]);
+		expect(await winreglib.diff(key, snapshot)).toEqual([
+			{ type: 'modified', key: 'a\\c', value: 'x' }
+		]);
+	});
+
+	it('should find a single change in a large tree', async () => {
+		const key = testKey();
+		const ops: Parameters<typeof winreglib.batch>[0] = [];
+		for (let i = 0; i < 100; i++) {
+			for (let j = 0; j < 100; j++) {
+				ops.push({ op: 'set', key: `${key}\\${i}\\${j}`, name: 'value', value: i * j });
+			}
+		}
+		winreglib.batch(ops);
+
+		const before = await winreglib.fingerprint(key);
+		winreglib.set(`${key}\\42\\17`, 'value', 0);
+		const after = await winreglib.fingerprint(key);
+
+		expect(await winreglib.diff(before, after)).toEqual([
+			{ type: 'modified', key: '42\\17', value: 'value' }
+		]);
+	});
+
+	it('should error if a snapshot is invalid', async () => {
+		const key = testKey();
+		populate(key);
+		const snapshot = await winreglib.fingerprint(key);
+
+		const err: Error & { code?: string } = new Error('Invalid snapshot');
+		err.code = 'ERR_WINREG_INVALID_SNAPSHOT';
+		await expect(
+			winreglib.diff(Buffer.from('not a snapshot'), snapshot)
+		).rejects.toThrowError(err);
+		await expect(
+			winreglib.diff(snapshot, snapshot.subarray(0, snapshot.length - 1))
+		).rejects.toThrowError(err);
+
+		await expect(winreglib.diff(snapshot, {} as any)).rejects.toThrowError(
+			new TypeError('Expected snapshot to be a buffer')
+		);
+	});
+});
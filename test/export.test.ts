@@ -0,0 +1,276 @@
+import { afterAll, beforeAll, describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+import { randomBytes } from 'node:crypto';
+import { closeSync, mkdtempSync, openSync, readFileSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { PassThrough, Writable } from 'node:stream';
+
+useMemoryBackend();
+
+let tmp: string;
+beforeAll(() => {
+	tmp = mkdtempSync(join(tmpdir(), 'winreglib-'));
+});
+afterAll(() => {
+	rmSync(tmp, { recursive: true, force: true });
+});
+
+const resolved = (key: string) => `HKEY_CURRENT_USER${key.substring(4)}`;
+
+const populate = (key: string) => {
+	winreglib.batch([
+		{ op: 'set', key, name: 'sz', value: 'héllo "world"\n😀' },
+		{ op: 'set', key, name: 'multi', value: ['a', 'bc'] },
+		{ op: 'set', key, name: 'dword', value: 42 },
+		{ op: 'set', key, name: 'be', value: 0x01020304, type: 'REG_DWORD_BIG_ENDIAN' },
+		{ op: 'set', key, name: 'small', value: 1234567890123n },
+		{ op: 'set', key, name: 'large', value: 0xfedcba9876543210n },
+		{ op: 'set', key, name: 'binary', value: Buffer.from([1, 2, 3, 4, 5]) },
+		{ op: 'set', key, name: 'none', value: null },
+		{ op: 'set', key: `${key}\\a\\b`, name: 'x', value: 'y' },
+		{ op: 'createKey', key: `${key}\\c` }
+	]);
+};
+
+const exportToFile = async (
+	key: string,
+	opts?: Parameters<typeof winreglib.exportTree>[2]
+) => {
+	const file = join(tmp, randomBytes(4).toString('hex'));
+	const fd = openSync(file, 'w');
+	try {
+		const result = await winreglib.exportTree(key, fd, opts);
+		return { result, data: readFileSync(file) };
+	} finally {
+		closeSync(fd);
+	}
+};
+
+const parseNdjson = (data: Buffer) =>
+	data
+		.toString('utf8')
+		.trim()
+		.split('\n')
+		.map(line => JSON.parse(line));
+
+/**
+ * Decodes the binary export format into the same shape as the NDJSON records.
+ */
+const parseBinary = (data: Buffer) => {
+	let offset = 0;
+	const varint = () => {
+		let result = 0;
+		let shift = 0;
+		let b: number;
+		do {
+			b = data[offset++];
+			result += (b & 0x7f) * 2 ** shift;
+			shift += 7;
+		} while (b & 0x80);
+		return result;
+	};
+	const string = () => {
+		const len = varint();
+		return data.toString('utf8', offset, (offset += len));
+	};
+
+	expect(data.toString('latin1', 0, 5)).toBe('WREG\x01');
+	offset = 5;
+
+	const path: string[] = [];
+	const keys: { key: string; values: { name: string; type: number; data: Buffer }[] }[] = [];
+	while (true) {
+		const tag = data[offset++];
+		if (tag === 0) {
+			break;
+		}
+		if (tag === 1) {
+			const level = varint();
+			path.length = level;
+			path.push(string());
+			keys.push({ key: path.join('\\'), values: [] });
+		} else if (tag === 2) {
+			const name = string();
+			const type = varint();
+			const len = varint();
+			keys[keys.length - 1].values.push({
+				name,
+				type,
+				data: data.subarray(offset, (offset += len))
+			});
+		} else {
+			throw new Error(`Unexpected tag ${tag}`);
+		}
+	}
+	expect(offset).toBe(data.length);
+	return keys;
+};
+
+describe('exportTree()', () => {
+	it('should error if key is not specified', async () => {
+		await expect(winreglib.exportTree(undefined as any, 1)).rejects.toThrowError(
+			new TypeError('Expected key to be a non-empty string')
+		);
+	});
+
+	it('should error if the destination is invalid', async () => {
+		await expect(winreglib.exportTree(testKey(), {} as any)).rejects.toThrowError(
+			new TypeError('Expected a file descriptor or writable stream')
+		);
+	});
+
+	it('should error if the format is invalid', async () => {
+		await expect(
+			winreglib.exportTree(testKey(), 1, { format: 'xml' as any })
+		).rejects.toThrowError(new TypeError('Invalid format "xml"'));
+	});
+
+	it('should error if the depth is invalid', async () => {
+		await expect(
+			winreglib.exportTree(testKey(), 1, { depth: -1 })
+		).rejects.toThrowError(
+			new TypeError('Expected depth to be a non-negative integer')
+		);
+	});
+
+	it('should error if key is not found', async () => {
+		const err: Error & { code?: string } = new Error(
+			'Registry key or value not found'
+		);
+		err.code = 'ERR_WINREG_NOT_FOUND';
+		await expect(exportToFile(testKey())).rejects.toThrowError(err);
+	});
+
+	it('should export NDJSON to a file descriptor', async () => {
+		const key = testKey();
+		populate(key);
+
+		const { result, data } = await exportToFile(key);
+		expect(result).toEqual({ keys: 4, values: 9, bytes: data.length, skipped: 0 });
+		expect(parseNdjson(data)).toEqual([
+			{
+				key: resolved(key),
+				values: [
+					{ name: 'be', type: 'REG_DWORD_BIG_ENDIAN', data: 0x01020304 },
+					{ name: 'binary', type: 'REG_BINARY', data: 'AQIDBAU=' },
+					{ name: 'dword', type: 'REG_DWORD', data: 42 },
+					{ name: 'large', type: 'REG_QWORD', data: '18364758544493064720' },
+					{ name: 'multi', type: 'REG_MULTI_SZ', data: ['a', 'bc'] },
+					{ name: 'none', type: 'REG_NONE', data: null },
+					{ name: 'small', type: 'REG_QWORD', data: '1234567890123' },
+					{ name: 'sz', type: 'REG_SZ', data: 'héllo "world"\n😀' }
+				]
+			},
+			{ key: `${resolved(key)}\\a`, values: [] },
+			{
+				key: `${resolved(key)}\\a\\b`,
+				values: [{ name: 'x', type: 'REG_SZ', data: 'y' }]
+			},
+			{ key: `${resolved(key)}\\c`, values: [] }
+		]);
+	});
+
+	it('should limit the depth', async () => {
+		const key = testKey();
+		populate(key);
+
+		let { result, data } = await exportToFile(key, { depth: 0 });
+		expect(result.keys).toBe(1);
+		expect(parseNdjson(data).map(r => r.key)).toEqual([resolved(key)]);
+
+		({ result, data } = await exportToFile(key, { depth: 1 }));
+		expect(parseNdjson(data).map(r => r.key)).toEqual([
+			resolved(key),
+			`${resolved(key)}\\a`,
+			`${resolved(key)}\\c`
+		]);
+	});
+
+	it('should export the binary format', async () => {
+		const key = testKey();
+		populate(key);
+
+		const { result, data } = await exportToFile(key, { format: 'binary' });
+		expect(result).toEqual({ keys: 4, values: 9, bytes: data.length, skipped: 0 });
+
+		const keys = parseBinary(data);
+		expect(keys.map(k => k.key)).toEqual([
+			resolved(key),
+			`${resolved(key)}\\a`,
+			`${resolved(key)}\\a\\b`,
+			`${resolved(key)}\\c`
+		]);
+
+		const values = Object.fromEntries(keys[0].values.map(v => [v.name, v]));
+		expect(values.sz.type).toBe(1);
+		expect(values.sz.data.toString('utf16le')).toBe('héllo "world"\n😀\0');
+		expect(values.multi.data.toString('utf16le')).toBe('a\0bc\0\0');
+		expect(values.dword.data.readUInt32LE()).toBe(42);
+		expect(values.large.data.readBigUInt64LE()).toBe(0xfedcba9876543210n);
+		expect(values.binary.data).toEqual(Buffer.from([1, 2, 3, 4, 5]));
+		expect(values.none.data.length).toBe(0);
+	});
+
+	it('should write the same output to a stream', async () => {
+		const key = testKey();
+		populate(key);
+
+		for (const format of ['ndjson', 'binary'] as const) {
+			const stream = new PassThrough();
+			const chunks: Buffer[] = [];
+			stream.on('data', chunk => chunks.push(chunk));
+			const result = await winreglib.exportTree(key, stream, { format });
+			expect(Buffer.concat(chunks)).toEqual((await exportToFile(key, { format })).data);
+			expect(result.bytes).toBe(Buffer.concat(chunks).length);
+		}
+	});
+
+	it('should wait for a slow stream', async () => {
+		const key = testKey();
+		winreglib.batch(
+			Array.from({ length: 2000 }, (_, i) => ({
+				op: 'set' as const,
+				key: `${key}\\key-${i}`,
+				name: 'value',
+				value: 'x'.repeat(100)
+			}))
+		);
+
+		let pending = 0;
+		let maxPending = 0;
+		let bytes = 0;
+		const stream = new Writable({
+			write(chunk, _encoding, callback) {
+				maxPending = Math.max(maxPending, ++pending);
+				bytes += chunk.length;
+				setTimeout(() => {
+					pending--;
+					callback();
+				}, 5);
+			}
+		});
+
+		const result = await winreglib.exportTree(key, stream);
+		expect(result.keys).toBe(2001);
+		expect(result.bytes).toBe(bytes);
+		expect(maxPending).toBeLessThanOrEqual(2);
+	});
+
+	it('should reject with the stream error', async () => {
+		const key = testKey();
+		populate(key);
+
+		const stream = new Writable({
+			write(_chunk, _encoding, callback) {
+				callback(new Error('Disk full'));
+			}
+		});
+		stream.on('error', () => {});
+
+		await expect(winreglib.exportTree(key, stream)).rejects.toThrowError(
+			new Error('Disk full')
+		);
+	});
+});
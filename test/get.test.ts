@@ -122,6 +122,16 @@ describe('get()', () => {
 		expect(value).toBeGreaterThan(0);
 	});
 
+	it('should get an 64-bit integer value as a bigint', async () => {
+		const value = winreglib.get(
+			'HKLM\\Software\\Microsoft\\Windows\\CurrentVersion\\AppModel\\StateRepositoryStatus',
+			'MaintenanceLastPerformed',
+			{ bigint: true }
+		) as bigint;
+		expect(value).toBeTypeOf('bigint');
+		expect(value).toBeGreaterThan(0n);
+	});
+
 	it('should get a binary value', () => {
 		const value = winreglib.get(
 			'HKLM\\HARDWARE\\DESCRIPTION\\System',
@@ -0,0 +1,54 @@
+import { afterAll, beforeAll } from 'vitest';
+import winreglib from '../../src/index.js';
+import { randomBytes } from 'node:crypto';
+import type { EventEmitter } from 'node:events';
+
+/**
+ * Runs the tests of the calling file against the in-memory backend so they work on every
+ * platform, then restores the platform's backend.
+ */
+export const useMemoryBackend = () => {
+	beforeAll(() => winreglib.setBackend('memory'));
+	afterAll(() =>
+		winreglib.setBackend(process.platform === 'win32' ? 'win32' : 'memory')
+	);
+};
+
+/**
+ * Returns a unique key name so that tests don't see each other's keys.
+ */
+export const testName = () => `test-${randomBytes(4).toString('hex')}`;
+
+/**
+ * Returns a unique key under `Software\winreglib`. Watch tests pass `HKEY_CURRENT_USER` since
+ * events spell out the root.
+ */
+export const testKey = (root = 'HKCU') => `${root}\\Software\\winreglib\\${testName()}`;
+
+/**
+ * Gives the monitor thread and pending callbacks time to catch up, for example to free the nodes
+ * that stopped being watched.
+ */
+export const settle = (ms = 50) => new Promise(resolve => setTimeout(resolve, ms));
+
+/**
+ * Collects a watch handle's `change` events as `"<type> <key>"` strings until there are `count`
+ * of them, or rejects after 5 seconds with the events it got.
+ */
+export const nextEvents = (handle: EventEmitter, count: number) =>
+	new Promise<string[]>((resolve, reject) => {
+		const events: string[] = [];
+		const timer = setTimeout(() => {
+			handle.off('change', listener);
+			reject(new Error(`Timed out waiting for events, got ${events.join(', ')}`));
+		}, 5000);
+		const listener = (evt: { type: string; key: string }) => {
+			events.push(`${evt.type} ${evt.key}`);
+			if (events.length === count) {
+				clearTimeout(timer);
+				handle.off('change', listener);
+				resolve(events);
+			}
+		};
+		handle.on('change', listener);
+	});
@@ -0,0 +1,180 @@
+import { describe, expect, it } from 'vitest';
+import winreglib, { type RegistryKeyPage } from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+const populate = (key: string, numSubkeys: number, numValues: number) => {
+	winreglib.batch([
+		{ op: 'createKey', key },
+		...Array.from({ length: numSubkeys }, (_, i) => ({
+			op: 'createKey' as const,
+			key: `${key}\\key-${String(i).padStart(4, '0')}`
+		})),
+		...Array.from({ length: numValues }, (_, i) => ({
+			op: 'set' as const,
+			key,
+			name: `value-${String(i).padStart(4, '0')}`,
+			value: i
+		}))
+	]);
+};
+
+const collect = async (iterator: AsyncIterable<RegistryKeyPage>) => {
+	const pages: RegistryKeyPage[] = [];
+	for await (const page of iterator) {
+		pages.push(page);
+	}
+	return pages;
+};
+
+describe('iterateKey()', () => {
+	it('should error if key is not specified', async () => {
+		await expect(
+			collect(winreglib.iterateKey(undefined as any))
+		).rejects.toThrowError(
+			new TypeError('Expected key to be a non-empty string')
+		);
+	});
+
+	it('should error if page size is invalid', async () => {
+		await expect(
+			collect(winreglib.iterateKey(testKey(), { pageSize: 0 }))
+		).rejects.toThrowError(
+			new TypeError('Expected page size to be a positive integer')
+		);
+	});
+
+	it('should error if key is not found', async () => {
+		const err: Error & { code?: string } = new Error(
+			'Registry key or value not found'
+		);
+		err.code = 'ERR_WINREG_NOT_FOUND';
+		await expect(collect(winreglib.iterateKey(testKey()))).rejects.toThrowError(
+			err
+		);
+	});
+
+	it('should return subkeys then values in pages', async () => {
+		const key = testKey();
+		populate(key, 5, 4);
+
+		const pages = await collect(winreglib.iterateKey(key, { pageSize: 3 }));
+		expect(pages).toEqual([
+			{ subkeys: ['key-0000', 'key-0001', 'key-0002'], values: [] },
+			{ subkeys: ['key-0003', 'key-0004'], values: ['value-0000'] },
+			{ subkeys: [], values: ['value-0001', 'value-0002', 'value-0003'] }
+		]);
+	});
+
+	it('should not yield anything for an empty key', async () => {
+		const key = testKey();
+		winreglib.createKey(key);
+		expect(await collect(winreglib.iterateKey(key))).toEqual([]);
+	});
+
+	it('should return the same names as list()', async () => {
+		const key = testKey();
+		populate(key, 250, 250);
+
+		const subkeys: string[] = [];
+		const values: string[] = [];
+		for await (const page of winreglib.iterateKey(key, { pageSize: 64 })) {
+			subkeys.push(...page.subkeys);
+			values.push(...page.values);
+		}
+
+		const result = winreglib.list(key);
+		expect(subkeys).toEqual(result?.subkeys);
+		expect(values).toEqual(result?.values);
+	});
+
+	it('should return every original name exactly once when modified', async () => {
+		const key = testKey();
+		populate(key, 20, 20);
+
+		const subkeys: string[] = [];
+		const values: string[] = [];
+		let i = 0;
+		for await (const page of winreglib.iterateKey(key, { pageSize: 5 })) {
+			subkeys.push(...page.subkeys);
+			values.push(...page.values);
+
+			// remove entries that were already returned, which shifts the indices of the
+			// remaining entries, and add new ones before and after the cursor
+			if (i++ < 6) {
+				if (page.subkeys.length) {
+					winreglib.delete(`${key}\\${page.subkeys[0]}`);
+				}
+				if (page.values.length) {
+					winreglib.delete(key, page.values[0]);
+				}
+				winreglib.createKey(`${key}\\key-000${i}a`);
+				winreglib.set(key, `value-added-${i}`, i);
+			}
+		}
+
+		for (let n = 0; n < 20; n++) {
+			const suffix = String(n).padStart(4, '0');
+			expect(subkeys.filter(s => s === `key-${suffix}`)).toHaveLength(1);
+			expect(values.filter(s => s === `value-${suffix}`)).toHaveLength(1);
+		}
+		expect(new Set(subkeys).size).toBe(subkeys.length);
+		expect(new Set(values).size).toBe(values.length);
+	});
+
+	it('should finish when the key changes between every page', async () => {
+		const key = testKey();
+		populate(key, 50, 50);
+
+		const subkeys: string[] = [];
+		const values: string[] = [];
+		let pages = 0;
+		for await (const page of winreglib.iterateKey(key, { pageSize: 5 })) {
+			subkeys.push(...page.subkeys);
+			values.push(...page.values);
+			expect(++pages).toBeLessThan(30);
+
+			// rewrite a value ahead of the cursor and remove an entry behind it
+			winreglib.set(key, 'touched', pages);
+			if (page.subkeys.length) {
+				winreglib.delete(`${key}\\${page.subkeys[0]}`);
+			}
+		}
+
+		for (let n = 0; n < 50; n++) {
+			const suffix = String(n).padStart(4, '0');
+			expect(subkeys.filter(s => s === `key-${suffix}`)).toHaveLength(1);
+			expect(values.filter(s => s === `value-${suffix}`)).toHaveLength(1);
+		}
+		expect(pages).toBe(21);
+	});
+
+	it('should error if the key is deleted while iterating', async () => {
+		const key = testKey();
+		populate(key, 10, 0);
+
+		let err: (Error & { code?: string }) | undefined;
+		try {
+			for await (const _page of winreglib.iterateKey(key, { pageSize: 2 })) {
+				winreglib.delete(key);
+			}
+		} catch (e) {
+			err = e as Error & { code?: string };
+		}
+		expect(err).toBeInstanceOf(Error);
+		expect(err?.code).toBe('ERR_WINREG_ENUM_KEY');
+	});
+
+	it('should stop reading when the consumer stops', async () => {
+		const key = testKey();
+		populate(key, 10, 0);
+
+		const pages: RegistryKeyPage[] = [];
+		for await (const page of winreglib.iterateKey(key, { pageSize: 2 })) {
+			pages.push(page);
+			break;
+		}
+		expect(pages).toEqual([{ subkeys: ['key-0000', 'key-0001'], values: [] }]);
+	});
+});
@@ -0,0 +1,160 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { settle, testKey, useMemoryBackend } from './helpers/memory-backend.js';
+import { appendFileSync, mkdtempSync, readdirSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+
+useMemoryBackend();
+
+const tempDir = () => mkdtempSync(join(tmpdir(), 'winreglib-journal-'));
+
+describe('openJournal()', () => {
+	it('should error if options are invalid', () => {
+		expect(() => winreglib.openJournal('')).toThrowError(
+			new TypeError('Expected dir to be a non-empty string')
+		);
+		expect(() =>
+			winreglib.openJournal(join(tmpdir(), 'unused'), {
+				fsync: 'sometimes' as any
+			})
+		).toThrowError(new TypeError('Invalid fsync policy "sometimes"'));
+	});
+
+	it('should only open one journal at a time', () => {
+		const dir = tempDir();
+		const journal = winreglib.openJournal(dir);
+		try {
+			expect(() => winreglib.openJournal(dir)).toThrowError(
+				'A journal is already open'
+			);
+		} finally {
+			journal.close();
+			rmSync(dir, { recursive: true });
+		}
+		expect(() => journal.lastSeq).toThrowError('Journal has been closed');
+	});
+
+	it('should record watch events with value diffs', async () => {
+		const dir = tempDir();
+		const key = testKey();
+		winreglib.set(key, 'keep', 'same');
+		winreglib.set(key, 'old', 'gone soon');
+
+		const journal = winreglib.openJournal(dir, { values: true });
+		const handle = winreglib.watch(key);
+		const events: any[] = [];
+		handle.on('change', evt => events.push(evt));
+
+		try {
+			await settle(250);
+			winreglib.batch([
+				{ op: 'set', key, name: 'added', value: 1 },
+				{ op: 'delete', key, name: 'old' }
+			]);
+			await settle(250);
+			winreglib.delete(key);
+			await settle(250);
+
+			expect(events.map(evt => evt.type)).toEqual(['change', 'delete']);
+			expect(events[0].seq).toBe(1);
+			expect(events[1].seq).toBe(2);
+
+			const entries = journal.readSince(0);
+			expect(entries).toHaveLength(2);
+			expect(entries[0].seq).toBe(1);
+			expect(entries[0].type).toBe('change');
+			expect(entries[0].key).toBe(events[0].key);
+			expect(entries[0].time).toBeInstanceOf(Date);
+			expect(entries[0].values).toEqual([
+				{ name: 'added', change: 'add', type: 'REG_DWORD', data: 1 },
+				{ name: 'old', change: 'delete', type: 'REG_SZ' }
+			]);
+			expect(entries[1].type).toBe('delete');
+			expect(entries[1].values).toEqual([
+				{ name: 'added', change: 'delete', type: 'REG_DWORD' },
+				{ name: 'keep', change: 'delete', type: 'REG_SZ' }
+			]);
+
+			expect(journal.readSince(1).map(entry => entry.seq)).toEqual([2]);
+			expect(journal.readSince(0, 1).map(entry => entry.seq)).toEqual([1]);
+		} finally {
+			handle.stop();
+			journal.close();
+			rmSync(dir, { recursive: true });
+		}
+	});
+
+	it('should resume after reopening and drop unfinished writes', async () => {
+		const dir = tempDir();
+		const key = testKey();
+		winreglib.createKey(key);
+
+		let journal = winreglib.openJournal(dir, { fsync: 'always' });
+		const handle = winreglib.watch(key);
+		try {
+			await settle(250);
+			winreglib.set(key, 'a', 'a');
+			await settle(250);
+			winreglib.set(key, 'b', 'b');
+			await settle(250);
+			expect(journal.lastSeq).toBe(2);
+			journal.close();
+
+			// a record that was cut short when the process died
+			const [segment] = readdirSync(dir);
+			appendFileSync(join(dir, segment), Buffer.from([40, 0, 0, 0, 1, 2, 3]));
+
+			journal = winreglib.openJournal(dir, { fsync: 'never' });
+			expect(journal.lastSeq).toBe(2);
+			expect(journal.readSince(0).map(entry => entry.seq)).toEqual([1, 2]);
+
+			winreglib.set(key, 'c', 'c');
+			await settle(250);
+			const entries = journal.readSince(2);
+			expect(entries.map(entry => entry.seq)).toEqual([3]);
+			expect(entries[0].values).toBeUndefined();
+		} finally {
+			handle.stop();
+			journal.close();
+			winreglib.delete(key);
+			rmSync(dir, { recursive: true });
+		}
+	});
+
+	it('should compact old segments', async () => {
+		const dir = tempDir();
+		const key = testKey();
+		winreglib.createKey(key);
+
+		// every batch of events fills a segment
+		const journal = winreglib.openJournal(dir, { segmentSize: 1 });
+		const handle = winreglib.watch(key);
+		try {
+			await settle(250);
+			for (let i = 0; i < 4; i++) {
+				winreglib.set(key, 'count', i);
+				await settle(250);
+			}
+			expect(readdirSync(dir)).toHaveLength(4);
+			expect(journal.firstSeq).toBe(1);
+
+			expect(journal.compact(2)).toBe(2);
+			expect(readdirSync(dir)).toHaveLength(2);
+			expect(journal.firstSeq).toBe(3);
+			expect(journal.readSince(2).map(entry => entry.seq)).toEqual([3, 4]);
+			expect(() => journal.readSince(1)).toThrowError(
+				'Events after sequence 1 have been compacted'
+			);
+
+			// the newest segment is kept
+			expect(journal.compact(4)).toBe(1);
+			expect(journal.readSince(3).map(entry => entry.seq)).toEqual([4]);
+		} finally {
+			handle.stop();
+			journal.close();
+			winreglib.delete(key);
+			rmSync(dir, { recursive: true });
+		}
+	});
+});
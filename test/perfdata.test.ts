@@ -0,0 +1,249 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+type Counter = { index: number; type: number; size: number; scale?: number };
+type Instance = { name: string; uniqueId?: number; values: (number | bigint)[] };
+type ObjectSpec = {
+	index: number;
+	counters: Counter[];
+	instances?: Instance[];
+	values?: (number | bigint)[];
+};
+
+const align = (n: number) => (n + 7) & ~7;
+
+/**
+ * Builds a counter block. Each counter is stored at an offset aligned to its size after the
+ * block's length.
+ */
+const counterBlock = (counters: Counter[], values: (number | bigint)[]) => {
+	const offsets: number[] = [];
+	let length = 8;
+	for (const counter of counters) {
+		offsets.push(length);
+		length = align(length + counter.size);
+	}
+	const block = Buffer.alloc(length);
+	block.writeUInt32LE(length, 0);
+	counters.forEach((counter, i) => {
+		if (counter.size === 4) {
+			block.writeUInt32LE(Number(values[i]), offsets[i]);
+		} else if (counter.size === 8) {
+			block.writeBigUInt64LE(BigInt(values[i]), offsets[i]);
+		}
+	});
+	return { block, offsets };
+};
+
+/**
+ * Builds a `PERF_DATA_BLOCK` the way the registry lays it out.
+ */
+const buildPerfData = (objects: ObjectSpec[]) => {
+	const name = Buffer.from('HOST\0', 'utf16le');
+	const header = Buffer.alloc(88 + align(name.length));
+	header.write('PERF', 0, 'utf16le');
+	header.writeUInt32LE(1, 8);
+	header.writeUInt32LE(88 + align(name.length), 24);
+	header.writeUInt32LE(objects.length, 28);
+	[2024, 3, 5, 14, 12, 34, 56, 789].forEach((n, i) => header.writeUInt16LE(n, 36 + i * 2));
+	header.writeBigUInt64LE(123456789n, 56);
+	header.writeBigUInt64LE(10000000n, 64);
+	header.writeBigUInt64LE(133543700967890000n, 72);
+	header.writeUInt32LE(name.length, 80);
+	header.writeUInt32LE(88, 84);
+	name.copy(header, 88);
+
+	const parts: Buffer[] = [header];
+	for (const obj of objects) {
+		const { offsets } = counterBlock(obj.counters, obj.counters.map(() => 0));
+		const definitions = Buffer.alloc(64 + obj.counters.length * 40);
+		obj.counters.forEach((counter, i) => {
+			const p = 64 + i * 40;
+			definitions.writeUInt32LE(40, p);
+			definitions.writeUInt32LE(counter.index, p + 4);
+			definitions.writeUInt32LE(counter.index + 1, p + 12);
+			definitions.writeInt32LE(counter.scale ?? 0, p + 20);
+			definitions.writeUInt32LE(100, p + 24);
+			definitions.writeUInt32LE(counter.type, p + 28);
+			definitions.writeUInt32LE(counter.size, p + 32);
+			definitions.writeUInt32LE(offsets[i], p + 36);
+		});
+
+		const data: Buffer[] = [];
+		if (obj.instances) {
+			for (const instance of obj.instances) {
+				const instanceName = Buffer.from(`${instance.name}\0`, 'utf16le');
+				const definition = Buffer.alloc(24 + align(instanceName.length));
+				definition.writeUInt32LE(definition.length, 0);
+				definition.writeInt32LE(instance.uniqueId ?? -1, 12);
+				definition.writeUInt32LE(24, 16);
+				definition.writeUInt32LE(instanceName.length, 20);
+				instanceName.copy(definition, 24);
+				data.push(definition, counterBlock(obj.counters, instance.values).block);
+			}
+		} else {
+			data.push(counterBlock(obj.counters, obj.values ?? []).block);
+		}
+
+		const body = Buffer.concat(data);
+		definitions.writeUInt32LE(definitions.length + body.length, 0);
+		definitions.writeUInt32LE(definitions.length, 4);
+		definitions.writeUInt32LE(64, 8);
+		definitions.writeUInt32LE(obj.index, 12);
+		definitions.writeUInt32LE(obj.index + 1, 20);
+		definitions.writeUInt32LE(100, 28);
+		definitions.writeUInt32LE(obj.counters.length, 32);
+		definitions.writeInt32LE(obj.instances ? obj.instances.length : -1, 40);
+		definitions.writeBigUInt64LE(987654321n, 48);
+		definitions.writeBigUInt64LE(10000000n, 56);
+		parts.push(definitions, body);
+	}
+
+	const result = Buffer.concat(parts);
+	result.writeUInt32LE(result.length, 20);
+	return result;
+};
+
+const processor: ObjectSpec = {
+	index: 238,
+	counters: [
+		{ index: 6, type: 0x20410500, size: 8 },
+		{ index: 148, type: 0x10000, size: 4, scale: -1 }
+	],
+	instances: [
+		{ name: '0', uniqueId: -1, values: [1234567890123n, 7] },
+		{ name: '_Total', values: [2345678901234n, 42] }
+	]
+};
+
+const system: ObjectSpec = {
+	index: 2,
+	counters: [
+		{ index: 44, type: 0x10000, size: 4 },
+		{ index: 700, type: 0x1b00, size: 16 }
+	],
+	values: [3, 0]
+};
+
+describe('parsePerfData()', () => {
+	it('should error if data is not a buffer', () => {
+		expect(() => winreglib.parsePerfData('foo' as any)).toThrowError(
+			new TypeError('Expected data to be a buffer')
+		);
+	});
+
+	it('should parse objects, instances, and counters', () => {
+		const sample = winreglib.parsePerfData(buildPerfData([processor, system]));
+		expect(sample.systemName).toBe('HOST');
+		expect(sample.systemTime).toEqual(new Date(Date.UTC(2024, 2, 14, 12, 34, 56, 789)));
+		expect(sample.time).toBe(123456789);
+		expect(sample.frequency).toBe(10000000);
+		expect(sample.objects).toHaveLength(2);
+
+		const [cpu, sys] = sample.objects;
+		expect(cpu.index).toBe(238);
+		expect(cpu.helpIndex).toBe(239);
+		expect(cpu.time).toBe(987654321);
+		expect(Array.from(cpu.counters.index)).toEqual([6, 148]);
+		expect(Array.from(cpu.counters.helpIndex)).toEqual([7, 149]);
+		expect(Array.from(cpu.counters.type)).toEqual([0x20410500, 0x10000]);
+		expect(Array.from(cpu.counters.size)).toEqual([8, 4]);
+		expect(Array.from(cpu.counters.scale)).toEqual([0, -1]);
+		expect(cpu.instances?.name).toEqual(['0', '_Total']);
+		expect(Array.from(cpu.instances!.uniqueId)).toEqual([-1, -1]);
+		expect(Array.from(cpu.values)).toEqual([1234567890123, 7, 2345678901234, 42]);
+
+		// counters other than 4 and 8 bytes aren't numbers
+		expect(sys.instances).toBeNull();
+		expect(Array.from(sys.values)).toEqual([3, NaN]);
+
+		// every column of a sample shares one buffer
+		expect(cpu.values.buffer).toBe(sys.counters.index.buffer);
+	});
+
+	it('should error if the data is truncated or corrupt', () => {
+		const data = buildPerfData([processor, system]);
+		const err: Error & { code?: string } = new Error('Invalid performance data signature');
+		err.code = 'ERR_WINREG_INVALID_PERF_DATA';
+		expect(() => winreglib.parsePerfData(Buffer.from('PERF'))).toThrowError(err);
+
+		for (const length of [100, 200, data.length - 8]) {
+			expect(() => winreglib.parsePerfData(data.subarray(0, length))).toThrowError(
+				/Truncated performance data/
+			);
+		}
+
+		// an instance that claims to be bigger than its object
+		const corrupt = Buffer.from(data);
+		const instance = 104 + 64 + 2 * 40;
+		corrupt.writeUInt32LE(0xffff, instance);
+		expect(() => winreglib.parsePerfData(corrupt)).toThrowError(
+			/Invalid performance instance/
+		);
+	});
+
+	it('should error if counter definitions overrun their object', () => {
+		// the second definition's length wraps the offset back to the first
+		const object = 104;
+		const second = object + 64 + 40;
+		const data = buildPerfData([system]);
+		data.writeUInt32LE(2 ** 32 - 40, second);
+		expect(() => winreglib.parsePerfData(data)).toThrowError(
+			/Invalid performance counter definition/
+		);
+
+		// and the object claims more counters than its definitions can hold
+		data.writeUInt32LE(0xffffffff, object + 32);
+		expect(() => winreglib.parsePerfData(data)).toThrowError(
+			/Invalid performance object/
+		);
+	});
+});
+
+describe('openPerfSampler()', () => {
+	it('should error if query is invalid', () => {
+		expect(() => winreglib.openPerfSampler('')).toThrowError(
+			new TypeError('Expected query to be a non-empty string')
+		);
+	});
+
+	it('should read samples into a growing buffer', () => {
+		// larger than the first read, and the registry doesn't report the size it needs
+		const instances = Array.from({ length: 2_000 }, (_, i) => ({
+			name: `instance-${i}`,
+			values: [BigInt(i) * 1000n, i]
+		}));
+		const data = buildPerfData([{ ...processor, instances }, system]);
+		expect(data.length).toBeGreaterThan(65536);
+		winreglib.set('HKEY_PERFORMANCE_DATA\\', 'Global', data);
+
+		expect(winreglib.get('HKEY_PERFORMANCE_DATA\\', 'Global')).toEqual(data);
+
+		const sampler = winreglib.openPerfSampler();
+		try {
+			for (let i = 0; i < 3; i++) {
+				const [cpu, sys] = sampler.sample().objects;
+				expect(cpu.instances?.name).toHaveLength(2_000);
+				expect(cpu.instances?.name[1999]).toBe('instance-1999');
+				expect(cpu.values[2 * 1999]).toBe(1999000);
+				expect(sys.values[0]).toBe(3);
+			}
+		} finally {
+			sampler.close();
+			winreglib.delete('HKEY_PERFORMANCE_DATA\\', 'Global');
+		}
+
+		const err: Error & { code?: string } = new Error('Performance sampler has been closed');
+		err.code = 'ERR_WINREG_PERF_SAMPLER_CLOSED';
+		expect(() => sampler.sample()).toThrowError(err);
+	});
+
+	it('should error if there is no performance data', () => {
+		const sampler = winreglib.openPerfSampler('Costly');
+		expect(() => sampler.sample()).toThrowError(/not found/);
+		sampler.close();
+	});
+});
@@ -0,0 +1,132 @@
+import { afterEach, describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { nextEvents, testName, useMemoryBackend } from './helpers/memory-backend.js';
+
+// the in-memory backend can't notify the performance data keys, just like the registry, so they
+// are polled. The clock is frozen so that the tests step through the polling schedule.
+useMemoryBackend();
+
+const testKey = () => `HKEY_PERFORMANCE_DATA\\${testName()}`;
+
+let clock = 0;
+
+const startClock = () => winreglib.setMemoryClock((clock = Date.UTC(2024, 0, 1)));
+
+// moves the clock forward and lets the polls that came due run
+const advance = async (ms: number) => {
+	winreglib.setMemoryClock((clock += ms));
+	await new Promise(resolve => setTimeout(resolve, 5));
+};
+
+describe('watch() polling', () => {
+	afterEach(() => winreglib.setMemoryClock());
+
+	it('should poll keys that cannot be notified', async () => {
+		startClock();
+		const key = testKey();
+		winreglib.createKey(key);
+		const handle = winreglib.watch(key);
+		const events: string[] = [];
+		handle.on('change', evt => events.push(evt.type));
+		try {
+			expect(winreglib.watchStats().polled).toBe(1);
+
+			await advance(1000);
+			expect(events).toEqual([]);
+
+			winreglib.set(key, 'value', 1);
+			await advance(1000);
+			expect(events).toEqual(['change']);
+
+			winreglib.delete(key);
+			await advance(1000);
+			expect(events).toEqual(['change', 'delete']);
+			expect(winreglib.watchStats().polled).toBe(0);
+		} finally {
+			handle.stop();
+		}
+	});
+
+	it('should poll on the system clock', async () => {
+		const key = testKey();
+		winreglib.createKey(key);
+		const handle = winreglib.watch(key);
+		try {
+			const changed = nextEvents(handle, 1);
+			winreglib.set(key, 'value', 1);
+			expect(await changed).toEqual([`change ${key}`]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should back off while a key does not change', async () => {
+		startClock();
+		const key = testKey();
+		winreglib.createKey(key);
+		const handle = winreglib.watch(key);
+		const before = winreglib.watchStats().polls;
+		try {
+			// every half second for two minutes would be 240 polls
+			for (let i = 0; i < 120; i++) {
+				await advance(1000);
+			}
+			const polls = winreglib.watchStats().polls - before;
+			expect(polls).toBeGreaterThan(4);
+			expect(polls).toBeLessThan(12);
+
+			// a change is found within the longest interval and resets it
+			let changed = false;
+			handle.once('change', () => (changed = true));
+			winreglib.set(key, 'value', 1);
+			for (let i = 0; i < 30 && !changed; i++) {
+				await advance(1000);
+			}
+			expect(changed).toBe(true);
+			const after = winreglib.watchStats().polls;
+			await advance(500);
+			expect(winreglib.watchStats().polls).toBe(after + 1);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should check a bounded number of keys per tick', async () => {
+		startClock();
+		const keys = Array.from({ length: 200 }, testKey);
+		for (const key of keys) {
+			winreglib.createKey(key);
+		}
+		const handles = keys.map(key => winreglib.watch(key));
+		let changes = 0;
+		for (const handle of handles) {
+			handle.on('change', () => changes++);
+		}
+		try {
+			expect(winreglib.watchStats().polled).toBe(200);
+			for (const key of keys) {
+				winreglib.set(key, 'value', 1);
+			}
+
+			// 64 keys per 100ms tick
+			const before = winreglib.watchStats().polls;
+			await advance(500);
+			expect(winreglib.watchStats().polls - before).toBe(64);
+			await advance(100);
+			expect(winreglib.watchStats().polls - before).toBe(128);
+			await advance(100);
+			await advance(100);
+			expect(winreglib.watchStats().polls - before).toBe(200);
+			expect(changes).toBe(200);
+		} finally {
+			for (const handle of handles) {
+				handle.stop();
+			}
+			for (const key of keys) {
+				winreglib.delete(key);
+			}
+		}
+	});
+});
@@ -0,0 +1,76 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+describe('tryGet()', () => {
+	it('should error if key or value name is not specified', () => {
+		expect(() => winreglib.tryGet(undefined as any, 'foo')).toThrowError(
+			new TypeError('Expected key to be a non-empty string')
+		);
+		expect(() => winreglib.tryGet('HKCU\\Software', undefined as any)).toThrowError(
+			new TypeError('Expected value name to be a non-empty string')
+		);
+	});
+
+	it('should error if root is not valid', () => {
+		const err: Error & { code?: string } = new Error(
+			'Invalid registry root key "foo"'
+		);
+		err.code = 'ERR_WINREG_INVALID_ROOT';
+		expect(() => winreglib.tryGet('foo\\bar', 'baz')).toThrowError(err);
+	});
+
+	it('should return undefined for a missing key or value', () => {
+		const key = testKey();
+		winreglib.set(key, 'sz', 'hello');
+		winreglib.set(key, 'qword', 2n ** 60n, 'REG_QWORD');
+
+		expect(winreglib.tryGet(key, 'sz')).toBe('hello');
+		expect(winreglib.tryGet(key, 'qword', { bigint: true })).toBe(2n ** 60n);
+		expect(winreglib.tryGet(key, 'missing')).toBeUndefined();
+		expect(winreglib.tryGet(`${key}\\missing`, 'sz')).toBeUndefined();
+
+		winreglib.delete(key);
+	});
+});
+
+describe('has() and hasMany()', () => {
+	it('should error if arguments are invalid', () => {
+		expect(() => winreglib.has('')).toThrowError(
+			new TypeError('Expected key to be a non-empty string')
+		);
+		expect(() => winreglib.has('HKCU\\Software', 1 as any)).toThrowError(
+			new TypeError('Expected value name to be a string')
+		);
+		expect(() => winreglib.hasMany('HKCU\\Software', ['a', 1] as any)).toThrowError(
+			new TypeError('Expected value names to be an array of strings')
+		);
+	});
+
+	it('should check keys and values without throwing', () => {
+		const key = testKey();
+		winreglib.set(key, 'dword', 1);
+		winreglib.createKey(`${key}\\sub`);
+
+		expect(winreglib.has(key)).toBe(true);
+		expect(winreglib.has(`${key}\\sub`)).toBe(true);
+		expect(winreglib.has(`${key}\\missing`)).toBe(false);
+		expect(winreglib.has(key, 'dword')).toBe(true);
+		expect(winreglib.has(key, 'DWORD')).toBe(true);
+		expect(winreglib.has(key, '')).toBe(false);
+		expect(winreglib.has(key, 'missing')).toBe(false);
+		expect(winreglib.has(`${key}\\missing`, 'dword')).toBe(false);
+
+		expect(winreglib.hasMany(key, ['dword', 'missing', 'Dword'])).toEqual([
+			true,
+			false,
+			true
+		]);
+		expect(winreglib.hasMany(`${key}\\missing`, ['dword', ''])).toEqual([false, false]);
+		expect(winreglib.hasMany(key, [])).toEqual([]);
+
+		winreglib.delete(key);
+	});
+});
@@ -0,0 +1,168 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { testName, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+describe('query()', () => {
+	it('should error if pattern is not specified', async () => {
+		await expect(winreglib.query(undefined as any)).rejects.toThrowError(
+			new TypeError('Expected pattern to be a non-empty string')
+		);
+	});
+
+	it('should error if values is not an array of strings', async () => {
+		await expect(
+			winreglib.query('HKCU\\Software', { values: 'foo' as any })
+		).rejects.toThrowError(
+			new TypeError('Expected values to be an array of strings')
+		);
+	});
+
+	it('should error if the root is not valid', async () => {
+		const err: Error & { code?: string } = new Error(
+			'Invalid registry root key "foo*"'
+		);
+		err.code = 'ERR_WINREG_INVALID_ROOT';
+		await expect(winreglib.query('foo*\\bar')).rejects.toThrowError(err);
+	});
+
+	it('should error if an alternation is not closed', async () => {
+		const err: Error & { code?: string } = new Error(
+			'Unbalanced "{" in pattern'
+		);
+		err.code = 'ERR_WINREG_INVALID_PATTERN';
+		await expect(winreglib.query('HKCU\\{a,b')).rejects.toThrowError(err);
+	});
+
+	it('should read values from every matched uninstall key', async () => {
+		const name = testName();
+		const uninstall = 'Microsoft\\Windows\\CurrentVersion\\Uninstall';
+		winreglib.batch([
+			{ op: 'set', key: `HKLM\\Software\\${name}\\${uninstall}\\App1`, name: 'DisplayName', value: 'App 1' },
+			{ op: 'set', key: `HKLM\\Software\\${name}\\${uninstall}\\App1`, name: 'DisplayVersion', value: '1.0' },
+			{ op: 'set', key: `HKLM\\Software\\${name}\\WOW6432Node\\${uninstall}\\App2`, name: 'DisplayName', value: 'App 2' },
+			{ op: 'set', key: `HKCU\\Software\\${name}\\${uninstall}\\App3`, name: 'DisplayVersion', value: '3.0' },
+			{ op: 'set', key: `HKCU\\Software\\${name}\\${uninstall}\\App3`, name: 'Publisher', value: 'Someone' }
+		]);
+
+		const { rows } = await winreglib.query(
+			`HK*\\Software\\${name}\\{,WOW6432Node\\}${uninstall}\\*`,
+			{ values: ['DisplayName', 'DisplayVersion'] }
+		);
+
+		expect(rows).toEqual([
+			{
+				key: `HKEY_CURRENT_USER\\Software\\${name}\\${uninstall}\\App3`,
+				values: { DisplayVersion: '3.0' }
+			},
+			{
+				key: `HKEY_LOCAL_MACHINE\\Software\\${name}\\${uninstall}\\App1`,
+				values: { DisplayName: 'App 1', DisplayVersion: '1.0' }
+			},
+			{
+				key: `HKEY_LOCAL_MACHINE\\Software\\${name}\\WOW6432Node\\${uninstall}\\App2`,
+				values: { DisplayName: 'App 2' }
+			}
+		]);
+
+		winreglib.delete(`HKLM\\Software\\${name}`);
+		winreglib.delete(`HKCU\\Software\\${name}`);
+	});
+
+	it('should only open the keys the pattern names', async () => {
+		const key = `HKCU\\Software\\winreglib\\${testName()}`;
+		winreglib.batch([
+			{ op: 'createKey', key: `${key}\\a\\b\\c` },
+			...Array.from({ length: 100 }, (_, i) => ({
+				op: 'createKey' as const,
+				key: `${key}\\other-${i}\\b\\c`
+			}))
+		]);
+
+		const { rows, keys } = await winreglib.query(`${key}\\A\\B\\C`);
+		expect(rows).toEqual([{ key: `HKEY_CURRENT_USER${key.substring(4)}\\A\\B\\C`, values: {} }]);
+
+		// HKCU, Software, winreglib, the test key, a, b, and c
+		expect(keys).toBe(7);
+	});
+
+	it('should match names with * and ? case-insensitively', async () => {
+		const key = `HKCU\\Software\\winreglib\\${testName()}`;
+		winreglib.batch(
+			['App-1', 'app-2', 'App-10', 'Tool-1', 'App-beta'].map(name => ({
+				op: 'createKey' as const,
+				key: `${key}\\${name}`
+			}))
+		);
+
+		const names = async (pattern: string) =>
+			(await winreglib.query(`${key}\\${pattern}`)).rows.map(row =>
+				row.key.substring(row.key.lastIndexOf('\\') + 1)
+			);
+
+		expect(await names('APP-?')).toEqual(['App-1', 'app-2']);
+		expect(await names('*-1*')).toEqual(['App-1', 'App-10', 'Tool-1']);
+		expect(await names('{app,tool}-?')).toEqual(['App-1', 'app-2', 'Tool-1']);
+		expect(await names('*')).toHaveLength(5);
+	});
+
+	it('should match non-ASCII names with * and ? case-insensitively', async () => {
+		const key = `HKCU\\Software\\winreglib\\${testName()}`;
+		winreglib.batch(
+			['Ärger-1', 'Σπίτι', 'Дом'].map(name => ({
+				op: 'createKey' as const,
+				key: `${key}\\${name}`
+			}))
+		);
+
+		const names = async (pattern: string) =>
+			(await winreglib.query(`${key}\\${pattern}`)).rows.map(row =>
+				row.key.substring(row.key.lastIndexOf('\\') + 1)
+			);
+
+		expect(await names('äRGER-?')).toEqual(['Ärger-1']);
+		expect(await names('*ΊΤΙ')).toEqual(['Σπίτι']);
+		expect(await names('{д?м,σ*}')).toEqual(['Σπίτι', 'Дом']);
+		expect(await names('д?М')).toEqual(['Дом']);
+	});
+
+	it('should match any number of keys with **', async () => {
+		const key = `HKCU\\Software\\winreglib\\${testName()}`;
+		winreglib.batch([
+			{ op: 'createKey', key: `${key}\\Target` },
+			{ op: 'createKey', key: `${key}\\a\\Target\\b\\target` },
+			{ op: 'createKey', key: `${key}\\a\\b\\c\\Other` }
+		]);
+
+		const { rows } = await winreglib.query(`${key}\\**\\target`);
+		expect(rows.map(row => row.key.substring(key.length + 13))).toEqual([
+			'\\a\\Target',
+			'\\a\\Target\\b\\target',
+			'\\Target'
+		]);
+	});
+
+	it('should return a key matched by several alternatives once', async () => {
+		const key = `HKCU\\Software\\winreglib\\${testName()}`;
+		winreglib.createKey(`${key}\\Foo`);
+
+		const { rows } = await winreglib.query(`${key}\\{Foo,foo,F*,**\\Foo}`);
+		expect(rows).toHaveLength(1);
+	});
+
+	it('should read values by glob and the default value', async () => {
+		const key = `HKCU\\Software\\winreglib\\${testName()}`;
+		winreglib.batch([
+			{ op: 'set', key, name: 'DisplayName', value: 'App' },
+			{ op: 'set', key, name: 'DisplayIcon', value: 'app.ico' },
+			{ op: 'set', key, name: 'EstimatedSize', value: 42 }
+		]);
+
+		let { rows } = await winreglib.query(key, { values: ['display*'] });
+		expect(rows[0].values).toEqual({ DisplayName: 'App', DisplayIcon: 'app.ico' });
+
+		({ rows } = await winreglib.query(key, { values: ['EstimatedSize', 'Missing'] }));
+		expect(rows[0].values).toEqual({ EstimatedSize: 42 });
+	});
+});
@@ -0,0 +1,123 @@
+import { afterEach, describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { settle, testKey, useMemoryBackend } from './helpers/memory-backend.js';
+import { randomBytes } from 'node:crypto';
+import { rmSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+
+useMemoryBackend();
+
+const fullKey = (key: string) => `HKEY_CURRENT_USER${key.substring(4)}`;
+
+const files: string[] = [];
+const traceFile = () => {
+	const file = join(tmpdir(), `winreglib-${randomBytes(4).toString('hex')}.trace`);
+	files.push(file);
+	return file;
+};
+
+describe('startRecording() and replay()', () => {
+	afterEach(() => {
+		winreglib.stopRecording();
+		winreglib.setBackend('memory');
+		for (const file of files.splice(0)) {
+			rmSync(file, { force: true });
+		}
+	});
+
+	it('should error if file is not specified', () => {
+		expect(() => winreglib.startRecording(undefined as any)).toThrowError(
+			new TypeError('Expected file to be a non-empty string')
+		);
+		expect(() => winreglib.replay('')).toThrowError(
+			new TypeError('Expected file to be a non-empty string')
+		);
+	});
+
+	it('should error if speed is invalid', () => {
+		expect(() => winreglib.replay('foo', { speed: 'slow' as any })).toThrowError(
+			new TypeError('Invalid speed "slow"')
+		);
+	});
+
+	it('should error if the file is not a trace', () => {
+		const file = traceFile();
+		writeFileSync(file, 'not a trace');
+		const err: Error & { code?: string } = new Error('Invalid trace');
+		err.code = 'ERR_WINREG_INVALID_TRACE';
+		expect(() => winreglib.replay(file)).toThrowError(err);
+	});
+
+	it('should not change backends while recording', () => {
+		winreglib.startRecording(traceFile());
+		const err: Error & { code?: string } = new Error(
+			'Cannot change the registry backend while recording'
+		);
+		err.code = 'ERR_WINREG_BACKEND_BUSY';
+		expect(() => winreglib.setBackend('memory')).toThrowError(err);
+		expect(() => winreglib.startRecording(traceFile())).toThrowError('Already recording');
+	});
+
+	it('should replay reads without the registry', async () => {
+		const key = testKey();
+		winreglib.batch([
+			{ op: 'set', key, name: 'sz', value: 'hello' },
+			{ op: 'set', key, name: 'dword', value: 42 },
+			{ op: 'set', key: `${key}\\sub`, name: 'multi', value: ['a', 'b'] },
+			{ op: 'set', key: `${key}\\sub`, name: 'binary', value: Buffer.from([1, 2, 3]) }
+		]);
+
+		const read = async () => ({
+			sz: winreglib.get(key, 'sz'),
+			dword: winreglib.get(key, 'dword'),
+			list: winreglib.list(key),
+			scan: (await winreglib.scan(key)).root,
+			query: (await winreglib.query(`${key}\\*`, { values: ['*'] })).rows
+		});
+
+		const file = traceFile();
+		winreglib.startRecording(file);
+		const recorded = await read();
+		winreglib.stopRecording();
+
+		// the replay must not read the in-memory registry
+		winreglib.delete(key);
+
+		winreglib.replay(file);
+		expect(await read()).toEqual(recorded);
+
+		// calls that weren't recorded fail
+		expect(() => winreglib.get(key, 'missing')).toThrowError(/not found/);
+
+		// and repeated calls get the last recorded result
+		expect(await read()).toEqual(recorded);
+	});
+
+	it('should replay change notifications', async () => {
+		const key = testKey();
+		winreglib.createKey(key);
+
+		const watch = async () => {
+			const handle = winreglib.watch(key);
+			const events: unknown[] = [];
+			handle.on('change', evt => events.push(evt));
+			await settle(250);
+			winreglib.set(key, 'name', 'value');
+			await settle(250);
+			handle.stop();
+			return events;
+		};
+
+		const file = traceFile();
+		winreglib.startRecording(file);
+		const recorded = await watch();
+		winreglib.stopRecording();
+		expect(recorded).toEqual([{ type: 'change', key: fullKey(key) }]);
+
+		winreglib.delete(key);
+
+		winreglib.replay(file, { speed: 'recorded' });
+		expect(await watch()).toEqual(recorded);
+	});
+});
@@ -0,0 +1,220 @@
+import { afterEach, describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+// these tests run against the in-memory backend with a frozen clock so they work on every
+// platform and last write times are predictable
+const epoch = new Date('2024-01-01T00:00:00Z');
+useMemoryBackend();
+afterEach(() => winreglib.setMemoryClock());
+
+const populate = (key: string) => {
+	winreglib.batch([
+		{ op: 'set', key, name: 'sz', value: 'foo' },
+		{ op: 'set', key, name: 'dword', value: 42 },
+		{ op: 'set', key: `${key}\\a\\b`, name: 'x', value: 'y' },
+		{ op: 'set', key: `${key}\\a\\c`, name: 'x', value: 'z' },
+		{ op: 'set', key: `${key}\\d`, name: 'multi', value: ['1', '2'] }
+	]);
+};
+
+const child = (node: { subkeys: { name: string }[] }, name: string) =>
+	node.subkeys.find(subkey => subkey.name === name) as any;
+
+describe('info()', () => {
+	it('should error if key is not specified', () => {
+		expect(() => winreglib.info(undefined as any)).toThrowError(
+			new TypeError('Expected key to be a non-empty string')
+		);
+	});
+
+	it('should error if key is not found', () => {
+		const err: Error & { code?: string } = new Error(
+			'Registry key or value not found'
+		);
+		err.code = 'ERR_WINREG_NOT_FOUND';
+		expect(() => winreglib.info(testKey())).toThrowError(err);
+	});
+
+	it('should return the counts, lengths, and last write time', () => {
+		winreglib.setMemoryClock(epoch);
+		const key = testKey();
+		winreglib.batch([
+			{ op: 'set', key, name: 'name', value: 'data' },
+			{ op: 'set', key, name: 'longer-name', value: Buffer.alloc(100) },
+			{ op: 'createKey', key: `${key}\\subkey` }
+		]);
+
+		const info = winreglib.info(key);
+		expect(info).toEqual({
+			subkeys: 1,
+			values: 2,
+			maxSubkeyLength: 6,
+			maxValueNameLength: 11,
+			maxValueLength: 100,
+			lastWriteTime: epoch
+		});
+	});
+
+	it('should move the last write time when a value changes', () => {
+		winreglib.setMemoryClock(epoch);
+		const key = testKey();
+		winreglib.createKey(key);
+
+		const later = new Date(epoch.getTime() + 60_000);
+		winreglib.setMemoryClock(later);
+		winreglib.set(key, 'foo', 'bar');
+		expect(winreglib.info(key).lastWriteTime).toEqual(later);
+	});
+});
+
+describe('scan()', () => {
+	it('should error if key is not specified', async () => {
+		await expect(winreglib.scan(undefined as any)).rejects.toThrowError(
+			new TypeError('Expected key to be a non-empty string')
+		);
+	});
+
+	it('should read the whole tree', async () => {
+		winreglib.setMemoryClock(epoch);
+		const key = testKey();
+		populate(key);
+
+		const result = await winreglib.scan(key);
+		expect(result.keys).toBe(5);
+		expect(result.changed).toBe(5);
+		expect(result.skipped).toBe(0);
+		expect(result.root).toEqual({
+			name: key,
+			lastWriteTime: epoch,
+			values: [
+				{ name: 'dword', type: 'REG_DWORD', data: 42 },
+				{ name: 'sz', type: 'REG_SZ', data: 'foo' }
+			],
+			subkeys: [
+				{
+					name: 'a',
+					lastWriteTime: epoch,
+					values: [],
+					subkeys: [
+						{
+							name: 'b',
+							lastWriteTime: epoch,
+							values: [{ name: 'x', type: 'REG_SZ', data: 'y' }],
+							subkeys: []
+						},
+						{
+							name: 'c',
+							lastWriteTime: epoch,
+							values: [{ name: 'x', type: 'REG_SZ', data: 'z' }],
+							subkeys: []
+						}
+					]
+				},
+				{
+					name: 'd',
+					lastWriteTime: epoch,
+					values: [{ name: 'multi', type: 'REG_MULTI_SZ', data: ['1', '2'] }],
+					subkeys: []
+				}
+			]
+		});
+	});
+});
+
+describe('rescan()', () => {
+	it('should error if the previous result is invalid', async () => {
+		await expect(winreglib.rescan({} as any)).rejects.toThrowError(
+			new TypeError('Expected a result returned by scan() or rescan()')
+		);
+	});
+
+	it('should reuse the previous result when nothing changed', async () => {
+		winreglib.setMemoryClock(epoch);
+		const key = testKey();
+		populate(key);
+
+		const first = await winreglib.scan(key);
+		const second = await winreglib.rescan(first);
+		expect(second.keys).toBe(5);
+		expect(second.changed).toBe(0);
+		expect(second.root).toBe(first.root);
+	});
+
+	it('should only read keys whose last write time moved', async () => {
+		winreglib.setMemoryClock(epoch);
+		const key = testKey();
+		populate(key);
+		const first = await winreglib.scan(key);
+
+		winreglib.set(`${key}\\a\\c`, 'x', 'changed');
+		const second = await winreglib.rescan(first);
+		expect(second.changed).toBe(1);
+
+		// the changed key and its ancestors are new, everything else is reused
+		expect(second.root).not.toBe(first.root);
+		expect(second.root.values).toBe(first.root.values);
+		expect(child(second.root, 'd')).toBe(child(first.root, 'd'));
+		expect(child(child(second.root, 'a'), 'b')).toBe(child(child(first.root, 'a'), 'b'));
+		expect(child(child(second.root, 'a'), 'c').values).toEqual([
+			{ name: 'x', type: 'REG_SZ', data: 'changed' }
+		]);
+
+		// the first result is unchanged and can be rescanned again
+		expect(child(child(first.root, 'a'), 'c').values[0].data).toBe('z');
+		expect((await winreglib.rescan(first)).changed).toBe(1);
+	});
+
+	it('should pick up added and removed subkeys', async () => {
+		winreglib.setMemoryClock(epoch);
+		const key = testKey();
+		populate(key);
+		const first = await winreglib.scan(key);
+
+		winreglib.batch([
+			{ op: 'delete', key: `${key}\\a` },
+			{ op: 'set', key: `${key}\\d\\e`, name: 'new', value: 1 }
+		]);
+		const second = await winreglib.rescan(first);
+
+		// the root lost a subkey, d gained one, and e is new
+		expect(second.changed).toBe(3);
+		expect(second.keys).toBe(3);
+		expect(second.root.subkeys.map(subkey => subkey.name)).toEqual(['d']);
+		expect(child(second.root, 'd').values).toEqual(child(first.root, 'd').values);
+		expect(child(child(second.root, 'd'), 'e').values).toEqual([
+			{ name: 'new', type: 'REG_DWORD', data: 1 }
+		]);
+	});
+
+	it('should detect changes while the clock is frozen', async () => {
+		winreglib.setMemoryClock(epoch);
+		const key = testKey();
+		populate(key);
+
+		let result = await winreglib.scan(key);
+		for (let i = 0; i < 3; i++) {
+			winreglib.set(key, 'counter', i);
+			result = await winreglib.rescan(result);
+			expect(result.changed).toBe(1);
+			expect(result.root.values.find(value => value.name === 'counter')).toEqual({
+				name: 'counter',
+				type: 'REG_DWORD',
+				data: i
+			});
+		}
+	});
+
+	it('should error if the key was deleted', async () => {
+		const key = testKey();
+		populate(key);
+		const result = await winreglib.scan(key);
+		winreglib.delete(key);
+
+		const err: Error & { code?: string } = new Error(
+			'Registry key or value not found'
+		);
+		err.code = 'ERR_WINREG_NOT_FOUND';
+		await expect(winreglib.rescan(result)).rejects.toThrowError(err);
+	});
+});
@@ -0,0 +1,229 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { settle, testKey, useMemoryBackend } from './helpers/memory-backend.js';
+import { spawn } from 'node:child_process';
+import { randomBytes } from 'node:crypto';
+import { statSync } from 'node:fs';
+import { createRequire } from 'node:module';
+import { dirname } from 'node:path';
+import { fileURLToPath } from 'node:url';
+
+useMemoryBackend();
+
+const cwd = dirname(dirname(fileURLToPath(import.meta.url)));
+const nodeGypBuild = createRequire(import.meta.url).resolve(
+	'node-gyp-build/node-gyp-build.js'
+);
+
+const cacheName = () => `test-${randomBytes(4).toString('hex')}`;
+
+// the reader loads the binding directly and reads as fast as it can until the writer is done
+const readerSource = `
+const binding = require(process.argv[1])(process.argv[2]);
+const [name, key] = process.argv.slice(3);
+binding.init(() => {});
+const { cache } = binding.openSharedCache(name);
+const stats = { reads: 0, torn: 0, versions: new Set() };
+process.stdout.write('ready\\n');
+for (;;) {
+	const value = binding.readSharedCache(cache, key, 'blob');
+	if (value === 'done') {
+		break;
+	}
+	stats.reads++;
+	stats.versions.add(binding.sharedCacheVersion(cache));
+	if (value !== undefined && value !== value[0].repeat(value.length)) {
+		stats.torn++;
+	}
+}
+binding.closeSharedCache(cache);
+process.stdout.write(JSON.stringify({ ...stats, versions: stats.versions.size }) + '\\n');
+`;
+
+describe('publishSharedCache()', () => {
+	it('should error if options are invalid', () => {
+		expect(() =>
+			winreglib.publishSharedCache('HKCU\\Software', { name: '' })
+		).toThrowError(
+			new TypeError(
+				'Expected name to be a non-empty string of letters, digits, ".", "_", and "-"'
+			)
+		);
+		expect(() =>
+			winreglib.publishSharedCache('HKCU\\Software', { name: 'a/b' })
+		).toThrowError(TypeError);
+		expect(() =>
+			winreglib.publishSharedCache('HKCU\\Software', { name: 'a', size: 0 })
+		).toThrowError(new TypeError('Expected size to be a positive number'));
+		expect(() =>
+			winreglib.publishSharedCache(testKey(), { name: cacheName() })
+		).toThrowError('Registry key or value not found');
+	});
+
+	it('should serve a subtree from shared memory', () => {
+		const key = testKey();
+		const name = cacheName();
+		winreglib.set(key, 'greeting', 'hello');
+		winreglib.set(`${key}\\Sub`, 'count', 42);
+		winreglib.set(`${key}\\Sub`, 'list', ['a', 'b']);
+
+		const publisher = winreglib.publishSharedCache(key, { name, watch: false });
+		const cache = winreglib.openSharedCache(name);
+		try {
+			expect(cache.key).toBe(publisher.key);
+			expect(cache.get(key, 'greeting')).toBe('hello');
+			expect(cache.get(`${key}\\sub`, 'COUNT')).toBe(42);
+			expect(cache.get(`${key}\\Sub`, 'list')).toEqual(['a', 'b']);
+			expect(cache.get(key, 'missing')).toBeUndefined();
+			expect(cache.get(`${key}\\Missing`, 'count')).toBeUndefined();
+			expect(cache.list(key)).toEqual({
+				resolvedRoot: 'HKEY_CURRENT_USER',
+				key: key.replace('HKCU', 'HKEY_CURRENT_USER'),
+				subkeys: ['Sub'],
+				values: ['greeting']
+			});
+			expect(() => cache.get('HKCU\\Software', 'x')).toThrowError(
+				'Key "HKEY_CURRENT_USER\\Software" is not in the shared cache'
+			);
+			expect(() =>
+				winreglib.publishSharedCache(key, { name, watch: false })
+			).toThrowError(`Shared cache "${name}" is already published`);
+
+			const version = cache.version;
+			winreglib.set(key, 'greeting', 'bye');
+			winreglib.delete(`${key}\\Sub`);
+			winreglib.set(`${key}\\Other\\Deep`, 'x', 'y');
+			expect(cache.get(key, 'greeting')).toBe('hello');
+			publisher.refresh();
+			expect(cache.version).toBeGreaterThan(version);
+			expect(cache.get(key, 'greeting')).toBe('bye');
+			expect(cache.get(`${key}\\Sub`, 'count')).toBeUndefined();
+			expect(cache.list(`${key}\\Sub`)).toBeUndefined();
+			expect(cache.get(`${key}\\Other\\Deep`, 'x')).toBe('y');
+		} finally {
+			publisher.close();
+			winreglib.delete(key);
+		}
+
+		expect(() => cache.get(key, 'greeting')).toThrowError(
+			'The shared cache is no longer published'
+		);
+		cache.close();
+		expect(() => cache.list(key)).toThrowError('Shared cache has been closed');
+		expect(() => winreglib.openSharedCache(name)).toThrowError(
+			`Shared cache "${name}" is not published`
+		);
+	});
+
+	// POSIX shared memory objects are only visible as files on Linux
+	it.skipIf(process.platform !== 'linux')('should only let the publishing user open the segment', () => {
+		const key = testKey();
+		const name = cacheName();
+		winreglib.set(key, 'secret', 'value');
+
+		const publisher = winreglib.publishSharedCache(key, { name, watch: false });
+		try {
+			expect(statSync(`/dev/shm/winreglib-${name}`).mode & 0o777).toBe(0o600);
+		} finally {
+			publisher.close();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should follow changes with watching', async () => {
+		const key = testKey();
+		const name = cacheName();
+		winreglib.set(key, 'a', 1);
+
+		const publisher = winreglib.publishSharedCache(key, { name });
+		const cache = winreglib.openSharedCache(name);
+		try {
+			await settle(250);
+			winreglib.set(`${key}\\Child`, 'b', 2);
+			await settle(250);
+			expect(cache.list(key)?.subkeys).toEqual(['Child']);
+			expect(cache.get(`${key}\\Child`, 'b')).toBe(2);
+
+			// the new key is watched too
+			winreglib.set(`${key}\\Child`, 'b', 3);
+			await settle(250);
+			expect(cache.get(`${key}\\Child`, 'b')).toBe(3);
+
+			winreglib.delete(`${key}\\Child`);
+			await settle(250);
+			expect(cache.list(key)?.subkeys).toEqual([]);
+			expect(cache.get(`${key}\\Child`, 'b')).toBeUndefined();
+		} finally {
+			cache.close();
+			publisher.close();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should error when the subtree does not fit', () => {
+		const key = testKey();
+		winreglib.set(key, 'big', 'x'.repeat(8192));
+		try {
+			expect(() =>
+				winreglib.publishSharedCache(key, { name: cacheName(), size: 8192 })
+			).toThrowError('The shared subtree does not fit in the shared cache');
+		} finally {
+			winreglib.delete(key);
+		}
+	});
+
+	it('should never return torn reads to another process', async () => {
+		const key = testKey();
+		const name = cacheName();
+		winreglib.set(key, 'blob', 'a'.repeat(4096));
+
+		// small enough that the cache is rebuilt, overwriting entries in place, every few writes
+		const publisher = winreglib.publishSharedCache(key, {
+			name,
+			size: 64 * 1024,
+			watch: false
+		});
+
+		try {
+			const child = spawn(process.execPath, [
+				'-e',
+				readerSource,
+				nodeGypBuild,
+				cwd,
+				name,
+				key
+			]);
+			let output = '';
+			const ready = new Promise<void>((resolve, reject) => {
+				child.stdout.on('data', chunk => {
+					output += chunk;
+					if (output.startsWith('ready\n')) {
+						resolve();
+					}
+				});
+				child.once('error', reject);
+			});
+			const exited = new Promise<number | null>(resolve =>
+				child.once('exit', code => resolve(code))
+			);
+			await ready;
+
+			// write for long enough that the reader is preempted in the middle of reads
+			const end = Date.now() + 1000;
+			for (let i = 0; Date.now() < end; i++) {
+				winreglib.set(key, 'blob', (i % 2 ? 'a' : 'b').repeat(4096));
+				publisher.refresh(key);
+			}
+			winreglib.set(key, 'blob', 'done');
+			publisher.refresh(key);
+
+			expect(await exited).toBe(0);
+			const stats = JSON.parse(output.split('\n')[1]);
+			expect(stats.reads).toBeGreaterThan(0);
+			expect(stats.torn).toBe(0);
+		} finally {
+			publisher.close();
+			winreglib.delete(key);
+		}
+	});
+});
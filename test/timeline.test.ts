@@ -0,0 +1,166 @@
+import { afterEach, describe, expect, it } from 'vitest';
+import winreglib, { type WinRegLibWatchHandle } from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+afterEach(() => winreglib.stopTimeline());
+
+type TraceEvent = {
+	ph: string;
+	name: string;
+	cat?: string;
+	pid: number;
+	tid: number;
+	ts?: number;
+	dur?: number;
+	id?: number;
+	args?: { name?: string; detail?: string };
+};
+
+// listeners are called before their spans end and the monitor thread may still be finishing
+// its own, so give both a moment before exporting
+const nextChange = (handle: WinRegLibWatchHandle) =>
+	new Promise((resolve, reject) => {
+		const timer = setTimeout(
+			() => reject(new Error('Timed out waiting for a change')),
+			5000
+		);
+		handle.once('change', () => {
+			clearTimeout(timer);
+			setTimeout(resolve, 50);
+		});
+	});
+
+const exportEvents = (): TraceEvent[] =>
+	JSON.parse(winreglib.exportTimeline()).traceEvents;
+
+describe('startTimeline()', () => {
+	it('should error if options are invalid', () => {
+		expect(() => winreglib.startTimeline({ capacity: 0 })).toThrowError(
+			new TypeError('Expected capacity to be a positive integer')
+		);
+		expect(() => winreglib.startTimeline({ capacity: 1.5 })).toThrowError(
+			TypeError
+		);
+		expect(() => winreglib.exportTimeline('')).toThrowError(
+			new TypeError('Expected file to be a non-empty string')
+		);
+	});
+
+	it('should record registry calls made by get() and list()', () => {
+		const key = testKey();
+		winreglib.set(key, 'value', 'data');
+		winreglib.set(`${key}\\Child`, 'x', 1);
+		try {
+			winreglib.startTimeline();
+			winreglib.get(key, 'value');
+			winreglib.list(key);
+
+			const events = exportEvents();
+			const spans = events.filter(e => e.ph === 'X');
+			const names = spans.map(e => e.name);
+			for (const name of [
+				'get',
+				'list',
+				'RegGetValue',
+				'RegOpenKeyEx',
+				'RegQueryInfoKey',
+				'RegEnumKeyEx',
+				'RegEnumValue',
+				'RegCloseKey'
+			]) {
+				expect(names).toContain(name);
+			}
+
+			// the registry calls are nested in the call that made them
+			const list = spans.find(e => e.name === 'list')!;
+			const open = spans.find(e => e.name === 'RegOpenKeyEx')!;
+			expect(list.cat).toBe('api');
+			expect(list.args?.detail).toBe(key);
+			expect(open.tid).toBe(list.tid);
+			expect(open.ts).toBeGreaterThanOrEqual(list.ts!);
+			expect(open.ts! + open.dur!).toBeLessThanOrEqual(list.ts! + list.dur!);
+
+			const thread = events.find(e => e.ph === 'M' && e.tid === list.tid);
+			expect(thread?.args?.name).toBe('JavaScript');
+		} finally {
+			winreglib.delete(key);
+		}
+	});
+
+	it('should keep the most recent spans of each thread', () => {
+		const key = testKey();
+		winreglib.set(key, 'value', 'data');
+		try {
+			winreglib.startTimeline({ capacity: 10 });
+			for (let i = 0; i < 100; i++) {
+				winreglib.get(key, 'value');
+			}
+			winreglib.list(key);
+
+			const spans = exportEvents().filter(e => e.ph === 'X');
+			expect(spans.length).toBeLessThanOrEqual(10);
+			expect(spans.length).toBeGreaterThan(5);
+			expect(spans.map(e => e.name)).toContain('list');
+		} finally {
+			winreglib.delete(key);
+		}
+	});
+
+	it('should connect change notifications to listeners with flows', async () => {
+		const key = testKey();
+		winreglib.createKey(key);
+		winreglib.startTimeline();
+		const handle = winreglib.watch(key);
+		try {
+			const changed = nextChange(handle);
+			winreglib.set(key, 'value', 'data');
+			await changed;
+
+			const events = exportEvents();
+			const spans = events.filter(e => e.ph === 'X');
+			const names = spans.map(e => e.name);
+			for (const name of [
+				'WatchNode::load',
+				'WatchNode::watch',
+				'WaitForMultipleObjects',
+				'Monitor::wake',
+				'Watchman::signal',
+				'Watchman::dispatch',
+				'WatchNode::onChange',
+				'listener'
+			]) {
+				expect(names).toContain(name);
+			}
+
+			const listener = spans.find(e => e.name === 'listener')!;
+			// long key names keep their tail
+			expect(listener.args?.detail).toBe(
+				key.replace('HKCU', 'HKEY_CURRENT_USER').slice(-48)
+			);
+
+			// the flow starts on the monitor thread and ends at the listener on this thread
+			const end = events.find(e => e.ph === 'f' && e.tid === listener.tid)!;
+			expect(end).toBeDefined();
+			const start = events.find(e => e.ph === 's' && e.id === end.id)!;
+			expect(start).toBeDefined();
+			expect(start.tid).not.toBe(end.tid);
+			expect(
+				events.find(e => e.ph === 'M' && e.tid === start.tid)?.args?.name
+			).toBe('winreglib monitor');
+			expect(start.ts).toBeLessThanOrEqual(end.ts!);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should discard spans when stopped', () => {
+		winreglib.startTimeline();
+		winreglib.info('HKCU\\Software');
+		winreglib.list('HKCU\\Software');
+		winreglib.stopTimeline();
+		winreglib.list('HKCU\\Software');
+		expect(exportEvents().filter(e => e.ph === 'X')).toEqual([]);
+	});
+});
@@ -0,0 +1,103 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { settle, testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+const createTree = () => {
+	const key = testKey();
+	winreglib.batch([
+		{ op: 'set', key, name: 'name', value: 'winreglib' },
+		{ op: 'set', key, name: 'count', value: 3 },
+		{ op: 'set', key: `${key}\\Settings`, name: 'theme', value: 'dark' },
+		{ op: 'set', key: `${key}\\Settings\\Fonts`, name: 'sizes', value: ['10', '12'] },
+		{ op: 'set', key: `${key}\\Other`, name: 'unused', value: 1 }
+	]);
+	return key;
+};
+
+describe('view()', () => {
+	it('should error if key is invalid', () => {
+		expect(() => winreglib.view('')).toThrowError(
+			new TypeError('Expected key to be a non-empty string')
+		);
+		expect(() => winreglib.view(`${testKey()}\\missing`)).toThrowError(
+			'Registry key or value not found'
+		);
+	});
+
+	it('should read values and subkeys on demand', () => {
+		const key = createTree();
+		const view = winreglib.view(key, { watch: false });
+		expect(winreglib.viewStats(view).faults).toBe(1);
+
+		expect(view.name).toBe('winreglib');
+		expect(view.COUNT).toBe(3);
+		expect(view.missing).toBeUndefined();
+
+		const settings = view.Settings as any;
+		expect(settings.theme).toBe('dark');
+		expect(settings.fonts.sizes).toEqual(['10', '12']);
+		expect(view.settings).toBe(settings);
+
+		expect(Object.keys(view).sort()).toEqual(['Other', 'Settings', 'count', 'name']);
+		expect('theme' in settings).toBe(true);
+		expect('Fonts' in settings).toBe(true);
+		expect('nope' in settings).toBe(false);
+
+		// the Other key was never read and everything else comes from the cache
+		const { faults } = winreglib.viewStats(view);
+		expect(view.name).toBe('winreglib');
+		expect(settings.fonts.sizes).toEqual(['10', '12']);
+		expect(view.missing).toBeUndefined();
+		expect(winreglib.viewStats(view).faults).toBe(faults);
+
+		expect(() => {
+			(view as any).name = 'foo';
+		}).toThrowError(new TypeError('Registry views are read-only'));
+
+		winreglib.closeView(view);
+		winreglib.delete(key);
+	});
+
+	it('should not see changes when not watching', () => {
+		const key = createTree();
+		const view = winreglib.view(key, { watch: false });
+		expect(view.name).toBe('winreglib');
+		winreglib.set(key, 'name', 'changed');
+		expect(view.name).toBe('winreglib');
+		winreglib.closeView(view);
+		winreglib.delete(key);
+	});
+
+	it('should refresh keys that change', async () => {
+		const key = createTree();
+		const view = winreglib.view(key);
+		const settings = view.Settings as any;
+		expect(view.name).toBe('winreglib');
+		expect(settings.theme).toBe('dark');
+		expect(view.added).toBeUndefined();
+		await settle(250);
+
+		winreglib.batch([
+			{ op: 'set', key, name: 'name', value: 'changed' },
+			{ op: 'set', key: `${key}\\Settings`, name: 'theme', value: 'light' },
+			{ op: 'createKey', key: `${key}\\added` }
+		]);
+		await settle(250);
+
+		expect(view.name).toBe('changed');
+		expect(settings.theme).toBe('light');
+		expect(view.added).toBeTypeOf('object');
+		expect(Object.keys(view)).toContain('added');
+
+		winreglib.delete(`${key}\\Settings`);
+		await settle(250);
+		expect(view.Settings).toBeUndefined();
+		expect(settings.theme).toBeUndefined();
+
+		winreglib.closeView(view);
+		expect(() => view.name).toThrowError('View has been closed');
+		winreglib.delete(key);
+	});
+});
@@ -0,0 +1,99 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { nextEvents, settle, testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+describe('watchMany()', () => {
+	it('should watch many keys with one handle', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		const keys = Array.from({ length: 100 }, (_, i) => `${key}\\Key${i}\\Sub`);
+		for (const k of keys) {
+			winreglib.createKey(k);
+		}
+		const before = winreglib.watchStats();
+		const handle = await winreglib.watchMany(keys);
+		try {
+			// the parents, the key, each KeyN, and each Sub
+			expect(winreglib.watchStats()).toEqual({
+				...before,
+				keys: before.keys + 3 + 200,
+				handles: before.handles + 3 + 200
+			});
+
+			const events = nextEvents(handle, 2);
+			winreglib.set(keys[0], 'value', 1);
+			winreglib.set(keys[99], 'value', 1);
+			expect((await events).sort()).toEqual([
+				`change ${keys[0]}`,
+				`change ${keys[99]}`
+			]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+
+		await settle();
+		expect(winreglib.watchStats()).toEqual(before);
+	});
+
+	it('should wait for keys that do not exist yet', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(`${key}\\A`);
+		const before = winreglib.watchStats();
+		const handle = await winreglib.watchMany([
+			`${key}\\A`,
+			`${key}\\B\\C`,
+			`${key}\\A`
+		]);
+		try {
+			// a key listed twice is only notified once
+			const events = nextEvents(handle, 2);
+			winreglib.set(`${key}\\A`, 'value', 1);
+			await settle();
+			winreglib.createKey(`${key}\\B\\C`);
+			expect(await events).toEqual([`change ${key}\\A`, `add ${key}\\B\\C`]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+
+		await settle();
+		expect(winreglib.watchStats()).toEqual(before);
+	});
+
+	it('should watch patterns alongside keys', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(`${key}\\Services\\A`);
+		winreglib.createKey(`${key}\\Other`);
+		const before = winreglib.watchStats();
+		const handle = await winreglib.watchMany(
+			[`${key}\\Services\\*`, `${key}\\Other`],
+			{ pattern: true }
+		);
+		try {
+			const events = nextEvents(handle, 2);
+			winreglib.set(`${key}\\Services\\A`, 'value', 1);
+			winreglib.set(`${key}\\Other`, 'value', 1);
+			expect((await events).sort()).toEqual([
+				`change ${key}\\Other`,
+				`change ${key}\\Services\\A`
+			]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+
+		await settle();
+		expect(winreglib.watchStats()).toEqual(before);
+	});
+
+	it('should error if a key is invalid', async () => {
+		await expect(winreglib.watchMany(['HKCU\\Software', ''])).rejects.toThrowError(
+			new TypeError('Expected keys to be an array of non-empty strings')
+		);
+		await expect(winreglib.watchMany(['HKCU\\Software', 'foo'])).rejects.toThrowError(
+			new Error('Expected key to contain both a root and subkey')
+		);
+	});
+});
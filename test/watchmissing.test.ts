@@ -0,0 +1,111 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { settle, testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+describe('watch() on missing keys', () => {
+	it('should only emit once the missing key itself is created', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(key);
+
+		const handle = winreglib.watch(`${key}\\foo\\bar\\baz`);
+		const events: unknown[] = [];
+		handle.on('change', evt => events.push(evt));
+
+		try {
+			winreglib.createKey(`${key}\\unrelated`);
+			winreglib.createKey(`${key}\\foo`);
+			winreglib.set(`${key}\\foo`, 'name', 'value');
+			await settle(250);
+			winreglib.createKey(`${key}\\foo\\bar`);
+			await settle(250);
+			expect(events).toEqual([]);
+
+			winreglib.createKey(`${key}\\foo\\bar\\baz`);
+			await settle(250);
+			expect(events).toEqual([{ type: 'add', key: `${key}\\foo\\bar\\baz` }]);
+
+			winreglib.set(`${key}\\foo\\bar\\baz`, 'name', 'value');
+			await settle(250);
+			expect(events).toEqual([
+				{ type: 'add', key: `${key}\\foo\\bar\\baz` },
+				{ type: 'change', key: `${key}\\foo\\bar\\baz` }
+			]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should emit when the whole missing chain is created at once', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(key);
+
+		const handle = winreglib.watch(`${key}\\foo\\bar\\baz`);
+		const events: unknown[] = [];
+		handle.on('change', evt => events.push(evt));
+
+		try {
+			winreglib.createKey(`${key}\\foo\\bar\\baz`);
+			await settle(250);
+			expect(events).toEqual([{ type: 'add', key: `${key}\\foo\\bar\\baz` }]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should go back to waiting when an ancestor is deleted', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(`${key}\\foo\\bar`);
+
+		const handle = winreglib.watch(`${key}\\foo\\bar`);
+		const events: unknown[] = [];
+		handle.on('change', evt => events.push(evt));
+
+		try {
+			winreglib.delete(`${key}\\foo`);
+			await settle(250);
+			expect(events).toEqual([{ type: 'delete', key: `${key}\\foo\\bar` }]);
+
+			winreglib.createKey(`${key}\\foo`);
+			await settle(250);
+			expect(events).toHaveLength(1);
+
+			winreglib.createKey(`${key}\\foo\\bar`);
+			await settle(250);
+			expect(events).toEqual([
+				{ type: 'delete', key: `${key}\\foo\\bar` },
+				{ type: 'add', key: `${key}\\foo\\bar` }
+			]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should see value changes once an intermediate key is watched', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(key);
+
+		// the first watch only tracks foo for bar being created
+		const barHandle = winreglib.watch(`${key}\\foo\\bar`);
+		winreglib.createKey(`${key}\\foo`);
+		await settle(250);
+
+		const fooHandle = winreglib.watch(`${key}\\foo`);
+		const events: unknown[] = [];
+		fooHandle.on('change', evt => events.push(evt));
+
+		try {
+			winreglib.set(`${key}\\foo`, 'name', 'value');
+			await settle(250);
+			expect(events).toEqual([{ type: 'change', key: `${key}\\foo` }]);
+		} finally {
+			barHandle.stop();
+			fooHandle.stop();
+			winreglib.delete(key);
+		}
+	});
+});
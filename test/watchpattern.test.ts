@@ -0,0 +1,127 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { nextEvents, settle, testKey, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+describe('watch() patterns', () => {
+	it('should watch every subkey a wildcard matches', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(`${key}\\Services\\A\\Parameters`);
+		winreglib.createKey(`${key}\\Services\\B`);
+		const before = winreglib.watchStats();
+		const handle = winreglib.watch(`${key}\\Services\\*\\Parameters`, { pattern: true });
+		try {
+			// the parents, Services, A and B, and their Parameters, which B does not have yet
+			expect(winreglib.watchStats().keys).toBe(before.keys + 8);
+
+			let events = nextEvents(handle, 1);
+			winreglib.set(`${key}\\Services\\A\\Parameters`, 'value', 1);
+			expect(await events).toEqual([
+				`change ${key}\\Services\\A\\Parameters`
+			]);
+
+			// a service that appears is matched, a key a pattern names is waited for
+			events = nextEvents(handle, 2);
+			winreglib.createKey(`${key}\\Services\\C\\Parameters`);
+			winreglib.createKey(`${key}\\Services\\B\\Parameters`);
+			expect((await events).sort()).toEqual([
+				`add ${key}\\Services\\B\\Parameters`,
+				`add ${key}\\Services\\C\\Parameters`
+			]);
+
+			// a service that is deleted is no longer watched
+			events = nextEvents(handle, 1);
+			winreglib.delete(`${key}\\Services\\C`);
+			expect(await events).toEqual([
+				`delete ${key}\\Services\\C\\Parameters`
+			]);
+			await settle();
+			expect(winreglib.watchStats().keys).toBe(before.keys + 8);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+
+		await settle();
+		expect(winreglib.watchStats()).toEqual(before);
+	});
+
+	it('should watch a subtree with a recursive wildcard', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(key);
+		const before = winreglib.watchStats();
+		const handle = winreglib.watch(`${key}\\**`, { pattern: true });
+		try {
+			// the key the pattern starts at matches too, so it changes when a subkey is added
+			let events = nextEvents(handle, 4);
+			winreglib.createKey(`${key}\\a\\b\\c`);
+			expect(await events).toEqual([
+				`change ${key}`,
+				`add ${key}\\a`,
+				`add ${key}\\a\\b`,
+				`add ${key}\\a\\b\\c`
+			]);
+
+			events = nextEvents(handle, 2);
+			winreglib.set(`${key}\\a\\b\\c`, 'value', 1);
+			winreglib.set(key, 'value', 1);
+			expect((await events).sort()).toEqual([
+				`change ${key}`,
+				`change ${key}\\a\\b\\c`
+			]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+
+		await settle();
+		expect(winreglib.watchStats()).toEqual(before);
+	});
+
+	it('should share keys between patterns and literal watches', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(`${key}\\Uninstall\\App`);
+		const handle = winreglib.watch(`${key}\\Uninstall\\*`, { pattern: true });
+		const literal = winreglib.watch(`${key}\\Uninstall\\App`);
+		try {
+			const events = Promise.all([
+				nextEvents(handle, 1),
+				nextEvents(literal, 1)
+			]);
+			winreglib.set(`${key}\\Uninstall\\App`, 'DisplayName', 'App');
+			expect(await events).toEqual([
+				[`change ${key}\\Uninstall\\App`],
+				[`change ${key}\\Uninstall\\App`]
+			]);
+
+			// the literal watch keeps the key after the pattern stops
+			handle.stop();
+			const changed = nextEvents(literal, 1);
+			winreglib.set(`${key}\\Uninstall\\App`, 'DisplayName', 'App 2');
+			expect(await changed).toEqual([`change ${key}\\Uninstall\\App`]);
+		} finally {
+			handle.stop();
+			literal.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should watch keys named * literally unless patterns are enabled', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(`${key}\\*\\shellex`);
+		winreglib.createKey(`${key}\\txtfile\\shellex`);
+		const handle = winreglib.watch(`${key}\\*\\shellex`);
+		try {
+			// only the key named * is watched, the changes to its sibling aren't seen
+			const events = nextEvents(handle, 1);
+			winreglib.set(`${key}\\txtfile\\shellex`, 'value', 1);
+			await settle();
+			winreglib.set(`${key}\\*\\shellex`, 'value', 1);
+			expect(await events).toEqual([`change ${key}\\*\\shellex`]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+});
@@ -0,0 +1,212 @@
+import { afterEach, describe, expect, it } from 'vitest';
+import winreglib, { type WatchStats } from '../src/index.js';
+import { settle, testKey, testName, useMemoryBackend } from './helpers/memory-backend.js';
+import { randomBytes } from 'node:crypto';
+
+useMemoryBackend();
+
+// changes every key while holding the event loop, like a busy JS thread, until the monitor
+// thread has queued all of the notifications
+const storm = (keys: string[], done: (stats: WatchStats) => boolean, quiet = false) => {
+	winreglib.batch(
+		keys.map(key => ({
+			op: 'set' as const,
+			key,
+			name: 'value',
+			value: randomBytes(4).toString('hex')
+		})),
+		{ quiet }
+	);
+	const deadline = Date.now() + 5000;
+	while (!done(winreglib.watchStats())) {
+		if (Date.now() > deadline) {
+			throw new Error('Timed out waiting for the notifications to be queued');
+		}
+	}
+};
+
+describe('setWatchQueue()', () => {
+	afterEach(() => winreglib.setWatchQueue());
+
+	it('should set aside keys that change while the queue is full', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		const keys = Array.from({ length: 50 }, (_, i) => `${key}\\Key${i}`);
+		for (const k of keys) {
+			winreglib.createKey(k);
+		}
+		const handle = await winreglib.watchMany(keys);
+		const events: string[] = [];
+		handle.on('change', evt => events.push(`${evt.type} ${evt.key}`));
+		try {
+			winreglib.setWatchQueue({ capacity: 10 });
+			const before = winreglib.watchStats();
+			storm(keys, stats => stats.queued === 50);
+			await settle();
+
+			const stats = winreglib.watchStats();
+			expect(stats.overflowed - before.overflowed).toBe(40);
+			expect(stats.dropped - before.dropped).toBe(0);
+			expect(stats.queued).toBe(0);
+			expect(events.sort()).toEqual(keys.map(k => `change ${k}`).sort());
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should drop the events of the oldest keys', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		const keys = Array.from({ length: 50 }, (_, i) => `${key}\\Key${i}`);
+		for (const k of keys) {
+			winreglib.createKey(k);
+		}
+		const handle = await winreglib.watchMany(keys);
+		const events: string[] = [];
+		handle.on('change', evt => events.push(`${evt.type} ${evt.key}`));
+		try {
+			winreglib.setWatchQueue({ capacity: 10, overflow: 'drop-oldest' });
+			const before = winreglib.watchStats();
+			storm(keys, stats => stats.overflowed - before.overflowed === 40);
+			await settle();
+
+			// the monitor thread may pick up the notifications in any order
+			expect(winreglib.watchStats().dropped - before.dropped).toBe(40);
+			expect(new Set(events).size).toBe(10);
+			const missed = keys.filter(k => !events.includes(`change ${k}`));
+			expect(missed.length).toBe(40);
+
+			// a key whose events were dropped is still notified of the next change
+			events.length = 0;
+			winreglib.set(missed[0], 'value', 'again');
+			await settle();
+			expect(events).toEqual([`change ${missed[0]}`]);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should notify a dropped key that changes again before it is dispatched', async () => {
+		// polled keys are checked by the main thread, so the dropped key can change again before
+		// anything is dispatched
+		let clock = Date.UTC(2024, 0, 1);
+		winreglib.setMemoryClock(clock);
+		const key = `HKEY_PERFORMANCE_DATA\\${testName()}`;
+		const keys = [`${key}\\A`, `${key}\\B`];
+		for (const k of keys) {
+			winreglib.createKey(k);
+		}
+		const handle = await winreglib.watchMany(keys);
+		const events: string[] = [];
+		handle.on('change', evt => events.push(`${evt.type} ${evt.key}`));
+		try {
+			winreglib.setWatchQueue({ capacity: 1, overflow: 'drop-oldest' });
+			const before = winreglib.watchStats();
+			winreglib.set(keys[0], 'value', 1);
+			winreglib.setMemoryClock((clock += 1000));
+			winreglib.set(keys[1], 'value', 1);
+			winreglib.setMemoryClock((clock += 1000));
+			expect(winreglib.watchStats().dropped - before.dropped).toBe(1);
+
+			winreglib.set(keys[0], 'value', 2);
+			winreglib.setMemoryClock((clock += 1000));
+			await settle();
+			expect(events.sort()).toEqual(keys.map(k => `change ${k}`));
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+			winreglib.setMemoryClock();
+		}
+	});
+
+	it('should collapse an overflowing queue into resync events', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		// every 11th change collapses the queue, so all 55 are resynced
+		const keys = Array.from({ length: 54 }, (_, i) => `${key}\\Key${i}`);
+		for (const k of keys) {
+			winreglib.createKey(k);
+		}
+		const handle = winreglib.watch(`${key}\\**`, { pattern: true });
+		const other = winreglib.watch(keys[25]);
+		const events: string[] = [];
+		const others: string[] = [];
+		handle.on('change', evt => events.push(`${evt.type} ${evt.key}`));
+		other.on('change', evt => others.push(`${evt.type} ${evt.key}`));
+		try {
+			winreglib.setWatchQueue({ capacity: 10, overflow: 'resync' });
+			const before = winreglib.watchStats();
+			storm([key, ...keys], stats => stats.queued === 55);
+			await settle();
+
+			// the pattern re-reads its whole subtree, the other handle only its key
+			expect(winreglib.watchStats().dropped - before.dropped).toBe(55);
+			expect(events).toEqual([`resync ${key}`]);
+			expect(others).toEqual([`resync ${keys[25]}`]);
+		} finally {
+			handle.stop();
+			other.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should resync keys changed by a quiet batch', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		const keys = Array.from({ length: 12 }, (_, i) => `${key}\\Key${i}`);
+		for (const k of keys) {
+			winreglib.createKey(k);
+		}
+		const handle = winreglib.watch(`${key}\\**`, { pattern: true });
+		const events: string[] = [];
+		handle.on('change', evt => events.push(`${evt.type} ${evt.key}`));
+		try {
+			winreglib.setWatchQueue({ capacity: 10, overflow: 'resync' });
+			storm(keys, stats => stats.queued === 12, true);
+			await settle();
+
+			// the writes themselves are muted, the resync of the 11 keys that overflowed is not
+			expect(events.length).toBe(11);
+			expect(events.every(evt => evt.startsWith('resync '))).toBe(true);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should coalesce repeated changes of a queued key', async () => {
+		// polled keys are checked by the main thread, so two polls can find changes before the
+		// first one is dispatched
+		let clock = Date.UTC(2024, 0, 1);
+		winreglib.setMemoryClock(clock);
+		const key = `HKEY_PERFORMANCE_DATA\\${testName()}`;
+		winreglib.createKey(key);
+		const handle = winreglib.watch(key);
+		const events: string[] = [];
+		handle.on('change', evt => events.push(evt.type));
+		try {
+			const before = winreglib.watchStats();
+			winreglib.set(key, 'value', 1);
+			winreglib.setMemoryClock((clock += 1000));
+			winreglib.set(key, 'value', 2);
+			winreglib.setMemoryClock((clock += 1000));
+
+			const stats = winreglib.watchStats();
+			expect(stats.queued).toBe(1);
+			expect(stats.coalesced - before.coalesced).toBe(1);
+			await settle();
+			expect(events).toEqual(['change']);
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+			winreglib.setMemoryClock();
+		}
+	});
+
+	it('should error if the options are invalid', () => {
+		expect(() => winreglib.setWatchQueue({ capacity: 0 })).toThrowError(
+			new TypeError('Expected capacity to be a positive integer')
+		);
+		expect(() => winreglib.setWatchQueue({ overflow: 'foo' as any })).toThrowError(
+			new TypeError('Expected overflow to be "coalesce", "drop-oldest", or "resync"')
+		);
+	});
+});
@@ -0,0 +1,98 @@
+import { afterEach, describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { nextEvents, settle, testName, useMemoryBackend } from './helpers/memory-backend.js';
+
+useMemoryBackend();
+
+// nodes that stopped being watched are freed once the monitor thread lets go of them
+afterEach(() => settle());
+
+describe('watchStats()', () => {
+	it('should count watched keys and their handles', async () => {
+		const name = testName();
+		const key = `HKCU\\Software\\winreglib\\${name}`;
+		winreglib.createKey(key);
+		const before = winreglib.watchStats();
+		const handle = winreglib.watch(`${key}\\Missing`);
+		try {
+			// Software, winreglib, and the key are open, the missing subkey is not
+			expect(winreglib.watchStats()).toEqual({
+				...before,
+				keys: before.keys + 4,
+				handles: before.handles + 3
+			});
+		} finally {
+			handle.stop();
+			winreglib.delete(key);
+		}
+
+		await settle();
+		expect(winreglib.watchStats()).toEqual(before);
+	});
+
+	it('should share one node between spellings of the same key', async () => {
+		const name = testName();
+		const key = `HKCU\\Software\\winreglib\\${name}`;
+		winreglib.createKey(key);
+		const before = winreglib.watchStats();
+
+		const a = winreglib.watch(key);
+		const after = winreglib.watchStats();
+		const b = winreglib.watch(
+			`HKEY_CURRENT_USER\\SOFTWARE\\WinRegLib\\${name.toUpperCase()}`
+		);
+		const c = winreglib.watch(
+			`HKCU\\software\\winreglib\\${name.toLowerCase()}`
+		);
+		try {
+			expect(after.keys).toBe(before.keys + 3);
+			expect(winreglib.watchStats()).toEqual(after);
+
+			// every handle is notified, with the key spelled the way it was first watched
+			const changes = Promise.all([a, b, c].map(handle => nextEvents(handle, 1)));
+			winreglib.set(key, 'value', 'data');
+			for (const events of await changes) {
+				expect(events).toEqual([`change ${key.replace('HKCU', 'HKEY_CURRENT_USER')}`]);
+			}
+
+			// the node stays until the last spelling stops watching
+			a.stop();
+			b.stop();
+			expect(winreglib.watchStats()).toEqual(after);
+		} finally {
+			a.stop();
+			b.stop();
+			c.stop();
+			winreglib.delete(key);
+		}
+	});
+
+	it('should share one node between spellings of a non-ASCII key', async () => {
+		// the registry uppercases each character on its own regardless of the locale
+		const name = `${testName()}-Äöü-Σπίτι-Дом`;
+		const key = `HKCU\\Software\\winreglib\\${name}`;
+		winreglib.createKey(key);
+		const before = winreglib.watchStats();
+
+		const a = winreglib.watch(key);
+		const after = winreglib.watchStats();
+		const b = winreglib.watch(`HKCU\\Software\\winreglib\\${name.toUpperCase()}`);
+		const c = winreglib.watch(`HKCU\\Software\\winreglib\\${name.toLowerCase()}`);
+		try {
+			expect(after.keys).toBe(before.keys + 3);
+			expect(winreglib.watchStats()).toEqual(after);
+			expect(winreglib.list(`HKCU\\Software\\winreglib\\${name.toLowerCase()}`)).toBeTruthy();
+
+			const changes = Promise.all([a, b, c].map(handle => nextEvents(handle, 1)));
+			winreglib.set(key, 'value', 'data');
+			for (const events of await changes) {
+				expect(events).toEqual([`change ${key.replace('HKCU', 'HKEY_CURRENT_USER')}`]);
+			}
+		} finally {
+			a.stop();
+			b.stop();
+			c.stop();
+			winreglib.delete(key);
+		}
+	});
+});
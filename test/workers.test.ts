@@ -0,0 +1,147 @@
+import { describe, expect, it } from 'vitest';
+import winreglib from '../src/index.js';
+import { testKey, useMemoryBackend } from './helpers/memory-backend.js';
+import { createRequire } from 'node:module';
+import { dirname } from 'node:path';
+import { fileURLToPath } from 'node:url';
+import { Worker } from 'node:worker_threads';
+
+useMemoryBackend();
+
+const cwd = dirname(dirname(fileURLToPath(import.meta.url)));
+const nodeGypBuild = createRequire(import.meta.url).resolve(
+	'node-gyp-build/node-gyp-build.js'
+);
+
+// workers load the binding directly, each one gets its own watcher state and log channel
+const workerSource = `
+const { parentPort, workerData } = require('node:worker_threads');
+const binding = require(workerData.nodeGypBuild)(workerData.cwd);
+const { key, changes } = workerData;
+const events = [];
+
+// watching doesn't keep the event loop alive
+const keepAlive = setInterval(() => {}, 1000);
+
+binding.init(() => {});
+binding.batch([{ op: 'createKey', key }], false, false);
+
+const write = () => binding.batch([{ op: 'set', key, name: 'counter', type: 4, value: events.length }], false, false);
+const listener = (type, evt) => {
+	events.push(evt.key);
+	if (events.length < changes) {
+		setTimeout(write, 10);
+	} else {
+		binding.unwatch(key, listener);
+		clearInterval(keepAlive);
+		parentPort.postMessage(events);
+	}
+};
+binding.watch(key, listener);
+setTimeout(write, 10);
+`;
+
+const runWorker = (key: string, changes: number) =>
+	new Promise<string[]>((resolve, reject) => {
+		const worker = new Worker(workerSource, {
+			eval: true,
+			workerData: { cwd, nodeGypBuild, key, changes }
+		});
+		worker.once('message', resolve);
+		worker.once('error', reject);
+		worker.once('exit', code => {
+			if (code !== 0) {
+				reject(new Error(`Worker exited with code ${code}`));
+			}
+		});
+	});
+
+describe('workers', () => {
+	it('should watch keys independently in each worker', async () => {
+		const keys = Array.from({ length: 4 }, () => testKey('HKEY_CURRENT_USER'));
+		const results = await Promise.all(keys.map(key => runWorker(key, 3)));
+
+		for (let i = 0; i < keys.length; i++) {
+			expect(results[i]).toEqual(Array(3).fill(keys[i]));
+		}
+	});
+
+	it('should keep watching in the main thread after a worker is terminated', async () => {
+		const key = testKey('HKEY_CURRENT_USER');
+		winreglib.createKey(key);
+
+		const handle = winreglib.watch(key);
+		try {
+			const worker = new Worker(
+				`${workerSource}\nrequire('node:worker_threads').parentPort.postMessage('ready');`,
+				{
+					eval: true,
+					workerData: {
+						cwd,
+						nodeGypBuild,
+						key: testKey('HKEY_CURRENT_USER'),
+						changes: Infinity
+					}
+				}
+			);
+			await new Promise(resolve => worker.once('message', resolve));
+			await worker.terminate();
+
+			const evt = await new Promise((resolve, reject) => {
+				const timer = setTimeout(() => reject(new Error('Timed out')), 2000);
+				handle.once('change', evt => {
+					clearTimeout(timer);
+					resolve(evt);
+				});
+				winreglib.set(key, 'foo', 'bar');
+			});
+			expect(evt).toEqual({ type: 'change', key });
+		} finally {
+			handle.stop();
+		}
+	});
+
+	it('should watch more keys than one wait can hold', async () => {
+		// a wait holds 64 handles, so the monitor spreads these across several threads
+		const key = testKey('HKEY_CURRENT_USER');
+		const keys = Array.from({ length: 200 }, (_, i) => `${key}\\Key${i}`);
+		for (const k of keys) {
+			winreglib.createKey(k);
+		}
+
+		const changed = (watched: string[]) =>
+			new Promise<string[]>((resolve, reject) => {
+				const events: string[] = [];
+				const timer = setTimeout(() => reject(new Error(`Timed out after ${events.length} events`)), 5000);
+				const listeners = watched.map(k => {
+					const handle = winreglib.watch(k);
+					handle.on('change', () => {
+						events.push(k);
+						if (events.length === watched.length) {
+							clearTimeout(timer);
+							for (const h of listeners) {
+								h.stop();
+							}
+							resolve(events);
+						}
+					});
+					return handle;
+				});
+				setTimeout(() => {
+					for (const k of watched) {
+						winreglib.set(k, 'foo', 'bar');
+					}
+				}, 50);
+			});
+
+		try {
+			expect((await changed(keys)).sort()).toEqual([...keys].sort());
+
+			// fewer keys leaves threads with nothing to wait on
+			const few = keys.slice(0, 70);
+			expect((await changed(few)).sort()).toEqual([...few].sort());
+		} finally {
+			winreglib.delete(key);
+		}
+	});
+});
@@ -3,6 +3,9 @@ import { defineConfig } from 'vitest/config';
 export default defineConfig({
 	test: {
 		allowOnly: true,
+		benchmark: {
+			include: ['bench/**/*.bench.ts']
+		},
 		coverage: {
 			include: ['src/**/*.ts'],
 			reporter: ['html', 'lcov', 'text']